@@ -73,20 +73,17 @@ if (arity == fixed + {n}) \{
     lean_assert(arity > {max});
     obj * as[{n}] = \{ {args} };
     obj ** args = static_cast<obj**>(LEAN_ALLOCA(arity*sizeof(obj*))); // NOLINT
-    for (unsigned i = 0; i < fixed; i++) \{ lean_inc(fx(i)); args[i] = fx(i); }
+    void * fn = take_fixed_args(f, args);
     for (unsigned i = 0; i < {n}; i++) args[fixed+i] = as[i];
-    obj * r = FNN(f)(args);
-    lean_dec_ref(f);
-    return r;
+    return reinterpret_cast<fnn>(fn)(args);
   }
 } else if (arity < fixed + {n}) \{\n"
   if n ≥ 2 then do
     emit  s!"  obj * as[{n}] = \{ {args} };
   obj ** args = static_cast<obj**>(LEAN_ALLOCA(arity*sizeof(obj*))); // NOLINT
-  for (unsigned i = 0; i < fixed; i++) \{ lean_inc(fx(i)); args[i] = fx(i); }
+  void * fn = take_fixed_args(f, args);
   for (unsigned i = 0; i < arity-fixed; i++) args[fixed+i] = as[i];
-  obj * new_f = curry(f, arity, args);
-  lean_dec_ref(f);
+  obj * new_f = curry(fn, arity, args);
   return lean_apply_n(new_f, {n}+fixed-arity, &as[arity-fixed]);\n"
   else emit s!"  lean_assert(fixed < arity);
   lean_unreachable();\n"
@@ -104,8 +101,7 @@ case 0: lean_unreachable();\n"
     emit  s!"case {i+1}: return reinterpret_cast<fn{i+1}>(f)({as});\n"
   emit "default: return reinterpret_cast<fnn>(f)(as);
 }
-}
-static obj* curry(obj* f, unsigned n, obj** as) { return curry(lean_closure_fun(f), n, as); }\n"
+}\n"
 
 def mkApplyN (max : Nat) : M Unit := do
   emit "extern \"C\" LEAN_EXPORT obj* lean_apply_n(obj* f, unsigned n, obj** as) {
@@ -126,17 +122,14 @@ unsigned arity = lean_closure_arity(f);
 unsigned fixed = lean_closure_num_fixed(f);
 if (arity == fixed + n) \{
   obj ** args = static_cast<obj**>(LEAN_ALLOCA(arity*sizeof(obj*))); // NOLINT
-  for (unsigned i = 0; i < fixed; i++) \{ lean_inc(fx(i)); args[i] = fx(i); }
+  void * fn = take_fixed_args(f, args);
   for (unsigned i = 0; i < n; i++) args[fixed+i] = as[i];
-  obj * r = FNN(f)(args);
-  lean_dec_ref(f);
-  return r;
+  return reinterpret_cast<fnn>(fn)(args);
 } else if (arity < fixed + n) \{
   obj ** args = static_cast<obj**>(LEAN_ALLOCA(arity*sizeof(obj*))); // NOLINT
-  for (unsigned i = 0; i < fixed; i++) \{ lean_inc(fx(i)); args[i] = fx(i); }
+  void * fn = take_fixed_args(f, args);
   for (unsigned i = 0; i < arity-fixed; i++) args[fixed+i] = as[i];
-  obj * new_f = FNN(f)(args);
-  lean_dec_ref(f);
+  obj * new_f = curry(fn, arity, args);
   return lean_apply_n(new_f, n+fixed-arity, &as[arity-fixed]);
 } else \{
   return fix_args(f, n, as);
@@ -149,7 +142,22 @@ static obj* fix_args(obj* f, unsigned n, obj*const* as) {
     unsigned fixed = lean_closure_num_fixed(f);
     unsigned new_fixed = fixed + n;
     lean_assert(new_fixed < arity);
-    obj * r = lean_alloc_closure(lean_closure_fun(f), arity, new_fixed);
+    if (lean_is_exclusive(f) && lean_small_object_size(f) >= sizeof(lean_closure_object) + sizeof(void*)*new_fixed) {
+        /* `f` was created by `fix_args` with room for more arguments, we extend it in place. */
+        obj ** target = lean_closure_arg_cptr(f) + fixed;
+        for (unsigned i = 0; i < n; i++, as++, target++) {
+            *target = *as;
+        }
+        lean_to_closure(f)->m_num_fixed = new_fixed;
+        return f;
+    }
+    /* Reserve room for a few more arguments, partial applications are often applied again to an argument at a time. */
+    unsigned capacity = std::min(arity - 1, new_fixed + LEAN_CLOSURE_EXTRA_ARGS);
+    obj * r = lean_alloc_small_object(sizeof(lean_closure_object) + sizeof(void*)*capacity);
+    lean_set_st_header(r, LeanClosure, 0);
+    lean_to_closure(r)->m_fun       = lean_closure_fun(f);
+    lean_to_closure(r)->m_arity     = arity;
+    lean_to_closure(r)->m_num_fixed = new_fixed;
     obj ** source = lean_closure_arg_cptr(f);
     obj ** target = lean_closure_arg_cptr(r);
     if (!lean_is_exclusive(f)) {
@@ -170,6 +178,21 @@ static obj* fix_args(obj* f, unsigned n, obj*const* as) {
     return r;
 }
 
+/* Store the fixed arguments of `f` in `args`, consume `f`, and return its function pointer.
+   The arguments are moved if `f` is exclusive. */
+static inline void* take_fixed_args(obj* f, obj** args) {
+    void * fn = lean_closure_fun(f);
+    unsigned fixed = lean_closure_num_fixed(f);
+    if (lean_is_exclusive(f)) {
+        for (unsigned i = 0; i < fixed; i++) args[i] = fx(i);
+        lean_free_small_object(f);
+    } else {
+        for (unsigned i = 0; i < fixed; i++) { lean_inc(fx(i)); args[i] = fx(i); }
+        lean_dec_ref(f);
+    }
+    return fn;
+}
+
 static inline obj* fix_args(obj* f, std::initializer_list<obj*> const & l) {
     return fix_args(f, l.size(), l.begin());
 }
@@ -187,7 +210,13 @@ def mkApplyCpp (max : Nat) : M Unit := do
   mkCopyright
   emit "// DO NOT EDIT, this is an automatically generated file
 // Generated using script: ../../gen/apply.lean
+#include <algorithm>
 #include \"runtime/apply.h\"
+
+#ifndef LEAN_CLOSURE_EXTRA_ARGS
+#define LEAN_CLOSURE_EXTRA_ARGS 2
+#endif
+
 namespace lean {
 #define obj lean_object
 #define fx(i) lean_closure_arg_cptr(f)[i]\n"
@@ -133,6 +133,13 @@ def pop (a : Array α) : Array α := {
   data := a.data.dropLast
 }
 
+/--
+Make sure that `a` has capacity for at least `n` more elements, so that pushing them does not reallocate
+the array. The contents of the array are not changed.
+-/
+@[extern "lean_array_reserve"]
+def reserve (a : Array α) (n : @& Nat) : Array α := a
+
 def shrink (a : Array α) (n : Nat) : Array α :=
   let rec loop
     | 0,   a => a
@@ -429,6 +436,25 @@ def foldr {α : Type u} {β : Type v} (f : α → β → β) (init : β) (as : A
 def map {α : Type u} {β : Type v} (f : α → β) (as : Array α) : Array β :=
   Id.run <| as.mapM f
 
+/--
+`as.parMap f` is `as.map f`, but blocks of consecutive elements are mapped in parallel by the current thread and
+the workers of the task manager. Only a few tasks are created, irrespective of the size of the array, so this is
+also efficient when `f` is cheap.
+-/
+@[extern "lean_array_par_map"]
+def parMap {α : Type u} {β : Type v} (f : α → β) (as : Array α) : Array β :=
+  as.map f
+
+/--
+`as.parFoldl f combine init` folds blocks of consecutive elements of `as` in parallel using `f`, starting each of
+them with `init`, and then combines the results of the blocks from left to right using `combine`.
+It is equal to `as.foldl f init` if `combine` is associative with neutral element `init`, and
+`f (combine b c) a = combine b (f c a)`. For example, `as.parFoldl (· + ·) (· + ·) 0` sums the elements of `as`.
+-/
+@[extern "lean_array_par_foldl"]
+def parFoldl {α : Type u} {β : Type v} (f : β → α → β) (combine : β → β → β) (init : β) (as : Array α) : β :=
+  as.foldl f init
+
 @[inline]
 def mapIdx {α : Type u} {β : Type v} (as : Array α) (f : Fin as.size → α → β) : Array β :=
   Id.run <| as.mapIdxM f
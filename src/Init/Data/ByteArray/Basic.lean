@@ -80,6 +80,13 @@ instance : Hashable ByteArray where
 def isEmpty (s : ByteArray) : Bool :=
   s.size == 0
 
+@[extern "lean_byte_array_beq"]
+protected def beq (a b : @& ByteArray) : Bool :=
+  a.data == b.data
+
+instance : BEq ByteArray where
+  beq := ByteArray.beq
+
 /--
   Copy the slice at `[srcOff, srcOff + len)` in `src` to `[destOff, destOff + len)` in `dest`, growing `dest` if necessary.
   If `exact` is `false`, the capacity will be doubled when grown. -/
@@ -112,6 +119,20 @@ partial def toList (bs : ByteArray) : List UInt8 :=
       none
   loop start
 
+/-- The index of the first occurrence of `b` in `a` at or after `start`. It is implemented natively using `memchr`. -/
+@[extern "lean_byte_array_index_of"]
+def indexOf? (a : @& ByteArray) (b : UInt8) (start : @& Nat := 0) : Option Nat :=
+  a.findIdx? (· == b) start
+
+/-- The index of the first occurrence of `pat` as a slice of `a` at or after `start`. -/
+@[extern "lean_byte_array_find"]
+def find? (a : @& ByteArray) (pat : @& ByteArray) (start : @& Nat := 0) : Option Nat :=
+  if start ≤ a.size then
+    (List.range (a.size + 1 - start)).find? (fun i => (a.extract (start + i) (start + i + pat.size)) == pat)
+      |>.map (start + ·)
+  else
+    none
+
 /--
   We claim this unsafe implementation is correct because an array cannot have more than `usizeSz` elements in our runtime.
   This is similar to the `Array` version.
@@ -162,6 +162,77 @@ def foldlM {β : Type v} {m : Type v → Type w} [Monad m] (f : β → Float →
 def foldl {β : Type v} (f : β → Float → β) (init : β) (as : FloatArray) (start := 0) (stop := as.size) : β :=
   Id.run <| as.foldlM f init start stop
 
+/-!
+Bulk operations, which are implemented natively by loops that the C compiler can vectorize.
+Elementwise operations truncate their result to the size of the smallest argument, and update their first argument
+in place if it is not shared.
+-/
+
+/-- Apply `f` to the elements of `a` and `b` with the same index. -/
+@[inline]
+def zipWith (f : Float → Float → Float) (a b : FloatArray) : FloatArray :=
+  let n := min a.size b.size
+  n.fold (fun i r => r.push (f (a.get! i) (b.get! i))) (mkEmpty n)
+
+/-- Elementwise sum. -/
+@[extern "lean_float_array_add"]
+def add (a : FloatArray) (b : @& FloatArray) : FloatArray :=
+  zipWith (· + ·) a b
+
+/-- Elementwise difference. -/
+@[extern "lean_float_array_sub"]
+def sub (a : FloatArray) (b : @& FloatArray) : FloatArray :=
+  zipWith (· - ·) a b
+
+/-- Elementwise product. -/
+@[extern "lean_float_array_mul"]
+def mul (a : FloatArray) (b : @& FloatArray) : FloatArray :=
+  zipWith (· * ·) a b
+
+/-- `a.mulAdd b c` is the array of `a[i] * b[i] + c[i]`. -/
+@[extern "lean_float_array_mul_add"]
+def mulAdd (a : FloatArray) (b c : @& FloatArray) : FloatArray :=
+  zipWith (· + ·) (zipWith (· * ·) a b) c
+
+/--
+Sum of `f i` for `i < n`. The terms are added up in four partial sums, of the terms whose index is `0`, `1`, `2`,
+and `3` modulo `4` respectively, so that the native implementations can add them up in parallel using SIMD
+instructions.
+-/
+@[inline] private def laneSum (n : Nat) (f : Nat → Float) : Float :=
+  let s := n.fold (init := (0, 0, 0, 0)) fun i (s : Float × Float × Float × Float) =>
+    match i % 4 with
+    | 0 => (s.1 + f i, s.2.1, s.2.2.1, s.2.2.2)
+    | 1 => (s.1, s.2.1 + f i, s.2.2.1, s.2.2.2)
+    | 2 => (s.1, s.2.1, s.2.2.1 + f i, s.2.2.2)
+    | _ => (s.1, s.2.1, s.2.2.1, s.2.2.2 + f i)
+  (s.1 + s.2.1) + (s.2.2.1 + s.2.2.2)
+
+/-- Sum of the elements, see `laneSum` for the order of the additions. -/
+@[extern "lean_float_array_sum"]
+def sum (a : @& FloatArray) : Float :=
+  laneSum a.size a.get!
+
+/-- Dot product, see `laneSum` for the order of the additions. -/
+@[extern "lean_float_array_dot"]
+def dot (a b : @& FloatArray) : Float :=
+  laneSum (min a.size b.size) fun i => a.get! i * b.get! i
+
+/-- The smallest element, or `none` if `a` is empty. -/
+@[extern "lean_float_array_min"]
+def min? (a : @& FloatArray) : Option Float :=
+  if a.isEmpty then none else some (a.foldl (fun m x => if x < m then x else m) (a.get! 0) 1)
+
+/-- The largest element, or `none` if `a` is empty. -/
+@[extern "lean_float_array_max"]
+def max? (a : @& FloatArray) : Option Float :=
+  if a.isEmpty then none else some (a.foldl (fun m x => if m < x then x else m) (a.get! 0) 1)
+
+/-- The elements with index in `[b, e)`. -/
+@[extern "lean_float_array_extract"]
+def extract (a : @& FloatArray) (b e : @& Nat) : FloatArray :=
+  ⟨a.data.extract b e⟩
+
 end FloatArray
 
 def List.toFloatArray (ds : List Float) : FloatArray :=
@@ -117,6 +117,22 @@ private structure SpaceResult where
     let r₂ := r₂ (w - r₁.space);
     { r₂ with space := r₁.space + r₂.space }
 
+/--
+Measures `text s` up to its first line break. The scan stops as soon as more than `w` characters have been seen:
+callers only compare the result against the remaining width, so the exact length of an overflowing string does not
+matter, and this keeps the lookahead of a group bounded by the line width instead of by the size of the text.
+-/
+private partial def spaceUptoLineText (s : String) (flatten : Bool) (w : Nat) (p : String.Pos := 0) (space : Nat := 0) :
+    SpaceResult :=
+  if s.atEnd p then
+    { space }
+  else if s.get p == '\n' then
+    { foundLine := true, foundFlattenedHardLine := flatten, space }
+  else if space > w then
+    { space }
+  else
+    spaceUptoLineText s flatten w (s.next p) (space + 1)
+
 private def spaceUptoLine : Format → Bool → Int → Nat → SpaceResult
   | nil,          _,       _, _ => {}
   | line,         flatten, _, _ => if flatten then { space := 1 } else { foundLine := true }
@@ -126,10 +142,7 @@ private def spaceUptoLine : Format → Bool → Int → Nat → SpaceResult
       { space := (m - w).toNat }
     else
       { foundLine := true }
-  | text s,       flatten, _, _ =>
-    let p := s.posOf '\n'
-    let off := s.offsetOfPos p
-    { foundLine := p != s.endPos, foundFlattenedHardLine := flatten && p != s.endPos, space := off }
+  | text s,       flatten, _, w => spaceUptoLineText s flatten w
   | append f₁ f₂, flatten, m, w => merge w (spaceUptoLine f₁ flatten m w) (spaceUptoLine f₂ flatten m)
   | nest n f,     flatten, m, w => spaceUptoLine f flatten (m - n) w
   | group f _,    _,       m, w => spaceUptoLine f true m w
@@ -295,7 +308,7 @@ private structure State where
 instance : MonadPrettyFormat (StateM State) where
   -- We avoid a structure instance update, and write these functions using pattern matching because of issue #316
   pushOutput s       := modify fun ⟨out, col⟩ => ⟨out ++ s, col + s.length⟩
-  pushNewline indent := modify fun ⟨out, _⟩ => ⟨out ++ "\n".pushn ' ' indent, indent⟩
+  pushNewline indent := modify fun ⟨out, _⟩ => ⟨(out.push '\n').pushn ' ' indent, indent⟩
   currColumn         := return (← get).column
   startTag _         := return ()
   endTags _          := return ()
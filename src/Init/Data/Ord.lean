@@ -180,6 +180,17 @@ instance [Ord α] : Ord (Option α) where
   | some _, none   => .gt
   | some x, some y => compare x y
 
+/-- The lexicographic order on byte arrays. -/
+@[extern "lean_byte_array_compare"]
+protected def ByteArray.compare (a b : @& ByteArray) : Ordering :=
+  (List.range (min a.size b.size)).foldr (init := compare a.size b.size) fun i r =>
+    match compare (a.get! i) (b.get! i) with
+    | .eq => r
+    | o   => o
+
+instance : Ord ByteArray where
+  compare := ByteArray.compare
+
 /-- The lexicographic order on pairs. -/
 def lexOrd [Ord α] [Ord β] : Ord (α × β) where
   compare := compareLex (compareOn (·.1)) (compareOn (·.2))
@@ -159,10 +159,15 @@ protected def _root_.USize.repr (n : @& USize) : String :=
 private def reprArray : Array String := Id.run do
   List.range 128 |>.map (·.toUSize.repr) |> Array.mk
 
+/-- Decimal representation of big numbers, computed natively by the bignum library. -/
+@[extern "lean_nat_big_repr"]
+private def reprBig (n : @& Nat) : String :=
+  (toDigits 10 n).asString
+
 private def reprFast (n : Nat) : String :=
   if h : n < 128 then Nat.reprArray.get ⟨n, h⟩ else
   if h : n < USize.size then (USize.ofNatCore n h).repr
-  else (toDigits 10 n).asString
+  else reprBig n
 
 @[implemented_by reprFast]
 protected def repr (n : Nat) : String :=
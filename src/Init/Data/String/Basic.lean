@@ -69,6 +69,15 @@ Example: `"abc".append "def" = "abcdef"`
 def append : String → (@& String) → String
   | ⟨a⟩, ⟨b⟩ => ⟨a ++ b⟩
 
+/--
+Returns `s` unchanged, but makes sure that `n` more bytes can be added to it by `push` and `append`
+without reallocating, as long as the result is not shared. This is useful when the size of a string
+built by repeated appends is known in advance. A shared `s` is copied.
+-/
+@[extern "lean_string_reserve"]
+def reserve (s : String) (_n : @& Nat) : String :=
+  s
+
 /--
 Converts a string to a list of characters.
 
@@ -335,7 +344,8 @@ theorem prev_lt_of_pos (s : String) (i : Pos) (h : i ≠ 0) : (s.prev i).1 < i.1
   simp [prev, h]
   exact utf8PrevAux_lt_of_pos _ _ _ h
 
-def posOfAux (s : String) (c : Char) (stopPos : Pos) (pos : Pos) : Pos :=
+@[extern "lean_string_pos_of_aux"]
+def posOfAux (s : @& String) (c : Char) (stopPos : @& Pos) (pos : @& Pos) : Pos :=
   if h : pos < stopPos then
     if s.get pos == c then pos
     else
@@ -521,13 +531,23 @@ def pushn (s : String) (c : Char) (n : Nat) : String :=
 def isEmpty (s : String) : Bool :=
   s.endPos == 0
 
-def join (l : List String) : String :=
+/--
+Concatenates a list of strings. The native implementation computes the size of the result first
+and copies each string once.
+-/
+@[extern "lean_string_join"]
+def join (l : @& List String) : String :=
   l.foldl (fun r s => r ++ s) ""
 
 def singleton (c : Char) : String :=
   "".push c
 
-def intercalate (s : String) : List String → String
+/--
+Concatenates a list of strings, with `s` between each two of them. The native implementation computes
+the size of the result first and copies each string once.
+-/
+@[extern "lean_string_intercalate"]
+def intercalate (s : @& String) : (@& List String) → String
   | []      => ""
   | a :: as => go a s as
 where go (acc : String) (s : String) : List String → String
@@ -773,9 +793,15 @@ termination_by s.endPos.1 - i.1
 def isNat (s : String) : Bool :=
   !s.isEmpty && s.all (·.isDigit)
 
+/-- Interpret the characters of `s` as decimal digits. Implemented natively, using the bignum library for long
+strings. -/
+@[extern "lean_string_dec_to_nat"]
+def decToNat (s : @& String) : Nat :=
+  s.foldl (fun n c => n*10 + (c.toNat - '0'.toNat)) 0
+
 def toNat? (s : String) : Option Nat :=
   if s.isNat then
-    some <| s.foldl (fun n c => n*10 + (c.toNat - '0'.toNat)) 0
+    some s.decToNat
   else
     none
 
@@ -801,7 +827,8 @@ def isPrefixOf (p : String) (s : String) : Bool :=
   substrEq p 0 s 0 p.endPos.byteIdx
 
 /-- Replace all occurrences of `pattern` in `s` with `replacement`. -/
-def replace (s pattern replacement : String) : String :=
+@[extern "lean_string_replace"]
+def replace (s pattern replacement : @& String) : String :=
   if h : pattern.endPos.1 = 0 then s
   else
     have hPatt := Nat.zero_lt_of_ne_zero h
@@ -13,7 +13,7 @@ namespace String
 Panics if the string is not a string of digits. -/
 def toNat! (s : String) : Nat :=
   if s.isNat then
-    s.foldl (fun n c => n*10 + (c.toNat - '0'.toNat)) 0
+    s.decToNat
   else
     panic! "Nat expected"
 
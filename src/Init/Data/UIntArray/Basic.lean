@@ -0,0 +1,667 @@
+/-
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+-/
+prelude
+import Init.Data.Array.Basic
+import Init.Data.UInt.Basic
+import Init.Data.Option.Basic
+universe u
+
+/-!
+Arrays of unsigned integers, which are stored unboxed like `ByteArray` and `FloatArray`: each element occupies
+2, 4, 8, or `System.Platform.numBits / 8` bytes, instead of a pointer to an object for `Array UInt64`, for
+example. The declarations are the same for all of them.
+-/
+
+structure UInt16Array where
+  data : Array UInt16
+
+attribute [extern "lean_uint16_array_mk"] UInt16Array.mk
+attribute [extern "lean_uint16_array_data"] UInt16Array.data
+
+namespace UInt16Array
+@[extern "lean_mk_empty_uint16_array"]
+def mkEmpty (c : @& Nat) : UInt16Array :=
+  { data := #[] }
+
+def empty : UInt16Array :=
+  mkEmpty 0
+
+instance : Inhabited UInt16Array where
+  default := empty
+
+instance : EmptyCollection UInt16Array where
+  emptyCollection := UInt16Array.empty
+
+@[extern "lean_uint16_array_push"]
+def push : UInt16Array → UInt16 → UInt16Array
+  | ⟨ds⟩, b => ⟨ds.push b⟩
+
+@[extern "lean_uint16_array_size"]
+def size : (@& UInt16Array) → Nat
+  | ⟨ds⟩ => ds.size
+
+@[extern "lean_uint16_array_uget"]
+def uget : (a : @& UInt16Array) → (i : USize) → i.toNat < a.size → UInt16
+  | ⟨ds⟩, i, h => ds[i]
+
+@[extern "lean_uint16_array_fget"]
+def get : (ds : @& UInt16Array) → (@& Fin ds.size) → UInt16
+  | ⟨ds⟩, i => ds.get i
+
+@[extern "lean_uint16_array_get"]
+def get! : (@& UInt16Array) → (@& Nat) → UInt16
+  | ⟨ds⟩, i => ds.get! i
+
+def get? (ds : UInt16Array) (i : Nat) : Option UInt16 :=
+  if h : i < ds.size then
+    ds.get ⟨i, h⟩
+  else
+    none
+
+instance : GetElem UInt16Array Nat UInt16 fun xs i => i < xs.size where
+  getElem xs i h := xs.get ⟨i, h⟩
+
+instance : LawfulGetElem UInt16Array Nat UInt16 fun xs i => i < xs.size where
+
+instance : GetElem UInt16Array USize UInt16 fun xs i => i.val < xs.size where
+  getElem xs i h := xs.uget i h
+
+instance : LawfulGetElem UInt16Array USize UInt16 fun xs i => i.val < xs.size where
+
+@[extern "lean_uint16_array_uset"]
+def uset : (a : UInt16Array) → (i : USize) → UInt16 → i.toNat < a.size → UInt16Array
+  | ⟨ds⟩, i, v, h => ⟨ds.uset i v h⟩
+
+@[extern "lean_uint16_array_fset"]
+def set : (ds : UInt16Array) → (@& Fin ds.size) → UInt16 → UInt16Array
+  | ⟨ds⟩, i, d => ⟨ds.set i d⟩
+
+@[extern "lean_uint16_array_set"]
+def set! : UInt16Array → (@& Nat) → UInt16 → UInt16Array
+  | ⟨ds⟩, i, d => ⟨ds.set! i d⟩
+
+def isEmpty (s : UInt16Array) : Bool :=
+  s.size == 0
+
+partial def toList (ds : UInt16Array) : List UInt16 :=
+  let rec loop (i r) :=
+    if h : i < ds.size then
+      loop (i+1) (ds.get ⟨i, h⟩ :: r)
+    else
+      r.reverse
+  loop 0 []
+
+/--
+  We claim this unsafe implementation is correct because an array cannot have more than `usizeSz` elements in our runtime.
+  This is similar to the `Array` version.
+-/
+-- TODO: avoid code duplication in the future after we improve the compiler.
+@[inline] unsafe def forInUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (as : UInt16Array) (b : β) (f : UInt16 → β → m (ForInStep β)) : m β :=
+  let sz := USize.ofNat as.size
+  let rec @[specialize] loop (i : USize) (b : β) : m β := do
+    if i < sz then
+      let a := as.uget i lcProof
+      match (← f a b) with
+      | ForInStep.done  b => pure b
+      | ForInStep.yield b => loop (i+1) b
+    else
+      pure b
+  loop 0 b
+
+/-- Reference implementation for `forIn` -/
+@[implemented_by UInt16Array.forInUnsafe]
+protected def forIn {β : Type v} {m : Type v → Type w} [Monad m] (as : UInt16Array) (b : β) (f : UInt16 → β → m (ForInStep β)) : m β :=
+  let rec loop (i : Nat) (h : i ≤ as.size) (b : β) : m β := do
+    match i, h with
+    | 0,   _ => pure b
+    | i+1, h =>
+      have h' : i < as.size            := Nat.lt_of_lt_of_le (Nat.lt_succ_self i) h
+      have : as.size - 1 < as.size     := Nat.sub_lt (Nat.zero_lt_of_lt h') (by decide)
+      have : as.size - 1 - i < as.size := Nat.lt_of_le_of_lt (Nat.sub_le (as.size - 1) i) this
+      match (← f (as.get ⟨as.size - 1 - i, this⟩) b) with
+      | ForInStep.done b  => pure b
+      | ForInStep.yield b => loop i (Nat.le_of_lt h') b
+  loop as.size (Nat.le_refl _) b
+
+instance : ForIn m UInt16Array UInt16 where
+  forIn := UInt16Array.forIn
+
+/-- See comment at `forInUnsafe` -/
+-- TODO: avoid code duplication.
+@[inline]
+unsafe def foldlMUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (f : β → UInt16 → m β) (init : β) (as : UInt16Array) (start := 0) (stop := as.size) : m β :=
+  let rec @[specialize] fold (i : USize) (stop : USize) (b : β) : m β := do
+    if i == stop then
+      pure b
+    else
+      fold (i+1) stop (← f b (as.uget i lcProof))
+  if start < stop then
+    if stop ≤ as.size then
+      fold (USize.ofNat start) (USize.ofNat stop) init
+    else
+      pure init
+  else
+    pure init
+
+/-- Reference implementation for `foldlM` -/
+@[implemented_by foldlMUnsafe]
+def foldlM {β : Type v} {m : Type v → Type w} [Monad m] (f : β → UInt16 → m β) (init : β) (as : UInt16Array) (start := 0) (stop := as.size) : m β :=
+  let fold (stop : Nat) (h : stop ≤ as.size) :=
+    let rec loop (i : Nat) (j : Nat) (b : β) : m β := do
+      if hlt : j < stop then
+        match i with
+        | 0    => pure b
+        | i'+1 =>
+          loop i' (j+1) (← f b (as.get ⟨j, Nat.lt_of_lt_of_le hlt h⟩))
+      else
+        pure b
+    loop (stop - start) start init
+  if h : stop ≤ as.size then
+    fold stop h
+  else
+    fold as.size (Nat.le_refl _)
+
+@[inline]
+def foldl {β : Type v} (f : β → UInt16 → β) (init : β) (as : UInt16Array) (start := 0) (stop := as.size) : β :=
+  Id.run <| as.foldlM f init start stop
+
+end UInt16Array
+
+def List.toUInt16Array (ds : List UInt16) : UInt16Array :=
+  let rec loop
+    | [],    r => r
+    | b::ds, r => loop ds (r.push b)
+  loop ds UInt16Array.empty
+
+instance : ToString UInt16Array := ⟨fun ds => ds.toList.toString⟩
+
+structure UInt32Array where
+  data : Array UInt32
+
+attribute [extern "lean_uint32_array_mk"] UInt32Array.mk
+attribute [extern "lean_uint32_array_data"] UInt32Array.data
+
+namespace UInt32Array
+@[extern "lean_mk_empty_uint32_array"]
+def mkEmpty (c : @& Nat) : UInt32Array :=
+  { data := #[] }
+
+def empty : UInt32Array :=
+  mkEmpty 0
+
+instance : Inhabited UInt32Array where
+  default := empty
+
+instance : EmptyCollection UInt32Array where
+  emptyCollection := UInt32Array.empty
+
+@[extern "lean_uint32_array_push"]
+def push : UInt32Array → UInt32 → UInt32Array
+  | ⟨ds⟩, b => ⟨ds.push b⟩
+
+@[extern "lean_uint32_array_size"]
+def size : (@& UInt32Array) → Nat
+  | ⟨ds⟩ => ds.size
+
+@[extern "lean_uint32_array_uget"]
+def uget : (a : @& UInt32Array) → (i : USize) → i.toNat < a.size → UInt32
+  | ⟨ds⟩, i, h => ds[i]
+
+@[extern "lean_uint32_array_fget"]
+def get : (ds : @& UInt32Array) → (@& Fin ds.size) → UInt32
+  | ⟨ds⟩, i => ds.get i
+
+@[extern "lean_uint32_array_get"]
+def get! : (@& UInt32Array) → (@& Nat) → UInt32
+  | ⟨ds⟩, i => ds.get! i
+
+def get? (ds : UInt32Array) (i : Nat) : Option UInt32 :=
+  if h : i < ds.size then
+    ds.get ⟨i, h⟩
+  else
+    none
+
+instance : GetElem UInt32Array Nat UInt32 fun xs i => i < xs.size where
+  getElem xs i h := xs.get ⟨i, h⟩
+
+instance : LawfulGetElem UInt32Array Nat UInt32 fun xs i => i < xs.size where
+
+instance : GetElem UInt32Array USize UInt32 fun xs i => i.val < xs.size where
+  getElem xs i h := xs.uget i h
+
+instance : LawfulGetElem UInt32Array USize UInt32 fun xs i => i.val < xs.size where
+
+@[extern "lean_uint32_array_uset"]
+def uset : (a : UInt32Array) → (i : USize) → UInt32 → i.toNat < a.size → UInt32Array
+  | ⟨ds⟩, i, v, h => ⟨ds.uset i v h⟩
+
+@[extern "lean_uint32_array_fset"]
+def set : (ds : UInt32Array) → (@& Fin ds.size) → UInt32 → UInt32Array
+  | ⟨ds⟩, i, d => ⟨ds.set i d⟩
+
+@[extern "lean_uint32_array_set"]
+def set! : UInt32Array → (@& Nat) → UInt32 → UInt32Array
+  | ⟨ds⟩, i, d => ⟨ds.set! i d⟩
+
+def isEmpty (s : UInt32Array) : Bool :=
+  s.size == 0
+
+partial def toList (ds : UInt32Array) : List UInt32 :=
+  let rec loop (i r) :=
+    if h : i < ds.size then
+      loop (i+1) (ds.get ⟨i, h⟩ :: r)
+    else
+      r.reverse
+  loop 0 []
+
+/--
+  We claim this unsafe implementation is correct because an array cannot have more than `usizeSz` elements in our runtime.
+  This is similar to the `Array` version.
+-/
+-- TODO: avoid code duplication in the future after we improve the compiler.
+@[inline] unsafe def forInUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (as : UInt32Array) (b : β) (f : UInt32 → β → m (ForInStep β)) : m β :=
+  let sz := USize.ofNat as.size
+  let rec @[specialize] loop (i : USize) (b : β) : m β := do
+    if i < sz then
+      let a := as.uget i lcProof
+      match (← f a b) with
+      | ForInStep.done  b => pure b
+      | ForInStep.yield b => loop (i+1) b
+    else
+      pure b
+  loop 0 b
+
+/-- Reference implementation for `forIn` -/
+@[implemented_by UInt32Array.forInUnsafe]
+protected def forIn {β : Type v} {m : Type v → Type w} [Monad m] (as : UInt32Array) (b : β) (f : UInt32 → β → m (ForInStep β)) : m β :=
+  let rec loop (i : Nat) (h : i ≤ as.size) (b : β) : m β := do
+    match i, h with
+    | 0,   _ => pure b
+    | i+1, h =>
+      have h' : i < as.size            := Nat.lt_of_lt_of_le (Nat.lt_succ_self i) h
+      have : as.size - 1 < as.size     := Nat.sub_lt (Nat.zero_lt_of_lt h') (by decide)
+      have : as.size - 1 - i < as.size := Nat.lt_of_le_of_lt (Nat.sub_le (as.size - 1) i) this
+      match (← f (as.get ⟨as.size - 1 - i, this⟩) b) with
+      | ForInStep.done b  => pure b
+      | ForInStep.yield b => loop i (Nat.le_of_lt h') b
+  loop as.size (Nat.le_refl _) b
+
+instance : ForIn m UInt32Array UInt32 where
+  forIn := UInt32Array.forIn
+
+/-- See comment at `forInUnsafe` -/
+-- TODO: avoid code duplication.
+@[inline]
+unsafe def foldlMUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (f : β → UInt32 → m β) (init : β) (as : UInt32Array) (start := 0) (stop := as.size) : m β :=
+  let rec @[specialize] fold (i : USize) (stop : USize) (b : β) : m β := do
+    if i == stop then
+      pure b
+    else
+      fold (i+1) stop (← f b (as.uget i lcProof))
+  if start < stop then
+    if stop ≤ as.size then
+      fold (USize.ofNat start) (USize.ofNat stop) init
+    else
+      pure init
+  else
+    pure init
+
+/-- Reference implementation for `foldlM` -/
+@[implemented_by foldlMUnsafe]
+def foldlM {β : Type v} {m : Type v → Type w} [Monad m] (f : β → UInt32 → m β) (init : β) (as : UInt32Array) (start := 0) (stop := as.size) : m β :=
+  let fold (stop : Nat) (h : stop ≤ as.size) :=
+    let rec loop (i : Nat) (j : Nat) (b : β) : m β := do
+      if hlt : j < stop then
+        match i with
+        | 0    => pure b
+        | i'+1 =>
+          loop i' (j+1) (← f b (as.get ⟨j, Nat.lt_of_lt_of_le hlt h⟩))
+      else
+        pure b
+    loop (stop - start) start init
+  if h : stop ≤ as.size then
+    fold stop h
+  else
+    fold as.size (Nat.le_refl _)
+
+@[inline]
+def foldl {β : Type v} (f : β → UInt32 → β) (init : β) (as : UInt32Array) (start := 0) (stop := as.size) : β :=
+  Id.run <| as.foldlM f init start stop
+
+end UInt32Array
+
+def List.toUInt32Array (ds : List UInt32) : UInt32Array :=
+  let rec loop
+    | [],    r => r
+    | b::ds, r => loop ds (r.push b)
+  loop ds UInt32Array.empty
+
+instance : ToString UInt32Array := ⟨fun ds => ds.toList.toString⟩
+
+structure UInt64Array where
+  data : Array UInt64
+
+attribute [extern "lean_uint64_array_mk"] UInt64Array.mk
+attribute [extern "lean_uint64_array_data"] UInt64Array.data
+
+namespace UInt64Array
+@[extern "lean_mk_empty_uint64_array"]
+def mkEmpty (c : @& Nat) : UInt64Array :=
+  { data := #[] }
+
+def empty : UInt64Array :=
+  mkEmpty 0
+
+instance : Inhabited UInt64Array where
+  default := empty
+
+instance : EmptyCollection UInt64Array where
+  emptyCollection := UInt64Array.empty
+
+@[extern "lean_uint64_array_push"]
+def push : UInt64Array → UInt64 → UInt64Array
+  | ⟨ds⟩, b => ⟨ds.push b⟩
+
+@[extern "lean_uint64_array_size"]
+def size : (@& UInt64Array) → Nat
+  | ⟨ds⟩ => ds.size
+
+@[extern "lean_uint64_array_uget"]
+def uget : (a : @& UInt64Array) → (i : USize) → i.toNat < a.size → UInt64
+  | ⟨ds⟩, i, h => ds[i]
+
+@[extern "lean_uint64_array_fget"]
+def get : (ds : @& UInt64Array) → (@& Fin ds.size) → UInt64
+  | ⟨ds⟩, i => ds.get i
+
+@[extern "lean_uint64_array_get"]
+def get! : (@& UInt64Array) → (@& Nat) → UInt64
+  | ⟨ds⟩, i => ds.get! i
+
+def get? (ds : UInt64Array) (i : Nat) : Option UInt64 :=
+  if h : i < ds.size then
+    ds.get ⟨i, h⟩
+  else
+    none
+
+instance : GetElem UInt64Array Nat UInt64 fun xs i => i < xs.size where
+  getElem xs i h := xs.get ⟨i, h⟩
+
+instance : LawfulGetElem UInt64Array Nat UInt64 fun xs i => i < xs.size where
+
+instance : GetElem UInt64Array USize UInt64 fun xs i => i.val < xs.size where
+  getElem xs i h := xs.uget i h
+
+instance : LawfulGetElem UInt64Array USize UInt64 fun xs i => i.val < xs.size where
+
+@[extern "lean_uint64_array_uset"]
+def uset : (a : UInt64Array) → (i : USize) → UInt64 → i.toNat < a.size → UInt64Array
+  | ⟨ds⟩, i, v, h => ⟨ds.uset i v h⟩
+
+@[extern "lean_uint64_array_fset"]
+def set : (ds : UInt64Array) → (@& Fin ds.size) → UInt64 → UInt64Array
+  | ⟨ds⟩, i, d => ⟨ds.set i d⟩
+
+@[extern "lean_uint64_array_set"]
+def set! : UInt64Array → (@& Nat) → UInt64 → UInt64Array
+  | ⟨ds⟩, i, d => ⟨ds.set! i d⟩
+
+def isEmpty (s : UInt64Array) : Bool :=
+  s.size == 0
+
+partial def toList (ds : UInt64Array) : List UInt64 :=
+  let rec loop (i r) :=
+    if h : i < ds.size then
+      loop (i+1) (ds.get ⟨i, h⟩ :: r)
+    else
+      r.reverse
+  loop 0 []
+
+/--
+  We claim this unsafe implementation is correct because an array cannot have more than `usizeSz` elements in our runtime.
+  This is similar to the `Array` version.
+-/
+-- TODO: avoid code duplication in the future after we improve the compiler.
+@[inline] unsafe def forInUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (as : UInt64Array) (b : β) (f : UInt64 → β → m (ForInStep β)) : m β :=
+  let sz := USize.ofNat as.size
+  let rec @[specialize] loop (i : USize) (b : β) : m β := do
+    if i < sz then
+      let a := as.uget i lcProof
+      match (← f a b) with
+      | ForInStep.done  b => pure b
+      | ForInStep.yield b => loop (i+1) b
+    else
+      pure b
+  loop 0 b
+
+/-- Reference implementation for `forIn` -/
+@[implemented_by UInt64Array.forInUnsafe]
+protected def forIn {β : Type v} {m : Type v → Type w} [Monad m] (as : UInt64Array) (b : β) (f : UInt64 → β → m (ForInStep β)) : m β :=
+  let rec loop (i : Nat) (h : i ≤ as.size) (b : β) : m β := do
+    match i, h with
+    | 0,   _ => pure b
+    | i+1, h =>
+      have h' : i < as.size            := Nat.lt_of_lt_of_le (Nat.lt_succ_self i) h
+      have : as.size - 1 < as.size     := Nat.sub_lt (Nat.zero_lt_of_lt h') (by decide)
+      have : as.size - 1 - i < as.size := Nat.lt_of_le_of_lt (Nat.sub_le (as.size - 1) i) this
+      match (← f (as.get ⟨as.size - 1 - i, this⟩) b) with
+      | ForInStep.done b  => pure b
+      | ForInStep.yield b => loop i (Nat.le_of_lt h') b
+  loop as.size (Nat.le_refl _) b
+
+instance : ForIn m UInt64Array UInt64 where
+  forIn := UInt64Array.forIn
+
+/-- See comment at `forInUnsafe` -/
+-- TODO: avoid code duplication.
+@[inline]
+unsafe def foldlMUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (f : β → UInt64 → m β) (init : β) (as : UInt64Array) (start := 0) (stop := as.size) : m β :=
+  let rec @[specialize] fold (i : USize) (stop : USize) (b : β) : m β := do
+    if i == stop then
+      pure b
+    else
+      fold (i+1) stop (← f b (as.uget i lcProof))
+  if start < stop then
+    if stop ≤ as.size then
+      fold (USize.ofNat start) (USize.ofNat stop) init
+    else
+      pure init
+  else
+    pure init
+
+/-- Reference implementation for `foldlM` -/
+@[implemented_by foldlMUnsafe]
+def foldlM {β : Type v} {m : Type v → Type w} [Monad m] (f : β → UInt64 → m β) (init : β) (as : UInt64Array) (start := 0) (stop := as.size) : m β :=
+  let fold (stop : Nat) (h : stop ≤ as.size) :=
+    let rec loop (i : Nat) (j : Nat) (b : β) : m β := do
+      if hlt : j < stop then
+        match i with
+        | 0    => pure b
+        | i'+1 =>
+          loop i' (j+1) (← f b (as.get ⟨j, Nat.lt_of_lt_of_le hlt h⟩))
+      else
+        pure b
+    loop (stop - start) start init
+  if h : stop ≤ as.size then
+    fold stop h
+  else
+    fold as.size (Nat.le_refl _)
+
+@[inline]
+def foldl {β : Type v} (f : β → UInt64 → β) (init : β) (as : UInt64Array) (start := 0) (stop := as.size) : β :=
+  Id.run <| as.foldlM f init start stop
+
+end UInt64Array
+
+def List.toUInt64Array (ds : List UInt64) : UInt64Array :=
+  let rec loop
+    | [],    r => r
+    | b::ds, r => loop ds (r.push b)
+  loop ds UInt64Array.empty
+
+instance : ToString UInt64Array := ⟨fun ds => ds.toList.toString⟩
+
+structure USizeArray where
+  data : Array USize
+
+attribute [extern "lean_usize_array_mk"] USizeArray.mk
+attribute [extern "lean_usize_array_data"] USizeArray.data
+
+namespace USizeArray
+@[extern "lean_mk_empty_usize_array"]
+def mkEmpty (c : @& Nat) : USizeArray :=
+  { data := #[] }
+
+def empty : USizeArray :=
+  mkEmpty 0
+
+instance : Inhabited USizeArray where
+  default := empty
+
+instance : EmptyCollection USizeArray where
+  emptyCollection := USizeArray.empty
+
+@[extern "lean_usize_array_push"]
+def push : USizeArray → USize → USizeArray
+  | ⟨ds⟩, b => ⟨ds.push b⟩
+
+@[extern "lean_usize_array_size"]
+def size : (@& USizeArray) → Nat
+  | ⟨ds⟩ => ds.size
+
+@[extern "lean_usize_array_uget"]
+def uget : (a : @& USizeArray) → (i : USize) → i.toNat < a.size → USize
+  | ⟨ds⟩, i, h => ds[i]
+
+@[extern "lean_usize_array_fget"]
+def get : (ds : @& USizeArray) → (@& Fin ds.size) → USize
+  | ⟨ds⟩, i => ds.get i
+
+@[extern "lean_usize_array_get"]
+def get! : (@& USizeArray) → (@& Nat) → USize
+  | ⟨ds⟩, i => ds.get! i
+
+def get? (ds : USizeArray) (i : Nat) : Option USize :=
+  if h : i < ds.size then
+    ds.get ⟨i, h⟩
+  else
+    none
+
+instance : GetElem USizeArray Nat USize fun xs i => i < xs.size where
+  getElem xs i h := xs.get ⟨i, h⟩
+
+instance : LawfulGetElem USizeArray Nat USize fun xs i => i < xs.size where
+
+instance : GetElem USizeArray USize USize fun xs i => i.val < xs.size where
+  getElem xs i h := xs.uget i h
+
+instance : LawfulGetElem USizeArray USize USize fun xs i => i.val < xs.size where
+
+@[extern "lean_usize_array_uset"]
+def uset : (a : USizeArray) → (i : USize) → USize → i.toNat < a.size → USizeArray
+  | ⟨ds⟩, i, v, h => ⟨ds.uset i v h⟩
+
+@[extern "lean_usize_array_fset"]
+def set : (ds : USizeArray) → (@& Fin ds.size) → USize → USizeArray
+  | ⟨ds⟩, i, d => ⟨ds.set i d⟩
+
+@[extern "lean_usize_array_set"]
+def set! : USizeArray → (@& Nat) → USize → USizeArray
+  | ⟨ds⟩, i, d => ⟨ds.set! i d⟩
+
+def isEmpty (s : USizeArray) : Bool :=
+  s.size == 0
+
+partial def toList (ds : USizeArray) : List USize :=
+  let rec loop (i r) :=
+    if h : i < ds.size then
+      loop (i+1) (ds.get ⟨i, h⟩ :: r)
+    else
+      r.reverse
+  loop 0 []
+
+/--
+  We claim this unsafe implementation is correct because an array cannot have more than `usizeSz` elements in our runtime.
+  This is similar to the `Array` version.
+-/
+-- TODO: avoid code duplication in the future after we improve the compiler.
+@[inline] unsafe def forInUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (as : USizeArray) (b : β) (f : USize → β → m (ForInStep β)) : m β :=
+  let sz := USize.ofNat as.size
+  let rec @[specialize] loop (i : USize) (b : β) : m β := do
+    if i < sz then
+      let a := as.uget i lcProof
+      match (← f a b) with
+      | ForInStep.done  b => pure b
+      | ForInStep.yield b => loop (i+1) b
+    else
+      pure b
+  loop 0 b
+
+/-- Reference implementation for `forIn` -/
+@[implemented_by USizeArray.forInUnsafe]
+protected def forIn {β : Type v} {m : Type v → Type w} [Monad m] (as : USizeArray) (b : β) (f : USize → β → m (ForInStep β)) : m β :=
+  let rec loop (i : Nat) (h : i ≤ as.size) (b : β) : m β := do
+    match i, h with
+    | 0,   _ => pure b
+    | i+1, h =>
+      have h' : i < as.size            := Nat.lt_of_lt_of_le (Nat.lt_succ_self i) h
+      have : as.size - 1 < as.size     := Nat.sub_lt (Nat.zero_lt_of_lt h') (by decide)
+      have : as.size - 1 - i < as.size := Nat.lt_of_le_of_lt (Nat.sub_le (as.size - 1) i) this
+      match (← f (as.get ⟨as.size - 1 - i, this⟩) b) with
+      | ForInStep.done b  => pure b
+      | ForInStep.yield b => loop i (Nat.le_of_lt h') b
+  loop as.size (Nat.le_refl _) b
+
+instance : ForIn m USizeArray USize where
+  forIn := USizeArray.forIn
+
+/-- See comment at `forInUnsafe` -/
+-- TODO: avoid code duplication.
+@[inline]
+unsafe def foldlMUnsafe {β : Type v} {m : Type v → Type w} [Monad m] (f : β → USize → m β) (init : β) (as : USizeArray) (start := 0) (stop := as.size) : m β :=
+  let rec @[specialize] fold (i : USize) (stop : USize) (b : β) : m β := do
+    if i == stop then
+      pure b
+    else
+      fold (i+1) stop (← f b (as.uget i lcProof))
+  if start < stop then
+    if stop ≤ as.size then
+      fold (USize.ofNat start) (USize.ofNat stop) init
+    else
+      pure init
+  else
+    pure init
+
+/-- Reference implementation for `foldlM` -/
+@[implemented_by foldlMUnsafe]
+def foldlM {β : Type v} {m : Type v → Type w} [Monad m] (f : β → USize → m β) (init : β) (as : USizeArray) (start := 0) (stop := as.size) : m β :=
+  let fold (stop : Nat) (h : stop ≤ as.size) :=
+    let rec loop (i : Nat) (j : Nat) (b : β) : m β := do
+      if hlt : j < stop then
+        match i with
+        | 0    => pure b
+        | i'+1 =>
+          loop i' (j+1) (← f b (as.get ⟨j, Nat.lt_of_lt_of_le hlt h⟩))
+      else
+        pure b
+    loop (stop - start) start init
+  if h : stop ≤ as.size then
+    fold stop h
+  else
+    fold as.size (Nat.le_refl _)
+
+@[inline]
+def foldl {β : Type v} (f : β → USize → β) (init : β) (as : USizeArray) (start := 0) (stop := as.size) : β :=
+  Id.run <| as.foldlM f init start stop
+
+end USizeArray
+
+def List.toUSizeArray (ds : List USize) : USizeArray :=
+  let rec loop
+    | [],    r => r
+    | b::ds, r => loop ds (r.push b)
+  loop ds USizeArray.empty
+
+instance : ToString USizeArray := ⟨fun ds => ds.toList.toString⟩
@@ -100,6 +100,22 @@ def isIdFirst (c : Char) : Bool :=
 def isIdRest (c : Char) : Bool :=
   c.isAlphanum || c = '_' || c = '\'' || c == '!' || c == '?' || isLetterLike c || isSubScriptAlnum c
 
+/--
+Returns the first position at or after `pos` that does not hold an ASCII `isIdRest` character.
+This is the fast path for scanning identifiers: the native implementation skips a run of such bytes
+without decoding them one code point at a time, and callers continue with `isIdRest` for the rest.
+-/
+@[extern "lean_string_skip_ascii_id_rest"]
+def skipAsciiIdRest (s : @& String) (pos : @& String.Pos) : String.Pos :=
+  if h : pos < s.endPos then
+    let c := s.get pos
+    if c.val < 128 && isIdRest c then
+      have := Nat.sub_lt_sub_left h (String.lt_next s pos)
+      skipAsciiIdRest s (s.next pos)
+    else pos
+  else pos
+termination_by s.endPos.1 - pos.1
+
 def idBeginEscape := '«'
 def idEndEscape   := '»'
 def isIdBeginEscape (c : Char) : Bool := c = idBeginEscape
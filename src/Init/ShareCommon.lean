@@ -81,6 +81,13 @@ instance : Inhabited (State σ) := ⟨.mk σ⟩
 @[extern "lean_state_sharecommon"]
 def State.shareCommon {σ : @& StateFactory} (s : State σ) (a : α) : α × State σ := (a, s)
 
+/--
+Maximize sharing in `a` using hash tables implemented natively, which are freed afterwards. This is faster than
+`State.shareCommon`, which uses the tables of a `StateFactory`, but no sharing is introduced between different calls.
+-/
+@[extern "lean_sharecommon_quick"]
+def shareCommon' (a : @& α) : α := a
+
 end ShareCommon
 
 class MonadShareCommon (m : Type u → Type v) where
@@ -9,3 +9,4 @@ import Init.System.Platform
 import Init.System.Uri
 import Init.System.Mutex
 import Init.System.Promise
+import Init.System.Concurrent
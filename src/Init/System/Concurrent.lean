@@ -0,0 +1,90 @@
+/-
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+-/
+prelude
+import Init.System.IO
+
+set_option linter.missingDocs true
+
+namespace IO
+
+private opaque ConcurrentQueuePointed : NonemptyType.{0}
+
+/--
+Bounded queue that can be pushed to and popped from by any number of tasks concurrently without locking.
+
+Values are marked as multi-threaded when they are pushed.
+-/
+def ConcurrentQueue (_ : Type) : Type := ConcurrentQueuePointed.type
+
+instance : Nonempty (ConcurrentQueue α) := ConcurrentQueuePointed.property
+
+/-- Creates a new queue that can hold `capacity` values, rounded up to a power of two. -/
+@[extern "lean_io_concurrent_queue_new"]
+opaque ConcurrentQueue.new (capacity : @& Nat) : BaseIO (ConcurrentQueue α)
+
+/-- The number of values that the queue can hold. -/
+@[extern "lean_io_concurrent_queue_capacity"]
+opaque ConcurrentQueue.capacity (q : @& ConcurrentQueue α) : Nat
+
+/-- Pushes `a` at the end of the queue, and returns `false` if the queue is full. -/
+@[extern "lean_io_concurrent_queue_try_push"]
+opaque ConcurrentQueue.tryPush (q : @& ConcurrentQueue α) (a : α) : BaseIO Bool
+
+/-- Pops the value at the front of the queue, if the queue is not empty. -/
+@[extern "lean_io_concurrent_queue_try_pop"]
+opaque ConcurrentQueue.tryPop (q : @& ConcurrentQueue α) : BaseIO (Option α)
+
+private opaque ConcurrentHashMapPointed : NonemptyType.{0}
+
+/--
+Hash map that can be accessed by any number of tasks concurrently. The entries are split into shards by hash, each
+with its own lock, so that accesses to different shards do not contend.
+
+Keys and values are marked as multi-threaded when they are inserted. All operations on a map must use the same `BEq`
+and `Hashable` instances.
+-/
+def ConcurrentHashMap (_ _ : Type) : Type := ConcurrentHashMapPointed.type
+
+instance : Nonempty (ConcurrentHashMap α β) := ConcurrentHashMapPointed.property
+
+/-- Creates a new empty map. -/
+@[extern "lean_io_concurrent_hash_map_new"]
+opaque ConcurrentHashMap.new : BaseIO (ConcurrentHashMap α β)
+
+@[extern "lean_io_concurrent_hash_map_insert"]
+private opaque ConcurrentHashMap.insertImpl (m : @& ConcurrentHashMap α β) (hash : UInt64)
+  (beq : @& (α → α → Bool)) (k : α) (v : β) : BaseIO Unit
+
+@[extern "lean_io_concurrent_hash_map_find"]
+private opaque ConcurrentHashMap.getImpl? (m : @& ConcurrentHashMap α β) (hash : UInt64)
+  (beq : @& (α → α → Bool)) (k : @& α) : BaseIO (Option β)
+
+@[extern "lean_io_concurrent_hash_map_erase"]
+private opaque ConcurrentHashMap.eraseImpl (m : @& ConcurrentHashMap α β) (hash : UInt64)
+  (beq : @& (α → α → Bool)) (k : @& α) : BaseIO (Option β)
+
+/-- The number of entries of the map. -/
+@[extern "lean_io_concurrent_hash_map_size"]
+opaque ConcurrentHashMap.size (m : @& ConcurrentHashMap α β) : BaseIO Nat
+
+/-- The number of entries of each shard of the map, for diagnosing how evenly the hashes of its keys are spread. -/
+@[extern "lean_io_concurrent_hash_map_shard_sizes"]
+opaque ConcurrentHashMap.shardSizes (m : @& ConcurrentHashMap α β) : BaseIO (Array Nat)
+
+variable [BEq α] [Hashable α]
+
+/-- Maps `k` to `v`, replacing the previous value of `k` if any. -/
+@[inline] def ConcurrentHashMap.insert (m : ConcurrentHashMap α β) (k : α) (v : β) : BaseIO Unit :=
+  m.insertImpl (hash k) (· == ·) k v
+
+/-- The value of `k`, if any. -/
+@[inline] def ConcurrentHashMap.get? (m : ConcurrentHashMap α β) (k : α) : BaseIO (Option β) :=
+  m.getImpl? (hash k) (· == ·) k
+
+/-- Removes `k`, and returns its value if any. -/
+@[inline] def ConcurrentHashMap.erase (m : ConcurrentHashMap α β) (k : α) : BaseIO (Option β) :=
+  m.eraseImpl (hash k) (· == ·) k
+
+end IO
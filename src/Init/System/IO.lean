@@ -261,6 +261,93 @@ instance : ToString TaskState := ⟨TaskState.toString⟩
 /-- Helper method for implementing "deterministic" timeouts. It is the number of "small" memory allocations performed by the current execution thread. -/
 @[extern "lean_io_get_num_heartbeats"] opaque getNumHeartbeats : BaseIO Nat
 
+/-- Statistics of the runtime's small object allocator for all objects of a single size class. -/
+structure AllocSlotStats where
+  /-- Size in bytes of the objects in this size class. -/
+  objSize     : Nat
+  /-- Maximum number of objects of this size class in a page. -/
+  objsPerPage : Nat
+  /--
+  Number of allocations since the start of the process. Always `0` unless the runtime was built with
+  `RUNTIME_STATS=ON`, as counting them slows down the allocator's fast path.
+  -/
+  numAlloc    : Nat
+  /-- Number of deallocations since the start of the process, see `numAlloc`. -/
+  numFree     : Nat
+  /-- Number of pages currently assigned to this size class. -/
+  numPages    : Nat
+  deriving Inhabited, Repr
+
+namespace AllocSlotStats
+
+/-- Number of objects of this size class that are currently alive. -/
+def numLive (s : AllocSlotStats) : Nat := s.numAlloc - s.numFree
+
+/-- Number of bytes used by live objects of this size class. -/
+def liveBytes (s : AllocSlotStats) : Nat := s.numLive * s.objSize
+
+/--
+Number of objects that fit in the pages currently assigned to this size class. The ratio of `numLive` to this value
+is the page occupancy of this size class.
+-/
+def capacity (s : AllocSlotStats) : Nat := s.numPages * s.objsPerPage
+
+end AllocSlotStats
+
+/--
+Returns statistics of the runtime's small object allocator, one entry per size class, summed over all threads.
+The result is empty if the runtime was built without the small object allocator. The counters of other threads are
+not read atomically, so the result is only an approximation while other threads are running.
+-/
+@[extern "lean_io_get_alloc_stats"] opaque getAllocStats : BaseIO (Array AllocSlotStats)
+
+/--
+Returns the number of bytes used by live Lean objects outside of compacted regions. The value is maintained by the
+runtime's small object allocator without querying the OS; the allocations of other threads are accounted in batches
+of 64Kb. If the runtime was built without the small object allocator, the resident set size is returned instead.
+-/
+@[extern "lean_io_get_allocated_memory"] opaque getAllocatedMemory : BaseIO Nat
+
+/--
+Sets a soft memory limit of `limit` bytes, replacing the previous one. `handler` is run the first time the runtime
+notices that `getAllocatedMemory` reached `limit`, e.g. to release caches before reaching the `--memory` limit. The
+runtime checks the allocated memory where it checks the `--memory` limit, e.g. in the kernel. `handler` runs again
+when the limit is reached again after the allocated memory went below it. The value 0 disables the soft limit.
+-/
+@[extern "lean_io_set_memory_soft_limit"]
+opaque setMemorySoftLimit (limit : @& Nat) (handler : BaseIO Unit) : BaseIO Unit
+
+/--
+Registers a cache that the runtime may evict under memory pressure, e.g. when the `--memory-soft` limit is reached,
+and returns its identifier. `size` estimates the memory used by the cache in bytes, and `evict` empties it. Both may
+be called from any thread. Caches are evicted in the order in which they were last used, see `touchCache`.
+-/
+@[extern "lean_io_register_cache"]
+opaque registerCache (name : @& String) (size : BaseIO Nat) (evict : BaseIO Unit) : BaseIO Nat
+
+/-- Removes a cache registered by `registerCache`. Does nothing if `id` was not returned by `registerCache`. -/
+@[extern "lean_io_unregister_cache"] opaque unregisterCache (id : @& Nat) : BaseIO Unit
+
+/--
+Records that the cache registered by `registerCache` has been used. Does nothing if `id` was not returned by
+`registerCache`.
+-/
+@[extern "lean_io_touch_cache"] opaque touchCache (id : @& Nat) : BaseIO Unit
+
+/--
+Evicts the least recently used caches registered by `registerCache` and by the runtime until `getAllocatedMemory` is
+at most `target`, and returns the number of evicted caches.
+-/
+@[extern "lean_io_evict_caches"] opaque evictCaches (target : @& Nat) : BaseIO Nat
+
+/--
+Writes a snapshot of the objects reachable from `root` to the file `path`, in the V8 heap snapshot format. It can be
+loaded, e.g., in the memory tab of the Chrome developer tools, which compute the dominator tree and the retained size
+of each object. Objects are classified by kind, and constructor objects by their constructor index and number of
+object fields. Scalars are not included, and neither are objects that are only reachable from other roots.
+-/
+@[extern "lean_io_heap_snapshot"] opaque heapSnapshot {α : Type u} (root : @& α) (path : @& FilePath) : IO Unit
+
 /--
 Adjusts the heartbeat counter of the current thread by the given amount. This can be useful to give
 allocation-avoiding code additional "weight" and is also used to adjust the counter after resuming
@@ -424,6 +511,24 @@ Note that EOF does not actually close a handle, so further reads may block and r
 -/
 @[extern "lean_io_prim_handle_read"] opaque read (h : @& Handle) (bytes : USize) : IO ByteArray
 @[extern "lean_io_prim_handle_write"] opaque write (h : @& Handle) (buffer : @& ByteArray) : IO Unit
+/--
+Write all the given buffers to the handle, in order. On Unix systems, this is done using as few system calls
+as possible, which is faster than calling `write` on each buffer when there are many small ones.
+-/
+@[extern "lean_io_prim_handle_write_many"]
+opaque writeMany (h : @& Handle) (buffers : @& Array ByteArray) : IO Unit
+/--
+Like `read`, but the read is performed by a separate I/O thread and its result is returned as a task,
+so that waiting for the operating system neither blocks the current thread nor occupies a task manager worker.
+The handle must not be used concurrently until the task has finished.
+-/
+@[extern "lean_io_prim_handle_read_async"]
+opaque readAsync (h : @& Handle) (bytes : USize) : BaseIO (Task (Except IO.Error ByteArray))
+/--
+Like `write`, but the write is performed by a separate I/O thread. See `readAsync`.
+-/
+@[extern "lean_io_prim_handle_write_async"]
+opaque writeAsync (h : @& Handle) (buffer : @& ByteArray) : BaseIO (Task (Except IO.Error Unit))
 
 /--
 Read text up to (including) the next line break from the handle.
@@ -482,9 +587,20 @@ partial def Handle.readToEnd (h : Handle) : IO String := do
       loop (s ++ line)
   loop ""
 
-def readBinFile (fname : FilePath) : IO ByteArray := do
-  let h ← Handle.mk fname Mode.read
-  h.readBinToEnd
+/-- Reads the entire contents of the binary file at the given path. -/
+@[extern "lean_io_read_bin_file"]
+opaque readBinFile (fname : @& FilePath) : IO ByteArray
+
+/--
+Like `readBinFile`, but maps regular files into memory instead of copying them, which avoids reading the parts of a
+large file that are never accessed. The mapping is private, so updating the resulting array never modifies the file.
+
+The contents of the array are read from the file when they are accessed, so the file must not be modified, truncated
+or replaced in place (e.g. by `writeBinFile`) while the array is alive: the array may then change, and accessing it
+may crash the process. Replacing the file by renaming another file over it is safe.
+-/
+@[extern "lean_io_map_bin_file"]
+opaque mapBinFile (fname : @& FilePath) : IO ByteArray
 
 def readFile (fname : FilePath) : IO String := do
   let h ← Handle.mk fname Mode.read
@@ -546,6 +662,13 @@ structure Metadata where
   type     : FileType
   deriving Repr
 
+/-- An entry returned by `System.FilePath.readDirRecursive`. -/
+structure WalkEntry where
+  path     : FilePath
+  modified : SystemTime
+  type     : FileType
+  deriving Repr
+
 end FS
 end IO
 
@@ -558,6 +681,13 @@ opaque readDir : @& FilePath → IO (Array IO.FS.DirEntry)
 @[extern "lean_io_metadata"]
 opaque metadata : @& FilePath → IO IO.FS.Metadata
 
+/--
+  Return all filesystem entries below the given directory, together with their types and modification times,
+  in an unspecified order. Symbolic links are reported as such and are not followed. Subdirectories are read in
+  parallel, which makes this much faster than `walkDir` on large trees. -/
+@[extern "lean_io_read_dir_recursive"]
+opaque readDirRecursive : @& FilePath → IO (Array IO.FS.WalkEntry)
+
 def isDir (p : FilePath) : BaseIO Bool := do
   match (← p.metadata.toBaseIO) with
   | Except.ok m => return m.type == IO.FS.FileType.dir
@@ -714,6 +844,31 @@ structure Child (cfg : StdioConfig) where
 
 @[extern "lean_io_process_child_wait"] opaque Child.wait {cfg : @& StdioConfig} : @& Child cfg → IO UInt32
 
+/--
+Like `Child.wait`, but returns a task that is resolved when the child process exits, without blocking a thread
+on POSIX systems. At most one of `Child.wait` and `Child.waitAsync` should be used on a given child process.
+-/
+@[extern "lean_io_process_child_wait_async"]
+opaque Child.waitAsync {cfg : @& StdioConfig} : @& Child cfg → BaseIO (Task (Except IO.Error UInt32))
+
+/--
+Read up to the given number of bytes from a pipe connected to a child process, as soon as any data is available.
+An empty array signals that the pipe has been closed. On POSIX systems, all pending reads are served by a single
+thread, so this scales to many child processes; for this reason, the handle should not be read using the
+buffered operations of `FS.Handle` as well.
+-/
+@[extern "lean_io_process_read_pipe_async"]
+opaque readPipeAsync (h : @& FS.Handle) (bytes : USize) : BaseIO (Task (Except IO.Error ByteArray))
+
+/-- Read from a pipe connected to a child process until it is closed. See `readPipeAsync`. -/
+partial def readPipeToEndAsync (h : FS.Handle) : BaseIO (Task (Except IO.Error ByteArray)) :=
+  go ByteArray.empty
+where
+  go (acc : ByteArray) : BaseIO (Task (Except IO.Error ByteArray)) := do
+    BaseIO.bindTask (sync := true) (← readPipeAsync h 65536) fun
+      | .ok chunk => if chunk.isEmpty then return .pure (.ok acc) else go (acc ++ chunk)
+      | .error e  => return .pure (.error e)
+
 /-- Terminates the child process using the SIGTERM signal or a platform analogue.
     If the process was started using `SpawnArgs.setsid`, terminates the entire process group instead. -/
 @[extern "lean_io_process_child_kill"] opaque Child.kill {cfg : @& StdioConfig} : @& Child cfg → IO Unit
@@ -744,6 +899,25 @@ def output (args : SpawnArgs) : IO Output := do
   let stdout ← IO.ofExcept stdout.get
   pure { exitCode := exitCode, stdout := stdout, stderr := stderr }
 
+/--
+Like `output`, but returns a task that is resolved when the process has exited and both of its output pipes have
+been closed. No thread is blocked while waiting on POSIX systems, which makes it suitable for running many
+processes in parallel.
+-/
+def outputAsync (args : SpawnArgs) : IO (Task (Except IO.Error Output)) := do
+  let child ← spawn { args with stdout := .piped, stderr := .piped, stdin := .null }
+  let stdout ← readPipeToEndAsync child.stdout
+  let stderr ← readPipeToEndAsync child.stderr
+  let exitCode ← child.waitAsync
+  let decode (stream : String) (bytes : ByteArray) : Except IO.Error String :=
+    match String.fromUTF8? bytes with
+    | some s => pure s
+    | none   => throw <| IO.userError s!"process '{args.cmd}' produced invalid UTF-8 on {stream}"
+  BaseIO.bindTask (sync := true) stdout fun stdout =>
+  BaseIO.bindTask (sync := true) stderr fun stderr =>
+  BaseIO.mapTask (sync := true) (t := exitCode) fun exitCode => return do
+    return { exitCode := ← exitCode, stdout := ← decode "stdout" (← stdout), stderr := ← decode "stderr" (← stderr) }
+
 /-- Run process to completion and return stdout on success. -/
 def run (args : SpawnArgs) : IO String := do
   let out ← output args
@@ -82,6 +82,18 @@ opaque Ref.ptrEq {σ α} (r1 r2 : @& Ref σ α) : ST σ Bool
   Ref.set r a
   pure b
 
+/--
+Atomically replaces the value `a` of `r` with `(f a).2`, and returns `(f a).1`. Unlike `Ref.modifyGet`, the reference
+is never left empty, so concurrent `Ref.get`s do not wait for `f`. Under contention, `f` may be evaluated several
+times, and it never has exclusive access to `a`, so it cannot update `a` in place.
+-/
+@[extern "lean_st_ref_atomic_modify_get"]
+opaque Ref.atomicModifyGet {σ α β : Type} (r : @& Ref σ α) (f : α → β × α) : ST σ β := do
+  let v ← Ref.get r
+  let (b, a) := f v
+  Ref.set r a
+  pure b
+
 @[implemented_by Ref.modifyUnsafe]
 def Ref.modify {σ α : Type} (r : Ref σ α) (f : α → α) : ST σ Unit := do
   let v ← Ref.get r
@@ -107,6 +119,8 @@ variable {σ : Type} {m : Type → Type} [Monad m] [MonadLiftT (ST σ) m]
 @[inline] def Ref.ptrEq {α : Type} (r1 r2 : Ref σ α) : m Bool := liftM <| Prim.Ref.ptrEq r1 r2
 @[inline] def Ref.modify {α : Type} (r : Ref σ α) (f : α → α) : m Unit := liftM <| Prim.Ref.modify r f
 @[inline] def Ref.modifyGet {α : Type} {β : Type} (r : Ref σ α) (f : α → β × α) : m β := liftM <| Prim.Ref.modifyGet r f
+@[inline] def Ref.atomicModifyGet {α : Type} {β : Type} (r : Ref σ α) (f : α → β × α) : m β :=
+  liftM <| Prim.Ref.atomicModifyGet r f
 
 def Ref.toMonadStateOf (r : Ref σ α) : MonadStateOf α m where
   get := r.get
@@ -15,15 +15,59 @@ def Environment.addAndCompile (env : Environment) (opts : Options) (decl : Decla
   let env ← addDecl env opts decl
   compileDecl env opts decl
 
+register_builtin_option debug.kernel.asyncTheorems : Bool := {
+  defValue := false
+  descr    := "(kernel) type check theorems in parallel tasks. A theorem is added to the environment right away, and \
+    kernel errors are reported at the end of the file. This is only supported by the command-line driver."
+}
+
+/-- A kernel check started by `debug.kernel.asyncTheorems`. -/
+structure AsyncKernelCheck where
+  ref  : Syntax
+  task : Task (Except KernelException Unit)
+
+builtin_initialize asyncKernelChecksExt : EnvExtension (Array AsyncKernelCheck) ←
+  registerEnvExtension (pure #[])
+
+/--
+Add the theorem `decl` without checking it, and check it against the current environment in a separate task.
+Checking a theorem does not change the resulting environment, so the theorem can be used right away.
+-/
+private def addTheoremAsync (decl : Declaration) : CoreM Unit := do
+  let env ← getEnv
+  let maxHeartbeats := (Core.getMaxHeartbeats (← getOptions)).toUSize
+  let task := Task.spawn fun _ => (env.addDeclCore maxHeartbeats decl).map fun _ => ()
+  let ref ← getRef
+  match env.addDeclWithoutChecking decl with
+  | .ok    env => setEnv <| asyncKernelChecksExt.modifyState env (·.push { ref, task })
+  | .error ex  => throwKernelException ex
+
 def addDecl (decl : Declaration) : CoreM Unit := do
   profileitM Exception "type checking" (← getOptions) do
     withTraceNode `Kernel (fun _ => return m!"typechecking declaration") do
       if !(← MonadLog.hasErrors) && decl.hasSorry then
         logWarning "declaration uses 'sorry'"
+      if (decl matches .thmDecl _) && debug.kernel.asyncTheorems.get (← getOptions) then
+        addTheoremAsync decl
+        return
       match (← getEnv).addDecl (← getOptions) decl with
       | .ok    env => setEnv env
       | .error ex  => throwKernelException ex
 
+/--
+Wait for the kernel checks started by `debug.kernel.asyncTheorems` in `env` and return their errors.
+-/
+def waitAsyncKernelChecks (env : Environment) (opts : Options) (fileName : String) (fileMap : FileMap) :
+    BaseIO MessageLog := do
+  let mut msgs : MessageLog := {}
+  for check in asyncKernelChecksExt.getState env do
+    if let .error ex := (← IO.wait check.task) then
+      let pos    := check.ref.getPos?.getD 0
+      let endPos := check.ref.getTailPos?.getD pos
+      msgs := msgs.add {
+        fileName, pos := fileMap.toPosition pos, endPos := fileMap.toPosition endPos, data := ex.toMessageData opts }
+  return msgs
+
 def addAndCompile (decl : Declaration) : CoreM Unit := do
   addDecl decl
   compileDecl decl
@@ -10,12 +10,14 @@ import Lean.Compiler.IR.CompilerM
 import Lean.Compiler.IR.PushProj
 import Lean.Compiler.IR.ElimDeadVars
 import Lean.Compiler.IR.SimpCase
+import Lean.Compiler.IR.SimpApp
 import Lean.Compiler.IR.ResetReuse
 import Lean.Compiler.IR.NormIds
 import Lean.Compiler.IR.Checker
 import Lean.Compiler.IR.Borrow
 import Lean.Compiler.IR.Boxing
 import Lean.Compiler.IR.RC
+import Lean.Compiler.IR.SimpRC
 import Lean.Compiler.IR.ExpandResetReuse
 import Lean.Compiler.IR.UnboxResult
 import Lean.Compiler.IR.ElimDeadBranches
@@ -44,6 +46,8 @@ private def compileAux (decls : Array Decl) : CompilerM Unit := do
   logDecls `elim_dead decls
   decls := decls.map Decl.simpCase
   logDecls `simp_case decls
+  decls ← simpApp decls
+  logDecls `simp_app decls
   decls := decls.map Decl.normalizeIds
   decls ← inferBorrow decls
   logDecls `borrow decls
@@ -54,6 +58,8 @@ private def compileAux (decls : Array Decl) : CompilerM Unit := do
   if compiler.reuse.get (← read) then
     decls := decls.map Decl.expandResetReuse
     logDecls `expand_reset_reuse decls
+  decls ← simpRC decls
+  logDecls `simp_rc decls
   decls := decls.map Decl.pushProj
   logDecls `push_proj decls
   decls ← updateSorryDep decls
@@ -5,6 +5,7 @@ Authors: Leonardo de Moura
 -/
 prelude
 import Lean.Runtime
+import Lean.Data.HashMap
 import Lean.Compiler.NameMangling
 import Lean.Compiler.ExportAttr
 import Lean.Compiler.InitAttr
@@ -25,11 +26,27 @@ structure Context where
   jpMap      : JPParamsMap := {}
   mainFn     : FunId := default
   mainParams : Array Param := #[]
+  /-- The translation unit being emitted when the output is split into `numShards` units, see `emitCShards`. -/
+  shard      : Nat := 0
+  numShards  : Nat := 1
+  /-- If `true`, every function counts its calls in a `lean_call_counter`, see `runtime/call_profile.h`. -/
+  instrument : Bool := false
+  /-- Call counts of a previous run of instrumented code, indexed by the C names of the functions. -/
+  profile    : HashMap String Nat := {}
+  /-- Functions called at least `hotCalls` times according to `profile` are marked as hot. -/
+  hotCalls   : Nat := 1
+  /-- `true` if `profile` contains a function of the module. Its other functions are then marked as cold. -/
+  profiled   : Bool := false
 
 abbrev M := ReaderT Context (EStateM String String)
 
 def getEnv : M Environment := Context.env <$> read
 def getModName : M Name := Context.modName <$> read
+/--
+Returns `true` if the output is split into several translation units. Module-local definitions must then have
+external linkage, and constants are only defined by the first unit.
+-/
+def isSharded : M Bool := return (← read).numShards > 1
 def getDecl (n : Name) : M Decl := do
   let env ← getEnv
   match findEnvDecl env n with
@@ -91,6 +108,13 @@ def toCInitName (n : Name) : M String := do
 def emitCInitName (n : Name) : M Unit :=
   toCInitName n >>= emit
 
+/--
+Closed terms of object type are accessed through `LEAN_CLOSED_TERM`, so that they are initialized on first access
+instead of by the module initializer when the C code is compiled with `LEAN_LAZY_CLOSED_TERMS`.
+-/
+def isLazyClosedTerm (env : Environment) (d : Decl) : Bool :=
+  d.params.isEmpty && d.resultType.isObj && isClosedTermName env d.name
+
 def shouldExport (n : Name) : Bool :=
   -- HACK: exclude symbols very unlikely to be used by the interpreter or other consumers of
   -- libleanshared to avoid Windows symbol limit
@@ -100,8 +124,10 @@ def emitFnDeclAux (decl : Decl) (cppBaseName : String) (isExternal : Bool) : M U
   let ps := decl.params
   let env ← getEnv
   if ps.isEmpty then
-    if isClosedTermName env decl.name then emit "static "
-    else if isExternal then emit "extern "
+    if isClosedTermName env decl.name then
+      if (← read).shard > 0 then emit "extern "
+      else unless (← isSharded) do emit "static "
+    else if isExternal || (← read).shard > 0 then emit "extern "
     else emit "LEAN_EXPORT "
   else
     if !isExternal && shouldExport decl.name then emit "LEAN_EXPORT "
@@ -118,6 +144,12 @@ def emitFnDeclAux (decl : Decl) (cppBaseName : String) (isExternal : Bool) : M U
         emit (toCType ps[i]!.ty)
     emit ")"
   emitLn ";"
+  if isLazyClosedTerm env decl then
+    unless (← isSharded) do emit "static "
+    emitLn (toCType decl.resultType ++ " _init_" ++ cppBaseName ++ "();")
+  else if (← isSharded) && ps.isEmpty && !isExternal && decl matches .fdecl .. && !hasInitAttr env decl.name then
+    -- the module initializer in the first unit may call an initialization function defined in another unit
+    emitLn (toCType decl.resultType ++ " _init_" ++ cppBaseName ++ "();")
 
 def emitFnDecl (decl : Decl) (isExternal : Bool) : M Unit := do
   let cppBaseName ← toCName decl.name
@@ -428,9 +460,12 @@ def emitFullApp (z : VarId) (f : FunId) (ys : Array Arg) : M Unit := do
   match decl with
   | Decl.extern _ ps _ extData => emitExternCall f ps extData ys
   | _ =>
-    emitCName f
-    if ys.size > 0 then emit "("; emitArgs ys; emit ")"
-    emitLn ";"
+    if isLazyClosedTerm (← getEnv) decl then
+      emit "LEAN_CLOSED_TERM("; emitCName f; emitLn ");"
+    else
+      emitCName f
+      if ys.size > 0 then emit "("; emitArgs ys; emit ")"
+      emitLn ";"
 
 def emitPartialApp (z : VarId) (f : FunId) (ys : Array Arg) : M Unit := do
   let decl ← getDecl f
@@ -636,6 +671,26 @@ partial def emitFnBody (b : FnBody) : M Unit := do
 
 end
 
+/-- Parses a call profile, i.e., lines of the form `<count> <C name>`. Malformed lines are ignored. -/
+def parseCallProfile (s : String) : HashMap String Nat :=
+  s.splitOn "\n" |>.foldl (init := {}) fun m line =>
+    match line.trim.splitOn " " with
+    | [n, cName] =>
+      match n.toNat? with
+      | some n => m.insert cName n
+      | none   => m
+    | _ => m
+
+/--
+Marks the function `baseName` as hot or cold according to the call profile, so that the C compiler optimizes it for
+speed or size and places it in the corresponding section of the binary.
+-/
+def emitCallProfileAttr (baseName : String) : M Unit := do
+  let ctx ← read
+  match ctx.profile.find? baseName with
+  | some n => if n ≥ ctx.hotCalls then emit "LEAN_HOT "
+  | none   => if ctx.profiled then emit "LEAN_COLD "
+
 def emitDeclAux (d : Decl) : M Unit := do
   let env ← getEnv
   let (_, jpMap) := mkVarJPMaps d
@@ -644,10 +699,15 @@ def emitDeclAux (d : Decl) : M Unit := do
     match d with
     | .fdecl (f := f) (xs := xs) (type := t) (body := b) .. =>
       let baseName ← toCName f;
+      let instrument := xs.size > 0 && (← read).instrument
+      if instrument then
+        emit "static lean_call_counter _calls_"; emit baseName; emit " = {0, \""; emit baseName; emitLn "\", NULL};"
       if xs.size == 0 then
-        emit "static "
-      else if shouldExport f then
-        emit "LEAN_EXPORT "  -- make symbol visible to the interpreter
+        unless (← isSharded) do emit "static "
+      else
+        emitCallProfileAttr baseName
+        if shouldExport f then
+          emit "LEAN_EXPORT "  -- make symbol visible to the interpreter
       emit (toCType t); emit " ";
       if xs.size > 0 then
         emit baseName;
@@ -667,6 +727,9 @@ def emitDeclAux (d : Decl) : M Unit := do
         xs.size.forM fun i => do
           let x := xs[i]!
           emit "lean_object* "; emit x.x; emit " = _args["; emit i; emitLn "];"
+      -- tail calls jump to `_start` and are not counted
+      if instrument then
+        emit "lean_count_call(&_calls_"; emit baseName; emitLn ");"
       emitLn "_start:";
       withReader (fun ctx => { ctx with mainFn := f, mainParams := xs }) (emitFnBody b);
       emitLn "}"
@@ -682,7 +745,10 @@ def emitDecl (d : Decl) : M Unit := do
 def emitFns : M Unit := do
   let env ← getEnv;
   let decls := getDecls env;
-  decls.reverse.forM emitDecl
+  let { shard, numShards, .. } ← read
+  -- Consecutive declarations, e.g. a function and its auxiliary definitions, are kept in the same unit
+  decls.reverse.enum.forM fun (i, d) => do
+    if i * numShards / decls.length == shard then emitDecl d
 
 def emitMarkPersistent (d : Decl) (n : Name) : M Unit := do
   if d.resultType.isObj then
@@ -718,8 +784,20 @@ def emitDeclInit (d : Decl) : M Unit := do
       if getBuiltinInitFnNameFor? env d.name |>.isSome then
         emit "}"
     | _ =>
-      emitCName n; emit " = "; emitCInitName n; emitLn "();"; emitMarkPersistent d n
+      if isLazyClosedTerm env d then
+        emitLn "#ifndef LEAN_LAZY_CLOSED_TERMS"
+        emitCName n; emit " = "; emitCInitName n; emitLn "();"; emitMarkPersistent d n
+        emitLn "#endif"
+      else
+        emitCName n; emit " = "; emitCInitName n; emitLn "();"; emitMarkPersistent d n
 
+/-
+Remark: module initializers run imports depth-first and in import order on a single thread on purpose.
+`builtin_initialize` declarations register extensions, attributes, parsers, etc. in global `IO.Ref`s, and the
+registration order is observable, e.g. it determines the extension indices and the order in which
+`finalizeImport` processes persistent extensions. Running independent import subtrees concurrently would make
+that order nondeterministic.
+-/
 def emitInitFn : M Unit := do
   let env ← getEnv
   let modName ← getModName
@@ -740,11 +818,16 @@ def emitInitFn : M Unit := do
   emitLns ["return lean_io_result_mk_ok(lean_box(0));", "}"]
 
 def main : M Unit := do
+  let profile := (← read).profile
+  let profiled ← if profile.isEmpty then pure false else
+    (getDecls (← getEnv)).anyM fun d => do return profile.contains (← toCName d.name)
+  withReader (fun ctx => { ctx with profiled }) do
   emitFileHeader
   emitFnDecls
   emitFns
-  emitInitFn
-  emitMainFnIfNeeded
+  if (← read).shard == 0 then
+    emitInitFn
+    emitMainFnIfNeeded
   emitFileFooter
 
 end EmitC
@@ -755,4 +838,24 @@ def emitC (env : Environment) (modName : Name) : Except String String :=
   | EStateM.Result.ok    _   s => Except.ok s
   | EStateM.Result.error err _ => Except.error err
 
+/--
+Like `emitC`, but splits the function definitions into `n` translation units that can be compiled in parallel.
+Every unit declares all functions and constants used by the module. The first one defines the constants and contains
+the module initializer and `main`, and is the result of `emitC` if `n ≤ 1`.
+
+If `instrument` is `true`, every function counts its calls. `profile` is a call profile written by such code, see
+`runtime/call_profile.h`. Functions called at least 1% as often as the most frequently called one are then marked as
+hot, and the functions of a module that was run but that were never called as cold.
+-/
+@[export lean_ir_emit_c_shards]
+def emitCShards (env : Environment) (modName : Name) (n : Nat) (instrument := false) (profile := "") :
+    Except String (Array String) :=
+  let numShards := max n 1
+  let profile := EmitC.parseCallProfile profile
+  let hotCalls := max 1 (profile.fold (fun m _ c => max m c) 0 / 100)
+  (List.range numShards).toArray.mapM fun shard =>
+    match (EmitC.main { env, modName, shard, numShards, instrument, profile, hotCalls }).run "" with
+    | EStateM.Result.ok    _   s => Except.ok s
+    | EStateM.Result.error err _ => Except.error err
+
 end Lean.IR
@@ -1595,9 +1595,12 @@ partial def getModuleFunctions (mod : LLVM.Module llvmctx) : IO (Array (LLVM.Val
 
 /--
 `emitLLVM` is the entrypoint for the lean shell to code generate LLVM.
+If `thinLTO` is `true`, the bitcode file also contains the module summary used by ThinLTO.
+Code generation only uses the given environment and a fresh LLVM context, so it can run concurrently for
+different modules.
 -/
 @[export lean_ir_emit_llvm]
-def emitLLVM (env : Environment) (modName : Name) (filepath : String) : IO Unit := do
+def emitLLVM (env : Environment) (modName : Name) (filepath : String) (thinLTO : Bool := false) : IO Unit := do
   LLVM.llvmInitializeTargetInfo
   let llvmctx ← LLVM.createContext
   let module ← LLVM.createModule llvmctx modName.toString
@@ -1632,7 +1635,10 @@ def emitLLVM (env : Environment) (modName : Name) (filepath : String) : IO Unit
            LLVM.setLinkage fn LLVM.Linkage.internal
          if let some err ← LLVM.verifyModule emitLLVMCtx.llvmmodule then
            throw <| .userError err
-         LLVM.writeBitcodeToFile emitLLVMCtx.llvmmodule filepath
+         if thinLTO then
+           LLVM.writeThinLTOBitcodeToFile emitLLVMCtx.llvmmodule filepath
+         else
+           LLVM.writeBitcodeToFile emitLLVMCtx.llvmmodule filepath
          LLVM.disposeModule emitLLVMCtx.llvmmodule
   | .error err => throw (IO.Error.userError err)
 end Lean.IR
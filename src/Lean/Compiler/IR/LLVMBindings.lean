@@ -108,6 +108,10 @@ opaque moduleToString (m : Module ctx) : BaseIO String
 @[extern "lean_llvm_write_bitcode_to_file"]
 opaque writeBitcodeToFile (m : Module ctx) (path : @&String) : BaseIO Unit
 
+/-- Like `writeBitcodeToFile`, but includes the module summary needed for cross-module optimization with ThinLTO. -/
+@[extern "lean_llvm_write_thin_lto_bitcode_to_file"]
+opaque writeThinLTOBitcodeToFile (m : Module ctx) (path : @&String) : BaseIO Unit
+
 @[extern "lean_llvm_add_function"]
 opaque addFunction (m : Module ctx) (name : @&String) (type : LLVMType ctx) : BaseIO (Value ctx)
 
@@ -27,6 +27,12 @@ Here are the main differences:
   the last occurrence of the variable `x`.
 - Because we have join points in the actual implementation, a variable may be live even if it
   does not occur in a function body. See example at `livevars.lean`.
+
+Remark: the transformation is intraprocedural. A memory cell released by a `reset` can only be
+reused by a constructor application in the same function body; there is no calling convention
+for passing reuse tokens to callees. Helpers that destruct an exclusive value and build a value
+of the same shape (e.g., `balance1` and `balance2` in `RBMap`) should thus be marked `@[inline]`,
+so that their constructor applications become visible here after inlining.
 -/
 
 private def mayReuse (c₁ c₂ : CtorInfo) (relaxedReuse : Bool) : Bool :=
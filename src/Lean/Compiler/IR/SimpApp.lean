@@ -0,0 +1,60 @@
+/-
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+-/
+prelude
+import Lean.Compiler.IR.CompilerM
+import Lean.Compiler.IR.ElimDeadVars
+
+namespace Lean.IR.SimpApp
+/-!
+Replace `ap x zs` with `fap f (ys ++ zs)` when `x` was created by `let x := pap f ys` in the same declaration and the
+number of arguments is the arity of `f`, and with `pap f (ys ++ zs)` when there are fewer arguments. Variables are
+immutable and `ys` is still in scope, so the function invoked by `x` is known statically, and we do not need to go
+through `lean_apply_<n>`. This pass runs before explicit boxing and reference counting, which adapt the new
+applications to the actual signature of `f`.
+-/
+
+abbrev PapMap := RBMap VarId (FunId × Array Arg) (fun x y => compare x.idx y.idx)
+
+structure Context where
+  env   : Environment
+  decls : Array Decl
+
+def simpAp (ctx : Context) (m : PapMap) (x : VarId) (zs : Array Arg) : Option Expr := do
+  let (f, ys) ← m.find? x
+  let decl ← findEnvDecl' ctx.env f ctx.decls
+  let n := ys.size + zs.size
+  if n == decl.params.size then
+    return .fap f (ys ++ zs)
+  else if n < decl.params.size then
+    return .pap f (ys ++ zs)
+  else
+    none
+
+partial def visit (ctx : Context) (m : PapMap) : FnBody → FnBody
+  | .vdecl x t v b =>
+    let v := match v with
+      | .ap y zs => simpAp ctx m y zs |>.getD v
+      | _        => v
+    let m := match v with
+      | .pap f ys => m.insert x (f, ys)
+      | _         => m
+    .vdecl x t v (visit ctx m b)
+  | .jdecl j xs v b        => .jdecl j xs (visit ctx m v) (visit ctx m b)
+  | .case tid x xType alts => .case tid x xType (alts.map (·.modifyBody (visit ctx m)))
+  | b                      => if b.isTerminal then b else b.setBody (visit ctx m b.body)
+
+end SimpApp
+
+/-- Call closures created in `d` directly. `decls` are the declarations being compiled together with `d`. -/
+def Decl.simpApp (env : Environment) (decls : Array Decl) (d : Decl) : Decl :=
+  match d with
+  | .fdecl (body := b) .. => (d.updateBody! (SimpApp.visit { env, decls } {} b)).elimDead
+  | other                 => other
+
+def simpApp (decls : Array Decl) : CompilerM (Array Decl) := do
+  let env ← getEnv
+  return decls.map (Decl.simpApp env decls)
+
+end Lean.IR
@@ -0,0 +1,136 @@
+/-
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+-/
+prelude
+import Lean.Compiler.IR.CompilerM
+
+namespace Lean.IR.SimpRC
+/-!
+Remove redundant reference counting instructions inserted by `explicitRC`. The instructions are placed per block, so
+we often get
+- `inc x; dec x`,
+- `case` alternatives that all start with the same `inc x`, and
+- jumps `inc x; jmp j ys` to a join point whose body starts with `dec x`.
+
+The state is the number of increments and decrements removed.
+-/
+
+abbrev M := StateM Nat
+
+private def removed (n : Nat) : M Unit :=
+  modify (· + n)
+
+private def mkInc (x : VarId) (n : Nat) (c p : Bool) (b : FnBody) : FnBody :=
+  if n == 0 then b else FnBody.inc x n c p b
+
+/-- Number of jumps to `j` in `b`. -/
+partial def countJmps (j : JoinPointId) : FnBody → Nat
+  | .jdecl _ _ v b      => countJmps j v + countJmps j b
+  | .case _ _ _ alts    => alts.foldl (fun n alt => n + countJmps j alt.body) 0
+  | .jmp j' _           => if j' == j then 1 else 0
+  | .ret _              => 0
+  | .unreachable        => 0
+  | b                   => countJmps j b.body
+
+/-- If `b` is a sequence of `inc` instructions followed by `jmp j ys`, return `ys`. -/
+private partial def trailingJmp? (j : JoinPointId) : FnBody → Option (Array Arg)
+  | .inc _ _ _ _ b => trailingJmp? j b
+  | .jmp j' ys     => if j' == j then some ys else none
+  | _              => none
+
+/-- Remove one increment of `z` from the sequence of `inc` instructions `b`. -/
+private partial def removeIncOf (z : VarId) : FnBody → Option FnBody
+  | .inc x n c p b =>
+    if x == z then some (mkInc x (n-1) c p b)
+    else (FnBody.inc x n c p ·) <$> removeIncOf z b
+  | _ => none
+
+/--
+Remove one increment of the variable passed for `y` right before each `jmp j ys` in `b`, where `y` is either the
+parameter at position `idx?` or a variable in the scope of `j`. Return `none` if some jump is not preceded by such
+an increment.
+-/
+private partial def removeIncs (j : JoinPointId) (idx? : Option Nat) (y : VarId) (b : FnBody) : Option FnBody :=
+  match b with
+  | .inc x n c p k =>
+    match trailingJmp? j b with
+    | some ys =>
+      let z? := match idx? with
+        | none   => some y
+        | some i => match ys[i]? with
+          | some (.var z) => some z
+          | _             => none
+      z? >>= (removeIncOf · b)
+    | none => do return .inc x n c p (← removeIncs j idx? y k)
+  | .jdecl j' xs v k       => do return .jdecl j' xs (← removeIncs j idx? y v) (← removeIncs j idx? y k)
+  | .case tid x xType alts => do return .case tid x xType (← alts.mapM (·.mmodifyBody (removeIncs j idx? y)))
+  | .jmp j' _              => if j' == j then none else some b
+  | .ret _                 => some b
+  | .unreachable           => some b
+  | _                      => do return b.setBody (← removeIncs j idx? y b.body)
+
+/--
+If the body `v` of the join point `j` starts with `dec y`, and every jump to `j` in its scope `b` is preceded by an
+increment of the variable passed for `y`, remove both.
+-/
+private partial def elimJP (j : JoinPointId) (xs : Array Param) (v b : FnBody) : M FnBody := do
+  if let .dec y 1 _ _ v' := v then
+    let n := countJmps j b
+    if n > 0 && countJmps j v' == 0 then
+      if let some b' := removeIncs j (xs.findIdx? (·.x == y)) y b then
+        removed (n + 1)
+        return (← elimJP j xs v' b')
+  return .jdecl j xs v b
+
+/-- If all the alternatives start with the same `inc`, execute it before the `case`. -/
+private partial def hoistIncs (tid : Name) (x : VarId) (xType : IRType) (alts : Array Alt) : M FnBody := do
+  if alts.size > 1 then
+    if let .inc y n c p _ := alts[0]!.body then
+      let common := alts.all fun alt => match alt.body with
+        | .inc y' n' c' p' _ => y' == y && n' == n && c' == c && p' == p
+        | _                  => false
+      if common then
+        removed ((alts.size - 1) * n)
+        return .inc y n c p (← hoistIncs tid x xType (alts.map (·.modifyBody FnBody.body)))
+  return .case tid x xType alts
+
+partial def visit : FnBody → M FnBody
+  | .jdecl j xs v b => do
+    elimJP j xs (← visit v) (← visit b)
+  | .inc x n c p b => do
+    let b ← visit b
+    if let .dec y 1 _ _ b' := b then
+      if x == y then
+        removed 2
+        return mkInc x (n-1) c p b'
+    return .inc x n c p b
+  | .case tid x xType alts => do
+    hoistIncs tid x xType (← alts.mapM (·.mmodifyBody visit))
+  | b => do
+    if b.isTerminal then
+      return b
+    else
+      return b.setBody (← visit b.body)
+
+end SimpRC
+
+/-- Remove redundant `inc` and `dec` instructions, and return the number of increments and decrements removed. -/
+def Decl.simpRC (d : Decl) : Decl × Nat :=
+  match d with
+  | .fdecl (body := b) .. =>
+    let (b, n) := SimpRC.visit b |>.run 0
+    (d.updateBody! b, n)
+  | other => (other, 0)
+
+def simpRC (decls : Array Decl) : CompilerM (Array Decl) := do
+  let mut total := 0
+  let mut result := #[]
+  for decl in decls do
+    let (decl, n) := decl.simpRC
+    total := total + n
+    result := result.push decl
+  logMessageIf `simp_rc s!"removed {total} reference counting operations"
+  return result
+
+end Lean.IR
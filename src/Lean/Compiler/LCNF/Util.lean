@@ -5,6 +5,7 @@ Authors: Leonardo de Moura
 -/
 prelude
 import Init.Data.FloatArray.Basic
+import Init.Data.UIntArray.Basic
 import Lean.CoreM
 import Lean.MonadEnv
 import Lean.Util.Recognizers
@@ -83,6 +84,7 @@ def builtinRuntimeTypes : List Name := [
   ``Float,
   ``Thunk, ``Task,
   ``Array, ``ByteArray, ``FloatArray,
+  ``UInt16Array, ``UInt32Array, ``UInt64Array, ``USizeArray,
   ``Nat, ``Int
 ]
 
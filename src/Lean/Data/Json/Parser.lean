@@ -213,7 +213,16 @@ end Json.Parser
 
 namespace Json
 
+/--
+Native implementation of `Json.Parser.any`. Returns `none` if parsing fails, and on inputs it does
+not support (values nested too deeply or very large exponents).
+-/
+@[extern "lean_json_parse"]
+opaque parseNative? (s : @& String) : Option Lean.Json
+
 def parse (s : String) : Except String Lean.Json :=
+  -- the Lean parser is only used for the inputs rejected by `parseNative?`, and for its error messages
+  if let some j := parseNative? s then Except.ok j else
   match Json.Parser.any s.mkIterator with
   | Parsec.ParseResult.success _ res => Except.ok res
   | Parsec.ParseResult.error it err  => Except.error s!"offset {repr it.i.byteIdx}: {err}"
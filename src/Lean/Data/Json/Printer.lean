@@ -74,7 +74,7 @@ protected inductive CompressWorkItem
   | comma
 
 open Json.CompressWorkItem in
-partial def compress (j : Json) : String :=
+partial def compressCore (j : Json) : String :=
   go "" [json j]
 where go (acc : String) : List Json.CompressWorkItem → String
   | []               => acc
@@ -95,6 +95,18 @@ where go (acc : String) : List Json.CompressWorkItem → String
   | objectEnd :: is                    => go (acc ++ "}") is
   | comma :: is                        => go (acc ++ ",") is
 
+/--
+Native implementation of `compressCore`. Returns `none` if `j` contains a number whose exponent is
+not a small natural number.
+-/
+@[extern "lean_json_compress"]
+opaque compressNative? (j : @& Json) : Option String
+
+def compress (j : Json) : String :=
+  match compressNative? j with
+  | some s => s
+  | none   => compressCore j
+
 instance : ToFormat Json := ⟨render⟩
 instance : ToString Json := ⟨pretty⟩
 
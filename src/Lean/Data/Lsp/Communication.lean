@@ -71,6 +71,22 @@ section
     catch e =>
       throw $ userError s!"Cannot read LSP message: {e}"
 
+  /--
+  Like `readLspMessage`, but also returns the JSON content of the message as it was read. Messages that are
+  forwarded unchanged can be written using `writeLspMessageRaw` with this content, which avoids serializing
+  them again. -/
+  def readLspMessageWithContent (h : FS.Stream) : IO (Message × String) := do
+    try
+      let nBytes ← readLspHeader h
+      let bytes ← h.read (USize.ofNat nBytes)
+      let some content := String.fromUTF8? bytes | throw (IO.userError "invalid UTF-8")
+      let j ← ofExcept (Json.parse content)
+      match fromJson? j with
+      | Except.ok m => pure (m, content)
+      | Except.error inner => throw $ userError s!"JSON '{j.compress}' did not have the format of a JSON-RPC message.\n{inner}"
+    catch e =>
+      throw $ userError s!"Cannot read LSP message: {e}"
+
   def readLspRequestAs (h : FS.Stream) (expectedMethod : String) (α) [FromJson α] : IO (Request α) := do
     try
       let nBytes ← readLspHeader h
@@ -96,14 +112,17 @@ end
 section
   variable [ToJson α]
 
-  def writeLspMessage (h : FS.Stream) (msg : Message) : IO Unit := do
+  /-- Writes an LSP message given by its already serialized JSON content. -/
+  def writeLspMessageRaw (h : FS.Stream) (content : String) : IO Unit := do
     -- inlined implementation instead of using jsonrpc's writeMessage
     -- to maintain the atomicity of putStr
-    let j := (toJson msg).compress
-    let header := s!"Content-Length: {toString j.utf8ByteSize}\r\n\r\n"
-    h.putStr (header ++ j)
+    let header := s!"Content-Length: {toString content.utf8ByteSize}\r\n\r\n"
+    h.putStr (header ++ content)
     h.flush
 
+  def writeLspMessage (h : FS.Stream) (msg : Message) : IO Unit :=
+    h.writeLspMessageRaw (toJson msg).compress
+
   def writeLspRequest (h : FS.Stream) (r : Request α) : IO Unit :=
     h.writeLspMessage r
 
@@ -76,12 +76,18 @@ private def lineStartPos (text : FileMap) (line : Nat) : String.Pos :=
 from an LSP-style 0-indexed (ln, col) position. -/
 def lspPosToUtf8Pos (text : FileMap) (pos : Lsp.Position) : String.Pos :=
   let lineStartPos := lineStartPos text pos.line
-  let chr := text.source.utf16PosToCodepointPosFrom pos.character lineStartPos
-  text.source.codepointPosToUtf8PosFrom lineStartPos chr
+  if text.isAsciiLinePrefix pos.line pos.character then
+    lineStartPos + ⟨pos.character⟩
+  else
+    let chr := text.source.utf16PosToCodepointPosFrom pos.character lineStartPos
+    text.source.codepointPosToUtf8PosFrom lineStartPos chr
 
 def leanPosToLspPos (text : FileMap) : Lean.Position → Lsp.Position
   | ⟨line, col⟩ =>
-    ⟨line - 1, text.source.codepointPosToUtf16PosFrom col (lineStartPos text (line - 1))⟩
+    if text.isAsciiLinePrefix (line - 1) col then
+      ⟨line - 1, col⟩
+    else
+      ⟨line - 1, text.source.codepointPosToUtf16PosFrom col (lineStartPos text (line - 1))⟩
 
 def utf8PosToLspPos (text : FileMap) (pos : String.Pos) : Lsp.Position :=
   text.leanPosToLspPos (text.toPosition pos)
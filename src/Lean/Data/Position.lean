@@ -39,6 +39,10 @@ structure FileMap where
   The first entry is always `0` and the last always the index of the last character.
   In particular, if the last character is a newline, that index will appear twice. -/
   positions : Array String.Pos
+  /-- `asciiLines[i]` is `true` if the `i`-th line, i.e. the text between `positions[i]` and `positions[i+1]`,
+  only contains ASCII characters. In such a line, code point, UTF-16 and UTF-8 offsets coincide, so that converting
+  between them does not have to scan the line. Lines not covered by the array are treated as non-ASCII. -/
+  asciiLines : Array Bool := #[]
   deriving Inhabited
 
 class MonadFileMap (m : Type → Type) where
@@ -59,25 +63,35 @@ def getLine (fmap : FileMap) (x : Nat) : Nat :=
   min (x + 1) fmap.getLastLine
 
 partial def ofString (s : String) : FileMap :=
-  let rec loop (i : String.Pos) (line : Nat) (ps : Array String.Pos) : FileMap :=
-    if s.atEnd i then { source := s, positions := ps.push i }
+  let rec loop (i : String.Pos) (line : Nat) (ps : Array String.Pos) (ascii : Bool) (as : Array Bool) : FileMap :=
+    if s.atEnd i then { source := s, positions := ps.push i, asciiLines := as.push ascii }
     else
       let c := s.get i
       let i := s.next i
-      if c == '\n' then loop i (line+1) (ps.push i)
-      else loop i line ps
-  loop 0 1 (#[0])
+      if c == '\n' then loop i (line+1) (ps.push i) true (as.push ascii)
+      else loop i line ps (ascii && c.val < 128) as
+  loop 0 1 (#[0]) true #[]
+
+/--
+Returns `true` if the 0-based line `line` only contains ASCII characters and has at least `n` bytes, counting its
+newline character. The first `n` code points, UTF-16 code units and bytes of the line then coincide.
+-/
+def isAsciiLinePrefix (fmap : FileMap) (line : Nat) (n : Nat) : Bool :=
+  fmap.asciiLines.getD line false && line + 1 < fmap.positions.size &&
+    n ≤ (fmap.positions[line + 1]! - fmap.positions[line]!).byteIdx
 
 partial def toPosition (fmap : FileMap) (pos : String.Pos) : Position :=
   match fmap with
-  | { source := str, positions := ps } =>
+  | { source := str, positions := ps, .. } =>
     if ps.size >= 2 && pos <= ps.back then
       let rec toColumn (i : String.Pos) (c : Nat) : Nat :=
         if i == pos || str.atEnd i then c
         else toColumn (str.next i) (c+1)
       let rec loop (b e : Nat) :=
         let posB := ps[b]!
-        if e == b + 1 then { line := fmap.getLine b, column := toColumn posB 0 }
+        if e == b + 1 then
+          let column := if fmap.asciiLines.getD b false then (pos - posB).byteIdx else toColumn posB 0
+          { line := fmap.getLine b, column }
         else
           let m := (b + e) / 2;
           let posM := ps.get! m;
@@ -102,7 +116,10 @@ def ofPosition (text : FileMap) (pos : Position) : String.Pos :=
       0
     else
       text.positions.back
-  String.Iterator.nextn ⟨text.source, colPos⟩ pos.column |>.pos
+  if text.isAsciiLinePrefix (pos.line - 1) pos.column then
+    colPos + ⟨pos.column⟩
+  else
+    String.Iterator.nextn ⟨text.source, colPos⟩ pos.column |>.pos
 
 /--
 Returns the position of the start of (1-based) line `line`.
@@ -113,6 +130,55 @@ def lineStart (map : FileMap) (line : Nat) : String.Pos :=
     map.positions.get ⟨line - 1, h⟩
   else map.positions.back?.getD 0
 
+/--
+Replaces the text between `start` and `stop` with `newText`. The result coincides with
+`(text.source.extract 0 start ++ newText ++ text.source.extract stop text.source.endPos).toFileMap`,
+but only `newText` and the lines containing `start` and `stop` are scanned: the line table is copied
+before the edit and shifted after it.
+-/
+def replace (text : FileMap) (start stop : String.Pos) (newText : String) : FileMap := Id.run do
+  let src := text.source
+  let source := src.extract 0 start ++ newText ++ src.extract stop src.endPos
+  let ps := text.positions
+  if ps.size < 2 || stop < start || src.endPos < stop then
+    return ofString source
+  -- `ps[0:numLines]` are the starts of the lines
+  let numLines := ps.size - 1
+  -- `a` is the line containing `start`, and `b` the first line starting after `stop`
+  let mut a := 0
+  let mut b := numLines
+  while a + 1 < b do
+    let m := (a + b) / 2
+    if ps[m]! ≤ start then a := m else b := m
+  b := numLines
+  let mut lo := a
+  while lo + 1 < b do
+    let m := (lo + b) / 2
+    if ps[m]! ≤ stop then lo := m else b := m
+  let isAscii (line : Nat) (p q : String.Pos) : Bool :=
+    text.asciiLines.getD line false || (Substring.mk src p q).all (·.val < 128)
+  let mut positions := ps.extract 0 (a + 1)
+  let mut asciiLines := text.asciiLines.extract 0 a
+  while asciiLines.size < a do
+    asciiLines := asciiLines.push false
+  let mut ascii := isAscii a ps[a]! start
+  let mut i : String.Pos := 0
+  while !newText.atEnd i do
+    let c := newText.get i
+    i := newText.next i
+    if c == '\n' then
+      positions := positions.push (start + i)
+      asciiLines := asciiLines.push ascii
+      ascii := true
+    else
+      ascii := ascii && c.val < 128
+  ascii := ascii && isAscii (b - 1) stop (if b < numLines then ps[b]! else src.endPos)
+  for j in [b:numLines] do
+    positions := positions.push ⟨ps[j]!.byteIdx - stop.byteIdx + start.byteIdx + newText.utf8ByteSize⟩
+    asciiLines := asciiLines.push ascii
+    ascii := text.asciiLines.getD j false
+  return { source, positions := positions.push source.endPos, asciiLines := asciiLines.push ascii }
+
 end FileMap
 end Lean
 
@@ -160,6 +160,8 @@ def runFrontend
       commandState := { commandState with infoState.enabled := true }
 
     let s ← IO.processCommands inputCtx parserState commandState
+    let kernelMsgs ← waitAsyncKernelChecks s.commandState.env opts fileName inputCtx.fileMap
+    let s := { s with commandState.messages := s.commandState.messages ++ kernelMsgs }
     Language.reportMessages s.commandState.messages opts jsonOutput
 
     if let some ileanFileName := ileanFileName? then
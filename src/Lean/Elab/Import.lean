@@ -42,4 +42,15 @@ def printImports (input : String) (fileName : Option String) : IO Unit := do
     let fname ← findOLean dep.module
     IO.println fname
 
+/-- The `.olean` files of the modules imported by the header of `input`. -/
+@[export lean_find_import_oleans]
+def findImportOLeans (input : String) (fileName : Option String) : IO (Array String) := do
+  let (deps, _, _) ← parseImports input fileName
+  deps.mapM fun dep => return (← findOLean dep.module).toString
+
+/-- The `.olean` files of all modules imported by `env`, directly or indirectly. -/
+@[export lean_get_imported_oleans]
+def getImportedOLeans (env : Environment) : IO (Array String) :=
+  env.allImportedModuleNames.mapM fun mod => return (← findOLean mod).toString
+
 end Lean.Elab
@@ -30,6 +30,11 @@ register_builtin_option inductive.autoPromoteIndices : Bool := {
     descr    := "Promote indices to parameters in inductive types whenever possible."
   }
 
+register_builtin_option inductive.lazyBInductionOn : Bool := {
+    defValue := false
+    descr    := "Generate the `ibelow` and `binductionOn` constructions of inductive types when they are first referenced instead of when the type is declared. Two modules that both generate the constructions of the same imported type cannot be imported together."
+  }
+
 def checkValidInductiveModifier [Monad m] [MonadError m] (modifiers : Modifiers) : m Unit := do
   if modifiers.isNoncomputable then
     throwError "invalid use of 'noncomputable' in inductive declaration"
@@ -643,17 +648,19 @@ private def mkAuxConstructions (views : Array InductiveView) : TermElabM Unit :=
   let hasHEq  := env.contains ``HEq
   let hasUnit := env.contains ``PUnit
   let hasProd := env.contains ``Prod
+  let lazyBInductionOn := inductive.lazyBInductionOn.get (← getOptions)
   for view in views do
     let n := view.declName
     mkRecOn n
     if hasUnit then mkCasesOn n
     if hasUnit && hasEq && hasHEq then mkNoConfusion n
     if hasUnit && hasProd then mkBelow n
-    if hasUnit && hasProd then mkIBelow n
+    if hasUnit && hasProd then
+      if lazyBInductionOn then modifyEnv (lazyBInductionOnExt.tag · n) else mkIBelow n
   for view in views do
     let n := view.declName;
     if hasUnit && hasProd then mkBRecOn n
-    if hasUnit && hasProd then mkBInductionOn n
+    if hasUnit && hasProd && !lazyBInductionOn then mkBInductionOn n
 
 private def getArity (indType : InductiveType) : MetaM Nat :=
   forallTelescopeReducing indType.type fun xs _ => return xs.size
@@ -5,6 +5,7 @@ Authors: Leonardo de Moura
 -/
 prelude
 import Lean.Util.HasConstCache
+import Lean.Meta.Constructions
 import Lean.Meta.Match.MatcherApp.Transform
 import Lean.Elab.RecAppSyntax
 import Lean.Elab.PreDefinition.Basic
@@ -180,6 +181,8 @@ def mkBRecOn (recFnName : Name) (recArgInfo : RecArgInfo) (value : Expr) : M Exp
     brecOnUniv ← decLevel brecOnUniv
   let motive ← mkLambdaFVars (recArgInfo.indIndices.push major) motive
   trace[Elab.definition.structural] "brecOn motive: {motive}"
+  if useBInductionOn then
+    discard <| ensureBInductionOn recArgInfo.indName
   let brecOn :=
     if useBInductionOn then
       Lean.mkConst (mkBInductionOnName recArgInfo.indName) recArgInfo.indLevels
@@ -4,6 +4,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Authors: Leonardo de Moura
 -/
 prelude
+import Lean.Meta.Constructions
 import Lean.Elab.PreDefinition.Structural.Basic
 
 namespace Lean.Elab.Structural
@@ -86,7 +87,7 @@ partial def findRecArg (numFixed : Nat) (xs : Array Expr) (k : RecArgInfo → M
         matchConstInduct xType.getAppFn (fun _ => go (i+1) firstPass) fun indInfo us => do
         if !(← hasConst (mkBRecOnName indInfo.name)) then
           go (i+1) firstPass
-        else if indInfo.isReflexive && !(← hasConst (mkBInductionOnName indInfo.name)) && !(← isInductivePredicate indInfo.name) then
+        else if indInfo.isReflexive && !(← ensureBInductionOn indInfo.name) && !(← isInductivePredicate indInfo.name) then
           go (i+1) firstPass
         else
           let indArgs    := xType.getAppArgs
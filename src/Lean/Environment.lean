@@ -8,6 +8,7 @@ import Init.Control.StateRef
 import Init.Data.Array.BinSearch
 import Init.Data.Stream
 import Lean.Data.HashMap
+import Lean.Data.Json.FromToJson
 import Lean.ImportingFlag
 import Lean.Data.SMap
 import Lean.Declaration
@@ -54,6 +55,18 @@ opaque CompactedRegion.isMemoryMapped : CompactedRegion → Bool
 @[extern "lean_compacted_region_free"]
 unsafe opaque CompactedRegion.free : CompactedRegion → IO Unit
 
+/-- Size of the compacted region in bytes. -/
+@[extern "lean_compacted_region_size"]
+opaque CompactedRegion.size : CompactedRegion → USize
+
+/--
+Returns the total size in bytes of the distinct objects reachable from `a`, i.e., shared objects are counted once.
+Objects contained in one of the compacted regions `excluded` and the objects only reachable through them are not
+counted.
+-/
+@[extern "lean_object_graph_size"]
+opaque objectGraphSize {α : Type} (a : @& α) (excluded : @& Array CompactedRegion := #[]) : BaseIO USize
+
 /-- Opaque persistent environment extension entry. -/
 opaque EnvExtensionEntrySpec : NonemptyType.{0}
 def EnvExtensionEntry : Type := EnvExtensionEntrySpec.type
@@ -175,9 +188,30 @@ def find? (env : Environment) (n : Name) : Option ConstantInfo :=
   /- It is safe to use `find'` because we never overwrite imported declarations. -/
   env.constants.find?' n
 
+/-- Look up all names in `ns` at once. This is used by the kernel to avoid crossing into Lean once per name. -/
+@[export lean_environment_find_many]
+def findMany (env : Environment) (ns : Array Name) : Array (Option ConstantInfo) :=
+  ns.map env.find?
+
 def contains (env : Environment) (n : Name) : Bool :=
   env.constants.contains n
 
+/--
+Applies `f` in parallel to slices of at most `chunkSize` constants of `env`, without building a list of all constants.
+The constants of each imported module are visited as slices of its `ModuleData.constants`, in the order of
+`allImportedModuleNames`, followed by the constants added to `env` since the import. The result contains one task
+per slice, in the same order.
+-/
+def mapConstantsPar (env : Environment) (f : Subarray ConstantInfo → α) (chunkSize := 4096)
+    (prio := Task.Priority.default) : Array (Task α) := Id.run do
+  let chunkSize := max chunkSize 1
+  let locals := env.constants.map₂.foldl (fun cs _ c => cs.push c) #[]
+  let mut tasks := #[]
+  for cs in (env.header.moduleData.map (·.constants)).push locals do
+    for i in [0:cs.size:chunkSize] do
+      tasks := tasks.push <| Task.spawn (prio := prio) fun _ => f cs[i:i+chunkSize]
+  return tasks
+
 def imports (env : Environment) : Array Import :=
   env.header.imports
 
@@ -207,6 +241,10 @@ private def getTrustLevel (env : Environment) : UInt32 :=
 def getModuleIdxFor? (env : Environment) (declName : Name) : Option ModuleIdx :=
   env.const2ModIdx.find? declName
 
+@[export lean_environment_is_imported_const]
+private def isImportedConst (env : Environment) (declName : Name) : Bool :=
+  env.const2ModIdx.contains declName
+
 def isConstructor (env : Environment) (declName : Name) : Bool :=
   match env.find? declName with
   | some (.ctorInfo _) => true
@@ -242,12 +280,37 @@ inductive KernelException where
   | deepRecursion
   | interrupted
 
+/-- Resources used by the kernel to check a declaration, see `Environment.addDeclWithStats`. -/
+structure KernelCheckStats where
+  /-- Number of kernel heartbeats, the unit of the `maxHeartbeats` argument of `Environment.addDeclCore`. -/
+  heartbeats    : UInt64
+  /-- Wall-clock time, in nanoseconds. -/
+  timeNs        : UInt64
+  /-- Largest number of entries in the `infer_type`, `whnf_core` and `whnf` caches of a kernel type checker. -/
+  peakCacheSize : UInt64
+  deriving Inhabited, Repr
+
 namespace Environment
 
 /-- Type check given declaration and add it to the environment -/
 @[extern "lean_add_decl"]
 opaque addDeclCore (env : Environment) (maxHeartbeats : USize) (decl : @& Declaration) : Except KernelException Environment
 
+/--
+Like `addDeclCore`, but also return the resources used by the kernel to check `decl`, so that declarations
+approaching the heartbeat limit can be detected before they fail.
+-/
+@[extern "lean_add_decl_with_stats"]
+opaque addDeclWithStats (env : Environment) (maxHeartbeats : USize) (decl : @& Declaration) :
+    Except KernelException (Environment × KernelCheckStats)
+
+/--
+Add `decl` to `env` without type checking it. Inductive declarations are still checked.
+This is used to add theorems whose kernel check runs asynchronously, see `debug.kernel.asyncTheorems`.
+-/
+@[extern "lean_add_decl_without_checking"]
+opaque addDeclWithoutChecking (env : Environment) (decl : @& Declaration) : Except KernelException Environment
+
 end Environment
 
 namespace ConstantInfo
@@ -446,6 +509,8 @@ structure PersistentEnvExtension (α : Type) (β : Type) (σ : Type) where
   addEntryFn      : σ → β → σ
   exportEntriesFn : σ → Array α
   statsFn         : σ → Format
+  /-- See `PersistentEnvExtensionDescr.parallelImport`. -/
+  parallelImport  : Bool := false
 
 instance {α σ} [Inhabited σ] : Inhabited (PersistentEnvExtensionState α σ) :=
   ⟨{importedEntries := #[], state := default }⟩
@@ -493,6 +558,12 @@ structure PersistentEnvExtensionDescr (α β σ : Type) where
   addEntryFn      : σ → β → σ
   exportEntriesFn : σ → Array α
   statsFn         : σ → Format := fun _ => Format.nil
+  /--
+  If `true`, `addImportedFn` only depends on the imported entries: it neither reads `ImportM.Context.env` nor
+  has side effects. `finalizeImport` then runs it in a separate task, against an environment without constants or
+  extension states, concurrently with the other extensions.
+  -/
+  parallelImport  : Bool := false
 
 unsafe def registerPersistentEnvExtensionUnsafe {α β σ : Type} [Inhabited σ] (descr : PersistentEnvExtensionDescr α β σ) : IO (PersistentEnvExtension α β σ) := do
   let pExts ← persistentEnvExtensionsRef.get
@@ -510,7 +581,8 @@ unsafe def registerPersistentEnvExtensionUnsafe {α β σ : Type} [Inhabited σ]
     addImportedFn   := descr.addImportedFn,
     addEntryFn      := descr.addEntryFn,
     exportEntriesFn := descr.exportEntriesFn,
-    statsFn         := descr.statsFn
+    statsFn         := descr.statsFn,
+    parallelImport  := descr.parallelImport
   }
   persistentEnvExtensionsRef.modify fun pExts => pExts.push (unsafeCast pExt)
   return pExt
@@ -538,7 +610,8 @@ def registerSimplePersistentEnvExtension {α σ : Type} [Inhabited σ] (descr :
     addEntryFn      := fun s e => match s with
       | (entries, s) => (e::entries, descr.addEntryFn s e),
     exportEntriesFn := fun s => descr.toArrayFn s.1.reverse,
-    statsFn := fun s => format "number of local entries: " ++ format s.1.length
+    statsFn := fun s => format "number of local entries: " ++ format s.1.length,
+    parallelImport := true
   }
 
 namespace SimplePersistentEnvExtension
@@ -636,6 +709,39 @@ end MapDeclarationExtension
 opaque saveModuleData (fname : @& System.FilePath) (mod : @& Name) (data : @& ModuleData) : IO Unit
 @[extern "lean_read_module_data"]
 opaque readModuleData (fname : @& System.FilePath) : IO (ModuleData × CompactedRegion)
+/--
+  Read several module data files, opening and mapping them in parallel. Equivalent to `fnames.mapM readModuleData`,
+  except that if any file cannot be read, an error is returned and none of the regions are kept. -/
+@[extern "lean_read_module_data_many"]
+opaque readModuleDataMany (fnames : @& Array System.FilePath) : IO (Array (ModuleData × CompactedRegion))
+
+/--
+  Resources used by `readModuleData` and `readModuleDataMany` since the start of the process. The times are in
+  nanoseconds and summed over all threads. -/
+structure OleanLoadStats where
+  /-- Number of files loaded. -/
+  files       : UInt64
+  /-- Total size of the files loaded, after decompression. -/
+  bytes       : UInt64
+  /-- Number of files memory-mapped at their base address, which need not be relocated. -/
+  mappedFiles : UInt64
+  /-- Time spent opening the files and reading their headers. -/
+  openNs      : UInt64
+  /-- Time spent mapping, reading, decompressing and verifying the files. -/
+  readNs      : UInt64
+  /-- Time spent relocating the objects of the files and fixing up their headers. -/
+  fixupNs     : UInt64
+  /--
+  Number of bytes of the memory-mapped files that are currently resident in memory, i.e. that can be accessed without
+  a page fault. Always `0` on platforms without `mincore`. The files can be read in eagerly by setting the environment
+  variable `LEAN_OLEAN_PREFAULT`. -/
+  residentBytes : UInt64
+  /-- Number of memory-mapped files locked in memory as requested by the environment variable `LEAN_OLEAN_MLOCK`. -/
+  lockedFiles : UInt64
+  deriving Inhabited, Repr
+
+@[extern "lean_get_olean_load_stats"]
+opaque getOleanLoadStats : BaseIO OleanLoadStats
 
 /--
   Free compacted regions of imports. No live references to imported objects may exist at the time of invocation; in
@@ -719,9 +825,18 @@ private def setImportedEntries (env : Environment) (mods : Array ModuleData) (st
 @[extern 1 "lean_get_num_attributes"] opaque getNumBuiltinAttributes : IO Nat
 
 private partial def finalizePersistentExtensions (env : Environment) (mods : Array ModuleData) (opts : Options) : IO Environment := do
-  loop 0 env
+  -- Start the extensions that can be imported in parallel, see `PersistentEnvExtensionDescr.parallelImport`
+  let ctx : ImportM.Context := { env := { const2ModIdx := {}, constants := {}, extensions := #[], extraConstNames := {} }, opts }
+  let mut tasks := #[]
+  for extDescr in (← persistentEnvExtensionsRef.get) do
+    if extDescr.parallelImport then
+      let entries := (extDescr.toEnvExtension.getState env).importedEntries
+      tasks := tasks.push (some (← IO.asTask (extDescr.addImportedFn entries ctx)))
+    else
+      tasks := tasks.push none
+  loop tasks 0 env
 where
-  loop (i : Nat) (env : Environment) : IO Environment := do
+  loop (tasks : Array (Option (Task (Except IO.Error EnvExtensionState)))) (i : Nat) (env : Environment) : IO Environment := do
     -- Recall that the size of the array stored `persistentEnvExtensionRef` may increase when we import user-defined environment extensions.
     let pExtDescrs ← persistentEnvExtensionsRef.get
     if i < pExtDescrs.size then
@@ -729,7 +844,9 @@ where
       let s := extDescr.toEnvExtension.getState env
       let prevSize := (← persistentEnvExtensionsRef.get).size
       let prevAttrSize ← getNumBuiltinAttributes
-      let newState ← extDescr.addImportedFn s.importedEntries { env := env, opts := opts }
+      let newState ← match tasks[i]? with
+        | some (some task) => IO.ofExcept (← IO.wait task)
+        | _                => extDescr.addImportedFn s.importedEntries { env := env, opts := opts }
       let mut env := extDescr.toEnvExtension.setState env { s with state := newState }
       env ← ensureExtensionsArraySize env
       if (← persistentEnvExtensionsRef.get).size > prevSize || (← getNumBuiltinAttributes) > prevAttrSize then
@@ -739,7 +856,7 @@ where
         env ← setImportedEntries env mods prevSize
         -- See comment at `updateEnvAttributesRef`
         env ← updateEnvAttributes env
-      loop (i + 1) env
+      loop tasks (i + 1) env
     else
       return env
 
@@ -748,6 +865,8 @@ structure ImportState where
   moduleNames   : Array Name := #[]
   moduleData    : Array ModuleData := #[]
   regions       : Array CompactedRegion := #[]
+  /-- Module data read ahead of time by `prefetchImports`, but not imported yet. -/
+  prefetched    : HashMap Name (ModuleData × CompactedRegion) := {}
 
 def throwAlreadyImported (s : ImportState) (const2ModIdx : HashMap Name ModuleIdx) (modIdx : Nat) (cname : Name) : IO α := do
   let modName := s.moduleNames[modIdx]!
@@ -759,15 +878,38 @@ abbrev ImportStateM := StateRefT ImportState IO
 @[inline] nonrec def ImportStateM.run (x : ImportStateM α) (s : ImportState := {}) : IO (α × ImportState) :=
   x.run s
 
-partial def importModulesCore (imports : Array Import) : ImportStateM Unit := do
+/-- Read the .olean files of all `imports` that have not been imported yet in parallel. -/
+def prefetchImports (imports : Array Import) : ImportStateM Unit := do
+  let mut mods  := #[]
+  let mut files := #[]
   for i in imports do
-    if i.runtimeOnly || (← get).moduleNameSet.contains i.module then
+    let s ← get
+    if i.runtimeOnly || s.moduleNameSet.contains i.module || s.prefetched.contains i.module || mods.contains i.module then
       continue
-    modify fun s => { s with moduleNameSet := s.moduleNameSet.insert i.module }
     let mFile ← findOLean i.module
     unless (← mFile.pathExists) do
       throw <| IO.userError s!"object file '{mFile}' of module {i.module} does not exist"
-    let (mod, region) ← readModuleData mFile
+    mods  := mods.push i.module
+    files := files.push mFile
+  if files.size > 1 then
+    let data ← readModuleDataMany files
+    modify fun s => { s with prefetched := (mods.zip data).foldl (fun m (n, d) => m.insert n d) s.prefetched }
+
+partial def importModulesCore (imports : Array Import) : ImportStateM Unit := do
+  prefetchImports imports
+  for i in imports do
+    if i.runtimeOnly || (← get).moduleNameSet.contains i.module then
+      continue
+    modify fun s => { s with moduleNameSet := s.moduleNameSet.insert i.module }
+    let (mod, region) ← match (← get).prefetched.find? i.module with
+      | some data =>
+        modify fun s => { s with prefetched := s.prefetched.erase i.module }
+        pure data
+      | none =>
+        let mFile ← findOLean i.module
+        unless (← mFile.pathExists) do
+          throw <| IO.userError s!"object file '{mFile}' of module {i.module} does not exist"
+        readModuleData mFile
     importModulesCore mod.imports
     modify fun s => { s with
       moduleData  := s.moduleData.push mod
@@ -817,6 +959,12 @@ def finalizeImport (s : ImportState) (imports : Array Import) (opts : Options) (
     numConsts + mod.constants.size + mod.extraConstNames.size
   let mut const2ModIdx : HashMap Name ModuleIdx := mkHashMap (capacity := numConsts)
   let mut constantMap : HashMap Name ConstantInfo := mkHashMap (capacity := numConsts)
+  /-
+  Note that no name is rehashed here: `Name.hash` is a computed field stored in the compacted `.olean` regions.
+  A per-module index written by `saveModuleData` would not save the insertions either, since `SMap` needs one map
+  for the whole import closure, and querying the modules' indices in place would make every `find?` linear in the
+  number of imported modules.
+  -/
   for h:modIdx in [0:s.moduleData.size] do
     let mod := s.moduleData[modIdx]'h.upper
     for cname in mod.constNames, cinfo in mod.constants do
@@ -978,12 +1126,18 @@ private def add (env : Environment) (cinfo : ConstantInfo) : Environment :=
   let env := registerNamePrefixes env cinfo.name
   env.addAux cinfo
 
+/-- Add a block of constants, e.g., the declarations of a mutual block, in one call. -/
+@[export lean_environment_add_many]
+private def addMany (env : Environment) (cinfos : Array ConstantInfo) : Environment :=
+  cinfos.foldl add env
+
 @[export lean_display_stats]
 def displayStats (env : Environment) : IO Unit := do
   let pExtDescrs ← persistentEnvExtensionsRef.get
   IO.println ("direct imports:                        " ++ toString env.header.imports);
   IO.println ("number of imported modules:            " ++ toString env.header.regions.size);
   IO.println ("number of memory-mapped modules:       " ++ toString (env.header.regions.filter (·.isMemoryMapped) |>.size));
+  IO.println ("number of copied (non-mapped) modules: " ++ toString (env.header.regions.filter (!·.isMemoryMapped) |>.size));
   IO.println ("number of consts:                      " ++ toString env.constants.size);
   IO.println ("number of imported consts:             " ++ toString env.constants.stageSizes.1);
   IO.println ("number of local consts:                " ++ toString env.constants.stageSizes.2);
@@ -997,6 +1151,31 @@ def displayStats (env : Environment) : IO Unit := do
     unless fmt.isNil do IO.println ("  " ++ toString (Format.nest 2 (extDescr.statsFn s.state)))
     IO.println ("  number of imported entries: " ++ toString (s.importedEntries.foldl (fun sum es => sum + es.size) 0))
 
+/--
+Prints a JSON object describing the memory used by `env`: the size of the compacted region of each imported module,
+the size of the state of each persistent environment extension that is not contained in a compacted region, and the
+`numDecls` declarations using the most memory. Objects shared within an extension state or declaration are counted
+once, but are counted for each extension state or declaration that refers to them.
+-/
+@[export lean_display_memory_stats]
+def displayMemoryStats (env : Environment) (numDecls : Nat) : IO Unit := do
+  let regions := env.header.regions
+  let modules := env.header.moduleNames.zipWith regions fun n r =>
+    Json.mkObj [("name", toJson n), ("size", toJson r.size.toNat)]
+  let mut exts := #[]
+  for extDescr in (← persistentEnvExtensionsRef.get) do
+    let size ← objectGraphSize (extDescr.toEnvExtension.getState env) regions
+    exts := exts.push <| Json.mkObj [("name", toJson extDescr.name), ("size", toJson size.toNat)]
+  let mut decls : Array (Name × Nat) := #[]
+  let locals := env.constants.map₂.foldl (fun cs _ c => cs.push c) #[]
+  for cs in (env.header.moduleData.map (·.constants)).push locals do
+    for c in cs do
+      decls := decls.push (c.name, (← objectGraphSize c).toNat)
+  let decls := decls.qsort (·.2 > ·.2) |>.extract 0 numDecls |>.map fun (n, size) =>
+    Json.mkObj [("name", toJson n), ("size", toJson size)]
+  IO.println <| Json.compress <| Json.mkObj [
+    ("modules", toJson modules), ("extensions", toJson exts), ("declarations", toJson decls)]
+
 /--
   Evaluate the given declaration under the given environment to a value of the given type.
   This function is only safe to use if the type matches the declaration's type in the environment
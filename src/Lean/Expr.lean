@@ -760,7 +760,13 @@ namespace Expr
 @[extern "lean_expr_dbg_to_string"]
 opaque dbgToString (e : @& Expr) : String
 
-/-- A total order for expressions. We say it is quick because it first compares the hashcodes. -/
+/--
+A total order for expressions. We say it is quick because it first compares the hashcodes, and only compares the
+structure of expressions with the same hashcode. The order is compatible with `==`, but it is not semantic: it
+depends on the hash function, which may change between versions of Lean. It must only be used when the result of a
+computation does not depend on the order, e.g., for the keys of maps and caches. Use `Expr.lt` to order data that is
+visible to users.
+-/
 @[extern "lean_expr_quick_lt"]
 opaque quickLt (a : @& Expr) (b : @& Expr) : Bool
 
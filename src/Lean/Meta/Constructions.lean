@@ -7,6 +7,7 @@ prelude
 import Lean.AuxRecursor
 import Lean.AddDecl
 import Lean.Meta.AppBuilder
+import Lean.ReservedNameAction
 
 namespace Lean
 
@@ -32,6 +33,37 @@ def mkIBelow (declName : Name) : m Unit := adaptFn mkIBelowImp declName
 def mkBRecOn (declName : Name) : m Unit := adaptFn mkBRecOnImp declName
 def mkBInductionOn (declName : Name) : m Unit := adaptFn mkBInductionOnImp declName
 
+/--
+Inductive types whose `ibelow` and `binductionOn` constructions are generated when they are first referenced,
+see `inductive.lazyBInductionOn`.
+-/
+builtin_initialize lazyBInductionOnExt : TagDeclarationExtension ← mkTagDeclarationExtension
+
+/-- Returns `true` if `declName` is the deferred `ibelow` or `binductionOn` construction of an inductive type. -/
+def isLazyBInductionOnName (env : Environment) (declName : Name) : Bool :=
+  match declName with
+  | .str indName s => (s == "ibelow" || s == binductionOnSuffix) && lazyBInductionOnExt.isTagged env indName
+  | _ => false
+
+/--
+Generates the `ibelow` and `binductionOn` constructions of `indName` if they were deferred and have not been
+generated yet. Returns `true` if `binductionOn` exists afterwards.
+-/
+def ensureBInductionOn (indName : Name) : CoreM Bool := do
+  if lazyBInductionOnExt.isTagged (← getEnv) indName && !(← getEnv).contains (mkBInductionOnName indName) then
+    mkIBelow indName
+    mkBInductionOn indName
+  return (← getEnv).contains (mkBInductionOnName indName)
+
+builtin_initialize
+  registerReservedNamePredicate isLazyBInductionOnName
+
+  registerReservedNameAction fun name => do
+    let .str indName _ := name | return false
+    unless isLazyBInductionOnName (← getEnv) name do return false
+    discard <| ensureBInductionOn indName
+    return true
+
 open Meta
 
 def mkNoConfusionEnum (enumName : Name) : MetaM Unit := do
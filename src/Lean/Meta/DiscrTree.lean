@@ -471,16 +471,36 @@ where
       vs.push v
   termination_by vs.size - i
 
+/-- Returns the index of the first child in `cs` whose key is not less than `k`. -/
+private partial def lowerBound (cs : Array (Key × Trie α)) (k : Key) : Nat :=
+  go 0 cs.size
+where
+  go (lo hi : Nat) : Nat :=
+    if lo < hi then
+      let m := (lo + hi) / 2
+      if cs[m]!.1 < k then go (m + 1) hi else go lo m
+    else
+      lo
+
+/-
+Remark: the child to be updated is detached from `cs` (and from the root map in `insertCore`) before recursing.
+Otherwise it would be shared with its parent, and `insertAux` would copy every node on the key path instead of
+updating it in place. This matters when building the trees of large imported entry sets.
+-/
 private partial def insertAux [BEq α] (keys : Array Key) (v : α) : Nat → Trie α → Trie α
   | i, .node vs cs =>
     if h : i < keys.size then
       let k := keys.get ⟨i, h⟩
-      let c := Id.run $ cs.binInsertM
-          (fun a b => a.1 < b.1)
-          (fun ⟨_, s⟩ => let c := insertAux keys v (i+1) s; (k, c)) -- merge with existing
-          (fun _ => let c := createNodes keys v (i+1); (k, c))
-          (k, default)
-      .node vs c
+      let j := lowerBound cs k
+      if h : j < cs.size then
+        let (k', c) := cs.get ⟨j, h⟩
+        if k < k' then
+          .node vs (cs.insertAt! j (k, createNodes keys v (i+1)))
+        else
+          let cs := cs.set ⟨j, h⟩ (k, default)
+          .node vs (cs.set! j (k, insertAux keys v (i+1) c))
+      else
+        .node vs (cs.push (k, createNodes keys v (i+1)))
     else
       .node (insertVal vs v) cs
 
@@ -493,8 +513,9 @@ def insertCore [BEq α] (d : DiscrTree α) (keys : Array Key) (v : α) : DiscrTr
       let c := createNodes keys v 1
       { root := d.root.insert k c }
     | some c =>
+      let root := d.root.insert k default
       let c := insertAux keys v 1 c
-      { root := d.root.insert k c }
+      { root := root.insert k c }
 
 def insert [BEq α] (d : DiscrTree α) (e : Expr) (v : α) (config : WhnfCoreConfig) (noIndexAtArgs := false) : MetaM (DiscrTree α) := do
   let keys ← mkPath e config noIndexAtArgs
@@ -25,6 +25,11 @@ register_builtin_option synthInstance.maxSize : Nat := {
   descr := "maximum number of instances used to construct a solution in the type class instance synthesis procedure"
 }
 
+register_builtin_option synthInstance.persistentCache : Bool := {
+  defValue := false
+  descr := "reuse solutions of closed type class problems found in earlier commands and imported modules, and store new ones in the .olean file. A solution is only reused if the global instances that may solve the problem itself are still the same, instances used for its subgoals are not checked"
+}
+
 register_builtin_option backward.synthInstance.canonInstances : Bool := {
   defValue := true
   group    := "backward compatibility"
@@ -700,6 +705,30 @@ private def preprocessOutParam (type : Expr) : MetaM Expr :=
     | _ =>
       return type
 
+/-- A solution of a closed type class problem, see `synthInstance.persistentCache`. -/
+structure SynthInstanceCacheEntry where
+  type        : Expr
+  /-- `instancesFingerprint type` when `result` was found. -/
+  fingerprint : UInt64
+  result      : Expr
+  deriving Inhabited
+
+builtin_initialize synthInstanceCacheExt : SimplePersistentEnvExtension SynthInstanceCacheEntry (PHashMap Expr (UInt64 × Expr)) ←
+  registerSimplePersistentEnvExtension {
+    addEntryFn    := fun m e => m.insert e.type (e.fingerprint, e.result)
+    addImportedFn := fun es => mkStateFromImportedEntries (fun m e =>
+      if m.contains e.type then m else m.insert e.type (e.fingerprint, e.result)) {} es
+  }
+
+/-- Hash of the global instances that may be tried at the root of the problem `type`. -/
+private def instancesFingerprint (type : Expr) : MetaM UInt64 :=
+  forallTelescopeReducing type fun _ type => do
+    let erasedInstances ← getErasedInstances
+    let result ← (← getGlobalInstancesIndex).getUnify type tcDtConfig
+    return result.foldl (init := 7) fun h e =>
+      let declName := e.val.constName!
+      if erasedInstances.contains declName then h else mixHash h (mixHash (hash declName) (hash e.priority))
+
 /-!
   Remark: when `maxResultSize? == none`, the configuration option `synthInstance.maxResultSize` is used.
   Remark: we use a different option for controlling the maximum result size for coercions.
@@ -735,6 +764,15 @@ def synthInstance? (type : Expr) (maxResultSize? : Option Nat := none) : MetaM (
           return none
       pure result
     | none        =>
+      let persistent := synthInstance.persistentCache.get opts && localInsts.isEmpty &&
+        !type.hasFVar && !type.hasMVar && !type.hasLevelParam
+      let fingerprint ← if persistent then instancesFingerprint type else pure 0
+      if persistent then
+        if let some (fingerprint', result) := (synthInstanceCacheExt.getState (← getEnv)).find? type then
+          if fingerprint == fingerprint' then
+            trace[Meta.synthInstance] "result {result} (persistent cache)"
+            modify fun s => { s with cache.synthInstance := s.cache.synthInstance.insert cacheKey (some result) }
+            return some result
       let result? ← withNewMCtxDepth (allowLevelAssignments := true) do
         let normType ← preprocessOutParam type
         SynthInstance.main normType maxResultSize
@@ -775,6 +813,10 @@ def synthInstance? (type : Expr) (maxResultSize? : Option Nat := none) : MetaM (
           else
             pure none
       modify fun s => { s with cache.synthInstance := s.cache.synthInstance.insert cacheKey result? }
+      if persistent then
+        if let some result := result? then
+          unless result.hasFVar || result.hasMVar do
+            modifyEnv (synthInstanceCacheExt.addEntry · { type, fingerprint, result })
       pure result?
 
 /--
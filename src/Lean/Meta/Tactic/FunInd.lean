@@ -16,6 +16,7 @@ import Lean.Elab.PreDefinition.WF.Eqns
 import Lean.Elab.PreDefinition.Structural.Eqns
 import Lean.Elab.Command
 import Lean.Meta.Tactic.ElimInfo
+import Lean.Meta.Constructions
 
 /-!
 This module contains code to derive, from the definition of a recursive function (structural or
@@ -764,7 +765,9 @@ def findRecursor {α} (name : Name) (varNames : Array Name) (e : Expr)
             -- parameters correspond
             let us := f.constLevels!.drop 1
             let bInductionName ← match f.constName with
-              | .str indDeclName _ => pure <| mkBInductionOnName indDeclName
+              | .str indDeclName _ => do
+                discard <| ensureBInductionOn indDeclName
+                pure <| mkBInductionOnName indDeclName
               | _ => throwError "Unexpected brecOn name {f.constName}"
             pure <| mkAppN (.const bInductionName us) (args[:elimInfo.motivePos])
 
@@ -893,10 +893,11 @@ def reduceBinNatPred (f : Nat → Nat → Bool) (a b : Expr) : MetaM (Option Exp
 def reduceNat? (e : Expr) : MetaM (Option Expr) :=
   match e with
   | .app (.const fn _) a =>
-    if fn == ``Nat.succ then
-      reduceUnaryNatOp Nat.succ a
-    else
-      return none
+    match fn with
+    | ``Nat.succ => reduceUnaryNatOp Nat.succ a
+    | ``Nat.pred => reduceUnaryNatOp Nat.pred a
+    | ``Nat.log2 => reduceUnaryNatOp Nat.log2 a
+    | _ => return none
   | .app (.app (.const fn _) a1) a2 =>
     match fn with
     | ``Nat.add => reduceBinNatOp Nat.add a1 a2
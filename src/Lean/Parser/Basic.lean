@@ -564,7 +564,7 @@ partial def whitespace : ParserFn := fun c s =>
     else if curr == '-' then
       let i    := input.next' i h
       let curr := input.get i
-      if curr == '-' then andthenFn (takeUntilFn (fun c => c = '\n')) whitespace c (s.next input i)
+      if curr == '-' then whitespace c (s.setPos (input.posOfAux '\n' input.endPos (input.next i)))
       else s
     else if curr == '/' then
       let i        := input.next' i h
@@ -957,7 +957,8 @@ partial def identFnAux (startPos : String.Pos) (tk : Option Token) (r : Name) :
             mkIdResult startPos tk r c s
       else if isIdFirst curr then
         let startPart := i
-        let s         := takeWhileFn isIdRest c (s.next input i)
+        let s         := s.next input i
+        let s         := takeWhileFn isIdRest c (s.setPos (skipAsciiIdRest input s.pos))
         let stopPart  := s.pos
         let r := .str r (input.extract startPart stopPart)
         if isIdCont input s then
@@ -22,6 +22,12 @@ after replaying any inductive definitions occurring in `constantMap`.
 * a verifier for an `Environment`, by sending everything to the kernel, or
 * a mechanism to safely transfer constants from one `Environment` to another.
 
+With `parallel := true`, definitions, theorems, opaque constants and axioms are added to the environment
+without checking as soon as their dependencies have been replayed, and the kernel checks them in separate tasks,
+each against the environment it was added to. `replay` waits for all these tasks before returning.
+Inductive types and `Quot` are still checked sequentially, because they extend the environment
+with further constants.
+
 -/
 
 namespace Lean.Environment
@@ -30,6 +36,7 @@ namespace Replay
 
 structure Context where
   newConstants : HashMap Name ConstantInfo
+  parallel : Bool := false
 
 structure State where
   env : Environment
@@ -37,6 +44,8 @@ structure State where
   pending : NameSet := {}
   postponedConstructors : NameSet := {}
   postponedRecursors : NameSet := {}
+  /-- Kernel checks running in separate tasks, see `parallel`. -/
+  pendingChecks : Array (Task (Except KernelException Unit)) := #[]
 
 abbrev M := ReaderT Context <| StateRefT State IO
 
@@ -57,9 +66,23 @@ def throwKernelException (ex : KernelException) : M Unit := do
 
 /-- Add a declaration, possibly throwing a `KernelException`. -/
 def addDecl (d : Declaration) : M Unit := do
-  match (← get).env.addDecl {} d with
-  | .ok env => modify fun s => { s with env := env }
-  | .error ex => throwKernelException ex
+  let env := (← get).env
+  if (← read).parallel && !(d matches .inductDecl .. || d matches .quotDecl) then
+    let task := Task.spawn fun _ => (env.addDecl {} d).map fun _ => ()
+    match env.addDeclWithoutChecking d with
+    | .ok env => modify fun s => { s with env := env, pendingChecks := s.pendingChecks.push task }
+    | .error ex => throwKernelException ex
+  else
+    match env.addDecl {} d with
+    | .ok env => modify fun s => { s with env := env }
+    | .error ex => throwKernelException ex
+
+/-- Wait for the kernel checks started by `addDecl`, throwing the first `KernelException`, if any. -/
+def checkPendingChecks : M Unit := do
+  for task in (← get).pendingChecks do
+    match ← IO.wait task with
+    | .ok () => pure ()
+    | .error ex => throwKernelException ex
 
 mutual
 /--
@@ -154,8 +177,10 @@ open Replay
 
 Throws a `IO.userError` if the kernel rejects a constant,
 or if there are malformed recursors or constructors for inductive types.
+If `parallel` is set, independent declarations are checked concurrently.
 -/
-def replay (newConstants : HashMap Name ConstantInfo) (env : Environment) : IO Environment := do
+def replay (newConstants : HashMap Name ConstantInfo) (env : Environment) (parallel := false) :
+    IO Environment := do
   let mut remaining : NameSet := ∅
   for (n, ci) in newConstants.toList do
     -- We skip unsafe constants, and also partial constants.
@@ -163,9 +188,29 @@ def replay (newConstants : HashMap Name ConstantInfo) (env : Environment) : IO E
     if !ci.isUnsafe && !ci.isPartial then
       remaining := remaining.insert n
   let (_, s) ← StateRefT'.run (s := { env, remaining }) do
-    ReaderT.run (r := { newConstants }) do
+    ReaderT.run (r := { newConstants, parallel }) do
       for n in remaining do
         replayConstant n
+      checkPendingChecks
       checkPostponedConstructors
       checkPostponedRecursors
   return s.env
+
+/--
+Check all constants of the module `mod` with the kernel, trusting its imports.
+
+The constants are read from the module's `.olean` file, where they are stored as compacted, maximally shared terms,
+and replayed into the environment of its imports. Nothing is elaborated, so this only needs the `.olean` files of `mod`
+and its dependencies. The search path must be initialized.
+Throws a `IO.userError` if the kernel rejects a constant, see `replay`.
+-/
+unsafe def checkModule (mod : Name) (parallel := true) : IO Unit := do
+  let (data, region) ← readModuleData (← findOLean mod)
+  try
+    let mut newConstants : HashMap Name ConstantInfo := {}
+    for name in data.constNames, ci in data.constants do
+      newConstants := newConstants.insert name ci
+    withImportModules data.imports {} 0 fun env => do
+      discard <| env.replay newConstants parallel
+  finally
+    region.free
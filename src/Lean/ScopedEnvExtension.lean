@@ -37,6 +37,8 @@ structure Descr (α : Type) (β : Type) (σ : Type) where
   toOLeanEntry   : β → α
   addEntry       : σ → β → σ
   finalizeImport : σ → σ := id
+  /-- See `PersistentEnvExtensionDescr.parallelImport`, which `ofOLeanEntry` must satisfy when this is `true`. -/
+  parallelImport : Bool := false
 
 instance [Inhabited α] : Inhabited (Descr α β σ) where
   default := {
@@ -112,6 +114,7 @@ unsafe def registerScopedEnvExtensionUnsafe (descr : Descr α β σ) : IO (Scope
     addEntryFn      := addEntryFn descr
     exportEntriesFn := exportEntriesFn
     statsFn         := fun s => format "number of local entries: " ++ format s.newEntries.length
+    parallelImport  := descr.parallelImport
   }
   let ext := { descr := descr, ext := ext : ScopedEnvExtension α β σ }
   scopedEnvExtensionsRef.modify fun exts => exts.push (unsafeCast ext)
@@ -215,6 +218,7 @@ def registerSimpleScopedEnvExtension (descr : SimpleScopedEnvExtension.Descr α
     toOLeanEntry   := id
     ofOLeanEntry   := fun _ a => return a
     finalizeImport := descr.finalizeImport
+    parallelImport := true
   }
 
 end Lean
@@ -618,7 +618,7 @@ section MessageHandling
 
     -- we assume that any other request requires at least the the search path
     -- TODO: move into language-specific request handling
-    let t ← IO.bindTask st.srcSearchPathTask fun srcSearchPath => do
+    let t ← IO.bindTask (prio := requestPriority) st.srcSearchPathTask fun srcSearchPath => do
       let rc : RequestContext :=
         { rpcSessions := st.rpcSessions
           srcSearchPath
@@ -628,9 +628,9 @@ section MessageHandling
       let t? ← EIO.toIO' <| handleLspRequest method params rc
       let t₁ ← match t? with
         | Except.error e =>
-          IO.asTask do
+          IO.asTask (prio := requestPriority) do
             ctx.chanOut.send <| e.toLspResponseError id
-        | Except.ok t => (IO.mapTask · t) fun
+        | Except.ok t => (IO.mapTask (prio := requestPriority) · t) fun
           | Except.ok resp =>
             ctx.chanOut.send <| .response id (toJson resp)
           | Except.error e =>
@@ -73,6 +73,13 @@ abbrev RequestM := ReaderT RequestContext <| EIO RequestError
 
 abbrev RequestTask.pure (a : α) : RequestTask α := .pure (.ok a)
 
+/--
+Priority of the tasks running request handlers. Requests are interactive, so they are scheduled
+before the elaboration tasks of the worker, which use `Task.Priority.default`, even when the latter
+saturate the thread pool.
+-/
+def requestPriority : Task.Priority := Task.Priority.max
+
 instance : MonadLift IO RequestM where
   monadLift x := do
     match ←  x.toBaseIO with
@@ -93,17 +100,18 @@ def readDoc [Monad m] [MonadReaderOf RequestContext m] : m EditableDocument := d
   let rc ← readThe RequestContext
   return rc.doc
 
-def asTask (t : RequestM α) : RequestM (RequestTask α) := do
+def asTask (t : RequestM α) (prio := requestPriority) : RequestM (RequestTask α) := do
   let rc ← readThe RequestContext
-  EIO.asTask <| t.run rc
+  EIO.asTask (t.run rc) prio
 
-def mapTask (t : Task α) (f : α → RequestM β) : RequestM (RequestTask β) := do
+def mapTask (t : Task α) (f : α → RequestM β) (prio := requestPriority) : RequestM (RequestTask β) := do
   let rc ← readThe RequestContext
-  EIO.mapTask (f · rc) t
+  EIO.mapTask (f · rc) t prio
 
-def bindTask (t : Task α) (f : α → RequestM (RequestTask β)) : RequestM (RequestTask β) := do
+def bindTask (t : Task α) (f : α → RequestM (RequestTask β)) (prio := requestPriority) :
+    RequestM (RequestTask β) := do
   let rc ← readThe RequestContext
-  EIO.bindTask t (f · rc)
+  EIO.bindTask t (f · rc) prio
 
 def waitFindSnapAux (notFoundX : RequestM α) (x : Snapshot → RequestM α)
     : Except IO.Error (Option Snapshot) → RequestM α
@@ -99,13 +99,12 @@ with `newText`.
 def replaceLspRange (text : FileMap) (r : Lsp.Range) (newText : String) : FileMap :=
   let start := text.lspPosToUtf8Pos r.start
   let «end» := text.lspPosToUtf8Pos r.«end»
-  let pre := text.source.extract 0 start
-  let post := text.source.extract «end» text.source.endPos
-  -- `pre` and `post` already have normalized line endings, so only `newText` needs its endings normalized.
+  -- The text before and after the range already has normalized line endings, so only `newText` needs its endings
+  -- normalized.
   -- Note: this assumes that editing never separates a `\r\n`.
-  -- If `pre` ends with `\r` and `newText` begins with `\n`, the result is potentially inaccurate.
+  -- If the text before the range ends with `\r` and `newText` begins with `\n`, the result is potentially inaccurate.
   -- If this is ever a problem, we could store a second unnormalized FileMap, edit it, and normalize it here.
-  (pre ++ newText.crlfToLf ++ post).toFileMap
+  text.replace start «end» newText.crlfToLf
 
 open IO
 
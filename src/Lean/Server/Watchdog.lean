@@ -285,16 +285,17 @@ section ServerM
     let o := (←read).hOut
     let rec loop : ServerM WorkerEvent := do
       try
-        let msg ← fw.stdout.readLspMessage
+        let (msg, content) ← fw.stdout.readLspMessageWithContent
         -- Re. `o.writeLspMessage msg`:
         -- Writes to Lean I/O channels are atomic, so these won't trample on each other.
+        -- Messages forwarded unchanged are written as received instead of being serialized again.
         match msg with
           | Message.response id _ => do
             fw.erasePendingRequest id
-            o.writeLspMessage msg
+            o.writeLspMessageRaw content
           | Message.responseError id _ _ _ => do
             fw.erasePendingRequest id
-            o.writeLspMessage msg
+            o.writeLspMessageRaw content
           | Message.request id method params? =>
             let globalID ← (←read).serverRequestData.modifyGet
               (·.trackOutboundRequest fw.doc.uri id)
@@ -311,7 +312,7 @@ section ServerM
             if let some params := params then
               if let Except.ok params := FromJson.fromJson? <| ToJson.toJson params then
                 handleImportClosure fw params
-          | _ => o.writeLspMessage msg
+          | _ => o.writeLspMessageRaw content
       catch err =>
         -- If writeLspMessage from above errors we will block here, but the main task will
         -- quit eventually anyways if that happens
@@ -1074,12 +1075,15 @@ def startLoadingReferences (references : IO.Ref References) : IO Unit := do
   -- but we should try to continue server operations regardless
   let _ ← IO.asTask do
     let oleanSearchPath ← Lean.searchPathRef.get
-    for path in ← oleanSearchPath.findAllWithExt "ilean" do
-      try
-        let ilean ← Ilean.load path
+    -- parse the .ileans in parallel, but add them in search path order so that the result stays deterministic
+    let loads ← (← oleanSearchPath.findAllWithExt "ilean").mapM fun path =>
+      return (path, ← IO.asTask (Ilean.load path))
+    for (path, load) in loads do
+      match ← IO.wait load with
+      | .ok ilean =>
         references.modify fun refs =>
           refs.addIlean path ilean
-      catch _ =>
+      | .error _ =>
         -- could be a race with the build system, for example
         -- ilean load errors should not be fatal, but we *should* log them
         -- when we add logging to the server
@@ -47,4 +47,4 @@ instance PShareCommonT.monadShareCommon [Monad m] : MonadShareCommon (PShareComm
 @[inline] def ShareCommonM.run : ShareCommonM α → α := ShareCommonT.run
 @[inline] def PShareCommonM.run : PShareCommonM α → α := PShareCommonT.run
 
-def shareCommon (a : α) : α := (withShareCommon a : ShareCommonM α).run
+def shareCommon (a : α) : α := ShareCommon.shareCommon' a
@@ -0,0 +1,14 @@
+#!/bin/bash
+# Auxiliary script that succeeds iff running the given `lean` binary
+# with `--trace-tasks` writes a task trace containing at least one task.
+set -e
+LEAN="$1"
+shift
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+echo '#eval (Task.spawn fun _ => 1 + 1).get' > "$dir/Trace.lean"
+"$LEAN" "$@" --trace-tasks="$dir/trace.json" "$dir/Trace.lean"
+if ! grep -q '"traceEvents"' "$dir/trace.json" || ! grep -q '"ph":"X"' "$dir/trace.json"; then
+   echo "task trace missing or empty"
+   exit 1
+fi
@@ -207,6 +207,8 @@ typedef struct {
     // If true, task will not be freed until finished
     uint8_t              m_keep_alive;
     uint8_t              m_deleted;
+    // If true, task is run by the thread that finishes its dependency instead of being queued
+    uint8_t              m_sync;
 } lean_task_imp;
 
 /* Object of type `Task _`. The lifetime of a `lean_task` object can be represented as a state machine with atomic
@@ -222,7 +224,7 @@ typedef struct {
 
    states:
    * Queued
-     * condition: in task_manager::m_queues && m_imp != nullptr && !m_imp->m_deleted
+     * condition: in a task_manager worker queue (or, for `m_sync` tasks, in `g_inline_tasks`) && m_imp != nullptr && !m_imp->m_deleted
      * invariant: m_value == nullptr
      * transition: RC becomes 0 ==> Deactivated (`deactivate_task` lock)
      * transition: dequeued by worker thread            ==> Running     (`spawn_worker` lock)
@@ -495,6 +497,56 @@ static inline bool lean_is_shared(lean_object * o) {
 LEAN_EXPORT void lean_mark_mt(lean_object * o);
 LEAN_EXPORT void lean_mark_persistent(lean_object * o);
 
+/* Closed terms extracted by the compiler are stored in module-level variables. By default, they are initialized by
+   the module initializer. When the generated C code is compiled with `LEAN_LAZY_CLOSED_TERMS` defined, each one is
+   instead initialized by `init` the first time it is accessed, which reduces the startup time of executables
+   that only use a small part of the modules they are linked with. */
+LEAN_EXPORT lean_object * lean_closed_term_init(lean_object ** p, lean_object * (*init)(void));
+
+static inline lean_object * lean_closed_term_get(lean_object ** p, lean_object * (*init)(void)) {
+#if defined(__GNUC__) || defined(__clang__)
+    lean_object * r = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+    lean_object * r = *p;
+#endif
+    if (LEAN_LIKELY(r != NULL)) return r;
+    return lean_closed_term_init(p, init);
+}
+
+#ifdef LEAN_LAZY_CLOSED_TERMS
+#define LEAN_CLOSED_TERM(n) lean_closed_term_get(&n, _init_##n)
+#else
+#define LEAN_CLOSED_TERM(n) n
+#endif
+
+/* Call counter of a function whose C code was emitted with instrumentation, see `runtime/call_profile.h`.
+   A counter is registered with the runtime the first time the function is called. */
+typedef struct lean_call_counter {
+    uint64_t                   m_count;
+    char const *               m_name;
+    struct lean_call_counter * m_next;
+} lean_call_counter;
+
+LEAN_EXPORT void lean_register_call_counter(lean_call_counter * c);
+
+static inline void lean_count_call(lean_call_counter * c) {
+#if defined(__GNUC__) || defined(__clang__)
+    uint64_t n = __atomic_fetch_add(&c->m_count, 1, __ATOMIC_RELAXED);
+#else
+    uint64_t n = c->m_count++;
+#endif
+    if (LEAN_UNLIKELY(n == 0)) lean_register_call_counter(c);
+}
+
+/* Functions marked by the compiler as frequently or never called in a call profile. */
+#if defined(__GNUC__) || defined(__clang__)
+#define LEAN_HOT __attribute__((hot))
+#define LEAN_COLD __attribute__((cold))
+#else
+#define LEAN_HOT
+#define LEAN_COLD
+#endif
+
 static inline void lean_set_st_header(lean_object * o, unsigned tag, unsigned other) {
     o->m_rc       = 1;
     o->m_tag      = tag;
@@ -820,6 +872,9 @@ static inline lean_object * lean_array_swap(lean_obj_arg a, b_lean_obj_arg i, b_
 }
 
 LEAN_EXPORT lean_object * lean_array_push(lean_obj_arg a, lean_obj_arg v);
+LEAN_EXPORT lean_object * lean_array_reserve(lean_obj_arg a, b_lean_obj_arg n);
+LEAN_EXPORT lean_object * lean_array_par_map(lean_obj_arg f, lean_obj_arg a);
+LEAN_EXPORT lean_object * lean_array_par_foldl(lean_obj_arg f, lean_obj_arg combine, lean_obj_arg init, lean_obj_arg a);
 LEAN_EXPORT lean_object * lean_mk_array(lean_obj_arg n, lean_obj_arg v);
 
 /* Array of scalars */
@@ -855,6 +910,10 @@ LEAN_EXPORT lean_obj_res lean_byte_array_mk(lean_obj_arg a);
 LEAN_EXPORT lean_obj_res lean_byte_array_data(lean_obj_arg a);
 LEAN_EXPORT lean_obj_res lean_copy_byte_array(lean_obj_arg a);
 LEAN_EXPORT uint64_t lean_byte_array_hash(b_lean_obj_arg a);
+LEAN_EXPORT uint8_t lean_byte_array_beq(b_lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT uint8_t lean_byte_array_compare(b_lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_byte_array_index_of(b_lean_obj_arg a, uint8_t b, b_lean_obj_arg start);
+LEAN_EXPORT lean_obj_res lean_byte_array_find(b_lean_obj_arg a, b_lean_obj_arg pat, b_lean_obj_arg start);
 
 static inline lean_obj_res lean_mk_empty_byte_array(b_lean_obj_arg capacity) {
     if (!lean_is_scalar(capacity)) lean_internal_panic_out_of_memory();
@@ -914,6 +973,15 @@ static inline lean_obj_res lean_byte_array_fset(lean_obj_arg a, b_lean_obj_arg i
 LEAN_EXPORT lean_obj_res lean_float_array_mk(lean_obj_arg a);
 LEAN_EXPORT lean_obj_res lean_float_array_data(lean_obj_arg a);
 LEAN_EXPORT lean_obj_res lean_copy_float_array(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_float_array_add(lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_float_array_sub(lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_float_array_mul(lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_float_array_mul_add(lean_obj_arg a, b_lean_obj_arg b, b_lean_obj_arg c);
+LEAN_EXPORT double lean_float_array_sum(b_lean_obj_arg a);
+LEAN_EXPORT double lean_float_array_dot(b_lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_float_array_min(b_lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_float_array_max(b_lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_float_array_extract(b_lean_obj_arg a, b_lean_obj_arg b, b_lean_obj_arg e);
 
 static inline lean_obj_res lean_mk_empty_float_array(b_lean_obj_arg capacity) {
     if (!lean_is_scalar(capacity)) lean_internal_panic_out_of_memory();
@@ -974,6 +1042,266 @@ static inline lean_obj_res lean_float_array_set(lean_obj_arg a, b_lean_obj_arg i
     }
 }
 
+/* UInt16Array (special case of Array of Scalars) */
+
+LEAN_EXPORT lean_obj_res lean_uint16_array_mk(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_uint16_array_data(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_copy_uint16_array(lean_obj_arg a);
+
+static inline lean_obj_res lean_mk_empty_uint16_array(b_lean_obj_arg capacity) {
+    if (!lean_is_scalar(capacity)) lean_internal_panic_out_of_memory();
+    return lean_alloc_sarray(sizeof(uint16_t), 0, lean_unbox(capacity));
+}
+
+static inline lean_obj_res lean_uint16_array_size(b_lean_obj_arg a) {
+    return lean_box(lean_sarray_size(a));
+}
+
+static inline uint16_t * lean_uint16_array_cptr(b_lean_obj_arg a) {
+    return (uint16_t*)(lean_sarray_cptr(a)); // NOLINT
+}
+
+static inline uint16_t lean_uint16_array_uget(b_lean_obj_arg a, size_t i) {
+    return lean_uint16_array_cptr(a)[i];
+}
+
+static inline uint16_t lean_uint16_array_fget(b_lean_obj_arg a, b_lean_obj_arg i) {
+    return lean_uint16_array_uget(a, lean_unbox(i));
+}
+
+static inline uint16_t lean_uint16_array_get(b_lean_obj_arg a, b_lean_obj_arg i) {
+    if (lean_is_scalar(i)) {
+        size_t idx = lean_unbox(i);
+        return idx < lean_sarray_size(a) ? lean_uint16_array_uget(a, idx) : 0;
+    } else {
+        /* The index must be out of bounds. Otherwise we would be out of memory. */
+        return 0;
+    }
+}
+
+LEAN_EXPORT lean_obj_res lean_uint16_array_push(lean_obj_arg a, uint16_t v);
+
+static inline lean_obj_res lean_uint16_array_uset(lean_obj_arg a, size_t i, uint16_t v) {
+    lean_obj_res r;
+    if (lean_is_exclusive(a)) r = a;
+    else r = lean_copy_uint16_array(a);
+    uint16_t * it = lean_uint16_array_cptr(r) + i;
+    *it = v;
+    return r;
+}
+
+static inline lean_obj_res lean_uint16_array_fset(lean_obj_arg a, b_lean_obj_arg i, uint16_t v) {
+    return lean_uint16_array_uset(a, lean_unbox(i), v);
+}
+
+static inline lean_obj_res lean_uint16_array_set(lean_obj_arg a, b_lean_obj_arg i, uint16_t v) {
+    if (!lean_is_scalar(i)) {
+        return a;
+    } else {
+        size_t idx = lean_unbox(i);
+        if (idx >= lean_sarray_size(a)) {
+            return a;
+        } else {
+            return lean_uint16_array_uset(a, idx, v);
+        }
+    }
+}
+
+/* UInt32Array (special case of Array of Scalars) */
+
+LEAN_EXPORT lean_obj_res lean_uint32_array_mk(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_uint32_array_data(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_copy_uint32_array(lean_obj_arg a);
+
+static inline lean_obj_res lean_mk_empty_uint32_array(b_lean_obj_arg capacity) {
+    if (!lean_is_scalar(capacity)) lean_internal_panic_out_of_memory();
+    return lean_alloc_sarray(sizeof(uint32_t), 0, lean_unbox(capacity));
+}
+
+static inline lean_obj_res lean_uint32_array_size(b_lean_obj_arg a) {
+    return lean_box(lean_sarray_size(a));
+}
+
+static inline uint32_t * lean_uint32_array_cptr(b_lean_obj_arg a) {
+    return (uint32_t*)(lean_sarray_cptr(a)); // NOLINT
+}
+
+static inline uint32_t lean_uint32_array_uget(b_lean_obj_arg a, size_t i) {
+    return lean_uint32_array_cptr(a)[i];
+}
+
+static inline uint32_t lean_uint32_array_fget(b_lean_obj_arg a, b_lean_obj_arg i) {
+    return lean_uint32_array_uget(a, lean_unbox(i));
+}
+
+static inline uint32_t lean_uint32_array_get(b_lean_obj_arg a, b_lean_obj_arg i) {
+    if (lean_is_scalar(i)) {
+        size_t idx = lean_unbox(i);
+        return idx < lean_sarray_size(a) ? lean_uint32_array_uget(a, idx) : 0;
+    } else {
+        /* The index must be out of bounds. Otherwise we would be out of memory. */
+        return 0;
+    }
+}
+
+LEAN_EXPORT lean_obj_res lean_uint32_array_push(lean_obj_arg a, uint32_t v);
+
+static inline lean_obj_res lean_uint32_array_uset(lean_obj_arg a, size_t i, uint32_t v) {
+    lean_obj_res r;
+    if (lean_is_exclusive(a)) r = a;
+    else r = lean_copy_uint32_array(a);
+    uint32_t * it = lean_uint32_array_cptr(r) + i;
+    *it = v;
+    return r;
+}
+
+static inline lean_obj_res lean_uint32_array_fset(lean_obj_arg a, b_lean_obj_arg i, uint32_t v) {
+    return lean_uint32_array_uset(a, lean_unbox(i), v);
+}
+
+static inline lean_obj_res lean_uint32_array_set(lean_obj_arg a, b_lean_obj_arg i, uint32_t v) {
+    if (!lean_is_scalar(i)) {
+        return a;
+    } else {
+        size_t idx = lean_unbox(i);
+        if (idx >= lean_sarray_size(a)) {
+            return a;
+        } else {
+            return lean_uint32_array_uset(a, idx, v);
+        }
+    }
+}
+
+/* UInt64Array (special case of Array of Scalars) */
+
+LEAN_EXPORT lean_obj_res lean_uint64_array_mk(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_uint64_array_data(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_copy_uint64_array(lean_obj_arg a);
+
+static inline lean_obj_res lean_mk_empty_uint64_array(b_lean_obj_arg capacity) {
+    if (!lean_is_scalar(capacity)) lean_internal_panic_out_of_memory();
+    return lean_alloc_sarray(sizeof(uint64_t), 0, lean_unbox(capacity));
+}
+
+static inline lean_obj_res lean_uint64_array_size(b_lean_obj_arg a) {
+    return lean_box(lean_sarray_size(a));
+}
+
+static inline uint64_t * lean_uint64_array_cptr(b_lean_obj_arg a) {
+    return (uint64_t*)(lean_sarray_cptr(a)); // NOLINT
+}
+
+static inline uint64_t lean_uint64_array_uget(b_lean_obj_arg a, size_t i) {
+    return lean_uint64_array_cptr(a)[i];
+}
+
+static inline uint64_t lean_uint64_array_fget(b_lean_obj_arg a, b_lean_obj_arg i) {
+    return lean_uint64_array_uget(a, lean_unbox(i));
+}
+
+static inline uint64_t lean_uint64_array_get(b_lean_obj_arg a, b_lean_obj_arg i) {
+    if (lean_is_scalar(i)) {
+        size_t idx = lean_unbox(i);
+        return idx < lean_sarray_size(a) ? lean_uint64_array_uget(a, idx) : 0;
+    } else {
+        /* The index must be out of bounds. Otherwise we would be out of memory. */
+        return 0;
+    }
+}
+
+LEAN_EXPORT lean_obj_res lean_uint64_array_push(lean_obj_arg a, uint64_t v);
+
+static inline lean_obj_res lean_uint64_array_uset(lean_obj_arg a, size_t i, uint64_t v) {
+    lean_obj_res r;
+    if (lean_is_exclusive(a)) r = a;
+    else r = lean_copy_uint64_array(a);
+    uint64_t * it = lean_uint64_array_cptr(r) + i;
+    *it = v;
+    return r;
+}
+
+static inline lean_obj_res lean_uint64_array_fset(lean_obj_arg a, b_lean_obj_arg i, uint64_t v) {
+    return lean_uint64_array_uset(a, lean_unbox(i), v);
+}
+
+static inline lean_obj_res lean_uint64_array_set(lean_obj_arg a, b_lean_obj_arg i, uint64_t v) {
+    if (!lean_is_scalar(i)) {
+        return a;
+    } else {
+        size_t idx = lean_unbox(i);
+        if (idx >= lean_sarray_size(a)) {
+            return a;
+        } else {
+            return lean_uint64_array_uset(a, idx, v);
+        }
+    }
+}
+
+/* USizeArray (special case of Array of Scalars) */
+
+LEAN_EXPORT lean_obj_res lean_usize_array_mk(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_usize_array_data(lean_obj_arg a);
+LEAN_EXPORT lean_obj_res lean_copy_usize_array(lean_obj_arg a);
+
+static inline lean_obj_res lean_mk_empty_usize_array(b_lean_obj_arg capacity) {
+    if (!lean_is_scalar(capacity)) lean_internal_panic_out_of_memory();
+    return lean_alloc_sarray(sizeof(size_t), 0, lean_unbox(capacity));
+}
+
+static inline lean_obj_res lean_usize_array_size(b_lean_obj_arg a) {
+    return lean_box(lean_sarray_size(a));
+}
+
+static inline size_t * lean_usize_array_cptr(b_lean_obj_arg a) {
+    return (size_t*)(lean_sarray_cptr(a)); // NOLINT
+}
+
+static inline size_t lean_usize_array_uget(b_lean_obj_arg a, size_t i) {
+    return lean_usize_array_cptr(a)[i];
+}
+
+static inline size_t lean_usize_array_fget(b_lean_obj_arg a, b_lean_obj_arg i) {
+    return lean_usize_array_uget(a, lean_unbox(i));
+}
+
+static inline size_t lean_usize_array_get(b_lean_obj_arg a, b_lean_obj_arg i) {
+    if (lean_is_scalar(i)) {
+        size_t idx = lean_unbox(i);
+        return idx < lean_sarray_size(a) ? lean_usize_array_uget(a, idx) : 0;
+    } else {
+        /* The index must be out of bounds. Otherwise we would be out of memory. */
+        return 0;
+    }
+}
+
+LEAN_EXPORT lean_obj_res lean_usize_array_push(lean_obj_arg a, size_t v);
+
+static inline lean_obj_res lean_usize_array_uset(lean_obj_arg a, size_t i, size_t v) {
+    lean_obj_res r;
+    if (lean_is_exclusive(a)) r = a;
+    else r = lean_copy_usize_array(a);
+    size_t * it = lean_usize_array_cptr(r) + i;
+    *it = v;
+    return r;
+}
+
+static inline lean_obj_res lean_usize_array_fset(lean_obj_arg a, b_lean_obj_arg i, size_t v) {
+    return lean_usize_array_uset(a, lean_unbox(i), v);
+}
+
+static inline lean_obj_res lean_usize_array_set(lean_obj_arg a, b_lean_obj_arg i, size_t v) {
+    if (!lean_is_scalar(i)) {
+        return a;
+    } else {
+        size_t idx = lean_unbox(i);
+        if (idx >= lean_sarray_size(a)) {
+            return a;
+        } else {
+            return lean_usize_array_uset(a, idx, v);
+        }
+    }
+}
+
 /* Strings */
 
 static inline lean_obj_res lean_alloc_string(size_t size, size_t capacity, size_t len) {
@@ -1000,6 +1328,9 @@ static inline size_t lean_string_size(b_lean_obj_arg o) { return lean_to_string(
 static inline size_t lean_string_len(b_lean_obj_arg o) { return lean_to_string(o)->m_length; }
 LEAN_EXPORT lean_obj_res lean_string_push(lean_obj_arg s, uint32_t c);
 LEAN_EXPORT lean_obj_res lean_string_append(lean_obj_arg s1, b_lean_obj_arg s2);
+LEAN_EXPORT lean_obj_res lean_string_reserve(lean_obj_arg s, b_lean_obj_arg n);
+LEAN_EXPORT lean_obj_res lean_string_join(b_lean_obj_arg l);
+LEAN_EXPORT lean_obj_res lean_string_intercalate(b_lean_obj_arg s, b_lean_obj_arg l);
 static inline lean_obj_res lean_string_length(b_lean_obj_arg s) { return lean_box(lean_string_len(s)); }
 LEAN_EXPORT lean_obj_res lean_string_mk(lean_obj_arg cs);
 LEAN_EXPORT lean_obj_res lean_string_data(lean_obj_arg s);
@@ -1034,6 +1365,9 @@ static inline uint8_t lean_string_utf8_at_end(b_lean_obj_arg s, b_lean_obj_arg i
     return !lean_is_scalar(i) || lean_unbox(i) >= lean_string_size(s) - 1;
 }
 LEAN_EXPORT lean_obj_res lean_string_utf8_extract(b_lean_obj_arg s, b_lean_obj_arg b, b_lean_obj_arg e);
+LEAN_EXPORT lean_obj_res lean_string_pos_of_aux(b_lean_obj_arg s, uint32_t c, b_lean_obj_arg stop, b_lean_obj_arg pos);
+LEAN_EXPORT lean_obj_res lean_string_skip_ascii_id_rest(b_lean_obj_arg s, b_lean_obj_arg pos);
+LEAN_EXPORT lean_obj_res lean_string_replace(b_lean_obj_arg s, b_lean_obj_arg pattern, b_lean_obj_arg replacement);
 static inline lean_obj_res lean_string_utf8_byte_size(b_lean_obj_arg s) { return lean_box(lean_string_size(s) - 1); }
 LEAN_EXPORT bool lean_string_eq_cold(b_lean_obj_arg s1, b_lean_obj_arg s2);
 static inline bool lean_string_eq(b_lean_obj_arg s1, b_lean_obj_arg s2) {
@@ -1045,6 +1379,8 @@ static inline uint8_t lean_string_dec_eq(b_lean_obj_arg s1, b_lean_obj_arg s2) {
 static inline uint8_t lean_string_dec_lt(b_lean_obj_arg s1, b_lean_obj_arg s2) { return lean_string_lt(s1, s2); }
 LEAN_EXPORT uint64_t lean_string_hash(b_lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_string_of_usize(size_t);
+LEAN_EXPORT lean_obj_res lean_nat_big_repr(b_lean_obj_arg n);
+LEAN_EXPORT lean_obj_res lean_string_dec_to_nat(b_lean_obj_arg s);
 
 /* Thunks */
 
@@ -1082,8 +1418,14 @@ static inline lean_obj_res lean_thunk_get_own(b_lean_obj_arg t) {
 
 /* Tasks */
 
+/* By default, up to this many additional workers are started while workers are blocked in `lean_task_get`/`IO.wait`. */
+#define LEAN_DEFAULT_MAX_EXTRA_WORKERS 256
+
 LEAN_EXPORT void lean_init_task_manager(void);
 LEAN_EXPORT void lean_init_task_manager_using(unsigned num_workers);
+/* Initialize the task manager with `num_workers` workers. While workers are blocked waiting for other tasks,
+   up to `max_extra_workers` additional workers are allowed to run tasks. */
+LEAN_EXPORT void lean_init_task_manager_with_extra_workers(unsigned num_workers, unsigned max_extra_workers);
 LEAN_EXPORT void lean_finalize_task_manager(void);
 
 LEAN_EXPORT lean_obj_res lean_task_spawn_core(lean_obj_arg c, unsigned prio, bool keep_alive);
@@ -1955,6 +2297,7 @@ LEAN_EXPORT lean_obj_res lean_st_ref_get(b_lean_obj_arg, lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_st_ref_set(b_lean_obj_arg, lean_obj_arg, lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_st_ref_reset(b_lean_obj_arg, lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_st_ref_swap(b_lean_obj_arg, lean_obj_arg, lean_obj_arg);
+LEAN_EXPORT lean_obj_res lean_st_ref_atomic_modify_get(b_lean_obj_arg, lean_obj_arg, lean_obj_arg);
 
 /* pointer address unsafe primitive  */
 static inline size_t lean_ptr_addr(b_lean_obj_arg a) { return (size_t)a; }
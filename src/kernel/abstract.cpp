@@ -7,14 +7,41 @@ Author: Leonardo de Moura
 #include <algorithm>
 #include <utility>
 #include <vector>
+#include "util/name_hash_map.h"
 #include "kernel/abstract.h"
 #include "kernel/replace_fn.h"
 
+#ifndef LEAN_ABSTRACT_LINEAR_SEARCH_MAX
+#define LEAN_ABSTRACT_LINEAR_SEARCH_MAX 8
+#endif
+
 namespace lean {
+/* Version of `abstract` for many free variables, e.g., when `local_ctx::mk_binding` abstracts a long telescope.
+   The position of each free variable is found using a hash map instead of a linear search. */
+static expr abstract_many(expr const & e, unsigned n, expr const * subst) {
+    name_hash_map<unsigned> pos;
+    pos.reserve(n);
+    for (unsigned i = 0; i < n; i++)
+        pos[fvar_name(subst[i])] = i; // keep the last occurrence, as in the linear search
+    return replace(e, [&](expr const & m, unsigned offset) -> optional<expr> {
+            if (!has_fvar(m))
+                return some_expr(m); // expression m does not contain free variables
+            if (is_fvar(m)) {
+                auto it = pos.find(fvar_name(m));
+                if (it != pos.end())
+                    return some_expr(mk_bvar(offset + n - it->second - 1));
+                return some_expr(m);
+            }
+            return none_expr();
+        });
+}
+
 expr abstract(expr const & e, unsigned n, expr const * subst) {
     lean_assert(std::all_of(subst, subst+n, [](expr const & e) { return !has_loose_bvars(e) && is_fvar(e); }));
-    if (!has_fvar(e))
+    if (n == 0 || !has_fvar(e))
         return e;
+    if (n > LEAN_ABSTRACT_LINEAR_SEARCH_MAX)
+        return abstract_many(e, n, subst);
     return replace(e, [=](expr const & m, unsigned offset) -> optional<expr> {
             if (!has_fvar(m))
                 return some_expr(m); // expression m does not contain free variables
@@ -0,0 +1,564 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "runtime/hash.h"
+#include "runtime/stackinfo.h"
+#include "runtime/thread.h"
+#include "runtime/cache_registry.h"
+#include "kernel/check_cache.h"
+#include "githash.h" // NOLINT
+
+#ifndef LEAN_KERNEL_CHECK_CACHE_ENTRY_SIZE
+/* Estimated size in bytes of the memoized hash of a constant, excluding the constant itself. */
+#define LEAN_KERNEL_CHECK_CACHE_ENTRY_SIZE 128
+#endif
+
+namespace lean {
+/* Must be changed whenever the hashed content changes. */
+static char const * const g_check_cache_version = "1";
+
+static name * g_reduce_bool = nullptr;
+static name * g_reduce_nat  = nullptr;
+/* Constants used by the kernel even if they do not occur in a declaration, e.g., for literals. */
+static std::vector<name> * g_builtin_consts = nullptr;
+
+enum class hash_tag { Name, Level, Expr, Constant, Declaration, Component, Key };
+
+static inline bool operator==(check_cache_key const & k1, check_cache_key const & k2) {
+    return k1.m_h1 == k2.m_h1 && k1.m_h2 == k2.m_h2;
+}
+
+static inline bool operator<(check_cache_key const & k1, check_cache_key const & k2) {
+    return k1.m_h1 < k2.m_h1 || (k1.m_h1 == k2.m_h1 && k1.m_h2 < k2.m_h2);
+}
+
+struct check_cache_key_hash {
+    size_t operator()(check_cache_key const & k) const { return k.m_h1; }
+};
+
+static inline uint64 rotl(uint64 x, unsigned r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64 fmix(uint64 h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Two independently seeded and mixed 64-bit lanes. */
+class key_hasher {
+    uint64 m_h1 = 0x243f6a8885a308d3;
+    uint64 m_h2 = 0x13198a2e03707344;
+public:
+    explicit key_hasher(hash_tag t) { mix(static_cast<uint64>(t)); }
+    void mix(uint64 k) {
+        m_h1 = hash(m_h1, k);
+        m_h2 = rotl(m_h2 ^ (k * 0x9e3779b97f4a7c15), 29) * 0xbf58476d1ce4e5b9;
+    }
+    void mix(check_cache_key const & k) { mix(k.m_h1); mix(k.m_h2); }
+    void mix(char const * s, size_t len) {
+        mix(len);
+        m_h1 = hash_str(len, reinterpret_cast<unsigned char const *>(s), m_h1);
+        m_h2 = hash_str(len, reinterpret_cast<unsigned char const *>(s), m_h2);
+    }
+    void mix(string_ref const & s) { mix(s.data(), s.num_bytes()); }
+    void mix(nat const & n) {
+        if (n.is_small()) {
+            mix(0);
+            mix(n.get_small_value());
+        } else {
+            std::string s = n.to_std_string();
+            mix(1);
+            mix(s.data(), s.size());
+        }
+    }
+    check_cache_key get() const { return check_cache_key{fmix(m_h1), fmix(m_h2)}; }
+};
+
+/* Hash of the content of declarations and constants. The names of the constants they refer to are collected
+   in `m_deps`. Metadata is ignored since it is ignored by the kernel as well. */
+class content_hasher {
+    /* Names, levels and terms. The anonymous name is the only scalar among them, and it is not cached. */
+    std::unordered_map<object *, check_cache_key> m_cache;
+    std::vector<name> &                           m_deps;
+    bool                                          m_native = false;
+
+    void add_dep(key_hasher & h, name const & n) {
+        h.mix(hash_name(n));
+        m_deps.push_back(n);
+    }
+
+    void mix_names(key_hasher & h, names const & ns, bool deps) {
+        h.mix(length(ns));
+        for (name const & n : ns) {
+            if (deps)
+                add_dep(h, n);
+            else
+                h.mix(hash_name(n));
+        }
+    }
+
+    check_cache_key hash_name(name const & n) {
+        key_hasher h(hash_tag::Name);
+        if (n.is_anonymous())
+            return h.get();
+        auto it = m_cache.find(n.raw());
+        if (it != m_cache.end())
+            return it->second;
+        h.mix(hash_name(n.get_prefix()));
+        if (n.is_string()) {
+            h.mix(0);
+            h.mix(n.get_string());
+        } else {
+            h.mix(1);
+            h.mix(n.get_numeral());
+        }
+        return m_cache[n.raw()] = h.get();
+    }
+
+    check_cache_key hash_level(level const & l) {
+        auto it = m_cache.find(l.raw());
+        if (it != m_cache.end())
+            return it->second;
+        key_hasher h(hash_tag::Level);
+        h.mix(static_cast<uint64>(l.kind()));
+        switch (l.kind()) {
+        case level_kind::Zero:  break;
+        case level_kind::Succ:  h.mix(hash_level(succ_of(l))); break;
+        case level_kind::Max:   h.mix(hash_level(max_lhs(l))); h.mix(hash_level(max_rhs(l))); break;
+        case level_kind::IMax:  h.mix(hash_level(imax_lhs(l))); h.mix(hash_level(imax_rhs(l))); break;
+        case level_kind::Param: h.mix(hash_name(param_id(l))); break;
+        case level_kind::MVar:  h.mix(hash_name(mvar_id(l))); break;
+        }
+        return m_cache[l.raw()] = h.get();
+    }
+
+    check_cache_key hash_expr(expr const & e) {
+        auto it = m_cache.find(e.raw());
+        if (it != m_cache.end())
+            return it->second;
+        check_stack("kernel check cache");
+        if (is_mdata(e))
+            return m_cache[e.raw()] = hash_expr(mdata_expr(e));
+        key_hasher h(hash_tag::Expr);
+        h.mix(static_cast<uint64>(e.kind()));
+        switch (e.kind()) {
+        case expr_kind::BVar:
+            h.mix(bvar_idx(e));
+            break;
+        case expr_kind::FVar: case expr_kind::MVar:
+            h.mix(hash_name(static_cast<name const &>(cnstr_get_ref(e, 0))));
+            break;
+        case expr_kind::Sort:
+            h.mix(hash_level(sort_level(e)));
+            break;
+        case expr_kind::Const:
+            if (const_name(e) == *g_reduce_bool || const_name(e) == *g_reduce_nat)
+                m_native = true;
+            add_dep(h, const_name(e));
+            h.mix(length(const_levels(e)));
+            for (level const & l : const_levels(e))
+                h.mix(hash_level(l));
+            break;
+        case expr_kind::App:
+            h.mix(hash_expr(app_fn(e)));
+            h.mix(hash_expr(app_arg(e)));
+            break;
+        case expr_kind::Lambda: case expr_kind::Pi:
+            h.mix(hash_name(binding_name(e)));
+            h.mix(static_cast<uint64>(binding_info(e)));
+            h.mix(hash_expr(binding_domain(e)));
+            h.mix(hash_expr(binding_body(e)));
+            break;
+        case expr_kind::Let:
+            h.mix(hash_name(let_name(e)));
+            h.mix(hash_expr(let_type(e)));
+            h.mix(hash_expr(let_value(e)));
+            h.mix(hash_expr(let_body(e)));
+            break;
+        case expr_kind::Lit:
+            h.mix(static_cast<uint64>(lit_value(e).kind()));
+            if (lit_value(e).kind() == literal_kind::Nat)
+                h.mix(lit_value(e).get_nat());
+            else
+                h.mix(lit_value(e).get_string());
+            break;
+        case expr_kind::MData:
+            lean_unreachable();
+        case expr_kind::Proj:
+            add_dep(h, proj_sname(e));
+            h.mix(proj_idx(e));
+            h.mix(hash_expr(proj_expr(e)));
+            break;
+        }
+        return m_cache[e.raw()] = h.get();
+    }
+
+    template<typename V> void mix_constant_val(key_hasher & h, V const & v) {
+        h.mix(hash_name(v.get_name()));
+        mix_names(h, v.get_lparams(), false);
+        h.mix(hash_expr(v.get_type()));
+    }
+
+    void mix_hints(key_hasher & h, reducibility_hints const & hints) {
+        h.mix(static_cast<uint64>(hints.kind()));
+        if (hints.is_regular())
+            h.mix(hints.get_height());
+    }
+
+public:
+    explicit content_hasher(std::vector<name> & deps):m_deps(deps) {}
+
+    /* Return `true` if the hashed terms may be reduced using compiled code, see `reduce_native`. */
+    bool uses_native() const { return m_native; }
+
+    check_cache_key hash_declaration(declaration const & d) {
+        key_hasher h(hash_tag::Declaration);
+        h.mix(static_cast<uint64>(d.kind()));
+        switch (d.kind()) {
+        case declaration_kind::Definition: {
+            definition_val const & v = d.to_definition_val();
+            mix_constant_val(h, v.to_constant_val());
+            h.mix(hash_expr(v.get_value()));
+            mix_hints(h, v.get_hints());
+            h.mix(static_cast<uint64>(v.get_safety()));
+            break;
+        }
+        case declaration_kind::Theorem:
+            mix_constant_val(h, d.to_theorem_val().to_constant_val());
+            h.mix(hash_expr(d.to_theorem_val().get_value()));
+            break;
+        case declaration_kind::Opaque:
+            mix_constant_val(h, d.to_opaque_val().to_constant_val());
+            h.mix(hash_expr(d.to_opaque_val().get_value()));
+            h.mix(d.to_opaque_val().is_unsafe());
+            break;
+        default:
+            lean_unreachable();
+        }
+        return h.get();
+    }
+
+    check_cache_key hash_constant(constant_info const & info) {
+        key_hasher h(hash_tag::Constant);
+        h.mix(static_cast<uint64>(info.kind()));
+        mix_constant_val(h, info);
+        switch (info.kind()) {
+        case constant_info_kind::Axiom:
+            h.mix(info.to_axiom_val().is_unsafe());
+            break;
+        case constant_info_kind::Definition: {
+            definition_val const & v = info.to_definition_val();
+            h.mix(hash_expr(v.get_value()));
+            mix_hints(h, v.get_hints());
+            h.mix(static_cast<uint64>(v.get_safety()));
+            break;
+        }
+        case constant_info_kind::Theorem:
+            h.mix(hash_expr(info.to_theorem_val().get_value()));
+            break;
+        case constant_info_kind::Opaque:
+            h.mix(hash_expr(info.to_opaque_val().get_value()));
+            h.mix(info.to_opaque_val().is_unsafe());
+            break;
+        case constant_info_kind::Quot:
+            h.mix(static_cast<uint64>(info.to_quot_val().get_quot_kind()));
+            break;
+        case constant_info_kind::Inductive: {
+            inductive_val const & v = info.to_inductive_val();
+            h.mix(v.get_nparams());
+            h.mix(v.get_nindices());
+            mix_names(h, v.get_all(), true);
+            mix_names(h, v.get_cnstrs(), true);
+            h.mix(v.is_rec());
+            h.mix(v.is_unsafe());
+            h.mix(v.is_reflexive());
+            h.mix(v.is_nested());
+            break;
+        }
+        case constant_info_kind::Constructor: {
+            constructor_val const & v = info.to_constructor_val();
+            add_dep(h, v.get_induct());
+            h.mix(v.get_cidx());
+            h.mix(v.get_nparams());
+            h.mix(v.get_nfields());
+            h.mix(v.is_unsafe());
+            break;
+        }
+        case constant_info_kind::Recursor: {
+            recursor_val const & v = info.to_recursor_val();
+            mix_names(h, v.get_all(), true);
+            h.mix(v.get_nparams());
+            h.mix(v.get_nindices());
+            h.mix(v.get_nmotives());
+            h.mix(v.get_nminors());
+            h.mix(length(v.get_rules()));
+            for (recursor_rule const & r : v.get_rules()) {
+                add_dep(h, r.get_cnstr());
+                h.mix(r.get_nfields());
+                h.mix(hash_expr(r.get_rhs()));
+            }
+            h.mix(v.is_k());
+            h.mix(v.is_unsafe());
+            break;
+        }
+        }
+        return h.get();
+    }
+};
+
+/* Hash of a constant and of all constants it transitively depends on. `m_ok` is `false` if any of them refers
+   to a missing constant or may be reduced using compiled code. */
+struct closure_entry {
+    constant_info   m_info;
+    check_cache_key m_key;
+    bool            m_ok;
+};
+
+static mutex *                                                          g_check_cache_mutex = nullptr;
+static std::unordered_map<object *, closure_entry> *                    g_closures = nullptr;
+static std::unordered_set<check_cache_key, check_cache_key_hash> *      g_checked = nullptr;
+static FILE *                                                           g_check_cache_file = nullptr;
+static unsigned                                                         g_check_cache_id = 0;
+
+struct tarjan_frame {
+    constant_info              m_info;
+    check_cache_key            m_content;
+    std::vector<constant_info> m_deps;
+    size_t                     m_next = 0;
+    unsigned                   m_index;
+    unsigned                   m_low;
+    bool                       m_ok;
+    bool                       m_on_stack = true;
+};
+
+/* Return the closure hash of `root`. Constants may depend on each other (e.g., an inductive type and its
+   constructors), so the hash is computed for the strongly connected components of the dependency graph using
+   Tarjan's algorithm: all constants of a component share the hash of their sorted content hashes and of the
+   sorted hashes of the components they depend on. Must be called with `g_check_cache_mutex` held. */
+static closure_entry const & get_closure(environment const & env, constant_info const & root) {
+    auto it = g_closures->find(root.raw());
+    if (it != g_closures->end())
+        return it->second;
+    std::vector<tarjan_frame> frames;
+    std::unordered_map<object *, unsigned> frame_of;
+    std::vector<unsigned> component_stack;
+    std::vector<unsigned> call_stack;
+    auto push = [&](constant_info const & info) {
+        unsigned idx = frames.size();
+        frames.emplace_back();
+        tarjan_frame & f = frames.back();
+        std::vector<name> deps;
+        content_hasher h(deps);
+        f.m_info    = info;
+        f.m_content = h.hash_constant(info);
+        f.m_ok      = !h.uses_native();
+        for (name const & n : deps) {
+            if (optional<constant_info> d = env.find(n))
+                f.m_deps.push_back(*d);
+            else
+                f.m_ok = false;
+        }
+        f.m_index = f.m_low = idx;
+        frame_of[info.raw()] = idx;
+        component_stack.push_back(idx);
+        call_stack.push_back(idx);
+    };
+    push(root);
+    while (!call_stack.empty()) {
+        unsigned idx = call_stack.back();
+        if (frames[idx].m_next < frames[idx].m_deps.size()) {
+            constant_info dep = frames[idx].m_deps[frames[idx].m_next++];
+            if (g_closures->find(dep.raw()) != g_closures->end())
+                continue;
+            auto it = frame_of.find(dep.raw());
+            if (it == frame_of.end())
+                push(dep);
+            else if (frames[it->second].m_on_stack)
+                frames[idx].m_low = std::min(frames[idx].m_low, frames[it->second].m_index);
+            continue;
+        }
+        call_stack.pop_back();
+        if (frames[idx].m_low == frames[idx].m_index) {
+            std::vector<unsigned> members;
+            unsigned m;
+            do {
+                m = component_stack.back();
+                component_stack.pop_back();
+                frames[m].m_on_stack = false;
+                members.push_back(m);
+            } while (m != idx);
+            std::vector<check_cache_key> contents;
+            std::vector<check_cache_key> external;
+            bool ok = true;
+            for (unsigned i : members) {
+                contents.push_back(frames[i].m_content);
+                ok = ok && frames[i].m_ok;
+                for (constant_info const & d : frames[i].m_deps) {
+                    /* Dependencies that are not in `g_closures` yet are members of this component. */
+                    auto it = g_closures->find(d.raw());
+                    if (it != g_closures->end()) {
+                        external.push_back(it->second.m_key);
+                        ok = ok && it->second.m_ok;
+                    }
+                }
+            }
+            std::sort(contents.begin(), contents.end());
+            std::sort(external.begin(), external.end());
+            external.erase(std::unique(external.begin(), external.end()), external.end());
+            key_hasher h(hash_tag::Component);
+            h.mix(contents.size());
+            for (check_cache_key const & k : contents)
+                h.mix(k);
+            h.mix(external.size());
+            for (check_cache_key const & k : external)
+                h.mix(k);
+            check_cache_key key = h.get();
+            for (unsigned i : members)
+                g_closures->emplace(frames[i].m_info.raw(), closure_entry{frames[i].m_info, key, ok});
+        }
+        if (!call_stack.empty()) {
+            unsigned parent = call_stack.back();
+            frames[parent].m_low = std::min(frames[parent].m_low, frames[idx].m_low);
+        }
+    }
+    return g_closures->find(root.raw())->second;
+}
+
+bool set_kernel_check_cache(std::string const & path) {
+    if (FILE * in = fopen(path.c_str(), "rb")) {
+        uint64 k[2];
+        while (fread(k, sizeof(k), 1, in) == 1)
+            g_checked->insert(check_cache_key{k[0], k[1]});
+        fclose(in);
+    }
+    g_check_cache_file = fopen(path.c_str(), "ab");
+    if (!g_check_cache_file)
+        return false;
+    g_check_cache_id = register_cache("kernel check cache",
+        []() {
+            lock_guard<mutex> lock(*g_check_cache_mutex);
+            return g_closures->size() * LEAN_KERNEL_CHECK_CACHE_ENTRY_SIZE;
+        },
+        []() {
+            std::unordered_map<object *, closure_entry> closures;
+            {
+                lock_guard<mutex> lock(*g_check_cache_mutex);
+                closures.swap(*g_closures);
+            }
+        });
+    return true;
+}
+
+bool is_kernel_check_cache_enabled() {
+    return g_check_cache_file != nullptr;
+}
+
+optional<check_cache_key> get_check_cache_key(environment const & env, declaration const & d) {
+    if (!is_kernel_check_cache_enabled() || env.trust_lvl() == 0)
+        return optional<check_cache_key>();
+    switch (d.kind()) {
+    case declaration_kind::Definition:
+        if (d.to_definition_val().get_safety() != definition_safety::safe)
+            return optional<check_cache_key>();
+        break;
+    case declaration_kind::Theorem:
+        break;
+    case declaration_kind::Opaque:
+        if (d.to_opaque_val().is_unsafe())
+            return optional<check_cache_key>();
+        break;
+    default:
+        return optional<check_cache_key>();
+    }
+    std::vector<name> deps;
+    content_hasher hasher(deps);
+    key_hasher h(hash_tag::Key);
+    h.mix(g_check_cache_version, strlen(g_check_cache_version));
+    h.mix(LEAN_GITHASH, strlen(LEAN_GITHASH));
+    h.mix(env.is_quot_initialized());
+    h.mix(hasher.hash_declaration(d));
+    if (hasher.uses_native())
+        return optional<check_cache_key>();
+    std::vector<check_cache_key> closures;
+    lock_guard<mutex> lock(*g_check_cache_mutex);
+    touch_cache(g_check_cache_id);
+    for (name const & n : deps) {
+        optional<constant_info> info = env.find(n);
+        if (!info)
+            return optional<check_cache_key>();
+        closure_entry const & c = get_closure(env, *info);
+        if (!c.m_ok)
+            return optional<check_cache_key>();
+        closures.push_back(c.m_key);
+    }
+    for (name const & n : *g_builtin_consts) {
+        if (optional<constant_info> info = env.find(n)) {
+            closure_entry const & c = get_closure(env, *info);
+            if (!c.m_ok)
+                return optional<check_cache_key>();
+            closures.push_back(c.m_key);
+        }
+    }
+    std::sort(closures.begin(), closures.end());
+    closures.erase(std::unique(closures.begin(), closures.end()), closures.end());
+    h.mix(closures.size());
+    for (check_cache_key const & k : closures)
+        h.mix(k);
+    return optional<check_cache_key>(h.get());
+}
+
+bool is_in_check_cache(check_cache_key const & k) {
+    lock_guard<mutex> lock(*g_check_cache_mutex);
+    return g_checked->find(k) != g_checked->end();
+}
+
+void add_to_check_cache(check_cache_key const & k) {
+    lock_guard<mutex> lock(*g_check_cache_mutex);
+    if (!g_checked->insert(k).second)
+        return;
+    /* Records are appended by a single `write`, so that concurrent builds may share the file. */
+    uint64 r[2] = {k.m_h1, k.m_h2};
+    fwrite(r, sizeof(r), 1, g_check_cache_file);
+    fflush(g_check_cache_file);
+}
+
+void initialize_check_cache() {
+    g_check_cache_mutex = new mutex();
+    g_closures          = new std::unordered_map<object *, closure_entry>();
+    g_checked           = new std::unordered_set<check_cache_key, check_cache_key_hash>();
+    g_reduce_bool       = new name{"Lean", "reduceBool"};
+    mark_persistent(g_reduce_bool->raw());
+    g_reduce_nat        = new name{"Lean", "reduceNat"};
+    mark_persistent(g_reduce_nat->raw());
+    name const builtin_consts[] = {
+        name{"Nat"}, name{"Nat", "zero"}, name{"Nat", "succ"}, name{"String"}, name{"String", "mk"}, name{"Char"},
+        name{"Char", "ofNat"}, name{"List"}, name{"List", "nil"}, name{"List", "cons"}, name{"Bool"},
+        name{"Bool", "true"}, name{"Bool", "false"}, name{"Eq"}, name{"Eq", "refl"}, name{"Quot"}};
+    g_builtin_consts    = new std::vector<name>(std::begin(builtin_consts), std::end(builtin_consts));
+}
+
+void finalize_check_cache() {
+    if (g_check_cache_file) {
+        unregister_cache(g_check_cache_id);
+        fclose(g_check_cache_file);
+        g_check_cache_file = nullptr;
+    }
+    delete g_builtin_consts;
+    delete g_reduce_nat;
+    delete g_reduce_bool;
+    delete g_checked;
+    delete g_closures;
+    delete g_check_cache_mutex;
+}
+}
@@ -0,0 +1,34 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <string>
+#include "runtime/optional.h"
+#include "kernel/environment.h"
+
+namespace lean {
+/* Persistent cache of declarations that have been checked by the kernel. A declaration is identified by a hash
+   of its content, and of the content of all constants it transitively depends on in the environment, so that a
+   declaration whose dependencies are byte-identical is not type checked again when a module is rebuilt. Only
+   safe definitions, theorems and opaque constants are cached. The hash is not cryptographic: environments
+   created with trust level 0 never consult the cache, which should be used for audits. */
+
+struct check_cache_key {
+    uint64 m_h1;
+    uint64 m_h2;
+};
+
+/* Load the cache stored in the file `path`, creating it if needed, and append the keys of newly checked
+   declarations to it. Return `false` if the file cannot be opened. */
+bool set_kernel_check_cache(std::string const & path);
+bool is_kernel_check_cache_enabled();
+
+/* Return the key of `d` in `env`, or `none` if `d` must not be looked up in the cache. */
+optional<check_cache_key> get_check_cache_key(environment const & env, declaration const & d);
+bool is_in_check_cache(check_cache_key const & k);
+void add_to_check_cache(check_cache_key const & k);
+
+void initialize_check_cache();
+void finalize_check_cache();
+}
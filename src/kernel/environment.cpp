@@ -7,19 +7,26 @@ Author: Leonardo de Moura
 #include <utility>
 #include <vector>
 #include <limits>
+#include <chrono>
 #include "runtime/sstream.h"
 #include "runtime/thread.h"
+#include "runtime/array_ref.h"
 #include "util/map_foreach.h"
 #include "util/io.h"
 #include "kernel/environment.h"
 #include "kernel/kernel_exception.h"
 #include "kernel/type_checker.h"
 #include "kernel/quot.h"
+#include "kernel/profiler.h"
+#include "kernel/check_cache.h"
 
 namespace lean {
 extern "C" object* lean_environment_add(object*, object*);
 extern "C" object* lean_mk_empty_environment(uint32, object*);
 extern "C" object* lean_environment_find(object*, object*);
+extern "C" object* lean_environment_find_many(object*, object*);
+extern "C" object* lean_environment_add_many(object*, object*);
+extern "C" uint8 lean_environment_is_imported_const(object*, object*);
 extern "C" uint32 lean_environment_trust_level(object*);
 extern "C" object* lean_environment_mark_quot_init(object*);
 extern "C" uint8 lean_environment_quot_init(object*);
@@ -101,6 +108,12 @@ optional<constant_info> environment::find(name const & n) const {
     return to_optional<constant_info>(lean_environment_find(to_obj_arg(), n.to_obj_arg()));
 }
 
+void environment::find_many(buffer<name> const & ns, buffer<optional<constant_info>> & r) const {
+    array_ref<object_ref> infos(lean_environment_find_many(to_obj_arg(), array_ref<name>(ns).steal()));
+    for (object_ref const & info : infos)
+        r.push_back(to_optional<constant_info>(info.to_obj_arg()));
+}
+
 constant_info environment::get(name const & n) const {
     object * o = lean_environment_find(to_obj_arg(), n.to_obj_arg());
     if (is_scalar(o))
@@ -110,6 +123,15 @@ constant_info environment::get(name const & n) const {
     return r;
 }
 
+bool environment::is_imported(name const & n) const {
+    return lean_environment_is_imported_const(to_obj_arg(), n.to_obj_arg());
+}
+
+b_obj_res environment::get_imports_id() const {
+    // `Environment.const2ModIdx`, it is only created when importing modules
+    return cnstr_get(raw(), 0);
+}
+
 static void check_no_metavar(environment const & env, name const & n, expr const & e) {
     if (has_metavar(e))
         throw declaration_has_metavars_exception(env, n, e);
@@ -120,6 +142,8 @@ static void check_no_fvar(environment const & env, name const & n, expr const &
         throw declaration_has_free_vars_exception(env, n, e);
 }
 
+/* Constant time: `has_metavar` and `has_fvar` read flags cached in the expression data, so validating declarations
+   does not traverse their terms; the only traversals are the ones of the type checker. */
 void check_no_metavar_no_fvar(environment const & env, name const & n, expr const & e) {
     check_no_metavar(env, n, e);
     check_no_fvar(env, n, e);
@@ -171,6 +195,10 @@ void environment::add_core(constant_info const & info) {
     m_obj = lean_environment_add(m_obj, info.to_obj_arg());
 }
 
+void environment::add_core_many(buffer<constant_info> const & infos) {
+    m_obj = lean_environment_add_many(m_obj, array_ref<constant_info>(infos).steal());
+}
+
 environment environment::add(constant_info const & info) const {
     return environment(lean_environment_add(to_obj_arg(), info.to_obj_arg()));
 }
@@ -263,9 +291,10 @@ environment environment::add_mutual(declaration const & d, bool check) const {
     }
     /* Add declarations */
     environment new_env = *this;
-    for (definition_val const & v : vs) {
-        new_env.add_core(constant_info(v));
-    }
+    buffer<constant_info> infos;
+    for (definition_val const & v : vs)
+        infos.push_back(constant_info(v));
+    new_env.add_core_many(infos);
     /* Check actual definitions */
     if (check) {
         type_checker checker(new_env, diag.get(), safety);
@@ -279,7 +308,41 @@ environment environment::add_mutual(declaration const & d, bool check) const {
     return diag.update(new_env);
 }
 
+/* Name used to report the kernel profile of `d`. */
+static name get_decl_profile_name(declaration const & d) {
+    switch (d.kind()) {
+    case declaration_kind::Axiom:            return d.to_axiom_val().get_name();
+    case declaration_kind::Definition:       return d.to_definition_val().get_name();
+    case declaration_kind::Theorem:          return d.to_theorem_val().get_name();
+    case declaration_kind::Opaque:           return d.to_opaque_val().get_name();
+    case declaration_kind::MutualDefinition: return head(d.to_definition_vals()).get_name();
+    case declaration_kind::Quot:             return name("Quot");
+    case declaration_kind::Inductive:        return head(inductive_decl(d).get_types()).get_name();
+    }
+    lean_unreachable();
+}
+
 environment environment::add(declaration const & d, bool check) const {
+    optional<check_cache_key> key;
+    if (check && is_kernel_check_cache_enabled())
+        key = get_check_cache_key(*this, d);
+    if (key) {
+        if (is_in_check_cache(*key)) {
+            /* The name may have been declared since `d` was checked. */
+            check_name(get_decl_profile_name(d));
+            return add(d, false);
+        }
+        environment new_env = add_checked(d);
+        add_to_check_cache(*key);
+        return new_env;
+    }
+    return add_checked(d, check);
+}
+
+environment environment::add_checked(declaration const & d, bool check) const {
+    optional<scoped_kernel_profile> prof;
+    if (check && is_kernel_profiler_enabled())
+        prof.emplace(get_decl_profile_name(d));
     switch (d.kind()) {
     case declaration_kind::Axiom:            return add_axiom(d, check);
     case declaration_kind::Definition:       return add_definition(d, check);
@@ -299,6 +362,32 @@ extern "C" LEAN_EXPORT object * lean_add_decl(object * env, size_t max_heartbeat
         });
 }
 
+/* Return `(env.add decl, stats)`, where `stats : Kernel.CheckStats` contains the resources used to check `decl`. */
+extern "C" LEAN_EXPORT object * lean_add_decl_with_stats(object * env, size_t max_heartbeat, object * decl) {
+    scope_max_heartbeat s(max_heartbeat);
+    size_t old_peak = get_kernel_peak_cache_size();
+    set_kernel_peak_cache_size(0);
+    object * r = catch_kernel_exceptions<object_ref>([&]() {
+            size_t heartbeat = get_heartbeat();
+            auto start       = std::chrono::steady_clock::now();
+            environment new_env = environment(env).add(declaration(decl, true));
+            auto time        = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            object * stats   = alloc_cnstr(0, 0, 3 * sizeof(uint64));
+            cnstr_set_uint64(stats, 0, get_heartbeat() - heartbeat);
+            cnstr_set_uint64(stats, sizeof(uint64), time.count());
+            cnstr_set_uint64(stats, 2 * sizeof(uint64), get_kernel_peak_cache_size());
+            return mk_cnstr(0, new_env, object_ref(stats));
+        });
+    set_kernel_peak_cache_size(old_peak);
+    return r;
+}
+
+extern "C" LEAN_EXPORT object * lean_add_decl_without_checking(object * env, object * decl) {
+    return catch_kernel_exceptions<environment>([&]() {
+            return environment(env).add(declaration(decl, true), false);
+        });
+}
+
 void environment::for_each_constant(std::function<void(constant_info const & d)> const & f) const {
     smap_foreach(cnstr_get(raw(), 1), [&](object *, object * v) {
             constant_info cinfo(v, true);
@@ -312,6 +401,12 @@ void environment::display_stats() const {
     dec_ref(lean_display_stats(to_obj_arg(), io_mk_world()));
 }
 
+extern "C" obj_res lean_display_memory_stats(obj_arg env, obj_arg num_decls, obj_arg w);
+
+void environment::display_memory_stats(unsigned num_decls) const {
+    dec_ref(lean_display_memory_stats(to_obj_arg(), nat(num_decls).to_obj_arg(), io_mk_world()));
+}
+
 void initialize_environment() {
 }
 
@@ -66,6 +66,8 @@ class environment : public object_ref {
     void check_duplicated_univ_params(names ls) const;
 
     void add_core(constant_info const & info);
+    /** \brief Add all of \c infos using a single call into the Lean runtime. */
+    void add_core_many(buffer<constant_info> const & infos);
     void mark_quot_initialized();
     environment add(constant_info const & info) const;
     environment add_axiom(declaration const & d, bool check) const;
@@ -75,6 +77,8 @@ class environment : public object_ref {
     environment add_mutual(declaration const & d, bool check) const;
     environment add_quot() const;
     environment add_inductive(declaration const & d) const;
+    /** \brief Add \c d without consulting the kernel check cache, see `check_cache.h`. */
+    environment add_checked(declaration const & d, bool check = true) const;
 public:
     environment(unsigned trust_lvl = 0);
     environment(environment const & other):object_ref(other) {}
@@ -104,6 +108,15 @@ public:
     /** \brief Return information for the constant with name \c n. Throws and exception if constant declaration does not exist in this environment. */
     constant_info get(name const & n) const;
 
+    /** \brief Append to \c r the result of `find` for each name in \c ns, using a single call into the Lean runtime. */
+    void find_many(buffer<name> const & ns, buffer<optional<constant_info>> & r) const;
+
+    /** \brief Return true iff \c n is a constant imported from another module. */
+    bool is_imported(name const & n) const;
+
+    /** \brief Return an object that is shared by all environments created from the same imports, and only by them. */
+    b_obj_res get_imports_id() const;
+
     /** \brief Extends the current environment with the given declaration */
     environment add(declaration const & d, bool check = true) const;
 
@@ -116,6 +129,9 @@ public:
     }
 
     void display_stats() const;
+    /* Print the memory used by the imported modules, the environment extensions and the `num_decls` largest
+       declarations as JSON, see `Lean.Environment.displayMemoryStats`. */
+    void display_memory_stats(unsigned num_decls) const;
 };
 
 void check_no_metavar_no_fvar(environment const & env, name const & n, expr const & e);
@@ -19,11 +19,14 @@ auto equiv_manager::mk_node() -> node_ref {
 }
 
 auto equiv_manager::find(node_ref n) -> node_ref {
+    /* path halving: every other node on the path is made to point to its grandparent */
     while (true) {
         node_ref p = m_nodes[n].m_parent;
         if (p == n)
             return p;
-        n = p;
+        node_ref g = m_nodes[p].m_parent;
+        m_nodes[n].m_parent = g;
+        n = g;
     }
 }
 
@@ -45,22 +48,30 @@ void equiv_manager::merge(node_ref n1, node_ref n2) {
 }
 
 auto equiv_manager::to_node(expr const & e) -> node_ref {
-    auto it = m_to_node.find(e);
-    if (it != m_to_node.end())
-        return it->second;
+    if (node_ref const * n = m_to_node.find(e))
+        return *n;
     node_ref r = mk_node();
-    m_to_node.insert(mk_pair(e, r));
+    m_to_node.insert(e, r);
+    return r;
+}
+
+auto equiv_manager::find_root(expr const & e) const -> node_ref {
+    node_ref const * n = m_to_node.find(e);
+    if (!n)
+        return null_node;
+    node_ref r = *n;
+    while (m_nodes[r].m_parent != r)
+        r = m_nodes[r].m_parent;
     return r;
 }
 
 bool equiv_manager::is_equiv_core(expr const & a, expr const & b) {
     if (is_eqp(a, b))                      return true;
-    if (m_use_hash && hash(a) != hash(b))  return false;
     if (is_bvar(a) && is_bvar(b))          return bvar_idx(a) == bvar_idx(b);
-    node_ref r1 = find(to_node(a));
-    node_ref r2 = find(to_node(b));
-    if (r1 == r2)
+    node_ref r1 = find_root(a);
+    if (r1 != null_node && r1 == find_root(b))
         return true;
+    if (m_use_hash && hash(a) != hash(b))  return false;
     // fall back to structural equality
     if (a.kind() != b.kind())
         return false;
@@ -110,7 +121,7 @@ bool equiv_manager::is_equiv_core(expr const & a, expr const & b) {
         break;
     }
     if (result)
-        merge(r1, r2);
+        merge(to_node(a), to_node(b));
     return result;
 }
 
@@ -6,9 +6,13 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <vector>
-#include "kernel/expr_maps.h"
+#include "kernel/expr_flat_map.h"
 
 namespace lean {
+/* Union-find over expressions, used by the type checker to remember definitional equalities it has already
+   established. Nodes are keyed by pointer: structurally equal copies of an expression get different nodes,
+   which are merged the first time they are compared by `is_equiv`. Thus, looking up a node never traverses
+   the expression. */
 class equiv_manager {
     typedef unsigned node_ref;
 
@@ -17,18 +21,32 @@ class equiv_manager {
         unsigned m_rank;
     };
 
-    std::vector<node>  m_nodes;
-    expr_map<node_ref> m_to_node;
-    bool               m_use_hash;
+    struct expr_ptr_eq {
+        bool operator()(expr const & a, expr const & b) const { return is_eqp(a, b); }
+    };
+
+    static constexpr node_ref null_node = static_cast<node_ref>(-1);
+
+    std::vector<node>                                       m_nodes;
+    flat_hash_map<expr, node_ref, expr_hash, expr_ptr_eq>   m_to_node;
+    bool                                                    m_use_hash;
 
     node_ref mk_node();
     node_ref find(node_ref n);
     void merge(node_ref n1, node_ref n2);
     node_ref to_node(expr const & e);
+    /* Return the root of the class of `e`, or `null_node` if `e` has no node. */
+    node_ref find_root(expr const & e) const;
     bool is_equiv_core(expr const & e1, expr const & e2);
 public:
     equiv_manager():m_use_hash(false) {}
     bool is_equiv(expr const & e1, expr const & e2, bool use_hash = false);
     void add_equiv(expr const & e1, expr const & e2);
+    /* Forget all equivalences, keeping up to `max_slots` slots of the node table allocated for reuse. */
+    void reset(size_t max_slots) {
+        m_nodes.clear();
+        m_to_node.reset(max_slots);
+        m_use_hash = false;
+    }
 };
 }
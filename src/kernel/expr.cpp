@@ -27,6 +27,10 @@ literal::literal(char const * v):
     object_ref(mk_cnstr(static_cast<unsigned>(literal_kind::String), mk_string(v))) {
 }
 
+literal::literal(string_ref const & v):
+    object_ref(mk_cnstr(static_cast<unsigned>(literal_kind::String), v)) {
+}
+
 literal::literal(unsigned v):
     object_ref(mk_cnstr(static_cast<unsigned>(literal_kind::Nat), mk_nat_obj(v))) {
 }
@@ -99,7 +103,13 @@ extern "C" uint8 lean_expr_has_level_param(obj_arg e);
 bool has_univ_param(expr const & e) { return lean_expr_has_level_param(e.to_obj_arg()); }
 
 extern "C" unsigned lean_expr_loose_bvar_range(object * e);
-unsigned get_loose_bvar_range(expr const & e) { return lean_expr_loose_bvar_range(e.to_obj_arg()); }
+unsigned get_loose_bvar_range(expr const & e) {
+    /* `Expr.Data.looseBVarRange` */
+    object * o = e.raw();
+    unsigned r = static_cast<unsigned>(lean_ctor_get_uint64(o, lean_ctor_num_objs(o)*sizeof(object*)) >> 44);
+    lean_assert(r == lean_expr_loose_bvar_range(e.to_obj_arg()));
+    return r;
+}
 
 // =======================================
 // Constructors
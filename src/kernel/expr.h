@@ -48,6 +48,7 @@ public:
     explicit literal(unsigned v);
     explicit literal(mpz const & v);
     explicit literal(nat const & v);
+    explicit literal(string_ref const & v);
     literal():literal(0u) {}
     literal(literal const & other):object_ref(other) {}
     literal(literal && other):object_ref(other) {}
@@ -123,6 +124,11 @@ inline bool is_eqp(optional<expr> const & a, optional<expr> const & b) {
     return static_cast<bool>(a) == static_cast<bool>(b) && (!a || is_eqp(*a, *b));
 }
 
+/* Structural hash stored in the lower 32 bits of `Expr.Data`. The upper 32 bits hold the flags, the approximate depth
+   and the loose bound variable range, so that `Expr.Data` is a single scalar field of every `Expr` object. The hash
+   is the lower half of a 64-bit `mixHash`, and its low bits, which the kernel caches use as slot indices, are
+   uniformly distributed. For caches of any practical size, slot conflicts are thus far more frequent than collisions
+   of the full 32 bits, which `flat_hash_map` and `expr_cache` resolve by comparing the expressions. */
 unsigned hash(expr const & e);
 bool has_expr_mvar(expr const & e);
 bool has_univ_mvar(expr const & e);
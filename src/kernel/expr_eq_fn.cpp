@@ -6,7 +6,8 @@ Author: Leonardo de Moura
 */
 #include <vector>
 #include <memory>
-#include "runtime/interrupt.h"
+#include "runtime/memory.h"
+#include "runtime/buffer.h"
 #include "runtime/thread.h"
 #include "kernel/expr.h"
 #include "kernel/expr_sets.h"
@@ -55,16 +56,18 @@ MK_THREAD_LOCAL_GET_DEF(eq_cache, get_eq_cache);
 /** \brief Functional object for comparing expressions.
 
     Remark if CompareBinderInfo is true, then functional object will also compare
-    binder information attached to lambda and Pi expressions */
+    binder information attached to lambda and Pi expressions
+
+    The traversal uses an explicit stack of pairs of subterms still to be compared, so that deep terms such as
+    long list literals do not exhaust the native stack. */
 template<bool CompareBinderInfo>
 class expr_eq_fn {
+    typedef pair<expr const &, expr const &> todo_entry;
     eq_cache & m_cache;
 
-    static void check_system() {
-        ::lean::check_system("expression equality test");
-    }
-
-    bool apply(expr const & a, expr const & b) {
+    /* Compare the data of `a` and `b` that is not a subterm, and push the pairs of subterms that still need to be
+       compared to `todo`. Return false if `a` and `b` are known to be different. */
+    bool step(expr const & a, expr const & b, buffer<todo_entry> & todo) {
         if (is_eqp(a, b))          return true;
         if (hash(a) != hash(b))    return false;
         if (a.kind() != b.kind())  return false;
@@ -80,14 +83,15 @@ class expr_eq_fn {
         case expr_kind::BVar:
             lean_unreachable(); // LCOV_EXCL_LINE
         case expr_kind::MData:
-            return
-                apply(mdata_expr(a), mdata_expr(b)) &&
-                mdata_data(a) == mdata_data(b);
+            if (mdata_data(a) != mdata_data(b))
+                return false;
+            todo.emplace_back(mdata_expr(a), mdata_expr(b));
+            return true;
         case expr_kind::Proj:
-            return
-                apply(proj_expr(a), proj_expr(b)) &&
-                proj_sname(a) == proj_sname(b) &&
-                proj_idx(a) == proj_idx(b);
+            if (proj_sname(a) != proj_sname(b) || proj_idx(a) != proj_idx(b))
+                return false;
+            todo.emplace_back(proj_expr(a), proj_expr(b));
+            return true;
         case expr_kind::Lit:
             return lit_value(a) == lit_value(b);
         case expr_kind::Const:
@@ -99,29 +103,43 @@ class expr_eq_fn {
         case expr_kind::FVar:
             return fvar_name(a) == fvar_name(b);
         case expr_kind::App:
-            check_system();
-            return
-                apply(app_fn(a), app_fn(b)) &&
-                apply(app_arg(a), app_arg(b));
+            check_memory("expression equality test");
+            // `app_fn` is compared first, it is more likely to differ
+            todo.emplace_back(app_arg(a), app_arg(b));
+            todo.emplace_back(app_fn(a), app_fn(b));
+            return true;
         case expr_kind::Lambda: case expr_kind::Pi:
-            check_system();
-            return
-                apply(binding_domain(a), binding_domain(b)) &&
-                apply(binding_body(a), binding_body(b)) &&
-                (!CompareBinderInfo || binding_name(a) == binding_name(b)) &&
-                (!CompareBinderInfo || binding_info(a) == binding_info(b));
+            if (CompareBinderInfo && (binding_name(a) != binding_name(b) || binding_info(a) != binding_info(b)))
+                return false;
+            check_memory("expression equality test");
+            todo.emplace_back(binding_body(a), binding_body(b));
+            todo.emplace_back(binding_domain(a), binding_domain(b));
+            return true;
         case expr_kind::Let:
-            check_system();
-            return
-                apply(let_type(a), let_type(b)) &&
-                apply(let_value(a), let_value(b)) &&
-                apply(let_body(a), let_body(b)) &&
-                (!CompareBinderInfo || let_name(a) == let_name(b));
+            if (CompareBinderInfo && let_name(a) != let_name(b))
+                return false;
+            check_memory("expression equality test");
+            todo.emplace_back(let_body(a), let_body(b));
+            todo.emplace_back(let_value(a), let_value(b));
+            todo.emplace_back(let_type(a), let_type(b));
+            return true;
         case expr_kind::Sort:
             return sort_level(a) == sort_level(b);
         }
         lean_unreachable(); // LCOV_EXCL_LINE
     }
+
+    bool apply(expr const & a, expr const & b) {
+        buffer<todo_entry> todo;
+        todo.emplace_back(a, b);
+        while (!todo.empty()) {
+            todo_entry p = todo.back();
+            todo.pop_back();
+            if (!step(p.first, p.second, todo))
+                return false;
+        }
+        return true;
+    }
 public:
     expr_eq_fn():m_cache(get_eq_cache()) {}
     ~expr_eq_fn() { m_cache.clear(); }
@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <vector>
+#include <utility>
+#include "util/unit.h"
+#include "kernel/expr.h"
+
+namespace lean {
+/* Structural equality where pointer equality is tested inline before falling back to `is_equal`. */
+struct expr_fast_eq {
+    bool operator()(expr const & a, expr const & b) const { return is_eqp(a, b) || is_equal(a, b); }
+};
+
+struct expr_pair_fast_eq {
+    bool operator()(expr_pair const & p1, expr_pair const & p2) const {
+        return expr_fast_eq()(p1.first, p2.first) && expr_fast_eq()(p1.second, p2.second);
+    }
+};
+
+/* Hash map with open addressing and linear probing for the kernel caches. It only supports insertion and
+   `clear`. Each slot stores the hash of its key, so that probing only compares keys when the hashes match.
+   Compared to `std::unordered_map`, inserting does not allocate a node and lookups do not chase pointers. */
+template<typename Key, typename T, typename Hash, typename Eq>
+class flat_hash_map {
+    struct slot {
+        unsigned m_hash;
+        bool     m_used{false};
+        Key      m_key;
+        T        m_value;
+    };
+    std::vector<slot> m_slots;
+    size_t            m_size{0};
+
+    static constexpr size_t initial_capacity = 64;
+
+    size_t mask() const { return m_slots.size() - 1; }
+
+    /* Return the slot containing `k`, or the empty slot where it should be inserted.
+       \pre !m_slots.empty() */
+    slot & find_slot(Key const & k, unsigned h) {
+        size_t i = h & mask();
+        while (true) {
+            slot & s = m_slots[i];
+            if (!s.m_used || (s.m_hash == h && Eq()(s.m_key, k)))
+                return s;
+            i = (i + 1) & mask();
+        }
+    }
+
+    void grow() {
+        std::vector<slot> old;
+        old.swap(m_slots);
+        m_slots.resize(old.empty() ? initial_capacity : 2 * old.size());
+        for (slot & s : old) {
+            if (s.m_used) {
+                slot & n = find_slot(s.m_key, s.m_hash);
+                n.m_hash  = s.m_hash;
+                n.m_used  = true;
+                n.m_key   = std::move(s.m_key);
+                n.m_value = std::move(s.m_value);
+            }
+        }
+    }
+public:
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    void clear() {
+        m_slots.clear();
+        m_size = 0;
+    }
+
+    /* Remove all entries like `clear`, but keep the slots allocated for reuse if there are at most `max_slots`. */
+    void reset(size_t max_slots) {
+        if (m_slots.size() > max_slots) {
+            clear();
+            return;
+        }
+        if (m_size > 0) {
+            for (slot & s : m_slots) {
+                if (s.m_used)
+                    s = slot();
+            }
+        }
+        m_size = 0;
+    }
+
+    /* Return a pointer to the value associated with `k`, or `nullptr` if there is none. */
+    T const * find(Key const & k) const {
+        if (m_size == 0)
+            return nullptr;
+        unsigned h = Hash()(k);
+        size_t i   = h & mask();
+        while (true) {
+            slot const & s = m_slots[i];
+            if (!s.m_used)
+                return nullptr;
+            if (s.m_hash == h && Eq()(s.m_key, k))
+                return &s.m_value;
+            i = (i + 1) & mask();
+        }
+    }
+
+    bool contains(Key const & k) const { return find(k) != nullptr; }
+
+    /* Associate `v` with `k`. The existing value is kept if `k` is already in the map. */
+    void insert(Key const & k, T const & v) {
+        /* Keep the load factor below 3/4. */
+        if (4 * (m_size + 1) > 3 * m_slots.size())
+            grow();
+        unsigned h = Hash()(k);
+        slot & s   = find_slot(k, h);
+        if (s.m_used)
+            return;
+        s.m_hash  = h;
+        s.m_used  = true;
+        s.m_key   = k;
+        s.m_value = v;
+        m_size++;
+    }
+};
+
+template<typename T>
+using expr_flat_map = flat_hash_map<expr, T, expr_hash, expr_fast_eq>;
+
+class expr_pair_flat_set : public flat_hash_map<expr_pair, unit, expr_pair_hash, expr_pair_fast_eq> {
+public:
+    void insert(expr_pair const & p) { flat_hash_map::insert(p, unit()); }
+};
+}
@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <vector>
+#include "runtime/hash.h"
+#include "kernel/expr.h"
+
+#ifndef LEAN_EXPR_OFFSET_CACHE_WAYS
+#define LEAN_EXPR_OFFSET_CACHE_WAYS 4
+#endif
+
+namespace lean {
+/** \brief Bounded cache for traversals such as `replace` and `for_each`, mapping pairs (expression cell, offset)
+    to values of type `T`. Keys are compared by pointer.
+
+    The cache is set-associative: a key can be stored in any of the `LEAN_EXPR_OFFSET_CACHE_WAYS` entries of its
+    set. When the set is full, the entry to be replaced is selected using the CLOCK policy: entries that have been
+    found since the hand last passed them get a second chance. Thus, hot entries are not evicted by a stream of
+    cold entries that collide with them, as in a direct-mapped table. */
+template<typename T>
+class expr_offset_cache {
+    static constexpr unsigned ways = LEAN_EXPR_OFFSET_CACHE_WAYS;
+    struct entry {
+        object const * m_cell{nullptr};
+        unsigned       m_offset{0};
+        bool           m_referenced{false};
+        T              m_value;
+    };
+    unsigned                   m_num_sets;
+    std::vector<entry>         m_entries;
+    /* CLOCK hand of each set */
+    std::vector<unsigned char> m_hands;
+    /* Sets that contain at least one entry, to make `clear` proportional to the number of sets used. */
+    std::vector<unsigned>      m_used;
+
+    entry * get_set(expr const & e, unsigned offset) {
+        unsigned i = hash(hash(e), offset) % m_num_sets;
+        return m_entries.data() + i * ways;
+    }
+public:
+    expr_offset_cache(unsigned capacity):
+        m_num_sets(capacity < ways ? 1 : capacity / ways), m_entries(m_num_sets * ways), m_hands(m_num_sets, 0) {}
+
+    T * find(expr const & e, unsigned offset) {
+        entry * set = get_set(e, offset);
+        for (unsigned j = 0; j < ways; j++) {
+            entry & en = set[j];
+            if (en.m_cell == e.raw() && en.m_offset == offset) {
+                en.m_referenced = true;
+                return &en.m_value;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(expr const & e, unsigned offset, T const & v) {
+        entry * set  = get_set(e, offset);
+        unsigned set_idx = (set - m_entries.data()) / ways;
+        entry * slot = nullptr;
+        for (unsigned j = 0; j < ways; j++) {
+            entry & en = set[j];
+            if (en.m_cell == e.raw() && en.m_offset == offset) {
+                slot = &en;
+                break;
+            }
+            if (!slot && en.m_cell == nullptr)
+                slot = &en;
+        }
+        if (!slot) {
+            unsigned char & hand = m_hands[set_idx];
+            while (set[hand].m_referenced) {
+                set[hand].m_referenced = false;
+                hand = (hand + 1) % ways;
+            }
+            slot = &set[hand];
+            hand = (hand + 1) % ways;
+        } else if (slot == set && slot->m_cell == nullptr) {
+            /* Entries are only removed by `clear`, so the sets are filled in order, and this is the first entry. */
+            m_used.push_back(set_idx);
+        }
+        slot->m_cell       = e.raw();
+        slot->m_offset     = offset;
+        slot->m_referenced = false;
+        slot->m_value      = v;
+    }
+
+    void clear() {
+        for (unsigned i : m_used) {
+            entry * set = m_entries.data() + i * ways;
+            for (unsigned j = 0; j < ways; j++) {
+                set[j].m_cell       = nullptr;
+                set[j].m_referenced = false;
+                set[j].m_value      = T();
+            }
+            m_hands[i] = 0;
+        }
+        m_used.clear();
+    }
+};
+}
@@ -11,40 +11,24 @@ Author: Leonardo de Moura
 #include "runtime/flet.h"
 #include "kernel/for_each_fn.h"
 #include "kernel/cache_stack.h"
+#include "kernel/expr_offset_cache.h"
+#include "kernel/profiler.h"
+#include "util/unit.h"
 
 #ifndef LEAN_DEFAULT_FOR_EACH_CACHE_CAPACITY
 #define LEAN_DEFAULT_FOR_EACH_CACHE_CAPACITY 1024*8
 #endif
 
 namespace lean {
-struct for_each_cache {
-    struct entry {
-        object const *    m_cell;
-        unsigned          m_offset;
-        entry():m_cell(nullptr) {}
-    };
-    unsigned              m_capacity;
-    std::vector<entry>    m_cache;
-    std::vector<unsigned> m_used;
-    for_each_cache(unsigned c):m_capacity(c), m_cache(c) {}
+struct for_each_cache : public expr_offset_cache<unit> {
+    for_each_cache(unsigned c):expr_offset_cache<unit>(c) {}
 
     bool visited(expr const & e, unsigned offset) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == e.raw() && m_cache[i].m_offset == offset) {
-            return true;
-        } else {
-            if (m_cache[i].m_cell == nullptr)
-                m_used.push_back(i);
-            m_cache[i].m_cell   = e.raw();
-            m_cache[i].m_offset = offset;
-            return false;
-        }
-    }
-
-    void clear() {
-        for (unsigned i : m_used)
-            m_cache[i].m_cell = nullptr;
-        m_used.clear();
+        bool r = find(e, offset) != nullptr;
+        record_kernel_cache_access(kernel_profile_cache::ForEach, r);
+        if (!r)
+            insert(e, offset, unit());
+        return r;
     }
 };
 
@@ -0,0 +1,49 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include "runtime/interrupt.h"
+#include "kernel/hash_cons.h"
+
+namespace lean {
+expr hash_cons_table::share(expr const & e) {
+    if (expr const * r = m_table.find(e))
+        return *r;
+    check_system("hash consing");
+    expr r;
+    switch (e.kind()) {
+    case expr_kind::BVar:  case expr_kind::Lit:
+    case expr_kind::MVar:  case expr_kind::FVar:
+    case expr_kind::Const: case expr_kind::Sort:
+        r = e;
+        break;
+    case expr_kind::MData:
+        r = update_mdata(e, share(mdata_expr(e)));
+        break;
+    case expr_kind::Proj:
+        r = update_proj(e, share(proj_expr(e)));
+        break;
+    case expr_kind::App: {
+        expr new_f = share(app_fn(e));
+        expr new_a = share(app_arg(e));
+        r = update_app(e, new_f, new_a);
+        break;
+    }
+    case expr_kind::Lambda: case expr_kind::Pi: {
+        expr new_d = share(binding_domain(e));
+        expr new_b = share(binding_body(e));
+        r = update_binding(e, new_d, new_b);
+        break;
+    }
+    case expr_kind::Let: {
+        expr new_t = share(let_type(e));
+        expr new_v = share(let_value(e));
+        expr new_b = share(let_body(e));
+        r = update_let(e, new_t, new_v, new_b);
+        break;
+    }
+    }
+    m_table.insert(r, r);
+    return r;
+}
+}
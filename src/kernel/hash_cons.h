@@ -0,0 +1,25 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include "kernel/expr_flat_map.h"
+
+namespace lean {
+struct expr_bi_fast_eq {
+    bool operator()(expr const & a, expr const & b) const { return is_eqp(a, b) || is_bi_equal(a, b); }
+};
+
+/* Hash-consing table for the kernel, similar to `max_sharing_fn`. `share(e)` returns a term identical to `e`
+   (binder names and information included) such that structurally equal subterms of all terms returned
+   by the same table are pointer equal. Terms that were already returned are found in constant time, so the
+   cost of `share` is proportional to the number of new subterms. */
+class hash_cons_table {
+    flat_hash_map<expr, expr, expr_hash, expr_bi_fast_eq> m_table;
+public:
+    expr share(expr const & e);
+    size_t size() const { return m_table.size(); }
+    void clear() { m_table.clear(); }
+    void reset(size_t max_slots) { m_table.reset(max_slots); }
+};
+}
@@ -4,6 +4,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <memory>
 #include "runtime/sstream.h"
 #include "runtime/utf8.h"
 #include "util/name_generator.h"
@@ -158,6 +159,10 @@ class add_inductive_fn {
        and for nested inductive datatypes. */
     buffer<rec_info>       m_rec_infos;
 
+    /* State shared by the type checkers returned by `tc()`, so that the `whnf` and `infer_type` caches are reused
+       across the constructors and their arguments. It is recreated when `m_env` changes. */
+    std::unique_ptr<type_checker::state> m_st;
+
 public:
     add_inductive_fn(environment const & env, diagnostics * diag, inductive_decl const & decl, bool is_nested):
         m_env(env), m_ngen(*g_ind_fresh), m_diag(diag), m_lparams(decl.get_lparams()), m_is_unsafe(decl.is_unsafe()),
@@ -168,7 +173,14 @@ public:
         to_buffer(decl.get_types(), m_ind_types);
     }
 
-    type_checker tc() { return type_checker(m_env, m_lctx, m_diag, m_is_unsafe ? definition_safety::unsafe : definition_safety::safe); }
+    type_checker tc() {
+        definition_safety ds = m_is_unsafe ? definition_safety::unsafe : definition_safety::safe;
+        if (m_diag)
+            return type_checker(m_env, m_lctx, m_diag, ds);
+        if (!m_st || !is_eqp(m_st->env(), m_env))
+            m_st.reset(new type_checker::state(m_env));
+        return type_checker(*m_st, m_lctx, ds);
+    }
 
     /** Return type of the parameter at position `i` */
     expr get_param_type(unsigned i) const {
@@ -13,6 +13,7 @@ Author: Leonardo de Moura
 #include "kernel/inductive.h"
 #include "kernel/quot.h"
 #include "kernel/trace.h"
+#include "kernel/check_cache.h"
 
 namespace lean {
 void initialize_kernel_module() {
@@ -25,9 +26,11 @@ void initialize_kernel_module() {
     initialize_inductive();
     initialize_quot();
     initialize_trace();
+    initialize_check_cache();
 }
 
 void finalize_kernel_module() {
+    finalize_check_cache();
     finalize_trace();
     finalize_quot();
     finalize_inductive();
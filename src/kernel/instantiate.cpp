@@ -11,31 +11,105 @@ Author: Leonardo de Moura
 #include "kernel/kernel_exception.h"
 #include "kernel/instantiate.h"
 
+#ifndef LEAN_INSTANTIATE_FAST_PATH_MAX_VISITS
+#define LEAN_INSTANTIATE_FAST_PATH_MAX_VISITS 128
+#endif
+
 namespace lean {
-expr instantiate(expr const & a, unsigned s, unsigned n, expr const * subst) {
-    if (s >= get_loose_bvar_range(a) || n == 0)
-        return a;
-    return replace(a, [=](expr const & m, unsigned offset) -> optional<expr> {
+/* Fast path for instantiating the loose bound variables `>= s` of small terms, such as the body of a lambda in a
+   beta step, without going through `replace`. Subterms without loose bound variables in range are skipped using
+   `get_loose_bvar_range`, and nothing is cached. `F` is invoked on the bound variables `#i` with `i >= s + offset`
+   in the scope of `offset` binders. Since there is no cache, a term with a lot of sharing could be traversed
+   exponentially many times, thus we give up after `LEAN_INSTANTIATE_FAST_PATH_MAX_VISITS` subterms, and the
+   caller must use `replace` instead. */
+template<typename F>
+class instantiate_small_fn {
+    F const & m_f;
+    unsigned  m_s;
+    unsigned  m_visits{0};
+    bool      m_failed{false};
+
+    expr visit(expr const & e, unsigned offset) {
+        unsigned s1 = m_s + offset;
+        if (s1 < m_s || s1 >= get_loose_bvar_range(e))
+            return e; // overflow, or `e` does not contain loose bound variables with idx >= s1
+        if (m_failed || ++m_visits > LEAN_INSTANTIATE_FAST_PATH_MAX_VISITS) {
+            m_failed = true;
+            return e;
+        }
+        switch (e.kind()) {
+        case expr_kind::BVar:
+            return m_f(e, offset);
+        case expr_kind::Const: case expr_kind::Sort:
+        case expr_kind::Lit:   case expr_kind::MVar:
+        case expr_kind::FVar:
+            lean_unreachable();
+        case expr_kind::MData:
+            return update_mdata(e, visit(mdata_expr(e), offset));
+        case expr_kind::Proj:
+            return update_proj(e, visit(proj_expr(e), offset));
+        case expr_kind::App: {
+            expr new_f = visit(app_fn(e), offset);
+            expr new_a = visit(app_arg(e), offset);
+            return update_app(e, new_f, new_a);
+        }
+        case expr_kind::Pi: case expr_kind::Lambda: {
+            expr new_d = visit(binding_domain(e), offset);
+            expr new_b = visit(binding_body(e), offset+1);
+            return update_binding(e, new_d, new_b);
+        }
+        case expr_kind::Let: {
+            expr new_t = visit(let_type(e), offset);
+            expr new_v = visit(let_value(e), offset);
+            expr new_b = visit(let_body(e), offset+1);
+            return update_let(e, new_t, new_v, new_b);
+        }
+        }
+        lean_unreachable();
+    }
+public:
+    instantiate_small_fn(F const & f, unsigned s):m_f(f), m_s(s) {}
+    optional<expr> operator()(expr const & e) {
+        expr r = visit(e, 0);
+        if (m_failed)
+            return none_expr();
+        return some_expr(r);
+    }
+};
+
+/* Instantiate the loose bound variables `>= s` of `a` using `instantiate_bvar`, see `instantiate_small_fn`. */
+template<typename F>
+static expr instantiate_core(expr const & a, unsigned s, F const & instantiate_bvar) {
+    if (auto r = instantiate_small_fn<F>(instantiate_bvar, s)(a))
+        return *r;
+    return replace(a, [&](expr const & m, unsigned offset) -> optional<expr> {
             unsigned s1 = s + offset;
             if (s1 < s)
                 return some_expr(m); // overflow, vidx can't be >= max unsigned
             if (s1 >= get_loose_bvar_range(m))
                 return some_expr(m); // expression m does not contain loose bound variables with idx >= s1
-            if (is_bvar(m)) {
-                nat const & vidx = bvar_idx(m);
-                if (vidx >= s1) {
-                    unsigned h = s1 + n;
-                    if (h < s1 /* overflow, h is bigger than any vidx */ || vidx < h) {
-                        return some_expr(lift_loose_bvars(subst[vidx.get_small_value() - s1], offset));
-                    } else {
-                        return some_expr(mk_bvar(vidx - nat(n)));
-                    }
-                }
-            }
+            if (is_bvar(m))
+                return some_expr(instantiate_bvar(m, offset));
             return none_expr();
         });
 }
 
+expr instantiate(expr const & a, unsigned s, unsigned n, expr const * subst) {
+    if (s >= get_loose_bvar_range(a) || n == 0)
+        return a;
+    return instantiate_core(a, s, [=](expr const & m, unsigned offset) -> expr {
+            /* `vidx >= s + offset` */
+            unsigned s1 = s + offset;
+            nat const & vidx = bvar_idx(m);
+            unsigned h = s1 + n;
+            if (h < s1 /* overflow, h is bigger than any vidx */ || vidx < h) {
+                return lift_loose_bvars(subst[vidx.get_small_value() - s1], offset);
+            } else {
+                return mk_bvar(vidx - nat(n));
+            }
+        });
+}
+
 expr instantiate(expr const & e, unsigned n, expr const * s) { return instantiate(e, 0, n, s); }
 expr instantiate(expr const & e, std::initializer_list<expr> const & l) {  return instantiate(e, l.size(), l.begin()); }
 expr instantiate(expr const & e, unsigned i, expr const & s) { return instantiate(e, i, 1, &s); }
@@ -58,22 +132,15 @@ static object * lean_expr_instantiate_core(b_obj_arg a0, size_t n, object** subs
         lean_inc(a0);
         return a0;
     }
-    expr r = replace(a, [=](expr const & m, unsigned offset) -> optional<expr> {
-            if (offset >= get_loose_bvar_range(m))
-                return some_expr(m); // expression m does not contain loose bound variables with idx >= offset
-            if (is_bvar(m)) {
-                nat const & vidx = bvar_idx(m);
-                if (vidx >= offset) {
-                    size_t h = offset + n;
-                    if (h < offset /* overflow, h is bigger than any vidx */ || (vidx.is_small() && vidx.get_small_value() < h)) {
-                        object * v = subst[vidx.get_small_value() - offset];
-                        return some_expr(lift_loose_bvars(TO_REF(expr, v), offset));
-                    } else {
-                        return some_expr(mk_bvar(vidx - nat::of_size_t(n)));
-                    }
-                }
+    expr r = instantiate_core(a, 0, [=](expr const & m, unsigned offset) -> expr {
+            nat const & vidx = bvar_idx(m);
+            size_t h = offset + n;
+            if (h < offset /* overflow, h is bigger than any vidx */ || (vidx.is_small() && vidx.get_small_value() < h)) {
+                object * v = subst[vidx.get_small_value() - offset];
+                return lift_loose_bvars(TO_REF(expr, v), offset);
+            } else {
+                return mk_bvar(vidx - nat::of_size_t(n));
             }
-            return none_expr();
         });
     return r.steal();
 }
@@ -99,21 +166,14 @@ extern "C" LEAN_EXPORT object * lean_expr_instantiate_range(b_obj_arg a, b_obj_a
 expr instantiate_rev(expr const & a, unsigned n, expr const * subst) {
     if (!has_loose_bvars(a))
         return a;
-    return replace(a, [=](expr const & m, unsigned offset) -> optional<expr> {
-            if (offset >= get_loose_bvar_range(m))
-                return some_expr(m); // expression m does not contain loose bound variables with idx >= offset
-            if (is_bvar(m)) {
-                nat const & vidx = bvar_idx(m);
-                if (vidx >= offset) {
-                    size_t h = offset + n;
-                    if (h < offset /* overflow, h is bigger than any vidx */ || (vidx.is_small() && vidx.get_small_value() < h)) {
-                        return some_expr(lift_loose_bvars(subst[n - (vidx.get_small_value() - offset) - 1], offset));
-                    } else {
-                        return some_expr(mk_bvar(vidx - nat(n)));
-                    }
-                }
+    return instantiate_core(a, 0, [=](expr const & m, unsigned offset) -> expr {
+            nat const & vidx = bvar_idx(m);
+            size_t h = offset + n;
+            if (h < offset /* overflow, h is bigger than any vidx */ || (vidx.is_small() && vidx.get_small_value() < h)) {
+                return lift_loose_bvars(subst[n - (vidx.get_small_value() - offset) - 1], offset);
+            } else {
+                return mk_bvar(vidx - nat(n));
             }
-            return none_expr();
         });
 }
 
@@ -123,22 +183,15 @@ static object * lean_expr_instantiate_rev_core(object * a0, size_t n, object **
         lean_inc(a0);
         return a0;
     }
-    expr r = replace(a, [=](expr const & m, unsigned offset) -> optional<expr> {
-            if (offset >= get_loose_bvar_range(m))
-                return some_expr(m); // expression m does not contain loose bound variables with idx >= offset
-            if (is_bvar(m)) {
-                nat const & vidx = bvar_idx(m);
-                if (vidx >= offset) {
-                    size_t h = offset + n;
-                    if (h < offset /* overflow, h is bigger than any vidx */ || (vidx.is_small() && vidx.get_small_value() < h)) {
-                        object * v = subst[n - (vidx.get_small_value() - offset) - 1];
-                        return some_expr(lift_loose_bvars(TO_REF(expr, v), offset));
-                    } else {
-                        return some_expr(mk_bvar(vidx - nat::of_size_t(n)));
-                    }
-                }
+    expr r = instantiate_core(a, 0, [=](expr const & m, unsigned offset) -> expr {
+            nat const & vidx = bvar_idx(m);
+            size_t h = offset + n;
+            if (h < offset /* overflow, h is bigger than any vidx */ || (vidx.is_small() && vidx.get_small_value() < h)) {
+                object * v = subst[n - (vidx.get_small_value() - offset) - 1];
+                return lift_loose_bvars(TO_REF(expr, v), offset);
+            } else {
+                return mk_bvar(vidx - nat::of_size_t(n));
             }
-            return none_expr();
         });
     return r.steal();
 }
@@ -181,14 +234,30 @@ expr apply_beta(expr f, unsigned num_args, expr const * args) {
     }
 }
 
+expr beta_rev_args(expr f, buffer<expr> & rev_args) {
+    lean_assert(is_lambda(f) && !rev_args.empty());
+    unsigned num_args = rev_args.size();
+    unsigned m = 1;
+    while (is_lambda(binding_body(f)) && m < num_args) {
+        f = binding_body(f);
+        m++;
+    }
+    expr b = instantiate(binding_body(f), m, rev_args.data() + (num_args - m));
+    rev_args.shrink(num_args - m);
+    return get_app_rev_args(b, rev_args);
+}
+
 expr head_beta_reduce(expr const & t) {
     if (!is_head_beta(t)) {
         return t;
     } else {
         buffer<expr> args;
-        expr const & f = get_app_rev_args(t, args);
+        expr f = get_app_rev_args(t, args);
         lean_assert(is_lambda(f));
-        return head_beta_reduce(apply_beta(f, args.size(), args.data()));
+        do {
+            f = beta_rev_args(f, args);
+        } while (is_lambda(f) && !args.empty());
+        return mk_rev_app(f, args.size(), args.data());
     }
 }
 
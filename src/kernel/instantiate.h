@@ -26,6 +26,12 @@ inline expr instantiate_rev(expr const & e, buffer<expr> const & s) {
 
 expr apply_beta(expr f, unsigned num_rev_args, expr const * rev_args);
 bool is_head_beta(expr const & t);
+/** \brief Given `f := fun x_1 ... x_k => b` and the arguments of `f a_1 ... a_n` in reverse order in `rev_args`,
+    beta-reduce `m := min(k, n)` arguments at once, and return the head `h` of the result. The consumed arguments
+    are removed from `rev_args`, and the arguments of the instantiated body are added to it, so that
+    `mk_rev_app(h, rev_args)` is `b[a_1, ..., a_m] a_{m+1} ... a_n`. The intermediate applications are not built.
+    \pre is_lambda(f) && !rev_args.empty() */
+expr beta_rev_args(expr f, buffer<expr> & rev_args);
 expr head_beta_reduce(expr const & t);
 /* If `e` is of the form `(fun x, t) a` return `head_beta_const_fn(t)` if `t` does not depend on `x`,
    and `e` otherwise. We also reduce `(fun x_1 ... x_n, x_i) a_1 ... a_n` into `a_[n-i-1]` */
@@ -12,10 +12,15 @@ Author: Leonardo de Moura
 #include "runtime/interrupt.h"
 #include "runtime/hash.h"
 #include "runtime/buffer.h"
+#include "runtime/thread.h"
 #include "util/list.h"
 #include "kernel/level.h"
 #include "kernel/environment.h"
 
+#ifndef LEAN_LEVEL_NORMALIZE_CACHE_CAPACITY
+#define LEAN_LEVEL_NORMALIZE_CACHE_CAPACITY 1024*8
+#endif
+
 namespace lean {
 
 extern "C" unsigned lean_level_hash(obj_arg l);
@@ -426,7 +431,41 @@ level mk_succ(level l, unsigned k) {
     return l;
 }
 
+/* Direct-mapped cache for `normalize`, keyed by level pointer. Universe-polymorphic declarations make the type
+   checker compare the same `max`/`imax` levels many times, and normalizing them sorts their arguments. */
+struct normalize_cache {
+    struct entry {
+        level m_key;
+        level m_value;
+    };
+    std::vector<entry> m_entries;
+    normalize_cache():m_entries(LEAN_LEVEL_NORMALIZE_CACHE_CAPACITY) {}
+
+    entry & get_entry(level const & l) {
+        return m_entries[l.hash() % LEAN_LEVEL_NORMALIZE_CACHE_CAPACITY];
+    }
+};
+
+/* CACHE_RESET: No */
+MK_THREAD_LOCAL_GET_DEF(normalize_cache, get_normalize_cache);
+
+static level normalize_core(level const & l);
+
 level normalize(level const & l) {
+    level const & r = to_offset(l).first;
+    if (!is_max(r) && !is_imax(r))
+        return l;
+    normalize_cache::entry & en = get_normalize_cache().get_entry(l);
+    if (is_eqp(en.m_key, l))
+        return en.m_value;
+    level n = normalize_core(l);
+    /* The recursive calls in `normalize_core` may have overwritten `en`; the table itself is never reallocated. */
+    en.m_key   = l;
+    en.m_value = n;
+    return n;
+}
+
+static level normalize_core(level const & l) {
     auto p = to_offset(l);
     level const & r = p.first;
     switch (kind(r)) {
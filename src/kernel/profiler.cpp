@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <algorithm>
+#include <vector>
+#include "runtime/thread.h"
+#include "runtime/sstream.h"
+#include "util/name_hash_map.h"
+#include "kernel/profiler.h"
+#include "kernel/trace.h"
+
+#ifndef LEAN_KERNEL_PROFILE_TOP_CONSTANTS
+#define LEAN_KERNEL_PROFILE_TOP_CONSTANTS 10
+#endif
+
+namespace lean {
+bool g_kernel_profiler = false;
+static second_duration g_kernel_profiler_threshold{0};
+
+void set_kernel_profiler(bool enabled, second_duration threshold) {
+    g_kernel_profiler           = enabled;
+    g_kernel_profiler_threshold = threshold;
+}
+
+struct kernel_profile_entry {
+    uint64_t        m_steps{0};
+    second_duration m_time{0};
+};
+
+struct kernel_profile {
+    name                                   m_decl_name;
+    std::chrono::steady_clock::time_point  m_start{std::chrono::steady_clock::now()};
+    kernel_profile_step *                  m_current{nullptr};
+    kernel_profile_entry                   m_totals[static_cast<unsigned>(kernel_profile_event::NumEvents)];
+    name_hash_map<kernel_profile_entry>    m_entries[static_cast<unsigned>(kernel_profile_event::NumEvents)];
+    uint64_t                               m_hits[static_cast<unsigned>(kernel_profile_cache::NumCaches)] = {};
+    uint64_t                               m_misses[static_cast<unsigned>(kernel_profile_cache::NumCaches)] = {};
+    kernel_profile(name const & decl_name):m_decl_name(decl_name) {}
+};
+
+LEAN_THREAD_PTR(kernel_profile, g_kernel_profile);
+
+static char const * event_name(kernel_profile_event ev) {
+    switch (ev) {
+    case kernel_profile_event::WhnfCore:       return "whnf_core";
+    case kernel_profile_event::LazyDeltaStep:  return "lazy_delta_reduction_step";
+    case kernel_profile_event::ReduceRecursor: return "reduce_recursor";
+    case kernel_profile_event::IsDefEqCore:    return "is_def_eq_core";
+    case kernel_profile_event::NumEvents:      break;
+    }
+    lean_unreachable();
+}
+
+static char const * cache_name(kernel_profile_cache c) {
+    switch (c) {
+    case kernel_profile_cache::InferType: return "infer_type";
+    case kernel_profile_cache::InferOnly: return "infer_type (infer only)";
+    case kernel_profile_cache::WhnfCore:  return "whnf_core";
+    case kernel_profile_cache::Whnf:      return "whnf";
+    case kernel_profile_cache::Failure:   return "is_def_eq failure";
+    case kernel_profile_cache::IsProp:    return "is_prop";
+    case kernel_profile_cache::Shared:    return "shared";
+    case kernel_profile_cache::Replace:   return "replace";
+    case kernel_profile_cache::ForEach:   return "for_each";
+    case kernel_profile_cache::NumCaches: break;
+    }
+    lean_unreachable();
+}
+
+static void report(kernel_profile const & p) {
+    second_duration total(std::chrono::steady_clock::now() - p.m_start);
+    if (total < g_kernel_profiler_threshold)
+        return;
+    sstream out;
+    out << "kernel profile of " << p.m_decl_name << ", type checking took " << display_profiling_time{total} << "\n";
+    for (unsigned i = 0; i < static_cast<unsigned>(kernel_profile_event::NumEvents); i++) {
+        kernel_profile_entry const & t = p.m_totals[i];
+        if (t.m_steps == 0)
+            continue;
+        out << "  " << event_name(static_cast<kernel_profile_event>(i)) << ": " << t.m_steps << " steps, "
+            << display_profiling_time{t.m_time} << "\n";
+        std::vector<std::pair<name, kernel_profile_entry>> entries(p.m_entries[i].begin(), p.m_entries[i].end());
+        std::sort(entries.begin(), entries.end(), [](auto const & a, auto const & b) {
+                return a.second.m_time > b.second.m_time;
+            });
+        if (entries.size() > LEAN_KERNEL_PROFILE_TOP_CONSTANTS)
+            entries.resize(LEAN_KERNEL_PROFILE_TOP_CONSTANTS);
+        for (auto const & e : entries)
+            out << "    " << (e.first.is_anonymous() ? name("<other>") : e.first) << ": " << e.second.m_steps
+                << " steps, " << display_profiling_time{e.second.m_time} << "\n";
+    }
+    bool first = true;
+    for (unsigned i = 0; i < static_cast<unsigned>(kernel_profile_cache::NumCaches); i++) {
+        uint64_t n = p.m_hits[i] + p.m_misses[i];
+        if (n == 0)
+            continue;
+        if (first) {
+            out << "  cache hit rates:\n";
+            first = false;
+        }
+        out << "    " << cache_name(static_cast<kernel_profile_cache>(i)) << ": "
+            << (100 * p.m_hits[i] / n) << "% (" << p.m_hits[i] << "/" << n << ")\n";
+    }
+    tout() << out.str();
+}
+
+scoped_kernel_profile::scoped_kernel_profile(name const & decl_name) {
+    if (is_kernel_profiler_enabled()) {
+        m_profile       = new kernel_profile(decl_name);
+        m_old_profile   = g_kernel_profile;
+        g_kernel_profile = m_profile;
+    }
+}
+
+scoped_kernel_profile::~scoped_kernel_profile() {
+    if (m_profile) {
+        g_kernel_profile = m_old_profile;
+        report(*m_profile);
+        delete m_profile;
+    }
+}
+
+void kernel_profile_step::start(kernel_profile_event ev, expr const & e) {
+    kernel_profile * p = g_kernel_profile;
+    if (!p)
+        return;
+    expr const & f = get_app_fn(e);
+    m_profile   = p;
+    m_parent    = p->m_current;
+    m_event     = ev;
+    if (is_constant(f))
+        m_const = const_name(f);
+    m_start     = std::chrono::steady_clock::now();
+    p->m_current = this;
+}
+
+void kernel_profile_step::stop() {
+    second_duration elapsed(std::chrono::steady_clock::now() - m_start);
+    second_duration self = elapsed - m_nested;
+    m_profile->m_current = m_parent;
+    if (m_parent)
+        m_parent->m_nested += elapsed;
+    unsigned i = static_cast<unsigned>(m_event);
+    m_profile->m_totals[i].m_steps++;
+    m_profile->m_totals[i].m_time += self;
+    kernel_profile_entry & entry = m_profile->m_entries[i][m_const];
+    entry.m_steps++;
+    entry.m_time += self;
+}
+
+void record_kernel_cache_access_core(kernel_profile_cache c, bool hit) {
+    if (kernel_profile * p = g_kernel_profile) {
+        if (hit)
+            p->m_hits[static_cast<unsigned>(c)]++;
+        else
+            p->m_misses[static_cast<unsigned>(c)]++;
+    }
+}
+}
@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <chrono>
+#include "util/timeit.h"
+#include "kernel/expr.h"
+
+namespace lean {
+/* Kernel profiler. When enabled, the work done by the kernel while checking a declaration is attributed to
+   the constants being reduced, and a report is printed when the declaration has been checked. It is enabled by
+   `--profile` (i.e., the `profiler` option), and only declarations that take at least `profiler.threshold`
+   are reported. */
+
+enum class kernel_profile_event { WhnfCore, LazyDeltaStep, ReduceRecursor, IsDefEqCore, NumEvents };
+enum class kernel_profile_cache { InferType, InferOnly, WhnfCore, Whnf, Failure, IsProp, Shared, Replace, ForEach, NumCaches };
+
+extern bool g_kernel_profiler;
+inline bool is_kernel_profiler_enabled() { return LEAN_UNLIKELY(g_kernel_profiler); }
+LEAN_EXPORT void set_kernel_profiler(bool enabled, second_duration threshold);
+
+struct kernel_profile;
+
+/* Profile the kernel work done by the current thread in the scope of this object, and report it for `decl_name`. */
+class scoped_kernel_profile {
+    kernel_profile * m_profile{nullptr};
+    kernel_profile * m_old_profile{nullptr};
+public:
+    scoped_kernel_profile(name const & decl_name);
+    scoped_kernel_profile(scoped_kernel_profile const &) = delete;
+    ~scoped_kernel_profile();
+};
+
+/* A step of one of the `kernel_profile_event` kinds, attributed to the head constant of `e`. The time of nested
+   steps is excluded. */
+class kernel_profile_step {
+    kernel_profile *                      m_profile{nullptr};
+    kernel_profile_step *                 m_parent;
+    kernel_profile_event                  m_event;
+    name                                  m_const;
+    std::chrono::steady_clock::time_point m_start;
+    second_duration                       m_nested{0};
+    void start(kernel_profile_event ev, expr const & e);
+    void stop();
+public:
+    kernel_profile_step(kernel_profile_event ev, expr const & e) {
+        if (is_kernel_profiler_enabled()) start(ev, e);
+    }
+    kernel_profile_step(kernel_profile_step const &) = delete;
+    ~kernel_profile_step() {
+        if (m_profile) stop();
+    }
+};
+
+void record_kernel_cache_access_core(kernel_profile_cache c, bool hit);
+inline void record_kernel_cache_access(kernel_profile_cache c, bool hit) {
+    if (is_kernel_profiler_enabled()) record_kernel_cache_access_core(c, hit);
+}
+}
@@ -6,111 +6,156 @@ Author: Leonardo de Moura
 */
 #include <vector>
 #include <memory>
+#include "runtime/memory.h"
+#include "runtime/buffer.h"
 #include "kernel/replace_fn.h"
 #include "kernel/cache_stack.h"
+#include "kernel/expr_offset_cache.h"
+#include "kernel/profiler.h"
 
 #ifndef LEAN_DEFAULT_REPLACE_CACHE_CAPACITY
 #define LEAN_DEFAULT_REPLACE_CACHE_CAPACITY 1024*8
 #endif
 
 namespace lean {
-struct replace_cache {
-    struct entry {
-        object  *  m_cell;
-        unsigned   m_offset;
-        expr       m_result;
-        entry():m_cell(nullptr) {}
-    };
-    unsigned              m_capacity;
-    std::vector<entry>    m_cache;
-    std::vector<unsigned> m_used;
-    replace_cache(unsigned c):m_capacity(c), m_cache(c) {}
-
-    expr * find(expr const & e, unsigned offset) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == e.raw() && m_cache[i].m_offset == offset)
-            return &m_cache[i].m_result;
-        else
-            return nullptr;
-    }
-
-    void insert(expr const & e, unsigned offset, expr const & v) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == nullptr)
-            m_used.push_back(i);
-        m_cache[i].m_cell   = e.raw();
-        m_cache[i].m_offset = offset;
-        m_cache[i].m_result = v;
-    }
-
-    void clear() {
-        for (unsigned i : m_used) {
-            m_cache[i].m_cell   = nullptr;
-            m_cache[i].m_result = expr();
-        }
-        m_used.clear();
-    }
+struct replace_cache : public expr_offset_cache<expr> {
+    replace_cache(unsigned c):expr_offset_cache<expr>(c) {}
 };
 
 /* CACHE_RESET: NO */
 MK_CACHE_STACK(replace_cache, LEAN_DEFAULT_REPLACE_CACHE_CAPACITY)
 
+/* Explicit-stack traversal, so that deep terms such as long list literals do not exhaust the native stack.
+   Subterms are visited in the same order as by a recursive traversal, so `m_f` observes the same calls. */
 class replace_rec_fn {
+    /* A term still to be visited, or whose `num_children` results are on top of `m_results` if `m_done` is set. */
+    struct frame {
+        expr const & m_e;
+        unsigned     m_offset;
+        bool         m_shared;
+        bool         m_done;
+        frame(expr const & e, unsigned offset, bool shared, bool done):
+            m_e(e), m_offset(offset), m_shared(shared), m_done(done) {}
+    };
     replace_cache_ref                                     m_cache;
     std::function<optional<expr>(expr const &, unsigned)> m_f;
     bool                                                  m_use_cache;
+    buffer<frame>                                         m_todo;
+    buffer<expr>                                          m_results;
 
-    expr save_result(expr const & e, unsigned offset, expr const & r, bool shared) {
+    void save_result(expr const & e, unsigned offset, expr const & r, bool shared) {
         if (shared)
             m_cache->insert(e, offset, r);
-        return r;
+        m_results.push_back(r);
     }
 
-    expr apply(expr const & e, unsigned offset) {
+    /* Visit `e`, pushing its result to `m_results` or scheduling the visit of its children. */
+    void visit(expr const & e, unsigned offset) {
         bool shared = false;
         if (m_use_cache && is_shared(e)) {
-            if (auto r = m_cache->find(e, offset))
-                return *r;
+            expr * r = m_cache->find(e, offset);
+            record_kernel_cache_access(kernel_profile_cache::Replace, r);
+            if (r) {
+                m_results.push_back(*r);
+                return;
+            }
             shared = true;
         }
-        check_system("replace");
+        check_memory("replace");
 
         if (optional<expr> r = m_f(e, offset)) {
-            return save_result(e, offset, *r, shared);
-        } else {
-            switch (e.kind()) {
-            case expr_kind::Const: case expr_kind::Sort:
-            case expr_kind::BVar:  case expr_kind::Lit:
-            case expr_kind::MVar:  case expr_kind::FVar:
-                return save_result(e, offset, e, shared);
-            case expr_kind::MData: {
-                expr new_e = apply(mdata_expr(e), offset);
-                return save_result(e, offset, update_mdata(e, new_e), shared);
-            }
-            case expr_kind::Proj: {
-                expr new_e = apply(proj_expr(e), offset);
-                return save_result(e, offset, update_proj(e, new_e), shared);
-            }
-            case expr_kind::App: {
-                expr new_f = apply(app_fn(e), offset);
-                expr new_a = apply(app_arg(e), offset);
-                return save_result(e, offset, update_app(e, new_f, new_a), shared);
-            }
-            case expr_kind::Pi: case expr_kind::Lambda: {
-                expr new_d = apply(binding_domain(e), offset);
-                expr new_b = apply(binding_body(e), offset+1);
-                return save_result(e, offset, update_binding(e, new_d, new_b), shared);
-            }
-            case expr_kind::Let: {
-                expr new_t = apply(let_type(e), offset);
-                expr new_v = apply(let_value(e), offset);
-                expr new_b = apply(let_body(e), offset+1);
-                return save_result(e, offset, update_let(e, new_t, new_v, new_b), shared);
-            }
-            }
+            save_result(e, offset, *r, shared);
+            return;
+        }
+        switch (e.kind()) {
+        case expr_kind::Const: case expr_kind::Sort:
+        case expr_kind::BVar:  case expr_kind::Lit:
+        case expr_kind::MVar:  case expr_kind::FVar:
+            save_result(e, offset, e, shared);
+            return;
+        default:
+            break;
+        }
+        m_todo.emplace_back(e, offset, shared, true);
+        // children are pushed in reverse order, so that they are visited from left to right
+        switch (e.kind()) {
+        case expr_kind::MData:
+            m_todo.emplace_back(mdata_expr(e), offset, false, false);
+            return;
+        case expr_kind::Proj:
+            m_todo.emplace_back(proj_expr(e), offset, false, false);
+            return;
+        case expr_kind::App:
+            m_todo.emplace_back(app_arg(e), offset, false, false);
+            m_todo.emplace_back(app_fn(e), offset, false, false);
+            return;
+        case expr_kind::Pi: case expr_kind::Lambda:
+            m_todo.emplace_back(binding_body(e), offset+1, false, false);
+            m_todo.emplace_back(binding_domain(e), offset, false, false);
+            return;
+        case expr_kind::Let:
+            m_todo.emplace_back(let_body(e), offset+1, false, false);
+            m_todo.emplace_back(let_value(e), offset, false, false);
+            m_todo.emplace_back(let_type(e), offset, false, false);
+            return;
+        default:
             lean_unreachable();
         }
     }
+
+    /* All children of `e` have been visited, combine their results. */
+    void finish(expr const & e, unsigned offset, bool shared) {
+        expr * rs = m_results.end();
+        switch (e.kind()) {
+        case expr_kind::MData: {
+            expr r = update_mdata(e, rs[-1]);
+            m_results.pop_back();
+            return save_result(e, offset, r, shared);
+        }
+        case expr_kind::Proj: {
+            expr r = update_proj(e, rs[-1]);
+            m_results.pop_back();
+            return save_result(e, offset, r, shared);
+        }
+        case expr_kind::App: {
+            expr r = update_app(e, rs[-2], rs[-1]);
+            m_results.pop_back();
+            m_results.pop_back();
+            return save_result(e, offset, r, shared);
+        }
+        case expr_kind::Pi: case expr_kind::Lambda: {
+            expr r = update_binding(e, rs[-2], rs[-1]);
+            m_results.pop_back();
+            m_results.pop_back();
+            return save_result(e, offset, r, shared);
+        }
+        case expr_kind::Let: {
+            expr r = update_let(e, rs[-3], rs[-2], rs[-1]);
+            m_results.pop_back();
+            m_results.pop_back();
+            m_results.pop_back();
+            return save_result(e, offset, r, shared);
+        }
+        default:
+            lean_unreachable();
+        }
+    }
+
+    expr apply(expr const & e, unsigned offset) {
+        m_todo.emplace_back(e, offset, false, false);
+        while (!m_todo.empty()) {
+            frame f = m_todo.back();
+            m_todo.pop_back();
+            if (f.m_done)
+                finish(f.m_e, f.m_offset, f.m_shared);
+            else
+                visit(f.m_e, f.m_offset);
+        }
+        lean_assert(m_results.size() == 1);
+        expr r = m_results.back();
+        m_results.pop_back();
+        return r;
+    }
 public:
     template<typename F>
     replace_rec_fn(F const & f, bool use_cache):m_f(f), m_use_cache(use_cache) {}
@@ -4,14 +4,20 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <cstdlib>
+#include <algorithm>
 #include <utility>
 #include <vector>
 #include "runtime/interrupt.h"
+#include "runtime/stackinfo.h"
 #include "runtime/sstream.h"
 #include "runtime/flet.h"
+#include "runtime/thread.h"
 #include "util/lbool.h"
+#include "util/name_hash_map.h"
 #include "kernel/type_checker.h"
 #include "kernel/expr_maps.h"
+#include "kernel/expr_flat_map.h"
 #include "kernel/instantiate.h"
 #include "kernel/kernel_exception.h"
 #include "kernel/abstract.h"
@@ -19,6 +25,7 @@ Author: Leonardo de Moura
 #include "kernel/for_each_fn.h"
 #include "kernel/quot.h"
 #include "kernel/inductive.h"
+#include "kernel/profiler.h"
 
 namespace lean {
 static name * g_kernel_fresh = nullptr;
@@ -26,6 +33,8 @@ static expr * g_dont_care    = nullptr;
 static name * g_bool_true    = nullptr;
 static expr * g_nat_zero     = nullptr;
 static expr * g_nat_succ     = nullptr;
+static expr * g_nat_pred     = nullptr;
+static expr * g_nat_log2     = nullptr;
 static expr * g_nat_add      = nullptr;
 static expr * g_nat_sub      = nullptr;
 static expr * g_nat_mul      = nullptr;
@@ -40,9 +49,238 @@ static expr * g_nat_lor      = nullptr;
 static expr * g_nat_xor      = nullptr;
 static expr * g_nat_shiftLeft  = nullptr;
 static expr * g_nat_shiftRight = nullptr;
+static expr * g_string_length         = nullptr;
+static expr * g_string_utf8_byte_size = nullptr;
+static expr * g_string_append         = nullptr;
+static expr * g_string_dec_eq         = nullptr;
+static expr * g_string_eq             = nullptr;
+static expr * g_string_eq_refl        = nullptr;
+static expr * g_decidable_is_true     = nullptr;
+
+#ifndef LEAN_SHARED_KERNEL_CACHE_SIZE
+#define LEAN_SHARED_KERNEL_CACHE_SIZE 1024*64
+#endif
+
+#ifndef LEAN_SHARED_KERNEL_CACHE_SHARDS
+#define LEAN_SHARED_KERNEL_CACHE_SHARDS 64
+#endif
+
+/* Cache of `whnf` and `infer_type` (in `infer_only` mode) results shared by all type checkers.
+   Only closed terms that contain only imported constants are stored. Imported constants cannot be
+   redefined, so the results are valid for any environment built on top of the same imports.
+
+   The entries are split into shards by hash, each with its own lock, so that type checkers running in parallel do
+   not contend on a single lock. A shard is flushed when it is used with a different set of imports. Each shard keeps
+   two generations of entries of each kind: new entries go into the current one, and when it is full it replaces
+   the previous one, which is dropped. Entries of the previous generation that are used again are moved to the
+   current one, so that only entries that were not used for a whole generation are evicted. */
+struct shared_kernel_cache_shard {
+    mutex         m_mutex;
+    /* `environment::get_imports_id()` of the imports the entries were computed for. We keep a reference to it
+       so that its address cannot be reused by a different set of imports. */
+    object *      m_imports_id{nullptr};
+    /* 0: whnf, 1: infer_type */
+    expr_flat_map<expr> m_current[2];
+    expr_flat_map<expr> m_previous[2];
+    char          m_pad[64];
+};
+
+/* Maximal number of entries of each kind in a generation of a shard. */
+static constexpr size_t g_shared_cache_generation_size =
+    std::max(LEAN_SHARED_KERNEL_CACHE_SIZE / LEAN_SHARED_KERNEL_CACHE_SHARDS / 2, 1);
+
+static shared_kernel_cache_shard * g_shared_cache = nullptr;
+
+enum class shared_cache_kind { Whnf = 0, InferType = 1 };
+
+static shared_kernel_cache_shard & get_shared_cache_shard(expr const & e) {
+    /* The low bits of the hash select the slot in the maps of the shard, use the high bits for the shard. */
+    return g_shared_cache[(static_cast<unsigned>(hash(e)) * 2654435761u >> 16) % LEAN_SHARED_KERNEL_CACHE_SHARDS];
+}
+
+static void insert_shared(shared_kernel_cache_shard & s, unsigned k, expr const & e, expr const & v) {
+    if (s.m_current[k].size() >= g_shared_cache_generation_size) {
+        std::swap(s.m_previous[k], s.m_current[k]);
+        s.m_current[k].clear();
+    }
+    s.m_current[k].insert(e, v);
+}
+
+static optional<expr> find_shared(environment const & env, shared_cache_kind k, expr const & e) {
+    if (has_fvar(e) || has_mvar(e))
+        return none_expr();
+    shared_kernel_cache_shard & s = get_shared_cache_shard(e);
+    unsigned i = static_cast<unsigned>(k);
+    lock_guard<mutex> lock(s.m_mutex);
+    if (s.m_imports_id != env.get_imports_id())
+        return none_expr();
+    if (expr const * r = s.m_current[i].find(e))
+        return some_expr(*r);
+    if (expr const * r = s.m_previous[i].find(e)) {
+        expr v = *r;
+        insert_shared(s, i, e, v);
+        return some_expr(v);
+    }
+    return none_expr();
+}
+
+/* Per-thread memo for `only_imported_constants`, valid for the imports `m_imports_id`: the constants that are known to
+   be imported, and closed terms known to contain only imported constants. The results for the subterms of a term
+   that was checked before are thus not recomputed, and `environment::is_imported` is called once per constant. */
+struct imported_constants_memo {
+    object *            m_imports_id{nullptr};
+    name_hash_map<bool> m_consts;
+    expr_flat_map<unit> m_exprs;
+
+    void reset(object * imports_id) {
+        if (m_imports_id)
+            dec_ref(m_imports_id);
+        inc_ref(imports_id);
+        m_imports_id = imports_id;
+        m_consts.clear();
+        m_exprs.clear();
+    }
+
+    ~imported_constants_memo() {
+        if (m_imports_id)
+            dec_ref(m_imports_id);
+    }
+};
+MK_THREAD_LOCAL_GET_DEF(imported_constants_memo, get_imported_constants_memo);
+
+static bool only_imported_constants(environment const & env, expr const & e) {
+    imported_constants_memo & memo = get_imported_constants_memo();
+    object * id = env.get_imports_id();
+    if (memo.m_imports_id != id || memo.m_consts.size() + memo.m_exprs.size() >= LEAN_SHARED_KERNEL_CACHE_SIZE)
+        memo.reset(id);
+    if (memo.m_exprs.contains(e))
+        return true;
+    bool ok = true;
+    for_each(e, [&](expr const & c, unsigned) {
+            if (!ok) return false;
+            switch (c.kind()) {
+            case expr_kind::Const: {
+                name const & n = const_name(c);
+                auto it = memo.m_consts.find(n);
+                if (it == memo.m_consts.end())
+                    it = memo.m_consts.insert(mk_pair(n, env.is_imported(n))).first;
+                ok = it->second;
+                return false;
+            }
+            case expr_kind::App: case expr_kind::Lambda: case expr_kind::Pi: case expr_kind::Let:
+            case expr_kind::Proj: case expr_kind::MData:
+                // subterms of terms that were checked before
+                return !memo.m_exprs.contains(c);
+            default:
+                return false;
+            }
+        });
+    if (ok)
+        memo.m_exprs.insert(e, unit());
+    return ok;
+}
+
+static void add_shared(environment const & env, shared_cache_kind k, expr const & e, expr const & v) {
+    if (has_fvar(e) || has_mvar(e) || !only_imported_constants(env, e))
+        return;
+    /* The entries are read by other threads. */
+    mark_mt(e.raw());
+    mark_mt(v.raw());
+    object * id = env.get_imports_id();
+    shared_kernel_cache_shard & s = get_shared_cache_shard(e);
+    lock_guard<mutex> lock(s.m_mutex);
+    if (s.m_imports_id != id) {
+        for (unsigned i = 0; i < 2; i++) {
+            s.m_current[i].clear();
+            s.m_previous[i].clear();
+        }
+        if (s.m_imports_id)
+            dec_ref(s.m_imports_id);
+        mark_mt(id);
+        inc_ref(id);
+        s.m_imports_id = id;
+    }
+    insert_shared(s, static_cast<unsigned>(k), e, v);
+}
+
+static bool g_hash_consing = false;
+
+void set_kernel_hash_consing(bool flag) {
+    g_hash_consing = flag;
+}
 
 type_checker::state::state(environment const & env):
-    m_env(env), m_ngen(*g_kernel_fresh) {}
+    m_env(env), m_ngen(*g_kernel_fresh), m_hash_consing(g_hash_consing) {}
+
+size_t type_checker::state::cache_size() const {
+    return m_infer_type[0].size() + m_infer_type[1].size() + m_whnf_core.size() + m_whnf.size();
+}
+
+/* Caches with more slots than this are freed instead of kept for reuse, so that a pooled state does not hold on to
+   the memory of an unusually large declaration. */
+#define LEAN_POOLED_CACHE_MAX_SLOTS (1u << 16)
+/* Maximal number of checker states kept for reuse per thread. */
+#define LEAN_STATE_POOL_SIZE 4
+
+void type_checker::state::reset(environment const & env) {
+    m_env  = env;
+    m_ngen = name_generator(*g_kernel_fresh);
+    m_hash_consing = g_hash_consing;
+    m_infer_type[0].reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_infer_type[1].reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_whnf_core.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_whnf.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_eqv_manager.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_failure.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_is_prop.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_hash_cons.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_structure_info.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_native.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+    m_unfold.reset(LEAN_POOLED_CACHE_MAX_SLOTS);
+}
+
+/* States of type checkers that owned them, kept per thread with their cache slots still allocated. Declarations are
+   usually small, so most of the cost of a fresh state is allocating and freeing its caches. A pooled state does not
+   refer to any environment, `acquire_state` binds it to the one of the new checker. */
+struct state_pool {
+    std::vector<type_checker::state *> m_states;
+    ~state_pool() {
+        for (type_checker::state * s : m_states)
+            delete s;
+    }
+};
+MK_THREAD_LOCAL_GET_DEF(state_pool, get_state_pool);
+
+type_checker::state * type_checker::acquire_state(environment const & env) {
+    if (!in_thread_finalization()) {
+        std::vector<state *> & states = get_state_pool().m_states;
+        if (!states.empty()) {
+            state * s = states.back();
+            states.pop_back();
+            s->reset(env);
+            return s;
+        }
+    }
+    return new state(env);
+}
+
+void type_checker::release_state(state * s) {
+    if (!in_thread_finalization()) {
+        std::vector<state *> & states = get_state_pool().m_states;
+        if (states.size() < LEAN_STATE_POOL_SIZE) {
+            // release the cached objects now, and do not keep the environment alive while the state is unused
+            s->reset(environment(box(0)));
+            states.push_back(s);
+            return;
+        }
+    }
+    delete s;
+}
+
+LEAN_THREAD_VALUE(size_t, g_peak_cache_size, 0);
+
+size_t get_kernel_peak_cache_size() { return g_peak_cache_size; }
+void set_kernel_peak_cache_size(size_t sz) { g_peak_cache_size = sz; }
 
 /** \brief Make sure \c e "is" a sort, and return the corresponding sort.
     If \c e is not a sort, then the whnf procedure is invoked.
@@ -80,8 +318,51 @@ void type_checker::check_level(level const & l) {
     }
 }
 
+/* Save `m_lctx` and `m_fvars`, and restore them on scope exit. */
+class type_checker::scoped_lctx {
+    type_checker & m_tc;
+    local_ctx      m_lctx;
+    size_t         m_num_fvars;
+public:
+    scoped_lctx(type_checker & tc):m_tc(tc), m_lctx(tc.m_lctx), m_num_fvars(tc.m_fvars.size()) {}
+    ~scoped_lctx() {
+        m_tc.m_lctx = m_lctx;
+        m_tc.m_fvars.erase(m_tc.m_fvars.begin() + m_num_fvars, m_tc.m_fvars.end());
+    }
+};
+
+expr type_checker::mk_local_decl(name const & un, expr const & type, binder_info bi) {
+    m_fvars.push_back(m_lctx.mk_local_decl(m_st->m_ngen.next(), un, type, bi));
+    return m_fvars.back().mk_ref();
+}
+
+expr type_checker::mk_local_decl(name const & un, expr const & type, expr const & value) {
+    m_fvars.push_back(m_lctx.mk_local_decl(m_st->m_ngen.next(), un, type, value));
+    return m_fvars.back().mk_ref();
+}
+
+static size_t fresh_fvar_idx(name const & n) {
+    return n.get_numeral().get_small_value();
+}
+
+optional<local_decl> type_checker::find_local_decl(expr const & e) const {
+    name const & n = fvar_name(e);
+    if (n.is_numeral() && n.get_numeral().is_small()) {
+        /* The numerals in `m_fvars` only decrease when `m_ngen` switches to a new prefix after exhausting its
+           indices. The binary search may then miss, but a hit is always genuine since the fvar name must be the
+           very object created by `mk_local_decl`. Names from other generators or from the initial `m_lctx` never
+           pass this test and take the slow path. */
+        size_t idx = fresh_fvar_idx(n);
+        auto it = std::lower_bound(m_fvars.begin(), m_fvars.end(), idx,
+                                   [](local_decl const & d, size_t i) { return fresh_fvar_idx(d.get_name()) < i; });
+        if (it != m_fvars.end() && it->get_name().raw() == n.raw())
+            return optional<local_decl>(*it);
+    }
+    return m_lctx.find_local_decl(e);
+}
+
 expr type_checker::infer_fvar(expr const & e) {
-    if (optional<local_decl> decl = m_lctx.find_local_decl(e)) {
+    if (optional<local_decl> decl = find_local_decl(e)) {
         return decl->get_type();
     } else {
         throw kernel_exception(env(), "unknown free variable");
@@ -113,12 +394,12 @@ expr type_checker::infer_constant(expr const & e, bool infer_only) {
 }
 
 expr type_checker::infer_lambda(expr const & _e, bool infer_only) {
-    flet<local_ctx> save_lctx(m_lctx, m_lctx);
+    scoped_lctx save_lctx(*this);
     buffer<expr> fvars;
     expr e = _e;
     while (is_lambda(e)) {
         expr d    = instantiate_rev(binding_domain(e), fvars.size(), fvars.data());
-        expr fvar = m_lctx.mk_local_decl(m_st->m_ngen, binding_name(e), d, binding_info(e));
+        expr fvar = mk_local_decl(binding_name(e), d, binding_info(e));
         fvars.push_back(fvar);
         if (!infer_only) {
             ensure_sort_core(infer_type_core(d, infer_only), d);
@@ -131,7 +412,7 @@ expr type_checker::infer_lambda(expr const & _e, bool infer_only) {
 }
 
 expr type_checker::infer_pi(expr const & _e, bool infer_only) {
-    flet<local_ctx> save_lctx(m_lctx, m_lctx);
+    scoped_lctx save_lctx(*this);
     buffer<expr> fvars;
     buffer<level> us;
     expr e = _e;
@@ -139,7 +420,7 @@ expr type_checker::infer_pi(expr const & _e, bool infer_only) {
         expr d  = instantiate_rev(binding_domain(e), fvars.size(), fvars.data());
         expr t1 = ensure_sort_core(infer_type_core(d, infer_only), d);
         us.push_back(sort_level(t1));
-        expr fvar  = m_lctx.mk_local_decl(m_st->m_ngen, binding_name(e), d, binding_info(e));
+        expr fvar  = mk_local_decl(binding_name(e), d, binding_info(e));
         fvars.push_back(fvar);
         e = binding_body(e);
     }
@@ -156,13 +437,29 @@ expr type_checker::infer_pi(expr const & _e, bool infer_only) {
 
 expr type_checker::infer_app(expr const & e, bool infer_only) {
     if (!infer_only) {
-        expr f_type = ensure_pi_core(infer_type_core(app_fn(e), infer_only), e);
-        expr a_type = infer_type_core(app_arg(e), infer_only);
-        expr d_type = binding_domain(f_type);
-        if (!is_def_eq(a_type, d_type)) {
-            throw app_type_mismatch_exception(env(), m_lctx, e, f_type, a_type);
+        /* Check the whole spine `f a_1 ... a_n` at once. As in the `infer_only` case, the type of `f` is only
+           instantiated when its head is not a Pi, and the partial applications are only built for error messages. */
+        buffer<expr> args;
+        expr const & f = get_app_args(e, args);
+        expr f_type    = infer_type_core(f, infer_only);
+        unsigned j     = 0;
+        unsigned nargs = args.size();
+        for (unsigned i = 0; i < nargs; i++) {
+            if (!is_pi(f_type)) {
+                f_type = whnf(instantiate_rev(f_type, i-j, args.data()+j));
+                j = i;
+                if (!is_pi(f_type))
+                    throw function_expected_exception(env(), m_lctx, mk_app(f, i+1, args.data()));
+            }
+            expr a_type = infer_type_core(args[i], infer_only);
+            expr d_type = instantiate_rev(binding_domain(f_type), i-j, args.data()+j);
+            if (!is_def_eq(a_type, d_type)) {
+                throw app_type_mismatch_exception(env(), m_lctx, mk_app(f, i+1, args.data()),
+                                                  instantiate_rev(f_type, i-j, args.data()+j), a_type);
+            }
+            f_type = binding_body(f_type);
         }
-        return instantiate(binding_body(f_type), app_arg(e));
+        return instantiate_rev(f_type, nargs-j, args.data()+j);
     } else {
         buffer<expr> args;
         expr const & f = get_app_args(e, args);
@@ -200,14 +497,14 @@ static void mark_used(unsigned n, expr const * fvars, expr const & b, bool * use
 }
 
 expr type_checker::infer_let(expr const & _e, bool infer_only) {
-    flet<local_ctx> save_lctx(m_lctx, m_lctx);
+    scoped_lctx save_lctx(*this);
     buffer<expr> fvars;
     buffer<expr> vals;
     expr e = _e;
     while (is_let(e)) {
         expr type = instantiate_rev(let_type(e), fvars.size(), fvars.data());
         expr val  = instantiate_rev(let_value(e), fvars.size(), fvars.data());
-        expr fvar = m_lctx.mk_local_decl(m_st->m_ngen, let_name(e), type, val);
+        expr fvar = mk_local_decl(let_name(e), type, val);
         fvars.push_back(fvar);
         vals.push_back(val);
         if (!infer_only) {
@@ -292,11 +589,27 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
         throw kernel_exception(env(), "type checker does not support loose bound variables, replace them with free variables before invoking it");
 
     lean_assert(!has_loose_bvars(e));
+    if (needs_stack_segment())
+        return with_stack_segment<expr>([&]() { return infer_type_core(e, infer_only); });
     check_system("type checker", /* do_check_interrupted */ true);
 
-    auto it = m_st->m_infer_type[infer_only].find(e);
-    if (it != m_st->m_infer_type[infer_only].end())
-        return it->second;
+    expr const * cached = m_st->m_infer_type[infer_only].find(e);
+    record_kernel_cache_access(infer_only ? kernel_profile_cache::InferOnly : kernel_profile_cache::InferType, cached);
+    if (cached)
+        return *cached;
+
+    /* Only `infer_only` results are shared, checking also depends on the universe parameters and safety
+       of the declaration being checked. */
+    bool shared = infer_only && !m_diag &&
+        (is_app(e) || is_proj(e) || is_lambda(e) || is_pi(e) || is_let(e));
+    if (shared) {
+        auto r = find_shared(env(), shared_cache_kind::InferType, e);
+        record_kernel_cache_access(kernel_profile_cache::Shared, static_cast<bool>(r));
+        if (r) {
+            m_st->m_infer_type[infer_only].insert(e, *r);
+            return *r;
+        }
+    }
 
     expr r;
     switch (e.kind()) {
@@ -318,7 +631,10 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
     case expr_kind::Let:      r = infer_let(e, infer_only);            break;
     }
 
-    m_st->m_infer_type[infer_only].insert(mk_pair(e, r));
+    r = share(r);
+    m_st->m_infer_type[infer_only].insert(e, r);
+    if (shared)
+        add_shared(env(), shared_cache_kind::InferType, e, r);
     return r;
 }
 
@@ -328,12 +644,12 @@ expr type_checker::infer_type(expr const & e) {
 
 expr type_checker::check(expr const & e, names const & lps) {
     flet<names const *> updt(m_lparams, &lps);
-    return infer_type_core(e, false);
+    return infer_type_core(share(e), false);
 }
 
 expr type_checker::check_ignore_undefined_universes(expr const & e) {
     flet<names const *> updt(m_lparams, nullptr);
-    return infer_type_core(e, false);
+    return infer_type_core(share(e), false);
 }
 
 expr type_checker::ensure_sort(expr const & e, expr const & s) {
@@ -346,12 +662,19 @@ expr type_checker::ensure_pi(expr const & e, expr const & s) {
 
 /** \brief Return true iff \c e is a proposition */
 bool type_checker::is_prop(expr const & e) {
-    return whnf(infer_type(e)) == mk_Prop();
+    bool const * cached = m_st->m_is_prop.find(e);
+    record_kernel_cache_access(kernel_profile_cache::IsProp, cached);
+    if (cached)
+        return *cached;
+    bool r = whnf(infer_type(e)) == mk_Prop();
+    m_st->m_is_prop.insert(e, r);
+    return r;
 }
 
 /** \brief Apply normalizer extensions to \c e.
     If `cheap == true`, then we don't perform delta-reduction when reducing major premise. */
 optional<expr> type_checker::reduce_recursor(expr const & e, bool cheap_rec, bool cheap_proj) {
+    kernel_profile_step prof(kernel_profile_event::ReduceRecursor, e);
     if (env().is_quot_initialized()) {
         if (optional<expr> r = quot_reduce_rec(e, [&](expr const & e) { return whnf(e); })) {
             return r;
@@ -367,7 +690,7 @@ optional<expr> type_checker::reduce_recursor(expr const & e, bool cheap_rec, boo
 }
 
 expr type_checker::whnf_fvar(expr const & e, bool cheap_rec, bool cheap_proj) {
-    if (optional<local_decl> decl = m_lctx.find_local_decl(e)) {
+    if (optional<local_decl> decl = find_local_decl(e)) {
         if (optional<expr> const & v = decl->get_value()) {
             /* zeta-reduction */
             return whnf_core(*v, cheap_rec, cheap_proj);
@@ -376,22 +699,40 @@ expr type_checker::whnf_fvar(expr const & e, bool cheap_rec, bool cheap_proj) {
     return e;
 }
 
+/* Return whether `I` is a structure-like inductive type, and the number of fields of its constructor. The result is
+   cached because the eta for structures and unit-like rules are tried on most failed definitional equality tests. */
+auto type_checker::get_structure_info(name const & I) -> state::structure_info {
+    if (state::structure_info const * info = m_st->m_structure_info.find(I))
+        return *info;
+    state::structure_info info{false, 0};
+    if (is_structure_like(env(), I)) {
+        name ctor_name        = head(env().get(I).to_inductive_val().get_cnstrs());
+        info.m_structure_like = true;
+        info.m_nfields        = env().get(ctor_name).to_constructor_val().get_nfields();
+    }
+    m_st->m_structure_info.insert(I, info);
+    return info;
+}
+
 /* Auxiliary method for `reduce_proj` */
 optional<expr> type_checker::reduce_proj_core(expr c, unsigned idx) {
     if (is_string_lit(c))
         c = string_lit_to_constructor(c);
-    buffer<expr> args;
-    expr const & mk = get_app_args(c, args);
+    expr const & mk = get_app_fn(c);
     if (!is_constant(mk))
         return none_expr();
     constant_info mk_info = env().get(const_name(mk));
     if (!mk_info.is_constructor())
         return none_expr();
     unsigned nparams = mk_info.to_constructor_val().get_nparams();
-    if (nparams + idx < args.size())
-        return some_expr(args[nparams + idx]);
-    else
+    unsigned nargs   = get_app_num_args(c);
+    if (nparams + idx >= nargs)
         return none_expr();
+    /* retrieve the argument without copying the spine into a buffer */
+    expr const * it = &c;
+    for (unsigned i = nargs - 1; i > nparams + idx; i--)
+        it = &app_fn(*it);
+    return some_expr(app_arg(*it));
 }
 
 /* If `cheap == true`, then we don't perform delta-reduction when reducing major premise. */
@@ -407,9 +748,9 @@ optional<expr> type_checker::reduce_proj(expr const & e, bool cheap_rec, bool ch
     return reduce_proj_core(c, idx);
 }
 
-static bool is_let_fvar(local_ctx const & lctx, expr const & e) {
+bool type_checker::is_let_fvar(expr const & e) const {
     lean_assert(is_fvar(e));
-    if (optional<local_decl> decl = lctx.find_local_decl(e)) {
+    if (optional<local_decl> decl = find_local_decl(e)) {
         return static_cast<bool>(decl->get_value());
     } else {
         return false;
@@ -420,6 +761,8 @@ static bool is_let_fvar(local_ctx const & lctx, expr const & e) {
     If `cheap == true`, then we don't perform delta-reduction when reducing major premise of recursors and projections.
     We also do not cache results. */
 expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
+    if (needs_stack_segment())
+        return with_stack_segment<expr>([&]() { return whnf_core(e, cheap_rec, cheap_proj); });
     check_system("type checker: whnf", /* do_check_interrupted */ true);
 
     // handle easy cases
@@ -431,7 +774,7 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
     case expr_kind::MData:
         return whnf_core(mdata_expr(e), cheap_rec, cheap_proj);
     case expr_kind::FVar:
-        if (is_let_fvar(m_lctx, e))
+        if (is_let_fvar(e))
             break;
         else
             return e;
@@ -441,11 +784,13 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
     }
 
     // check cache
-    auto it = m_st->m_whnf_core.find(e);
-    if (it != m_st->m_whnf_core.end())
-        return it->second;
+    expr const * cached = m_st->m_whnf_core.find(e);
+    record_kernel_cache_access(kernel_profile_cache::WhnfCore, cached);
+    if (cached)
+        return *cached;
 
     // do the actual work
+    kernel_profile_step prof(kernel_profile_event::WhnfCore, e);
     expr r;
     switch (e.kind()) {
     case expr_kind::BVar:  case expr_kind::Sort:  case expr_kind::MVar:
@@ -466,15 +811,12 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
         expr f0 = get_app_rev_args(e, args);
         expr f = whnf_core(f0, cheap_rec, cheap_proj);
         if (is_lambda(f)) {
-            unsigned m = 1;
-            unsigned num_args = args.size();
-            while (is_lambda(binding_body(f)) && m < num_args) {
-                f = binding_body(f);
-                m++;
-            }
-            lean_assert(m <= num_args);
-            r = whnf_core(mk_rev_app(instantiate(binding_body(f), m, args.data() + (num_args - m)), num_args - m, args.data()),
-                          cheap_rec, cheap_proj);
+            /* Beta-reduce the whole spine, the arguments of each instantiated body are added to `args`
+               instead of building the intermediate applications. */
+            do {
+                f = whnf_core(beta_rev_args(f, args), cheap_rec, cheap_proj);
+            } while (is_lambda(f) && !args.empty());
+            r = args.empty() ? f : whnf_core(mk_rev_app(f, args.size(), args.data()), cheap_rec, cheap_proj);
         } else if (f == f0) {
             if (auto r = reduce_recursor(e, cheap_rec, cheap_proj)) {
                 if (m_diag) {
@@ -498,7 +840,8 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
     }
 
     if (!cheap_rec && !cheap_proj) {
-        m_st->m_whnf_core.insert(mk_pair(e, r));
+        r = share(r);
+        m_st->m_whnf_core.insert(e, r);
     }
     return r;
 }
@@ -522,7 +865,15 @@ optional<expr> type_checker::unfold_definition_core(expr const & e) {
                 if (m_diag) {
                     m_diag->record_unfold(d->get_name());
                 }
-                return some_expr(instantiate_value_lparams(*d, const_levels(e)));
+                if (is_nil(const_levels(e)))
+                    return some_expr(instantiate_value_lparams(*d, const_levels(e)));
+                /* Substituting the universe parameters traverses the whole value, and the same instance of a
+                   definition is usually unfolded many times while checking a declaration. */
+                if (expr const * r = m_st->m_unfold.find(e))
+                    return some_expr(*r);
+                expr r = instantiate_value_lparams(*d, const_levels(e));
+                m_st->m_unfold.insert(e, r);
+                return some_expr(r);
             }
         }
     }
@@ -578,6 +929,19 @@ optional<expr> reduce_native(environment const & env, expr const & e) {
     return none_expr();
 }
 
+/* `reduce_native` memoized in the type checker state. The compiled code of a constant cannot change within an
+   environment, and the same `native_decide` proof is often reduced several times while checking a declaration. */
+optional<expr> type_checker::reduce_native(expr const & e) {
+    if (!is_app(e) || !is_constant(app_arg(e)))
+        return none_expr();
+    if (expr const * r = m_st->m_native.find(e))
+        return some_expr(*r);
+    optional<expr> r = ::lean::reduce_native(env(), e);
+    if (r)
+        m_st->m_native.insert(e, *r);
+    return r;
+}
+
 static inline bool is_nat_lit_ext(expr const & e) { return e == *g_nat_zero || is_nat_lit(e); }
 static inline nat get_nat_val(expr const & e) {
     lean_assert(is_nat_lit_ext(e));
@@ -585,6 +949,13 @@ static inline nat get_nat_val(expr const & e) {
     return lit_value(e).get_nat();
 }
 
+template<typename F> optional<expr> type_checker::reduce_unary_nat_op(F const & f, expr const & e) {
+    expr arg = whnf(app_arg(e));
+    if (!is_nat_lit_ext(arg)) return none_expr();
+    nat v = get_nat_val(arg);
+    return some_expr(mk_lit(literal(nat(f(v.raw())))));
+}
+
 template<typename F> optional<expr> type_checker::reduce_bin_nat_op(F const & f, expr const & e) {
     expr arg1 = whnf(app_arg(app_fn(e)));
     if (!is_nat_lit_ext(arg1)) return none_expr();
@@ -616,6 +987,9 @@ optional<expr> type_checker::reduce_nat(expr const & e) {
             nat v = get_nat_val(arg);
             return some_expr(mk_lit(literal(nat(v+nat(1)))));
         }
+        if (!is_constant(f)) return none_expr();
+        if (f == *g_nat_pred) return reduce_unary_nat_op(lean_nat_pred, e);
+        if (f == *g_nat_log2) return reduce_unary_nat_op(lean_nat_log2, e);
     } else if (nargs == 2) {
         expr const & f = app_fn(app_fn(e));
         if (!is_constant(f)) return none_expr();
@@ -637,6 +1011,42 @@ optional<expr> type_checker::reduce_nat(expr const & e) {
     return none_expr();
 }
 
+/** \brief Evaluate `String` functions with a native implementation on string literals, without expanding them
+    into `List Char` terms. */
+optional<expr> type_checker::reduce_string(expr const & e) {
+    if (has_fvar(e)) return none_expr();
+    unsigned nargs = get_app_num_args(e);
+    if (nargs == 1) {
+        expr const & f = app_fn(e);
+        if (f != *g_string_length && f != *g_string_utf8_byte_size) return none_expr();
+        expr arg = whnf(app_arg(e));
+        if (!is_string_lit(arg)) return none_expr();
+        string_ref const & v = lit_value(arg).get_string();
+        if (f == *g_string_length)
+            return some_expr(mk_lit(literal(nat(lean_string_length(v.raw())))));
+        else
+            return some_expr(mk_lit(literal(nat(lean_string_utf8_byte_size(v.raw())))));
+    } else if (nargs == 2) {
+        expr const & f = app_fn(app_fn(e));
+        if (f != *g_string_append && f != *g_string_dec_eq) return none_expr();
+        expr arg1 = whnf(app_arg(app_fn(e)));
+        if (!is_string_lit(arg1)) return none_expr();
+        expr arg2 = whnf(app_arg(e));
+        if (!is_string_lit(arg2)) return none_expr();
+        string_ref const & v1 = lit_value(arg1).get_string();
+        string_ref const & v2 = lit_value(arg2).get_string();
+        if (f == *g_string_append)
+            return some_expr(mk_lit(literal(string_ref(lean_string_append(v1.to_obj_arg(), v2.raw())))));
+        /* `String.decEq a b` where `a` and `b` are the same literal reduces to `isTrue rfl`.
+           We do not have a short proof of `a ≠ b` for different literals, so they are still reduced by unfolding. */
+        if (v1 != v2) return none_expr();
+        expr a = app_arg(app_fn(e));
+        expr b = app_arg(e);
+        return some_expr(mk_app(*g_decidable_is_true, mk_app(*g_string_eq, a, b), mk_app(*g_string_eq_refl, a)));
+    }
+    return none_expr();
+}
+
 /** \brief Put expression \c t in weak head normal form */
 expr type_checker::whnf(expr const & e) {
     // Do not cache easy cases
@@ -647,7 +1057,7 @@ expr type_checker::whnf(expr const & e) {
     case expr_kind::MData:
         return whnf(mdata_expr(e));
     case expr_kind::FVar:
-        if (is_let_fvar(m_lctx, e))
+        if (is_let_fvar(e))
             break;
         else
             return e;
@@ -657,25 +1067,43 @@ expr type_checker::whnf(expr const & e) {
     }
 
     // check cache
-    auto it = m_st->m_whnf.find(e);
-    if (it != m_st->m_whnf.end())
-        return it->second;
+    expr const * cached = m_st->m_whnf.find(e);
+    record_kernel_cache_access(kernel_profile_cache::Whnf, cached);
+    if (cached)
+        return *cached;
+
+    /* Unfolding statistics must be recorded, so do not use the shared cache when collecting them. */
+    bool shared = !m_diag;
+    if (shared) {
+        auto r = find_shared(env(), shared_cache_kind::Whnf, e);
+        record_kernel_cache_access(kernel_profile_cache::Shared, static_cast<bool>(r));
+        if (r) {
+            m_st->m_whnf.insert(e, *r);
+            return *r;
+        }
+    }
+
+    auto cache = [&](expr r) {
+        r = share(r);
+        m_st->m_whnf.insert(e, r);
+        if (shared)
+            add_shared(env(), shared_cache_kind::Whnf, e, r);
+        return r;
+    };
 
     expr t = e;
     while (true) {
         expr t1 = whnf_core(t);
-        if (auto v = reduce_native(env(), t1)) {
-            m_st->m_whnf.insert(mk_pair(e, *v));
-            return *v;
+        if (auto v = reduce_native(t1)) {
+            return cache(*v);
         } else if (auto v = reduce_nat(t1)) {
-            m_st->m_whnf.insert(mk_pair(e, *v));
-            return *v;
+            return cache(*v);
+        } else if (auto v = reduce_string(t1)) {
+            return cache(*v);
         } else if (auto next_t = unfold_definition(t1)) {
             t = *next_t;
         } else {
-            auto r = t1;
-            m_st->m_whnf.insert(mk_pair(e, r));
-            return r;
+            return cache(t1);
         }
     }
 }
@@ -690,7 +1118,7 @@ expr type_checker::whnf(expr const & e) {
 bool type_checker::is_def_eq_binding(expr t, expr s) {
     lean_assert(t.kind() == s.kind());
     lean_assert(is_binding(t));
-    flet<local_ctx> save_lctx(m_lctx, m_lctx);
+    scoped_lctx save_lctx(*this);
     expr_kind k = t.kind();
     buffer<expr> subst;
     do {
@@ -705,7 +1133,7 @@ bool type_checker::is_def_eq_binding(expr t, expr s) {
             // free variable is used inside t or s
             if (!var_s_type)
                 var_s_type = instantiate_rev(binding_domain(s), subst.size(), subst.data());
-            subst.push_back(m_lctx.mk_local_decl(m_st->m_ngen, binding_name(s), *var_s_type, binding_info(s)));
+            subst.push_back(mk_local_decl(binding_name(s), *var_s_type, binding_info(s)));
         } else {
             subst.push_back(*g_dont_care); // don't care
         }
@@ -797,7 +1225,7 @@ bool type_checker::try_eta_struct_core(expr const & t, expr const & s) {
     if (!f_info.is_constructor()) return false;
     constructor_val f_val = f_info.to_constructor_val();
     if (get_app_num_args(s) != f_val.get_nparams() + f_val.get_nfields()) return false;
-    if (!is_structure_like(env(), f_val.get_induct())) return false;
+    if (!get_structure_info(f_val.get_induct()).m_structure_like) return false;
     if (!is_def_eq(infer_type(t), infer_type(s))) return false;
     buffer<expr> s_args;
     get_app_args(s, s_args);
@@ -843,15 +1271,18 @@ lbool type_checker::is_def_eq_proof_irrel(expr const & t, expr const & s) {
 }
 
 bool type_checker::failed_before(expr const & t, expr const & s) const {
+    bool r;
     if (hash(t) < hash(s)) {
-        return m_st->m_failure.find(mk_pair(t, s)) != m_st->m_failure.end();
+        r = m_st->m_failure.contains(mk_pair(t, s));
     } else if (hash(t) > hash(s)) {
-        return m_st->m_failure.find(mk_pair(s, t)) != m_st->m_failure.end();
+        r = m_st->m_failure.contains(mk_pair(s, t));
     } else {
-        return
-            m_st->m_failure.find(mk_pair(t, s)) != m_st->m_failure.end() ||
-            m_st->m_failure.find(mk_pair(s, t)) != m_st->m_failure.end();
+        r =
+            m_st->m_failure.contains(mk_pair(t, s)) ||
+            m_st->m_failure.contains(mk_pair(s, t));
     }
+    record_kernel_cache_access(kernel_profile_cache::Failure, r);
+    return r;
 }
 
 void type_checker::cache_failure(expr const & t, expr const & s) {
@@ -884,6 +1315,7 @@ optional<expr> type_checker::try_unfold_proj_app(expr const & e) {
 auto type_checker::lazy_delta_reduction_step(expr & t_n, expr & s_n) -> reduction_status {
     auto d_t = is_delta(t_n);
     auto d_s = is_delta(s_n);
+    kernel_profile_step prof(kernel_profile_event::LazyDeltaStep, d_t ? t_n : s_n);
     if (!d_t && !d_s) {
         return reduction_status::DefUnknown;
     } else if (d_t && !d_s) {
@@ -979,12 +1411,16 @@ lbool type_checker::lazy_delta_reduction(expr & t_n, expr & s_n) {
                 return to_lbool(is_def_eq_core(*t_v, s_n));
             } else if (auto s_v = reduce_nat(s_n)) {
                 return to_lbool(is_def_eq_core(t_n, *s_v));
+            } else if (auto t_v = reduce_string(t_n)) {
+                return to_lbool(is_def_eq_core(*t_v, s_n));
+            } else if (auto s_v = reduce_string(s_n)) {
+                return to_lbool(is_def_eq_core(t_n, *s_v));
             }
         }
 
-        if (auto t_v = reduce_native(env(), t_n)) {
+        if (auto t_v = reduce_native(t_n)) {
             return to_lbool(is_def_eq_core(*t_v, s_n));
-        } else if (auto s_v = reduce_native(env(), s_n)) {
+        } else if (auto s_v = reduce_native(s_n)) {
             return to_lbool(is_def_eq_core(t_n, *s_v));
         }
 
@@ -1043,17 +1479,17 @@ lbool type_checker::try_string_lit_expansion(expr const & t, expr const & s) {
 bool type_checker::is_def_eq_unit_like(expr const & t, expr const & s) {
     expr t_type = whnf(infer_type(t));
     expr I = get_app_fn(t_type);
-    if (!is_constant(I) || !is_structure_like(env(), const_name(I)))
+    if (!is_constant(I))
         return false;
-    name ctor_name = head(env().get(const_name(I)).to_inductive_val().get_cnstrs());
-    constructor_val ctor_val = env().get(ctor_name).to_constructor_val();
-    if (ctor_val.get_nfields() != 0)
+    state::structure_info info = get_structure_info(const_name(I));
+    if (!info.m_structure_like || info.m_nfields != 0)
         return false;
     return is_def_eq_core(t_type, infer_type(s));
 }
 
 bool type_checker::is_def_eq_core(expr const & t, expr const & s) {
     check_system("is_definitionally_equal", /* do_check_interrupted */ true);
+    kernel_profile_step prof(kernel_profile_event::IsDefEqCore, t);
     bool use_hash = true;
     lbool r = quick_is_def_eq(t, s, use_hash);
     if (r != l_undef) return r == l_true;
@@ -1127,7 +1563,9 @@ bool type_checker::is_def_eq_core(expr const & t, expr const & s) {
     return false;
 }
 
-bool type_checker::is_def_eq(expr const & t, expr const & s) {
+bool type_checker::is_def_eq(expr const & t0, expr const & s0) {
+    expr t = share(t0);
+    expr s = share(s0);
     bool r = is_def_eq_core(t, s);
     if (r)
         m_st->m_eqv_manager.add_equiv(t, s);
@@ -1136,11 +1574,11 @@ bool type_checker::is_def_eq(expr const & t, expr const & s) {
 
 expr type_checker::eta_expand(expr const & e) {
     buffer<expr> fvars;
-    flet<local_ctx> save_lctx(m_lctx, m_lctx);
+    scoped_lctx save_lctx(*this);
     expr it = e;
     while (is_lambda(it)) {
         expr d = instantiate_rev(binding_domain(it), fvars.size(), fvars.data());
-        fvars.push_back(m_lctx.mk_local_decl(m_st->m_ngen, binding_name(it), d, binding_info(it)));
+        fvars.push_back(mk_local_decl(binding_name(it), d, binding_info(it)));
         it     = binding_body(it);
     }
     it = instantiate_rev(it, fvars.size(), fvars.data());
@@ -1148,7 +1586,7 @@ expr type_checker::eta_expand(expr const & e) {
     if (!is_pi(it_type)) return e;
     buffer<expr> args;
     while (is_pi(it_type)) {
-        expr arg = m_lctx.mk_local_decl(m_st->m_ngen, binding_name(it_type), binding_domain(it_type), binding_info(it_type));
+        expr arg = mk_local_decl(binding_name(it_type), binding_domain(it_type), binding_info(it_type));
         args.push_back(arg);
         fvars.push_back(arg);
         it_type  = whnf(instantiate(binding_body(it_type), arg));
@@ -1158,7 +1596,7 @@ expr type_checker::eta_expand(expr const & e) {
 }
 
 type_checker::type_checker(environment const & env, local_ctx const & lctx, diagnostics * diag, definition_safety ds):
-    m_st_owner(true), m_st(new state(env)), m_diag(diag),
+    m_st_owner(true), m_st(acquire_state(env)), m_diag(diag),
     m_lctx(lctx), m_definition_safety(ds), m_lparams(nullptr) {
 }
 
@@ -1168,14 +1606,18 @@ type_checker::type_checker(state & st, local_ctx const & lctx, definition_safety
 }
 
 type_checker::type_checker(type_checker && src):
-    m_st_owner(src.m_st_owner), m_st(src.m_st), m_diag(src.m_diag), m_lctx(std::move(src.m_lctx)),
+    m_st_owner(src.m_st_owner), m_st(src.m_st), m_diag(src.m_diag), m_lctx(std::move(src.m_lctx)), m_fvars(std::move(src.m_fvars)),
     m_definition_safety(src.m_definition_safety), m_lparams(src.m_lparams) {
     src.m_st_owner = false;
+    src.m_st       = nullptr;
 }
 
 type_checker::~type_checker() {
+    if (!m_st)
+        return;
+    g_peak_cache_size = std::max(g_peak_cache_size, m_st->cache_size());
     if (m_st_owner)
-        delete m_st;
+        release_state(m_st);
 }
 
 extern "C" LEAN_EXPORT lean_object * lean_kernel_is_def_eq(lean_object * env, lean_object * lctx, lean_object * a, lean_object * b) {
@@ -1204,6 +1646,8 @@ void initialize_type_checker() {
     g_dont_care    = new_persistent_expr_const("dontcare");
     g_nat_zero     = new_persistent_expr_const({"Nat", "zero"});
     g_nat_succ     = new_persistent_expr_const({"Nat", "succ"});
+    g_nat_pred     = new_persistent_expr_const({"Nat", "pred"});
+    g_nat_log2     = new_persistent_expr_const({"Nat", "log2"});
     g_nat_add      = new_persistent_expr_const({"Nat", "add"});
     g_nat_sub      = new_persistent_expr_const({"Nat", "sub"});
     g_nat_mul      = new_persistent_expr_const({"Nat", "mul"});
@@ -1219,9 +1663,20 @@ void initialize_type_checker() {
     g_nat_shiftLeft  = new_persistent_expr_const({"Nat", "shiftLeft"});
     g_nat_shiftRight = new_persistent_expr_const({"Nat", "shiftRight"});
     g_string_mk    = new_persistent_expr_const({"String", "mk"});
+    g_string_length         = new_persistent_expr_const({"String", "length"});
+    g_string_utf8_byte_size = new_persistent_expr_const({"String", "utf8ByteSize"});
+    g_string_append         = new_persistent_expr_const({"String", "append"});
+    g_string_dec_eq         = new_persistent_expr_const({"String", "decEq"});
+    g_string_eq             = new expr(mk_app(mk_constant("Eq", levels(mk_level_one())), mk_constant("String")));
+    mark_persistent(g_string_eq->raw());
+    g_string_eq_refl        = new expr(mk_app(mk_constant(name{"Eq", "refl"}, levels(mk_level_one())), mk_constant("String")));
+    mark_persistent(g_string_eq_refl->raw());
+    g_decidable_is_true     = new_persistent_expr_const({"Decidable", "isTrue"});
     g_lean_reduce_bool = new_persistent_expr_const({"Lean", "reduceBool"});
     g_lean_reduce_nat  = new_persistent_expr_const({"Lean", "reduceNat"});
     register_name_generator_prefix(*g_kernel_fresh);
+    g_hash_consing = std::getenv("LEAN_KERNEL_HASH_CONS") != nullptr;
+    g_shared_cache = new shared_kernel_cache_shard[LEAN_SHARED_KERNEL_CACHE_SHARDS];
 }
 
 void finalize_type_checker() {
@@ -1230,6 +1685,8 @@ void finalize_type_checker() {
     delete g_dont_care;
     delete g_nat_succ;
     delete g_nat_zero;
+    delete g_nat_pred;
+    delete g_nat_log2;
     delete g_nat_add;
     delete g_nat_sub;
     delete g_nat_mul;
@@ -1245,7 +1702,19 @@ void finalize_type_checker() {
     delete g_nat_shiftLeft;
     delete g_nat_shiftRight;
     delete g_string_mk;
+    delete g_string_length;
+    delete g_string_utf8_byte_size;
+    delete g_string_append;
+    delete g_string_dec_eq;
+    delete g_string_eq;
+    delete g_string_eq_refl;
+    delete g_decidable_is_true;
     delete g_lean_reduce_bool;
     delete g_lean_reduce_nat;
+    for (unsigned i = 0; i < LEAN_SHARED_KERNEL_CACHE_SHARDS; i++) {
+        if (g_shared_cache[i].m_imports_id)
+            dec_ref(g_shared_cache[i].m_imports_id);
+    }
+    delete[] g_shared_cache;
 }
 }
@@ -5,6 +5,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
+#include <vector>
 #include <unordered_set>
 #include <memory>
 #include <utility>
@@ -15,6 +16,8 @@ Author: Leonardo de Moura
 #include "kernel/environment.h"
 #include "kernel/local_ctx.h"
 #include "kernel/expr_maps.h"
+#include "kernel/expr_flat_map.h"
+#include "kernel/hash_cons.h"
 #include "kernel/equiv_manager.h"
 
 namespace lean {
@@ -23,32 +26,66 @@ namespace lean {
 class type_checker {
 public:
     class state {
-        typedef expr_map<expr> infer_cache;
-        typedef std::unordered_set<expr_pair, expr_pair_hash, expr_pair_eq> expr_pair_set;
+        typedef expr_flat_map<expr> infer_cache;
+        typedef expr_pair_flat_set expr_pair_set;
         environment               m_env;
         name_generator            m_ngen;
         infer_cache               m_infer_type[2];
-        expr_map<expr>            m_whnf_core;
-        expr_map<expr>            m_whnf;
+        expr_flat_map<expr>       m_whnf_core;
+        expr_flat_map<expr>       m_whnf;
         equiv_manager             m_eqv_manager;
         expr_pair_set             m_failure;
+        /* Results of `is_prop`, which proof irrelevance queries for the types of most terms compared by `is_def_eq`. */
+        expr_flat_map<bool>       m_is_prop;
+        /* When hash-consing is enabled, the terms being checked and the results of `whnf_core`, `whnf` and
+           `infer_type` are maximally shared, so most definitional equality tests are decided by pointer equality. */
+        bool                      m_hash_consing;
+        hash_cons_table           m_hash_cons;
+        /* Inductive types used by the eta for structures and unit-like rules, see `get_structure_info`. */
+        struct structure_info {
+            bool     m_structure_like;
+            unsigned m_nfields;
+        };
+        flat_hash_map<name, structure_info, name_hash_fn, name_eq_fn> m_structure_info;
+        /* Results of `reduce_native` on `Lean.reduceBool c` and `Lean.reduceNat c` terms. */
+        expr_flat_map<expr>       m_native;
+        /* Values of the constants `c.{ls}` unfolded by `unfold_definition_core`, for universe polymorphic `c`.
+           Their types are already cached by `m_infer_type`. */
+        expr_flat_map<expr>       m_unfold;
         friend type_checker;
+        /* Empty the caches for reuse by a type checker for `env`, see `acquire_state`. */
+        void reset(environment const & env);
     public:
         state(environment const & env);
+        /* Number of entries in the `infer_type`, `whnf_core` and `whnf` caches. */
+        size_t cache_size() const;
         environment & env() { return m_env; }
         environment const & env() const { return m_env; }
         name_generator & ngen() { return m_ngen; }
     };
 private:
+    /* Owned states are taken from and returned to a per-thread pool, which keeps their caches allocated. */
+    static state * acquire_state(environment const & env);
+    static void release_state(state * s);
     bool                      m_st_owner;
     state *                   m_st;
     diagnostics *             m_diag;
     local_ctx                 m_lctx;
+    /* The declarations added to `m_lctx` by `mk_local_decl`, in creation order. Their names are fresh numerals of
+       `m_st->m_ngen`, so `find_local_decl` can look them up by binary search on the numeral instead of querying
+       the `LocalContext` object. Scopes restoring `m_lctx` must use `scoped_lctx`, which also truncates this vector. */
+    std::vector<local_decl>   m_fvars;
     definition_safety         m_definition_safety;
     /* When `m_lparams != nullptr, the `check` method makes sure all level parameters
        are in `m_lparams`. */
     names const *             m_lparams;
 
+    class scoped_lctx;
+    expr mk_local_decl(name const & un, expr const & type, binder_info bi);
+    expr mk_local_decl(name const & un, expr const & type, expr const & value);
+    optional<local_decl> find_local_decl(expr const & e) const;
+    bool is_let_fvar(expr const & e) const;
+
     expr ensure_sort_core(expr e, expr const & s);
     expr ensure_pi_core(expr e, expr const & s);
     void check_level(level const & l);
@@ -64,6 +101,7 @@ private:
 
     enum class reduction_status { Continue, DefUnknown, DefEqual, DefDiff };
     optional<expr> reduce_recursor(expr const & e, bool cheap_rec, bool cheap_proj);
+    state::structure_info get_structure_info(name const & I);
     optional<expr> reduce_proj_core(expr c, unsigned idx);
     optional<expr> reduce_proj(expr const & e, bool cheap_rec, bool cheap_proj);
     expr whnf_fvar(expr const & e, bool cheap_rec, bool cheap_proj);
@@ -99,9 +137,13 @@ private:
     expr check_ignore_undefined_universes(expr const & e);
     optional<expr> try_unfold_proj_app(expr const & e);
 
+    template<typename F> optional<expr> reduce_unary_nat_op(F const & f, expr const & e);
     template<typename F> optional<expr> reduce_bin_nat_op(F const & f, expr const & e);
     template<typename F> optional<expr> reduce_bin_nat_pred(F const & f, expr const & e);
     optional<expr> reduce_nat(expr const & e);
+    optional<expr> reduce_string(expr const & e);
+    optional<expr> reduce_native(expr const & e);
+    expr share(expr const & e) { return m_st->m_hash_consing ? m_st->m_hash_cons.share(e) : e; }
 public:
     type_checker(state & st, local_ctx const & lctx, definition_safety ds = definition_safety::safe);
     type_checker(state & st, definition_safety ds = definition_safety::safe):type_checker(st, local_ctx(), ds) {}
@@ -160,6 +202,15 @@ public:
     optional<expr> unfold_definition(expr const & e);
 };
 
+/** \brief Enable hash-consing in new type checker states. It is disabled by default, and it can also be
+    enabled by setting the environment variable `LEAN_KERNEL_HASH_CONS`. */
+LEAN_EXPORT void set_kernel_hash_consing(bool flag);
+
+/** \brief Largest `type_checker::state::cache_size()` reached by a type checker of the current thread since the
+    last call to `set_kernel_peak_cache_size`. */
+size_t get_kernel_peak_cache_size();
+void set_kernel_peak_cache_size(size_t sz);
+
 void initialize_type_checker();
 void finalize_type_checker();
 }
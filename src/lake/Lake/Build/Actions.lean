@@ -22,6 +22,7 @@ def compileLeanModule
   (leanPath : SearchPath := []) (rootDir : FilePath := ".")
   (dynlibs : Array FilePath := #[]) (dynlibPath : SearchPath := {})
   (leanArgs : Array String := #[]) (lean : FilePath := "lean")
+  (rssFile? : Option FilePath := none)
 : LogIO Unit := do
   let mut args := leanArgs ++
     #[leanFile.toString, "-R", rootDir.toString]
@@ -40,6 +41,11 @@ def compileLeanModule
   for dynlib in dynlibs do
     args := args.push s!"--load-dynlib={dynlib}"
   args := args.push "--json"
+  -- the outputs are complete when `lean` exits, so it need not free its memory
+  args := args.push "--fast-exit"
+  if let some rssFile := rssFile? then
+    createParentDirs rssFile
+    args := args.push s!"--peak-rss={rssFile}"
   withLogErrorPos do
   let out ← rawProc {
     args
@@ -37,6 +37,12 @@ structure BuildConfig where
   out : OutStream := .stderr
   /-- Whether to use ANSI escape codes in build output. -/
   ansiMode : AnsiMode := .auto
+  /--
+  The memory (in MiB) that the Lean processes of a build may use at once,
+  as estimated from the peak memory of previous builds of the same modules.
+  A value of `0` disables the limit.
+  -/
+  memBudget : Nat := 0
 
 /-- The minimum log level for an log entry to be reported. -/
 @[inline] def BuildConfig.outLv (cfg : BuildConfig) : LogLevel :=
@@ -58,6 +64,8 @@ declare_opaque_type OpaqueJob
 structure BuildContext extends BuildConfig, Context where
   leanTrace : BuildTrace
   registeredJobs : IO.Ref (Array OpaqueJob)
+  /-- The memory (in MiB) reserved by the running jobs under the `memBudget`. -/
+  memReserved : IO.Ref Nat
 
 /-- A transformer to equip a monad with a `BuildContext`. -/
 abbrev BuildT := ReaderT BuildContext
@@ -105,3 +113,33 @@ As a result, this no longer functions the way it used to. It now just logs the
 -/
 @[deprecated, inline] def logStep [Monad m] [MonadLog m] (message : String) : m Unit := do
   logVerbose message
+
+/-- The memory (in MiB) reserved for a module without a previous estimate. -/
+def defaultMemEstimate : Nat := 1024
+
+/-- Wait until `mem` more MiB fit into the build's `memBudget` and reserve them. -/
+partial def BuildContext.reserveMem (ctx : BuildContext) (mem : Nat) : BaseIO Unit := do
+  let ok ← ctx.memReserved.modifyGet fun used =>
+    -- a job always runs on its own, so that jobs larger than the budget make progress
+    if used == 0 || used + mem ≤ ctx.memBudget then (true, used + mem) else (false, used)
+  unless ok do
+    IO.sleep 10
+    ctx.reserveMem mem
+
+/--
+Run `x` under the build's `memBudget`, reserving `mem` MiB of it
+(or `defaultMemEstimate`, if `none`) while `x` runs.
+-/
+@[inline] def withMemReservation
+  [Monad m] [MonadLiftT BaseIO m] [MonadFinally m] [MonadBuild m]
+  (mem? : Option Nat) (x : m α)
+: m α := do
+  let ctx ← getBuildContext
+  if ctx.memBudget == 0 then
+    return ← x
+  let mem := mem?.getD defaultMemEstimate
+  ctx.reserveMem mem
+  try
+    x
+  finally
+    ctx.memReserved.modify (· - mem)
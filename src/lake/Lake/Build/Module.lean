@@ -143,6 +143,15 @@ def Module.recBuildDeps (mod : Module) : FetchM (BuildJob (SearchPath × Array F
 def Module.depsFacetConfig : ModuleFacetConfig depsFacet :=
   mkFacetJobConfig (·.recBuildDeps)
 
+/--
+The memory (in MiB) that building the module took the last time,
+as recorded by `lean` in the module's `.rss` file.
+-/
+def Module.memEstimate? (mod : Module) : BaseIO (Option Nat) := do
+  let .ok contents ← IO.FS.readFile mod.rssFile |>.toBaseIO
+    | return none
+  return contents.trim.toNat?.map fun bytes => (bytes + 1024 * 1024 - 1) / (1024 * 1024)
+
 /--
 Recursively build a Lean module.
 Fetch its dependencies and then elaborate the Lean source file, producing
@@ -158,8 +167,10 @@ def Module.recBuildLean (mod : Module) : FetchM (BuildJob Unit) := do
       let hasLLVM := Lean.Internal.hasLLVMBackend ()
       let bcFile? := if hasLLVM then some mod.bcFile else none
       cacheBuildLog mod.logFile modTrace do
+        withMemReservation (← mod.memEstimate?) do
         compileLeanModule mod.leanFile mod.oleanFile mod.ileanFile mod.cFile bcFile?
           (← getLeanPath) mod.rootDir dynlibs dynlibPath (mod.weakLeanArgs ++ mod.leanArgs) (← getLean)
+          (rssFile? := mod.rssFile)
       discard <| cacheFileHash mod.oleanFile
       discard <| cacheFileHash mod.ileanFile
       discard <| cacheFileHash mod.cFile
@@ -22,6 +22,7 @@ def mkBuildContext (ws : Workspace) (config : BuildConfig) : BaseIO BuildContext
     opaqueWs := ws,
     toBuildConfig := config,
     registeredJobs := ← IO.mkRef #[],
+    memReserved := ← IO.mkRef 0,
     leanTrace := Hash.ofString ws.lakeEnv.leanGithash
   }
 
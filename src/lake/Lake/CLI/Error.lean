@@ -13,6 +13,7 @@ inductive CliError
 | unknownCommand (cmd : String)
 | missingArg (arg : String)
 | missingOptArg (opt arg : String)
+| invalidOptArg (opt arg : String)
 | unknownShortOption (opt : Char)
 | unknownLongOption (opt : String)
 | unexpectedArguments (args : List String)
@@ -52,6 +53,7 @@ def toString : CliError → String
 | unknownCommand cmd      => s!"unknown command '{cmd}'"
 | missingArg arg          => s!"missing {arg}"
 | missingOptArg opt arg   => s!"missing {arg} after {opt}"
+| invalidOptArg opt arg   => s!"invalid argument '{arg}' for {opt}"
 | unknownShortOption opt  => s!"unknown short option '-{opt}'"
 | unknownLongOption opt   => s!"unknown long option '{opt}'"
 | unexpectedArguments as  => s!"unexpected arguments: {" ".intercalate as}"
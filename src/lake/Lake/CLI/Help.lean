@@ -52,6 +52,8 @@ OPTIONS:
   --iofail              fail build if any I/O or other info is logged
   --ansi, --no-ansi     toggle the use of ANSI escape codes to prettify output
   --no-build            exit immediately if a build target is not up-to-date
+  --mem-budget=mib      only run as many Lean processes at once as fit into the
+                        given memory, based on their usage in previous builds
 
 See `lake help <command>` for more information on a specific command."
 
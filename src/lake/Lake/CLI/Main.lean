@@ -42,6 +42,7 @@ structure LakeOptions where
   noBuild : Bool := false
   failLv : LogLevel := .error
   ansiMode : AnsiMode := .auto
+  memBudget : Nat := 0
 
 /-- Get the Lean installation. Error if missing. -/
 def LakeOptions.getLeanInstall (opts : LakeOptions) : Except CliError LeanInstall :=
@@ -83,6 +84,7 @@ def LakeOptions.mkBuildConfig (opts : LakeOptions) (out := OutStream.stderr) : B
   verbosity := opts.verbosity
   failLv := opts.failLv
   ansiMode := opts.ansiMode
+  memBudget := opts.memBudget
   out := out
 
 export LakeOptions (mkLoadConfig mkBuildConfig)
@@ -172,6 +174,11 @@ def lakeLongOption : (opt : String) → CliM PUnit
 | "--dir"         => do let rootDir ← takeOptArg "--dir" "path"; modifyThe LakeOptions ({· with rootDir})
 | "--file"        => do let configFile ← takeOptArg "--file" "path"; modifyThe LakeOptions ({· with configFile})
 | "--lean"        => do setLean <| ← takeOptArg "--lean" "path or command"
+| "--mem-budget"  => do
+  let arg ← takeOptArg "--mem-budget" "size in MiB"
+  let some memBudget := arg.toNat?
+    | throw <| CliError.invalidOptArg "--mem-budget" arg
+  modifyThe LakeOptions ({· with memBudget})
 | "--help"        => modifyThe LakeOptions ({· with wantsHelp := true})
 | "--"            => do let subArgs ← takeArgs; modifyThe LakeOptions ({· with subArgs})
 | opt             =>  throw <| CliError.unknownLongOption opt
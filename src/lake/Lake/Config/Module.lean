@@ -86,6 +86,10 @@ abbrev pkg (self : Module) : Package :=
 @[inline] def traceFile (self : Module) : FilePath :=
   self.leanLibPath "trace"
 
+/-- The file to which `lean` writes its peak memory usage (in bytes) when building the module. -/
+@[inline] def rssFile (self : Module) : FilePath :=
+  self.leanLibPath "rss"
+
 @[inline] def irPath (ext : String) (self : Module) : FilePath :=
   self.filePath self.pkg.irDir ext
 
@@ -0,0 +1,17 @@
+#!/usr/bin/env bash
+set -exo pipefail
+
+LAKE=${LAKE:-../../.lake/build/bin/lake}
+
+./clean.sh
+
+# Test that module builds record their peak memory and
+# that a budget smaller than a single module still makes progress
+
+$LAKE new hello
+$LAKE -d hello build --mem-budget=1
+test -s hello/.lake/build/lib/Hello/Basic.rss
+grep -E '^[0-9]+$' hello/.lake/build/lib/Hello/Basic.rss
+echo 'def hello := "budget"' > hello/Hello/Basic.lean
+$LAKE -d hello build --mem-budget=1 | grep --color 'Built Hello.Basic'
+($LAKE -d hello build --mem-budget=foo 2>&1 && exit 1 || true) | grep --color "invalid argument 'foo' for --mem-budget"
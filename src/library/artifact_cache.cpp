@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <sys/stat.h>
+#if defined(LEAN_WINDOWS)
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include "runtime/hash.h"
+#include "library/module.h"
+#include "library/artifact_cache.h"
+#include "githash.h"
+
+namespace lean {
+static char const * const g_manifest = "manifest";
+
+/* Two MurmurHash64A instances with different seeds. */
+struct artifact_hasher {
+    uint64 m_h1 = 17;
+    uint64 m_h2 = 0x9e3779b97f4a7c15;
+    void mix(char const * s, size_t len) {
+        uint64 n = len;
+        m_h1 = hash_str(sizeof(n), reinterpret_cast<unsigned char const *>(&n), m_h1);
+        m_h2 = hash_str(sizeof(n), reinterpret_cast<unsigned char const *>(&n), m_h2);
+        m_h1 = hash_str(len, reinterpret_cast<unsigned char const *>(s), m_h1);
+        m_h2 = hash_str(len, reinterpret_cast<unsigned char const *>(s), m_h2);
+    }
+    void mix(std::string const & s) { mix(s.data(), s.size()); }
+    void mix(uint64 v) { mix(reinterpret_cast<char const *>(&v), sizeof(v)); }
+    std::string get() const {
+        std::ostringstream out;
+        out << std::hex << std::setfill('0') << std::setw(16) << m_h1 << std::setw(16) << m_h2;
+        return out.str();
+    }
+};
+
+static std::string to_hex(uint64 h) {
+    std::ostringstream out;
+    out << std::hex << std::setfill('0') << std::setw(16) << h;
+    return out.str();
+}
+
+static int make_dir(std::string const & dir) {
+#if defined(LEAN_WINDOWS)
+    return mkdir(dir.c_str());
+#else
+    return mkdir(dir.c_str(), 0777);
+#endif
+}
+
+static bool copy_file(std::string const & src, std::string const & dst) {
+    std::ifstream in(src, std::ios_base::binary);
+    if (in.fail())
+        return false;
+    std::ofstream out(dst, std::ios_base::binary);
+    if (out.fail())
+        return false;
+    out << in.rdbuf();
+    out.close();
+    return !out.fail();
+}
+
+/* Copy `src` to `dst` through a temporary file, so that neither partially written files are exposed nor possibly
+   memory-mapped .olean files are modified, as in `lean_save_module_data`. */
+static bool copy_file_atomic(std::string const & src, std::string const & dst) {
+    std::string tmp = dst + ".tmp";
+    if (!copy_file(src, tmp))
+        return false;
+    if (std::rename(tmp.c_str(), dst.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+optional<std::string> get_artifact_key(std::string const & contents, std::string const & config,
+                                       std::vector<std::string> const & import_oleans) {
+    artifact_hasher h;
+    h.mix(LEAN_GITHASH);
+    h.mix(config);
+    h.mix(contents);
+    h.mix(static_cast<uint64>(import_oleans.size()));
+    for (std::string const & fn : import_oleans) {
+        optional<uint64> header = get_olean_header_hash(fn);
+        if (!header)
+            return optional<std::string>();
+        h.mix(*header);
+    }
+    return optional<std::string>(h.get());
+}
+
+/* The outputs of `outs` together with their names in a cache entry. */
+static std::vector<std::pair<char const *, std::string>> get_outputs(module_artifacts const & outs) {
+    std::vector<std::pair<char const *, std::string>> r;
+    if (outs.m_olean) r.emplace_back("olean", *outs.m_olean);
+    if (outs.m_ilean) r.emplace_back("ilean", *outs.m_ilean);
+    if (outs.m_c)     r.emplace_back("c", *outs.m_c);
+    if (outs.m_bc)    r.emplace_back("bc", *outs.m_bc);
+    return r;
+}
+
+bool restore_artifacts(std::string const & dir, std::string const & key, module_artifacts const & outs) {
+    std::string entry = dir + "/" + key;
+    std::ifstream manifest(entry + "/" + g_manifest);
+    if (manifest.fail())
+        return false;
+    std::string line;
+    while (std::getline(manifest, line)) {
+        // `<header hash> <.olean file>`
+        size_t sep = line.find(' ');
+        if (sep == std::string::npos)
+            return false;
+        optional<uint64> header = get_olean_header_hash(line.substr(sep + 1));
+        if (!header || to_hex(*header) != line.substr(0, sep))
+            return false;
+    }
+    for (auto const & out : get_outputs(outs)) {
+        if (!copy_file_atomic(entry + "/" + out.first, out.second))
+            return false;
+    }
+    return true;
+}
+
+void store_artifacts(std::string const & dir, std::string const & key, module_artifacts const & outs,
+                     std::vector<std::string> const & imported_oleans) {
+    std::ostringstream manifest;
+    for (std::string const & fn : imported_oleans) {
+        optional<uint64> header = get_olean_header_hash(fn);
+        if (!header)
+            return;
+        manifest << to_hex(*header) << " " << fn << "\n";
+    }
+    make_dir(dir);
+    // the entry is prepared in a private directory, and then renamed, so that it is never seen partially written
+    std::string tmp = dir + "/" + key + ".tmp." + std::to_string(getpid());
+    if (make_dir(tmp) != 0)
+        return;
+    std::vector<std::pair<char const *, std::string>> files = get_outputs(outs);
+    bool ok = true;
+    for (auto const & out : files)
+        ok = ok && copy_file(out.second, tmp + "/" + out.first);
+    if (ok) {
+        std::ofstream out(tmp + "/" + g_manifest);
+        out << manifest.str();
+        out.close();
+        ok = !out.fail();
+    }
+    if (ok && std::rename(tmp.c_str(), (dir + "/" + key).c_str()) == 0)
+        return;
+    for (auto const & out : files)
+        std::remove((tmp + "/" + out.first).c_str());
+    std::remove((tmp + "/" + g_manifest).c_str());
+    rmdir(tmp.c_str());
+}
+}
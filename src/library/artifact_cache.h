@@ -0,0 +1,37 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include "runtime/optional.h"
+
+namespace lean {
+/* Content-addressed cache of the outputs of `lean` for a module, stored in a directory that may be shared between
+   builds, e.g. a network file system or a directory synchronized by CI. An entry is a subdirectory named after its key
+   containing the outputs and a manifest, which lists the .olean files of all modules imported directly or indirectly
+   together with the hashes of their headers. The key is derived from the source, the configuration and the headers of
+   the directly imported .olean files. An entry is only used if all the .olean files of its manifest are unchanged. */
+
+/* The requested outputs of a module. */
+struct module_artifacts {
+    optional<std::string> m_olean;
+    optional<std::string> m_ilean;
+    optional<std::string> m_c;
+    optional<std::string> m_bc;
+};
+
+/* Return the key of a module with source `contents` and directly imported .olean files `import_oleans`. `config`
+   must contain everything else that affects the outputs. Return `none` if an imported .olean file cannot be read. */
+optional<std::string> get_artifact_key(std::string const & contents, std::string const & config,
+                                       std::vector<std::string> const & import_oleans);
+
+/* Copy the outputs of the entry `key` of the cache `dir` to `outs`, and return `true` on success. */
+bool restore_artifacts(std::string const & dir, std::string const & key, module_artifacts const & outs);
+
+/* Add the outputs `outs` of a module that imports `imported_oleans`, directly or indirectly, to the entry `key` of
+   the cache `dir`. Failures are ignored, and an existing entry is kept. */
+void store_artifacts(std::string const & dir, std::string const & key, module_artifacts const & outs,
+                     std::vector<std::string> const & imported_oleans);
+}
@@ -4,6 +4,9 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <exception>
+#include <functional>
+#include <vector>
 #include "util/option_declarations.h"
 #include "util/io.h"
 #include "kernel/type_checker.h"
@@ -32,6 +35,10 @@ Author: Leonardo de Moura
 #include "library/compiler/struct_cases_on.h"
 #include "library/compiler/ir.h"
 
+#ifndef LEAN_PAR_COMPILE_MIN_DECLS
+#define LEAN_PAR_COMPILE_MIN_DECLS 2
+#endif
+
 namespace lean {
 static name * g_extract_closed = nullptr;
 
@@ -55,9 +62,79 @@ static expr eta_expand(environment const & env, expr const & e) {
     return type_checker(env).eta_expand(e);
 }
 
+struct par_decl_job {
+    std::function<void(unsigned)> const * m_fn;
+    unsigned                              m_idx;
+    std::exception_ptr                    m_ex;
+};
+
+static void run_par_decl_job(par_decl_job & j) {
+    try {
+        (*j.m_fn)(j.m_idx);
+    } catch (...) {
+        j.m_ex = std::current_exception();
+    }
+}
+
+static obj_res par_decl_job_fn(obj_arg j, obj_arg) {
+    run_par_decl_job(*reinterpret_cast<par_decl_job *>(lean_unbox_usize(j)));
+    lean_dec(j);
+    return box(0);
+}
+
+/* Execute `fn(0)`, ..., `fn(n-1)` in parallel using the task manager. If some of them throw, the exception
+   thrown by the first one is rethrown after all of them have finished. */
+static void par_for_decls(unsigned n, std::function<void(unsigned)> const & fn) {
+    std::vector<par_decl_job> jobs(n);
+    std::vector<object *> tasks;
+    for (unsigned i = 0; i < n; i++) {
+        jobs[i].m_fn  = &fn;
+        jobs[i].m_idx = i;
+    }
+    for (unsigned i = 1; i < n; i++) {
+        object * c = lean_alloc_closure(reinterpret_cast<void *>(par_decl_job_fn), 2, 1);
+        lean_closure_set(c, 0, lean_box_usize(reinterpret_cast<size_t>(&jobs[i])));
+        tasks.push_back(lean_task_spawn_core(c, 0, false));
+    }
+    // the first declaration is processed on the current thread
+    run_par_decl_job(jobs[0]);
+    for (object * t : tasks) {
+        lean_task_get(t);
+        lean_dec(t);
+    }
+    for (par_decl_job const & j : jobs) {
+        if (j.m_ex)
+            std::rethrow_exception(j.m_ex);
+    }
+}
+
+/* Apply `f` to each declaration in `ds`. The declarations of a block are independent of each other here, and
+   `env` is not modified, so when there are several declarations, they are processed in parallel using the task
+   manager. The result does not depend on the order of evaluation since each application of `f` uses its own
+   state (e.g., name generators). They are processed sequentially when tracing is enabled, since traces
+   are not collected in worker threads. */
 template<typename F>
 comp_decls apply(F && f, environment const & env, comp_decls const & ds) {
-    return map(ds, [&](comp_decl const & d) { return comp_decl(d.fst(), f(env, d.snd())); });
+    unsigned n = length(ds);
+    if (n < LEAN_PAR_COMPILE_MIN_DECLS || !has_task_manager() || is_trace_enabled())
+        return map(ds, [&](comp_decl const & d) { return comp_decl(d.fst(), f(env, d.snd())); });
+    buffer<comp_decl> in;
+    to_buffer(ds, in);
+    /* The environment and the input are shared by the worker threads, and the results are passed back to this
+       one. */
+    lean_mark_mt(env.raw());
+    for (comp_decl const & d : in)
+        lean_mark_mt(d.snd().raw());
+    std::vector<expr> out(n);
+    par_for_decls(n, [&](unsigned i) {
+            expr r = f(env, in[i].snd());
+            lean_mark_mt(r.raw());
+            out[i] = r;
+        });
+    buffer<comp_decl> r;
+    for (unsigned i = 0; i < n; i++)
+        r.push_back(comp_decl(in[i].fst(), out[i]));
+    return comp_decls(r);
 }
 
 template<typename F>
@@ -204,24 +281,35 @@ environment compile(environment const & env, options const & opts, names cs) {
     // scope_traces_as_string trace_scope;
     auto simp  = [&](environment const & env, expr const & e) { return csimp(env, e, cfg); };
     auto esimp = [&](environment const & env, expr const & e) { return cesimp(env, e, cfg); };
+    /* Note that each pass infers types using its own `type_checker::state`. The states cannot share their caches:
+       the fresh names of all states start at the same index, so the same free variable name denotes different locals
+       in different passes, and the passes after `erase_irrelevant` work on erased terms, whose types are computed by
+       `ll_infer_type` instead of the kernel type checker. */
+    /* Run the compiler pass `fn`. The profiler reports its time and allocations in a subcategory of `compilation`. */
+    auto pass = [&](char const * pass_name, auto && fn) {
+        time_task t(std::string("compilation: ") + pass_name, opts, head(cs), /* count_allocs */ true);
+        return fn();
+    };
     trace_compiler(name({"compiler", "input"}), ds);
-    ds = apply(eta_expand, env, ds);
+    ds = pass("eta_expand", [&]() { return apply(eta_expand, env, ds); });
     trace_compiler(name({"compiler", "eta_expand"}), ds);
-    ds = apply(to_lcnf, env, ds);
-    ds = apply(find_jp, env, ds);
+    ds = pass("to_lcnf", [&]() { return apply(to_lcnf, env, ds); });
+    ds = pass("find_jp", [&]() { return apply(find_jp, env, ds); });
     // trace(ds);
     trace_compiler(name({"compiler", "lcnf"}), ds);
     // trace(ds);
-    ds = apply(cce, env, ds);
+    ds = pass("cce", [&]() { return apply(cce, env, ds); });
     trace_compiler(name({"compiler", "cce"}), ds);
-    ds = apply(csimp_replace_constants, env, ds);
-    ds = apply(simp, env, ds);
+    ds = pass("csimp_replace_constants", [&]() { return apply(csimp_replace_constants, env, ds); });
+    ds = pass("csimp", [&]() { return apply(simp, env, ds); });
     trace_compiler(name({"compiler", "simp"}), ds);
     // trace(ds);
     environment new_env = env;
-    std::tie(new_env, ds) = eager_lambda_lifting(new_env, ds, cfg);
+    std::tie(new_env, ds) = pass("eager_lambda_lifting", [&]() { return eager_lambda_lifting(new_env, ds, cfg); });
     trace_compiler(name({"compiler", "eager_lambda_lifting"}), ds);
-    ds = apply(max_sharing, ds);
+    ds = pass("max_sharing", [&]() {
+            return apply([](environment const &, expr const & e) { return max_sharing(e); }, env, ds);
+        });
     trace_compiler(name({"compiler", "stage1"}), ds);
     new_env = cache_stage1(new_env, ds);
     if (is_matcher(new_env, ds)) {
@@ -233,44 +321,44 @@ environment compile(environment const & env, options const & opts, names cs) {
            when it is partially applied. Then, we can mark all `match` auxiliary functions as `[strong_inline]` */
         return new_env;
     }
-    std::tie(new_env, ds) = specialize(new_env, ds, cfg);
+    std::tie(new_env, ds) = pass("specialize", [&]() { return specialize(new_env, ds, cfg); });
     // The following check is incorrect. It was exposed by issue #1812.
     // We will not fix the check since we will delete the compiler.
     // lean_assert(lcnf_check_let_decls(new_env, ds));
     trace_compiler(name({"compiler", "specialize"}), ds);
-    ds = apply(elim_dead_let, ds);
+    ds = pass("elim_dead_let", [&]() { return apply(elim_dead_let, ds); });
     trace_compiler(name({"compiler", "elim_dead_let"}), ds);
-    ds = apply(erase_irrelevant, new_env, ds);
+    ds = pass("erase_irrelevant", [&]() { return apply(erase_irrelevant, new_env, ds); });
     trace_compiler(name({"compiler", "erase_irrelevant"}), ds);
-    ds = apply(struct_cases_on, new_env, ds);
+    ds = pass("struct_cases_on", [&]() { return apply(struct_cases_on, new_env, ds); });
     trace_compiler(name({"compiler", "struct_cases_on"}), ds);
-    ds = apply(esimp, new_env, ds);
+    ds = pass("csimp", [&]() { return apply(esimp, new_env, ds); });
     trace_compiler(name({"compiler", "simp"}), ds);
-    ds = reduce_arity(new_env, ds);
+    ds = pass("reduce_arity", [&]() { return reduce_arity(new_env, ds); });
     trace_compiler(name({"compiler", "reduce_arity"}), ds);
-    std::tie(new_env, ds) = lambda_lifting(new_env, ds);
+    std::tie(new_env, ds) = pass("lambda_lifting", [&]() { return lambda_lifting(new_env, ds); });
     trace_compiler(name({"compiler", "lambda_lifting"}), ds);
     // trace(ds);
-    ds = apply(esimp, new_env, ds);
+    ds = pass("csimp", [&]() { return apply(esimp, new_env, ds); });
     trace_compiler(name({"compiler", "simp"}), ds);
     new_env = cache_stage2(new_env, ds);
     trace_compiler(name({"compiler", "stage2"}), ds);
     if (is_extract_closed_enabled(opts)) {
-        std::tie(new_env, ds) = extract_closed(new_env, ds);
-        ds = apply(elim_dead_let, ds);
-        ds = apply(esimp, new_env, ds);
+        std::tie(new_env, ds) = pass("extract_closed", [&]() { return extract_closed(new_env, ds); });
+        ds = pass("elim_dead_let", [&]() { return apply(elim_dead_let, ds); });
+        ds = pass("csimp", [&]() { return apply(esimp, new_env, ds); });
         trace_compiler(name({"compiler", "extract_closed"}), ds);
     }
     new_env = cache_new_stage2(new_env, ds);
-    ds = apply(esimp, new_env, ds);
+    ds = pass("csimp", [&]() { return apply(esimp, new_env, ds); });
     trace_compiler(name({"compiler", "simp"}), ds);
-    ds = apply(simp_app_args, new_env, ds);
-    ds = apply(ecse, new_env, ds);
-    ds = apply(elim_dead_let, ds);
+    ds = pass("simp_app_args", [&]() { return apply(simp_app_args, new_env, ds); });
+    ds = pass("ecse", [&]() { return apply(ecse, new_env, ds); });
+    ds = pass("elim_dead_let", [&]() { return apply(elim_dead_let, ds); });
     trace_compiler(name({"compiler", "simp_app_args"}), ds);
     // std::cout << trace_scope.get_string() << "\n";
     /* compile IR. */
-    return compile_ir(new_env, opts, ds);
+    return pass("ir", [&]() { return compile_ir(new_env, opts, ds); });
 }
 
 extern "C" LEAN_EXPORT object * lean_compile_decls(object * env, object * opts, object * decls) {
@@ -316,10 +404,12 @@ void initialize_compiler() {
     register_trace_class({"compiler", "ir", "elim_dead_branches"});
     register_trace_class({"compiler", "ir", "elim_dead"});
     register_trace_class({"compiler", "ir", "simp_case"});
+    register_trace_class({"compiler", "ir", "simp_app"});
     register_trace_class({"compiler", "ir", "borrow"});
     register_trace_class({"compiler", "ir", "boxing"});
     register_trace_class({"compiler", "ir", "rc"});
     register_trace_class({"compiler", "ir", "expand_reset_reuse"});
+    register_trace_class({"compiler", "ir", "simp_rc"});
     register_trace_class({"compiler", "ir", "result"});
 }
 
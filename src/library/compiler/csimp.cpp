@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <unordered_set>
 #include <unordered_map>
 #include "runtime/flet.h"
+#include "runtime/thread.h"
 #include "kernel/type_checker.h"
 #include "kernel/for_each_fn.h"
 #include "kernel/find_fn.h"
@@ -26,11 +27,17 @@ Author: Leonardo de Moura
 #include "library/compiler/csimp.h"
 #include "library/compiler/extract_closed.h"
 #include "library/compiler/reduce_arity.h"
+#include "library/compiler/specialize.h"
 #include "library/compiler/init_attribute.h"
 
+#ifndef LEAN_CSIMP_INLINE_CACHE_SIZE
+#define LEAN_CSIMP_INLINE_CACHE_SIZE 8192
+#endif
+
 namespace lean {
-csimp_cfg::csimp_cfg(options const &):
+csimp_cfg::csimp_cfg(options const & opts):
     csimp_cfg() {
+    m_specialize_budget               = get_specialize_budget(opts);
 }
 
 csimp_cfg::csimp_cfg() {
@@ -38,6 +45,7 @@ csimp_cfg::csimp_cfg() {
     m_inline_threshold                = 1;
     m_float_cases_threshold           = 20;
     m_inline_jp_threshold             = 2;
+    m_specialize_budget               = 0;
 }
 
 /*
@@ -62,6 +70,64 @@ optional<expr> fold_bin_op(bool before_erasure, expr const & f, expr const & a,
     return to_optional_expr(lean_fold_bin_op(before_erasure, f.raw(), a.raw(), b.raw()));
 }
 
+/* Information about the `_cstage1` or `_cstage2` declaration of a function that may be inlined. It only depends
+   on the declaration itself, so it is shared by all `csimp` invocations of a thread, instead of being recomputed
+   at every application of popular functions such as monadic binds. */
+struct inline_candidate {
+    /* The entry is valid for environments containing this object. Keeping a reference to it makes sure its address
+       is not reused by a different declaration. */
+    constant_info m_info;
+    unsigned      m_lcnf_size;
+    unsigned      m_arity;
+    bool          m_uses_unsafe_inductive;
+    /* The value of the declaration instantiated with `m_lvls`, the universe levels of the last instantiation. */
+    levels        m_lvls;
+    expr          m_value;
+};
+
+typedef std::unordered_map<name, inline_candidate, name_hash_fn> inline_candidate_cache;
+MK_THREAD_LOCAL_GET_DEF(inline_candidate_cache, get_inline_candidate_cache);
+
+static bool uses_unsafe_inductive(environment const & env, expr const & v) {
+    return static_cast<bool>(::lean::find(v, [&](expr const & e, unsigned) {
+                if (!is_constant(e) || !is_cases_on_recursor(env, const_name(e))) return false;
+                name const & I = const_name(e).get_prefix();
+                constant_info I_cinfo = env.get(I);
+                return I_cinfo.is_unsafe();
+            }));
+}
+
+/* Return the cache entry for the definition `c` in `env`, or `nullptr` if `env` does not contain a definition `c`.
+   The result is only valid until the next call. */
+static inline_candidate * get_inline_candidate(environment const & env, name const & c) {
+    optional<constant_info> info = env.find(c);
+    if (!info || !info->is_definition()) return nullptr;
+    inline_candidate_cache & cache = get_inline_candidate_cache();
+    auto it = cache.find(c);
+    if (it != cache.end() && it->second.m_info.raw() == info->raw())
+        return &it->second;
+    if (cache.size() >= LEAN_CSIMP_INLINE_CACHE_SIZE)
+        cache.clear();
+    expr const & v = info->get_value();
+    inline_candidate & r = cache[c];
+    r.m_info                  = *info;
+    r.m_lcnf_size             = get_lcnf_size(env, v);
+    r.m_arity                 = get_num_nested_lambdas(v);
+    r.m_uses_unsafe_inductive = uses_unsafe_inductive(env, v);
+    r.m_lvls                  = levels();
+    r.m_value                 = v;
+    return &r;
+}
+
+/* Cached version of `instantiate_value_lparams(c.m_info, ls)`. */
+static expr instantiate_inline_candidate(inline_candidate & c, levels const & ls) {
+    if (c.m_lvls != ls) {
+        c.m_value = instantiate_value_lparams(c.m_info, ls);
+        c.m_lvls  = ls;
+    }
+    return c.m_value;
+}
+
 class csimp_fn {
     typedef expr_pair_struct_map<expr> jp_cache;
     type_checker::state      m_st;
@@ -95,6 +161,8 @@ class csimp_fn {
        We use this information to reduce nested cases_on applications and projections. */
     typedef rb_expr_map<expr> expr2ctor;
     expr2ctor                m_expr2ctor;
+    /* Cache for `is_recursive`. */
+    std::unordered_map<name, bool, name_hash_fn> m_recursive;
 
     environment const & env() const { return m_st.env(); }
 
@@ -1298,10 +1366,10 @@ class csimp_fn {
             expr const & s_fn = get_app_fn(s);
             if (!is_constant(s_fn) || !should_inline_instance(const_name(s_fn)))
                 return none_expr();
-            optional<constant_info> info = env().find(mk_cstage1_name(const_name(s_fn)));
-            if (!info || !info->is_definition()) return none_expr();
-            if (get_app_num_args(s) < get_num_nested_lambdas(info->get_value())) return none_expr();
-            expr new_s_fn = instantiate_value_lparams(*info, const_levels(s_fn));
+            inline_candidate * info = get_inline_candidate(env(), mk_cstage1_name(const_name(s_fn)));
+            if (!info) return none_expr();
+            if (get_app_num_args(s) < info->m_arity) return none_expr();
+            expr new_s_fn = instantiate_inline_candidate(*info, const_levels(s_fn));
             expr r        = find(beta_reduce(new_s_fn, s, false));
             if (is_constructor_app(env(), r)) {
                 return some_expr(r);
@@ -1425,11 +1493,11 @@ class csimp_fn {
         if (!is_constant(s_fn)) return none_expr();
         if (has_init_attribute(env(), const_name(s_fn))) return none_expr();
         if (has_noinline_attribute(env(), const_name(s_fn))) return none_expr();
-        optional<constant_info> info = env().find(mk_cstage1_name(const_name(s_fn)));
-        if (!info || !info->is_definition()) return none_expr();
-        if (s_args.size()  < get_num_nested_lambdas(info->get_value())) return none_expr();
-        if (!inline_proj_app_candidate(info->get_value())) return none_expr();
-        expr s_val = instantiate_value_lparams(*info, const_levels(s_fn));
+        inline_candidate * info = get_inline_candidate(env(), mk_cstage1_name(const_name(s_fn)));
+        if (!info) return none_expr();
+        if (s_args.size()  < info->m_arity) return none_expr();
+        if (!inline_proj_app_candidate(info->m_info.get_value())) return none_expr();
+        expr s_val = instantiate_inline_candidate(*info, const_levels(s_fn));
         s_val = apply_beta(s_val, s_args.size(), s_args.data());
         buffer<expr> fvars;
         while (is_let(s_val)) {
@@ -1636,13 +1704,11 @@ class csimp_fn {
 
         optional<constant_info> is_inline_candidate(name const  & f) {
             name c = m_before_erasure ? mk_cstage1_name(f) : mk_cstage2_name(f);
-            optional<constant_info> info = m_env.find(c);
-            if (!info || !info->is_definition()) {
+            inline_candidate * info = get_inline_candidate(m_env, c);
+            if (!info) {
                 return optional<constant_info>();
-            } else if (has_inline_attribute(m_env, f)) {
-                return info;
-            } else if (get_lcnf_size(m_env, info->get_value()) <= m_cfg.m_inline_threshold) {
-                return info;
+            } else if (info->m_lcnf_size <= m_cfg.m_inline_threshold || has_inline_attribute(m_env, f)) {
+                return optional<constant_info>(info->m_info);
             } else {
                 return optional<constant_info>();
             }
@@ -1669,17 +1735,12 @@ class csimp_fn {
 
     /* We don't inline recursive functions. */
     bool is_recursive(name const & c) {
-        return is_recursive_fn(env(), m_cfg, m_before_erasure)(c);
-    }
-
-    bool uses_unsafe_inductive(name const & c) {
-        constant_info info = env().get(c);
-        return static_cast<bool>(::lean::find(info.get_value(), [&](expr const & e, unsigned) {
-                    if (!is_constant(e) || !is_cases_on_recursor(env(), const_name(e))) return false;
-                    name const & I = const_name(e).get_prefix();
-                    constant_info I_cinfo = env().get(I);
-                    return I_cinfo.is_unsafe();
-                }));
+        auto it = m_recursive.find(c);
+        if (it != m_recursive.end())
+            return it->second;
+        bool r = is_recursive_fn(env(), m_cfg, m_before_erasure)(c);
+        m_recursive.insert(mk_pair(c, r));
+        return r;
     }
 
     bool is_stuck_at_cases(expr e) {
@@ -1735,25 +1796,26 @@ class csimp_fn {
         if (m_before_erasure) {
             if (already_simplified(e)) return none_expr();
             name c = mk_cstage1_name(const_name(fn));
-            optional<constant_info> info = env().find(c);
-            if (!info || !info->is_definition()) return none_expr();
-            if (get_app_num_args(e) < get_num_nested_lambdas(info->get_value())) return none_expr();
+            inline_candidate * info = get_inline_candidate(env(), c);
+            if (!info) return none_expr();
+            if (get_app_num_args(e) < info->m_arity) return none_expr();
             bool inline_attr           = has_inline_attribute(env(), const_name(fn));
             bool inline_if_reduce_attr = has_inline_if_reduce_attribute(env(), const_name(fn));
             if (!inline_attr && !inline_if_reduce_attr &&
-                (get_lcnf_size(env(), info->get_value()) > m_cfg.m_inline_threshold ||
+                (info->m_lcnf_size > m_cfg.m_inline_threshold ||
                  is_constant(e))) { /* We only inline constants if they are marked with the `[inline]` or `[inline_if_reduce]` attrs */
                 return none_expr();
             }
-            if (!inline_if_reduce_attr && is_recursive(const_name(fn))) return none_expr();
             if (!is_matcher(env(), const_name(fn))) {
                 // Hack for test `inliner_loop`. We don't generate code for auxiliary matcher applications.
                 // However, they are safe to be inline even when they use unsafe inductive types.
                 // REMARK: the to be implemented `[strong_inline]` attribute should not be used in unsafe code.
-                if (uses_unsafe_inductive(c)) return none_expr();
+                if (info->m_uses_unsafe_inductive) return none_expr();
             }
+            expr new_fn = instantiate_inline_candidate(*info, const_levels(fn));
+            /* `is_recursive` uses the inline candidate cache, so `info` must not be used after it */
+            if (!inline_if_reduce_attr && is_recursive(const_name(fn))) return none_expr();
             lean_trace(name({"compiler", "inline"}), tout() << const_name(fn) << "\n";);
-            expr new_fn = instantiate_value_lparams(*info, const_levels(fn));
             if (inline_if_reduce_attr && !inline_attr) {
                 return beta_reduce_if_not_cases(new_fn, e, is_let_val);
             } else {
@@ -1763,14 +1825,15 @@ class csimp_fn {
             /* We should not inline closed constants we have extracted. */
             if (is_extract_closed_aux_fn(const_name(fn))) return none_expr();
             name c = mk_cstage2_name(const_name(fn));
-            optional<constant_info> info = env().find(c);
-            if (!info || !info->is_definition()) return none_expr();
-            unsigned arity = get_num_nested_lambdas(info->get_value());
+            inline_candidate * info = get_inline_candidate(env(), c);
+            if (!info) return none_expr();
+            unsigned arity = info->m_arity;
             if (get_app_num_args(e) < arity || arity == 0) return none_expr();
-            if (get_lcnf_size(env(), info->get_value()) > m_cfg.m_inline_threshold) return none_expr();
+            if (info->m_lcnf_size > m_cfg.m_inline_threshold) return none_expr();
+            if (info->m_uses_unsafe_inductive) return none_expr();
+            expr v = info->m_info.get_value();
             if (is_recursive(const_name(fn))) return none_expr();
-            if (uses_unsafe_inductive(c)) return none_expr();
-            return some_expr(beta_reduce(info->get_value(), e, is_let_val));
+            return some_expr(beta_reduce(v, e, is_let_val));
         }
     }
 
@@ -1790,10 +1853,10 @@ class csimp_fn {
         bool first = true;
         while (true) {
             name c = mk_cstage1_name(const_name(fn));
-            optional<constant_info> info = env().find(c);
-            if (!info || !info->is_definition())
+            inline_candidate * info = get_inline_candidate(env(), c);
+            if (!info)
                 return first ? visit(r, is_let_val) : r;
-            expr new_fn = instantiate_value_lparams(*info, const_levels(fn));
+            expr new_fn = instantiate_inline_candidate(*info, const_levels(fn));
             r = beta_reduce(new_fn, new_args.size(), new_args.data(), is_let_val);
             if (!is_app(r)) return r;
             fn = get_app_fn(r);
@@ -18,6 +18,9 @@ struct csimp_cfg {
     unsigned m_float_cases_threshold;
     /* We inline join-points that are smaller m_inline_threshold. */
     unsigned m_inline_jp_threshold;
+    /* The specializer stops creating new specializations for a declaration after the sum of their `get_lcnf_size`
+       exceeds `m_specialize_budget`. Existing specializations are still reused. There is no limit if it is 0. */
+    unsigned m_specialize_budget;
 public:
     csimp_cfg(options const & opts);
     csimp_cfg();
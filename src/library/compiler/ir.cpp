@@ -589,6 +589,24 @@ string_ref emit_c(environment const & env, name const & mod_name) {
     }
 }
 
+extern "C" object * lean_ir_emit_c_shards(object * env, object * mod_name, object * n, uint8 instrument,
+                                          object * profile);
+
+array_ref<string_ref> emit_c_shards(environment const & env, name const & mod_name, unsigned n,
+                                    bool instrument, std::string const & profile) {
+    object * r = lean_ir_emit_c_shards(env.to_obj_arg(), mod_name.to_obj_arg(), nat(n).to_obj_arg(), instrument,
+                                       string_ref(profile).to_obj_arg());
+    if (cnstr_tag(r) == 0) {
+        string_ref s(cnstr_get(r, 0), true);
+        dec_ref(r);
+        throw exception(s.to_std_string());
+    } else {
+        array_ref<string_ref> units(cnstr_get(r, 0), true);
+        dec_ref(r);
+        return units;
+    }
+}
+
 /*
 inductive CtorFieldInfo
 | irrelevant
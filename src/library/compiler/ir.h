@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <string>
+#include "runtime/array_ref.h"
 #include "kernel/environment.h"
 #include "library/compiler/util.h"
 namespace lean {
@@ -37,6 +38,11 @@ void test(decl const & d);
 environment compile(environment const & env, options const & opts, comp_decls const & decls);
 environment add_extern(environment const & env, name const & fn);
 string_ref emit_c(environment const & env, name const & mod_name);
+/* Like `emit_c`, but split the function definitions into `n` translation units, see `Lean.IR.emitCShards`.
+   If `instrument` is true, the emitted functions count their calls. `profile` is the contents of a call profile
+   written by instrumented code, or empty. */
+array_ref<string_ref> emit_c_shards(environment const & env, name const & mod_name, unsigned n,
+                                    bool instrument = false, std::string const & profile = std::string());
 void emit_llvm(environment const & env, name const & mod_name, std::string const &filepath);
 }
 void initialize_ir();
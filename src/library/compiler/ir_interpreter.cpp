@@ -26,7 +26,12 @@ functions, which have a (relatively) homogeneous ABI that we can use without run
 `call/lookup_symbol` below.
 
 */
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #ifdef LEAN_WINDOWS
 #include <windows.h>
@@ -40,17 +45,30 @@ functions, which have a (relatively) homogeneous ABI that we can use without run
 #include "runtime/io.h"
 #include "runtime/option_ref.h"
 #include "runtime/array_ref.h"
+#include "runtime/thread.h"
+#include "runtime/cache_registry.h"
 #include "kernel/trace.h"
 #include "library/time_task.h"
 #include "library/compiler/ir.h"
 #include "library/compiler/init_attribute.h"
 #include "util/nat.h"
+#include "util/name_hash_map.h"
 #include "util/option_declarations.h"
 
 #ifndef LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE
 #define LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE true
 #endif
 
+// Native functions taking at most this many arguments are called using their unboxed signature, see `call_unboxed`.
+// This relies on every non-floating-point argument being passed in a 64-bit integer register or stack slot.
+#if !defined(LEAN_INTERPRETER_MAX_UNBOXED_ARGS)
+#if (defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) || defined(_M_ARM64)) && !defined(__EMSCRIPTEN__)
+#define LEAN_INTERPRETER_MAX_UNBOXED_ARGS 6
+#else
+#define LEAN_INTERPRETER_MAX_UNBOXED_ARGS 0
+#endif
+#endif
+
 namespace lean {
 namespace ir {
 // C++ wrappers of Lean data types
@@ -206,10 +224,92 @@ std::string format_fn_body_head(fn_body const & b) {
     return string_to_std(lean_ir_format_fn_body_head(b.to_obj_arg()));
 }
 
+/** \brief Return the largest index of a variable declared in `b` or in the parameters `ps`, i.e., the number of
+    variable slots needed to execute `b` (variables are 1-indexed). */
+static size_t get_frame_size(array_ref<param> const & ps, fn_body const & b);
+
+static size_t get_frame_size(fn_body const & b0) {
+    size_t r = 0;
+    fn_body const * b = &b0;
+    while (true) {
+        switch (fn_body_tag(*b)) {
+        case fn_body_kind::VDecl:
+            r = std::max<size_t>(r, fn_body_vdecl_var(*b).get_small_value());
+            b = &fn_body_vdecl_cont(*b);
+            break;
+        case fn_body_kind::JDecl:
+            r = std::max(r, get_frame_size(fn_body_jdecl_params(*b), fn_body_jdecl_body(*b)));
+            b = &fn_body_jdecl_cont(*b);
+            break;
+        case fn_body_kind::Set:    b = &fn_body_set_cont(*b); break;
+        case fn_body_kind::SetTag: b = &fn_body_set_tag_cont(*b); break;
+        case fn_body_kind::USet:   b = &fn_body_uset_cont(*b); break;
+        case fn_body_kind::SSet:   b = &fn_body_sset_cont(*b); break;
+        case fn_body_kind::Inc:    b = &fn_body_inc_cont(*b); break;
+        case fn_body_kind::Dec:    b = &fn_body_dec_cont(*b); break;
+        case fn_body_kind::Del:    b = &fn_body_del_cont(*b); break;
+        case fn_body_kind::MData:  b = &fn_body_mdata_cont(*b); break;
+        case fn_body_kind::Case:
+            for (alt_core const & a : fn_body_case_alts(*b)) {
+                fn_body const & cont = alt_core_tag(a) == alt_core_kind::Ctor ? alt_core_ctor_cont(a) : alt_core_default_cont(a);
+                r = std::max(r, get_frame_size(cont));
+            }
+            return r;
+        case fn_body_kind::Ret: case fn_body_kind::Jmp: case fn_body_kind::Unreachable:
+            return r;
+        }
+    }
+}
+
+static size_t get_frame_size(array_ref<param> const & ps, fn_body const & b) {
+    size_t r = get_frame_size(b);
+    for (param const & p : ps)
+        r = std::max<size_t>(r, param_var(p).get_small_value());
+    return r;
+}
+
 static bool type_is_scalar(type t) {
     return t != type::Object && t != type::TObject && t != type::Irrelevant;
 }
 
+/** \brief Return true if a native implementation of `d` can be called with `call_unboxed`. */
+static bool can_call_unboxed(decl const & d) {
+    array_ref<param> const & ps = decl_params(d);
+    if (ps.size() == 0 || ps.size() > LEAN_INTERPRETER_MAX_UNBOXED_ARGS || decl_type(d) == type::Float)
+        return false;
+    for (param const & p : ps) {
+        if (param_type(p) == type::Float)
+            return false;
+    }
+    return true;
+}
+
+/** \brief Call native function `f` with the arguments `as`, where each argument is either an object pointer or an
+    integer zero-extended to 64 bits. Only the low bits of the result that belong to its actual type are meaningful.
+    \pre 0 < n <= LEAN_INTERPRETER_MAX_UNBOXED_ARGS */
+static uint64 call_unboxed(void * f, unsigned n, uint64 const * as) {
+    typedef uint64 u;
+    switch (n) {
+    case 1: return reinterpret_cast<u(*)(u)>(f)(as[0]);
+    case 2: return reinterpret_cast<u(*)(u, u)>(f)(as[0], as[1]);
+    case 3: return reinterpret_cast<u(*)(u, u, u)>(f)(as[0], as[1], as[2]);
+    case 4: return reinterpret_cast<u(*)(u, u, u, u)>(f)(as[0], as[1], as[2], as[3]);
+    case 5: return reinterpret_cast<u(*)(u, u, u, u, u)>(f)(as[0], as[1], as[2], as[3], as[4]);
+    case 6: return reinterpret_cast<u(*)(u, u, u, u, u, u)>(f)(as[0], as[1], as[2], as[3], as[4], as[5]);
+    }
+    lean_unreachable();
+}
+
+/** \brief Convert the result of `call_unboxed` to a value of type `t`. */
+static uint64 truncate_unboxed(uint64 r, type t) {
+    switch (t) {
+    case type::UInt8:  return static_cast<uint8>(r);
+    case type::UInt16: return static_cast<uint16>(r);
+    case type::UInt32: return static_cast<uint32>(r);
+    default:           return r;
+    }
+}
+
 extern "C" object* lean_get_regular_init_fn_name_for(object* env, object* fn);
 optional<name> get_regular_init_fn_name_for(environment const & env, name const & n) {
     return to_optional<name>(lean_get_regular_init_fn_name_for(env.to_obj_arg(), n.to_obj_arg()));
@@ -319,6 +419,71 @@ void * lookup_symbol_in_cur_exe(char const * sym) {
 #endif
 }
 
+// With GCC and Clang, `eval_body` is direct-threaded: each instruction jumps to the code of the next one through a
+// table of label addresses, so that the indirect branches at the end of the instructions are predicted separately.
+// Otherwise, or if `LEAN_INTERPRETER_NO_COMPUTED_GOTO` is defined, a `switch` in a loop is used.
+#if defined(__GNUC__) && !defined(LEAN_INTERPRETER_NO_COMPUTED_GOTO)
+#define LEAN_INTERPRETER_COMPUTED_GOTO
+#endif
+
+#ifndef LEAN_INTERPRETER_SHARED_CACHES
+#define LEAN_INTERPRETER_SHARED_CACHES 8
+#endif
+
+// estimated size in bytes of a cached symbol or constant, see `shared_caches_size`
+#ifndef LEAN_INTERPRETER_CACHE_ENTRY_SIZE
+#define LEAN_INTERPRETER_CACHE_ENTRY_SIZE 256
+#endif
+
+#ifndef LEAN_INTERPRETER_PROFILE_INTERVAL_US
+#define LEAN_INTERPRETER_PROFILE_INTERVAL_US 1000
+#endif
+
+/* Sampling profiler for interpreted code, enabled by setting the environment variable `LEAN_INTERPRETER_PROFILE` to
+   the name of an output file. A ticker thread increments `m_tick` every `LEAN_INTERPRETER_PROFILE_INTERVAL_US`
+   microseconds, and interpreters check it when entering a function body, tail-calling, or jumping to a join point.
+   On a new tick, the names in the current call stack are recorded as a sample. We use a ticker thread instead of a
+   timer signal because a signal handler cannot safely read the call stack of the interrupted interpreter. Time spent
+   in native code is attributed to the stack observed when control returns to the interpreter.
+
+   When the interpreter is finalized, the samples are written in the folded-stack format expected by flame graph
+   tools, i.e., one `f_1;...;f_n count` line per distinct stack, outermost function first. */
+#if defined(LEAN_MULTI_THREAD)
+class interpreter_profiler {
+    std::string                             m_file;
+    atomic<bool>                            m_done{false};
+    mutex                                   m_mutex;
+    std::unordered_map<std::string, uint64> m_samples;
+    std::unique_ptr<lthread>                m_ticker;
+public:
+    atomic<unsigned>                        m_tick{0};
+
+    explicit interpreter_profiler(std::string const & file):m_file(file) {
+        m_ticker.reset(new lthread([this]() {
+            while (!m_done.load(memory_order_relaxed)) {
+                this_thread::sleep_for(std::chrono::microseconds(LEAN_INTERPRETER_PROFILE_INTERVAL_US));
+                atomic_fetch_add_explicit(&m_tick, 1u, memory_order_relaxed);
+            }
+        }));
+    }
+
+    void add_sample(std::string const & stack) {
+        lock_guard<mutex> lock(m_mutex);
+        m_samples[stack]++;
+    }
+
+    ~interpreter_profiler() {
+        m_done = true;
+        m_ticker->join();
+        std::ofstream out(m_file);
+        for (auto const & s : m_samples)
+            out << s.first << " " << s.second << "\n";
+    }
+};
+
+static interpreter_profiler * g_profiler = nullptr;
+#endif
+
 class interpreter;
 LEAN_THREAD_PTR(interpreter, g_interpreter);
 
@@ -332,8 +497,11 @@ class interpreter {
         // base pointers into the stack above
         size_t m_arg_bp;
         size_t m_jp_bp;
+        // number of variable slots reserved for the frame
+        size_t m_size;
 
-        frame(name const & mFn, size_t mArgBp, size_t mJpBp) : m_fn(mFn), m_arg_bp(mArgBp), m_jp_bp(mJpBp) {}
+        frame(name const & mFn, size_t mArgBp, size_t mJpBp, size_t mSize) :
+            m_fn(mFn), m_arg_bp(mArgBp), m_jp_bp(mJpBp), m_size(mSize) {}
     };
     std::vector<frame> m_call_stack;
     environment const & m_env;
@@ -345,16 +513,55 @@ class interpreter {
       value m_val;
     };
     // caches values of nullary functions ("constants")
-    name_map<constant_cache_entry> m_constant_cache;
+    name_hash_map<constant_cache_entry> m_constant_cache;
     struct symbol_cache_entry {
         decl m_decl;
         // symbol address; `nullptr` if function does not have native code
         void * m_addr;
         // true iff we chose the boxed version of a function where the IR uses the unboxed version
         bool m_boxed;
+        // number of variable slots needed to interpret `m_decl`, see `get_frame_size`
+        size_t m_frame_size;
+        // address of the unboxed version of the function, to be called by `call` using `call_unboxed`; `nullptr` if
+        // the function does not have native code or cannot be called in this way
+        void * m_unboxed_addr;
+    };
+    // caches symbol lookup successes _and_ failures; entries are never removed, so references to them stay valid
+    name_hash_map<symbol_cache_entry> m_symbol_cache;
+    // direct-mapped inline cache from IR call sites (`FAp`/`PAp` expressions) to `m_symbol_cache` entries, so that
+    // calls in interpreted loops do not hash the callee name; the sites are kept alive so that their addresses are
+    // not reused by other expressions
+    struct call_site_cache_entry {
+        expr m_site;
+        symbol_cache_entry const * m_sym = nullptr;
     };
-    // caches symbol lookup successes _and_ failures
-    name_map<symbol_cache_entry> m_symbol_cache;
+    static constexpr size_t call_site_cache_size = 1024;
+    std::vector<call_site_cache_entry> m_call_site_cache;
+public:
+    // symbol lookups and evaluated constants shared by the interpreters for the same environment, which may run in
+    // different threads; see `get_shared_cache`
+    struct shared_cache {
+        environment m_env;
+        bool m_prefer_native;
+        mutex m_mutex;
+        name_hash_map<symbol_cache_entry> m_symbol_cache;
+        name_hash_map<constant_cache_entry> m_constant_cache;
+
+        shared_cache(environment const & env, bool prefer_native) : m_env(env), m_prefer_native(prefer_native) {}
+        ~shared_cache() {
+            for (auto const & p : m_constant_cache) {
+                if (!p.second.m_is_scalar) {
+                    dec(p.second.m_val.m_obj);
+                }
+            }
+        }
+    };
+private:
+    // `nullptr` if the environment is only used by the current thread; the local caches above are consulted first, so
+    // the shared cache is only locked the first time an interpreter needs a symbol or constant
+    std::shared_ptr<shared_cache> m_shared;
+    // last profiler tick observed by `check_profile_sample`
+    unsigned m_profile_tick = 0;
 
     /** \brief Get current stack frame */
     inline frame & get_frame() {
@@ -365,10 +572,8 @@ class interpreter {
     inline value & var(var_id const & v) {
         // variables are 1-indexed
         size_t i = get_frame().m_arg_bp + v.get_small_value() - 1;
-        // we don't know the frame size (unless we do an additional IR pass), so we extend it dynamically
-        if (i >= m_arg_stack.size()) {
-            m_arg_stack.resize(i + 1);
-        }
+        // the slots of all variables of the function are reserved by `push_frame`
+        lean_assert(i < get_frame().m_arg_bp + get_frame().m_size);
         return m_arg_stack[i];
     }
 
@@ -485,14 +690,14 @@ private:
             }
             case expr_kind::FAp: { // satured ("full") application of top-level function
                 if (expr_fap_args(e).size()) {
-                    return call(expr_fap_fun(e), expr_fap_args(e));
+                    return call(lookup_call_site(e, expr_fap_fun(e)), expr_fap_fun(e), expr_fap_args(e));
                 } else {
                     // nullary function ("constant")
                     return load(expr_fap_fun(e), t);
                 }
             }
             case expr_kind::PAp: { // unsatured (partial) application of top-level function
-                symbol_cache_entry sym = lookup_symbol(expr_pap_fun(e));
+                symbol_cache_entry const & sym = lookup_call_site(e, expr_pap_fun(e));
                 if (sym.m_addr) {
                     // point closure directly at native symbol
                     object * cls = alloc_closure(sym.m_addr, decl_params(sym.m_decl).size(), expr_pap_args(e).size());
@@ -571,16 +776,62 @@ private:
         }
     }
 
+#if defined(LEAN_MULTI_THREAD)
+    void record_profile_sample() {
+        std::string stack;
+        for (frame const & f : m_call_stack) {
+            if (!stack.empty())
+                stack += ';';
+            stack += f.m_fn.to_string();
+        }
+        g_profiler->add_sample(stack);
+    }
+#endif
+
+    /** \brief Record a sample of the call stack if the profiler is enabled and has ticked since the last sample. */
+    inline void check_profile_sample() {
+#if defined(LEAN_MULTI_THREAD)
+        if (LEAN_UNLIKELY(g_profiler != nullptr)) {
+            unsigned tick = g_profiler->m_tick.load(memory_order_relaxed);
+            if (tick != m_profile_tick) {
+                m_profile_tick = tick;
+                record_profile_sample();
+            }
+        }
+#endif
+    }
+
+    void trace_step(fn_body const & DEBUG_CODE(b)) {
+        DEBUG_CODE(lean_trace(name({"interpreter", "step"}),
+                              tout() << std::string(m_call_stack.size(), ' ') << format_fn_body_head(b) << "\n";);)
+    }
+
     value eval_body(fn_body const & b0) {
         check_system();
+        check_profile_sample();
 
         // make reference reassignable...
         std::reference_wrapper<fn_body const> b(b0);
+#ifdef LEAN_INTERPRETER_COMPUTED_GOTO
+        // indexed by `fn_body_kind`
+        static void * const dispatch_table[] = {
+            &&lbl_VDecl, &&lbl_JDecl, &&lbl_Set, &&lbl_SetTag, &&lbl_USet, &&lbl_SSet, &&lbl_Inc, &&lbl_Dec, &&lbl_Del,
+            &&lbl_MData, &&lbl_Case, &&lbl_Ret, &&lbl_Jmp, &&lbl_Unreachable };
+        static_assert(sizeof(dispatch_table) / sizeof(void *) == static_cast<size_t>(fn_body_kind::Unreachable) + 1,
+                      "dispatch table must cover all instruction kinds");
+#define LEAN_IR_CASE(k) lbl_##k
+#define LEAN_IR_NEXT() do { trace_step(b); goto *dispatch_table[static_cast<size_t>(fn_body_tag(b))]; } while (0)
+        LEAN_IR_NEXT();
+        {
+            {
+#else
+#define LEAN_IR_CASE(k) case fn_body_kind::k
+#define LEAN_IR_NEXT() break
         while (true) {
-            DEBUG_CODE(lean_trace(name({"interpreter", "step"}),
-                                  tout() << std::string(m_call_stack.size(), ' ') << format_fn_body_head(b) << "\n";);)
+            trace_step(b);
             switch (fn_body_tag(b)) {
-                case fn_body_kind::VDecl: { // variable declaration
+#endif
+                LEAN_IR_CASE(VDecl): { // variable declaration
                     expr const & e = fn_body_vdecl_expr(b);
                     fn_body const & cont = fn_body_vdecl_cont(b);
                     // tail recursion?
@@ -598,12 +849,16 @@ private:
                         for (size_t i = 0; i < args.size(); i++) {
                             m_arg_stack[get_frame().m_arg_bp + i] = m_arg_stack[old_size + i];
                         }
-                        m_arg_stack.resize(get_frame().m_arg_bp + args.size());
+                        m_arg_stack.resize(get_frame().m_arg_bp + get_frame().m_size);
                         b = b0;
                         check_system();
-                        break;
+                        check_profile_sample();
+                        LEAN_IR_NEXT();
                     }
-                    value v = eval_expr(fn_body_vdecl_expr(b), fn_body_vdecl_type(b));
+                    // field accesses are the most frequent expressions, so avoid the dispatch in `eval_expr` for them
+                    value v = expr_tag(e) == expr_kind::Proj
+                        ? value(cnstr_get(var(expr_proj_obj(e)).m_obj, expr_proj_idx(e).get_small_value()))
+                        : eval_expr(e, fn_body_vdecl_type(b));
                     // NOTE: `var` must be called *after* `eval_expr` because the stack may get resized and invalidate
                     // the pointer
                     var(fn_body_vdecl_var(b)) = v;
@@ -612,40 +867,47 @@ private:
                                           tout() << fn_body_vdecl_var(b).get_small_value() << " = ";
                                           print_value(tout(), var(fn_body_vdecl_var(b)), fn_body_vdecl_type(b));
                                           tout() << "\n";);)
-                    b = fn_body_vdecl_cont(b);
-                    break;
+                    // superinstruction: `let x := ...; inc x; ...`, e.g. when reading a field that is kept alive, is
+                    // executed without dispatching on the `inc`
+                    if (fn_body_tag(cont) == fn_body_kind::Inc && fn_body_inc_var(cont) == fn_body_vdecl_var(b)) {
+                        inc(v.m_obj, fn_body_inc_val(cont).get_small_value());
+                        b = fn_body_inc_cont(cont);
+                    } else {
+                        b = cont;
+                    }
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::JDecl: { // join-point declaration; store in stack slot just like variables
+                LEAN_IR_CASE(JDecl): { // join-point declaration; store in stack slot just like variables
                     size_t i = get_frame().m_jp_bp + fn_body_jdecl_id(b).get_small_value();
                     if (i >= m_jp_stack.size()) {
                         m_jp_stack.resize(i + 1);
                     }
                     m_jp_stack[i] = &b.get();
                     b = fn_body_jdecl_cont(b);
-                    break;
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::Set: { // set boxed field of unique reference
+                LEAN_IR_CASE(Set): { // set boxed field of unique reference
                     object * o = var(fn_body_set_var(b)).m_obj;
                     lean_assert(is_exclusive(o));
                     cnstr_set(o, fn_body_set_idx(b).get_small_value(), eval_arg(fn_body_set_arg(b)).m_obj);
                     b = fn_body_set_cont(b);
-                    break;
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::SetTag: { // set constructor tag of unique reference
+                LEAN_IR_CASE(SetTag): { // set constructor tag of unique reference
                     object * o = var(fn_body_set_tag_var(b)).m_obj;
                     lean_assert(is_exclusive(o));
                     cnstr_set_tag(o, fn_body_set_tag_cidx(b).get_small_value());
                     b = fn_body_set_tag_cont(b);
-                    break;
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::USet: { // set USize field of unique reference
+                LEAN_IR_CASE(USet): { // set USize field of unique reference
                     object * o = var(fn_body_uset_target(b)).m_obj;
                     lean_assert(is_exclusive(o));
                     cnstr_set_usize(o, fn_body_uset_idx(b).get_small_value(), var(fn_body_uset_source(b)).m_num);
                     b = fn_body_uset_cont(b);
-                    break;
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::SSet: { // set other unboxed field of unique reference
+                LEAN_IR_CASE(SSet): { // set other unboxed field of unique reference
                     object * o = var(fn_body_sset_target(b)).m_obj;
                     size_t offset = fn_body_sset_idx(b).get_small_value() * sizeof(void *) +
                                     fn_body_sset_offset(b).get_small_value();
@@ -664,28 +926,34 @@ private:
                             throw exception(sstream() << "invalid instruction");
                     }
                     b = fn_body_sset_cont(b);
-                    break;
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::Inc: // increment reference counter
+                LEAN_IR_CASE(Inc): // increment reference counter
                     inc(var(fn_body_inc_var(b)).m_obj, fn_body_inc_val(b).get_small_value());
                     b = fn_body_inc_cont(b);
-                    break;
-                case fn_body_kind::Dec: { // decrement reference counter
-                    size_t n = fn_body_dec_val(b).get_small_value();
-                    for (size_t i = 0; i < n; i++) {
-                        dec(var(fn_body_dec_var(b)).m_obj);
-                    }
-                    b = fn_body_dec_cont(b);
-                    break;
+                    LEAN_IR_NEXT();
+                LEAN_IR_CASE(Dec): { // decrement reference counter
+                    // superinstruction: a sequence of `dec`s, usually followed by `ret` at the end of a function, is
+                    // executed without dispatching on each instruction
+                    do {
+                        size_t n = fn_body_dec_val(b).get_small_value();
+                        for (size_t i = 0; i < n; i++) {
+                            dec(var(fn_body_dec_var(b)).m_obj);
+                        }
+                        b = fn_body_dec_cont(b);
+                    } while (fn_body_tag(b) == fn_body_kind::Dec);
+                    if (fn_body_tag(b) == fn_body_kind::Ret)
+                        return eval_arg(fn_body_ret_arg(b));
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::Del: // delete object of unique reference
+                LEAN_IR_CASE(Del): // delete object of unique reference
                     lean_free_object(var(fn_body_del_var(b)).m_obj);
                     b = fn_body_del_cont(b);
-                    break;
-                case fn_body_kind::MData: // metadata; no-op
+                    LEAN_IR_NEXT();
+                LEAN_IR_CASE(MData): // metadata; no-op
                     b = fn_body_mdata_cont(b);
-                    break;
-                case fn_body_kind::Case: { // branch according to constructor tag
+                    LEAN_IR_NEXT();
+                LEAN_IR_CASE(Case): { // branch according to constructor tag
                     array_ref<alt_core> const & alts = fn_body_case_alts(b);
                     unsigned tag;
                     value v = var(fn_body_case_var(b));
@@ -708,27 +976,32 @@ private:
                         }
                     }
                     throw exception("incomplete case");
-                    done: break;
+                    done: LEAN_IR_NEXT();
                 }
-                case fn_body_kind::Ret:
+                LEAN_IR_CASE(Ret):
                     return eval_arg(fn_body_ret_arg(b));
-                case fn_body_kind::Jmp: { // jump to join-point
+                LEAN_IR_CASE(Jmp): { // jump to join-point
                     fn_body const & jp = *m_jp_stack[get_frame().m_jp_bp + fn_body_jmp_jp(b).get_small_value()];
                     lean_assert(fn_body_jdecl_params(jp).size() == fn_body_jmp_args(b).size());
                     for (size_t i = 0; i < fn_body_jdecl_params(jp).size(); i++) {
                         var(param_var(fn_body_jdecl_params(jp)[i])) = eval_arg(fn_body_jmp_args(b)[i]);
                     }
                     b = fn_body_jdecl_body(jp);
-                    break;
+                    check_profile_sample();
+                    LEAN_IR_NEXT();
                 }
-                case fn_body_kind::Unreachable:
+                LEAN_IR_CASE(Unreachable):
                     throw exception("unreachable code");
             }
         }
+#undef LEAN_IR_CASE
+#undef LEAN_IR_NEXT
     }
 
+
     // specify argument base pointer explicitly because we've usually already pushed some function arguments
-    void push_frame(decl const & d, size_t arg_bp) {
+    // `frame_size` variable slots are reserved if the body of `d` is going to be interpreted, and 0 otherwise
+    void push_frame(decl const & d, size_t arg_bp, size_t frame_size) {
         DEBUG_CODE({
             lean_trace(name({"interpreter", "call"}),
                        tout() << std::string(m_call_stack.size(), ' ')
@@ -738,7 +1011,9 @@ private:
                        }
                        tout() << "\n";);
         });
-        m_call_stack.emplace_back(decl_fun_id(d), arg_bp, m_jp_stack.size());
+        m_call_stack.emplace_back(decl_fun_id(d), arg_bp, m_jp_stack.size(), frame_size);
+        if (m_arg_stack.size() < arg_bp + frame_size)
+            m_arg_stack.resize(arg_bp + frame_size);
     }
 
     void pop_frame(value DEBUG_CODE(r), type DEBUG_CODE(t)) {
@@ -755,11 +1030,20 @@ private:
     }
 
     /** \brief Return cached lookup result for given unmangled function name in the current binary. */
-    symbol_cache_entry lookup_symbol(name const & fn) {
-        if (symbol_cache_entry const * e = m_symbol_cache.find(fn)) {
-            return *e;
+    symbol_cache_entry const & lookup_symbol(name const & fn) {
+        auto it = m_symbol_cache.find(fn);
+        if (it != m_symbol_cache.end()) {
+            return it->second;
         } else {
-            symbol_cache_entry e_new { get_decl(fn), nullptr, false };
+            if (m_shared) {
+                lock_guard<mutex> lock(m_shared->m_mutex);
+                auto shared_it = m_shared->m_symbol_cache.find(fn);
+                if (shared_it != m_shared->m_symbol_cache.end())
+                    return m_symbol_cache.emplace(fn, shared_it->second).first->second;
+            }
+            symbol_cache_entry e_new { get_decl(fn), nullptr, false, 0, nullptr };
+            if (decl_tag(e_new.m_decl) == decl_kind::Fun)
+                e_new.m_frame_size = ::lean::ir::get_frame_size(decl_params(e_new.m_decl), decl_fun_body(e_new.m_decl));
             if (m_prefer_native || decl_tag(e_new.m_decl) == decl_kind::Extern || has_init_attribute(m_env, fn)) {
                 string_ref mangled = name_mangle(fn, *g_mangle_prefix);
                 string_ref boxed_mangled(string_append(mangled.to_obj_arg(), g_boxed_mangled_suffix->raw()));
@@ -771,10 +1055,36 @@ private:
                     // if there is no boxed version, there are no unboxed parameters, so use default version
                     e_new.m_addr = p;
                 }
+                if (e_new.m_addr && can_call_unboxed(e_new.m_decl)) {
+                    // direct calls can then use the IR signature, avoiding boxing of scalar arguments and results
+                    e_new.m_unboxed_addr = e_new.m_boxed ? lookup_symbol_in_cur_exe(mangled.data()) : e_new.m_addr;
+                }
+            }
+            if (m_shared) {
+                // `fn` may be owned by the current thread, so use the name from the environment instead
+                lock_guard<mutex> lock(m_shared->m_mutex);
+                m_shared->m_symbol_cache.emplace(decl_fun_id(e_new.m_decl), e_new);
             }
-            m_symbol_cache.insert(fn, e_new);
-            return e_new;
+            return m_symbol_cache.emplace(fn, e_new).first->second;
+        }
+    }
+
+    /** \brief Return `lookup_symbol(fn)`, where `fn` is the function called by the IR expression `site`. */
+    symbol_cache_entry const & lookup_call_site(expr const & site, name const & fn) {
+        call_site_cache_entry & c = m_call_site_cache[(reinterpret_cast<uintptr_t>(site.raw()) >> 4) % call_site_cache_size];
+        if (c.m_site.raw() != site.raw()) {
+            c.m_sym  = &lookup_symbol(fn);
+            c.m_site = site;
         }
+        return *c.m_sym;
+    }
+
+    /** \brief Return the frame size of `d`, which may come from a closure created in a different environment. */
+    size_t get_frame_size(decl const & d) {
+        auto it = m_symbol_cache.find(decl_fun_id(d));
+        if (it != m_symbol_cache.end() && it->second.m_decl.raw() == d.raw())
+            return it->second.m_frame_size;
+        return ::lean::ir::get_frame_size(decl_params(d), decl_fun_body(d));
     }
 
     /** \brief Retrieve Lean declaration from environment. */
@@ -788,7 +1098,9 @@ private:
 
     /** \brief Evaluate nullary function ("constant"). */
     value load(name const & fn, type t) {
-        if (constant_cache_entry const * cached = m_constant_cache.find(fn)) {
+        auto cached_it = m_constant_cache.find(fn);
+        if (cached_it != m_constant_cache.end()) {
+            constant_cache_entry const * cached = &cached_it->second;
             if (!cached->m_is_scalar) {
                 inc(cached->m_val.m_obj);
             }
@@ -798,8 +1110,21 @@ private:
             // persistent, so no `inc` needed
             return *o;
         }
+        if (m_shared) {
+            lock_guard<mutex> lock(m_shared->m_mutex);
+            auto shared_it = m_shared->m_constant_cache.find(fn);
+            if (shared_it != m_shared->m_constant_cache.end()) {
+                constant_cache_entry const & cached = shared_it->second;
+                if (!cached.m_is_scalar) {
+                    // one reference for the local cache and one for the result
+                    inc(cached.m_val.m_obj, 2);
+                }
+                m_constant_cache.emplace(fn, cached);
+                return cached.m_val;
+            }
+        }
 
-        symbol_cache_entry e = lookup_symbol(fn);
+        symbol_cache_entry const & e = lookup_symbol(fn);
         if (e.m_addr) {
             // we can assume that all native code has been initialized (see e.g. `evalConst`)
 
@@ -823,21 +1148,46 @@ private:
             // We don't know whether `[init]` decls can be re-executed, so let's not.
             throw exception(sstream() << "cannot evaluate `[init]` declaration '" << fn << "' in the same module");
         }
-        push_frame(e.m_decl, m_arg_stack.size());
+        push_frame(e.m_decl, m_arg_stack.size(), e.m_frame_size);
         value r = eval_body(decl_fun_body(e.m_decl));
         pop_frame(r, decl_type(e.m_decl));
         if (!type_is_scalar(t)) {
             inc(r.m_obj);
         }
-        m_constant_cache.insert(fn, constant_cache_entry { type_is_scalar(t), r });
+        m_constant_cache.emplace(fn, constant_cache_entry { type_is_scalar(t), r });
+        if (m_shared) {
+            if (!type_is_scalar(t)) {
+                // the value may now be used by other threads
+                mark_mt(r.m_obj);
+                inc(r.m_obj);
+            }
+            lock_guard<mutex> lock(m_shared->m_mutex);
+            if (!m_shared->m_constant_cache.emplace(decl_fun_id(e.m_decl), constant_cache_entry { type_is_scalar(t), r }).second &&
+                !type_is_scalar(t)) {
+                dec(r.m_obj);
+            }
+        }
         return r;
     }
 
-    value call(name const & fn, array_ref<arg> const & args) {
+    value call(symbol_cache_entry const & e, name const & fn, array_ref<arg> const & args) {
         size_t old_size = m_arg_stack.size();
         value r;
-        symbol_cache_entry e = lookup_symbol(fn);
-        if (e.m_addr) {
+        if (e.m_unboxed_addr) {
+            // the native function has the IR signature, so arguments are passed as in compiled code
+            uint64 * args2 = static_cast<uint64 *>(LEAN_ALLOCA(args.size() * sizeof(uint64))); // NOLINT
+            for (size_t i = 0; i < args.size(); i++) {
+                value v  = eval_arg(args[i]);
+                args2[i] = type_is_scalar(param_type(decl_params(e.m_decl)[i])) ? v.m_num : reinterpret_cast<uint64>(v.m_obj);
+            }
+            push_frame(e.m_decl, old_size, 0);
+            uint64 o = call_unboxed(e.m_unboxed_addr, args.size(), args2);
+            type t   = decl_type(e.m_decl);
+            if (type_is_scalar(t))
+                r = truncate_unboxed(o, t);
+            else
+                r = reinterpret_cast<object *>(o);
+        } else if (e.m_addr) {
             object ** args2 = static_cast<object **>(LEAN_ALLOCA(args.size() * sizeof(object *))); // NOLINT
             for (size_t i = 0; i < args.size(); i++) {
                 type t = param_type(decl_params(e.m_decl)[i]);
@@ -850,7 +1200,7 @@ private:
                     inc(args2[i]);
                 }
             }
-            push_frame(e.m_decl, old_size);
+            push_frame(e.m_decl, old_size, 0);
             object * o = curry(e.m_addr, args.size(), args2);
             type t = decl_type(e.m_decl);
             if (type_is_scalar(t)) {
@@ -874,7 +1224,7 @@ private:
             for (const auto & arg : args) {
                 m_arg_stack.push_back(eval_arg(arg));
             }
-            push_frame(e.m_decl, old_size);
+            push_frame(e.m_decl, old_size, e.m_frame_size);
             r = eval_body(decl_fun_body(e.m_decl));
         }
         pop_frame(r, decl_type(e.m_decl));
@@ -888,7 +1238,7 @@ private:
         for (size_t i = 0; i < decl_params(d).size(); i++) {
             m_arg_stack.push_back(args[3 + i]);
         }
-        push_frame(d, old_size);
+        push_frame(d, old_size, get_frame_size(d));
         object * r = eval_body(decl_fun_body(d)).m_obj;
         pop_frame(r, type::TObject);
         return r;
@@ -944,18 +1294,22 @@ private:
         }
     }
 public:
-    explicit interpreter(environment const & env, options const & opts) : m_env(env), m_opts(opts) {
+    explicit interpreter(environment const & env, options const & opts) :
+        m_env(env), m_opts(opts), m_call_site_cache(call_site_cache_size) {
         m_prefer_native = opts.get_bool(*g_interpreter_prefer_native, LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE);
+        m_shared = get_shared_cache(env, m_prefer_native);
     }
 
     interpreter(interpreter const &) = delete;
 
+    static std::shared_ptr<shared_cache> get_shared_cache(environment const & env, bool prefer_native);
+
     ~interpreter() {
-        for_each(m_constant_cache, [](name const &, constant_cache_entry const & e) {
-            if (!e.m_is_scalar) {
-                dec(e.m_val.m_obj);
+        for (auto const & p : m_constant_cache) {
+            if (!p.second.m_is_scalar) {
+                dec(p.second.m_val.m_obj);
             }
-        });
+        }
     }
 
     /** A variant of `call` designed for external uses.
@@ -963,7 +1317,7 @@ public:
      *  * supports under- and over-application.
      *  * supports "calling" (evaluating) nullary constants. */
     object * call_boxed(name const & fn, unsigned n, object ** args) {
-        symbol_cache_entry e = lookup_symbol(fn);
+        symbol_cache_entry const & e = lookup_symbol(fn);
         unsigned arity = decl_params(e.m_decl).size();
         object * r;
         if (arity == 0) {
@@ -1037,7 +1391,7 @@ public:
                 object * o = io_result_get_value(r);
                 mark_persistent(o);
                 dec_ref(r);
-                symbol_cache_entry e = lookup_symbol(decl);
+                symbol_cache_entry const & e = lookup_symbol(decl);
                 if (e.m_addr) {
                     *((object **)e.m_addr) = o;
                 } else {
@@ -1053,6 +1407,57 @@ public:
     }
 };
 
+static mutex * g_shared_caches_mutex = nullptr;
+// most recently used last
+static std::vector<std::shared_ptr<interpreter::shared_cache>> * g_shared_caches = nullptr;
+// `g_shared_caches` as registered in the cache registry
+static unsigned g_shared_caches_id = 0;
+
+/* Rough estimate of the memory used by the shared caches, as the cached values may be shared with other data. */
+static size_t shared_caches_size() {
+    lock_guard<mutex> lock(*g_shared_caches_mutex);
+    size_t n = 0;
+    for (std::shared_ptr<interpreter::shared_cache> const & c : *g_shared_caches) {
+        lock_guard<mutex> cache_lock(c->m_mutex);
+        n += c->m_symbol_cache.size() + c->m_constant_cache.size();
+    }
+    return n * LEAN_INTERPRETER_CACHE_ENTRY_SIZE;
+}
+
+static void evict_shared_caches() {
+    std::vector<std::shared_ptr<interpreter::shared_cache>> caches;
+    {
+        lock_guard<mutex> lock(*g_shared_caches_mutex);
+        caches.swap(*g_shared_caches);
+    }
+    // the caches are released without holding the lock; interpreters still using one keep it alive
+}
+
+/** \brief Return the cache shared by the interpreters for `env`, or `nullptr` if `env` is only used by the current
+    thread. Cached data depends on the environment, so the caches are keyed by its address, and the
+    `LEAN_INTERPRETER_SHARED_CACHES` most recently used ones are kept. */
+std::shared_ptr<interpreter::shared_cache> interpreter::get_shared_cache(environment const & env, bool prefer_native) {
+    // Objects owned by a single thread would be unsafe to share, and an environment used by several threads (e.g.,
+    // parallel elaboration tasks) is not.
+    if (lean_is_st(env.raw()))
+        return nullptr;
+    touch_cache(g_shared_caches_id);
+    lock_guard<mutex> lock(*g_shared_caches_mutex);
+    std::vector<std::shared_ptr<shared_cache>> & caches = *g_shared_caches;
+    for (size_t i = caches.size(); i > 0; i--) {
+        std::shared_ptr<shared_cache> c = caches[i - 1];
+        if (is_eqp(c->m_env, env) && c->m_prefer_native == prefer_native) {
+            caches.erase(caches.begin() + (i - 1));
+            caches.push_back(c);
+            return c;
+        }
+    }
+    if (caches.size() >= LEAN_INTERPRETER_SHARED_CACHES)
+        caches.erase(caches.begin());
+    caches.push_back(std::make_shared<shared_cache>(env, prefer_native));
+    return caches.back();
+}
+
 extern "C" object * lean_decl_get_sorry_dep(object * env, object * n);
 
 optional<name> get_sorry_dep(environment const & env, name const & n) {
@@ -1114,15 +1519,27 @@ void initialize_ir_interpreter() {
     mark_persistent(ir::g_boxed_mangled_suffix->raw());
     ir::g_interpreter_prefer_native = new name({"interpreter", "prefer_native"});
     ir::g_init_globals = new name_map<object *>();
+    ir::g_shared_caches_mutex = new mutex();
+    ir::g_shared_caches = new std::vector<std::shared_ptr<ir::interpreter::shared_cache>>();
+    ir::g_shared_caches_id = register_cache("interpreter", ir::shared_caches_size, ir::evict_shared_caches);
     register_bool_option(*ir::g_interpreter_prefer_native, LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE, "(interpreter) whether to use precompiled code where available");
     DEBUG_CODE({
         register_trace_class({"interpreter"});
         register_trace_class({"interpreter", "call"});
         register_trace_class({"interpreter", "step"});
     });
+#if defined(LEAN_MULTI_THREAD)
+    if (char const * file = std::getenv("LEAN_INTERPRETER_PROFILE"))
+        ir::g_profiler = new ir::interpreter_profiler(file);
+#endif
 }
 
 void finalize_ir_interpreter() {
+#if defined(LEAN_MULTI_THREAD)
+    delete ir::g_profiler;
+#endif
+    delete ir::g_shared_caches;
+    delete ir::g_shared_caches_mutex;
     delete ir::g_init_globals;
     delete ir::g_interpreter_prefer_native;
     delete ir::g_boxed_mangled_suffix;
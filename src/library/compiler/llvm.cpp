@@ -12,6 +12,7 @@ Lean's IR.
 #include <lean/lean.h>
 
 #include <cassert>
+#include <mutex>
 
 #include "runtime/array_ref.h"
 #include "runtime/debug.h"
@@ -28,6 +29,12 @@ Lean's IR.
 #include "llvm-c/Types.h"
 #include "llvm-c/Transforms/PassBuilder.h"
 #include "llvm-c/Transforms/PassManagerBuilder.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 #endif
 
 // This is mostly boilerplate, suppress warnings
@@ -37,14 +44,20 @@ Lean's IR.
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #endif
 
+/* LLVM objects are confined to the `Context` they were created in, so threads can emit code concurrently as long as
+   each one uses its own context. The target registry is global, though, and must only be initialized once. */
+static std::once_flag g_target_info_initialized;
+
 extern "C" LEAN_EXPORT lean_object* lean_llvm_initialize_target_info(lean_object * /* w */) {
 
 #ifdef LEAN_LLVM
-    LLVMInitializeAllTargetInfos();
-    LLVMInitializeAllTargets();
-    LLVMInitializeAllTargetMCs();
-    LLVMInitializeAllAsmParsers();
-    LLVMInitializeAllAsmPrinters();
+    std::call_once(g_target_info_initialized, []() {
+        LLVMInitializeAllTargetInfos();
+        LLVMInitializeAllTargets();
+        LLVMInitializeAllTargetMCs();
+        LLVMInitializeAllAsmParsers();
+        LLVMInitializeAllAsmPrinters();
+    });
 #endif
 
     return lean_io_result_mk_ok(lean_box(0));
@@ -261,6 +274,28 @@ extern "C" LEAN_EXPORT lean_object *lean_llvm_write_bitcode_to_file(size_t ctx,
 #endif  // LEAN_LLVM
 };
 
+/* Like `lean_llvm_write_bitcode_to_file`, but also write the module summary index used by ThinLTO, so that the
+   bitcode can take part in cross-module inlining at link time. The C API does not expose summaries. */
+extern "C" LEAN_EXPORT lean_object *lean_llvm_write_thin_lto_bitcode_to_file(size_t ctx,
+    size_t mod, lean_object *filepath, lean_object * /* w */) {
+#ifndef LEAN_LLVM
+    lean_always_assert(
+        false && ("Please build a version of Lean4 with -DLLVM=ON to invoke "
+                  "the LLVM backend function."));
+#else
+    llvm::Module * m = llvm::unwrap(lean_to_Module(mod));
+    std::error_code ec;
+    llvm::raw_fd_ostream out(lean_string_cstr(filepath), ec, llvm::sys::fs::OF_None);
+    lean_always_assert(!ec && "unable to write bitcode");
+    llvm::ProfileSummaryInfo psi(*m);
+    llvm::ModuleSummaryIndex index = llvm::buildModuleSummaryIndex(*m, nullptr, &psi);
+    llvm::WriteBitcodeToFile(*m, out, /* ShouldPreserveUseListOrder */ false, &index);
+    out.flush();
+    lean_always_assert(!out.has_error() && "unable to write bitcode");
+    return lean_io_result_mk_ok(lean_box(0));  // IO Unit
+#endif  // LEAN_LLVM
+};
+
 extern "C" LEAN_EXPORT lean_object *lean_llvm_module_to_string(
     size_t ctx, size_t mod, lean_object * /* w */) {
 #ifndef LEAN_LLVM
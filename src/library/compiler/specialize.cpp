@@ -6,11 +6,13 @@ Author: Leonardo de Moura
 */
 #include <algorithm>
 #include "runtime/flet.h"
+#include "util/option_declarations.h"
 #include "kernel/instantiate.h"
 #include "kernel/for_each_fn.h"
 #include "kernel/abstract.h"
 #include "kernel/inductive.h"
 #include "kernel/trace.h"
+#include "kernel/expr_flat_map.h"
 #include "library/class.h"
 #include "library/compiler/util.h"
 #include "library/compiler/csimp.h"
@@ -263,6 +265,12 @@ static optional<name> get_cached_specialization(environment const & env, expr co
     return to_optional<name>(lean_get_cached_specialization(env.to_obj_arg(), e.to_obj_arg()));
 }
 
+static name * g_specialize_budget = nullptr;
+
+unsigned get_specialize_budget(options const & opts) {
+    return opts.get_unsigned(*g_specialize_budget, 0);
+}
+
 class specialize_fn {
     type_checker::state m_st;
     csimp_cfg           m_cfg;
@@ -273,6 +281,8 @@ class specialize_fn {
     name                m_spec;
     unsigned            m_next_idx{1};
     name_set            m_to_respecialize;
+    /* Sum of the sizes of the specializations created so far, see `csimp_cfg::m_specialize_budget`. */
+    unsigned            m_spec_size{0};
 
     environment const & env() { return m_st.env(); }
 
@@ -374,7 +384,9 @@ class specialize_fn {
     }
 
     struct spec_ctx {
-        typedef rb_expr_map<name> cache;
+        /* Keys are compared using their precomputed hashes before being compared structurally, instead of being
+           ordered by `expr_lt`. */
+        typedef expr_flat_map<name> cache;
         names                 m_mutual;
         /* `m_params` contains all variables that must be lambda abstracted in the specialization.
            It may contain let-variables that occurs inside of binders.
@@ -983,6 +995,7 @@ class specialize_fn {
         // lean_trace(name("compiler", "spec_info"), tout() << "STEP 2 " << n << "\n" << code << "\n";);
         code = csimp(env(), code, m_cfg);
         code = visit(code);
+        m_spec_size += get_lcnf_size(env(), code);
         lean_trace(name("compiler", "specialize"), tout() << "new code " << n << "\n" << trace_pp_expr(code) << "\n";);
         comp_decl new_decl(n, code);
         m_new_decls.push_back(new_decl);
@@ -1130,6 +1143,10 @@ class specialize_fn {
         }
         if (!new_fn_name) {
             /* Cache does not contain specialization result */
+            if (m_cfg.m_specialize_budget > 0 && m_spec_size >= m_cfg.m_specialize_budget) {
+                lean_trace(name({"compiler", "specialize"}), tout() << "budget exhausted, not specializing " << const_name(fn) << "\n";);
+                return none_expr();
+            }
             new_fn_name = spec_preprocess(fn, mask, ctx);
             if (!new_fn_name)
                 return none_expr();
@@ -1245,10 +1262,16 @@ pair<environment, comp_decls> specialize(environment env, comp_decls const & ds,
 }
 
 void initialize_specialize() {
+    g_specialize_budget = new name{"compiler", "specialize", "budget"};
+    mark_persistent(g_specialize_budget->raw());
+    register_unsigned_option(*g_specialize_budget, 0,
+                             "(compiler) stop creating new specializations for a declaration after the total size of its "
+                             "specializations exceeds this value (0 means no limit)");
     register_trace_class({"compiler", "spec_info"});
     register_trace_class({"compiler", "spec_candidate"});
 }
 
 void finalize_specialize() {
+    delete g_specialize_budget;
 }
 }
@@ -10,6 +10,8 @@ Author: Leonardo de Moura
 #include "library/compiler/csimp.h"
 namespace lean {
 pair<environment, comp_decls> specialize(environment env, comp_decls const & ds, csimp_cfg const & cfg);
+/* Value of the `compiler.specialize.budget` option, see `csimp_cfg::m_specialize_budget`. */
+unsigned get_specialize_budget(options const & opts);
 void initialize_specialize();
 void finalize_specialize();
 }
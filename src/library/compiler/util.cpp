@@ -392,6 +392,10 @@ bool is_runtime_builtin_type(name const & n) {
         n == get_mut_quot_name()  ||
         n == get_byte_array_name()  ||
         n == get_float_array_name()  ||
+        n == get_uint16_array_name()  ||
+        n == get_uint32_array_name()  ||
+        n == get_uint64_array_name()  ||
+        n == get_usize_array_name()  ||
         n == get_nat_name()    ||
         n == get_int_name();
 }
@@ -110,4 +110,12 @@ name const & get_uint16_name();
 name const & get_uint32_name();
 name const & get_uint64_name();
 name const & get_usize_name();
+name const & get_uint16_array_name();
+name const & get_uint16_array_data_name();
+name const & get_uint32_array_name();
+name const & get_uint32_array_data_name();
+name const & get_uint64_array_name();
+name const & get_uint64_array_data_name();
+name const & get_usize_array_name();
+name const & get_usize_array_data_name();
 }
@@ -33,6 +33,18 @@ static optional<unsigned> is_typeformer_app(buffer<name> const & typeformer_name
     return optional<unsigned>();
 }
 
+/* Like `to_telescope(env, lctx, ngen, type, telescope)`, but only creates type checkers to put `type` in weak head
+   normal form if it is not already. This is the case for almost all constructor fields, whose types are `Pi`s ending
+   in an application of a local, such as a type former, or of an inductive type. */
+static expr to_field_telescope(environment const & env, local_ctx & lctx, name_generator & ngen, expr type,
+                               buffer<expr> & telescope) {
+    type = to_telescope(lctx, ngen, type, telescope);
+    expr const & fn = get_app_fn(type);
+    if (is_fvar(fn) || is_sort(fn) || (is_constant(fn) && is_inductive(env, const_name(fn))))
+        return type;
+    return to_telescope(env, lctx, ngen, type, telescope);
+}
+
 static environment mk_below(environment const & env, name const & n, bool ibelow) {
     if (!is_recursive_datatype(env, n))
         return env;
@@ -115,7 +127,7 @@ static environment mk_below(environment const & env, name const & n, bool ibelow
         buffer<expr> prod_pairs;
         for (expr & minor_arg : minor_args) {
             buffer<expr> minor_arg_args;
-            expr minor_arg_type = to_telescope(env, lctx, ngen, lctx.get_type(minor_arg), minor_arg_args);
+            expr minor_arg_type = to_field_telescope(env, lctx, ngen, lctx.get_type(minor_arg), minor_arg_args);
             if (is_typeformer_app(typeformer_names, minor_arg_type)) {
                 expr fst  = lctx.get_type(minor_arg);
                 minor_arg = lctx.mk_local_decl(ngen, lctx.get_local_decl(minor_arg).get_user_name(), lctx.mk_pi(minor_arg_args, Type_result));
@@ -302,7 +314,7 @@ static environment mk_brec_on(environment const & env, name const & n, bool ind)
         buffer<expr> pairs;
         for (expr & minor_arg : minor_args) {
             buffer<expr> minor_arg_args;
-            expr minor_arg_type = to_telescope(env, lctx, ngen, lctx.get_type(minor_arg), minor_arg_args);
+            expr minor_arg_type = to_field_telescope(env, lctx, ngen, lctx.get_type(minor_arg), minor_arg_args);
             if (auto k = is_typeformer_app(typeformer_names, minor_arg_type)) {
                 buffer<expr> C_args;
                 get_app_args(minor_arg_type, C_args);
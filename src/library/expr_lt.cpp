@@ -70,6 +70,14 @@ bool is_lt(expr const & a, expr const & b, bool use_hash, local_ctx const * lctx
     lean_unreachable(); // LCOV_EXCL_LINE
 }
 
+int quick_cmp(expr const & a, expr const & b) {
+    if (is_eqp(a, b))                    return 0;
+    if (a.kind() != b.kind())            return a.kind() < b.kind() ? -1 : 1;
+    if (hash(a) != hash(b))              return hash(a) < hash(b) ? -1 : 1;
+    if (a == b)                          return 0;
+    return is_lt(a, b, true) ? -1 : 1;
+}
+
 bool is_lt_no_level_params(level const & a, level const & b) {
     if (is_eqp(a, b))              return false;
     if (kind(a) != kind(b)) {
@@ -14,13 +14,20 @@ namespace lean {
 
     \remark If \c use_hash is true, then we use the hash_code to
     partially order expressions. Setting use_hash to false is useful
-    for testing the code.
+    for testing the code. The resulting order is compatible with `==` but
+    is not semantic: it depends on the hash function, and must only be
+    used when the result of a computation does not depend on the order,
+    e.g., for the keys of maps and caches. Clients ordering user-visible
+    data, such as the variables of `ac_rfl`, must use `use_hash = false`.
 
     \remark If lctx is not nullptr, then we use the local_decl index to compare local constants.
 */
 bool is_lt(expr const & a, expr const & b, bool use_hash, local_ctx const * lctx = nullptr);
 /** \brief Similar to is_lt, but universe level parameter names are ignored. */
 bool is_lt_no_level_params(expr const & a, expr const & b);
+/** \brief Three-way comparison for the order of `is_lt(a, b, true)`. It compares the kinds and hash codes first,
+    and traverses `a` and `b` once if they are equal, while `is_lt` followed by `==` traverses them twice. */
+int quick_cmp(expr const & a, expr const & b);
 inline bool is_hash_lt(expr const & a, expr const & b) { return is_lt(a, b, true); }
 inline bool operator<(expr const & a, expr const & b)  { return is_lt(a, b, true); }
 inline bool operator>(expr const & a, expr const & b)  { return is_lt(b, a, true); }
@@ -28,12 +35,12 @@ inline bool operator<=(expr const & a, expr const & b) { return !is_lt(b, a, tru
 inline bool operator>=(expr const & a, expr const & b) { return !is_lt(a, b, true); }
 struct expr_quick_cmp {
     typedef expr type;
-    int operator()(expr const & e1, expr const & e2) const { return is_lt(e1, e2, true) ? -1 : (e1 == e2 ? 0 : 1); }
+    int operator()(expr const & e1, expr const & e2) const { return quick_cmp(e1, e2); }
 };
 struct expr_cmp_no_level_params { int operator()(expr const & e1, expr const & e2) const; };
 
 template<typename T>
 using rb_expr_map = rb_map<expr, T, expr_quick_cmp>;
 
-typedef rb_tree<expr, expr_quick_cmp> rb_expr_tree;
+typedef btree<expr, expr_quick_cmp> rb_expr_tree;
 }
@@ -14,6 +14,9 @@ inline bool is_lt(expr_pair const & p1, expr_pair const & p2, bool use_hash) {
     return is_lt(p1.first, p2.first, use_hash) || (p1.first == p2.first && is_lt(p1.second, p2.second, use_hash));
 }
 struct expr_pair_quick_cmp {
-    int operator()(expr_pair const & p1, expr_pair const & p2) const { return is_lt(p1, p2, true) ? -1 : (p1 == p2 ? 0 : 1);  }
+    int operator()(expr_pair const & p1, expr_pair const & p2) const {
+        int c = quick_cmp(p1.first, p2.first);
+        return c != 0 ? c : quick_cmp(p1.second, p2.second);
+    }
 };
 }
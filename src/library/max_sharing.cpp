@@ -9,6 +9,7 @@ Author: Leonardo de Moura
 #include <functional>
 #include "runtime/interrupt.h"
 #include "runtime/buffer.h"
+#include "kernel/hash_cons.h"
 #include "library/max_sharing.h"
 
 namespace lean {
@@ -17,7 +18,7 @@ namespace lean {
    shared sub-expressions.
 */
 struct max_sharing_fn::imp {
-    typedef typename std::unordered_set<expr, expr_hash, is_bi_equal_proc> expr_cache;
+    typedef flat_hash_map<expr, expr, expr_hash, expr_bi_fast_eq>          expr_cache;
     typedef typename std::unordered_set<level, level_hash>                 level_cache;
     expr_cache  m_expr_cache;
     level_cache m_lvl_cache;
@@ -48,8 +49,7 @@ struct max_sharing_fn::imp {
 
     expr apply(expr const & a) {
         check_system("max_sharing");
-        auto r = m_expr_cache.find(a);
-        if (r != m_expr_cache.end())
+        if (expr const * r = m_expr_cache.find(a))
             return *r;
         expr res;
         switch (a.kind()) {
@@ -93,7 +93,7 @@ struct max_sharing_fn::imp {
             break;
         }
         }
-        m_expr_cache.insert(res);
+        m_expr_cache.insert(res, res);
         return res;
     }
 
@@ -102,8 +102,8 @@ struct max_sharing_fn::imp {
     }
 
     bool already_processed(expr const & a) const {
-        auto r = m_expr_cache.find(a);
-        return r != m_expr_cache.end() && is_eqp(*r, a);
+        expr const * r = m_expr_cache.find(a);
+        return r && is_eqp(*r, a);
     }
 };
 
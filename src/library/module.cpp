@@ -13,6 +13,11 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <sys/stat.h>
 #include "runtime/thread.h"
 #include "runtime/interrupt.h"
@@ -37,6 +42,10 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include <fcntl.h>
 #endif
 
+#ifdef LEAN_USE_ZSTD
+#include <zstd.h>
+#endif
+
 #if defined(__has_feature)
 #if __has_feature(address_sanitizer)
 #include <sanitizer/lsan_interface.h>
@@ -49,17 +58,103 @@ namespace lean {
 struct olean_header {
     // 5 bytes: magic number
     char marker[5] = {'o', 'l', 'e', 'a', 'n'};
-    // 1 byte: version, currently always `1`
-    uint8_t version = 1;
+    // 1 byte: version, `2` for a raw payload or `LEAN_OLEAN_COMPRESSED_VERSION` for a compressed one
+    uint8_t version = 2;
     // 42 bytes: build githash, padded with `\0` to the right
     char githash[42];
     // address at which the beginning of the file (including header) is attempted to be mmapped
     size_t base_addr;
+    // size of the payload as stored in the file, used to detect truncated files
+    uint64_t payload_size;
+    // hash of the payload as stored in the file, see `payload_checksum`
+    uint64_t checksum;
     // payload, a serialize Lean object graph; `size_t` has same alignment requirements as Lean objects
     size_t data[];
 };
 // make sure we don't have any padding bytes, which also ensures `data` is properly aligned
-static_assert(sizeof(olean_header) == 5 + 1 + 42 + sizeof(size_t), "olean_header must be packed");
+static_assert(sizeof(olean_header) == 5 + 1 + 42 + sizeof(size_t) + 2 * sizeof(uint64_t), "olean_header must be packed");
+
+static uint64_t payload_checksum(char const * payload, size_t size) {
+    return hash_str(size, reinterpret_cast<unsigned char const *>(payload), 11);
+}
+
+#ifdef LEAN_USE_ZSTD
+#define LEAN_OLEAN_COMPRESSED_VERSION 3
+// uncompressed size of the chunks of a compressed payload
+#define LEAN_OLEAN_CHUNK_SIZE (4*1024*1024)
+// zstd compression level used when `LEAN_COMPRESS_OLEAN` is set
+#define LEAN_OLEAN_COMPRESSION_LEVEL 3
+
+/** Compressed payload of an .olean file, following `olean_header`. The payload is split into chunks of
+    `LEAN_OLEAN_CHUNK_SIZE` bytes (except for the last one) that are compressed independently so that they can be
+    decompressed in parallel. The compressed chunks follow `chunk_sizes`. The object graph is still compacted for
+    `base_addr`, so it does not need to be relocated if it can be decompressed at that address. */
+struct olean_compressed_header {
+    // size of the uncompressed payload
+    uint64_t data_size;
+    uint64_t num_chunks;
+    // compressed size of each chunk
+    uint64_t chunk_sizes[];
+};
+
+/* Return the compressed payload for the compacted object graph `[data, data + size)`. */
+static std::vector<char> compress_payload(char const * data, size_t size) {
+    size_t num_chunks = (size + LEAN_OLEAN_CHUNK_SIZE - 1) / LEAN_OLEAN_CHUNK_SIZE;
+    size_t table_size = (2 + num_chunks) * sizeof(uint64_t);
+    std::vector<char> r(table_size + ZSTD_compressBound(LEAN_OLEAN_CHUNK_SIZE));
+    olean_compressed_header * table = reinterpret_cast<olean_compressed_header *>(r.data());
+    table->data_size  = size;
+    table->num_chunks = num_chunks;
+    size_t end = table_size;
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t begin = i * LEAN_OLEAN_CHUNK_SIZE;
+        size_t chunk_size = std::min(size - begin, static_cast<size_t>(LEAN_OLEAN_CHUNK_SIZE));
+        r.resize(end + ZSTD_compressBound(chunk_size));
+        size_t n = ZSTD_compress(r.data() + end, r.size() - end, data + begin, chunk_size, LEAN_OLEAN_COMPRESSION_LEVEL);
+        if (ZSTD_isError(n))
+            throw exception(sstream() << "compression failed: " << ZSTD_getErrorName(n));
+        reinterpret_cast<olean_compressed_header *>(r.data())->chunk_sizes[i] = n;
+        end += n;
+    }
+    r.resize(end);
+    return r;
+}
+#endif
+
+/* Address ranges `[base_addr, base_addr + size)` of the .olean files loaded by this process, mapped or not. When saving a
+   module, we avoid base addresses overlapping any of them: the module's imports are loaded while it is being compiled,
+   so this ensures that importing it cannot lose `mmap` because of a collision with one of its dependencies. */
+static mutex                                g_olean_ranges_mutex;
+static std::vector<std::pair<size_t, size_t>> g_olean_ranges;
+
+static void register_olean_range(size_t base_addr, size_t size) {
+    lock_guard<mutex> lock(g_olean_ranges_mutex);
+    g_olean_ranges.emplace_back(base_addr, size);
+}
+
+static bool overlaps_loaded_olean(size_t base_addr, size_t size) {
+    lock_guard<mutex> lock(g_olean_ranges_mutex);
+    for (auto const & r : g_olean_ranges) {
+        if (base_addr < r.first + r.second && r.first < base_addr + size)
+            return true;
+    }
+    return false;
+}
+
+/* Turn the hash `h` into a base address that should most likely work for `mmap` on all interesting platforms. */
+static size_t hash_to_base_addr(size_t h) {
+    // x86-64 user space is currently limited to the lower 47 bits
+    // https://en.wikipedia.org/wiki/X86-64#Virtual_address_space_details
+    // On Linux at least, the stack grows down from ~0x7fff... followed by shared libraries, so reserve
+    // a bit of space for them (0x7fff...-0x7f00... = 1TB)
+    h = h % 0x7f0000000000;
+    // `mmap` addresses must be page-aligned. The default (non-huge) page size on x86-64 is 4KB.
+    // `MapViewOfFileEx` addresses must be aligned to the "memory allocation granularity", which is 64KB.
+    return h & ~((1LL<<16) - 1);
+}
+
+// number of alternative base addresses tried when the first one collides with a loaded .olean file
+#define LEAN_MAX_BASE_ADDR_ATTEMPTS 16
 
 extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg mod, b_obj_arg mdata, object *) {
     std::string olean_fn(string_cstr(fname));
@@ -80,25 +175,39 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
         // Let's start with a hash of the module name. Note that while our string hash is a dubious 32-bit
         // algorithm, the mixing of multiple `Name` parts seems to result in a nicely distributed 64-bit
         // output
-        size_t base_addr = name(mod, true).hash();
-        // x86-64 user space is currently limited to the lower 47 bits
-        // https://en.wikipedia.org/wiki/X86-64#Virtual_address_space_details
-        // On Linux at least, the stack grows down from ~0x7fff... followed by shared libraries, so reserve
-        // a bit of space for them (0x7fff...-0x7f00... = 1TB)
-        base_addr = base_addr % 0x7f0000000000;
-        // `mmap` addresses must be page-aligned. The default (non-huge) page size on x86-64 is 4KB.
-        // `MapViewOfFileEx` addresses must be aligned to the "memory allocation granularity", which is 64KB.
-        base_addr = base_addr & ~((1LL<<16) - 1);
-
-        object_compactor compactor(reinterpret_cast<void *>(base_addr + offsetof(olean_header, data)));
-        compactor(mdata);
+        size_t h = name(mod, true).hash();
+        size_t base_addr = hash_to_base_addr(h);
+        std::unique_ptr<object_compactor> compactor(
+            new object_compactor(reinterpret_cast<void *>(base_addr + offsetof(olean_header, data))));
+        (*compactor)(mdata);
+        // The payload size does not depend on the base address, so on a collision with a loaded .olean file we
+        // rehash and compact again. This is rare enough that we do not bother with relocating the first result.
+        for (unsigned attempt = 1; attempt <= LEAN_MAX_BASE_ADDR_ATTEMPTS &&
+                 overlaps_loaded_olean(base_addr, sizeof(olean_header) + compactor->size()); attempt++) {
+            base_addr = hash_to_base_addr(hash(h, attempt));
+            compactor.reset(new object_compactor(reinterpret_cast<void *>(base_addr + offsetof(olean_header, data))));
+            (*compactor)(mdata);
+        }
 
         // see/sync with file format description above
         olean_header header = {};
         header.base_addr = base_addr;
         strncpy(header.githash, LEAN_GITHASH, sizeof(header.githash));
+        char const * payload = static_cast<char const *>(compactor->data());
+        size_t payload_size  = compactor->size();
+#ifdef LEAN_USE_ZSTD
+        std::vector<char> compressed;
+        if (std::getenv("LEAN_COMPRESS_OLEAN")) {
+            compressed = compress_payload(payload, payload_size);
+            header.version = LEAN_OLEAN_COMPRESSED_VERSION;
+            payload      = compressed.data();
+            payload_size = compressed.size();
+        }
+#endif
+        header.payload_size = payload_size;
+        header.checksum     = payload_checksum(payload, payload_size);
         out.write(reinterpret_cast<char *>(&header), sizeof(header));
-        out.write(static_cast<char const *>(compactor.data()), compactor.size());
+        out.write(payload, payload_size);
         out.close();
         while (std::rename(olean_tmp_fn.c_str(), olean_fn.c_str()) != 0) {
 #ifdef LEAN_WINDOWS
@@ -126,12 +235,190 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
     }
 }
 
-extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *) {
-    std::string olean_fn(string_cstr(fname));
+optional<uint64> get_olean_header_hash(std::string const & olean_fn) {
+    std::ifstream in(olean_fn, std::ios_base::binary);
+    olean_header default_header = {};
+    olean_header header;
+    if (in.fail() || !in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        memcmp(header.marker, default_header.marker, sizeof(header.marker)) != 0 ||
+        strncmp(header.githash, LEAN_GITHASH, sizeof(header.githash)) != 0)
+        return optional<uint64>();
+    // the payload checksum identifies the content, the base address does not
+    header.base_addr = 0;
+    return optional<uint64>(hash_str(sizeof(header), reinterpret_cast<unsigned char const *>(&header), 11));
+}
+
+/* An .olean file being loaded by `lean_read_module_data(_many)`. Loading is split into `load_olean`, which only performs
+   I/O and may run on any thread, and `mk_module_data`, which creates the Lean objects. */
+struct olean_load {
+    std::string           m_fn;
+    std::string           m_error;
+    size_t                m_size{0};
+    char *                m_base_addr{nullptr};
+    char *                m_buffer{nullptr};
+    bool                  m_is_mmap{false};
+    std::function<void()> m_free_data;
+    /* Time spent opening the file and reading its header, in nanoseconds. */
+    uint64                m_open_ns{0};
+    explicit olean_load(std::string const & fn):m_fn(fn) {}
+};
+
+#ifdef LEAN_USE_ZSTD
+/* A chunk of a compressed payload, see `olean_compressed_header`. */
+struct olean_chunk {
+    char const * m_src;
+    size_t       m_src_size;
+    char *       m_dst;
+    size_t       m_dst_size;
+    std::string  m_error;
+};
+
+static void decompress_chunk(olean_chunk & c) {
+    size_t r = ZSTD_decompress(c.m_dst, c.m_dst_size, c.m_src, c.m_src_size);
+    if (ZSTD_isError(r))
+        c.m_error = ZSTD_getErrorName(r);
+    else if (r != c.m_dst_size)
+        c.m_error = "unexpected chunk size";
+}
+
+static obj_res decompress_chunk_fn(obj_arg c, obj_arg) {
+    decompress_chunk(*reinterpret_cast<olean_chunk *>(lean_unbox_usize(c)));
+    lean_dec(c);
+    return box(0);
+}
+
+/* Read and decompress the payload of a compressed .olean file, `in` is positioned after `header`. If possible, the payload
+   is decompressed at `base_addr` like for a memory-mapped file. Otherwise, it is decompressed into a fresh buffer that is
+   relocated by `compacted_region::read`. */
+static bool load_compressed_olean(olean_load & l, std::ifstream & in, olean_header const & header, char * base_addr) {
+    std::string const & olean_fn = l.m_fn;
+    std::vector<char> src(header.payload_size);
+    if (!in.read(src.data(), src.size())) {
+        l.m_error = (sstream() << "failed to read file '" << olean_fn << "'").str();
+        return false;
+    }
+    // the compressed payload is read in full anyway, so its checksum is always verified
+    if (payload_checksum(src.data(), src.size()) != header.checksum) {
+        l.m_error = (sstream() << "failed to read file '" << olean_fn << "', checksum mismatch").str();
+        return false;
+    }
+    olean_compressed_header const * table = reinterpret_cast<olean_compressed_header const *>(src.data());
+    bool valid = src.size() >= sizeof(olean_compressed_header);
+    size_t data_size  = valid ? table->data_size : 0;
+    size_t num_chunks = valid ? table->num_chunks : 0;
+    valid = valid && num_chunks == (data_size + LEAN_OLEAN_CHUNK_SIZE - 1) / LEAN_OLEAN_CHUNK_SIZE &&
+        num_chunks <= (src.size() - sizeof(olean_compressed_header)) / sizeof(uint64_t);
+    size_t table_size = sizeof(olean_compressed_header) + num_chunks * sizeof(uint64_t);
+    uint64_t total = table_size;
+    for (size_t i = 0; valid && i < num_chunks; i++)
+        total += table->chunk_sizes[i];
+    if (!valid || total != src.size()) {
+        l.m_error = (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
+        return false;
+    }
+
+    size_t size = sizeof(olean_header) + data_size;
+    char * buffer = nullptr;
+    std::function<void()> free_data;
+#if defined(LEAN_MMAP) && !defined(LEAN_WINDOWS)
+    char * region = should_map_oleans() ?
+        static_cast<char *>(mmap(base_addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) :
+        static_cast<char *>(MAP_FAILED);
+    if (region == base_addr) {
+        buffer = region + sizeof(olean_header);
+        free_data = [=]() {
+            lean_always_assert(munmap(region, size) == 0);
+        };
+    } else if (region != MAP_FAILED) {
+        lean_always_assert(munmap(region, size) == 0);
+    }
+#endif
+    if (!buffer) {
+        buffer = static_cast<char *>(malloc(data_size));
+        free_data = [=]() {
+            free(buffer);
+        };
+    }
+
+    std::vector<olean_chunk> chunks(num_chunks);
+    char const * next_src = src.data() + table_size;
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t begin = i * LEAN_OLEAN_CHUNK_SIZE;
+        chunks[i].m_src      = next_src;
+        chunks[i].m_src_size = table->chunk_sizes[i];
+        chunks[i].m_dst      = buffer + begin;
+        chunks[i].m_dst_size = std::min(data_size - begin, static_cast<size_t>(LEAN_OLEAN_CHUNK_SIZE));
+        next_src += table->chunk_sizes[i];
+    }
+    std::vector<object *> tasks;
+    if (has_task_manager()) {
+        for (size_t i = 1; i < num_chunks; i++) {
+            object * c = lean_alloc_closure(reinterpret_cast<void *>(decompress_chunk_fn), 2, 1);
+            lean_closure_set(c, 0, lean_box_usize(reinterpret_cast<size_t>(&chunks[i])));
+            tasks.push_back(lean_task_spawn_core(c, 0, false));
+        }
+    }
+    // decompress the first chunk on the current thread, and the remaining ones if there is no task manager
+    for (size_t i = 0; i < (tasks.empty() ? num_chunks : 1); i++)
+        decompress_chunk(chunks[i]);
+    for (object * t : tasks) {
+        lean_task_get(t);
+        lean_dec(t);
+    }
+    for (olean_chunk const & c : chunks) {
+        if (!c.m_error.empty()) {
+            free_data();
+            l.m_error = (sstream() << "failed to decompress file '" << olean_fn << "': " << c.m_error).str();
+            return false;
+        }
+    }
+#if defined(LEAN_MMAP) && !defined(LEAN_WINDOWS)
+    if (buffer == base_addr + sizeof(olean_header))
+        mprotect(base_addr, size, PROT_READ);
+#endif
+    l.m_size      = size;
+    l.m_base_addr = base_addr;
+    l.m_buffer    = buffer;
+    l.m_is_mmap   = false;
+    l.m_free_data = free_data;
+    return true;
+}
+#endif
+
+/* Whether the checksums of memory-mapped .olean files should be verified as well, set by `LEAN_VERIFY_OLEAN`. */
+static bool should_verify_mapped_oleans() {
+    static bool verify = std::getenv("LEAN_VERIFY_OLEAN") != nullptr;
+    return verify;
+}
+
+/* Whether .olean files should always be copied and relocated instead of being mapped at their base address, set by
+   `LEAN_OLEAN_NO_MMAP`. This is the fallback used when the base address is not available, which can be measured this way. */
+static bool should_map_oleans() {
+    static bool map = std::getenv("LEAN_OLEAN_NO_MMAP") == nullptr;
+    return map;
+}
+
+/* Resources used to load .olean files since the start of the process, see `getOleanLoadStats`. The times are in
+   nanoseconds and summed over all threads. */
+static std::atomic<uint64> g_olean_files{0};
+static std::atomic<uint64> g_olean_bytes{0};
+static std::atomic<uint64> g_olean_mapped_files{0};
+static std::atomic<uint64> g_olean_open_ns{0};
+static std::atomic<uint64> g_olean_read_ns{0};
+static std::atomic<uint64> g_olean_fixup_ns{0};
+static std::atomic<uint64> g_olean_locked_files{0};
+
+static uint64 ns_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool load_olean_core(olean_load & l, std::chrono::steady_clock::time_point start) {
+    std::string const & olean_fn = l.m_fn;
     try {
         std::ifstream in(olean_fn, std::ios_base::binary);
         if (in.fail()) {
-            return io_result_mk_error((sstream() << "failed to open file '" << olean_fn << "'").str());
+            l.m_error = (sstream() << "failed to open file '" << olean_fn << "'").str();
+            return false;
         }
         /* Get file size */
         in.seekg(0, in.end);
@@ -141,17 +428,36 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         olean_header default_header = {};
         olean_header header;
         if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
-            return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "', invalid header").str());
+            l.m_error = (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
+            return false;
         }
         if (memcmp(header.marker, default_header.marker, sizeof(header.marker)) != 0
-            || header.version != default_header.version
+            || (header.version != default_header.version
+#ifdef LEAN_USE_ZSTD
+                && header.version != LEAN_OLEAN_COMPRESSED_VERSION
+#endif
+               )
 #ifdef LEAN_CHECK_OLEAN_VERSION
             || strncmp(header.githash, LEAN_GITHASH, sizeof(header.githash)) != 0
 #endif
         ) {
-            return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "', invalid header").str());
+            l.m_error = (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
+            return false;
+        }
+        if (header.payload_size != size - sizeof(olean_header)) {
+            l.m_error = (sstream() << "failed to read file '" << olean_fn << "', file is truncated or corrupted").str();
+            return false;
         }
         char * base_addr = reinterpret_cast<char *>(header.base_addr);
+        l.m_open_ns = ns_since(start);
+#ifdef LEAN_USE_ZSTD
+        if (header.version == LEAN_OLEAN_COMPRESSED_VERSION) {
+            if (!load_compressed_olean(l, in, header, base_addr))
+                return false;
+            register_olean_range(header.base_addr, l.m_size);
+            return true;
+        }
+#endif
         char * buffer = nullptr;
         bool is_mmap = false;
         std::function<void()> free_data;
@@ -159,11 +465,13 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         // `FILE_SHARE_DELETE` is necessary to allow the file to (be marked to) be deleted while in use
         HANDLE h_olean_fn = CreateFile(olean_fn.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
         if (h_olean_fn == INVALID_HANDLE_VALUE) {
-            return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << GetLastError()).str());
+            l.m_error = (sstream() << "failed to open '" << olean_fn << "': " << GetLastError()).str();
+            return false;
         }
         HANDLE h_map = CreateFileMapping(h_olean_fn, NULL, PAGE_READONLY, 0, 0, NULL);
         if (h_olean_fn == NULL) {
-            return io_result_mk_error((sstream() << "failed to map '" << olean_fn << "': " << GetLastError()).str());
+            l.m_error = (sstream() << "failed to map '" << olean_fn << "': " << GetLastError()).str();
+            return false;
         }
         buffer = static_cast<char *>(MapViewOfFileEx(h_map, FILE_MAP_READ, 0, 0, 0, base_addr));
         free_data = [=]() {
@@ -176,10 +484,16 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
 #else
         int fd = open(olean_fn.c_str(), O_RDONLY);
         if (fd == -1) {
-            return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << strerror(errno)).str());
+            l.m_error = (sstream() << "failed to open '" << olean_fn << "': " << strerror(errno)).str();
+            return false;
         }
 #ifdef LEAN_MMAP
-        buffer = static_cast<char *>(mmap(base_addr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+        buffer = should_map_oleans() ? static_cast<char *>(mmap(base_addr, size, PROT_READ, MAP_PRIVATE, fd, 0)) :
+            static_cast<char *>(MAP_FAILED);
+        if (buffer == base_addr) {
+            // start reading the file in the background, the pages are touched by `compacted_region::read`
+            madvise(buffer, size, MADV_WILLNEED);
+        }
 #endif
         close(fd);
         free_data = [=]() {
@@ -201,27 +515,395 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
             };
             in.read(buffer, size - sizeof(olean_header));
             if (!in) {
-                return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "'").str());
+                free_data();
+                l.m_error = (sstream() << "failed to read file '" << olean_fn << "'").str();
+                return false;
             }
         }
+        // A copied payload is read in full and usually relocated anyway, so verifying it is cheap. Verifying a mapped one
+        // would touch all of its pages, so it is only done on request.
+        if ((!is_mmap || should_verify_mapped_oleans()) &&
+            payload_checksum(buffer, size - sizeof(olean_header)) != header.checksum) {
+            free_data();
+            l.m_error = (sstream() << "failed to read file '" << olean_fn << "', checksum mismatch").str();
+            return false;
+        }
         in.close();
+        register_olean_range(header.base_addr, size);
+        l.m_size      = size;
+        l.m_base_addr = base_addr;
+        l.m_buffer    = buffer;
+        l.m_is_mmap   = is_mmap;
+        l.m_free_data = free_data;
+        return true;
+    } catch (exception & ex) {
+        l.m_error = (sstream() << "failed to read '" << olean_fn << "': " << ex.what()).str();
+        return false;
+    }
+}
+
+#if defined(LEAN_MMAP) && !defined(LEAN_WINDOWS)
+/* Pages of a mapped .olean file are only read once they are accessed, so e.g. the first requests to a freshly started
+   server worker can stall on page faults. If `LEAN_OLEAN_PREFAULT` is set, all pages of mapped files are read in a
+   background thread right after mapping them. `LEAN_OLEAN_MLOCK` is a comma-separated list of module names (or `*`)
+   whose mapped files are additionally locked in memory, as far as `RLIMIT_MEMLOCK` permits. */
+struct olean_prefault {
+    char * m_addr;
+    size_t m_size;
+    bool   m_lock;
+};
+
+static std::vector<std::pair<size_t, size_t>> g_mapped_olean_ranges; // protected by `g_olean_ranges_mutex`
+static mutex *                     g_prefault_mutex = new mutex();
+static condition_variable *        g_prefault_cv    = new condition_variable();
+static std::deque<olean_prefault> * g_prefault_queue = new std::deque<olean_prefault>();
+static lthread *                   g_prefault_thread = nullptr;
+/* Start address of the file currently being prefaulted by `prefault_worker`, if any. */
+static char *                      g_prefault_active = nullptr;
+
+static bool should_prefault_oleans() {
+    static bool prefault = std::getenv("LEAN_OLEAN_PREFAULT") != nullptr;
+    return prefault;
+}
+
+/* Whether the .olean file `fn` belongs to one of the modules listed in `LEAN_OLEAN_MLOCK`. */
+static bool should_lock_olean(std::string const & fn) {
+    static std::vector<std::string> * suffixes = []() {
+        auto * r = new std::vector<std::string>();
+        char const * mods = std::getenv("LEAN_OLEAN_MLOCK");
+        std::stringstream in(mods ? mods : "");
+        std::string mod;
+        while (std::getline(in, mod, ',')) {
+            if (mod.empty()) continue;
+            if (mod != "*") {
+                std::replace(mod.begin(), mod.end(), '.', '/');
+                mod = "/" + mod + ".olean";
+            }
+            r->push_back(mod);
+        }
+        return r;
+    }();
+    for (std::string const & s : *suffixes) {
+        if (s == "*" || (fn.size() >= s.size() && fn.compare(fn.size() - s.size(), s.size(), s) == 0))
+            return true;
+    }
+    return false;
+}
+
+static void prefault_olean(olean_prefault const & p) {
+    // `mlock` populates the range as well
+    if (p.m_lock && mlock(p.m_addr, p.m_size) == 0) {
+        g_olean_locked_files++;
+        return;
+    }
+#ifdef MADV_POPULATE_READ
+    if (madvise(p.m_addr, p.m_size, MADV_POPULATE_READ) == 0)
+        return;
+#endif
+    size_t page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < p.m_size; i += page)
+        static_cast<void>(*static_cast<char volatile *>(p.m_addr + i));
+}
+
+static void prefault_worker() {
+    unique_lock<mutex> lock(*g_prefault_mutex);
+    while (true) {
+        while (g_prefault_queue->empty())
+            g_prefault_cv->wait(lock);
+        olean_prefault p = g_prefault_queue->front();
+        g_prefault_queue->pop_front();
+        g_prefault_active = p.m_addr;
+        lock.unlock();
+        prefault_olean(p);
+        lock.lock();
+        g_prefault_active = nullptr;
+        // wake up `unregister_mapped_olean` waiting for this file
+        g_prefault_cv->notify_all();
+    }
+}
+
+/* Forget about the mapped file at `addr` before it is unmapped: drop its range and pending prefault, and wait for the
+   prefault in progress, if any, so that neither the worker nor `get_mapped_olean_resident_bytes` touch unmapped pages. */
+static void unregister_mapped_olean(char * addr) {
+    {
+        lock_guard<mutex> lock(g_olean_ranges_mutex);
+        auto it = std::find_if(g_mapped_olean_ranges.begin(), g_mapped_olean_ranges.end(),
+                               [&](std::pair<size_t, size_t> const & r) { return r.first == reinterpret_cast<size_t>(addr); });
+        if (it != g_mapped_olean_ranges.end())
+            g_mapped_olean_ranges.erase(it);
+    }
+#if defined(LEAN_MULTI_THREAD)
+    unique_lock<mutex> lock(*g_prefault_mutex);
+    g_prefault_queue->erase(std::remove_if(g_prefault_queue->begin(), g_prefault_queue->end(),
+                                           [&](olean_prefault const & p) { return p.m_addr == addr; }),
+                            g_prefault_queue->end());
+    while (g_prefault_active == addr)
+        g_prefault_cv->wait(lock);
+#endif
+}
+
+/* Record the mapped file loaded by `l` for `get_mapped_olean_resident_bytes` and prefault or lock it if requested.
+   `l.m_free_data` is extended to undo the registration before unmapping the file. */
+static void register_mapped_olean(olean_load & l) {
+    {
+        lock_guard<mutex> lock(g_olean_ranges_mutex);
+        g_mapped_olean_ranges.emplace_back(reinterpret_cast<size_t>(l.m_base_addr), l.m_size);
+    }
+    char * addr = l.m_base_addr;
+    std::function<void()> free_data = l.m_free_data;
+    l.m_free_data = [=]() {
+        unregister_mapped_olean(addr);
+        free_data();
+    };
+    bool lock_file = should_lock_olean(l.m_fn);
+    if (!lock_file && !should_prefault_oleans())
+        return;
+    olean_prefault p{l.m_base_addr, l.m_size, lock_file};
+#if defined(LEAN_MULTI_THREAD)
+    lock_guard<mutex> lock(*g_prefault_mutex);
+    g_prefault_queue->push_back(p);
+    if (!g_prefault_thread)
+        // never joined, the thread waits for more files until the process exits
+        g_prefault_thread = new lthread(prefault_worker);
+    g_prefault_cv->notify_one();
+#else
+    prefault_olean(p);
+#endif
+}
+
+/* The number of bytes of mapped .olean files that are currently resident in memory. */
+static uint64 get_mapped_olean_resident_bytes() {
+    size_t page = sysconf(_SC_PAGESIZE);
+    uint64 r = 0;
+    lock_guard<mutex> lock(g_olean_ranges_mutex);
+    for (auto const & range : g_mapped_olean_ranges) {
+        std::vector<unsigned char> vec((range.second + page - 1) / page);
+#if defined(__APPLE__)
+        int ok = mincore(reinterpret_cast<void *>(range.first), range.second, reinterpret_cast<char *>(vec.data()));
+#else
+        int ok = mincore(reinterpret_cast<void *>(range.first), range.second, vec.data());
+#endif
+        if (ok != 0) continue;
+        for (unsigned char v : vec)
+            if (v & 1) r += page;
+    }
+    return r;
+}
+#else
+static void register_mapped_olean(olean_load &) {}
+static uint64 get_mapped_olean_resident_bytes() { return 0; }
+#endif
+
+/* Open, map or read the file `l.m_fn`. Return `false` and set `l.m_error` on failure. */
+static bool load_olean(olean_load & l) {
+    auto start = std::chrono::steady_clock::now();
+    if (!load_olean_core(l, start))
+        return false;
+    g_olean_files++;
+    g_olean_bytes += l.m_size;
+    if (l.m_is_mmap) {
+        g_olean_mapped_files++;
+        register_mapped_olean(l);
+    }
+    g_olean_open_ns += l.m_open_ns;
+    g_olean_read_ns += ns_since(start) - l.m_open_ns;
+    return true;
+}
 
-        compacted_region * region =
-          new compacted_region(size - sizeof(olean_header), buffer, base_addr + sizeof(olean_header), is_mmap, free_data);
+/* Create the `ModuleData × CompactedRegion` pair for a file loaded by `load_olean`. */
+static object * mk_module_data(olean_load & l) {
+    compacted_region * region =
+      new compacted_region(l.m_size - sizeof(olean_header), l.m_buffer, l.m_base_addr + sizeof(olean_header), l.m_is_mmap, l.m_free_data);
 #if defined(__has_feature)
 #if __has_feature(address_sanitizer)
-        // do not report as leak
-        __lsan_ignore_object(region);
+    // do not report as leak
+    __lsan_ignore_object(region);
 #endif
 #endif
-        object * mod = region->read();
-        object * mod_region = alloc_cnstr(0, 2, 0);
-        cnstr_set(mod_region, 0, mod);
-        cnstr_set(mod_region, 1, box_size_t(reinterpret_cast<size_t>(region)));
-        return io_result_mk_ok(mod_region);
+    auto start = std::chrono::steady_clock::now();
+    object * mod = region->read();
+    g_olean_fixup_ns += ns_since(start);
+    object * mod_region = alloc_cnstr(0, 2, 0);
+    cnstr_set(mod_region, 0, mod);
+    cnstr_set(mod_region, 1, box_size_t(reinterpret_cast<size_t>(region)));
+    return mod_region;
+}
+
+/* Module data cached by `set_module_data_cache`, keyed by file name. An entry is used only if the size and modification
+   time of the file are unchanged. The cached `ModuleData × CompactedRegion` pairs are never freed, like the regions of
+   the environments of the command-line driver. */
+struct module_data_cache_entry {
+    uint64   m_size;
+    int64    m_mtime;
+    object * m_data;
+};
+static bool g_module_data_cache_enabled = false;
+static mutex * g_module_data_cache_mutex = nullptr;
+static std::unordered_map<std::string, module_data_cache_entry> * g_module_data_cache = nullptr;
+
+void set_module_data_cache(bool enabled) {
+    if (enabled && !g_module_data_cache) {
+        g_module_data_cache_mutex = new mutex();
+        g_module_data_cache       = new std::unordered_map<std::string, module_data_cache_entry>();
+    }
+    g_module_data_cache_enabled = enabled;
+}
+
+static bool get_file_stamp(std::string const & fn, uint64 & size, int64 & mtime) {
+    struct stat st;
+    if (stat(fn.c_str(), &st) != 0)
+        return false;
+    size  = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+/* Return the cached module data of `fn` if it is still valid, or `nullptr`. */
+static object * find_cached_module_data(std::string const & fn) {
+    if (!g_module_data_cache_enabled)
+        return nullptr;
+    uint64 size; int64 mtime;
+    if (!get_file_stamp(fn, size, mtime))
+        return nullptr;
+    lock_guard<mutex> _(*g_module_data_cache_mutex);
+    auto it = g_module_data_cache->find(fn);
+    if (it == g_module_data_cache->end() || it->second.m_size != size || it->second.m_mtime != mtime)
+        return nullptr;
+    lean_inc(it->second.m_data);
+    return it->second.m_data;
+}
+
+/* Cache the module data `d` (`ModuleData × CompactedRegion`) of `fn`, which was just loaded. */
+static void cache_module_data(std::string const & fn, b_obj_arg d) {
+    if (!g_module_data_cache_enabled)
+        return;
+    uint64 size; int64 mtime;
+    if (!get_file_stamp(fn, size, mtime))
+        return;
+    // the pair is shared with the importers of later jobs, which may run on other threads
+    lean_mark_mt(d);
+    lean_inc(d);
+    lock_guard<mutex> _(*g_module_data_cache_mutex);
+    auto it = g_module_data_cache->find(fn);
+    if (it != g_module_data_cache->end()) {
+        // the environments using the previous version of the file may still be alive, so it is not freed
+        it->second = module_data_cache_entry{size, mtime, d};
+    } else {
+        g_module_data_cache->emplace(fn, module_data_cache_entry{size, mtime, d});
+    }
+}
+
+extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *) {
+    if (object * d = find_cached_module_data(string_cstr(fname)))
+        return io_result_mk_ok(d);
+    olean_load l(string_cstr(fname));
+    if (!load_olean(l))
+        return io_result_mk_error(l.m_error);
+    try {
+        object * d = mk_module_data(l);
+        cache_module_data(l.m_fn, d);
+        return io_result_mk_ok(d);
     } catch (exception & ex) {
-        return io_result_mk_error((sstream() << "failed to read '" << olean_fn << "': " << ex.what()).str());
+        return io_result_mk_error((sstream() << "failed to read '" << l.m_fn << "': " << ex.what()).str());
+    }
+}
+
+static obj_res load_olean_fn(obj_arg l, obj_arg) {
+    load_olean(*reinterpret_cast<olean_load *>(lean_unbox_usize(l)));
+    lean_dec(l);
+    return box(0);
+}
+
+/*
+@[extern "lean_get_olean_load_stats"]
+opaque getOleanLoadStats : BaseIO OleanLoadStats */
+extern "C" LEAN_EXPORT object * lean_get_olean_load_stats(object *) {
+    object * stats = alloc_cnstr(0, 0, 8 * sizeof(uint64));
+    cnstr_set_uint64(stats, 0, g_olean_files);
+    cnstr_set_uint64(stats, sizeof(uint64), g_olean_bytes);
+    cnstr_set_uint64(stats, 2 * sizeof(uint64), g_olean_mapped_files);
+    cnstr_set_uint64(stats, 3 * sizeof(uint64), g_olean_open_ns);
+    cnstr_set_uint64(stats, 4 * sizeof(uint64), g_olean_read_ns);
+    cnstr_set_uint64(stats, 5 * sizeof(uint64), g_olean_fixup_ns);
+    cnstr_set_uint64(stats, 6 * sizeof(uint64), get_mapped_olean_resident_bytes());
+    cnstr_set_uint64(stats, 7 * sizeof(uint64), g_olean_locked_files);
+    return io_result_mk_ok(stats);
+}
+
+/*
+@[extern "lean_read_module_data_many"]
+opaque readModuleDataMany (fnames : @& Array System.FilePath) : IO (Array (ModuleData × CompactedRegion))
+
+The files are opened and mapped in parallel using the task manager, and the results are returned in order. */
+extern "C" LEAN_EXPORT object * lean_read_module_data_many(b_obj_arg fnames, object *) {
+    size_t n = array_size(fnames);
+    std::vector<object *> cached(n, nullptr);
+    std::vector<std::unique_ptr<olean_load>> loads(n);
+    std::vector<olean_load *> todo;
+    for (size_t i = 0; i < n; i++) {
+        cached[i] = find_cached_module_data(string_cstr(array_get(fnames, i)));
+        if (!cached[i]) {
+            loads[i].reset(new olean_load(string_cstr(array_get(fnames, i))));
+            todo.push_back(loads[i].get());
+        }
+    }
+    std::vector<object *> tasks;
+    if (has_task_manager() && todo.size() > 1) {
+        for (size_t i = 1; i < todo.size(); i++) {
+            object * c = lean_alloc_closure(reinterpret_cast<void *>(load_olean_fn), 2, 1);
+            lean_closure_set(c, 0, lean_box_usize(reinterpret_cast<size_t>(todo[i])));
+            tasks.push_back(lean_task_spawn_core(c, 0, false));
+        }
+    }
+    // load the first file on the current thread, and the remaining ones if there is no task manager
+    for (size_t i = 0; i < (tasks.empty() ? todo.size() : 1); i++)
+        load_olean(*todo[i]);
+    for (object * t : tasks) {
+        lean_task_get(t);
+        lean_dec(t);
+    }
+    object * r = lean_alloc_array(0, n);
+    // whether each element of `r` was just loaded
+    std::vector<bool> is_new;
+    std::string error;
+    for (size_t i = 0; i < n; i++) {
+        if (cached[i]) {
+            r = lean_array_push(r, cached[i]);
+            is_new.push_back(false);
+            continue;
+        }
+        olean_load & l = *loads[i];
+        if (!error.empty() || !l.m_error.empty()) {
+            if (error.empty())
+                error = l.m_error;
+            if (l.m_error.empty())
+                l.m_free_data();
+            continue;
+        }
+        try {
+            r = lean_array_push(r, mk_module_data(l));
+            is_new.push_back(true);
+        } catch (exception & ex) {
+            error = (sstream() << "failed to read '" << l.m_fn << "': " << ex.what()).str();
+        }
+    }
+    if (!error.empty()) {
+        // the new regions are not referenced by anything else yet, free them after the objects pointing into them
+        std::vector<compacted_region *> regions;
+        for (size_t i = 0; i < array_size(r); i++) {
+            if (is_new[i])
+                regions.push_back(reinterpret_cast<compacted_region *>(unbox_size_t(cnstr_get(array_get(r, i), 1))));
+        }
+        dec_ref(r);
+        for (compacted_region * region : regions)
+            delete region;
+        return io_result_mk_error(error);
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!cached[i])
+            cache_module_data(loads[i]->m_fn, array_get(r, i));
     }
+    return io_result_mk_ok(r);
 }
 
 /*
@@ -15,4 +15,12 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 namespace lean {
 /** \brief Store module using \c env. */
 void write_module(environment const & env, std::string const & olean_fn);
+
+/** \brief Return a hash of the header of the .olean file \c olean_fn, which identifies its content, or none if it cannot
+    be read or was not created by this build. The payload is not read. */
+optional<uint64> get_olean_header_hash(std::string const & olean_fn);
+
+/** \brief Keep the module data loaded by `readModuleData(Many)` and reuse it when the same unchanged file is read again,
+    for processes that import modules repeatedly such as `lean --build-worker`. */
+void set_module_data_cache(bool enabled);
 }
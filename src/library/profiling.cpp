@@ -20,10 +20,46 @@ second_duration get_profiling_threshold(options const & opts) {
     return second_duration(ms);
 }
 
+static name * g_profiler_trace = nullptr;
+static name * g_profiler_counters = nullptr;
+static name * g_profiler_report = nullptr;
+
+char const * get_profiling_report_file(options const & opts) {
+    char const * fn = opts.get_string(*g_profiler_report, "");
+    return *fn ? fn : nullptr;
+}
+
+bool get_profiling_counters(options const & opts) {
+    return opts.get_bool(*g_profiler_counters, false);
+}
+
+char const * get_profiling_trace_file(options const & opts) {
+    char const * fn = opts.get_string(*g_profiler_trace, "");
+    return *fn ? fn : nullptr;
+}
+
 void initialize_profiling() {
+    g_profiler_trace = new name{"profiler", "trace"};
+    mark_persistent(g_profiler_trace->raw());
+    register_option(*g_profiler_trace, {}, data_value_kind::String, "",
+                    "(profiler) if non-empty, write the tasks measured by `profiler` to this file, "
+                    "in the Chrome trace event format (supported by Perfetto)");
+    g_profiler_report = new name{"profiler", "report"};
+    mark_persistent(g_profiler_report->raw());
+    register_option(*g_profiler_report, {}, data_value_kind::String, "",
+                    "(profiler) if non-empty, write the time and heartbeats of every declaration measured by `profiler` "
+                    "to this file, one JSON object per line and independently of `profiler.threshold`");
+    g_profiler_counters = new name{"profiler", "counters"};
+    mark_persistent(g_profiler_counters->raw());
+    register_bool_option(*g_profiler_counters, false,
+                         "(profiler) report hardware performance counters (cycles, instructions, cache misses, "
+                         "branch misses) of each category in the cumulative profile (Linux only)");
 }
 
 void finalize_profiling() {
+    delete g_profiler_trace;
+    delete g_profiler_counters;
+    delete g_profiler_report;
 }
 
 }
@@ -14,6 +14,12 @@ using second_duration = std::chrono::duration<double>;
 
 bool get_profiler(options const &);
 second_duration get_profiling_threshold(options const &);
+/** \brief Return the file specified by the `profiler.trace` option, or `nullptr` if it is not set. */
+char const * get_profiling_trace_file(options const &);
+/** \brief Return the file specified by the `profiler.report` option, or `nullptr` if it is not set. */
+char const * get_profiling_report_file(options const &);
+/** \brief Return true if the `profiler.counters` option is set. */
+bool get_profiling_counters(options const &);
 
 void initialize_profiling();
 void finalize_profiling();
@@ -4,67 +4,260 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Sebastian Ullrich
 */
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <map>
+#include <vector>
+#include "runtime/alloc.h"
+#include "util/perf_counters.h"
 #include "library/time_task.h"
 #include "kernel/trace.h"
 
 namespace lean {
 
-static std::map<std::string, second_duration> * g_cum_times;
-static mutex * g_cum_times_mutex;
+/* Profiling data of a thread. It is only updated by its thread, the mutex is only contended while reporting. */
+struct thread_profile {
+    unsigned                               m_thread_idx;
+    mutex                                  m_mutex;
+    std::map<std::string, second_duration> m_cum_times;
+    std::map<std::string, uint64>          m_cum_allocs;
+    std::map<std::string, perf_counter_values> m_cum_counters;
+    std::vector<profiling_span>            m_spans;
+    uint64                                 m_dropped_spans{0};
+    thread_profile(unsigned idx):m_thread_idx(idx) {}
+};
+
+static std::vector<thread_profile *> * g_thread_profiles;
+static mutex * g_thread_profiles_mutex;
+static std::chrono::steady_clock::time_point g_profiling_start;
+static bool g_record_spans = false;
+/* Output of `set_profiling_report_file`, guarded by `g_thread_profiles_mutex`. */
+static std::ofstream * g_report_out = nullptr;
+LEAN_THREAD_PTR(thread_profile, g_thread_profile);
 LEAN_THREAD_PTR(time_task, g_current_time_task);
 
+static thread_profile & get_thread_profile() {
+    if (!g_thread_profile) {
+        lock_guard<mutex> _(*g_thread_profiles_mutex);
+        g_thread_profile = new thread_profile(g_thread_profiles->size());
+        g_thread_profiles->push_back(g_thread_profile);
+    }
+    return *g_thread_profile;
+}
+
 void report_profiling_time(std::string const & category, second_duration time) {
-    lock_guard<mutex> _(*g_cum_times_mutex);
-    (*g_cum_times)[category] += time;
+    thread_profile & p = get_thread_profile();
+    lock_guard<mutex> _(p.m_mutex);
+    p.m_cum_times[category] += time;
+}
+
+void report_profiling_allocs(std::string const & category, uint64 num_allocs) {
+    thread_profile & p = get_thread_profile();
+    lock_guard<mutex> _(p.m_mutex);
+    p.m_cum_allocs[category] += num_allocs;
+}
+
+void report_profiling_counters(std::string const & category, perf_counter_values const & counters) {
+    thread_profile & p = get_thread_profile();
+    lock_guard<mutex> _(p.m_mutex);
+    p.m_cum_counters[category] += counters;
+}
+
+static void report_profiling_span(profiling_span && s) {
+    thread_profile & p = get_thread_profile();
+    lock_guard<mutex> _(p.m_mutex);
+    if (p.m_spans.size() < LEAN_PROFILING_MAX_SPANS_PER_THREAD)
+        p.m_spans.push_back(std::move(s));
+    else
+        p.m_dropped_spans++;
 }
 
 void display_cumulative_profiling_times(std::ostream & out) {
-    if (g_cum_times->empty())
+    std::map<std::string, second_duration> cum_times;
+    std::map<std::string, uint64> cum_allocs;
+    std::map<std::string, perf_counter_values> cum_counters;
+    {
+        lock_guard<mutex> _(*g_thread_profiles_mutex);
+        for (thread_profile * p : *g_thread_profiles) {
+            lock_guard<mutex> _(p->m_mutex);
+            for (auto const & e : p->m_cum_times)
+                cum_times[e.first] += e.second;
+            for (auto const & e : p->m_cum_allocs)
+                cum_allocs[e.first] += e.second;
+            for (auto const & e : p->m_cum_counters)
+                cum_counters[e.first] += e.second;
+        }
+    }
+    if (cum_times.empty())
         return;
     sstream ss;
     ss << "cumulative profiling times:\n";
-    for (auto const & p : *g_cum_times)
-        ss << "\t" << p.first << " " << display_profiling_time{p.second} << "\n";
+    for (auto const & p : cum_times) {
+        ss << "\t" << p.first << " " << display_profiling_time{p.second};
+        auto it = cum_allocs.find(p.first);
+        if (it != cum_allocs.end())
+            ss << ", " << it->second << " allocations";
+        auto it2 = cum_counters.find(p.first);
+        if (it2 != cum_counters.end())
+            ss << ", " << display_perf_counters{it2->second};
+        ss << "\n";
+    }
     // output atomically, like IO.print
     out << ss.str();
 }
 
+void set_record_profiling_spans(bool enabled) {
+    g_record_spans = enabled;
+}
+
+static void write_json_string(std::ostream & out, std::string const & s) {
+    out << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+bool set_profiling_report_file(char const * fname) {
+    lock_guard<mutex> _(*g_thread_profiles_mutex);
+    delete g_report_out;
+    g_report_out = new std::ofstream(fname);
+    return !g_report_out->fail();
+}
+
+/* Write a line of the per-declaration report, see `set_profiling_report_file`. */
+static void report_profiling_decl(std::string const & category, name const & decl, second_duration time,
+                                  uint64 allocs) {
+    std::ostringstream ss;
+    ss << "{\"decl\":";
+    write_json_string(ss, decl.to_string());
+    ss << ",\"category\":";
+    write_json_string(ss, category);
+    ss << ",\"time\":" << time.count() << ",\"heartbeats\":" << allocs << "}\n";
+    lock_guard<mutex> _(*g_thread_profiles_mutex);
+    *g_report_out << ss.str();
+    g_report_out->flush();
+}
+
+static double to_microseconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+void write_profiling_trace(std::ostream & out) {
+    lock_guard<mutex> _(*g_thread_profiles_mutex);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (thread_profile * p : *g_thread_profiles) {
+        lock_guard<mutex> _(p->m_mutex);
+        for (profiling_span const & s : p->m_spans) {
+            out << (first ? "\n" : ",\n");
+            first = false;
+            out << "{\"ph\":\"X\",\"pid\":0,\"tid\":" << p->m_thread_idx << ",\"name\":";
+            write_json_string(out, s.m_category);
+            out << ",\"ts\":" << to_microseconds(s.m_start - g_profiling_start)
+                << ",\"dur\":" << to_microseconds(s.m_end - s.m_start)
+                << ",\"args\":{\"allocations\":" << s.m_allocs;
+            if (s.m_decl) {
+                out << ",\"decl\":";
+                write_json_string(out, s.m_decl.to_string());
+            }
+            out << "}}";
+        }
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"ph\":\"M\",\"pid\":0,\"tid\":" << p->m_thread_idx
+            << ",\"name\":\"thread_name\",\"args\":{\"name\":\"thread " << p->m_thread_idx;
+        if (p->m_dropped_spans > 0)
+            out << " (" << p->m_dropped_spans << " spans dropped)";
+        out << "\"}}";
+    }
+    out << "\n]}\n";
+}
+
 void initialize_time_task() {
-    g_cum_times_mutex = new mutex;
-    g_cum_times = new std::map<std::string, second_duration>;
+    g_thread_profiles_mutex = new mutex;
+    g_thread_profiles = new std::vector<thread_profile *>;
+    g_profiling_start = std::chrono::steady_clock::now();
 }
 
 void finalize_time_task() {
-    delete g_cum_times;
-    delete g_cum_times_mutex;
+    delete g_report_out;
+    for (thread_profile * p : *g_thread_profiles)
+        delete p;
+    delete g_thread_profiles;
+    delete g_thread_profiles_mutex;
 }
 
-time_task::time_task(std::string const & category, options const & opts, name decl) :
-        m_category(category) {
+time_task::time_task(std::string const & category, options const & opts, name decl, bool count_allocs) :
+        m_category(category), m_decl(decl), m_count_allocs(count_allocs) {
     if (get_profiler(opts)) {
         m_timeit = optional<xtimeit>(get_profiling_threshold(opts), [=](second_duration duration) mutable {
             sstream ss;
             ss << m_category;
             if (decl)
                 ss << " of " << decl;
-            ss << " took " << display_profiling_time{duration} << "\n";
+            ss << " took " << display_profiling_time{duration};
+            if (m_count_allocs)
+                ss << ", " << m_allocs << " allocations";
+            ss << "\n";
             // output atomically, like IO.print
             tout() << ss.str();
         });
         m_parent_task = g_current_time_task;
         g_current_time_task = this;
+        /* The heartbeats of a thread are the number of small objects it has allocated. */
+        m_start_allocs = get_num_heartbeats();
+        if (perf_counters_enabled()) {
+            perf_counter_values start;
+            if (read_perf_counters(start))
+                m_start_counters = optional<perf_counter_values>(start);
+        }
+        if (g_record_spans) {
+            m_span = optional<profiling_span>(profiling_span());
+            m_span->m_category = m_category;
+            m_span->m_decl     = decl;
+            m_span->m_start    = std::chrono::steady_clock::now();
+        }
     }
 }
 
 time_task::~time_task() {
     if (m_timeit) {
         g_current_time_task = m_parent_task;
+        uint64 allocs = get_num_heartbeats() - m_start_allocs;
+        m_allocs = allocs - m_nested_allocs;
         report_profiling_time(m_category, m_timeit->get_elapsed());
-        if (m_parent_task && m_parent_task->m_timeit)
+        if (g_report_out && m_decl)
+            report_profiling_decl(m_category, m_decl, m_timeit->get_elapsed(), m_allocs);
+        if (m_count_allocs)
+            report_profiling_allocs(m_category, m_allocs);
+        perf_counter_values counters;
+        if (m_start_counters && read_perf_counters(counters)) {
+            counters -= *m_start_counters;
+            report_profiling_counters(m_category, counters - m_nested_counters);
+            if (m_parent_task)
+                m_parent_task->m_nested_counters += counters;
+        }
+        if (m_span) {
+            m_span->m_end    = std::chrono::steady_clock::now();
+            m_span->m_allocs = allocs;
+            report_profiling_span(std::move(*m_span));
+        }
+        if (m_parent_task && m_parent_task->m_timeit) {
             // report exclusive times
             m_parent_task->m_timeit->exclude_duration(m_timeit->get_elapsed_inclusive());
+            m_parent_task->m_nested_allocs += allocs;
+        }
     }
 }
 
@@ -6,21 +6,59 @@ Author: Sebastian Ullrich
 */
 #pragma once
 #include <string>
+#include <chrono>
 #include "library/profiling.h"
 #include "util/timeit.h"
+#include "util/perf_counters.h"
 #include "util/message_definitions.h"
 
+#ifndef LEAN_PROFILING_MAX_SPANS_PER_THREAD
+#define LEAN_PROFILING_MAX_SPANS_PER_THREAD (1u << 20)
+#endif
+
 namespace lean {
 void report_profiling_time(std::string const & category, second_duration time);
 void display_cumulative_profiling_times(std::ostream & out);
 
-/** Measure time of some task and report it for the final cumulative profile. */
+void report_profiling_allocs(std::string const & category, uint64 num_allocs);
+void report_profiling_counters(std::string const & category, perf_counter_values const & counters);
+
+/** \brief A task measured by `time_task`. Its duration and number of allocations include nested tasks. */
+struct profiling_span {
+    std::string                           m_category;
+    name                                  m_decl;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_end;
+    uint64                                m_allocs{0};
+};
+
+/** \brief Record the tasks measured by `time_task` in the current thread's buffer, to be written by
+    `write_profiling_trace`. */
+void set_record_profiling_spans(bool enabled);
+/** \brief Write the recorded tasks of all threads in the Chrome trace event format. */
+void write_profiling_trace(std::ostream & out);
+/** \brief Write a line to `fname` in the JSON lines format for every task with a declaration measured by
+    `time_task`, independently of the profiling threshold. Each line contains the declaration, the category, and the
+    exclusive time in seconds and number of heartbeats of the task. Return false if the file cannot be created. */
+bool set_profiling_report_file(char const * fname);
+
+/** Measure time of some task and report it for the final cumulative profile. If `count_allocs` is true, the number
+    of small objects allocated by the task is reported as well. If hardware performance counters are enabled (see
+    `set_perf_counters_enabled`), they are also reported. Like the time, they exclude nested tasks. */
 class time_task {
     std::string     m_category;
+    name            m_decl;
+    bool            m_count_allocs;
+    uint64          m_start_allocs{0};
+    uint64          m_nested_allocs{0};
+    uint64          m_allocs{0};
     optional<xtimeit> m_timeit;
+    optional<profiling_span> m_span;
+    optional<perf_counter_values> m_start_counters;
+    perf_counter_values m_nested_counters;
     time_task *     m_parent_task;
 public:
-    time_task(std::string const & category, options const & opts, name decl = name());
+    time_task(std::string const & category, options const & opts, name decl = name(), bool count_allocs = false);
     ~time_task();
 };
 
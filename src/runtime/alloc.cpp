@@ -4,11 +4,18 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
-#include <vector>
+#include <cmath>
 #include <lean/lean.h>
+#if defined(LEAN_MMAP)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "runtime/int64.h"
 #include "runtime/thread.h"
 #include "runtime/debug.h"
+#include "runtime/numa.h"
 #include "runtime/alloc.h"
+#include "runtime/heap_profile.h"
 
 #ifdef LEAN_RUNTIME_STATS
 #define LEAN_RUNTIME_STAT_CODE(c) c
@@ -24,11 +31,14 @@ Author: Leonardo de Moura
 
 #define LEAN_PAGE_SIZE             8192        // 8 Kb
 #define LEAN_SEGMENT_SIZE          8*1024*1024 // 8 Mb
+#define LEAN_HUGE_PAGE_SIZE        2*1024*1024 // 2 Mb
 #define LEAN_NUM_SLOTS             (LEAN_MAX_SMALL_OBJECT_SIZE / LEAN_OBJECT_SIZE_DELTA)
-#define LEAN_MAX_TO_EXPORT_OBJS    1024
+#define LEAN_PURGE_CHECK_FREQ      64          // number of cold allocator events between clock reads
+#define LEAN_ALLOC_BUDGET          64*1024     // small allocations of a thread between updates of `g_allocated_bytes`
 
 LEAN_CASSERT(LEAN_PAGE_SIZE > LEAN_MAX_SMALL_OBJECT_SIZE);
 LEAN_CASSERT(LEAN_SEGMENT_SIZE > LEAN_PAGE_SIZE);
+LEAN_CASSERT(LEAN_SEGMENT_SIZE % LEAN_HUGE_PAGE_SIZE == 0);
 
 namespace lean {
 
@@ -42,8 +52,12 @@ static atomic<uint64> g_num_dealloc(0);
 static atomic<uint64> g_num_small_dealloc(0);
 static atomic<uint64> g_num_segments(0);
 static atomic<uint64> g_num_pages(0);
-static atomic<uint64> g_num_exports(0);
+static atomic<uint64> g_num_remote_frees(0);
 static atomic<uint64> g_num_recycled_pages(0);
+static atomic<uint64> g_num_adopted_pages(0);
+static atomic<uint64> g_num_purged_segments(0);
+static atomic<uint64> g_num_reused_segments(0);
+static atomic<uint64> g_num_huge_segments(0);
 struct alloc_stats {
     ~alloc_stats() {
         std::cerr << "num. alloc.:         " << g_num_alloc << "\n";
@@ -53,7 +67,11 @@ struct alloc_stats {
         std::cerr << "num. segments:       " << g_num_segments << "\n";
         std::cerr << "num. pages:          " << g_num_pages << "\n";
         std::cerr << "num. recycled pages: " << g_num_recycled_pages << "\n";
-        std::cerr << "num. exports:        " << g_num_exports << "\n";
+        std::cerr << "num. adopted pages:  " << g_num_adopted_pages << "\n";
+        std::cerr << "num. purged segm.:   " << g_num_purged_segments << "\n";
+        std::cerr << "num. reused segm.:   " << g_num_reused_segments << "\n";
+        std::cerr << "num. huge segm.:     " << g_num_huge_segments << "\n";
+        std::cerr << "num. remote frees:   " << g_num_remote_frees << "\n";
     }
 };
 static alloc_stats g_alloc_stats;
@@ -71,6 +89,8 @@ struct page_header {
     unsigned         m_num_free;
     unsigned         m_slot_idx;
     bool             m_in_page_free_list;
+    /* True if objects of this page have been sampled by the heap profiler, see `runtime/heap_profile.h`. */
+    bool             m_sampled;
 };
 
 struct page {
@@ -83,6 +103,7 @@ struct page {
     void set_heap(heap * h) { m_header.m_heap = h; }
     heap * get_heap() { return m_header.m_heap; }
     bool has_many_free() const { return m_header.m_num_free > m_header.m_max_free / 4; }
+    bool is_empty() const { return m_header.m_num_free == m_header.m_max_free; }
     bool in_page_free_list() const { return m_header.m_in_page_free_list; }
     unsigned get_slot_idx() const { return m_header.m_slot_idx; }
     void push_free_obj(void * o);
@@ -92,10 +113,20 @@ inline char * align_ptr(char * p, size_t a) {
     return reinterpret_cast<char*>(lean_align(reinterpret_cast<size_t>(p), a));
 }
 
-struct segment {
+struct segment;
+struct segment_header {
     segment *    m_next{nullptr};
     char *       m_next_page_mem;
-    char         m_data[LEAN_SEGMENT_SIZE];
+    /* Time at which all pages of this segment were first observed to be empty (if `m_empty`). */
+    chrono::steady_clock::time_point m_empty_since;
+    bool         m_empty{false};
+    /* True if the segment is backed by explicit huge pages (`MAP_HUGETLB`). */
+    bool         m_huge_tlb{false};
+};
+
+/* The header is included in the segment size so that segments can be exactly covered by huge pages. */
+struct segment : public segment_header {
+    char         m_data[LEAN_SEGMENT_SIZE - sizeof(segment_header)];
 
     char * get_first_page_mem() {
         lean_assert(align_ptr(m_data, LEAN_PAGE_SIZE) >= m_data);
@@ -108,53 +139,115 @@ struct segment {
     }
 
     bool is_full() const {
-        return m_next_page_mem + LEAN_PAGE_SIZE > m_data + LEAN_SEGMENT_SIZE;
+        return m_next_page_mem + LEAN_PAGE_SIZE > reinterpret_cast<char const *>(this) + LEAN_SEGMENT_SIZE;
+    }
+
+    void reset() {
+        m_next_page_mem = get_first_page_mem();
+        m_empty = false;
     }
 };
 
+LEAN_CASSERT(sizeof(segment) == LEAN_SEGMENT_SIZE);
+
 struct heap {
     segment * m_curr_segment{nullptr};
     heap *    m_next_orphan{nullptr};
+    heap *    m_next_heap{nullptr}; /* list of all heaps, see `heap_manager::m_heaps` */
+    int       m_numa_node{-1};      /* NUMA node new segments are bound to, or -1 */
     page *    m_curr_page[LEAN_NUM_SLOTS];
     page *    m_page_free_list[LEAN_NUM_SLOTS];
-    /* Objects that must be sent to other heaps. */
-    void *    m_to_export_list{nullptr};
-    unsigned  m_to_export_list_size{0};
-    mutex     m_mutex; /* for the following fields */
-    /* The following list contains object by this heap that were deallocated
-       by other heaps. */
-    void *    m_to_import_list{nullptr};
+    /* Multi-producer single-consumer list of objects owned by this heap that were deallocated
+       by other threads. Other threads push objects using compare-and-swap, and the owner
+       takes the whole list at once in `import_objs`. */
+    atomic<void *> m_to_import_list{nullptr};
     uint64_t  m_heartbeat{0}; /* Counter for implementing "deterministic timeouts". It is currently the number of small allocations */
+    /* Per size class counters. They are only updated by the thread currently owning the heap, but they are read by
+       `get_alloc_stats` from arbitrary threads. Deallocations are counted in the heap of the thread executing them,
+       and page counters may become negative when pages are adopted by other heaps. Only the sum over all heaps is
+       meaningful. The allocation and deallocation counters sit on the fast paths and are only maintained if
+       `LEAN_RUNTIME_STATS` is defined, the page counters are only updated on the cold paths and always maintained. */
+    atomic<uint64_t> m_slot_num_alloc[LEAN_NUM_SLOTS];
+    atomic<uint64_t> m_slot_num_free[LEAN_NUM_SLOTS];
+    atomic<uint64_t> m_slot_num_pages[LEAN_NUM_SLOTS];
+    /* Segments whose memory has been returned to the OS. They are reused before allocating new ones. */
+    segment * m_purged_segments{nullptr};
+    unsigned  m_purge_check_counter{0};
+    chrono::steady_clock::time_point m_last_purge_check;
+    /* Number of bytes to be allocated before the next heap profiler sample. */
+    int64_t   m_sample_countdown{INT64_MAX};
+    uint64_t  m_sample_rng{0x9E3779B97F4A7C15ull};
+    /* Number of bytes to be allocated before the bytes allocated and deallocated by the owner of this heap since the
+       last update are added to `g_allocated_bytes`, see `account_allocated_bytes`. */
+    int64_t   m_alloc_budget{LEAN_ALLOC_BUDGET};
+    int64_t   m_freed_bytes{0};
     void import_objs();
-    void export_objs();
+    void push_remote_obj(void * o);
     void alloc_segment();
+    bool is_purgeable(segment * s);
+    void purge_segment(segment * s);
+    void purge_segments();
+    void maybe_purge_segments();
 };
 
+/* Orphan heaps are kept in a lock-free (Treiber) stack. To avoid the ABA problem, the head
+   pointer is packed together with a counter that is incremented on every update.
+   Remark: heaps are never deleted, so it is safe to read `m_next_orphan` of a heap
+   that has been concurrently popped by another thread. */
 struct heap_manager {
-    /* The mutex protects the list of orphan segments. */
-    mutex             m_mutex;
-    heap *            m_orphans{nullptr};
+#if UINTPTR_MAX > 0xFFFFFFFF
+    static constexpr unsigned ptr_bits = 48; /* user-space virtual addresses fit in 48 bits */
+#else
+    static constexpr unsigned ptr_bits = 32;
+#endif
+    static constexpr uint64_t ptr_mask = (static_cast<uint64_t>(1) << ptr_bits) - 1;
+    atomic<uint64_t>  m_orphans{0};
+    /* All heaps ever created, used to collect statistics. Heaps are never removed from this list. */
+    atomic<heap *>    m_heaps{nullptr};
+
+    void register_heap(heap * h) {
+        heap * head = m_heaps.load();
+        do {
+            h->m_next_heap = head;
+        } while (!m_heaps.compare_exchange_strong(head, h));
+    }
+
+    static heap * get_heap(uint64_t v) {
+        return reinterpret_cast<heap *>(static_cast<uintptr_t>(v & ptr_mask));
+    }
+
+    static uint64_t mk_tagged(heap * h, uint64_t old) {
+        lean_assert((reinterpret_cast<uintptr_t>(h) & ~ptr_mask) == 0);
+        uint64_t tag = (old >> ptr_bits) + 1;
+        return (tag << ptr_bits) | static_cast<uint64_t>(reinterpret_cast<uintptr_t>(h));
+    }
+
+    bool has_orphans() const {
+        return get_heap(m_orphans.load()) != nullptr;
+    }
 
     void push_orphan(heap * h) {
-        /* TODO(Leo): avoid mutex */
-        lock_guard<mutex> lock(m_mutex);
-        h->m_next_orphan = m_orphans;
-        m_orphans = h;
+        uint64_t old = m_orphans.load();
+        do {
+            h->m_next_orphan = get_heap(old);
+        } while (!m_orphans.compare_exchange_strong(old, mk_tagged(h, old)));
     }
 
     heap * pop_orphan() {
-        /* TODO(Leo): avoid mutex */
-        lock_guard<mutex> lock(m_mutex);
-        if (m_orphans) {
-            heap * h = m_orphans;
-            m_orphans = h->m_next_orphan;
-            return h;
-        } else {
-            return nullptr;
+        uint64_t old = m_orphans.load();
+        while (heap * h = get_heap(old)) {
+            if (m_orphans.compare_exchange_strong(old, mk_tagged(h->m_next_orphan, old)))
+                return h;
         }
+        return nullptr;
     }
 };
 
+/* Increment a counter that is only written by one thread at a time. */
+static inline void inc_counter(atomic<uint64_t> & c, uint64_t d = 1) {
+    c.store(c.load(memory_order_relaxed) + d, memory_order_relaxed);
+}
+
 static inline page * get_page_of(void * o) {
     return reinterpret_cast<page*>((reinterpret_cast<size_t>(o)/LEAN_PAGE_SIZE)*LEAN_PAGE_SIZE);
 }
@@ -175,29 +268,30 @@ static inline void page_list_insert(page * & head, page * new_head) {
     if (head)
         head->set_prev(new_head);
     new_head->set_next(head);
+    new_head->set_prev(nullptr);
     head = new_head;
 }
 
 static inline void page_list_remove(page * & head, page * to_remove) {
-    if (head == to_remove) {
-        /* First element */
-        head = to_remove->get_next();
-    }
     page * prev = to_remove->get_prev();
-    lean_assert(prev);
-    if (page * next = to_remove->get_next()) {
+    page * next = to_remove->get_next();
+    if (prev) {
         prev->set_next(next);
-        next->set_prev(prev);
     } else {
-        /* Last element */
-        prev->set_next(nullptr);
+        /* First element */
+        lean_assert(head == to_remove);
+        head = next;
     }
+    if (next)
+        next->set_prev(prev);
 }
 
 static inline page * page_list_pop(page * & head) {
     lean_assert(head);
     page * r = head;
     head = head->get_next();
+    if (head)
+        head->set_prev(nullptr);
     return r;
 }
 
@@ -216,66 +310,194 @@ void page::push_free_obj(void * o) {
             page_list_insert(h->m_page_free_list[slot_idx], this);
         }
     }
+    if (LEAN_UNLIKELY(is_empty()))
+        get_heap()->maybe_purge_segments();
 }
 
 void heap::import_objs() {
-    void * to_import = nullptr;
-    {   // TODO(Leo): avoid mutex using compare and swap
-        lock_guard<mutex> lock(m_mutex);
-        to_import = m_to_import_list;
-        m_to_import_list = nullptr;
-    }
+    if (m_to_import_list.load() == nullptr)
+        return;
+    void * to_import = m_to_import_list.exchange(nullptr);
     while (to_import) {
         page * p = get_page_of(to_import);
         void * n = get_next_obj(to_import);
-        p->push_free_obj(to_import);
+        heap * h = p->get_heap();
+        if (LEAN_LIKELY(h == this)) {
+            p->push_free_obj(to_import);
+        } else {
+            /* The page was adopted by another heap (see `adopt_orphan_page`) after the object
+               was sent to us. */
+            h->push_remote_obj(to_import);
+        }
         to_import = n;
     }
 }
 
-struct export_entry {
-    heap * m_heap;
-    void * m_head;
-    void * m_tail;
-};
+/* Remark: this method is executed by threads that do not own this heap. */
+void heap::push_remote_obj(void * o) {
+    void * head = m_to_import_list.load();
+    do {
+        set_next_obj(o, head);
+    } while (!m_to_import_list.compare_exchange_strong(head, o));
+}
 
-void heap::export_objs() {
-    std::vector<export_entry> to_export;
-    void * o = m_to_export_list;
-    while (o != nullptr) {
-        void * n   = get_next_obj(o);
-        heap * h   = get_page_of(o)->get_heap();
-        bool found = false;
-        for (export_entry & e : to_export) {
-            if (e.m_heap == h) {
-                set_next_obj(o, e.m_head);
-                e.m_head = o;
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            set_next_obj(o, nullptr);
-            to_export.push_back(export_entry{h, o, o});
-        }
-        o = n;
+/* Huge page mode for new segments, see `set_segment_huge_pages`. */
+static atomic<unsigned> g_segment_huge_pages(0);
+
+#if defined(LEAN_MMAP)
+static char * mmap_huge_aligned(size_t sz) {
+    /* Over-allocate to be able to align the segment to a huge page boundary and trim the excess. */
+    size_t map_sz = sz + LEAN_HUGE_PAGE_SIZE;
+    void * r = mmap(nullptr, map_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED)
+        return nullptr;
+    char * begin   = static_cast<char *>(r);
+    char * aligned = align_ptr(begin, LEAN_HUGE_PAGE_SIZE);
+    char * end     = begin + map_sz;
+    if (aligned > begin)
+        munmap(begin, aligned - begin);
+    if (aligned + sz < end)
+        munmap(aligned + sz, end - (aligned + sz));
+#if defined(MADV_HUGEPAGE)
+    madvise(aligned, sz, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+static segment * alloc_huge_segment(unsigned mode) {
+    void * mem = nullptr;
+    bool huge_tlb = false;
+#if defined(MAP_HUGETLB)
+    if (mode == LEAN_HUGE_PAGES_EXPLICIT) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#if defined(MAP_HUGE_2MB)
+        flags |= MAP_HUGE_2MB;
+#endif
+        mem = mmap(nullptr, LEAN_SEGMENT_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mem == MAP_FAILED)
+            mem = nullptr; /* no huge pages reserved, fall back to transparent huge pages */
+        else
+            huge_tlb = true;
     }
-    m_to_export_list      = nullptr;
-    m_to_export_list_size = 0;
-    for (export_entry const & e : to_export) {
-        unique_lock<mutex> lock(e.m_heap->m_mutex);
-        set_next_obj(e.m_tail, e.m_heap->m_to_import_list);
-        e.m_heap->m_to_import_list = e.m_head;
+#else
+    (void)mode;
+#endif
+    if (mem == nullptr)
+        mem = mmap_huge_aligned(LEAN_SEGMENT_SIZE);
+    if (mem == nullptr)
+        return nullptr;
+    LEAN_RUNTIME_STAT_CODE(g_num_huge_segments++);
+    segment * s = new (mem) segment();
+    s->m_huge_tlb = huge_tlb;
+    return s;
+}
+#endif
+
+static segment * alloc_segment_memory() {
+#if defined(LEAN_MMAP)
+    if (unsigned mode = g_segment_huge_pages) {
+        if (segment * s = alloc_huge_segment(mode))
+            return s;
     }
+#endif
+    return new segment();
 }
 
 void heap::alloc_segment() {
-    LEAN_RUNTIME_STAT_CODE(g_num_segments++);
-    segment * s = new segment();
+    segment * s;
+    if (m_purged_segments) {
+        LEAN_RUNTIME_STAT_CODE(g_num_reused_segments++);
+        s = m_purged_segments;
+        m_purged_segments = s->m_next;
+        s->reset();
+    } else {
+        LEAN_RUNTIME_STAT_CODE(g_num_segments++);
+        s = alloc_segment_memory();
+        if (m_numa_node >= 0 && is_numa_aware())
+            numa_bind_memory(s, LEAN_SEGMENT_SIZE, m_numa_node);
+    }
     s->m_next   = m_curr_segment;
     m_curr_segment = s;
 }
 
+/* Delay in milliseconds after which a segment containing only empty pages is returned to the OS.
+   The value 0 disables purging. */
+static atomic<unsigned> g_segment_purge_delay(0);
+
+/* Return true if all pages in `s` are empty and can be removed from the page lists of this heap. */
+bool heap::is_purgeable(segment * s) {
+    if (s == m_curr_segment)
+        return false;
+    for (char * mem = s->get_first_page_mem(); mem < s->m_next_page_mem; mem += LEAN_PAGE_SIZE) {
+        page * p = reinterpret_cast<page *>(mem);
+        /* Pages adopted by other heaps cannot be removed from their lists by us. */
+        if (p->get_heap() != this || !p->is_empty())
+            return false;
+        /* `lean_alloc_small` assumes `m_curr_page[slot_idx]` is never null. */
+        if (m_curr_page[p->get_slot_idx()] == p)
+            return false;
+    }
+    return true;
+}
+
+void heap::purge_segment(segment * s) {
+    LEAN_RUNTIME_STAT_CODE(g_num_purged_segments++);
+    char * begin = s->get_first_page_mem();
+    for (char * mem = begin; mem < s->m_next_page_mem; mem += LEAN_PAGE_SIZE) {
+        page * p = reinterpret_cast<page *>(mem);
+        unsigned slot_idx = p->get_slot_idx();
+        inc_counter(m_slot_num_pages[slot_idx], static_cast<uint64_t>(-1));
+        if (p->in_page_free_list())
+            page_list_remove(m_page_free_list[slot_idx], p);
+        else
+            page_list_remove(m_curr_page[slot_idx], p);
+    }
+#if defined(LEAN_MMAP)
+    /* `madvise` on memory mapped with `MAP_HUGETLB` requires huge page aligned ranges. */
+    size_t os_page_size = s->m_huge_tlb ? LEAN_HUGE_PAGE_SIZE : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    char * b = align_ptr(begin, os_page_size);
+    char * e = reinterpret_cast<char *>((reinterpret_cast<size_t>(s->m_next_page_mem) / os_page_size) * os_page_size);
+    if (b < e)
+        madvise(b, e - b, MADV_DONTNEED);
+#endif
+    s->reset();
+    s->m_next = m_purged_segments;
+    m_purged_segments = s;
+}
+
+void heap::purge_segments() {
+    unsigned delay = g_segment_purge_delay;
+    auto now = chrono::steady_clock::now();
+    segment ** it = &m_curr_segment;
+    while (segment * s = *it) {
+        if (!is_purgeable(s)) {
+            s->m_empty = false;
+        } else if (!s->m_empty) {
+            s->m_empty       = true;
+            s->m_empty_since = now;
+        } else if (now - s->m_empty_since >= chrono::milliseconds(delay)) {
+            *it = s->m_next;
+            purge_segment(s);
+            continue;
+        }
+        it = &s->m_next;
+    }
+}
+
+/* Cheap check executed on cold allocator paths. The segments are only scanned when purging is enabled and
+   enough time has elapsed since the last scan. */
+void heap::maybe_purge_segments() {
+    unsigned delay = g_segment_purge_delay;
+    if (delay == 0 || ++m_purge_check_counter < LEAN_PURGE_CHECK_FREQ)
+        return;
+    m_purge_check_counter = 0;
+    auto now = chrono::steady_clock::now();
+    if (now - m_last_purge_check < chrono::milliseconds(delay / 2))
+        return;
+    m_last_purge_check = now;
+    purge_segments();
+}
+
 static page * alloc_page(heap * h, unsigned obj_size) {
     lean_assert(lean_align(obj_size, LEAN_OBJECT_SIZE_DELTA) == obj_size);
     segment * s = h->m_curr_segment;
@@ -287,6 +509,7 @@ static page * alloc_page(heap * h, unsigned obj_size) {
         h->alloc_segment();
     }
     unsigned slot_idx        = lean_get_slot_idx(obj_size);
+    inc_counter(h->m_slot_num_pages[slot_idx]);
     p->m_header.m_heap       = h;
     page_list_insert(h->m_curr_page[slot_idx], p);
     p->m_header.m_slot_idx   = slot_idx;
@@ -318,12 +541,55 @@ static page * alloc_page(heap * h, unsigned obj_size) {
     p->m_header.m_max_free   = num_free;
     p->m_header.m_num_free   = num_free;
     p->m_header.m_in_page_free_list = false;
+    p->m_header.m_sampled    = false;
     return p;
 }
 
+/* Try to take a page for objects of the given slot from an orphan heap with enough free
+   objects in it. Orphan heaps are adopted wholesale only when a new thread starts, so heaps of
+   retired threads that still contain a few live objects would otherwise only be reused by
+   thread creation. Taking individual pages allows running threads to reuse this memory
+   instead of allocating fresh pages. */
+static page * adopt_orphan_page(heap * h, unsigned slot_idx) {
+    if (!g_heap_manager->has_orphans())
+        return nullptr;
+    heap * o = g_heap_manager->pop_orphan();
+    if (o == nullptr)
+        return nullptr;
+    /* We own `o` until we push it back. */
+    o->import_objs();
+    page * p = nullptr;
+    if (o->m_page_free_list[slot_idx] != nullptr) {
+        LEAN_RUNTIME_STAT_CODE(g_num_adopted_pages++);
+        p = page_list_pop(o->m_page_free_list[slot_idx]);
+        p->m_header.m_in_page_free_list = false;
+        p->set_heap(h);
+        inc_counter(o->m_slot_num_pages[slot_idx], static_cast<uint64_t>(-1));
+        inc_counter(h->m_slot_num_pages[slot_idx]);
+        page_list_insert(h->m_curr_page[slot_idx], p);
+    }
+    g_heap_manager->push_orphan(o);
+    return p;
+}
+
+/* Number of bytes of live objects, see `get_allocated_bytes`. Objects may be deallocated by a thread before their
+   allocation has been accounted by another one, so the value may be temporarily negative. */
+static atomic<int64_t> g_allocated_bytes(0);
+
+static inline void add_allocated_bytes(int64_t delta) {
+    atomic_fetch_add_explicit(&g_allocated_bytes, delta, memory_order_relaxed);
+}
+
+/* Add the bytes allocated and deallocated using `h` since the last update to `g_allocated_bytes`. */
+static void account_allocated_bytes(heap * h) {
+    add_allocated_bytes((LEAN_ALLOC_BUDGET - h->m_alloc_budget) - h->m_freed_bytes);
+    h->m_alloc_budget = LEAN_ALLOC_BUDGET;
+    h->m_freed_bytes  = 0;
+}
+
 static void finalize_heap(void * _h) {
     heap * h = static_cast<heap*>(_h);
-    h->export_objs();
+    account_allocated_bytes(h);
     h->import_objs();
     g_heap_manager->push_orphan(h);
 }
@@ -334,12 +600,20 @@ static void init_heap(bool main) {
     if (heap * h = g_heap_manager->pop_orphan()) {
         /* reuse orphan heap */
         g_heap = h;
+        g_heap->import_objs();
+        if (is_numa_aware())
+            g_heap->m_numa_node = numa_current_node();
     } else {
         g_heap = new heap();
+        if (is_numa_aware())
+            g_heap->m_numa_node = numa_current_node();
         g_curr_pages = g_heap->m_curr_page;
         for (unsigned i = 0; i < LEAN_NUM_SLOTS; i++) {
             g_heap->m_curr_page[i] = nullptr;
             g_heap->m_page_free_list[i] = nullptr;
+            g_heap->m_slot_num_alloc[i] = 0;
+            g_heap->m_slot_num_free[i] = 0;
+            g_heap->m_slot_num_pages[i] = 0;
         }
         g_heap->alloc_segment();
         unsigned obj_size = LEAN_OBJECT_SIZE_DELTA;
@@ -349,10 +623,32 @@ static void init_heap(bool main) {
             }
             obj_size += LEAN_OBJECT_SIZE_DELTA;
         }
+        g_heap_manager->register_heap(g_heap);
+    }
+    if (size_t interval = get_heap_profile_interval()) {
+        g_heap->m_sample_rng       = reinterpret_cast<uintptr_t>(g_heap) | 1;
+        g_heap->m_sample_countdown = interval;
     }
     if (!main)
         register_thread_finalizer(finalize_heap, g_heap);
 }
+
+/* Sample the intervals between heap profiler samples from an exponential distribution with the given mean, as
+   tcmalloc does, so that the samples are not correlated with periodic allocation patterns. */
+static int64_t next_sample_interval(heap * h, size_t mean) {
+    uint64_t & x = h->m_sample_rng;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    double u = (static_cast<double>(x >> 11) + 1.0) / 9007199254740993.0; /* in (0, 1] */
+    return static_cast<int64_t>(-std::log(u) * static_cast<double>(mean)) + 1;
+}
+
+LEAN_NOINLINE
+static void sample_alloc(void * r, size_t sz) {
+    g_heap->m_sample_countdown = next_sample_interval(g_heap, get_heap_profile_interval());
+    if (sz <= LEAN_MAX_SMALL_OBJECT_SIZE)
+        get_page_of(r)->m_header.m_sampled = true;
+    heap_profile_record(r, sz);
+}
 }
 using namespace allocator; // NOLINT
 
@@ -362,12 +658,17 @@ void init_thread_heap() {
 
 LEAN_NOINLINE
 void * lean_alloc_small_cold(unsigned sz, unsigned slot_idx, page * p) {
+    g_heap->maybe_purge_segments();
     if (g_heap->m_page_free_list[slot_idx] == nullptr) {
         g_heap->import_objs();
         lean_assert(g_heap->m_curr_page[slot_idx] == p);
         /* g_heap->import_objs() may add objects to p->m_header.m_free_list */
-        if (p->m_header.m_free_list == nullptr)
-            p = alloc_page(g_heap, sz);
+        if (p->m_header.m_free_list == nullptr) {
+            if (page * q = adopt_orphan_page(g_heap, slot_idx))
+                p = q;
+            else
+                p = alloc_page(g_heap, sz);
+        }
     } else {
         p = page_list_pop(g_heap->m_page_free_list[slot_idx]);
         p->m_header.m_in_page_free_list = false;
@@ -381,9 +682,17 @@ void * lean_alloc_small_cold(unsigned sz, unsigned slot_idx, page * p) {
     return r;
 }
 
+static void * lean_alloc_small_event(unsigned sz, unsigned slot_idx);
+
 extern "C" LEAN_EXPORT void * lean_alloc_small(unsigned sz, unsigned slot_idx) {
+    int64_t sample_countdown = (g_heap->m_sample_countdown -= sz);
+    int64_t alloc_budget     = (g_heap->m_alloc_budget -= sz);
+    if (LEAN_UNLIKELY((sample_countdown | alloc_budget) < 0)) {
+        return lean_alloc_small_event(sz, slot_idx);
+    }
     page * p = g_heap->m_curr_page[slot_idx];
     g_heap->m_heartbeat++;
+    LEAN_RUNTIME_STAT_CODE(inc_counter(g_heap->m_slot_num_alloc[slot_idx]));
     void * r = p->m_header.m_free_list;
     if (LEAN_UNLIKELY(r == nullptr)) {
         return lean_alloc_small_cold(sz, slot_idx, p);
@@ -394,12 +703,31 @@ extern "C" LEAN_EXPORT void * lean_alloc_small(unsigned sz, unsigned slot_idx) {
     return r;
 }
 
+/* Take a heap profiler sample and/or account the allocated bytes. */
+LEAN_NOINLINE
+static void * lean_alloc_small_event(unsigned sz, unsigned slot_idx) {
+    /* The counters are reset before allocating, so this does not recurse. They are decremented by `sz` again. */
+    bool sampled = g_heap->m_sample_countdown < 0;
+    if (sampled)
+        g_heap->m_sample_countdown = INT64_MAX;
+    if (g_heap->m_alloc_budget < 0)
+        account_allocated_bytes(g_heap);
+    g_heap->m_alloc_budget += sz;
+    void * r = lean_alloc_small(sz, slot_idx);
+    if (sampled)
+        sample_alloc(r, sz);
+    return r;
+}
+
 void * alloc(size_t sz) {
     sz = lean_align(sz, LEAN_OBJECT_SIZE_DELTA);
     LEAN_RUNTIME_STAT_CODE(g_num_alloc++);
     if (LEAN_UNLIKELY(sz > LEAN_MAX_SMALL_OBJECT_SIZE)) {
         void * r = malloc(sz);
         if (r == nullptr) lean_internal_panic_out_of_memory();
+        add_allocated_bytes(sz);
+        if (g_heap && LEAN_UNLIKELY((g_heap->m_sample_countdown -= sz) < 0))
+            sample_alloc(r, sz);
         return r;
     }
     lean_assert(g_heap);
@@ -409,14 +737,9 @@ void * alloc(size_t sz) {
 }
 
 LEAN_NOINLINE
-static void dealloc_small_core_cold(void * o) {
-    set_next_obj(o, g_heap->m_to_export_list);
-    g_heap->m_to_export_list = o;
-    g_heap->m_to_export_list_size++;
-    if (g_heap->m_to_export_list_size > LEAN_MAX_TO_EXPORT_OBJS) {
-        LEAN_RUNTIME_STAT_CODE(g_num_exports++);
-        g_heap->export_objs();
-    }
+static void dealloc_small_core_cold(void * o, page * p) {
+    LEAN_RUNTIME_STAT_CODE(g_num_remote_frees++);
+    p->get_heap()->push_remote_obj(o);
 }
 
 static inline void dealloc_small_core(void * o) {
@@ -426,10 +749,15 @@ static inline void dealloc_small_core(void * o) {
     }
     lean_assert(g_heap);
     page * p = get_page_of(o);
+    LEAN_RUNTIME_STAT_CODE(inc_counter(g_heap->m_slot_num_free[p->get_slot_idx()]));
+    g_heap->m_freed_bytes += p->m_header.m_obj_size;
+    if (LEAN_UNLIKELY(p->m_header.m_sampled)) {
+        heap_profile_forget(o);
+    }
     if (LEAN_LIKELY(p->get_heap() == g_heap)) {
         p->push_free_obj(o);
     } else {
-        dealloc_small_core_cold(o);
+        dealloc_small_core_cold(o, p);
     }
 }
 
@@ -437,6 +765,9 @@ void dealloc(void * o, size_t sz) {
     LEAN_RUNTIME_STAT_CODE(g_num_dealloc++);
     sz = lean_align(sz, LEAN_OBJECT_SIZE_DELTA);
     if (LEAN_UNLIKELY(sz > LEAN_MAX_SMALL_OBJECT_SIZE)) {
+        if (LEAN_UNLIKELY(get_heap_profile_interval() != 0))
+            heap_profile_forget(o);
+        add_allocated_bytes(-static_cast<int64_t>(sz));
         return free(o);
     }
     dealloc_small_core(o);
@@ -451,9 +782,41 @@ extern "C" LEAN_EXPORT unsigned lean_small_mem_size(void * o) {
     return p->m_header.m_obj_size;
 }
 
+void set_thread_heap_numa_node(unsigned node) {
+    if (LEAN_UNLIKELY(g_heap == nullptr))
+        init_heap(false);
+    g_heap->m_numa_node = node;
+    /* Move the pages of the current segment, which are the ones the thread will use next. */
+    numa_bind_memory(g_heap->m_curr_segment, LEAN_SEGMENT_SIZE, node);
+}
+
+extern "C" LEAN_EXPORT size_t lean_get_alloc_stats(lean_alloc_slot_stats * r, size_t n) {
+    if (n > LEAN_NUM_SLOTS)
+        n = LEAN_NUM_SLOTS;
+    unsigned obj_size = LEAN_OBJECT_SIZE_DELTA;
+    for (size_t i = 0; i < n; i++) {
+        r[i].m_obj_size  = obj_size;
+        r[i].m_num_alloc = 0;
+        r[i].m_num_free  = 0;
+        r[i].m_num_pages = 0;
+        r[i].m_page_size = LEAN_PAGE_SIZE;
+        r[i].m_objs_per_page = (LEAN_PAGE_SIZE - sizeof(page_header)) / obj_size;
+        obj_size += LEAN_OBJECT_SIZE_DELTA;
+    }
+    for (heap * h = g_heap_manager->m_heaps.load(); h != nullptr; h = h->m_next_heap) {
+        for (size_t i = 0; i < n; i++) {
+            r[i].m_num_alloc += h->m_slot_num_alloc[i].load(memory_order_relaxed);
+            r[i].m_num_free  += h->m_slot_num_free[i].load(memory_order_relaxed);
+            r[i].m_num_pages += h->m_slot_num_pages[i].load(memory_order_relaxed);
+        }
+    }
+    return LEAN_NUM_SLOTS;
+}
+
 #endif
 
 void initialize_alloc() {
+    initialize_heap_profile();
 #ifdef LEAN_SMALL_ALLOCATOR
     g_heap_manager = new heap_manager();
     init_heap(true);
@@ -463,6 +826,29 @@ void initialize_alloc() {
 void finalize_alloc() {
 }
 
+#ifndef LEAN_SMALL_ALLOCATOR
+extern "C" LEAN_EXPORT size_t lean_get_alloc_stats(lean_alloc_slot_stats *, size_t) {
+    return 0;
+}
+void set_thread_heap_numa_node(unsigned) {}
+#endif
+
+void set_segment_huge_pages(unsigned mode) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    g_segment_huge_pages = mode;
+#else
+    (void)mode;
+#endif
+}
+
+void set_segment_purge_delay(unsigned ms) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    g_segment_purge_delay = ms;
+#else
+    (void)ms;
+#endif
+}
+
 #ifndef LEAN_SMALL_ALLOCATOR
 LEAN_THREAD_VALUE(uint64_t, g_heartbeat, 0);
 #endif
@@ -481,6 +867,25 @@ extern "C" LEAN_EXPORT void lean_inc_heartbeat() {
     add_heartbeats(1);
 }
 
+void account_realloc(size_t old_sz, size_t new_sz) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    add_allocated_bytes(static_cast<int64_t>(new_sz) - static_cast<int64_t>(old_sz));
+#else
+    (void)old_sz; (void)new_sz;
+#endif
+}
+
+size_t get_allocated_bytes() {
+#ifdef LEAN_SMALL_ALLOCATOR
+    int64_t r = g_allocated_bytes.load(memory_order_relaxed);
+    if (g_heap)
+        r += (LEAN_ALLOC_BUDGET - g_heap->m_alloc_budget) - g_heap->m_freed_bytes;
+    return r > 0 ? static_cast<size_t>(r) : 0;
+#else
+    return 0;
+#endif
+}
+
 uint64_t get_num_heartbeats() {
 #ifdef LEAN_SMALL_ALLOCATOR
     if (g_heap)
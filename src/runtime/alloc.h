@@ -7,6 +7,26 @@ Author: Leonardo de Moura
 #pragma once
 #include <stddef.h>
 #include <stdint.h>
+#include <lean/lean.h>
+
+/* Statistics of the small object allocator for all objects of a given size class. */
+typedef struct {
+    unsigned m_obj_size;       /* object size in bytes */
+    unsigned m_page_size;      /* page size in bytes */
+    unsigned m_objs_per_page;  /* maximum number of objects in a page */
+    uint64_t m_num_alloc;      /* number of allocations, always 0 unless built with `LEAN_RUNTIME_STATS` */
+    uint64_t m_num_free;       /* number of deallocations, always 0 unless built with `LEAN_RUNTIME_STATS` */
+    uint64_t m_num_pages;      /* number of pages currently assigned to this size class */
+} lean_alloc_slot_stats;
+
+/* Store statistics for the first `n` size classes of the small object allocator in `r`, and return the total
+   number of size classes. The counters of different threads are not read atomically, i.e., the result is only an
+   approximation while other threads are allocating. */
+extern "C" LEAN_EXPORT size_t lean_get_alloc_stats(lean_alloc_slot_stats * r, size_t n);
+
+#define LEAN_HUGE_PAGES_NONE        0
+#define LEAN_HUGE_PAGES_TRANSPARENT 1
+#define LEAN_HUGE_PAGES_EXPLICIT    2
 
 namespace lean {
 void init_thread_heap();
@@ -14,6 +34,23 @@ void * alloc(size_t sz);
 void dealloc(void * o, size_t sz);
 void add_heartbeats(uint64_t count);
 uint64_t get_num_heartbeats();
+/* Return the number of bytes of live objects allocated with `alloc`, i.e., of all Lean objects except for the ones
+   in compacted regions. The value is maintained incrementally by the allocator: the allocations and deallocations of
+   other threads are only accounted after they have allocated 64Kb of small objects since their last update, or when
+   they exit. Returns 0 if the runtime was built without the small object allocator. */
+size_t get_allocated_bytes();
+/* Account the resizing of a block obtained from `alloc` for a large object using `realloc`. */
+void account_realloc(size_t old_sz, size_t new_sz);
+/* Return segments of the small object allocator to the OS after they have been completely empty
+   for `ms` milliseconds. The value 0 (default) disables purging. */
+void set_segment_purge_delay(unsigned ms);
+/* Back new segments of the small object allocator with 2 Mb huge pages. `LEAN_HUGE_PAGES_TRANSPARENT` aligns
+   segments and requests transparent huge pages using `madvise(MADV_HUGEPAGE)`, `LEAN_HUGE_PAGES_EXPLICIT`
+   uses `MAP_HUGETLB` and falls back to transparent huge pages if no huge pages are available.
+   The setting only affects platforms supporting `mmap`. */
+void set_segment_huge_pages(unsigned mode);
+/* Bind new segments of the current thread's heap to the given NUMA node, see `runtime/numa.h`. */
+void set_thread_heap_numa_node(unsigned node);
 void initialize_alloc();
 void finalize_alloc();
 }
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <algorithm>
+#include <climits>
+#include <vector>
+#include "runtime/cache_registry.h"
+#include "runtime/memory.h"
+#include "runtime/object.h"
+#include "runtime/object_ref.h"
+#include "runtime/io.h"
+#include "runtime/thread.h"
+
+namespace lean {
+struct cache_entry {
+    std::string            m_name;
+    std::function<size_t()> m_size;
+    std::function<void()>   m_evict;
+    bool                   m_registered{true};
+    // value of `g_cache_clock` at the last use
+    atomic<uint64_t>       m_last_use{0};
+};
+
+static mutex * g_cache_registry_mutex = nullptr;
+// entries are never deallocated, so that `evict_caches` can call their functions without holding the lock
+static std::vector<cache_entry *> * g_caches = nullptr;
+static atomic<uint64_t> g_cache_clock(0);
+
+unsigned register_cache(std::string const & name, std::function<size_t()> const & size,
+                        std::function<void()> const & evict) {
+    cache_entry * e = new cache_entry();
+    e->m_name  = name;
+    e->m_size  = size;
+    e->m_evict = evict;
+    e->m_last_use = ++g_cache_clock;
+    lock_guard<mutex> lock(*g_cache_registry_mutex);
+    g_caches->push_back(e);
+    return g_caches->size() - 1;
+}
+
+void unregister_cache(unsigned id) {
+    lock_guard<mutex> lock(*g_cache_registry_mutex);
+    if (id < g_caches->size())
+        (*g_caches)[id]->m_registered = false;
+}
+
+void touch_cache(unsigned id) {
+    cache_entry * e;
+    {
+        lock_guard<mutex> lock(*g_cache_registry_mutex);
+        if (id >= g_caches->size())
+            return;
+        e = (*g_caches)[id];
+    }
+    e->m_last_use.store(++g_cache_clock, std::memory_order_relaxed);
+}
+
+unsigned evict_caches(size_t target) {
+    std::vector<cache_entry *> caches;
+    {
+        lock_guard<mutex> lock(*g_cache_registry_mutex);
+        for (cache_entry * e : *g_caches) {
+            if (e->m_registered)
+                caches.push_back(e);
+        }
+    }
+    std::sort(caches.begin(), caches.end(), [](cache_entry * e1, cache_entry * e2) {
+        return e1->m_last_use.load(std::memory_order_relaxed) < e2->m_last_use.load(std::memory_order_relaxed);
+    });
+    // the functions are called without holding the lock, as they may register or use caches
+    unsigned n = 0;
+    for (cache_entry * e : caches) {
+        if (get_allocated_memory() <= target)
+            break;
+        if (e->m_size() == 0)
+            continue;
+        e->m_evict();
+        n++;
+    }
+    return n;
+}
+
+void set_cache_eviction_limit(size_t limit) {
+    set_memory_soft_limit(limit, [=]() { evict_caches(limit / 4 * 3); });
+}
+
+/* registerCache (name : @& String) (size : BaseIO Nat) (evict : BaseIO Unit) : BaseIO Nat */
+extern "C" LEAN_EXPORT obj_res lean_io_register_cache(b_obj_arg name, obj_arg size, obj_arg evict, obj_arg) {
+    // the functions may be called from any thread
+    mark_mt(size);
+    mark_mt(evict);
+    object_ref size_ref(size);
+    object_ref evict_ref(evict);
+    unsigned id = register_cache(string_cstr(name), [=]() {
+        object * r = apply_1(size_ref.to_obj_arg(), io_mk_world());
+        object * v = io_result_get_value(r);
+        size_t n = lean_is_scalar(v) ? unbox(v) : SIZE_MAX;
+        dec(r);
+        return n;
+    }, [=]() {
+        dec(apply_1(evict_ref.to_obj_arg(), io_mk_world()));
+    });
+    return io_result_mk_ok(box(id));
+}
+
+/* Return true if `id` may be an identifier returned by `lean_io_register_cache`. Larger identifiers are ignored
+   instead of being truncated to `unsigned`. */
+static bool is_cache_id(b_obj_arg id) {
+    return lean_is_scalar(id) && unbox(id) <= UINT_MAX;
+}
+
+/* unregisterCache (id : Nat) : BaseIO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_unregister_cache(b_obj_arg id, obj_arg) {
+    if (is_cache_id(id))
+        unregister_cache(unbox(id));
+    return io_result_mk_ok(box(0));
+}
+
+/* touchCache (id : Nat) : BaseIO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_touch_cache(b_obj_arg id, obj_arg) {
+    if (is_cache_id(id))
+        touch_cache(unbox(id));
+    return io_result_mk_ok(box(0));
+}
+
+/* evictCaches (target : @& Nat) : BaseIO Nat */
+extern "C" LEAN_EXPORT obj_res lean_io_evict_caches(b_obj_arg target, obj_arg) {
+    size_t t = lean_is_scalar(target) ? unbox(target) : SIZE_MAX;
+    return io_result_mk_ok(box(evict_caches(t)));
+}
+
+void initialize_cache_registry() {
+    g_cache_registry_mutex = new mutex();
+    g_caches = new std::vector<cache_entry *>();
+}
+
+void finalize_cache_registry() {
+}
+}
@@ -0,0 +1,32 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <lean/lean.h>
+
+namespace lean {
+/* Registry of caches that can be evicted under memory pressure. Each cache provides an estimate of its size in bytes
+   and an eviction function, which must be callable from any thread. Caches are evicted in the order in which they
+   were last used, see `touch_cache`. */
+
+/* Register a cache, and return its identifier. */
+LEAN_EXPORT unsigned register_cache(std::string const & name, std::function<size_t()> const & size,
+                                    std::function<void()> const & evict);
+/* `unregister_cache` and `touch_cache` ignore identifiers that were not returned by `register_cache`. */
+LEAN_EXPORT void unregister_cache(unsigned id);
+/* Record that the cache has been used. */
+LEAN_EXPORT void touch_cache(unsigned id);
+/* Evict the least recently used caches until the allocated memory (see `get_allocated_memory`) is at most `target`
+   bytes, or all caches have been evicted. Return the number of evicted caches. */
+LEAN_EXPORT unsigned evict_caches(size_t target);
+/* Evict caches down to 3/4 of `limit` bytes when the allocated memory reaches `limit`, see `set_memory_soft_limit`.
+   The value 0 disables automatic eviction. */
+LEAN_EXPORT void set_cache_eviction_limit(size_t limit);
+
+void initialize_cache_registry();
+void finalize_cache_registry();
+}
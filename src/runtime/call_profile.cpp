@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "runtime/call_profile.h"
+
+namespace lean {
+static std::atomic<lean_call_counter *> g_call_counters(nullptr);
+static std::string * g_call_profile_fname = nullptr;
+
+extern "C" LEAN_EXPORT void lean_register_call_counter(lean_call_counter * c) {
+    lean_call_counter * head = g_call_counters.load(std::memory_order_relaxed);
+    do {
+        c->m_next = head;
+    } while (!g_call_counters.compare_exchange_weak(head, c, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void write_call_profile() {
+    if (!g_call_profile_fname)
+        return;
+    std::vector<std::pair<uint64_t, char const *>> entries;
+    for (lean_call_counter * c = g_call_counters.load(std::memory_order_acquire); c; c = c->m_next) {
+#if defined(__GNUC__) || defined(__clang__)
+        uint64_t n = __atomic_load_n(&c->m_count, __ATOMIC_RELAXED);
+#else
+        uint64_t n = c->m_count;
+#endif
+        entries.emplace_back(n, c->m_name);
+    }
+    std::sort(entries.begin(), entries.end(), [](auto const & a, auto const & b) { return a.first > b.first; });
+    std::ofstream out(*g_call_profile_fname);
+    if (out.fail()) {
+        std::cerr << "failed to create call profile '" << *g_call_profile_fname << "'\n";
+        return;
+    }
+    for (auto const & e : entries)
+        out << e.first << " " << e.second << "\n";
+}
+
+static void write_call_profile_at_exit() {
+    write_call_profile();
+}
+
+void initialize_call_profile() {
+#ifndef LEAN_EMSCRIPTEN
+    char const * fname = std::getenv("LEAN_CALL_PROFILE");
+    if (!fname || !*fname)
+        return;
+    g_call_profile_fname = new std::string(fname);
+    /* Programs, including `lean` itself, may exit without finalizing the runtime. */
+    std::atexit(write_call_profile_at_exit);
+#endif
+}
+}
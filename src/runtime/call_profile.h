@@ -0,0 +1,16 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <lean/lean.h>
+
+namespace lean {
+/* Call profile of instrumented code. Functions emitted by `lean --c-instrument` count their calls in a
+   `lean_call_counter`. When the environment variable `LEAN_CALL_PROFILE` is set to a file name, the counters of all
+   functions called at least once are written to it at exit, one `<count> <C name>` line per function, most
+   frequently called first. The file can be passed back to the compiler using `lean --c-profile`. */
+void write_call_profile();
+
+void initialize_call_profile();
+}
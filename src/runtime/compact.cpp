@@ -35,7 +35,7 @@ struct max_sharing_hash {
     object_compactor * m;
     max_sharing_hash(object_compactor * manager):m(manager) {}
     unsigned operator()(max_sharing_key const & k) const {
-        return hash_str(k.m_size, reinterpret_cast<unsigned char const *>(m->m_begin) + k.m_offset, 17);
+        return hash_bytes(k.m_size, reinterpret_cast<unsigned char const *>(m->m_begin) + k.m_offset, 17);
     }
 };
 
@@ -81,12 +81,14 @@ void * object_compactor::alloc(size_t sz) {
         sz = sz + sizeof(void*) - rem;
     while (static_cast<char*>(m_end) + sz > m_capacity) {
         size_t new_capacity = capacity()*2;
-        void * new_begin = malloc(new_capacity);
-        memcpy(new_begin, m_begin, size());
-        m_end      = static_cast<char*>(new_begin) + size();
-        m_capacity = static_cast<char*>(new_begin) + new_capacity;
-        free(m_begin);
+        size_t old_size     = size();
+        // `realloc` can grow large buffers by remapping their pages instead of copying them, so that we do not need
+        // the old and the new buffer at the same time
+        void * new_begin = realloc(m_begin, new_capacity);
+        if (new_begin == nullptr) lean_internal_panic_out_of_memory();
         m_begin    = new_begin;
+        m_end      = static_cast<char*>(new_begin) + old_size;
+        m_capacity = static_cast<char*>(new_begin) + new_capacity;
     }
     void * r = m_end;
     memset(r, 0, sz);
@@ -386,63 +388,98 @@ inline object * compacted_region::fix_object_ptr(object * o) {
     return reinterpret_cast<object*>(static_cast<char*>(m_begin) + (reinterpret_cast<size_t>(o) - reinterpret_cast<size_t>(m_base_addr)));
 }
 
-inline void compacted_region::move(size_t d) {
-    lean_assert(m_next < m_end);
+static inline size_t align_size(size_t d) {
     size_t rem = d % sizeof(void*);
-    if (rem != 0)
-        d = d + sizeof(void*) - rem;
-    m_next = static_cast<char*>(m_next) + d;
+    return rem == 0 ? d : d + sizeof(void*) - rem;
 }
 
-inline void compacted_region::move(object * o) {
-    return move(lean_object_byte_size(o));
+inline void compacted_region::move(size_t d) {
+    lean_assert(m_next < m_end);
+    m_next = static_cast<char*>(m_next) + align_size(d);
 }
 
-inline void compacted_region::fix_constructor(object * o) {
-    lean_assert(!lean_has_rc(o));
-    object ** it  = lean_ctor_obj_cptr(o);
-    object ** end = it + lean_ctor_num_objs(o);
-    for (; it != end; it++) {
-        *it = fix_object_ptr(*it);
+/* Size of the object `o` in a compacted region, rounded up to a multiple of the word size. */
+inline size_t compacted_region::object_size(object * o) {
+    uint8 tag = lean_ptr_tag(o);
+    if (tag <= LeanMaxCtorTag) {
+        lean_assert(lean_object_byte_size(o) < 4192);
+        return align_size(lean_object_byte_size(o));
+    }
+    switch (tag) {
+    case LeanArray:           return align_size(lean_object_byte_size(o));
+    case LeanScalarArray:     return align_size(lean_sarray_byte_size(o));
+    case LeanString:          return align_size(lean_string_byte_size(o));
+#ifdef LEAN_USE_GMP
+    case LeanMPZ:             return align_size(sizeof(mpz_object) + sizeof(mp_limb_t) * mpz_size(to_mpz(o)->m_value.m_val));
+#else
+    case LeanMPZ:             return align_size(sizeof(mpz_object) + sizeof(mpn_digit) * to_mpz(o)->m_value.m_size);
+#endif
+    case LeanThunk:           return align_size(sizeof(lean_thunk_object));
+    case LeanRef:             return align_size(sizeof(lean_ref_object));
+    case LeanTask:            return align_size(sizeof(lean_task_object));
+    default:                  lean_unreachable();
     }
-    lean_assert(lean_object_byte_size(o) < 4192);
-    move(o);
 }
 
-inline void compacted_region::fix_array(object * o) {
-    object ** it  = lean_array_cptr(o);
-    object ** end = it + lean_array_size(o);
-    for (; it != end; it++) {
-        *it = fix_object_ptr(*it);
+/* Relocate the `n` object pointers starting at `it` by `delta`, skipping scalars. The loop has no branches so that
+   the compiler can vectorize it. */
+static inline void fix_object_ptrs(object ** it, size_t n, size_t delta) {
+    size_t * p = reinterpret_cast<size_t *>(it);
+    for (size_t i = 0; i < n; i++) {
+        // scalars are odd, the mask is `0` for them and all ones for pointers
+        p[i] += delta & ((p[i] & 1) - 1);
     }
-    move(o);
 }
 
-inline void compacted_region::fix_thunk(object * o) {
-    lean_to_thunk(o)->m_value = fix_object_ptr(lean_to_thunk(o)->m_value);
-    move(sizeof(lean_thunk_object));
+void compacted_region::fix_mpz(object * o, size_t delta) {
+#ifdef LEAN_USE_GMP
+    __mpz_struct & m = to_mpz(o)->m_value.m_val[0];
+    m._mp_d = reinterpret_cast<mp_limb_t *>(reinterpret_cast<size_t>(m._mp_d) + delta);
+#else
+    (void)delta;
+    to_mpz(o)->m_value.m_digits = reinterpret_cast<mpn_digit*>(reinterpret_cast<char*>(o) + sizeof(mpz_object));
+#endif
 }
 
-inline void compacted_region::fix_ref(object * o) {
-    lean_to_ref(o)->m_value = fix_object_ptr(lean_to_ref(o)->m_value);
-    move(sizeof(lean_ref_object));
+/* Relocate the pointers of all objects in `[begin, end)`. */
+void compacted_region::fix_objects(char * begin, char * end, size_t delta) {
+    char * next = begin;
+    while (next < end) {
+        object * curr = reinterpret_cast<object*>(next);
+        uint8 tag = lean_ptr_tag(curr);
+        if (tag <= LeanMaxCtorTag) {
+            lean_assert(!lean_has_rc(curr));
+            fix_object_ptrs(lean_ctor_obj_cptr(curr), lean_ctor_num_objs(curr), delta);
+        } else {
+            switch (tag) {
+            case LeanClosure:         lean_unreachable();
+            case LeanArray:           fix_object_ptrs(lean_array_cptr(curr), lean_array_size(curr), delta); break;
+            case LeanScalarArray:     break;
+            case LeanString:          break;
+            case LeanMPZ:             fix_mpz(curr, delta); break;
+            case LeanThunk:           fix_object_ptrs(reinterpret_cast<object **>(&lean_to_thunk(curr)->m_value), 1, delta); break;
+            case LeanRef:             fix_object_ptrs(reinterpret_cast<object **>(&lean_to_ref(curr)->m_value), 1, delta); break;
+            case LeanTask:            fix_object_ptrs(reinterpret_cast<object **>(&lean_to_task(curr)->m_value), 1, delta); break;
+            case LeanExternal:        lean_unreachable();
+            default:                  lean_unreachable();
+            }
+        }
+        next += object_size(curr);
+    }
 }
 
-inline void compacted_region::fix_task(object * o) {
-    lean_to_task(o)->m_value = fix_object_ptr(lean_to_task(o)->m_value);
-    move(sizeof(lean_task_object));
+obj_res compacted_region::fix_objects_fn(obj_arg begin, obj_arg end, obj_arg delta, obj_arg) {
+    fix_objects(reinterpret_cast<char *>(lean_unbox_usize(begin)), reinterpret_cast<char *>(lean_unbox_usize(end)),
+                lean_unbox_usize(delta));
+    lean_dec(begin); lean_dec(end); lean_dec(delta);
+    return box(0);
 }
 
-void compacted_region::fix_mpz(object * o) {
-#ifdef LEAN_USE_GMP
-    __mpz_struct & m = to_mpz(o)->m_value.m_val[0];
-    m._mp_d = reinterpret_cast<mp_limb_t *>(static_cast<char *>(m_begin) + reinterpret_cast<size_t>(m._mp_d) - reinterpret_cast<size_t>(m_base_addr));
-    move(sizeof(mpz_object) + sizeof(mp_limb_t) * mpz_size(to_mpz(o)->m_value.m_val));
-#else
-    to_mpz(o)->m_value.m_digits = reinterpret_cast<mpn_digit*>(reinterpret_cast<char*>(o) + sizeof(mpz_object));
-    move(sizeof(mpz_object) + sizeof(mpn_digit) * to_mpz(o)->m_value.m_size);
+// regions smaller than this are relocated on the current thread
+#ifndef LEAN_PARALLEL_RELOCATION_THRESHOLD
+#define LEAN_PARALLEL_RELOCATION_THRESHOLD 4*1024*1024
 #endif
-}
+#define LEAN_RELOCATION_CHUNK_SIZE 1024*1024
 
 object * compacted_region::read() {
     if (m_next == m_end)
@@ -457,26 +494,40 @@ object * compacted_region::read() {
     }
     lean_assert(!m_is_mmap);
 
-    while (m_next < m_end) {
-        object * curr = reinterpret_cast<object*>(m_next);
-        uint8 tag = lean_ptr_tag(curr);
-        if (tag <= LeanMaxCtorTag) {
-            fix_constructor(curr);
-        } else {
-            switch (tag) {
-            case LeanClosure:         lean_unreachable();
-            case LeanArray:           fix_array(curr); break;
-            case LeanScalarArray:     move(lean_sarray_byte_size(curr)); break;
-            case LeanString:          move(lean_string_byte_size(curr)); break;
-            case LeanMPZ:             fix_mpz(curr); break;
-            case LeanThunk:           fix_thunk(curr); break;
-            case LeanRef:             fix_ref(curr); break;
-            case LeanTask:            fix_task(curr); break;
-            case LeanExternal:        lean_unreachable();
-            default:                  lean_unreachable();
+    char * begin = static_cast<char *>(m_next);
+    char * end   = static_cast<char *>(m_end);
+    size_t delta = reinterpret_cast<size_t>(m_begin) - reinterpret_cast<size_t>(m_base_addr);
+    if (!has_task_manager() || static_cast<size_t>(end - begin) < LEAN_PARALLEL_RELOCATION_THRESHOLD) {
+        fix_objects(begin, end, delta);
+    } else {
+        /* Object boundaries are only known by walking the region, so we first split it into chunks of roughly
+           `LEAN_RELOCATION_CHUNK_SIZE` bytes using only the object headers, and then relocate the chunks in parallel.
+           The first chunk is relocated by the current thread. */
+        std::vector<char *> bounds;
+        bounds.push_back(begin);
+        char * next_bound = begin + LEAN_RELOCATION_CHUNK_SIZE;
+        for (char * next = begin; next < end; next += object_size(reinterpret_cast<object *>(next))) {
+            if (next >= next_bound) {
+                bounds.push_back(next);
+                next_bound = next + LEAN_RELOCATION_CHUNK_SIZE;
             }
         }
+        bounds.push_back(end);
+        std::vector<object *> tasks;
+        for (size_t i = 1; i + 1 < bounds.size(); i++) {
+            object * c = lean_alloc_closure(reinterpret_cast<void *>(fix_objects_fn), 4, 3);
+            lean_closure_set(c, 0, lean_box_usize(reinterpret_cast<size_t>(bounds[i])));
+            lean_closure_set(c, 1, lean_box_usize(reinterpret_cast<size_t>(bounds[i + 1])));
+            lean_closure_set(c, 2, lean_box_usize(delta));
+            tasks.push_back(lean_task_spawn_core(c, 0, false));
+        }
+        fix_objects(bounds[0], bounds[1], delta);
+        for (object * t : tasks) {
+            lean_task_get(t);
+            lean_dec(t);
+        }
     }
+    m_next = m_end;
     return root;
 }
 
@@ -488,4 +539,62 @@ extern "C" LEAN_EXPORT obj_res lean_compacted_region_free(usize region, object *
     delete reinterpret_cast<compacted_region *>(region);
     return lean_io_result_mk_ok(lean_box(0));
 }
+
+extern "C" LEAN_EXPORT usize lean_compacted_region_size(usize region) {
+    return reinterpret_cast<compacted_region *>(region)->size();
+}
+
+/* Return the total size of the distinct objects reachable from `o`, skipping the objects contained in one of the
+   compacted `regions`. The traversal does not evaluate thunks or wait for tasks. */
+extern "C" LEAN_EXPORT obj_res lean_object_graph_size(b_obj_arg o, b_obj_arg regions, obj_arg) {
+    std::vector<compacted_region const *> rs;
+    for (size_t i = 0; i < lean_array_size(regions); i++)
+        rs.push_back(reinterpret_cast<compacted_region const *>(lean_unbox_usize(lean_array_get_core(regions, i))));
+    std::unordered_set<object *> visited;
+    std::vector<object *> todo;
+    size_t sz = 0;
+    auto push = [&](object * c) {
+        if (c && !lean_is_scalar(c))
+            todo.push_back(c);
+    };
+    push(o);
+    while (!todo.empty()) {
+        object * curr = todo.back();
+        todo.pop_back();
+        if (!visited.insert(curr).second)
+            continue;
+        if (std::any_of(rs.begin(), rs.end(), [&](compacted_region const * r) { return r->contains(curr); }))
+            continue;
+        sz += lean_object_byte_size(curr);
+        switch (lean_ptr_tag(curr)) {
+        case LeanClosure:
+            for (unsigned i = 0; i < lean_closure_num_fixed(curr); i++)
+                push(lean_closure_get(curr, i));
+            break;
+        case LeanArray:
+            for (size_t i = 0; i < lean_array_size(curr); i++)
+                push(lean_array_get_core(curr, i));
+            break;
+        case LeanThunk:
+            push(lean_to_thunk(curr)->m_value);
+            push(lean_to_thunk(curr)->m_closure);
+            break;
+        case LeanTask:
+            push(lean_to_task(curr)->m_value);
+            break;
+        case LeanRef:
+            push(lean_to_ref(curr)->m_value);
+            break;
+        case LeanScalarArray: case LeanString: case LeanMPZ: case LeanExternal:
+            break;
+        case LeanReserved:
+            lean_unreachable();
+        default:
+            for (unsigned i = 0; i < lean_ctor_num_objs(curr); i++)
+                push(lean_ctor_get(curr, i));
+            break;
+        }
+    }
+    return lean_io_result_mk_ok(lean_box_usize(sz));
+}
 }
@@ -64,14 +64,11 @@ class LEAN_EXPORT compacted_region {
     void * m_next;
     void * m_end;
     void move(size_t d);
-    void move(object * o);
     object * fix_object_ptr(object * o);
-    void fix_constructor(object * o);
-    void fix_array(object * o);
-    void fix_thunk(object * o);
-    void fix_ref(object * o);
-    void fix_task(object * o);
-    void fix_mpz(object * o);
+    static size_t object_size(object * o);
+    static void fix_mpz(object * o, size_t delta);
+    static void fix_objects(char * begin, char * end, size_t delta);
+    static object * fix_objects_fn(object * begin, object * end, object * delta, object *);
 public:
     /* Creates a compacted object region using the given region in memory.
        This object takes ownership of the region. */
@@ -86,5 +83,7 @@ public:
     compacted_region operator=(compacted_region &&) = delete;
     object * read();
     bool is_memory_mapped() const { return m_is_mmap; }
+    size_t size() const { return static_cast<char*>(m_end) - static_cast<char*>(m_begin); }
+    bool contains(void const * p) const { return m_begin <= p && p < m_end; }
 };
 }
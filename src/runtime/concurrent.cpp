@@ -0,0 +1,327 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <lean/lean.h>
+#include "runtime/concurrent.h"
+#include "runtime/io.h"
+#include "runtime/object.h"
+#include "runtime/thread.h"
+
+#ifndef LEAN_CONCURRENT_HASH_MAP_SHARDS
+#define LEAN_CONCURRENT_HASH_MAP_SHARDS 64
+#endif
+
+#ifndef LEAN_CACHE_LINE_SIZE
+#define LEAN_CACHE_LINE_SIZE 64
+#endif
+
+#ifndef LEAN_CONCURRENT_QUEUE_MAX_CAPACITY
+#define LEAN_CONCURRENT_QUEUE_MAX_CAPACITY (static_cast<size_t>(1) << 30)
+#endif
+
+namespace lean {
+/* The values stored in the containers below are always marked as multi-threaded, so that the containers do not have
+   to enumerate them when they are themselves marked as multi-threaded or persistent. */
+
+/*
+  Bounded multi-producer multi-consumer queue, see Dmitry Vyukov's "Bounded MPMC queue". Each cell has a sequence
+  number that tells producers and consumers whether the cell is ready for the position it is claimed for, and the
+  positions are claimed by a compare-and-swap on their counter. Operations never block, `push` fails if the queue is
+  full and `pop` fails if it is empty. */
+class mpmc_queue {
+    struct cell {
+        atomic<size_t> m_seq;
+        object *       m_value;
+    };
+    cell *         m_cells;
+    size_t         m_mask;
+    // the counters are modified by producers and consumers respectively, and are kept on separate cache lines
+    char           m_pad1[LEAN_CACHE_LINE_SIZE];
+    atomic<size_t> m_push_pos{0};
+    char           m_pad2[LEAN_CACHE_LINE_SIZE];
+    atomic<size_t> m_pop_pos{0};
+    char           m_pad3[LEAN_CACHE_LINE_SIZE];
+public:
+    explicit mpmc_queue(size_t capacity):m_cells(new cell[capacity]), m_mask(capacity - 1) {
+        for (size_t i = 0; i < capacity; i++)
+            m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+    }
+
+    ~mpmc_queue() {
+        while (object * v = pop())
+            dec(v);
+        delete[] m_cells;
+    }
+
+    bool push(object * v) {
+        size_t pos = m_push_pos.load(std::memory_order_relaxed);
+        cell * c;
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->m_seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_push_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->m_value = v;
+        c->m_seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    object * pop() {
+        size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+        cell * c;
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->m_seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (m_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = m_pop_pos.load(std::memory_order_relaxed);
+            }
+        }
+        object * v = c->m_value;
+        c->m_seq.store(pos + m_mask + 1, std::memory_order_release);
+        return v;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+};
+
+static lean_external_class * g_mpmc_queue_external_class = nullptr;
+static void mpmc_queue_finalizer(void * q) {
+    delete static_cast<mpmc_queue *>(q);
+}
+static void mpmc_queue_foreach(void *, b_obj_arg) {}
+
+static mpmc_queue * mpmc_queue_get(b_obj_arg q) {
+    return static_cast<mpmc_queue *>(lean_get_external_data(q));
+}
+
+/* ConcurrentQueue.new {α} (capacity : @& Nat) : BaseIO (ConcurrentQueue α) */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_queue_new(b_obj_arg capacity, obj_arg) {
+    size_t n = lean_is_scalar(capacity) ? unbox(capacity) : LEAN_CONCURRENT_QUEUE_MAX_CAPACITY;
+    size_t c = 2;
+    while (c < n && c < LEAN_CONCURRENT_QUEUE_MAX_CAPACITY)
+        c *= 2;
+    return io_result_mk_ok(lean_alloc_external(g_mpmc_queue_external_class, new mpmc_queue(c)));
+}
+
+/* ConcurrentQueue.capacity {α} (q : @& ConcurrentQueue α) : Nat */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_queue_capacity(b_obj_arg q) {
+    return lean_usize_to_nat(mpmc_queue_get(q)->capacity());
+}
+
+/* ConcurrentQueue.tryPush {α} (q : @& ConcurrentQueue α) (a : α) : BaseIO Bool */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_queue_try_push(b_obj_arg q, obj_arg a, obj_arg) {
+    mark_mt(a);
+    if (mpmc_queue_get(q)->push(a))
+        return io_result_mk_ok(box(true));
+    dec(a);
+    return io_result_mk_ok(box(false));
+}
+
+/* ConcurrentQueue.tryPop {α} (q : @& ConcurrentQueue α) : BaseIO (Option α) */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_queue_try_pop(b_obj_arg q, obj_arg) {
+    if (object * v = mpmc_queue_get(q)->pop())
+        return io_result_mk_ok(mk_option_some(v));
+    return io_result_mk_ok(mk_option_none());
+}
+
+/*
+  Hash map whose entries are split into shards by the high bits of their mixed hashes, each protected by its own mutex, so
+  that operations on different shards do not contend. The hashes are computed and the keys are compared by Lean code,
+  the comparison being called with the lock of the shard held. */
+class concurrent_hash_map {
+    typedef std::unordered_multimap<uint64_t, std::pair<object *, object *>> entries;
+    struct shard {
+        mutex   m_mutex;
+        entries m_entries;
+        char    m_pad[LEAN_CACHE_LINE_SIZE];
+    };
+    shard          m_shards[LEAN_CONCURRENT_HASH_MAP_SHARDS];
+    atomic<size_t> m_size{0};
+
+    shard & get_shard(uint64_t hash) {
+        /* The hashes computed by Lean code are not necessarily well distributed, e.g. the hash of a `Nat` that fits in
+           a `UInt64` is the number itself. They are mixed using the finalizer of SplitMix64 so that every bit of the
+           hash affects the shard. */
+        hash ^= hash >> 30;
+        hash *= 0xbf58476d1ce4e5b9ULL;
+        hash ^= hash >> 27;
+        hash *= 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+        return m_shards[(hash >> 32) % LEAN_CONCURRENT_HASH_MAP_SHARDS];
+    }
+
+    static bool beq(b_obj_arg fn, b_obj_arg k1, b_obj_arg k2) {
+        inc(fn); inc(k1); inc(k2);
+        return unbox(apply_2(fn, k1, k2));
+    }
+
+    /* Return the entry for `k` in `es`, or `es.end()`. */
+    static entries::iterator find_entry(entries & es, uint64_t hash, b_obj_arg fn, b_obj_arg k) {
+        auto range = es.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (beq(fn, it->second.first, k))
+                return it;
+        }
+        return es.end();
+    }
+public:
+    ~concurrent_hash_map() {
+        for (shard & s : m_shards) {
+            for (auto & e : s.m_entries) {
+                dec(e.second.first);
+                dec(e.second.second);
+            }
+        }
+    }
+
+    /* Insert or replace the value of `k`, taking ownership of `k` and `v`. */
+    void insert(uint64_t hash, b_obj_arg fn, object * k, object * v) {
+        shard & s = get_shard(hash);
+        object * old_k = nullptr;
+        object * old_v = nullptr;
+        {
+            lock_guard<mutex> lock(s.m_mutex);
+            auto it = find_entry(s.m_entries, hash, fn, k);
+            if (it != s.m_entries.end()) {
+                old_k = it->second.first;
+                old_v = it->second.second;
+                it->second = std::make_pair(k, v);
+            } else {
+                s.m_entries.emplace(hash, std::make_pair(k, v));
+                m_size++;
+            }
+        }
+        // values are released after unlocking, as their finalizers may run arbitrary code
+        if (old_k) {
+            dec(old_k);
+            dec(old_v);
+        }
+    }
+
+    /* Return a new reference to the value of `k`, or `nullptr`. */
+    object * find(uint64_t hash, b_obj_arg fn, b_obj_arg k) {
+        shard & s = get_shard(hash);
+        lock_guard<mutex> lock(s.m_mutex);
+        auto it = find_entry(s.m_entries, hash, fn, k);
+        if (it == s.m_entries.end())
+            return nullptr;
+        inc(it->second.second);
+        return it->second.second;
+    }
+
+    /* Remove `k`, and return its value, or `nullptr`. */
+    object * erase(uint64_t hash, b_obj_arg fn, b_obj_arg k) {
+        shard & s = get_shard(hash);
+        object * old_k;
+        object * old_v;
+        {
+            lock_guard<mutex> lock(s.m_mutex);
+            auto it = find_entry(s.m_entries, hash, fn, k);
+            if (it == s.m_entries.end())
+                return nullptr;
+            old_k = it->second.first;
+            old_v = it->second.second;
+            s.m_entries.erase(it);
+            m_size--;
+        }
+        dec(old_k);
+        return old_v;
+    }
+
+    size_t size() const { return m_size; }
+
+    /* Return the number of entries of each shard. */
+    std::vector<size_t> shard_sizes() {
+        std::vector<size_t> r;
+        for (shard & s : m_shards) {
+            lock_guard<mutex> lock(s.m_mutex);
+            r.push_back(s.m_entries.size());
+        }
+        return r;
+    }
+};
+
+static lean_external_class * g_concurrent_hash_map_external_class = nullptr;
+static void concurrent_hash_map_finalizer(void * m) {
+    delete static_cast<concurrent_hash_map *>(m);
+}
+static void concurrent_hash_map_foreach(void *, b_obj_arg) {}
+
+static concurrent_hash_map * concurrent_hash_map_get(b_obj_arg m) {
+    return static_cast<concurrent_hash_map *>(lean_get_external_data(m));
+}
+
+/* ConcurrentHashMap.new {α β} : BaseIO (ConcurrentHashMap α β) */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_hash_map_new(obj_arg) {
+    return io_result_mk_ok(lean_alloc_external(g_concurrent_hash_map_external_class, new concurrent_hash_map()));
+}
+
+/* ConcurrentHashMap.insertImpl {α β} (m : @& ConcurrentHashMap α β) (hash : UInt64) (beq : @& (α → α → Bool))
+     (k : α) (v : β) : BaseIO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_hash_map_insert(b_obj_arg m, uint64_t hash, b_obj_arg beq,
+                                                                  obj_arg k, obj_arg v, obj_arg) {
+    mark_mt(k);
+    mark_mt(v);
+    concurrent_hash_map_get(m)->insert(hash, beq, k, v);
+    return io_result_mk_ok(box(0));
+}
+
+/* ConcurrentHashMap.getImpl? {α β} (m : @& ConcurrentHashMap α β) (hash : UInt64) (beq : @& (α → α → Bool))
+     (k : @& α) : BaseIO (Option β) */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_hash_map_find(b_obj_arg m, uint64_t hash, b_obj_arg beq,
+                                                                b_obj_arg k, obj_arg) {
+    if (object * v = concurrent_hash_map_get(m)->find(hash, beq, k))
+        return io_result_mk_ok(mk_option_some(v));
+    return io_result_mk_ok(mk_option_none());
+}
+
+/* ConcurrentHashMap.eraseImpl {α β} (m : @& ConcurrentHashMap α β) (hash : UInt64) (beq : @& (α → α → Bool))
+     (k : @& α) : BaseIO (Option β) */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_hash_map_erase(b_obj_arg m, uint64_t hash, b_obj_arg beq,
+                                                                 b_obj_arg k, obj_arg) {
+    if (object * v = concurrent_hash_map_get(m)->erase(hash, beq, k))
+        return io_result_mk_ok(mk_option_some(v));
+    return io_result_mk_ok(mk_option_none());
+}
+
+/* ConcurrentHashMap.size {α β} (m : @& ConcurrentHashMap α β) : BaseIO Nat */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_hash_map_size(b_obj_arg m, obj_arg) {
+    return io_result_mk_ok(lean_usize_to_nat(concurrent_hash_map_get(m)->size()));
+}
+
+/* ConcurrentHashMap.shardSizes {α β} (m : @& ConcurrentHashMap α β) : BaseIO (Array Nat) */
+extern "C" LEAN_EXPORT obj_res lean_io_concurrent_hash_map_shard_sizes(b_obj_arg m, obj_arg) {
+    std::vector<size_t> sizes = concurrent_hash_map_get(m)->shard_sizes();
+    object * a = lean_alloc_array(0, sizes.size());
+    for (size_t n : sizes)
+        a = lean_array_push(a, lean_usize_to_nat(n));
+    return io_result_mk_ok(a);
+}
+
+void initialize_concurrent() {
+    g_mpmc_queue_external_class = lean_register_external_class(mpmc_queue_finalizer, mpmc_queue_foreach);
+    g_concurrent_hash_map_external_class =
+        lean_register_external_class(concurrent_hash_map_finalizer, concurrent_hash_map_foreach);
+}
+
+void finalize_concurrent() {
+}
+}
@@ -4,6 +4,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <cstring>
 #include "runtime/hash.h"
 
 namespace lean {
@@ -55,4 +56,81 @@ uint64 hash_str(size_t len, unsigned char const * str, uint64 init_value) {
     return MurmurHash64A(str, len, init_value);
 }
 
+//-----------------------------------------------------------------------------
+// Hash function of the wyhash family, see https://github.com/wangyi-fudan/wyhash
+// It consumes 48 bytes per iteration in three independent lanes.
+static const uint64 g_hash_secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+/* `(lo, hi) := a * b` */
+static inline void mum(uint64 & a, uint64 & b) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    a = static_cast<uint64>(r);
+    b = static_cast<uint64>(r >> 64);
+#else
+    uint64 ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    uint64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+    uint64 c = t < rl;
+    uint64 lo = t + (rm1 << 32);
+    c += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64 mix(uint64 a, uint64 b) {
+    mum(a, b);
+    return a ^ b;
+}
+
+static inline uint64 read64(unsigned char const * p) { uint64 v; memcpy(&v, p, 8); return v; }
+static inline uint64 read32(unsigned char const * p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64 read_small(unsigned char const * p, size_t k) {
+    return (static_cast<uint64>(p[0]) << 16) | (static_cast<uint64>(p[k >> 1]) << 8) | p[k - 1];
+}
+
+uint64 hash_bytes(size_t len, unsigned char const * p, uint64 seed) {
+    uint64 const * s = g_hash_secret;
+    seed ^= mix(seed ^ s[0], s[1]);
+    uint64 a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t off = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + off);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - off);
+        } else if (len > 0) {
+            a = read_small(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64 see1 = seed, see2 = seed;
+            do {
+                seed = mix(read64(p) ^ s[1], read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ s[2], read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ s[3], read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ s[1], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= s[1];
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
 }
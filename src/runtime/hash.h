@@ -10,7 +10,11 @@ Author: Leonardo de Moura
 
 namespace lean {
 
+/* MurmurHash64A. It is used for `String.hash` and thus for `Name` hashes, which are stored in .olean files, so
+   its results must not change. */
 uint64 hash_str(size_t len, unsigned char const * str, uint64 init_value);
+/* Faster hash for byte sequences whose hashes are not persisted. */
+uint64 hash_bytes(size_t len, unsigned char const * str, uint64 init_value);
 
 inline uint64 hash(uint64 h, uint64 k) {
     uint64 m = 0xc6a4a7935bd1e995;
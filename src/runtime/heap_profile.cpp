@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "runtime/thread.h"
+#include "runtime/heap_profile.h"
+
+#ifdef __GLIBC__
+#include <execinfo.h>
+#endif
+
+#ifndef LEAN_HEAP_PROFILE_MAX_FRAMES
+#define LEAN_HEAP_PROFILE_MAX_FRAMES 64
+#endif
+
+namespace lean {
+/* Samples with the same call stack. */
+struct heap_profile_bucket {
+    uint64_t m_alloc_count{0};
+    uint64_t m_alloc_bytes{0};
+    uint64_t m_inuse_count{0};
+    uint64_t m_inuse_bytes{0};
+};
+
+struct heap_profile_sample {
+    heap_profile_bucket * m_bucket{nullptr};
+    size_t                m_size{0};
+};
+
+struct heap_profile {
+    std::string                                                 m_fname;
+    size_t                                                      m_interval;
+    mutex                                                       m_mutex;
+    std::map<std::vector<void *>, heap_profile_bucket>          m_buckets;
+    std::unordered_map<void *, heap_profile_sample>             m_live;
+};
+
+static heap_profile * g_heap_profile = nullptr;
+
+size_t get_heap_profile_interval() {
+    return g_heap_profile ? g_heap_profile->m_interval : 0;
+}
+
+void heap_profile_record(void * o, size_t sz) {
+    std::vector<void *> stack;
+#ifdef __GLIBC__
+    void * frames[LEAN_HEAP_PROFILE_MAX_FRAMES];
+    int n = backtrace(frames, LEAN_HEAP_PROFILE_MAX_FRAMES);
+    /* Skip the frames of the profiler and the allocator. */
+    int skip = n > 2 ? 2 : 0;
+    stack.assign(frames + skip, frames + n);
+#endif
+    lock_guard<mutex> _(g_heap_profile->m_mutex);
+    heap_profile_bucket & b = g_heap_profile->m_buckets[stack];
+    b.m_alloc_count++;
+    b.m_alloc_bytes += sz;
+    b.m_inuse_count++;
+    b.m_inuse_bytes += sz;
+    heap_profile_sample & s = g_heap_profile->m_live[o];
+    if (s.m_bucket) {
+        /* The previous object at this address was released without being reported, e.g., by `realloc`. */
+        s.m_bucket->m_inuse_count--;
+        s.m_bucket->m_inuse_bytes -= s.m_size;
+    }
+    s = heap_profile_sample{&b, sz};
+}
+
+void heap_profile_forget(void * o) {
+    lock_guard<mutex> _(g_heap_profile->m_mutex);
+    auto it = g_heap_profile->m_live.find(o);
+    if (it == g_heap_profile->m_live.end())
+        return;
+    heap_profile_bucket * b = it->second.m_bucket;
+    b->m_inuse_count--;
+    b->m_inuse_bytes -= it->second.m_size;
+    g_heap_profile->m_live.erase(it);
+}
+
+static void write_bucket(std::ostream & out, heap_profile_bucket const & b) {
+    out << b.m_inuse_count << ": " << b.m_inuse_bytes << " [" << b.m_alloc_count << ": " << b.m_alloc_bytes << "]";
+}
+
+void write_heap_profile() {
+    if (!g_heap_profile)
+        return;
+    lock_guard<mutex> _(g_heap_profile->m_mutex);
+    std::ofstream out(g_heap_profile->m_fname);
+    if (out.fail()) {
+        std::cerr << "failed to create heap profile '" << g_heap_profile->m_fname << "'\n";
+        return;
+    }
+    heap_profile_bucket total;
+    for (auto const & e : g_heap_profile->m_buckets) {
+        total.m_alloc_count += e.second.m_alloc_count;
+        total.m_alloc_bytes += e.second.m_alloc_bytes;
+        total.m_inuse_count += e.second.m_inuse_count;
+        total.m_inuse_bytes += e.second.m_inuse_bytes;
+    }
+    out << "heap profile: ";
+    write_bucket(out, total);
+    out << " @ heap_v2/" << g_heap_profile->m_interval << "\n";
+    for (auto const & e : g_heap_profile->m_buckets) {
+        write_bucket(out, e.second);
+        out << " @";
+        for (void * pc : e.first) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), " %p", pc);
+            out << buf;
+        }
+        out << "\n";
+    }
+    /* `pprof` uses the memory map to symbolize the addresses. */
+    out << "\nMAPPED_LIBRARIES:\n";
+    std::ifstream maps("/proc/self/maps");
+    if (maps)
+        out << maps.rdbuf();
+}
+
+static void write_heap_profile_at_exit() {
+    write_heap_profile();
+}
+
+void initialize_heap_profile() {
+#ifndef LEAN_EMSCRIPTEN
+    char const * fname = std::getenv("LEAN_HEAP_PROFILE");
+    if (!fname || !*fname)
+        return;
+    size_t interval = LEAN_HEAP_PROFILE_DEFAULT_INTERVAL;
+    if (char const * i = std::getenv("LEAN_HEAP_PROFILE_INTERVAL")) {
+        long long v = atoll(i);
+        if (v > 0)
+            interval = static_cast<size_t>(v);
+    }
+    g_heap_profile = new heap_profile();
+    g_heap_profile->m_fname    = fname;
+    g_heap_profile->m_interval = interval;
+    /* Programs, including `lean` itself, may exit without finalizing the runtime. */
+    std::atexit(write_heap_profile_at_exit);
+#endif
+}
+}
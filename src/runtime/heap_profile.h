@@ -0,0 +1,29 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <stddef.h>
+#include <lean/lean.h>
+
+#ifndef LEAN_HEAP_PROFILE_DEFAULT_INTERVAL
+#define LEAN_HEAP_PROFILE_DEFAULT_INTERVAL (512*1024)
+#endif
+
+namespace lean {
+/* Sampling heap profiler. When the environment variable `LEAN_HEAP_PROFILE` is set to a file name, the allocator
+   records the call stack of one allocation every `LEAN_HEAP_PROFILE_INTERVAL` bytes on average (default
+   `LEAN_HEAP_PROFILE_DEFAULT_INTERVAL`), and tracks whether the sampled objects are still alive. At exit, the
+   allocated and retained samples are written in the legacy gperftools heap profile format, which can be read by
+   `pprof`. Call stacks are only available on glibc platforms. */
+
+/* Return the average number of bytes between samples, or 0 if the profiler is disabled. */
+size_t get_heap_profile_interval();
+/* Record that `o` of `sz` bytes has been sampled. */
+void heap_profile_record(void * o, size_t sz);
+/* `o` belongs to a page or allocation containing sampled objects, and is about to be deallocated. */
+void heap_profile_forget(void * o);
+void write_heap_profile();
+
+void initialize_heap_profile();
+}
@@ -12,6 +12,9 @@ Author: Leonardo de Moura
 #include "runtime/stack_overflow.h"
 #include "runtime/process.h"
 #include "runtime/mutex.h"
+#include "runtime/concurrent.h"
+#include "runtime/cache_registry.h"
+#include "runtime/call_profile.h"
 #include "runtime/init_module.h"
 
 namespace lean {
@@ -22,8 +25,11 @@ extern "C" LEAN_EXPORT void lean_initialize_runtime_module() {
     initialize_io();
     initialize_thread();
     initialize_mutex();
+    initialize_concurrent();
+    initialize_cache_registry();
     initialize_process();
     initialize_stack_overflow();
+    initialize_call_profile();
 }
 void initialize_runtime_module() {
     lean_initialize_runtime_module();
@@ -31,6 +37,8 @@ void initialize_runtime_module() {
 void finalize_runtime_module() {
     finalize_stack_overflow();
     finalize_process();
+    finalize_cache_registry();
+    finalize_concurrent();
     finalize_mutex();
     finalize_thread();
     finalize_io();
@@ -11,6 +11,10 @@ Author: Leonardo de Moura
 #include "runtime/memory.h"
 #include "lean/lean.h"
 
+#ifndef LEAN_CHECK_INTERRUPTED_INTERVAL
+#define LEAN_CHECK_INTERRUPTED_INTERVAL 64
+#endif
+
 namespace lean {
 LEAN_THREAD_VALUE(size_t, g_max_heartbeat, 0);
 LEAN_THREAD_VALUE(size_t, g_heartbeat, 0);
@@ -19,6 +23,8 @@ void inc_heartbeat() { g_heartbeat++; }
 
 void reset_heartbeat() { g_heartbeat = 0; }
 
+size_t get_heartbeat() { return g_heartbeat; }
+
 void set_max_heartbeat(size_t max) { g_max_heartbeat = max; }
 
 size_t get_max_heartbeat() { return g_max_heartbeat; }
@@ -45,11 +51,20 @@ void check_interrupted() {
     }
 }
 
+/* Number of interruptible `check_system` calls left before the interrupt flag is checked again. */
+LEAN_THREAD_VALUE(unsigned, g_check_interrupted_countdown, 0);
+
 void check_system(char const * component_name, bool do_check_interrupted) {
     check_stack(component_name);
     check_memory(component_name);
     if (do_check_interrupted) {
-        check_interrupted();
+        /* Cancellation is only noticed every LEAN_CHECK_INTERRUPTED_INTERVAL calls, which is still a negligible delay.
+           Heartbeats are counted on every call, so that `maxHeartbeats` errors happen at the same point. */
+        if (g_check_interrupted_countdown == 0) {
+            g_check_interrupted_countdown = LEAN_CHECK_INTERRUPTED_INTERVAL;
+            check_interrupted();
+        }
+        g_check_interrupted_countdown--;
         check_heartbeat();
     }
 }
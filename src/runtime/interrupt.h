@@ -18,6 +18,9 @@ LEAN_EXPORT void inc_heartbeat();
 /** \brief Reset thread local counter for approximating elapsed time. */
 LEAN_EXPORT void reset_heartbeat();
 
+/** \brief Return the thread local counter for approximating elapsed time. */
+LEAN_EXPORT size_t get_heartbeat();
+
 /* Update the current heartbeat */
 class scope_heartbeat : flet<size_t> {
 public:
@@ -54,6 +57,8 @@ LEAN_EXPORT void check_interrupted();
    `do_check_interrupted` should only be set to `true` in places where a C++ exception is caught and
    would not bring down the entire process as interruption (via heartbeat limit or flag) should not
    be a fatal error.
+
+   The heartbeat limit is checked on every call, but the interrupt flag only every few calls.
 */
 LEAN_EXPORT void check_system(char const * component_name, bool do_check_interrupted = false);
 
@@ -27,6 +27,8 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #endif
 #ifndef LEAN_WINDOWS
 #include <csignal>
+#include <climits>
+#include <sys/uio.h>
 #endif
 #include <dirent.h>
 #include <fcntl.h>
@@ -36,6 +38,10 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include <fstream>
 #include <iomanip>
 #include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
 #include <cstdlib>
 #include <cctype>
 #include <sys/stat.h>
@@ -46,6 +52,7 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include "runtime/object.h"
 #include "runtime/thread.h"
 #include "runtime/allocprof.h"
+#include "runtime/memory.h"
 
 #ifdef _MSC_VER
 #define S_ISDIR(mode) ((mode & _S_IFDIR) != 0)
@@ -455,6 +462,16 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_truncate(b_obj_arg h, obj_arg
     }
 }
 
+#ifdef LEAN_WINDOWS
+static inline void lock_file(FILE * fp) { _lock_file(fp); }
+static inline void unlock_file(FILE * fp) { _unlock_file(fp); }
+static inline int getc_nolock(FILE * fp) { return _getc_nolock(fp); }
+#else
+static inline void lock_file(FILE * fp) { flockfile(fp); }
+static inline void unlock_file(FILE * fp) { funlockfile(fp); }
+static inline int getc_nolock(FILE * fp) { return getc_unlocked(fp); }
+#endif
+
 /* Handle.read : (@& Handle) → USize → IO ByteArray */
 extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_read(b_obj_arg h, usize nbytes, obj_arg /* w */) {
     FILE * fp = io_get_handle(h);
@@ -485,37 +502,317 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write(b_obj_arg h, b_obj_arg
     }
 }
 
-/*
-  Handle.getLine : (@& Handle) → IO Unit
-  The line returned by `lean_io_prim_handle_get_line`
-  is truncated at the first '\0' character and the
-  rest of the line is discarded. */
-extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_get_line(b_obj_arg h, obj_arg /* w */) {
+#if !defined(LEAN_WINDOWS) && !defined(IOV_MAX)
+#define IOV_MAX 1024
+#endif
+
+/* Handle.writeMany : (@& Handle) → (@& Array ByteArray) → IO Unit
+
+   Data buffered in the handle is flushed first, and then all buffers are written using as few `writev` calls as
+   possible, bypassing the `FILE` buffer. */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write_many(b_obj_arg h, b_obj_arg bufs, obj_arg /* w */) {
     FILE * fp = io_get_handle(h);
-    const int buf_sz = 64;
-    char buf_str[buf_sz]; // NOLINT
-    std::string result;
-    bool first = true;
+    size_t num = lean_array_size(bufs);
+    lock_file(fp);
+#ifdef LEAN_WINDOWS
+    for (size_t i = 0; i < num; i++) {
+        object * buf = lean_array_get_core(bufs, i);
+        usize n = lean_sarray_size(buf);
+        if (_fwrite_nolock(lean_sarray_cptr(buf), 1, n, fp) != n) {
+            int err = errno;
+            unlock_file(fp);
+            return io_result_mk_error(decode_io_error(err, nullptr));
+        }
+    }
+#else
+    if (std::fflush(fp) != 0) {
+        int err = errno;
+        unlock_file(fp);
+        return io_result_mk_error(decode_io_error(err, nullptr));
+    }
+    std::vector<iovec> iov;
+    iov.reserve(num);
+    for (size_t i = 0; i < num; i++) {
+        object * buf = lean_array_get_core(bufs, i);
+        if (lean_sarray_size(buf) > 0)
+            iov.push_back(iovec{lean_sarray_cptr(buf), lean_sarray_size(buf)});
+    }
+    int fd = fileno(fp);
+    size_t i = 0;
+    while (i < iov.size()) {
+        ssize_t k = writev(fd, iov.data() + i, static_cast<int>(std::min<size_t>(iov.size() - i, IOV_MAX)));
+        if (k < 0) {
+            if (errno == EINTR)
+                continue;
+            int err = errno;
+            unlock_file(fp);
+            return io_result_mk_error(decode_io_error(err, nullptr));
+        }
+        // skip the buffers written completely, and adjust the first one written partially
+        size_t written = k;
+        while (i < iov.size() && written >= iov[i].iov_len) {
+            written -= iov[i].iov_len;
+            i++;
+        }
+        if (written > 0) {
+            iov[i].iov_base = static_cast<char *>(iov[i].iov_base) + written;
+            iov[i].iov_len -= written;
+        }
+    }
+#endif
+    unlock_file(fp);
+    return io_result_mk_ok(box(0));
+}
+
+/* Read the contents of `fname` into a new byte array. If `map` is true, non-empty regular files are mapped into
+   memory instead, see `lean_io_map_bin_file`. */
+static obj_res read_bin_file(b_obj_arg fname, bool map) {
+    int flags = O_RDONLY;
+#ifdef LEAN_WINDOWS
+    flags |= O_BINARY | O_NOINHERIT;
+#else
+    flags |= O_CLOEXEC;
+#endif
+    int fd = open(lean_string_cstr(fname), flags);
+    if (fd == -1)
+        return io_result_mk_error(decode_io_error(errno, fname));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(err, fname));
+    }
+    // the size of other kinds of files (e.g. pipes) is not known in advance
+    size_t size = S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0;
+    if (map && size > 0) {
+        if (object * r = mmap_byte_array(fd, size)) {
+            close(fd);
+            return io_result_mk_ok(r);
+        }
+    }
+    size_t capacity = size > 0 ? size : 4096;
+    object * r = lean_alloc_sarray(1, 0, capacity);
+    size_t n = 0;
     while (true) {
-        char * out = std::fgets(buf_str, buf_sz, fp);
-        if (out != nullptr) {
-            if (strlen(buf_str) < buf_sz-1 || buf_str[buf_sz-2] == '\n') {
-                if (first) {
-                    return io_result_mk_ok(mk_string(out));
-                } else {
-                    result.append(out);
-                    return io_result_mk_ok(mk_string(result));
+        char buffer[4096];
+        bool full = n == capacity;
+        /* When the array is full, read into `buffer` first so that we do not grow it just to detect the end of file. */
+        auto k = read(fd, full ? buffer : reinterpret_cast<char *>(lean_sarray_cptr(r)) + n, full ? sizeof(buffer) : capacity - n);
+        if (k < 0) {
+            if (errno == EINTR)
+                continue;
+            int err = errno;
+            dec_ref(r);
+            close(fd);
+            return io_result_mk_error(decode_io_error(err, fname));
+        }
+        if (k == 0)
+            break;
+        if (full) {
+            capacity = 2 * capacity + k;
+            object * new_r = lean_alloc_sarray(1, n, capacity);
+            memcpy(lean_sarray_cptr(new_r), lean_sarray_cptr(r), n);
+            memcpy(lean_sarray_cptr(new_r) + n, buffer, k);
+            dec_ref(r);
+            r = new_r;
+        }
+        n += k;
+    }
+    close(fd);
+    lean_sarray_set_size(r, n);
+    return io_result_mk_ok(r);
+}
+
+/* IO.FS.readBinFile : (@& FilePath) → IO ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_io_read_bin_file(b_obj_arg fname, obj_arg /* w */) {
+    return read_bin_file(fname, false);
+}
+
+/* IO.FS.mapBinFile : (@& FilePath) → IO ByteArray
+
+   The mapping is private, so updates to the resulting array do not affect the file, but its contents are only read
+   from the file on access. */
+extern "C" LEAN_EXPORT obj_res lean_io_map_bin_file(b_obj_arg fname, obj_arg /* w */) {
+    return read_bin_file(fname, true);
+}
+
+// =======================================
+// Asynchronous handle operations
+
+extern "C" obj_res lean_io_promise_new(obj_arg);
+extern "C" obj_res lean_io_promise_resolve(obj_arg value, b_obj_arg promise, obj_arg);
+extern "C" obj_res lean_io_promise_result(obj_arg promise);
+
+#ifndef LEAN_ASYNC_IO_THREADS
+#define LEAN_ASYNC_IO_THREADS 4
+#endif
+
+/* Threads executing blocking handle operations for `Handle.readAsync`/`Handle.writeAsync`, so that
+   waiting for the operating system does not occupy task manager workers. */
+class async_io_pool {
+    mutex                                   m_mutex;
+    condition_variable                      m_cv;
+    std::deque<std::function<void()>>       m_jobs;
+    std::vector<std::unique_ptr<lthread>>   m_threads;
+    unsigned                                m_idle{0};
+    bool                                    m_shutting_down{false};
+
+    void spawn_thread() {
+        m_threads.emplace_back(new lthread([this]() {
+            unique_lock<mutex> lock(m_mutex);
+            m_idle++;
+            while (true) {
+                if (m_jobs.empty()) {
+                    if (m_shutting_down)
+                        break;
+                    m_cv.wait(lock);
+                    continue;
                 }
+                std::function<void()> job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                m_idle--;
+                lock.unlock();
+                job();
+                lock.lock();
+                m_idle++;
             }
-            result.append(out);
-        } else if (std::feof(fp)) {
-            clearerr(fp);
-            return io_result_mk_ok(mk_string(result));
-        } else {
-            return io_result_mk_error(decode_io_error(errno, nullptr));
+            m_idle--;
+        }));
+    }
+
+public:
+    ~async_io_pool() {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_shutting_down = true;
+        }
+        m_cv.notify_all();
+        for (auto & t : m_threads)
+            t->join();
+    }
+
+    void submit(std::function<void()> && job) {
+        unique_lock<mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+        if (m_idle == 0 && m_threads.size() < LEAN_ASYNC_IO_THREADS)
+            spawn_thread();
+        else
+            m_cv.notify_one();
+    }
+};
+
+static mutex *          g_async_io_mutex = nullptr;
+static async_io_pool *  g_async_io_pool  = nullptr;
+
+void finalize_async_io() {
+    async_io_pool * pool;
+    {
+        lock_guard<mutex> lock(*g_async_io_mutex);
+        pool = g_async_io_pool;
+        g_async_io_pool = nullptr;
+    }
+    delete pool;
+}
+
+obj_res io_result_to_except(obj_arg r) {
+    bool ok = lean_io_result_is_ok(r);
+    object * v = lean_ctor_get(r, 0);
+    lean_inc(v);
+    lean_dec_ref(r);
+    object * e = lean_alloc_ctor(ok ? 1 : 0, 1, 0);
+    lean_ctor_set(e, 0, v);
+    return e;
+}
+
+/* Run the handle operation `op` (returning an `IO` result) on an I/O thread, and return a task for its result.
+   Without a task manager or without threads, `op` is executed synchronously. */
+static obj_res io_handle_op_async(std::function<obj_res()> && op) {
+#if defined(LEAN_MULTI_THREAD)
+    if (!has_task_manager())
+#endif
+        return io_result_mk_ok(lean_task_pure(io_result_to_except(op())));
+    object * r = lean_io_promise_new(io_mk_world());
+    object * promise = lean_io_result_get_value(r);
+    lean_inc(promise);
+    lean_dec_ref(r);
+    lean_inc(promise);
+    {
+        lock_guard<mutex> lock(*g_async_io_mutex);
+        if (!g_async_io_pool)
+            g_async_io_pool = new async_io_pool();
+        g_async_io_pool->submit([=]() {
+            lean_dec_ref(lean_io_promise_resolve(io_result_to_except(op()), promise, io_mk_world()));
+            lean_dec_ref(promise);
+        });
+    }
+    return io_result_mk_ok(lean_io_promise_result(promise));
+}
+
+/* Handle.readAsync : (@& Handle) → USize → BaseIO (Task (Except IO.Error ByteArray)) */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_read_async(b_obj_arg h, usize nbytes, obj_arg /* w */) {
+    // `h` is shared with an I/O thread
+    lean_mark_mt(h);
+    lean_inc(h);
+    return io_handle_op_async([=]() {
+        obj_res r = lean_io_prim_handle_read(h, nbytes, io_mk_world());
+        lean_dec(h);
+        return r;
+    });
+}
+
+/* Handle.writeAsync : (@& Handle) → (@& ByteArray) → BaseIO (Task (Except IO.Error Unit)) */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write_async(b_obj_arg h, b_obj_arg buf, obj_arg /* w */) {
+    lean_mark_mt(h);
+    lean_mark_mt(buf);
+    lean_inc(h);
+    lean_inc(buf);
+    return io_handle_op_async([=]() {
+        obj_res r = lean_io_prim_handle_write(h, buf, io_mk_world());
+        lean_dec(h);
+        lean_dec(buf);
+        return r;
+    });
+}
+
+/*
+  Handle.getLine : (@& Handle) → IO String
+  The line is read directly from the `FILE` buffer into the resulting string, which may contain '\0' characters.
+  We do not keep a separate buffer per handle so that `getLine` can be freely mixed with the other handle
+  operations. */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_get_line(b_obj_arg h, obj_arg /* w */) {
+    FILE * fp = io_get_handle(h);
+    size_t capacity = 64;
+    object * r = lean_alloc_string(0, capacity, 0);
+    size_t n = 0;
+    int c;
+    lock_file(fp);
+    while ((c = getc_nolock(fp)) != EOF) {
+        // keep space for the terminating '\0'
+        if (n + 1 == capacity) {
+            capacity *= 2;
+            object * new_r = lean_alloc_string(0, capacity, 0);
+            memcpy(lean_to_string(new_r)->m_data, lean_to_string(r)->m_data, n);
+            lean_dec_ref(r);
+            r = new_r;
         }
-        first = false;
+        lean_to_string(r)->m_data[n++] = static_cast<char>(c);
+        if (c == '\n')
+            break;
     }
+    bool failed = c == EOF && std::ferror(fp);
+    int err = errno;
+    if (c == EOF && !failed)
+        clearerr(fp);
+    unlock_file(fp);
+    if (failed) {
+        lean_dec_ref(r);
+        return io_result_mk_error(decode_io_error(err, nullptr));
+    }
+    lean_string_object * o = lean_to_string(r);
+    o->m_data[n] = 0;
+    o->m_size    = n + 1;
+    o->m_length  = utf8_strlen(o->m_data, n);
+    return io_result_mk_ok(r);
 }
 
 /* Handle.putStr : (@& Handle) → (@& String) → IO Unit */
@@ -639,6 +936,41 @@ extern "C" LEAN_EXPORT obj_res lean_io_get_num_heartbeats(obj_arg /* w */) {
     return io_result_mk_ok(lean_uint64_to_nat(get_num_heartbeats()));
 }
 
+/* getAllocStats : BaseIO (Array AllocSlotStats) */
+extern "C" LEAN_EXPORT obj_res lean_io_get_alloc_stats(obj_arg /* w */) {
+    size_t n = lean_get_alloc_stats(nullptr, 0);
+    std::vector<lean_alloc_slot_stats> stats(n);
+    lean_get_alloc_stats(stats.data(), n);
+    object * r = lean_alloc_array(0, n);
+    for (lean_alloc_slot_stats const & s : stats) {
+        object * e = lean_alloc_ctor(0, 5, 0);
+        lean_ctor_set(e, 0, lean_usize_to_nat(s.m_obj_size));
+        lean_ctor_set(e, 1, lean_usize_to_nat(s.m_objs_per_page));
+        lean_ctor_set(e, 2, lean_uint64_to_nat(s.m_num_alloc));
+        lean_ctor_set(e, 3, lean_uint64_to_nat(s.m_num_free));
+        lean_ctor_set(e, 4, lean_uint64_to_nat(s.m_num_pages));
+        r = lean_array_push(r, e);
+    }
+    return io_result_mk_ok(r);
+}
+
+/* getAllocatedMemory : BaseIO Nat */
+extern "C" LEAN_EXPORT obj_res lean_io_get_allocated_memory(obj_arg /* w */) {
+    return io_result_mk_ok(lean_usize_to_nat(get_allocated_memory()));
+}
+
+/* setMemorySoftLimit (limit : @& Nat) (handler : BaseIO Unit) : BaseIO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_set_memory_soft_limit(b_obj_arg limit, obj_arg handler, obj_arg /* w */) {
+    // the handler may be called from any thread, and is never released
+    mark_mt(handler);
+    size_t n = lean_is_scalar(limit) ? unbox(limit) : SIZE_MAX;
+    set_memory_soft_limit(n, [=]() {
+        inc(handler);
+        dec(apply_1(handler, io_mk_world()));
+    });
+    return io_result_mk_ok(box(0));
+}
+
 /* addHeartbeats (count : Int64) : BaseIO Unit */
 extern "C" LEAN_EXPORT obj_res lean_io_add_heartbeats(int64_t count, obj_arg /* w */) {
     add_heartbeats(count);
@@ -764,6 +1096,28 @@ static obj_res timespec_to_obj(timespec const & ts) {
     return o;
 }
 
+static timespec stat_modified(struct stat const & st) {
+#ifdef __APPLE__
+    return st.st_mtimespec;
+#elif defined(LEAN_WINDOWS)
+    // TODO: sub-second precision on Windows
+    return timespec { st.st_mtime, 0 };
+#else
+    return st.st_mtim;
+#endif
+}
+
+/* Index of the `FileType` constructor for `st`. */
+static uint8 file_type_of_stat(struct stat const & st) {
+    return
+        S_ISDIR(st.st_mode) ? 0 :
+        S_ISREG(st.st_mode) ? 1 :
+#ifndef LEAN_WINDOWS
+        S_ISLNK(st.st_mode) ? 2 :
+#endif
+        3;
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_metadata(b_obj_arg fname, obj_arg) {
     struct stat st;
     if (stat(string_cstr(fname), &st) != 0) {
@@ -772,26 +1126,174 @@ extern "C" LEAN_EXPORT obj_res lean_io_metadata(b_obj_arg fname, obj_arg) {
     object * mdata = alloc_cnstr(0, 2, sizeof(uint64) + sizeof(uint8));
 #ifdef __APPLE__
     cnstr_set(mdata, 0, timespec_to_obj(st.st_atimespec));
-    cnstr_set(mdata, 1, timespec_to_obj(st.st_mtimespec));
 #elif defined(LEAN_WINDOWS)
     // TODO: sub-second precision on Windows
     cnstr_set(mdata, 0, timespec_to_obj(timespec { st.st_atime, 0 }));
-    cnstr_set(mdata, 1, timespec_to_obj(timespec { st.st_mtime, 0 }));
 #else
     cnstr_set(mdata, 0, timespec_to_obj(st.st_atim));
-    cnstr_set(mdata, 1, timespec_to_obj(st.st_mtim));
 #endif
+    cnstr_set(mdata, 1, timespec_to_obj(stat_modified(st)));
     cnstr_set_uint64(mdata, 2 * sizeof(object *), st.st_size);
-    cnstr_set_uint8(mdata, 2 * sizeof(object *) + sizeof(uint64),
-                    S_ISDIR(st.st_mode) ? 0 :
-                    S_ISREG(st.st_mode) ? 1 :
-#ifndef LEAN_WINDOWS
-                    S_ISLNK(st.st_mode) ? 2 :
-#endif
-                    3);
+    cnstr_set_uint8(mdata, 2 * sizeof(object *) + sizeof(uint64), file_type_of_stat(st));
     return io_result_mk_ok(mdata);
 }
 
+/*
+structure WalkEntry where
+  path     : FilePath
+  modified : SystemTime
+  type     : FileType
+
+constant readDirRecursive : @& FilePath → IO (Array WalkEntry)
+*/
+#ifndef LEAN_WALK_DIR_THREADS
+#define LEAN_WALK_DIR_THREADS 8
+#endif
+
+struct walk_dir_entry {
+    std::string m_path;
+    timespec    m_modified;
+    uint8       m_type;
+};
+
+/* Read the entries of the directory `path`, appending them to `entries` and the subdirectories to `subdirs`.
+   Symbolic links are not followed. Return an `errno` value on failure, and set `err_path` to the offending path. */
+static int read_dir_entries(std::string const & path, std::vector<walk_dir_entry> & entries,
+                            std::vector<std::string> & subdirs, std::string & err_path) {
+#ifdef LEAN_WINDOWS
+    DIR * dp = opendir(path.c_str());
+#else
+    DIR * dp = nullptr;
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1 && !(dp = fdopendir(fd))) {
+        int err = errno;
+        close(fd);
+        errno = err;
+    }
+#endif
+    if (!dp) {
+        err_path = path;
+        return errno;
+    }
+    while (dirent * entry = readdir(dp)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+#ifdef LEAN_WINDOWS
+        std::string entry_path = path + "\\" + entry->d_name;
+        struct stat st;
+        int r = stat(entry_path.c_str(), &st);
+#else
+        std::string entry_path = path + "/" + entry->d_name;
+        struct stat st;
+        int r = fstatat(dirfd(dp), entry->d_name, &st, AT_SYMLINK_NOFOLLOW);
+#endif
+        if (r != 0) {
+            // entry vanished, ignore
+            if (errno == ENOENT)
+                continue;
+            int err = errno;
+            closedir(dp);
+            err_path = entry_path;
+            return err;
+        }
+        uint8 type = file_type_of_stat(st);
+        if (type == 0)
+            subdirs.push_back(entry_path);
+        entries.push_back(walk_dir_entry{std::move(entry_path), stat_modified(st), type});
+    }
+    lean_always_assert(closedir(dp) == 0);
+    return 0;
+}
+
+/* Traverse the subdirectories queued in `m_todo` using a small number of threads. */
+class dir_walker {
+    mutex                           m_mutex;
+    condition_variable              m_cv;
+    std::vector<std::string>        m_todo;
+    unsigned                        m_busy{0};
+    std::vector<walk_dir_entry>     m_entries;
+    int                             m_error{0};
+    std::string                     m_error_path;
+
+    void run() {
+        unique_lock<mutex> lock(m_mutex);
+        while (true) {
+            if (m_error == 0 && !m_todo.empty()) {
+                std::string dir = std::move(m_todo.back());
+                m_todo.pop_back();
+                m_busy++;
+                lock.unlock();
+                std::vector<walk_dir_entry> entries;
+                std::vector<std::string> subdirs;
+                std::string err_path;
+                int err = read_dir_entries(dir, entries, subdirs, err_path);
+                lock.lock();
+                m_busy--;
+                // subdirectory vanished, ignore
+                if (err != 0 && err != ENOENT && m_error == 0) {
+                    m_error = err;
+                    m_error_path = err_path;
+                }
+                for (walk_dir_entry & e : entries)
+                    m_entries.push_back(std::move(e));
+                for (std::string & d : subdirs)
+                    m_todo.push_back(std::move(d));
+                if (!subdirs.empty() || m_busy == 0)
+                    m_cv.notify_all();
+            } else if (m_busy == 0) {
+                return;
+            } else {
+                m_cv.wait(lock);
+            }
+        }
+    }
+
+public:
+    dir_walker(std::vector<walk_dir_entry> && entries, std::vector<std::string> && subdirs):
+        m_todo(std::move(subdirs)), m_entries(std::move(entries)) {}
+
+    /* Return an `errno` value on failure. */
+    int walk(std::vector<walk_dir_entry> & entries, std::string & err_path) {
+        std::vector<std::unique_ptr<lthread>> threads;
+#if defined(LEAN_MULTI_THREAD)
+        /* The threads mostly wait for the file system, so we do not limit them by the number of cores. */
+        for (unsigned i = 1; i < LEAN_WALK_DIR_THREADS && i < m_todo.size(); i++)
+            threads.emplace_back(new lthread([this]() { run(); }));
+#endif
+        run();
+        for (auto & t : threads)
+            t->join();
+        entries = std::move(m_entries);
+        err_path = m_error_path;
+        return m_error;
+    }
+};
+
+extern "C" LEAN_EXPORT obj_res lean_io_read_dir_recursive(b_obj_arg dirname, obj_arg) {
+    std::vector<walk_dir_entry> entries;
+    std::vector<std::string> subdirs;
+    std::string err_path;
+    int err = read_dir_entries(string_cstr(dirname), entries, subdirs, err_path);
+    if (err == 0 && !subdirs.empty())
+        err = dir_walker(std::move(entries), std::move(subdirs)).walk(entries, err_path);
+    if (err != 0) {
+        object * p = mk_string(err_path);
+        obj_res r = io_result_mk_error(decode_io_error(err, p));
+        dec_ref(p);
+        return r;
+    }
+    object * arr = lean_alloc_array(0, entries.size());
+    for (walk_dir_entry const & e : entries) {
+        object * o = alloc_cnstr(0, 2, sizeof(uint8));
+        cnstr_set(o, 0, mk_string(e.m_path));
+        cnstr_set(o, 1, timespec_to_obj(e.m_modified));
+        cnstr_set_uint8(o, 2 * sizeof(object *), e.m_type);
+        arr = lean_array_push(arr, o);
+    }
+    return io_result_mk_ok(arr);
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_create_dir(b_obj_arg p, obj_arg) {
 #ifdef LEAN_WINDOWS
     if (mkdir(string_cstr(p)) == 0) {
@@ -936,25 +1438,79 @@ static inline atomic<object*> * mt_ref_val_addr(object * o) {
 */
 static inline bool ref_maybe_mt(b_obj_arg ref) { return lean_is_mt(ref) || lean_is_persistent(ref); }
 
+/*
+  Readers of multi-threaded refs must not `inc` a value that a writer has just removed and released. We use hazard
+  pointers: a reader publishes the value it is about to `inc` in its hazard slot, and validates that the ref still
+  contains it. A thread that removes a value from a ref and may release it waits until no hazard slot points to it,
+  which only takes a reader a few instructions. Thus readers never wait for each other, and they only wait for writers
+  while the ref is empty during `take`. The slots are never deallocated, they are reused after their thread exits. */
+struct hazard_slot {
+    atomic<object *>  m_ptr{nullptr};
+    atomic<bool>      m_used{true};
+    hazard_slot *     m_next{nullptr};
+};
+
+static atomic<hazard_slot *> g_hazard_slots{nullptr};
+LEAN_THREAD_PTR(hazard_slot, g_hazard_slot);
+
+static void release_hazard_slot(void *) {
+    g_hazard_slot->m_used.store(false);
+    g_hazard_slot = nullptr;
+}
+
+static hazard_slot * get_hazard_slot() {
+    if (g_hazard_slot)
+        return g_hazard_slot;
+    hazard_slot * slot = nullptr;
+    for (hazard_slot * it = g_hazard_slots.load(); it; it = it->m_next) {
+        bool used = false;
+        if (!it->m_used.load() && it->m_used.compare_exchange_strong(used, true)) {
+            slot = it;
+            break;
+        }
+    }
+    if (!slot) {
+        slot = new hazard_slot();
+        slot->m_next = g_hazard_slots.load();
+        while (!g_hazard_slots.compare_exchange_weak(slot->m_next, slot)) {}
+    }
+    g_hazard_slot = slot;
+    // a slot acquired by a thread finalizer stays in use
+    if (!in_thread_finalization())
+        register_post_thread_finalizer(release_hazard_slot, nullptr);
+    return slot;
+}
+
+/* Wait until no reader is about to `inc` `val`, which has been removed from a multi-threaded ref. */
+static void wait_for_ref_readers(object * val) {
+    for (hazard_slot * it = g_hazard_slots.load(); it; it = it->m_next) {
+        while (it->m_ptr.load() == val)
+            this_thread::yield();
+    }
+}
+
+/* Return a new reference to the value of the multi-threaded ref at `val_addr`. */
+static object * mt_ref_get(atomic<object *> * val_addr) {
+    hazard_slot * slot = get_hazard_slot();
+    while (true) {
+        object * val = val_addr->load();
+        if (val == nullptr) {
+            /* the value has been taken, and will be put back */
+            this_thread::yield();
+            continue;
+        }
+        slot->m_ptr.store(val);
+        if (val_addr->load() == val) {
+            inc(val);
+            slot->m_ptr.store(nullptr);
+            return val;
+        }
+    }
+}
+
 extern "C" LEAN_EXPORT obj_res lean_st_ref_get(b_obj_arg ref, obj_arg) {
     if (ref_maybe_mt(ref)) {
-        atomic<object *> * val_addr = mt_ref_val_addr(ref);
-        while (true) {
-            /*
-              We cannot simply read `val` from the ref and `inc` it like in the `else` branch since someone else could
-              write to the ref in between and remove the last owning reference to the object. Instead, we must take
-              ownership of the RC token in the ref via `exchange`, duplicate it, then put one RC token back. */
-            object * val = val_addr->exchange(nullptr);
-            if (val != nullptr) {
-                inc(val);
-                object * tmp = val_addr->exchange(val);
-                if (tmp != nullptr) {
-                    /* this may happen if another thread wrote `ref` */
-                    dec(tmp);
-                }
-                return io_result_mk_ok(val);
-            }
-        }
+        return io_result_mk_ok(mt_ref_get(mt_ref_val_addr(ref)));
     } else {
         object * val = lean_to_ref(ref)->m_value;
         lean_assert(val != nullptr);
@@ -968,8 +1524,10 @@ extern "C" LEAN_EXPORT obj_res lean_st_ref_take(b_obj_arg ref, obj_arg) {
         atomic<object *> * val_addr = mt_ref_val_addr(ref);
         while (true) {
             object * val = val_addr->exchange(nullptr);
-            if (val != nullptr)
+            if (val != nullptr) {
+                wait_for_ref_readers(val);
                 return io_result_mk_ok(val);
+            }
         }
     } else {
         object * val = lean_to_ref(ref)->m_value;
@@ -989,8 +1547,10 @@ extern "C" LEAN_EXPORT obj_res lean_st_ref_set(b_obj_arg ref, obj_arg a, obj_arg
         mark_mt(a);
         atomic<object *> * val_addr = mt_ref_val_addr(ref);
         object * old_a = val_addr->exchange(a);
-        if (old_a != nullptr)
+        if (old_a != nullptr) {
+            wait_for_ref_readers(old_a);
             dec(old_a);
+        }
         return io_result_mk_ok(box(0));
     } else {
         if (lean_to_ref(ref)->m_value != nullptr)
@@ -1007,8 +1567,10 @@ extern "C" LEAN_EXPORT obj_res lean_st_ref_swap(b_obj_arg ref, obj_arg a, obj_ar
         atomic<object *> * val_addr = mt_ref_val_addr(ref);
         while (true) {
             object * old_a = val_addr->exchange(a);
-            if (old_a != nullptr)
+            if (old_a != nullptr) {
+                wait_for_ref_readers(old_a);
                 return io_result_mk_ok(old_a);
+            }
         }
     } else {
         object * old_a = lean_to_ref(ref)->m_value;
@@ -1019,6 +1581,50 @@ extern "C" LEAN_EXPORT obj_res lean_st_ref_swap(b_obj_arg ref, obj_arg a, obj_ar
     }
 }
 
+/* atomicModifyGet {σ α β} (r : @& Ref σ α) (f : α → β × α) : ST σ β */
+extern "C" LEAN_EXPORT obj_res lean_st_ref_atomic_modify_get(b_obj_arg ref, obj_arg f, obj_arg) {
+    if (ref_maybe_mt(ref)) {
+        atomic<object *> * val_addr = mt_ref_val_addr(ref);
+        while (true) {
+            /* We keep a reference to `val` until the `compare_exchange` so that its address cannot be reused. */
+            object * val = mt_ref_get(val_addr);
+            inc(val);
+            inc(f);
+            object * r = apply_1(f, val);
+            object * b = cnstr_get(r, 0);
+            object * a = cnstr_get(r, 1);
+            inc(b);
+            inc(a);
+            dec(r);
+            /* See lean_st_ref_set */
+            mark_mt(a);
+            object * expected = val;
+            if (val_addr->compare_exchange_strong(expected, a)) {
+                wait_for_ref_readers(val);
+                dec(val);
+                dec(val);
+                dec(f);
+                return io_result_mk_ok(b);
+            }
+            dec(a);
+            dec(b);
+            dec(val);
+        }
+    } else {
+        object * val = lean_to_ref(ref)->m_value;
+        lean_assert(val != nullptr);
+        lean_to_ref(ref)->m_value = nullptr;
+        object * r = apply_1(f, val);
+        object * b = cnstr_get(r, 0);
+        object * a = cnstr_get(r, 1);
+        inc(b);
+        inc(a);
+        dec(r);
+        lean_to_ref(ref)->m_value = a;
+        return io_result_mk_ok(b);
+    }
+}
+
 extern "C" LEAN_EXPORT obj_res lean_st_ref_ptr_eq(b_obj_arg ref1, b_obj_arg ref2, obj_arg) {
     // TODO(Leo): ref_maybe_mt
     bool r = lean_to_ref(ref1)->m_value == lean_to_ref(ref2)->m_value;
@@ -1092,6 +1698,7 @@ extern "C" LEAN_EXPORT obj_res lean_io_exit(uint8_t code, obj_arg /* w */) {
 }
 
 void initialize_io() {
+    g_async_io_mutex = new mutex();
     g_io_error_nullptr_read = lean_mk_io_user_error(mk_string("null reference read"));
     mark_persistent(g_io_error_nullptr_read);
     g_io_handle_external_class = lean_register_external_class(io_handle_finalizer, io_handle_foreach);
@@ -1113,5 +1720,6 @@ void initialize_io() {
 }
 
 void finalize_io() {
+    delete g_async_io_mutex;
 }
 }
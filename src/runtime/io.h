@@ -16,6 +16,10 @@ LEAN_EXPORT lean_obj_res io_result_mk_error(char const * msg);
 LEAN_EXPORT lean_obj_res io_result_mk_error(std::string const & msg);
 inline lean_obj_res decode_io_error(int errnum, b_lean_obj_arg fname) { return lean_decode_io_error(errnum, fname); }
 LEAN_EXPORT lean_obj_res io_wrap_handle(FILE * hfile);
+/* Convert the result of an `IO α` action into an `Except IO.Error α`. */
+lean_obj_res io_result_to_except(lean_obj_arg r);
+/* Wait for pending `Handle.readAsync`/`Handle.writeAsync` operations and stop the threads executing them. */
+void finalize_async_io();
 void initialize_io();
 void finalize_io();
 }
@@ -0,0 +1,524 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "runtime/object_ref.h"
+#include "runtime/utf8.h"
+
+/* Native implementations of `Lean.Json.parse` and `Lean.Json.compress`, used by the server for JSON-RPC messages.
+   They produce and consume the `Json` objects of `Lean.Data.Json.Basic` directly:
+   ```
+   inductive Json | null | bool (b : Bool) | num (n : JsonNumber) | str (s : String)
+                  | arr (elems : Array Json) | obj (kvPairs : RBNode String (fun _ => Json))
+   ```
+   Both return `none` on inputs they do not handle, in which case the Lean implementations are used. In particular,
+   the parser does not produce error messages. */
+
+/* Nested arrays and objects deeper than this are left to the Lean parser. */
+#ifndef LEAN_JSON_MAX_DEPTH
+#define LEAN_JSON_MAX_DEPTH 512
+#endif
+
+/* Exponents that would add more than this many digits to a mantissa are left to the Lean parser. */
+#ifndef LEAN_JSON_MAX_SHIFT
+#define LEAN_JSON_MAX_SHIFT 4096
+#endif
+
+namespace lean {
+enum class json_kind { Null, Bool, Num, Str, Arr, Obj };
+
+static inline bool is_digit(char c) { return '0' <= c && c <= '9'; }
+
+static inline bool is_plain_char(unsigned char c) { return c != '"' && c != '\\' && c >= 0x20; }
+
+class json_parser {
+    char const * m_it;
+    char const * m_end;
+    unsigned     m_depth = 0;
+
+    bool at(char c) const { return m_it != m_end && *m_it == c; }
+    bool at_digit() const { return m_it != m_end && is_digit(*m_it); }
+
+    void ws() {
+        while (m_it != m_end && (*m_it == ' ' || *m_it == '\t' || *m_it == '\n' || *m_it == '\r'))
+            m_it++;
+    }
+
+    bool skip_string(char const * s) {
+        for (; *s; s++, m_it++) {
+            if (!at(*s))
+                return false;
+        }
+        return true;
+    }
+
+    bool hex_digit(unsigned & r) {
+        if (m_it == m_end)
+            return false;
+        char c = *m_it++;
+        if ('0' <= c && c <= '9')
+            r = 16*r + (c - '0');
+        else if ('a' <= c && c <= 'f')
+            r = 16*r + (c - 'a' + 10);
+        else if ('A' <= c && c <= 'F')
+            r = 16*r + (c - 'A' + 10);
+        else
+            return false;
+        return true;
+    }
+
+    /* Parse the remainder of a string literal whose opening quote has been consumed. */
+    bool str(std::string & r) {
+        r.clear();
+        while (true) {
+            char const * start = m_it;
+            while (m_it != m_end && is_plain_char(*m_it))
+                m_it++;
+            r.append(start, m_it);
+            if (m_it == m_end)
+                return false;
+            char c = *m_it++;
+            if (c == '"')
+                return true;
+            if (c != '\\' || m_it == m_end)
+                return false;
+            switch (*m_it++) {
+            case '\\': r.push_back('\\'); break;
+            case '"':  r.push_back('"'); break;
+            case '/':  r.push_back('/'); break;
+            case 'b':  r.push_back('\x08'); break;
+            case 'f':  r.push_back('\x0c'); break;
+            case 'n':  r.push_back('\n'); break;
+            case 'r':  r.push_back('\x0d'); break;
+            case 't':  r.push_back('\t'); break;
+            case 'u': {
+                unsigned v = 0;
+                if (!hex_digit(v) || !hex_digit(v) || !hex_digit(v) || !hex_digit(v))
+                    return false;
+                // `Char.ofNat` maps surrogates to `'\0'`
+                if (0xd800 <= v && v <= 0xdfff)
+                    v = 0;
+                push_unicode_scalar(r, v);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+    }
+
+    /* `JsonNumber` as produced by `Json.Parser.num`: the mantissa consists of the digits of the integral and
+       fractional parts, and the exponent is the number of fractional digits, adjusted by `shiftl`/`shiftr`. */
+    object * num() {
+        bool neg = false;
+        if (at('-')) {
+            neg = true;
+            m_it++;
+        }
+        if (!at_digit())
+            return nullptr;
+        char const * start = m_it;
+        if (*m_it == '0') {
+            m_it++;
+        } else {
+            while (at_digit())
+                m_it++;
+        }
+        std::string digits(start, m_it);
+        size_t exponent = 0;
+        if (at('.')) {
+            m_it++;
+            if (!at_digit())
+                return nullptr;
+            start = m_it;
+            while (at_digit())
+                m_it++;
+            digits.append(start, m_it);
+            exponent = m_it - start;
+        }
+        if (at('e') || at('E')) {
+            m_it++;
+            bool shiftr = false;
+            if (at('-')) {
+                shiftr = true;
+                m_it++;
+            } else if (at('+')) {
+                m_it++;
+            }
+            if (!at_digit())
+                return nullptr;
+            size_t n = 0;
+            while (at_digit()) {
+                n = 10*n + (*m_it - '0');
+                if (n > LEAN_JSON_MAX_SHIFT)
+                    return nullptr;
+                m_it++;
+            }
+            if (shiftr) {
+                exponent += n;
+            } else if (n > exponent) {
+                digits.append(n - exponent, '0');
+                exponent = 0;
+            } else {
+                exponent -= n;
+            }
+        }
+        size_t i = digits.find_first_not_of('0');
+        object * mantissa;
+        if (i == std::string::npos) {
+            mantissa = box(0);
+        } else if (digits.size() - i <= 18) {
+            uint64 v = 0;
+            for (; i < digits.size(); i++)
+                v = 10*v + (digits[i] - '0');
+            mantissa = lean_int64_to_int(neg ? -static_cast<int64>(v) : static_cast<int64>(v));
+        } else {
+            mantissa = lean_nat_to_int(lean_cstr_to_nat(digits.c_str() + i));
+            if (neg) {
+                object * r = lean_int_neg(mantissa);
+                dec(mantissa);
+                mantissa = r;
+            }
+        }
+        object * n = alloc_cnstr(0, 2, 0);
+        cnstr_set(n, 0, mantissa);
+        cnstr_set(n, 1, lean_usize_to_nat(exponent));
+        object * r = alloc_cnstr(static_cast<unsigned>(json_kind::Num), 1, 0);
+        cnstr_set(r, 0, n);
+        return r;
+    }
+
+    object * arr() {
+        std::vector<object_ref> elems;
+        if (at(']')) {
+            m_it++;
+            ws();
+        } else {
+            while (true) {
+                object * e = value();
+                if (!e)
+                    return nullptr;
+                elems.push_back(object_ref(e));
+                if (m_it == m_end)
+                    return nullptr;
+                char c = *m_it++;
+                ws();
+                if (c == ']')
+                    break;
+                if (c != ',')
+                    return nullptr;
+            }
+        }
+        object * a = alloc_array(elems.size(), elems.size());
+        for (size_t i = 0; i < elems.size(); i++)
+            lean_array_set_core(a, i, elems[i].steal());
+        object * r = alloc_cnstr(static_cast<unsigned>(json_kind::Arr), 1, 0);
+        cnstr_set(r, 0, a);
+        return r;
+    }
+
+    typedef std::vector<std::pair<std::string, object_ref>> fields;
+
+    /* Build a red-black tree of the sorted fields `fs[lo, hi)`. The tree is balanced, and all nodes on its deepest
+       level `red_depth` are red, so that it satisfies the invariants of `RBNode`. */
+    static object * mk_rbnode(fields & fs, size_t lo, size_t hi, unsigned depth, unsigned red_depth) {
+        if (lo == hi)
+            return box(0);
+        size_t mid = lo + (hi - lo) / 2;
+        object * r = alloc_cnstr(1, 4, 1);
+        cnstr_set(r, 0, mk_rbnode(fs, lo, mid, depth + 1, red_depth));
+        cnstr_set(r, 1, mk_string(fs[mid].first));
+        cnstr_set(r, 2, fs[mid].second.steal());
+        cnstr_set(r, 3, mk_rbnode(fs, mid + 1, hi, depth + 1, red_depth));
+        // `RBColor.red` is 0 and `RBColor.black` is 1
+        cnstr_set_uint8(r, 4*sizeof(object*), depth == red_depth ? 0 : 1);
+        return r;
+    }
+
+    object * obj() {
+        fields fs;
+        if (at('}')) {
+            m_it++;
+            ws();
+        } else {
+            std::string k;
+            while (true) {
+                if (!at('"'))
+                    return nullptr;
+                m_it++;
+                if (!str(k))
+                    return nullptr;
+                ws();
+                if (!at(':'))
+                    return nullptr;
+                m_it++;
+                ws();
+                object * v = value();
+                if (!v)
+                    return nullptr;
+                fs.emplace_back(k, object_ref(v));
+                if (m_it == m_end)
+                    return nullptr;
+                char c = *m_it++;
+                ws();
+                if (c == '}')
+                    break;
+                if (c != ',')
+                    return nullptr;
+            }
+        }
+        // `Json.Parser.objectCore` inserts the fields from last to first, so the first occurrence of a key wins
+        std::stable_sort(fs.begin(), fs.end(), [](fields::value_type const & a, fields::value_type const & b) {
+                return a.first < b.first;
+            });
+        fs.erase(std::unique(fs.begin(), fs.end(), [](fields::value_type const & a, fields::value_type const & b) {
+                    return a.first == b.first;
+                }), fs.end());
+        unsigned red_depth = 0;
+        while ((static_cast<size_t>(2) << red_depth) <= fs.size())
+            red_depth++;
+        object * r = alloc_cnstr(static_cast<unsigned>(json_kind::Obj), 1, 0);
+        cnstr_set(r, 0, mk_rbnode(fs, 0, fs.size(), 0, red_depth));
+        return r;
+    }
+
+    /* Parse a value and the whitespace following it, as `Json.Parser.anyCore`. Return `nullptr` on failure. */
+    object * value() {
+        if (m_it == m_end || m_depth >= LEAN_JSON_MAX_DEPTH)
+            return nullptr;
+        switch (*m_it) {
+        case '[': case '{': {
+            bool is_arr = *m_it == '[';
+            m_it++;
+            ws();
+            m_depth++;
+            object * r = is_arr ? arr() : obj();
+            m_depth--;
+            return r;
+        }
+        case '"': {
+            m_it++;
+            std::string s;
+            if (!str(s))
+                return nullptr;
+            ws();
+            object * r = alloc_cnstr(static_cast<unsigned>(json_kind::Str), 1, 0);
+            cnstr_set(r, 0, mk_string(s));
+            return r;
+        }
+        case 'f': case 't': {
+            bool b = *m_it == 't';
+            if (!skip_string(b ? "true" : "false"))
+                return nullptr;
+            ws();
+            object * r = alloc_cnstr(static_cast<unsigned>(json_kind::Bool), 0, 1);
+            cnstr_set_uint8(r, 0, b);
+            return r;
+        }
+        case 'n':
+            if (!skip_string("null"))
+                return nullptr;
+            ws();
+            return box(static_cast<unsigned>(json_kind::Null));
+        default: {
+            if (*m_it != '-' && !is_digit(*m_it))
+                return nullptr;
+            object * r = num();
+            if (r)
+                ws();
+            return r;
+        }
+        }
+    }
+
+public:
+    json_parser(char const * begin, char const * end):m_it(begin), m_end(end) {}
+
+    object * operator()() {
+        ws();
+        object * r = value();
+        if (r && m_it != m_end) {
+            dec(r);
+            return nullptr;
+        }
+        return r;
+    }
+};
+
+/* Parse `s` as `Json.Parser.any`, returning `none` if it fails or the input is not supported. */
+extern "C" LEAN_EXPORT obj_res lean_json_parse(b_obj_arg s) {
+    char const * begin = string_cstr(s);
+    object * r = json_parser(begin, begin + string_size(s) - 1)();
+    return r ? mk_option_some(r) : mk_option_none();
+}
+
+class json_compressor {
+    std::string m_out;
+
+    void render_string(b_obj_arg s) {
+        char const * it  = string_cstr(s);
+        char const * end = it + string_size(s) - 1;
+        m_out.push_back('"');
+        while (true) {
+            char const * start = it;
+            while (it != end && is_plain_char(*it))
+                it++;
+            m_out.append(start, it);
+            if (it == end)
+                break;
+            unsigned char c = *it++;
+            if (c == '"') {
+                m_out += "\\\"";
+            } else if (c == '\\') {
+                m_out += "\\\\";
+            } else if (c == '\n') {
+                m_out += "\\n";
+            } else if (c == '\x0d') {
+                m_out += "\\r";
+            } else {
+                static char const hex[] = "0123456789abcdef";
+                m_out += "\\u00";
+                m_out.push_back(hex[c / 16]);
+                m_out.push_back(hex[c % 16]);
+            }
+        }
+        m_out.push_back('"');
+    }
+
+    /* `JsonNumber.toString` */
+    bool render_num(b_obj_arg n) {
+        b_obj_arg m = cnstr_get(n, 0);
+        b_obj_arg e = cnstr_get(n, 1);
+        if (!is_scalar(e))
+            return false;
+        bool neg;
+        std::string digits;
+        if (is_scalar(m)) {
+            int64 v = lean_scalar_to_int64(m);
+            neg = v < 0;
+            digits = std::to_string(neg ? -static_cast<uint64>(v) : static_cast<uint64>(v));
+        } else {
+            neg = mpz_value(m).is_neg();
+            digits = mpz_value(m).to_string();
+            if (neg)
+                digits.erase(0, 1);
+        }
+        if (neg)
+            m_out.push_back('-');
+        size_t exponent = unbox(e);
+        if (exponent == 0) {
+            m_out += digits;
+            return true;
+        }
+        /* `m = left * 10^k + low` where `k := exponent` if the number is rendered without an explicit exponent
+           `exp`, and the number of digits of `m` plus 9 otherwise. */
+        size_t len = digits.size();
+        int64 exp = 9 + static_cast<int64>(len) - static_cast<int64>(exponent);
+        if (exp > 0)
+            exp = 0;
+        size_t k = exp < 0 ? 9 + len : exponent;
+        std::string left = k < len ? digits.substr(0, len - k) : std::string("0");
+        std::string low  = k < len ? digits.substr(len - k) : std::string(k - len, '0') + digits;
+        size_t last = low.find_last_not_of('0');
+        m_out += left;
+        if (last == std::string::npos && exp == 0)
+            return true;
+        m_out.push_back('.');
+        if (last != std::string::npos)
+            m_out.append(low, 0, last + 1);
+        if (exp != 0) {
+            m_out.push_back('e');
+            m_out += std::to_string(exp);
+        }
+        return true;
+    }
+
+    /* Pending output: a value, a field name followed by `:`, or a character. */
+    struct item {
+        b_obj_arg m_obj;
+        bool      m_key;
+        char      m_char;
+    };
+    std::vector<item> m_todo;
+
+    void push_value(b_obj_arg j) { m_todo.push_back(item{j, false, 0}); }
+    void push_key(b_obj_arg k) { m_todo.push_back(item{k, true, 0}); }
+    void push_char(char c) { m_todo.push_back(item{nullptr, false, c}); }
+
+    /* `Json.compress` renders the fields of an object in descending order of their keys, so we push them in
+       ascending order. */
+    void push_fields(b_obj_arg t, bool & first) {
+        if (is_scalar(t))
+            return;
+        push_fields(cnstr_get(t, 0), first);
+        if (!first)
+            push_char(',');
+        first = false;
+        push_value(cnstr_get(t, 2));
+        push_key(cnstr_get(t, 1));
+        push_fields(cnstr_get(t, 3), first);
+    }
+
+public:
+    optional<std::string> operator()(b_obj_arg j) {
+        push_value(j);
+        while (!m_todo.empty()) {
+            item i = m_todo.back();
+            m_todo.pop_back();
+            if (!i.m_obj) {
+                m_out.push_back(i.m_char);
+            } else if (i.m_key) {
+                render_string(i.m_obj);
+                m_out.push_back(':');
+            } else if (is_scalar(i.m_obj)) {
+                m_out += "null";
+            } else {
+                switch (static_cast<json_kind>(cnstr_tag(i.m_obj))) {
+                case json_kind::Bool:
+                    m_out += cnstr_get_uint8(i.m_obj, 0) ? "true" : "false";
+                    break;
+                case json_kind::Num:
+                    if (!render_num(cnstr_get(i.m_obj, 0)))
+                        return optional<std::string>();
+                    break;
+                case json_kind::Str:
+                    render_string(cnstr_get(i.m_obj, 0));
+                    break;
+                case json_kind::Arr: {
+                    b_obj_arg a = cnstr_get(i.m_obj, 0);
+                    size_t sz = array_size(a);
+                    m_out.push_back('[');
+                    push_char(']');
+                    for (size_t idx = sz; idx > 0; idx--) {
+                        push_value(array_get(a, idx - 1));
+                        if (idx > 1)
+                            push_char(',');
+                    }
+                    break;
+                }
+                case json_kind::Obj: {
+                    bool first = true;
+                    m_out.push_back('{');
+                    push_char('}');
+                    push_fields(cnstr_get(i.m_obj, 0), first);
+                    break;
+                }
+                case json_kind::Null:
+                    lean_unreachable();
+                }
+            }
+        }
+        return optional<std::string>(std::move(m_out));
+    }
+};
+
+/* Render `j` as `Json.compress`, returning `none` if it contains a number whose exponent is not a small `Nat`. */
+extern "C" LEAN_EXPORT obj_res lean_json_compress(b_obj_arg j) {
+    optional<std::string> r = json_compressor()(j);
+    return r ? mk_option_some(mk_string(*r)) : mk_option_none();
+}
+}
@@ -7,9 +7,11 @@ Author: Leonardo de Moura
 #include <new>
 #include <cstdlib>
 #include <iostream>
+#include <functional>
 #include "runtime/exception.h"
 #include "runtime/memory.h"
 #include "runtime/thread.h"
+#include "runtime/alloc.h"
 
 #ifndef LEAN_CHECK_MEM_THRESHOLD
 #define LEAN_CHECK_MEM_THRESHOLD 200
@@ -112,7 +114,10 @@ size_t get_current_rss() {
 
 namespace lean {
 static size_t g_max_memory = 0;
-LEAN_THREAD_VALUE(size_t, g_counter, 0);
+static atomic<size_t> g_memory_soft_limit(0);
+static atomic<std::function<void()> *> g_memory_soft_limit_fn(nullptr);
+/* Set when the soft limit has been reached, and reset when the allocated memory is below it again. */
+static atomic<bool> g_memory_soft_limit_reached(false);
 
 void set_max_memory(size_t max) {
     g_max_memory = max;
@@ -124,16 +129,56 @@ void set_max_memory_megabyte(unsigned max) {
     set_max_memory(m);
 }
 
+void set_memory_soft_limit(size_t limit, std::function<void()> const & fn) {
+    // the previous function is leaked, as it may be running in another thread
+    g_memory_soft_limit         = 0;
+    g_memory_soft_limit_fn      = new std::function<void()>(fn);
+    g_memory_soft_limit_reached = false;
+    g_memory_soft_limit         = limit;
+}
+
 // separate definition to allow breakpoint in debugger
 void throw_memory_exception(char const * component_name) {
     throw memory_exception(component_name);
 }
 
+static void check_memory_soft_limit(size_t limit, size_t r) {
+    if (r < limit) {
+        if (g_memory_soft_limit_reached.load(std::memory_order_relaxed))
+            g_memory_soft_limit_reached = false;
+    } else if (!g_memory_soft_limit_reached.exchange(true)) {
+        (*g_memory_soft_limit_fn.load())();
+    }
+}
+
+#ifdef LEAN_SMALL_ALLOCATOR
+/* The allocated memory is maintained by the allocator, and it is cheap enough to read it on every call. */
+void check_memory(char const * component_name) {
+    size_t soft_limit = g_memory_soft_limit.load(std::memory_order_acquire);
+    if (g_max_memory == 0 && soft_limit == 0) return;
+    size_t r = get_allocated_bytes();
+    if (soft_limit != 0)
+        check_memory_soft_limit(soft_limit, r);
+    if (g_max_memory != 0 && r >= g_max_memory)
+        throw_memory_exception(component_name);
+}
+
+size_t get_allocated_memory() {
+    return get_allocated_bytes();
+}
+#else
+LEAN_THREAD_VALUE(size_t, g_counter, 0);
+
 void check_memory(char const * component_name) {
-    if (g_max_memory == 0) return;
+    size_t soft_limit = g_memory_soft_limit.load(std::memory_order_acquire);
+    if (g_max_memory == 0 && soft_limit == 0) return;
     g_counter++;
     if (g_counter >= LEAN_CHECK_MEM_THRESHOLD) {
         g_counter = 0;
+        if (soft_limit != 0) {
+            check_memory_soft_limit(soft_limit, get_current_rss());
+            if (g_max_memory == 0) return;
+        }
         // We try first get_peak_rss because it is much faster
         // than get_current_rss on Linux.
         size_t r = get_peak_rss();
@@ -147,4 +192,5 @@ void check_memory(char const * component_name) {
 size_t get_allocated_memory() {
     return get_current_rss();
 }
+#endif
 }
@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <cstdlib>
+#include <functional>
 #include <lean/lean.h>
 
 namespace lean {
@@ -13,6 +14,16 @@ namespace lean {
 LEAN_EXPORT void set_max_memory(size_t max);
 /** \brief Set maximum amount of memory in megabytes */
 LEAN_EXPORT void set_max_memory_megabyte(unsigned max);
+/** \brief Call `fn` the first time `check_memory` notices that the allocated memory reached `limit` bytes, e.g.,
+    to release caches before reaching the maximum. `fn` is called again after the memory went below the limit and
+    reached it again. The value 0 disables the soft limit. */
+LEAN_EXPORT void set_memory_soft_limit(size_t limit, std::function<void()> const & fn);
+/** \brief Throw an exception if the allocated memory exceeds the maximum, and call the soft limit function if
+    the soft limit was reached. */
 LEAN_EXPORT void check_memory(char const * component_name);
+/** \brief Return the memory allocated by Lean objects as accounted by the small object allocator, see
+    `get_allocated_bytes`, or the resident set size if the runtime was built without it. */
 LEAN_EXPORT size_t get_allocated_memory();
+/** \brief Return the peak resident set size of the process in bytes, or 0 if it is not available. */
+LEAN_EXPORT size_t get_peak_rss();
 }
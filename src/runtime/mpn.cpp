@@ -23,6 +23,11 @@ Revision History:
 
 #define max(a,b)    (((a) > (b)) ? (a) : (b))
 
+/* Operands with fewer digits than this are multiplied using the schoolbook method. */
+#ifndef LEAN_MPN_KARATSUBA_THRESHOLD
+#define LEAN_MPN_KARATSUBA_THRESHOLD 40
+#endif
+
 namespace lean {
 
 typedef uint64_t mpn_double_digit;
@@ -86,11 +91,10 @@ void mpn_sub(mpn_digit const * a, size_t const lnga,
     }
 }
 
-void mpn_mul(mpn_digit const * a, size_t const lnga,
-             mpn_digit const * b, size_t const lngb,
-             mpn_digit * c) {
+static void mpn_mul_basecase(mpn_digit const * a, size_t const lnga,
+                             mpn_digit const * b, size_t const lngb,
+                             mpn_digit * c) {
     // Essentially Knuth's Algorithm M.
-    // Perhaps implement a more efficient version, see e.g., Knuth, Section 4.3.3.
     size_t i;
     mpn_digit k;
 
@@ -122,6 +126,100 @@ void mpn_mul(mpn_digit const * a, size_t const lnga,
     }
 }
 
+/* r[0, n) += b[0, m), return the carry.
+   \pre m <= n */
+static mpn_digit add_to(mpn_digit * r, size_t n, mpn_digit const * b, size_t m) {
+    mpn_digit k = 0;
+    size_t j = 0;
+    for (; j < m; j++) {
+        mpn_double_digit t = (mpn_double_digit)r[j] + b[j] + k;
+        r[j] = (mpn_digit)t;
+        k    = (mpn_digit)(t >> DIGIT_BITS);
+    }
+    for (; k != 0 && j < n; j++) {
+        r[j]++;
+        k = r[j] == 0;
+    }
+    return k;
+}
+
+/* r[0, n) -= b[0, m), return the borrow.
+   \pre m <= n */
+static mpn_digit sub_from(mpn_digit * r, size_t n, mpn_digit const * b, size_t m) {
+    mpn_digit k = 0;
+    size_t j = 0;
+    for (; j < m; j++) {
+        mpn_double_digit t = (mpn_double_digit)r[j] - b[j] - k;
+        r[j] = (mpn_digit)t;
+        k    = (mpn_digit)(t >> DIGIT_BITS) != 0;
+    }
+    for (; k != 0 && j < n; j++) {
+        k = r[j] == 0;
+        r[j]--;
+    }
+    return k;
+}
+
+static void mpn_mul_balanced(mpn_digit const * a, mpn_digit const * b, size_t n, mpn_digit * c);
+
+void mpn_mul(mpn_digit const * a, size_t const lnga,
+             mpn_digit const * b, size_t const lngb,
+             mpn_digit * c) {
+    if (lnga < lngb) {
+        mpn_mul(b, lngb, a, lnga, c);
+    } else if (lngb < LEAN_MPN_KARATSUBA_THRESHOLD) {
+        mpn_mul_basecase(a, lnga, b, lngb, c);
+    } else if (lnga == lngb) {
+        mpn_mul_balanced(a, b, lnga, c);
+    } else {
+        // Multiply `b` by chunks of `lngb` digits of `a`.
+        buffer<mpn_digit> t;
+        t.resize(2*lngb);
+        mpn_mul_balanced(a, b, lngb, c);
+        for (size_t i = 2*lngb; i < lnga + lngb; i++)
+            c[i] = 0;
+        for (size_t i = lngb; i < lnga; i += lngb) {
+            size_t sz = lnga - i < lngb ? lnga - i : lngb;
+            if (sz == lngb)
+                mpn_mul_balanced(a + i, b, lngb, t.data());
+            else
+                mpn_mul(b, lngb, a + i, sz, t.data());
+            add_to(c + i, lnga + lngb - i, t.data(), sz + lngb);
+        }
+    }
+}
+
+/* Karatsuba multiplication: c[0, 2n) := a[0, n) * b[0, n). With a = a1*B^h + a0 and b = b1*B^h + b0,
+   a*b = a1*b1*B^2h + ((a0+a1)*(b0+b1) - a0*b0 - a1*b1)*B^h + a0*b0. */
+static void mpn_mul_balanced(mpn_digit const * a, mpn_digit const * b, size_t n, mpn_digit * c) {
+    if (n < LEAN_MPN_KARATSUBA_THRESHOLD || n < 2) {
+        mpn_mul_basecase(a, n, b, n, c);
+        return;
+    }
+    size_t h = n / 2;
+    size_t k = n - h;
+    // c[0, 2h) := a0*b0, c[2h, 2n) := a1*b1
+    mpn_mul_balanced(a, b, h, c);
+    mpn_mul_balanced(a + h, b + h, k, c + 2*h);
+    buffer<mpn_digit> t;
+    t.resize(4*k + 4);
+    mpn_digit * sa = t.data();
+    mpn_digit * sb = sa + k + 1;
+    mpn_digit * z1 = sb + k + 1;
+    for (size_t i = 0; i < k; i++) {
+        sa[i] = a[h + i];
+        sb[i] = b[h + i];
+    }
+    sa[k] = add_to(sa, k, a, h);
+    sb[k] = add_to(sb, k, b, h);
+    mpn_mul_balanced(sa, sb, k + 1, z1);
+    // z1 := (a0+a1)*(b0+b1) - a0*b0 - a1*b1, which is nonnegative
+    sub_from(z1, 2*k + 2, c, 2*h);
+    sub_from(z1, 2*k + 2, c + 2*h, 2*k);
+    // The high digit of z1 is 0 now, and the sum fits in 2n digits.
+    add_to(c + h, 2*n - h, z1, 2*k + 1);
+}
+
 #define MASK_FIRST (~((mpn_digit)(-1) >> 1))
 #define FIRST_BITS(N, X) ((X) >> (DIGIT_BITS-(N)))
 #define LAST_BITS(N, X) (((X) << (DIGIT_BITS-(N))) >> (DIGIT_BITS-(N)))
@@ -329,21 +427,30 @@ char * mpn_to_string(mpn_digit const * a, size_t const lng, char * buf, size_t c
 #endif
     }
     else {
-        mpn_buffer temp(lng, 0), t_numer(lng+1, 0), t_denom(1, 0);
+        // Divide by 10^9 repeatedly, producing 9 decimal digits per pass over `temp`.
+        const mpn_digit chunk_base = 1000000000;
+        mpn_buffer temp(lng, 0);
         for (unsigned i = 0; i < lng; i++)
             temp[i] = a[i];
+        while (!temp.empty() && temp.back() == 0)
+            temp.pop_back();
 
         size_t j = 0;
-        mpn_digit rem;
-        mpn_digit ten = 10;
-        while (!temp.empty() && (temp.size() > 1 || temp[0] != 0)) {
-            size_t d = div_normalize(&temp[0], temp.size(), &ten, 1, t_numer, t_denom);
-            div_1(t_numer, t_denom[0], &temp[0]);
-            div_unnormalize(t_numer, t_denom, d, &rem);
-            buf[j++] = '0' + rem;
+        do {
+            mpn_double_digit rem = 0;
+            for (size_t i = temp.size(); i-- > 0; ) {
+                mpn_double_digit t = (rem << DIGIT_BITS) | temp[i];
+                temp[i] = (mpn_digit)(t / chunk_base);
+                rem     = t % chunk_base;
+            }
             while (!temp.empty() && temp.back() == 0)
                 temp.pop_back();
-        }
+            // all chunks but the most significant one are padded with zeros
+            for (unsigned i = 0; i < 9 && (!temp.empty() || rem != 0 || j == 0); i++) {
+                buf[j++] = '0' + (rem % 10);
+                rem /= 10;
+            }
+        } while (!temp.empty());
         buf[j] = 0;
 
         j--;
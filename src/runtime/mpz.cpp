@@ -96,6 +96,55 @@ bool mpz::is_size_t() const {
     return is_nonneg() && mpz_size(m_val) <= 1;
 }
 
+static constexpr unsigned g_inline_limbs = mpz::inline_storage_size / sizeof(mp_limb_t);
+static constexpr unsigned g_limb_bits    = 8 * sizeof(mp_limb_t);
+
+void mpz::init_inline_u128(uint64 hi, uint64 lo, void * storage) {
+    mp_limb_t * d = static_cast<mp_limb_t *>(storage);
+    for (unsigned i = 0; i < g_inline_limbs; i++) {
+        unsigned shift = i * g_limb_bits;
+        d[i] = static_cast<mp_limb_t>(shift < 64 ? lo >> shift : hi >> (shift - 64));
+    }
+    int sz = g_inline_limbs;
+    while (sz > 0 && d[sz - 1] == 0) sz--;
+    m_val->_mp_alloc = g_inline_limbs;
+    m_val->_mp_size  = sz;
+    m_val->_mp_d     = d;
+}
+
+size_t mpz::inline_storage_size_of(mpz const & v) {
+    return sizeof(mp_limb_t) * mpz_size(v.m_val);
+}
+
+void mpz::init_inline(mpz const & v, void * storage) {
+    size_t n = mpz_size(v.m_val);
+    mp_limb_t * d = static_cast<mp_limb_t *>(storage);
+    memcpy(d, mpz_limbs_read(v.m_val), sizeof(mp_limb_t) * n);
+    m_val->_mp_alloc = n;
+    m_val->_mp_size  = v.m_val->_mp_size;
+    m_val->_mp_d     = d;
+}
+
+bool mpz::uses_storage(void const * storage) const {
+    return m_val->_mp_d == storage;
+}
+
+bool mpz::get_u128(uint64 & hi, uint64 & lo) const {
+    size_t n = mpz_size(m_val);
+    if (is_neg() || n > g_inline_limbs)
+        return false;
+    hi = lo = 0;
+    for (unsigned i = 0; i < n; i++) {
+        unsigned shift = i * g_limb_bits;
+        uint64 limb    = mpz_getlimbn(m_val, i);
+        if (shift < 64)
+            lo |= limb << shift;
+        else
+            hi |= limb << (shift - 64);
+    }
+    return true;
+}
+
 int mpz::get_int() const {
     lean_assert(is_int());
     return static_cast<int>(mpz_get_si(m_val));
@@ -330,13 +379,24 @@ void mpz::init_str(char const * v) {
     while (str[0] == ' ') ++str;
     if (str[0] == '-')
         sign = true;
+    // Consume up to 9 digits at a time.
+    unsigned chunk = 0, chunk_base = 1;
     while (str[0]) {
         if ('0' <= str[0] && str[0] <= '9') {
-            operator*=(10);
-            operator+=(static_cast<unsigned>(str[0] - '0'));
+            chunk       = chunk * 10 + static_cast<unsigned>(str[0] - '0');
+            chunk_base *= 10;
+            if (chunk_base == 1000000000) {
+                operator*=(chunk_base);
+                operator+=(chunk);
+                chunk = 0; chunk_base = 1;
+            }
         }
         ++str;
     }
+    if (chunk_base > 1) {
+        operator*=(chunk_base);
+        operator+=(chunk);
+    }
     if (sign)
         neg();
 }
@@ -461,6 +521,41 @@ bool mpz::is_size_t() const {
     }
 }
 
+static constexpr unsigned g_inline_digits = mpz::inline_storage_size / sizeof(mpn_digit);
+static constexpr unsigned g_digit_bits    = 8 * sizeof(mpn_digit);
+
+void mpz::init_inline_u128(uint64 hi, uint64 lo, void * storage) {
+    mpn_digit * d = static_cast<mpn_digit *>(storage);
+    for (unsigned i = 0; i < g_inline_digits; i++) {
+        unsigned shift = i * g_digit_bits;
+        d[i] = static_cast<mpn_digit>(shift < 64 ? lo >> shift : hi >> (shift - 64));
+    }
+    size_t sz = g_inline_digits;
+    while (sz > 1 && d[sz - 1] == 0) sz--;
+    m_sign   = false;
+    m_size   = sz;
+    m_digits = d;
+}
+
+bool mpz::uses_storage(void const * storage) const {
+    return m_digits == storage;
+}
+
+bool mpz::get_u128(uint64 & hi, uint64 & lo) const {
+    if (m_sign || m_size > g_inline_digits)
+        return false;
+    hi = lo = 0;
+    for (unsigned i = 0; i < m_size; i++) {
+        unsigned shift = i * g_digit_bits;
+        uint64 digit   = m_digits[i];
+        if (shift < 64)
+            lo |= digit << shift;
+        else
+            hi |= digit << (shift - 64);
+    }
+    return true;
+}
+
 int mpz::get_int() const {
     lean_assert(is_int());
     if (m_sign) {
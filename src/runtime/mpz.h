@@ -136,6 +136,23 @@ public:
     bool is_unsigned_int() const;
     bool is_size_t() const;
 
+    /** \brief Size in bytes of the storage used by `init_inline_u128`. */
+    static constexpr size_t inline_storage_size = 16;
+    /** \brief Initialize the uninitialized `*this` with `hi * 2^64 + lo`, using `storage` (of `inline_storage_size`
+        bytes) for its digits. The result must not be modified, and must not be finalized using `~mpz`. */
+    void init_inline_u128(uint64 hi, uint64 lo, void * storage);
+#ifdef LEAN_USE_GMP
+    /** \brief Size in bytes of the storage used by `init_inline` for the digits of `v`. */
+    static size_t inline_storage_size_of(mpz const & v);
+    /** \brief Initialize the uninitialized `*this` with a copy of `v`, using `storage` (of `inline_storage_size_of(v)`
+        bytes) for its digits. The same restrictions as for `init_inline_u128` apply. */
+    void init_inline(mpz const & v, void * storage);
+#endif
+    /** \brief Return true iff the digits of `*this` are stored in `storage`, see `init_inline_u128`. */
+    bool uses_storage(void const * storage) const;
+    /** \brief Return true iff `*this` is a natural number smaller than 2^128, and store it in `hi * 2^64 + lo`. */
+    bool get_u128(uint64 & hi, uint64 & lo) const;
+
     int get_int() const;
     unsigned int get_unsigned_int() const;
     size_t get_size_t() const;
@@ -207,43 +224,43 @@ public:
     mpz & operator/=(int u) { return operator/=(mpz(u)); } // TODO(Leo): improve
 
     mpz & operator%=(mpz const & o);
-    friend mpz rem(mpz const & a, mpz const & b) { mpz r(a); return r %= b; }
+    friend mpz rem(mpz const & a, mpz const & b) { mpz r(a); r %= b; return r; }
 
     mpz pow(unsigned int exp) const;
 
-    friend mpz operator+(mpz a, mpz const & b) { return a += b; }
-    friend mpz operator+(mpz a, unsigned b)  { return a += b; }
-    friend mpz operator+(mpz a, uint64 b)  { return a += b; }
-    friend mpz operator+(mpz a, int b)  { return a += b; }
-    friend mpz operator+(unsigned a, mpz b) { return b += a; }
-    friend mpz operator+(uint64 a, mpz b) { return b += a; }
-    friend mpz operator+(int a, mpz b) { return b += a; }
-
-    friend mpz operator-(mpz a, mpz const & b) { return a -= b; }
-    friend mpz operator-(mpz a, unsigned b) { return a -= b; }
-    friend mpz operator-(mpz a, uint64 b) { return a -= b; }
-    friend mpz operator-(mpz a, int b) { return a -= b; }
-    friend mpz operator-(unsigned a, mpz b) { b.neg(); return b += a; }
-    friend mpz operator-(uint64 a, mpz b) { b.neg(); return b += a; }
-    friend mpz operator-(int a, mpz b) { b.neg(); return b += a; }
-
-    friend mpz operator*(mpz a, mpz const & b) { return a *= b; }
-    friend mpz operator*(mpz a, unsigned b) { return a *= b; }
-    friend mpz operator*(mpz a, uint64 b) { return a *= b; }
-    friend mpz operator*(mpz a, int b) { return a *= b; }
-    friend mpz operator*(unsigned a, mpz b) { return b *= a; }
-    friend mpz operator*(uint64 a, mpz b) { return b *= a; }
-    friend mpz operator*(int a, mpz b) { return b *= a; }
-
-    friend mpz operator/(mpz a, mpz const & b) { return a /= b; }
-    friend mpz operator/(mpz a, unsigned b) { return a /= b; }
-    friend mpz operator/(mpz a, uint64 b) { return a /= b; }
-    friend mpz operator/(mpz a, int b) { return a /= b; }
-    friend mpz operator/(unsigned a, mpz const & b) { mpz r(a); return r /= b; }
-    friend mpz operator/(uint64 a, mpz const & b) { mpz r(a); return r /= b; }
-    friend mpz operator/(int a, mpz const & b) { mpz r(a); return r /= b; }
-
-    friend mpz operator%(mpz a, mpz const & b) { return a %= b; }
+    friend mpz operator+(mpz a, mpz const & b) { a += b; return a; }
+    friend mpz operator+(mpz a, unsigned b)  { a += b; return a; }
+    friend mpz operator+(mpz a, uint64 b)  { a += b; return a; }
+    friend mpz operator+(mpz a, int b)  { a += b; return a; }
+    friend mpz operator+(unsigned a, mpz b) { b += a; return b; }
+    friend mpz operator+(uint64 a, mpz b) { b += a; return b; }
+    friend mpz operator+(int a, mpz b) { b += a; return b; }
+
+    friend mpz operator-(mpz a, mpz const & b) { a -= b; return a; }
+    friend mpz operator-(mpz a, unsigned b) { a -= b; return a; }
+    friend mpz operator-(mpz a, uint64 b) { a -= b; return a; }
+    friend mpz operator-(mpz a, int b) { a -= b; return a; }
+    friend mpz operator-(unsigned a, mpz b) { b.neg(); b += a; return b; }
+    friend mpz operator-(uint64 a, mpz b) { b.neg(); b += a; return b; }
+    friend mpz operator-(int a, mpz b) { b.neg(); b += a; return b; }
+
+    friend mpz operator*(mpz a, mpz const & b) { a *= b; return a; }
+    friend mpz operator*(mpz a, unsigned b) { a *= b; return a; }
+    friend mpz operator*(mpz a, uint64 b) { a *= b; return a; }
+    friend mpz operator*(mpz a, int b) { a *= b; return a; }
+    friend mpz operator*(unsigned a, mpz b) { b *= a; return b; }
+    friend mpz operator*(uint64 a, mpz b) { b *= a; return b; }
+    friend mpz operator*(int a, mpz b) { b *= a; return b; }
+
+    friend mpz operator/(mpz a, mpz const & b) { a /= b; return a; }
+    friend mpz operator/(mpz a, unsigned b) { a /= b; return a; }
+    friend mpz operator/(mpz a, uint64 b) { a /= b; return a; }
+    friend mpz operator/(mpz a, int b) { a /= b; return a; }
+    friend mpz operator/(unsigned a, mpz const & b) { mpz r(a); r /= b; return r; }
+    friend mpz operator/(uint64 a, mpz const & b) { mpz r(a); r /= b; return r; }
+    friend mpz operator/(int a, mpz const & b) { mpz r(a); r /= b; return r; }
+
+    friend mpz operator%(mpz a, mpz const & b) { a %= b; return a; }
 
     static mpz ediv(mpz const & n, mpz const & d);
     static mpz ediv(int n, mpz const & d) { return ediv(mpz(n), d); }
@@ -257,9 +274,9 @@ public:
     mpz & operator|=(mpz const & o);
     mpz & operator^=(mpz const & o);
 
-    friend mpz operator&(mpz a, mpz const & b) { return a &= b; }
-    friend mpz operator|(mpz a, mpz const & b) { return a |= b; }
-    friend mpz operator^(mpz a, mpz const & b) { return a ^= b; }
+    friend mpz operator&(mpz a, mpz const & b) { a &= b; return a; }
+    friend mpz operator|(mpz a, mpz const & b) { a |= b; return a; }
+    friend mpz operator^(mpz a, mpz const & b) { a ^= b; return a; }
 
     // a <- b * 2^k
     friend void mul2k(mpz & a, mpz const & b, unsigned k);
@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include <fstream>
+#include <string>
+#include "runtime/thread.h"
+#include "runtime/numa.h"
+
+#if defined(__linux__) && defined(SYS_mbind)
+#define LEAN_NUMA_SUPPORT
+#endif
+
+namespace lean {
+static atomic<bool> g_numa_aware(false);
+
+#if defined(LEAN_NUMA_SUPPORT)
+/* Constants from `<numaif.h>`, we do not want to depend on libnuma. */
+#define LEAN_MPOL_PREFERRED 1
+#define LEAN_MPOL_MF_MOVE   (1 << 1)
+
+/* Parse a Linux CPU/node list such as `0-3,8-11`, and invoke `fn` on each element. */
+template<typename F>
+static void parse_list(std::string const & s, F && fn) {
+    size_t i = 0;
+    while (i < s.size()) {
+        size_t j = s.find(',', i);
+        if (j == std::string::npos) j = s.size();
+        std::string range = s.substr(i, j - i);
+        size_t dash = range.find('-');
+        if (!range.empty() && range[0] != '\n') {
+            unsigned lo = std::stoul(range);
+            unsigned hi = dash == std::string::npos ? lo : std::stoul(range.substr(dash + 1));
+            for (unsigned k = lo; k <= hi; k++) fn(k);
+        }
+        i = j + 1;
+    }
+}
+
+static bool read_first_line(char const * fname, std::string & r) {
+    std::ifstream in(fname);
+    return in && std::getline(in, r);
+}
+
+static unsigned compute_num_nodes() {
+    std::string s;
+    unsigned r = 1;
+    if (read_first_line("/sys/devices/system/node/possible", s)) {
+        try {
+            parse_list(s, [&](unsigned n) { if (n + 1 > r) r = n + 1; });
+        } catch (std::exception &) {
+            return 1;
+        }
+    }
+    return r;
+}
+#endif
+
+void set_numa_aware(bool flag) {
+    g_numa_aware = flag && numa_num_nodes() > 1;
+}
+
+bool is_numa_aware() {
+    return g_numa_aware;
+}
+
+unsigned numa_num_nodes() {
+#if defined(LEAN_NUMA_SUPPORT)
+    static unsigned num_nodes = compute_num_nodes();
+    return num_nodes;
+#else
+    return 1;
+#endif
+}
+
+int numa_current_node() {
+#if defined(LEAN_NUMA_SUPPORT) && defined(SYS_getcpu)
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        return static_cast<int>(node);
+#endif
+    return -1;
+}
+
+bool numa_pin_current_thread(unsigned node) {
+#if defined(LEAN_NUMA_SUPPORT)
+    std::string fname = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    std::string s;
+    if (!read_first_line(fname.c_str(), s))
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    try {
+        parse_list(s, [&](unsigned cpu) { if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set); });
+    } catch (std::exception &) {
+        return false;
+    }
+    return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+void numa_bind_memory(void * p, size_t sz, unsigned node) {
+#if defined(LEAN_NUMA_SUPPORT)
+    constexpr unsigned bits = 8 * sizeof(unsigned long);
+    unsigned long mask[16] = {};
+    if (node >= 16 * bits)
+        return;
+    mask[node / bits] = 1UL << (node % bits);
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = lean_align(reinterpret_cast<size_t>(p), page_size);
+    size_t end   = ((reinterpret_cast<size_t>(p) + sz) / page_size) * page_size;
+    if (begin < end) {
+        /* Failure is not an error, the memory just stays where the kernel puts it. */
+        syscall(SYS_mbind, reinterpret_cast<void *>(begin), end - begin, LEAN_MPOL_PREFERRED, mask, 16 * bits,
+                LEAN_MPOL_MF_MOVE);
+    }
+#else
+    (void)p; (void)sz; (void)node;
+#endif
+}
+}
+
+extern "C" LEAN_EXPORT void lean_set_numa_aware(bool flag) {
+    lean::set_numa_aware(flag);
+}
@@ -0,0 +1,27 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <stddef.h>
+#include <lean/lean.h>
+
+namespace lean {
+/* Minimal NUMA support for the allocator and the task manager. It is implemented directly on top of the
+   Linux system calls and is a no-op on other platforms and on machines with a single NUMA node. */
+
+/* Enable NUMA awareness. When enabled, task manager workers are pinned to the CPUs of a node
+   (round-robin) and new allocator segments are bound to the node of the thread allocating them. */
+void set_numa_aware(bool flag);
+bool is_numa_aware();
+/* Number of (possible) NUMA nodes, at least 1. */
+unsigned numa_num_nodes();
+/* The node of the CPU the current thread is running on, or -1 if unknown. */
+int numa_current_node();
+/* Restrict the current thread to the CPUs of the given node. Return false on failure. */
+bool numa_pin_current_thread(unsigned node);
+/* Ask the kernel to place the pages of the given memory region on the given node. */
+void numa_bind_memory(void * p, size_t sz, unsigned node);
+}
+
+extern "C" LEAN_EXPORT void lean_set_numa_aware(bool flag);
@@ -8,25 +8,43 @@ Author: Leonardo de Moura
 #include <algorithm>
 #include <vector>
 #include <deque>
+#include <unordered_map>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <lean/lean.h>
 #include "runtime/object.h"
 #include "runtime/thread.h"
 #include "runtime/utf8.h"
 #include "runtime/alloc.h"
+#include "runtime/numa.h"
+#include "runtime/task_trace.h"
 #include "runtime/debug.h"
+#include "runtime/exception.h"
 #include "runtime/hash.h"
 #include "runtime/flet.h"
 #include "runtime/interrupt.h"
 #include "runtime/buffer.h"
 #include "runtime/io.h"
+#include "runtime/process.h"
 #include "runtime/hash.h"
+#include "runtime/heap_profile.h"
+#include "runtime/sstream.h"
 
 #ifdef __GLIBC__
 #include <execinfo.h>
 #include <unistd.h>
 #endif
 
+#ifndef LEAN_WINDOWS
+#include <dlfcn.h>
+#endif
+
+#if defined(LEAN_MMAP)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 // HACK: for unknown reasons, std::isnan(x) fails on msys64 because math.h
 // is imported and isnan(x) looks like a macro. On the other hand, isnan(x)
 // fails on linux because <cmath> doesn't define it (as expected).
@@ -160,12 +178,96 @@ static inline void lean_dealloc(lean_object * o, size_t sz) {
 #endif
 }
 
+// =======================================
+// Memory-mapped scalar arrays
+
+#if defined(LEAN_MMAP)
+/* Scalar arrays whose data is a private file mapping, see `mmap_byte_array`. They are ordinary `LeanScalarArray`
+   objects, so we keep track of them here to unmap them instead of freeing them when they die. */
+struct mmap_sarray_region {
+    void * m_base;
+    size_t m_size;
+};
+static mutex *                                              g_mmap_sarrays_mutex = nullptr;
+static std::unordered_map<object *, mmap_sarray_region> *   g_mmap_sarrays = nullptr;
+static atomic<size_t>                                       g_num_mmap_sarrays(0);
+
+object * mmap_byte_array(int fd, size_t size) {
+    if (size == 0)
+        return nullptr;
+    /* The object header precedes the data, so we put it at the end of an anonymous page in front
+       of the file mapping. */
+    size_t page   = sysconf(_SC_PAGESIZE);
+    size_t offset = offsetof(lean_sarray_object, m_data);
+    size_t total  = page + size;
+    char * base = static_cast<char *>(mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (base == MAP_FAILED)
+        return nullptr;
+    /* `MAP_PRIVATE`: in-place updates of an exclusive array copy the affected pages instead of changing the file. */
+    if (mmap(base + page, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, total);
+        return nullptr;
+    }
+    lean_sarray_object * o = reinterpret_cast<lean_sarray_object *>(base + page - offset);
+    lean_set_st_header(reinterpret_cast<object *>(o), LeanScalarArray, 1);
+    o->m_size     = size;
+    o->m_capacity = size;
+    {
+        lock_guard<mutex> lock(*g_mmap_sarrays_mutex);
+        g_mmap_sarrays->insert({reinterpret_cast<object *>(o), mmap_sarray_region{base, total}});
+        g_num_mmap_sarrays++;
+    }
+    return reinterpret_cast<object *>(o);
+}
+
+/* If `o` was created by `mmap_byte_array`, unmap it and return true. */
+static bool free_mmap_sarray(object * o) {
+    mmap_sarray_region r;
+    {
+        lock_guard<mutex> lock(*g_mmap_sarrays_mutex);
+        auto it = g_mmap_sarrays->find(o);
+        if (it == g_mmap_sarrays->end())
+            return false;
+        r = it->second;
+        g_mmap_sarrays->erase(it);
+        g_num_mmap_sarrays--;
+    }
+    munmap(r.m_base, r.m_size);
+    return true;
+}
+#else
+object * mmap_byte_array(int, size_t) {
+    return nullptr;
+}
+#endif
+
+static void lean_free_sarray(object * o) {
+    size_t sz = lean_sarray_byte_size(o);
+#if defined(LEAN_MMAP)
+    // mapped arrays are never small, and usually there are none at all
+    if (sz > LEAN_MAX_SMALL_OBJECT_SIZE && g_num_mmap_sarrays != 0 && free_mmap_sarray(o))
+        return;
+#endif
+    lean_dealloc(o, sz);
+}
+
+/* Big numbers usually store their digits right after the `mpz_object`, see `alloc_mpz` and `alloc_nat_u128`. */
+static inline void * mpz_inline_storage(lean_object * o) {
+    return reinterpret_cast<char *>(o) + sizeof(mpz_object);
+}
+
+static inline void free_mpz_object(lean_object * o) {
+    if (!to_mpz(o)->m_value.uses_storage(mpz_inline_storage(o)))
+        to_mpz(o)->m_value.~mpz();
+    lean_free_small_object(o);
+}
+
 extern "C" LEAN_EXPORT void lean_free_object(lean_object * o) {
     switch (lean_ptr_tag(o)) {
     case LeanArray:       return lean_dealloc(o, lean_array_byte_size(o));
-    case LeanScalarArray: return lean_dealloc(o, lean_sarray_byte_size(o));
+    case LeanScalarArray: return lean_free_sarray(o);
     case LeanString:      return lean_dealloc(o, lean_string_byte_size(o));
-    case LeanMPZ:         to_mpz(o)->m_value.~mpz(); return lean_free_small_object(o);
+    case LeanMPZ:         return free_mpz_object(o);
     default:              return lean_free_small_object(o);
     }
 }
@@ -206,31 +308,41 @@ static inline lean_object * pop_back(lean_object * & todo) {
     return r;
 }
 
-static inline void dec(lean_object * o, lean_object* & todo) {
+/* Decrement the RC of `o`, and return `true` if this was its last reference. */
+static inline bool dec_last(lean_object * o) {
     if (lean_is_scalar(o))
-        return;
+        return false;
     if (LEAN_LIKELY(o->m_rc > 1)) {
         o->m_rc--;
+        return false;
     } else if (o->m_rc == 1) {
-        push_back(todo, o);
+        return true;
     } else if (o->m_rc == 0) {
-        return;
-    } else if (std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), 1, std::memory_order_acq_rel) == -1) {
-        push_back(todo, o);
+        return false;
+    } else if (std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), 1, std::memory_order_release) == -1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
     }
+    return false;
+}
+
+static inline void dec(lean_object * o, lean_object* & todo) {
+    if (dec_last(o))
+        push_back(todo, o);
 }
 
 #ifdef LEAN_LAZY_RC
 LEAN_THREAD_PTR(object, g_to_free);
 #endif
 
-static void lean_del_core(object * o, object * & todo);
+static object * lean_del_core(object * o, object * & todo);
 
 extern "C" LEAN_EXPORT lean_object * lean_alloc_object(size_t sz) {
 #ifdef LEAN_LAZY_RC
      if (g_to_free) {
          object * o = pop_back(g_to_free);
-         lean_del_core(o, g_to_free);
+         if (object * next = lean_del_core(o, g_to_free))
+             push_back(g_to_free, next);
      }
 #endif
 #ifdef LEAN_SMALL_ALLOCATOR
@@ -244,13 +356,23 @@ extern "C" LEAN_EXPORT lean_object * lean_alloc_object(size_t sz) {
 
 static void deactivate_task(lean_task_object * t);
 
-static void lean_del_core(object * o, object * & todo) {
+/* Free `o`, adding the objects that become unreachable to `todo`. For constructor objects, the last field is
+   returned instead if it becomes unreachable, so that the tail of lists and right spines of trees are freed without
+   going through `todo`. */
+static object * lean_del_core(object * o, object * & todo) {
     uint8 tag = lean_ptr_tag(o);
-    if (tag <= LeanMaxCtorTag) {
-        object ** it  = lean_ctor_obj_cptr(o);
-        object ** end = it + lean_ctor_num_objs(o);
-        for (; it != end; ++it) dec(*it, todo);
+    if (LEAN_LIKELY(tag <= LeanMaxCtorTag)) {
+        unsigned num_objs = lean_ctor_num_objs(o);
+        object * next = nullptr;
+        if (num_objs > 0) {
+            object ** it   = lean_ctor_obj_cptr(o);
+            object ** last = it + num_objs - 1;
+            for (; it != last; ++it) dec(*it, todo);
+            if (dec_last(*last))
+                next = *last;
+        }
         lean_free_small_object(o);
+        return next;
     } else {
         switch (tag) {
         case LeanClosure: {
@@ -268,14 +390,13 @@ static void lean_del_core(object * o, object * & todo) {
             break;
         }
         case LeanScalarArray:
-            lean_dealloc(o, lean_sarray_byte_size(o));
+            lean_free_sarray(o);
             break;
         case LeanString:
             lean_dealloc(o, lean_string_byte_size(o));
             break;
         case LeanMPZ:
-            to_mpz(o)->m_value.~mpz();
-            lean_free_small_object(o);
+            free_mpz_object(o);
             break;
         case LeanThunk:
             if (object * c = lean_to_thunk(o)->m_closure) dec(c, todo);
@@ -296,21 +417,61 @@ static void lean_del_core(object * o, object * & todo) {
         default:
             lean_unreachable();
         }
+        return nullptr;
     }
 }
 
-extern "C" LEAN_EXPORT void lean_dec_ref_cold(lean_object * o) {
-    if (o->m_rc == 1 || std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), 1, std::memory_order_acq_rel) == -1) {
-#ifdef LEAN_LAZY_RC
-        push_back(g_to_free, o);
-#else
-        object * todo = nullptr;
-        while (true) {
-            lean_del_core(o, todo);
+#ifndef LEAN_LAZY_RC
+static atomic<size_t> g_deferred_free_threshold(0);
+
+void set_deferred_free_threshold(size_t n) {
+    g_deferred_free_threshold.store(n, memory_order_relaxed);
+}
+
+static bool defer_del(object * todo);
+
+/* Free `o` and all objects that become unreachable by freeing it.
+   After `threshold` objects (if non-zero), try to hand off the remaining `todo` list to a background task. */
+static void lean_del(object * o, size_t threshold) {
+    object * todo = nullptr;
+    size_t n = 0;
+    while (true) {
+        o = lean_del_core(o, todo);
+        if (o == nullptr) {
             if (todo == nullptr)
                 return;
             o = pop_back(todo);
         }
+        if (++n == threshold) {
+            push_back(todo, o);
+            if (defer_del(todo))
+                return;
+            o = pop_back(todo);
+        }
+    }
+}
+#else
+void set_deferred_free_threshold(size_t) {}
+#endif
+
+extern "C" LEAN_EXPORT void lean_dec_ref_cold(lean_object * o) {
+    if (o->m_rc == 1) {
+#ifdef LEAN_LAZY_RC
+        push_back(g_to_free, o);
+#else
+        lean_del(o, 0);
+#endif
+    } else if (std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), 1, std::memory_order_release) == -1) {
+        /* Only the thread releasing the last reference needs to synchronize with the writes of the other owners,
+           so the acquire ordering is not paid by every decrement. */
+        std::atomic_thread_fence(std::memory_order_acquire);
+#ifdef LEAN_LAZY_RC
+        push_back(g_to_free, o);
+#else
+        /* Only multi-threaded graphs may be freed by a different thread: all objects reachable
+           from a multi-threaded object are multi-threaded as well, so the background task never
+           touches a single-threaded object that is still owned by this thread. */
+        lean_del(o, g_deferred_free_threshold.load(memory_order_relaxed));
 #endif
     }
 }
@@ -366,6 +527,62 @@ extern "C" LEAN_EXPORT lean_obj_res lean_array_set_panic(lean_obj_arg a, lean_ob
 // =======================================
 // Thunks
 
+#ifndef LEAN_THUNK_WAIT_STRIPES
+#define LEAN_THUNK_WAIT_STRIPES 64
+#endif
+
+/* Number of times a thread that forces a thunk being evaluated by another thread yields before it blocks. */
+#ifndef LEAN_THUNK_WAIT_SPINS
+#define LEAN_THUNK_WAIT_SPINS 16
+#endif
+
+/* Threads forcing a thunk that is being evaluated by another thread block on the condition variable of the stripe of
+   the thunk. `m_waiters` is read by the evaluating thread after it has stored the value, so that it only needs to
+   take the lock and notify when another thread has announced that it is going to block. */
+struct thunk_wait_stripe {
+    mutex              m_mutex;
+    condition_variable m_cv;
+    atomic<unsigned>   m_waiters{0};
+};
+
+static thunk_wait_stripe * g_thunk_wait_stripes = nullptr;
+static atomic<uint64>      g_num_thunk_waits(0);
+static atomic<uint64>      g_num_thunk_blocks(0);
+
+static thunk_wait_stripe & get_thunk_wait_stripe(b_obj_arg t) {
+    return g_thunk_wait_stripes[(reinterpret_cast<size_t>(t) >> 4) % LEAN_THUNK_WAIT_STRIPES];
+}
+
+static void thunk_wait(b_obj_arg t) {
+    g_num_thunk_waits++;
+    for (unsigned i = 0; i < LEAN_THUNK_WAIT_SPINS; i++) {
+        if (lean_to_thunk(t)->m_value)
+            return;
+        this_thread::yield();
+    }
+    g_num_thunk_blocks++;
+    thunk_wait_stripe & s = get_thunk_wait_stripe(t);
+    unique_lock<mutex> lock(s.m_mutex);
+    s.m_waiters++;
+    s.m_cv.wait(lock, [&]() { return lean_to_thunk(t)->m_value != nullptr; });
+    s.m_waiters--;
+}
+
+static void thunk_notify(b_obj_arg t) {
+    /* Both this load and the increment in `thunk_wait` are sequentially consistent, so either we see the waiter, or the
+       waiter sees the value before blocking. */
+    thunk_wait_stripe & s = get_thunk_wait_stripe(t);
+    if (s.m_waiters != 0) {
+        lock_guard<mutex> lock(s.m_mutex);
+        s.m_cv.notify_all();
+    }
+}
+
+extern "C" LEAN_EXPORT void lean_get_thunk_wait_stats(uint64 * num_waits, uint64 * num_blocks) {
+    *num_waits  = g_num_thunk_waits;
+    *num_blocks = g_num_thunk_blocks;
+}
+
 extern "C" LEAN_EXPORT b_obj_res lean_thunk_get_core(b_obj_arg t) {
     object * c = lean_to_thunk(t)->m_closure.exchange(nullptr);
     if (c != nullptr) {
@@ -381,20 +598,211 @@ extern "C" LEAN_EXPORT b_obj_res lean_thunk_get_core(b_obj_arg t) {
         lean_assert(lean_to_thunk(t)->m_value == nullptr);
         mark_mt(r);
         lean_to_thunk(t)->m_value = r;
+        thunk_notify(t);
         return r;
     } else {
         lean_assert(c == nullptr);
-        /* There is another thread executing the closure. We keep waiting for the m_value to be
-           set by another thread. */
-        while (!lean_to_thunk(t)->m_value) {
-            this_thread::yield();
-        }
+        /* There is another thread executing the closure. We wait for the m_value to be set by this thread. */
+        if (!lean_to_thunk(t)->m_value)
+            thunk_wait(t);
         return lean_to_thunk(t)->m_value;
     }
 }
 
+extern "C" LEAN_EXPORT object * lean_closed_term_init(object ** p, object * (*init)()) {
+    object * r = init();
+    lean_mark_persistent(r);
+    /* If another thread initialized the closed term concurrently, we use its value. Ours is persistent, and it is
+       leaked. */
+    object * expected = nullptr;
+    if (reinterpret_cast<std::atomic<object *> *>(p)->compare_exchange_strong(expected, r, std::memory_order_acq_rel))
+        return r;
+    return expected;
+}
+
 // =======================================
-// Mark Persistent
+// Mark Persistent/MT
+
+/* Marking a graph with `lean_mark_persistent` or `lean_mark_mt` starts sequentially. When the stack of objects left
+   to visit reaches `LEAN_PARALLEL_MARK_THRESHOLD` entries, the rest of the graph is marked by up to
+   `LEAN_PARALLEL_MARK_MAX_THREADS` threads, which claim objects with a CAS on their RC and share their stacks
+   through a common pool when other threads are idle. */
+#ifndef LEAN_PARALLEL_MARK_THRESHOLD
+#define LEAN_PARALLEL_MARK_THRESHOLD 1024*64
+#endif
+#ifndef LEAN_PARALLEL_MARK_MAX_THREADS
+#define LEAN_PARALLEL_MARK_MAX_THREADS 8
+#endif
+// number of objects a marking thread moves to the pool at once
+#define LEAN_PARALLEL_MARK_CHUNK 1024
+
+/* Apply `f` to the objects directly reachable from `o`, except for the ones of external objects, which can only be
+   enumerated by passing a closure to their `m_foreach`. */
+template<typename F> static inline void for_each_child(object * o, F && f) {
+    uint8_t tag = lean_ptr_tag(o);
+    if (tag <= LeanMaxCtorTag) {
+        object ** it  = lean_ctor_obj_cptr(o);
+        object ** end = it + lean_ctor_num_objs(o);
+        for (; it != end; ++it) f(*it);
+    } else {
+        switch (tag) {
+        case LeanScalarArray:
+        case LeanString:
+        case LeanMPZ:
+        case LeanExternal:
+            break;
+        case LeanTask:
+            f(lean_task_get(o));
+            break;
+        case LeanClosure: {
+            object ** it  = lean_closure_arg_cptr(o);
+            object ** end = it + lean_closure_num_fixed(o);
+            for (; it != end; ++it) f(*it);
+            break;
+        }
+        case LeanArray: {
+            object ** it  = lean_array_cptr(o);
+            object ** end = it + lean_array_size(o);
+            for (; it != end; ++it) f(*it);
+            break;
+        }
+        case LeanThunk:
+            if (object * c = lean_to_thunk(o)->m_closure) f(c);
+            if (object * v = lean_to_thunk(o)->m_value) f(v);
+            break;
+        case LeanRef:
+            if (object * v = lean_to_ref(o)->m_value) f(v);
+            break;
+        default:
+            lean_unreachable();
+            break;
+        }
+    }
+}
+
+#if defined(LEAN_MULTI_THREAD)
+struct parallel_mark_state {
+    mutex                 m_mutex;
+    condition_variable    m_cv;
+    std::vector<object *> m_pool;
+    // external objects that have been marked, the objects reachable from them are visited by the initial thread
+    std::vector<object *> m_externals;
+    unsigned              m_num_threads;
+    atomic<unsigned>      m_idle{0};
+    bool                  m_done{false};
+    explicit parallel_mark_state(unsigned num_threads):m_num_threads(num_threads) {}
+};
+
+/* Mark the objects reachable from `todo` in parallel with other threads using `s`. Objects not satisfying
+   `M::should_mark` are neither marked nor traversed: they have been marked already, by this or another call. */
+template<typename M> static void parallel_mark_worker(parallel_mark_state & s, buffer<object *> & todo) {
+    std::vector<object *> externals;
+    while (true) {
+        if (todo.empty()) {
+            unique_lock<mutex> lock(s.m_mutex);
+            s.m_idle++;
+            while (s.m_pool.empty() && !s.m_done) {
+                if (s.m_idle == s.m_num_threads) {
+                    s.m_done = true;
+                    s.m_cv.notify_all();
+                } else {
+                    s.m_cv.wait(lock);
+                }
+            }
+            if (s.m_pool.empty()) {
+                s.m_externals.insert(s.m_externals.end(), externals.begin(), externals.end());
+                return;
+            }
+            size_t n = std::min<size_t>(s.m_pool.size(), LEAN_PARALLEL_MARK_CHUNK);
+            for (size_t i = s.m_pool.size() - n; i < s.m_pool.size(); i++)
+                todo.push_back(s.m_pool[i]);
+            s.m_pool.resize(s.m_pool.size() - n);
+            s.m_idle--;
+        }
+        object * o = todo.back();
+        todo.pop_back();
+        if (!M::mark_atomic(o))
+            continue;
+        if (lean_ptr_tag(o) == LeanExternal) {
+            externals.push_back(o);
+        } else {
+            for_each_child(o, [&](object * c) { if (M::should_mark(c)) todo.push_back(c); });
+        }
+        if (todo.size() >= 2 * LEAN_PARALLEL_MARK_CHUNK && s.m_idle.load(memory_order_relaxed) > 0) {
+            lock_guard<mutex> lock(s.m_mutex);
+            s.m_pool.insert(s.m_pool.end(), todo.end() - LEAN_PARALLEL_MARK_CHUNK, todo.end());
+            todo.shrink(todo.size() - LEAN_PARALLEL_MARK_CHUNK);
+            s.m_cv.notify_all();
+        }
+    }
+}
+#endif
+
+/* Mark the graph reachable from `o` using `M`, which provides
+   - `should_mark(o)`: whether `o` is a heap object that still needs to be marked,
+   - `mark(o)`/`mark_atomic(o)`: mark `o`; the latter returns `false` if `o` has already been marked by another thread,
+   - `mark_external(o)`: mark the objects reachable from the external object `o`. */
+template<typename M> static void mark_graph(object * o) {
+    if (!M::should_mark(o)) return;
+    buffer<object *> todo;
+    todo.push_back(o);
+#if defined(LEAN_MULTI_THREAD)
+    bool try_parallel = true;
+#endif
+    while (!todo.empty()) {
+#if defined(LEAN_MULTI_THREAD)
+        if (try_parallel && todo.size() >= LEAN_PARALLEL_MARK_THRESHOLD) {
+            try_parallel = false;
+            unsigned num_threads = std::min<unsigned>(hardware_concurrency(), LEAN_PARALLEL_MARK_MAX_THREADS);
+            if (num_threads > 1) {
+                parallel_mark_state s(num_threads);
+                // keep a chunk for this thread, everything else is shared
+                s.m_pool.assign(todo.begin() + LEAN_PARALLEL_MARK_CHUNK, todo.end());
+                todo.shrink(LEAN_PARALLEL_MARK_CHUNK);
+                std::vector<std::unique_ptr<lthread>> helpers;
+                helpers.reserve(num_threads - 1);
+                try {
+                    for (unsigned i = 1; i < num_threads; i++) {
+                        helpers.emplace_back(new lthread([&]() {
+                            buffer<object *> helper_todo;
+                            parallel_mark_worker<M>(s, helper_todo);
+                        }));
+                    }
+                } catch (exception &) {
+                    /* Continue with the helpers we have. This thread is not idle yet, so none of them can have
+                       decided that the marking is done. */
+                    lock_guard<mutex> lock(s.m_mutex);
+                    s.m_num_threads = helpers.size() + 1;
+                }
+                if (helpers.empty()) {
+                    // no thread could be created, mark sequentially
+                    for (object * p : s.m_pool)
+                        todo.push_back(p);
+                    continue;
+                }
+                parallel_mark_worker<M>(s, todo);
+                for (std::unique_ptr<lthread> & t : helpers)
+                    t->join();
+                // `m_foreach` is passed a closure allocated by the current thread, so it is not called by the helpers
+                for (object * e : s.m_externals)
+                    M::mark_external(e);
+                return;
+            }
+        }
+#endif
+        object * o = todo.back();
+        todo.pop_back();
+        // `o` may have been reached and marked through another path since it was pushed
+        if (!M::should_mark(o))
+            continue;
+        M::mark(o);
+        if (lean_ptr_tag(o) == LeanExternal) {
+            M::mark_external(o);
+        } else {
+            for_each_child(o, [&](object * c) { if (M::should_mark(c)) todo.push_back(c); });
+        }
+    }
+}
 
 extern "C" void lean_mark_persistent(object * o);
 
@@ -406,73 +814,48 @@ static obj_res mark_persistent_fn(obj_arg o) {
 #if defined(__has_feature)
 #if __has_feature(address_sanitizer)
 #include <sanitizer/lsan_interface.h>
+#define LEAN_LSAN_IGNORE_OBJECT(o) __lsan_ignore_object(o)
 #endif
 #endif
-
-extern "C" LEAN_EXPORT void lean_mark_persistent(object * o) {
-    buffer<object*> todo;
-    todo.push_back(o);
-    while (!todo.empty()) {
-        object * o = todo.back();
-        todo.pop_back();
-        if (!lean_is_scalar(o) && lean_has_rc(o)) {
-            o->m_rc = 0;
-#if defined(__has_feature)
-#if __has_feature(address_sanitizer)
-            // do not report as leak
-            // NOTE: Most persistent objects are actually reachable from global
-            // variables up to the end of the process. However, this is *not*
-            // true for closures inside of persistent thunks, which are
-            // "orphaned" after being evaluated.
-            __lsan_ignore_object(o);
-#endif
+#ifndef LEAN_LSAN_IGNORE_OBJECT
+#define LEAN_LSAN_IGNORE_OBJECT(o)
 #endif
-            uint8_t tag = lean_ptr_tag(o);
-            if (tag <= LeanMaxCtorTag) {
-                object ** it  = lean_ctor_obj_cptr(o);
-                object ** end = it + lean_ctor_num_objs(o);
-                for (; it != end; ++it) todo.push_back(*it);
-            } else {
-                switch (tag) {
-                case LeanScalarArray:
-                case LeanString:
-                case LeanMPZ:
-                    break;
-                case LeanExternal: {
-                    object * fn = lean_alloc_closure((void*)mark_persistent_fn, 1, 0);
-                    lean_to_external(o)->m_class->m_foreach(lean_to_external(o)->m_data, fn);
-                    lean_dec(fn);
-                    break;
-                }
-                case LeanTask:
-                    todo.push_back(lean_task_get(o));
-                    break;
-                case LeanClosure: {
-                    object ** it  = lean_closure_arg_cptr(o);
-                    object ** end = it + lean_closure_num_fixed(o);
-                    for (; it != end; ++it) todo.push_back(*it);
-                    break;
-                }
-                case LeanArray: {
-                    object ** it  = lean_array_cptr(o);
-                    object ** end = it + lean_array_size(o);
-                    for (; it != end; ++it) todo.push_back(*it);
-                    break;
-                }
-                case LeanThunk:
-                    if (object * c = lean_to_thunk(o)->m_closure) todo.push_back(c);
-                    if (object * v = lean_to_thunk(o)->m_value) todo.push_back(v);
-                    break;
-                case LeanRef:
-                    if (object * v = lean_to_ref(o)->m_value) todo.push_back(v);
-                    break;
-                default:
-                    lean_unreachable();
-                    break;
-                }
+
+struct mark_persistent_fns {
+    static bool should_mark(object * o) { return !lean_is_scalar(o) && lean_has_rc(o); }
+    static void ignore_leak(object * o) {
+        // do not report as leak
+        // NOTE: Most persistent objects are actually reachable from global
+        // variables up to the end of the process. However, this is *not*
+        // true for closures inside of persistent thunks, which are
+        // "orphaned" after being evaluated.
+        LEAN_LSAN_IGNORE_OBJECT(o);
+        (void)o;
+    }
+    static void mark(object * o) {
+        o->m_rc = 0;
+        ignore_leak(o);
+    }
+    static bool mark_atomic(object * o) {
+        int rc = std::atomic_load_explicit(lean_get_rc_mt_addr(o), std::memory_order_relaxed);
+        while (rc != 0) {
+            if (std::atomic_compare_exchange_weak_explicit(lean_get_rc_mt_addr(o), &rc, 0,
+                                                           std::memory_order_relaxed, std::memory_order_relaxed)) {
+                ignore_leak(o);
+                return true;
             }
         }
+        return false;
     }
+    static void mark_external(object * o) {
+        object * fn = lean_alloc_closure((void*)mark_persistent_fn, 1, 0);
+        lean_to_external(o)->m_class->m_foreach(lean_to_external(o)->m_data, fn);
+        lean_dec(fn);
+    }
+};
+
+extern "C" LEAN_EXPORT void lean_mark_persistent(object * o) {
+    mark_graph<mark_persistent_fns>(o);
 }
 
 // =======================================
@@ -486,65 +869,195 @@ static obj_res mark_mt_fn(obj_arg o) {
     return lean_box(0);
 }
 
+struct mark_mt_fns {
+    static bool should_mark(object * o) { return !lean_is_scalar(o) && lean_is_st(o); }
+    static void mark(object * o) { o->m_rc = -o->m_rc; }
+    static bool mark_atomic(object * o) {
+        int rc = std::atomic_load_explicit(lean_get_rc_mt_addr(o), std::memory_order_relaxed);
+        while (rc > 0) {
+            if (std::atomic_compare_exchange_weak_explicit(lean_get_rc_mt_addr(o), &rc, -rc,
+                                                           std::memory_order_relaxed, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+    static void mark_external(object * o) {
+        object * fn = lean_alloc_closure((void*)mark_mt_fn, 1, 0);
+        lean_to_external(o)->m_class->m_foreach(lean_to_external(o)->m_data, fn);
+        lean_dec(fn);
+    }
+};
+
 extern "C" LEAN_EXPORT void lean_mark_mt(object * o) {
 #ifndef LEAN_MULTI_THREAD
     return;
 #endif
-    if (lean_is_scalar(o) || !lean_is_st(o)) return;
+    mark_graph<mark_mt_fns>(o);
+}
 
-    buffer<object*> todo;
-    todo.push_back(o);
-    while (!todo.empty()) {
-        object * o = todo.back();
-        todo.pop_back();
-        if (!lean_is_scalar(o) && lean_is_st(o)) {
-            o->m_rc = -o->m_rc;
-            uint8_t tag = lean_ptr_tag(o);
-            if (tag <= LeanMaxCtorTag) {
-                object ** it  = lean_ctor_obj_cptr(o);
-                object ** end = it + lean_ctor_num_objs(o);
-                for (; it != end; ++it) todo.push_back(*it);
-            } else {
-                switch (tag) {
-                case LeanScalarArray:
-                case LeanString:
-                case LeanMPZ:
-                    break;
-                case LeanExternal: {
-                    object * fn = lean_alloc_closure((void*)mark_mt_fn, 1, 0);
-                    lean_to_external(o)->m_class->m_foreach(lean_to_external(o)->m_data, fn);
-                    lean_dec(fn);
-                    break;
-                }
-                case LeanTask:
-                    todo.push_back(lean_task_get(o));
-                    break;
-                case LeanClosure: {
-                    object ** it  = lean_closure_arg_cptr(o);
-                    object ** end = it + lean_closure_num_fixed(o);
-                    for (; it != end; ++it) todo.push_back(*it);
-                    break;
-                }
-                case LeanArray: {
-                    object ** it  = lean_array_cptr(o);
-                    object ** end = it + lean_array_size(o);
-                    for (; it != end; ++it) todo.push_back(*it);
-                    break;
-                }
-                case LeanThunk:
-                    if (object * c = lean_to_thunk(o)->m_closure) todo.push_back(c);
-                    if (object * v = lean_to_thunk(o)->m_value) todo.push_back(v);
-                    break;
-                case LeanRef:
-                    if (object * v = lean_to_ref(o)->m_value) todo.push_back(v);
-                    break;
-                default:
-                    lean_unreachable();
-                    break;
-                }
-            }
+// =======================================
+// Heap snapshots
+
+/* Snapshot of the objects reachable from a root, nodes are numbered in breadth-first order. */
+struct heap_snapshot {
+    std::vector<object *>                m_nodes;
+    std::unordered_map<object *, size_t> m_node_idx;
+    /* Targets of the edges of all nodes, the edges of each node are contiguous. */
+    std::vector<size_t>                  m_edges;
+    std::vector<unsigned>                m_num_edges;
+
+    void add_edge(object * c) {
+        if (lean_is_scalar(c))
+            return;
+        auto it = m_node_idx.find(c);
+        if (it == m_node_idx.end()) {
+            it = m_node_idx.emplace(c, m_nodes.size()).first;
+            m_nodes.push_back(c);
+        }
+        m_edges.push_back(it->second);
+    }
+};
+
+LEAN_THREAD_PTR(heap_snapshot, g_heap_snapshot);
+
+static obj_res heap_snapshot_child_fn(obj_arg o) {
+    g_heap_snapshot->add_edge(o);
+    lean_dec(o);
+    return lean_box(0);
+}
+
+static std::string heap_snapshot_node_name(object * o) {
+    uint8_t tag = lean_ptr_tag(o);
+    if (tag <= LeanMaxCtorTag)
+        return "ctor " + std::to_string(tag) + " (" + std::to_string(lean_ctor_num_objs(o)) + " objs)";
+    switch (tag) {
+    case LeanClosure: {
+#ifndef LEAN_WINDOWS
+        Dl_info info;
+        if (dladdr(lean_closure_fun(o), &info) && info.dli_sname)
+            return std::string("closure ") + info.dli_sname;
+#endif
+        return "closure";
+    }
+    case LeanArray:       return "Array";
+    case LeanScalarArray: return "scalar array (" + std::to_string(lean_sarray_elem_size(o)) + " byte elems)";
+    case LeanString:      return "String";
+    case LeanMPZ:         return "Nat/Int (big)";
+    case LeanThunk:       return "Thunk";
+    case LeanTask:        return "Task";
+    case LeanRef:         return "Ref";
+    case LeanExternal:    return "external";
+    default:              return "unknown";
+    }
+}
+
+/* Index of the V8 node type used for objects with the given tag, see `node_types` below. */
+static unsigned heap_snapshot_node_type(object * o) {
+    switch (lean_ptr_tag(o)) {
+    case LeanClosure:     return 5;
+    case LeanArray:       return 1;
+    case LeanString:      return 2;
+    case LeanMPZ:         return 13;
+    case LeanScalarArray:
+    case LeanExternal:    return 8;
+    default:              return 3;
+    }
+}
+
+static void write_heap_snapshot_string(std::ostream & out, std::string const & s) {
+    out << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+/* Write the objects reachable from `root` in the V8 heap snapshot format, which tools such as the memory tab of the
+   Chrome developer tools use to compute dominators and retained sizes. Node 0 is a synthetic root. Children are
+   enumerated as in `lean_mark_persistent`. */
+static void write_heap_snapshot(b_obj_arg root, std::ostream & out) {
+    heap_snapshot s;
+    flet<heap_snapshot *> set(g_heap_snapshot, &s);
+    s.m_nodes.push_back(nullptr);
+    s.add_edge(root);
+    s.m_num_edges.push_back(s.m_edges.size());
+    for (size_t i = 1; i < s.m_nodes.size(); i++) {
+        object * o = s.m_nodes[i];
+        size_t num_edges = s.m_edges.size();
+        if (lean_ptr_tag(o) == LeanExternal) {
+            object * fn = lean_alloc_closure((void*)heap_snapshot_child_fn, 1, 0);
+            lean_to_external(o)->m_class->m_foreach(lean_to_external(o)->m_data, fn);
+            lean_dec(fn);
+        } else {
+            for_each_child(o, [&](object * c) { s.add_edge(c); });
+        }
+        s.m_num_edges.push_back(s.m_edges.size() - num_edges);
+    }
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, size_t> string_idx;
+    auto get_string_idx = [&](std::string const & str) {
+        auto it = string_idx.find(str);
+        if (it != string_idx.end())
+            return it->second;
+        string_idx.emplace(str, strings.size());
+        strings.push_back(str);
+        return strings.size() - 1;
+    };
+    constexpr unsigned node_fields = 7;
+    out << "{\"snapshot\":{\"meta\":{"
+        << "\"node_fields\":[\"type\",\"name\",\"id\",\"self_size\",\"edge_count\",\"trace_node_id\",\"detachedness\"],"
+        << "\"node_types\":[[\"hidden\",\"array\",\"string\",\"object\",\"code\",\"closure\",\"regexp\",\"number\","
+        << "\"native\",\"synthetic\",\"concatenated string\",\"sliced string\",\"symbol\",\"bigint\",\"object shape\"],"
+        << "\"string\",\"number\",\"number\",\"number\",\"number\",\"number\"],"
+        << "\"edge_fields\":[\"type\",\"name_or_index\",\"to_node\"],"
+        << "\"edge_types\":[[\"context\",\"element\",\"property\",\"internal\",\"hidden\",\"shortcut\",\"weak\"],"
+        << "\"string_or_number\",\"node\"],"
+        << "\"trace_function_info_fields\":[],\"trace_node_fields\":[],\"sample_fields\":[],\"location_fields\":[]},"
+        << "\"node_count\":" << s.m_nodes.size() << ",\"edge_count\":" << s.m_edges.size()
+        << ",\"trace_function_count\":0},\n\"nodes\":[";
+    for (size_t i = 0; i < s.m_nodes.size(); i++) {
+        object * o = s.m_nodes[i];
+        if (i > 0) out << ",\n";
+        if (o == nullptr) {
+            out << "9," << get_string_idx("(roots)") << ",0,0,";
+        } else {
+            out << heap_snapshot_node_type(o) << "," << get_string_idx(heap_snapshot_node_name(o)) << ","
+                << 2*i + 1 << "," << lean_object_byte_size(o) << ",";
+        }
+        out << s.m_num_edges[i] << ",0,0";
+    }
+    out << "],\n\"edges\":[";
+    size_t e = 0;
+    for (size_t i = 0; i < s.m_nodes.size(); i++) {
+        for (unsigned j = 0; j < s.m_num_edges[i]; j++, e++) {
+            if (e > 0) out << ",\n";
+            /* element edge, named by the index of the field */
+            out << "1," << j << "," << s.m_edges[e] * node_fields;
         }
     }
+    out << "],\n\"trace_function_infos\":[],\"trace_tree\":[],\"samples\":[],\"locations\":[],\n\"strings\":[";
+    for (size_t i = 0; i < strings.size(); i++) {
+        if (i > 0) out << ",\n";
+        write_heap_snapshot_string(out, strings[i]);
+    }
+    out << "]}\n";
+}
+
+/* heapSnapshot (root : @& α) (path : @& FilePath) : IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_heap_snapshot(b_obj_arg root, b_obj_arg fname, obj_arg) {
+    std::ofstream out(lean_string_cstr(fname));
+    if (out.fail())
+        return io_result_mk_error((sstream() << "failed to create heap snapshot file '" << lean_string_cstr(fname) << "'").str());
+    write_heap_snapshot(root, out);
+    return io_result_mk_ok(box(0));
 }
 
 // =======================================
@@ -561,6 +1074,7 @@ static lean_task_imp * alloc_task_imp(obj_arg c, unsigned prio, bool keep_alive)
     imp->m_canceled    = false;
     imp->m_keep_alive  = keep_alive;
     imp->m_deleted     = false;
+    imp->m_sync        = false;
     return imp;
 }
 
@@ -569,6 +1083,7 @@ static void free_task_imp(lean_task_imp * imp) {
 }
 
 static void free_task(lean_task_object * t) {
+    trace_task_free(t);
     if (t->m_imp) free_task_imp(t->m_imp);
     lean_free_small_object((lean_object*)t);
 }
@@ -577,51 +1092,169 @@ struct scoped_current_task_object : flet<lean_task_object *> {
     scoped_current_task_object(lean_task_object * t):flet(g_current_task_object, t) {}
 };
 
+/* Index into `task_manager::m_worker_queues` of the queue new tasks spawned by this thread are pushed to.
+   Queue `0` is shared by all threads that are not standard workers. */
+LEAN_THREAD_VALUE(unsigned, g_worker_queue_idx, 0);
+
+/* `sync` tasks whose dependency was finished by this thread, linked via `m_next_dep`.
+   They are run by `task_manager::run_inline_tasks` without going through the queues. */
+LEAN_THREAD_PTR(lean_task_object, g_inline_tasks);
+LEAN_THREAD_VALUE(bool, g_running_inline_tasks, false);
+
+/* Run queue of a single worker. Other workers steal from it when they run out of tasks of the highest
+   queued priority. Each queue has its own lock so that spawning tasks does not contend on `task_manager::m_mutex`. */
+struct worker_queue {
+    mutex                                         m_mutex;
+    std::deque<lean_task_object *>                m_queues[LEAN_MAX_PRIO+1];
+    atomic<unsigned>                              m_sizes[LEAN_MAX_PRIO+1];
+
+    worker_queue() {
+        for (unsigned prio = 0; prio <= LEAN_MAX_PRIO; prio++)
+            m_sizes[prio] = 0;
+    }
+
+    void push(lean_task_object * t, unsigned prio) {
+        lock_guard<mutex> lock(m_mutex);
+        m_queues[prio].push_back(t);
+        m_sizes[prio]++;
+    }
+
+    lean_task_object * pop(unsigned prio) {
+        if (m_sizes[prio] == 0)
+            return nullptr;
+        lock_guard<mutex> lock(m_mutex);
+        std::deque<lean_task_object *> & q = m_queues[prio];
+        if (q.empty())
+            return nullptr;
+        lean_task_object * result = q.front();
+        q.pop_front();
+        m_sizes[prio]--;
+        return result;
+    }
+};
+
+static obj_res task_map_fn(obj_arg f, obj_arg t, obj_arg);
+static obj_res task_bind_fn1(obj_arg x, obj_arg f, obj_arg);
+
+/* The function executed by a task closure for tracing purposes, looking through `map` and `bind` wrappers. */
+static void * task_trace_fn(object * c) {
+    void * fn = lean_closure_fun(c);
+    if ((fn == reinterpret_cast<void *>(task_map_fn) || fn == reinterpret_cast<void *>(task_bind_fn1)) &&
+        lean_closure_num_fixed(c) >= 1) {
+        object * f = lean_closure_arg_cptr(c)[fn == reinterpret_cast<void *>(task_map_fn) ? 0 : 1];
+        if (lean_is_closure(f))
+            return lean_closure_fun(f);
+    }
+    return fn;
+}
+
+static atomic<size_t> g_dedicated_task_stack_size(0);
+
+void set_dedicated_task_stack_size(size_t sz) {
+    g_dedicated_task_stack_size.store(sz, memory_order_relaxed);
+}
+
 class task_manager {
     mutex                                         m_mutex;
     std::vector<std::unique_ptr<lthread>>         m_std_workers;
-    unsigned                                      m_idle_std_workers{0};
+    atomic<unsigned>                              m_num_std_workers{0};
+    atomic<unsigned>                              m_idle_std_workers{0};
+    /* Standard workers blocked in `wait_for`/`wait_any` while running a task. */
+    atomic<unsigned>                              m_blocked_std_workers{0};
     unsigned                                      m_max_std_workers{0};
+    /* Maximum number of additional standard workers that may be active to compensate for blocked ones. */
+    unsigned                                      m_max_extra_std_workers{0};
     unsigned                                      m_num_dedicated_workers{0};
-    std::deque<lean_task_object *>                m_queues[LEAN_MAX_PRIO+1];
-    unsigned                                      m_queues_size{0};
-    unsigned                                      m_max_prio{0};
+    /* `m_worker_queues[0]` is the shared queue, `m_worker_queues[i+1]` belongs to the `i`-th standard worker. */
+    std::vector<std::unique_ptr<worker_queue>>    m_worker_queues;
+    /* Number of queued tasks per priority over all queues. */
+    atomic<unsigned>                              m_num_queued[LEAN_MAX_PRIO+1];
     condition_variable                            m_queue_cv;
-    condition_variable                            m_task_finished_cv;
+    /* Threads blocked in `wait_for`/`wait_any`, by the tasks they are waiting for. Each waiter has its own
+       condition variable, so that finishing a task only wakes up the threads waiting for it. */
+    std::unordered_multimap<lean_task_object *, condition_variable *> m_waiters;
     bool                                          m_shutting_down{false};
 
+    bool has_queued() const {
+        for (unsigned prio = 0; prio <= LEAN_MAX_PRIO; prio++)
+            if (m_num_queued[prio] != 0)
+                return true;
+        return false;
+    }
+
+    /* Return a task of the highest queued priority, preferring the current worker's own queue,
+       or `nullptr` if other workers took all of them first. */
     lean_task_object * dequeue() {
-        lean_assert(m_queues_size != 0);
-        std::deque<lean_task_object *> & q = m_queues[m_max_prio];
-        lean_assert(!q.empty());
-        lean_task_object * result      = q.front();
-        q.pop_front();
-        m_queues_size--;
-        if (q.empty()) {
-            while (m_max_prio > 0) {
-                --m_max_prio;
-                if (!m_queues[m_max_prio].empty())
-                    break;
+        unsigned n   = m_worker_queues.size();
+        unsigned idx = g_worker_queue_idx;
+        for (unsigned prio = LEAN_MAX_PRIO + 1; prio-- > 0;) {
+            if (m_num_queued[prio] == 0)
+                continue;
+            for (unsigned i = 0; i < n; i++) {
+                if (lean_task_object * t = m_worker_queues[(idx + i) % n]->pop(prio)) {
+                    m_num_queued[prio]--;
+                    return t;
+                }
             }
         }
-        return result;
+        return nullptr;
+    }
+
+    void push(lean_task_object * t) {
+        unsigned prio = t->m_imp->m_prio;
+        lean_assert(prio <= LEAN_MAX_PRIO);
+        /* Increment first so that `m_num_queued` never underestimates the number of queued tasks. */
+        m_num_queued[prio]++;
+        trace_task_ready(t, prio);
+        m_worker_queues[g_worker_queue_idx % m_worker_queues.size()]->push(t, prio);
+    }
+
+    /* Return true if one more standard worker may run a task. Blocked workers do not count towards
+       `m_max_std_workers`, up to `m_max_extra_std_workers` of them. */
+    bool can_activate_worker() const {
+        unsigned active  = m_num_std_workers - m_idle_std_workers;
+        unsigned blocked = m_blocked_std_workers;
+        return active < m_max_std_workers + std::min(blocked, m_max_extra_std_workers);
+    }
+
+    bool needs_new_worker() const {
+        return m_idle_std_workers == 0 && can_activate_worker();
+    }
+
+    /* The current thread is about to block waiting for a task. If it is a standard worker running a task,
+       let another worker take its place in the meantime. Must be called with `m_mutex` held. */
+    bool enter_blocked() {
+        if (g_worker_queue_idx == 0 || !g_current_task_object)
+            return false;
+        m_blocked_std_workers++;
+        if (has_queued())
+            notify_worker();
+        return true;
+    }
+
+    /* Extra workers are not stopped eagerly when the blocked worker resumes; instead, `spawn_worker` does
+       not let idle workers pick up new tasks until the number of active workers is below the limit again. */
+    void exit_blocked(bool blocked) {
+        if (blocked)
+            m_blocked_std_workers--;
+    }
+
+    /* Wake up or spawn a worker for a newly pushed task. Must be called with `m_mutex` held. */
+    void notify_worker() {
+        if (needs_new_worker())
+            spawn_worker();
+        else
+            m_queue_cv.notify_one();
     }
 
     void enqueue_core(lean_task_object * t) {
         lean_assert(t->m_imp);
-        unsigned prio = t->m_imp->m_prio;
-        if (prio > LEAN_MAX_PRIO) {
+        if (t->m_imp->m_prio > LEAN_MAX_PRIO) {
             spawn_dedicated_worker(t);
             return;
         }
-        if (prio > m_max_prio)
-            m_max_prio = prio;
-        m_queues[prio].push_back(t);
-        m_queues_size++;
-        if (!m_idle_std_workers && m_std_workers.size() < m_max_std_workers)
-            spawn_worker();
-        else
-            m_queue_cv.notify_one();
+        push(t);
+        notify_worker();
     }
 
     void deactivate_task_core(unique_lock<mutex> & lock, lean_task_object * t) {
@@ -646,37 +1279,59 @@ class task_manager {
         if (m_shutting_down)
             return;
 
-        m_std_workers.emplace_back(new lthread([this]() {
+        unsigned worker_idx = m_std_workers.size();
+        m_num_std_workers++;
+        m_std_workers.emplace_back(new lthread([this, worker_idx]() {
             save_stack_info(false);
+            g_worker_queue_idx = worker_idx + 1;
+            if (is_numa_aware()) {
+                /* Distribute workers over the NUMA nodes, and make sure their heaps are local to them. */
+                unsigned node = worker_idx % numa_num_nodes();
+                if (numa_pin_current_thread(node))
+                    set_thread_heap_numa_node(node);
+            }
             unique_lock<mutex> lock(m_mutex);
             m_idle_std_workers++;
             while (true) {
-                if (m_queues_size == 0) {
+                if (!has_queued()) {
                     if (m_shutting_down) {
+                        // wake up workers that are waiting in the `can_activate_worker` case below
+                        m_queue_cv.notify_all();
                         break;
                     }
                     m_queue_cv.wait(lock);
                     continue;
                 }
 
-                lean_task_object * t = dequeue();
+                if (!can_activate_worker()) {
+                    // we are an extra worker whose blocked worker has resumed, stay idle
+                    m_queue_cv.wait(lock);
+                    continue;
+                }
+
                 m_idle_std_workers--;
-                run_task(lock, t);
+                lock.unlock();
+                lean_task_object * t = dequeue();
+                lock.lock();
+                if (t) {
+                    run_task(lock, t);
+                    reset_heartbeat();
+                }
                 m_idle_std_workers++;
-                reset_heartbeat();
             }
             m_idle_std_workers--;
         }));
     }
 
     void spawn_dedicated_worker(lean_task_object * t) {
+        trace_task_ready(t, t->m_imp->m_prio);
         m_num_dedicated_workers++;
         lthread([this, t]() {
             save_stack_info(false);
             unique_lock<mutex> lock(m_mutex);
             run_task(lock, t);
             m_num_dedicated_workers--;
-        });
+        }, g_dedicated_task_stack_size.load(memory_order_relaxed));
         // `lthread` will be implicitly freed, which frees up its control resources but does not terminate the thread
     }
 
@@ -693,7 +1348,10 @@ class task_manager {
             object * c = t->m_imp->m_closure;
             t->m_imp->m_closure = nullptr;
             lock.unlock();
+            if (is_task_tracing())
+                trace_task_start(t, task_trace_fn(c));
             v = lean_apply_1(c, box(0));
+            trace_task_stop(t, v != nullptr);
             // If deactivation was delayed by `m_keep_alive`, deactivate after the final execution (`v != nulltpr`)
             if (v != nullptr && t->m_imp->m_keep_alive) {
                 lean_dec_ref((lean_object*)t);
@@ -715,10 +1373,30 @@ class task_manager {
             // another thread could deactivate the task and empty `m_clousure` in
             // between.
             object * c = t->m_imp->m_closure;
+            // The remaining closure (`task_bind_fn2`) merely extracts the nested task's value,
+            // so run it directly on the thread that finishes the nested task.
+            t->m_imp->m_sync = true;
             lock.unlock();
             add_dep(lean_to_task(closure_arg_cptr(c)[0]), t);
             lock.lock();
         }
+        run_inline_tasks(lock);
+    }
+
+    /* Run the `sync` tasks that became ready on this thread (see `handle_finished`).
+       Tasks that become ready while doing so are appended to `g_inline_tasks` and processed
+       by the same loop, so long chains of continuations do not grow the stack. */
+    void run_inline_tasks(unique_lock<mutex> & lock) {
+        if (g_running_inline_tasks)
+            return;
+        flet<bool> running(g_running_inline_tasks, true);
+        // `run_task` resets the heartbeat, restore the current one afterwards
+        scope_heartbeat heartbeat(0);
+        while (lean_task_object * t = g_inline_tasks) {
+            g_inline_tasks = t->m_imp->m_next_dep;
+            t->m_imp->m_next_dep = nullptr;
+            run_task(lock, t);
+        }
     }
 
     void resolve_core(lean_task_object * t, object * v) {
@@ -729,7 +1407,21 @@ class task_manager {
            dependencies, we can release `m_imp` and keep just the value */
         free_task_imp(t->m_imp);
         t->m_imp   = nullptr;
-        m_task_finished_cv.notify_all();
+        if (!m_waiters.empty()) {
+            auto range = m_waiters.equal_range(t);
+            for (auto it = range.first; it != range.second; ++it)
+                it->second->notify_one();
+        }
+    }
+
+    void remove_waiter(lean_task_object * t, condition_variable * cv) {
+        auto range = m_waiters.equal_range(t);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == cv) {
+                m_waiters.erase(it);
+                return;
+            }
+        }
     }
 
     void handle_finished(lean_task_object * t) {
@@ -742,6 +1434,10 @@ class task_manager {
             it->m_imp->m_next_dep = nullptr;
             if (it->m_imp->m_deleted) {
                 free_task(it);
+            } else if (it->m_imp->m_sync && it->m_imp->m_prio <= LEAN_MAX_PRIO) {
+                trace_task_ready(it, it->m_imp->m_prio);
+                it->m_imp->m_next_dep = g_inline_tasks;
+                g_inline_tasks = it;
             } else {
                 enqueue_core(it);
             }
@@ -761,8 +1457,12 @@ class task_manager {
     }
 
 public:
-    task_manager(unsigned max_std_workers):
-        m_max_std_workers(max_std_workers) {
+    task_manager(unsigned max_std_workers, unsigned max_extra_std_workers):
+        m_max_std_workers(max_std_workers), m_max_extra_std_workers(max_extra_std_workers) {
+        for (unsigned prio = 0; prio <= LEAN_MAX_PRIO; prio++)
+            m_num_queued[prio] = 0;
+        for (unsigned i = 0; i <= max_std_workers; i++)
+            m_worker_queues.emplace_back(new worker_queue());
     }
 
     ~task_manager() {
@@ -781,8 +1481,19 @@ public:
     }
 
     void enqueue(lean_task_object * t) {
-        unique_lock<mutex> lock(m_mutex);
-        enqueue_core(t);
+        lean_assert(t->m_imp);
+        if (t->m_imp->m_prio > LEAN_MAX_PRIO) {
+            unique_lock<mutex> lock(m_mutex);
+            spawn_dedicated_worker(t);
+            return;
+        }
+        push(t);
+        /* Busy workers look for new tasks before going to sleep, so we only need `m_mutex` if some worker
+           is idle (and may be waiting on `m_queue_cv`) or if we may spawn a new one. */
+        if (m_idle_std_workers != 0 || needs_new_worker()) {
+            unique_lock<mutex> lock(m_mutex);
+            notify_worker();
+        }
     }
 
     void resolve(lean_task_object * t, object * v) {
@@ -793,10 +1504,12 @@ public:
             return;
         }
         resolve_core(t, v);
+        run_inline_tasks(lock);
     }
 
     void add_dep(lean_task_object * t1, lean_task_object * t2) {
         lean_assert(t2->m_value == nullptr);
+        trace_task_dep(t1, t2);
         if (t1->m_value) {
             enqueue(t2);
             return;
@@ -817,18 +1530,32 @@ public:
         unique_lock<mutex> lock(m_mutex);
         if (t->m_value)
             return;
-        m_task_finished_cv.wait(lock, [&]() { return t->m_value != nullptr; });
+        bool blocked = enter_blocked();
+        condition_variable cv;
+        m_waiters.emplace(t, &cv);
+        cv.wait(lock, [&]() { return t->m_value != nullptr; });
+        remove_waiter(t, &cv);
+        exit_blocked(blocked);
     }
 
     object * wait_any(object * task_list) {
         if (object * t = wait_any_check(task_list))
             return t;
         unique_lock<mutex> lock(m_mutex);
-        while (true) {
-            if (object * t = wait_any_check(task_list))
-                return t;
-            m_task_finished_cv.wait(lock);
-        }
+        if (object * t = wait_any_check(task_list))
+            return t;
+        bool blocked = enter_blocked();
+        /* Tasks are only finished while holding `m_mutex`, so none of them can finish between the check above and
+           registering the waiter for each of them. */
+        condition_variable cv;
+        for (object * it = task_list; !is_scalar(it); it = cnstr_get(it, 1))
+            m_waiters.emplace(lean_to_task(cnstr_get(it, 0)), &cv);
+        object * r;
+        cv.wait(lock, [&]() { return (r = wait_any_check(task_list)) != nullptr; });
+        for (object * it = task_list; !is_scalar(it); it = cnstr_get(it, 1))
+            remove_waiter(lean_to_task(cnstr_get(it, 0)), &cv);
+        exit_blocked(blocked);
+        return r;
     }
 
     void deactivate_task(lean_task_object * t) {
@@ -847,62 +1574,119 @@ public:
 
     void cancel(lean_task_object * t) {
         unique_lock<mutex> lock(m_mutex);
-        if (t->m_imp)
-            t->m_imp->m_canceled = true;
+        /* Also cancel all tasks waiting for `t`, transitively. `handle_finished` propagates the flag as well,
+           but only one level at a time when each task finishes. Each task waits for at most one task at a time,
+           so the `m_head_dep` lists form a tree. */
+        std::vector<lean_task_object *> todo;
+        todo.push_back(t);
+        while (!todo.empty()) {
+            lean_task_object * it = todo.back();
+            todo.pop_back();
+            if (!it->m_imp)
+                continue;
+            it->m_imp->m_canceled = true;
+            for (lean_task_object * dep = it->m_imp->m_head_dep; dep; dep = dep->m_imp->m_next_dep)
+                todo.push_back(dep);
+        }
     }
 
     bool shutting_down() const {
         return m_shutting_down;
     }
+
+    unsigned max_std_workers() const {
+        return m_max_std_workers;
+    }
 };
 
 static task_manager * g_task_manager = nullptr;
 
-extern "C" LEAN_EXPORT void lean_init_task_manager_using(unsigned num_workers) {
+extern "C" LEAN_EXPORT void lean_init_task_manager_with_extra_workers(unsigned num_workers, unsigned max_extra_workers) {
     lean_assert(g_task_manager == nullptr);
 #if defined(LEAN_MULTI_THREAD)
     if (num_workers > 0) {
-        g_task_manager = new task_manager(num_workers);
+        g_task_manager = new task_manager(num_workers, max_extra_workers);
     }
+#else
+    (void)num_workers; (void)max_extra_workers;
 #endif
 }
 
+extern "C" LEAN_EXPORT void lean_init_task_manager_using(unsigned num_workers) {
+    lean_init_task_manager_with_extra_workers(num_workers, LEAN_DEFAULT_MAX_EXTRA_WORKERS);
+}
+
 static unsigned get_lean_num_threads() {
 #ifndef LEAN_EMSCRIPTEN
     if (char const * num_threads = std::getenv("LEAN_NUM_THREADS")) {
         return atoi(num_threads);
     }
 #endif
+#if defined(LEAN_EMSCRIPTEN) && defined(LEAN_EMSCRIPTEN_PTHREAD_POOL_SIZE)
+    // Web Workers beyond the pool created at startup would not start while a thread blocks waiting for tasks
+    return std::max(1u, std::min<unsigned>(hardware_concurrency(), LEAN_EMSCRIPTEN_PTHREAD_POOL_SIZE));
+#else
     return hardware_concurrency();
+#endif
 }
 
 extern "C" LEAN_EXPORT void lean_init_task_manager() {
     lean_init_task_manager_using(get_lean_num_threads());
 }
 
+bool has_task_manager() {
+    return g_task_manager != nullptr;
+}
+
 extern "C" LEAN_EXPORT void lean_finalize_task_manager() {
     if (g_task_manager) {
+        // pending asynchronous I/O operations resolve promises, finish them first
+        finalize_async_io();
+        finalize_child_io();
         delete g_task_manager;
         g_task_manager = nullptr;
+        write_task_trace();
     }
 }
-
-scoped_task_manager::scoped_task_manager(unsigned num_workers) {
-    lean_assert(g_task_manager == nullptr);
-#if defined(LEAN_MULTI_THREAD)
-    if (num_workers > 0) {
-        g_task_manager = new task_manager(num_workers);
-    }
-#endif
+
+scoped_task_manager::scoped_task_manager(unsigned num_workers, unsigned max_extra_workers) {
+    lean_init_task_manager_with_extra_workers(num_workers, max_extra_workers);
 }
 
 scoped_task_manager::~scoped_task_manager() {
     if (g_task_manager) {
+        finalize_async_io();
+        finalize_child_io();
         delete g_task_manager;
         g_task_manager = nullptr;
+        write_task_trace();
+    }
+}
+
+#ifndef LEAN_LAZY_RC
+static obj_res deferred_del_fn(obj_arg p, obj_arg) {
+    object * todo = reinterpret_cast<object *>(lean_unbox_usize(p));
+    lean_dec(p);
+    while (todo != nullptr) {
+        object * o = pop_back(todo);
+        if (object * next = lean_del_core(o, todo))
+            push_back(todo, next);
     }
+    return box(0);
 }
 
+/* Free the objects in `todo` in a low-priority task. Return `false` if there is no task manager. */
+static bool defer_del(object * todo) {
+    if (!g_task_manager || g_task_manager->shutting_down())
+        return false;
+    /* The task is kept alive so that it runs even though we drop our reference immediately.
+       If it never gets to run (e.g., program exit), the objects are merely leaked. */
+    object * c = mk_closure_2_1(deferred_del_fn, lean_box_usize(reinterpret_cast<size_t>(todo)));
+    lean_dec_ref(lean_task_spawn_core(c, 0, true));
+    return true;
+}
+#endif
+
 void deactivate_task(lean_task_object * t) {
     if (g_task_manager) {
         g_task_manager->deactivate_task(t);
@@ -968,6 +1752,7 @@ extern "C" LEAN_EXPORT obj_res lean_task_map_core(obj_arg f, obj_arg t, unsigned
         return lean_task_pure(apply_1(f, lean_task_get_own(t)));
     } else {
         lean_task_object * new_task = alloc_task(mk_closure_3_2(task_map_fn, f, t), prio, keep_alive);
+        new_task->m_imp->m_sync = sync;
         g_task_manager->add_dep(lean_to_task(t), new_task);
         return (lean_object*)new_task;
     }
@@ -1011,6 +1796,7 @@ extern "C" LEAN_EXPORT obj_res lean_task_bind_core(obj_arg x, obj_arg f, unsigne
         return apply_1(f, lean_task_get_own(x));
     } else {
         lean_task_object * new_task = alloc_task(mk_closure_3_2(task_bind_fn1, x, f), prio, keep_alive);
+        new_task->m_imp->m_sync = sync;
         g_task_manager->add_dep(lean_to_task(x), new_task);
         return (lean_object*)new_task;
     }
@@ -1071,16 +1857,213 @@ extern "C" LEAN_EXPORT obj_res lean_io_promise_result(obj_arg promise) {
     return promise;
 }
 
+// =======================================
+// Parallel array primitives
+
+#ifndef LEAN_PAR_ARRAY_BLOCKS_PER_WORKER
+#define LEAN_PAR_ARRAY_BLOCKS_PER_WORKER 4
+#endif
+
+/* Maximum number of elements of a block, so that the pointers of a block fit in the L1 cache. */
+#ifndef LEAN_PAR_ARRAY_MAX_BLOCK
+#define LEAN_PAR_ARRAY_MAX_BLOCK 4096
+#endif
+
+/* `Array.parMap` and `Array.parFoldl` split the array into blocks of consecutive elements. The current thread and a
+   few helper tasks, at most one per standard worker, claim blocks until there are none left. Thus, the number of tasks
+   does not depend on the size of the array, and the helpers that only get to run after all blocks have been claimed
+   exit immediately. */
+struct par_array_job {
+    /* The current thread and the helpers. */
+    atomic<unsigned>      m_rc{1};
+    object *              m_fn;
+    object *              m_array;
+    /* Initial value of each block for `parFoldl`, `nullptr` for `parMap`. */
+    object *              m_init;
+    /* If true, the elements are passed to `m_fn` without incrementing their RC since `m_array` was exclusive. */
+    bool                  m_consume;
+    /* `parMap`: the elements of the new array, `parFoldl`: the results of the blocks. */
+    object **             m_out;
+    size_t                m_size;
+    size_t                m_block_size;
+    size_t                m_num_blocks;
+    unsigned              m_num_helpers;
+    atomic<size_t>        m_next{0};
+    atomic<size_t>        m_done{0};
+    mutex                 m_mutex;
+    condition_variable    m_done_cv;
+};
+
+static void par_array_job_dec(par_array_job * j) {
+    if (--j->m_rc == 0)
+        delete j;
+}
+
+/* Return a new closure with the same function and arguments as `f`. Each thread applies its own copy, so that they do
+   not compete for the RC of `f`. */
+static obj_res copy_closure(b_obj_arg f) {
+    unsigned n = lean_closure_num_fixed(f);
+    object * r = lean_alloc_closure(lean_closure_fun(f), lean_closure_arity(f), n);
+    for (unsigned i = 0; i < n; i++) {
+        object * a = lean_closure_get(f, i);
+        lean_inc(a);
+        lean_closure_set(r, i, a);
+    }
+    return r;
+}
+
+static void par_array_run_block(par_array_job & j, b_obj_arg f, size_t b) {
+    size_t begin    = b * j.m_block_size;
+    size_t end      = std::min(begin + j.m_block_size, j.m_size);
+    object ** elems = lean_array_cptr(j.m_array);
+    if (j.m_init) {
+        object * r = j.m_init;
+        lean_inc(r);
+        for (size_t i = begin; i < end; i++) {
+            if (!j.m_consume) lean_inc(elems[i]);
+            lean_inc(f);
+            r = lean_apply_2(f, r, elems[i]);
+        }
+        j.m_out[b] = r;
+    } else {
+        for (size_t i = begin; i < end; i++) {
+            if (!j.m_consume) lean_inc(elems[i]);
+            lean_inc(f);
+            j.m_out[i] = lean_apply_1(f, elems[i]);
+        }
+    }
+}
+
+static void par_array_work(par_array_job & j) {
+    object * f = nullptr;
+    size_t b;
+    while ((b = j.m_next++) < j.m_num_blocks) {
+        if (!f) f = copy_closure(j.m_fn);
+        par_array_run_block(j, f, b);
+        if (++j.m_done == j.m_num_blocks) {
+            lock_guard<mutex> lock(j.m_mutex);
+            j.m_done_cv.notify_all();
+        }
+    }
+    if (f) lean_dec(f);
+}
+
+static obj_res par_array_helper_fn(obj_arg p, obj_arg) {
+    par_array_job * j = reinterpret_cast<par_array_job *>(lean_unbox_usize(p));
+    lean_dec(p);
+    par_array_work(*j);
+    par_array_job_dec(j);
+    return box(0);
+}
+
+/* Return a job for applying `fn` to the elements of `a`, split into blocks. The caller must set `m_out`. */
+static par_array_job * mk_par_array_job(obj_arg fn, obj_arg a, obj_arg init) {
+    par_array_job * j = new par_array_job();
+    size_t n          = lean_array_size(a);
+    unsigned workers  = g_task_manager && !g_task_manager->shutting_down() ? g_task_manager->max_std_workers() : 0;
+    size_t blocks     = static_cast<size_t>(workers) * LEAN_PAR_ARRAY_BLOCKS_PER_WORKER;
+    size_t block_sz   = blocks == 0 ? n : std::min<size_t>((n + blocks - 1) / blocks, LEAN_PAR_ARRAY_MAX_BLOCK);
+    if (block_sz == 0) block_sz = 1;
+    j->m_fn           = fn;
+    j->m_array        = a;
+    j->m_init         = init;
+    j->m_consume      = lean_is_exclusive(a);
+    j->m_out          = nullptr;
+    j->m_size         = n;
+    j->m_block_size   = block_sz;
+    j->m_num_blocks   = (n + block_sz - 1) / block_sz;
+    j->m_num_helpers  = static_cast<unsigned>(std::min<size_t>(workers, j->m_num_blocks - 1));
+    return j;
+}
+
+/* Process all blocks of `j`, release the array, the function, and the initial value, and delete `j`. */
+static void par_array_run(par_array_job * j) {
+    unsigned helpers = j->m_num_helpers;
+    if (helpers > 0) {
+        /* The elements, the function, and the initial value are accessed by several threads. */
+        lean_mark_mt(j->m_array);
+        lean_mark_mt(j->m_fn);
+        if (j->m_init) lean_mark_mt(j->m_init);
+        j->m_rc += helpers;
+        for (unsigned i = 0; i < helpers; i++) {
+            /* The tasks are kept alive so that they run even though we drop our reference immediately. */
+            object * c = mk_closure_2_1(par_array_helper_fn, lean_box_usize(reinterpret_cast<size_t>(j)));
+            lean_dec_ref(lean_task_spawn_core(c, 0, true));
+        }
+    }
+    par_array_work(*j);
+    {
+        unique_lock<mutex> lock(j->m_mutex);
+        j->m_done_cv.wait(lock, [&]() { return j->m_done == j->m_num_blocks; });
+    }
+    if (j->m_consume)
+        lean_free_object(j->m_array);
+    else
+        lean_dec(j->m_array);
+    lean_dec(j->m_fn);
+    if (j->m_init) lean_dec(j->m_init);
+    par_array_job_dec(j);
+}
+
+extern "C" LEAN_EXPORT obj_res lean_array_par_map(obj_arg f, obj_arg a) {
+    size_t n = lean_array_size(a);
+    if (n == 0) {
+        lean_dec(f);
+        return a;
+    }
+    object * r        = lean_alloc_array(n, n);
+    par_array_job * j = mk_par_array_job(f, a, nullptr);
+    j->m_out = lean_array_cptr(r);
+    par_array_run(j);
+    return r;
+}
+
+extern "C" LEAN_EXPORT obj_res lean_array_par_foldl(obj_arg f, obj_arg combine, obj_arg init, obj_arg a) {
+    if (lean_array_size(a) == 0) {
+        lean_dec(f);
+        lean_dec(combine);
+        lean_dec(a);
+        return init;
+    }
+    par_array_job * j = mk_par_array_job(f, a, init);
+    size_t num_blocks = j->m_num_blocks;
+    std::vector<object *> results(num_blocks);
+    j->m_out = results.data();
+    par_array_run(j);
+    object * r = results[0];
+    for (size_t b = 1; b < num_blocks; b++) {
+        lean_inc(combine);
+        r = lean_apply_2(combine, r, results[b]);
+    }
+    lean_dec(combine);
+    return r;
+}
+
 // =======================================
 // Natural numbers
 
-object * alloc_mpz(mpz const & m) {
+object * alloc_mpz(mpz && m) {
+#ifdef LEAN_USE_GMP
+    /* Store the digits right after the object, as in `alloc_nat_u128`, so that they are allocated by our allocator
+       instead of GMP's. Only huge numbers keep the digits allocated by GMP. */
+    size_t sz = sizeof(mpz_object) + mpz::inline_storage_size_of(m);
+    if (sz <= LEAN_MAX_SMALL_OBJECT_SIZE) {
+        mpz_object * o = static_cast<mpz_object *>(static_cast<void *>(lean_alloc_small_object(sz)));
+        o->m_value.init_inline(m, mpz_inline_storage((lean_object*)o));
+        lean_set_st_header((lean_object*)o, LeanMPZ, 0);
+        return (lean_object*)o;
+    }
+#endif
     void * mem = lean_alloc_small_object(sizeof(mpz_object));
-    mpz_object * o = new (mem) mpz_object(m);
+    mpz_object * o = new (mem) mpz_object(std::move(m));
     lean_set_st_header((lean_object*)o, LeanMPZ, 0);
     return (lean_object*)o;
 }
 
+object * alloc_mpz(mpz const & m) {
+    return alloc_mpz(mpz(m));
+}
+
 #ifdef LEAN_USE_GMP
 extern "C" LEAN_EXPORT lean_object * lean_alloc_mpz(mpz_t v) {
     return alloc_mpz(mpz(v));
@@ -1091,16 +2074,87 @@ extern "C" LEAN_EXPORT void lean_extract_mpz_value(lean_object * o, mpz_t v) {
 }
 #endif
 
-object * mpz_to_nat_core(mpz const & m) {
+/* The results of the `mpz` operations below are temporaries, which are moved into the new objects. */
+object * mpz_to_nat_core(mpz && m) {
     lean_assert(!m.is_size_t() || m.get_size_t() > LEAN_MAX_SMALL_NAT);
-    return alloc_mpz(m);
+    return alloc_mpz(std::move(m));
+}
+
+object * mpz_to_nat_core(mpz const & m) {
+    return mpz_to_nat_core(mpz(m));
 }
 
-static inline obj_res mpz_to_nat(mpz const & m) {
+static inline obj_res mpz_to_nat(mpz && m) {
     if (m.is_size_t() && m.get_size_t() <= LEAN_MAX_SMALL_NAT)
         return lean_box(m.get_size_t());
     else
-        return mpz_to_nat_core(m);
+        return mpz_to_nat_core(std::move(m));
+}
+
+/* Fast paths for natural numbers smaller than 2^128, which are common as intermediate results of `UInt64` and
+   hashing code. They avoid the temporary `mpz` values of the general case. */
+
+static obj_res alloc_nat_u128(uint64 hi, uint64 lo) {
+    if (hi == 0 && lo <= LEAN_MAX_SMALL_NAT)
+        return lean_box(lo);
+    void * mem = lean_alloc_small_object(sizeof(mpz_object) + mpz::inline_storage_size);
+    mpz_object * o = static_cast<mpz_object *>(mem);
+    o->m_value.init_inline_u128(hi, lo, mpz_inline_storage((lean_object*)o));
+    lean_set_st_header((lean_object*)o, LeanMPZ, 0);
+    return (lean_object*)o;
+}
+
+static inline bool nat_get_u128(b_obj_arg a, uint64 & hi, uint64 & lo) {
+    if (lean_is_scalar(a)) {
+        hi = 0;
+        lo = lean_unbox(a);
+        return true;
+    }
+    return mpz_value(a).get_u128(hi, lo);
+}
+
+/* `(hi, lo) := a * b` */
+static inline void mul_u64(uint64 a, uint64 b, uint64 & hi, uint64 & lo) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    lo = static_cast<uint64>(r);
+    hi = static_cast<uint64>(r >> 64);
+#else
+    uint64 ah = a >> 32, bh = b >> 32, al = static_cast<uint32>(a), bl = static_cast<uint32>(b);
+    uint64 ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+    uint64 mid = (ll >> 32) + static_cast<uint32>(lh) + static_cast<uint32>(hl);
+    lo = (mid << 32) | static_cast<uint32>(ll);
+    hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+/* Store `a + b` in `(hi, lo)`, return false on overflow. */
+static inline bool add_u128(uint64 ah, uint64 al, uint64 bh, uint64 bl, uint64 & hi, uint64 & lo) {
+    lo = al + bl;
+    uint64 c = lo < al;
+    hi = ah + bh;
+    if (hi < ah)
+        return false;
+    hi += c;
+    return hi >= c;
+}
+
+/* Store `a * b` in `(hi, lo)`, return false on overflow. */
+static inline bool mul_u128(uint64 ah, uint64 al, uint64 bh, uint64 bl, uint64 & hi, uint64 & lo) {
+    if (ah != 0 && bh != 0)
+        return false;
+    if (bh != 0) {
+        std::swap(ah, bh);
+        std::swap(al, bl);
+    }
+    // a * bl, where a = ah * 2^64 + al
+    uint64 t_hi, t_lo;
+    mul_u64(al, bl, hi, lo);
+    mul_u64(ah, bl, t_hi, t_lo);
+    if (t_hi != 0)
+        return false;
+    hi += t_lo;
+    return hi >= t_lo;
 }
 
 extern "C" LEAN_EXPORT object * lean_cstr_to_nat(char const * n) {
@@ -1108,27 +2162,25 @@ extern "C" LEAN_EXPORT object * lean_cstr_to_nat(char const * n) {
 }
 
 extern "C" LEAN_EXPORT object * lean_big_usize_to_nat(size_t n) {
-    if (n <= LEAN_MAX_SMALL_NAT) {
-        return lean_box(n);
-    } else {
-        return mpz_to_nat_core(mpz::of_size_t(n));
-    }
+    return alloc_nat_u128(0, n);
 }
 
 extern "C" LEAN_EXPORT object * lean_big_uint64_to_nat(uint64_t n) {
-    if (LEAN_LIKELY(n <= LEAN_MAX_SMALL_NAT)) {
-        return lean_box(n);
-    } else {
-        return mpz_to_nat_core(mpz(n));
-    }
+    return alloc_nat_u128(0, n);
 }
 
 extern "C" LEAN_EXPORT object * lean_nat_big_succ(object * a) {
+    uint64 h, l;
+    if (nat_get_u128(a, h, l) && add_u128(h, l, 0, 1, h, l))
+        return alloc_nat_u128(h, l);
     return mpz_to_nat_core(mpz_value(a) + 1);
 }
 
 extern "C" LEAN_EXPORT object * lean_nat_big_add(object * a1, object * a2) {
     lean_assert(!lean_is_scalar(a1) || !lean_is_scalar(a2));
+    uint64 h1, l1, h2, l2;
+    if (nat_get_u128(a1, h1, l1) && nat_get_u128(a2, h2, l2) && add_u128(h1, l1, h2, l2, h1, l1))
+        return alloc_nat_u128(h1, l1);
     if (lean_is_scalar(a1))
         return mpz_to_nat_core(mpz::of_size_t(lean_unbox(a1)) + mpz_value(a2));
     else if (lean_is_scalar(a2))
@@ -1142,7 +2194,14 @@ extern "C" LEAN_EXPORT object * lean_nat_big_sub(object * a1, object * a2) {
     if (lean_is_scalar(a1)) {
         lean_assert(mpz::of_size_t(lean_unbox(a1)) < mpz_value(a2));
         return lean_box(0);
-    } else if (lean_is_scalar(a2)) {
+    }
+    uint64 h1, l1, h2, l2;
+    if (nat_get_u128(a1, h1, l1) && nat_get_u128(a2, h2, l2)) {
+        if (h1 < h2 || (h1 == h2 && l1 < l2))
+            return lean_box(0);
+        return alloc_nat_u128(h1 - h2 - (l1 < l2), l1 - l2);
+    }
+    if (lean_is_scalar(a2)) {
         lean_assert(mpz_value(a1) > mpz::of_size_t(lean_unbox(a2)));
         return mpz_to_nat(mpz_value(a1) - mpz::of_size_t(lean_unbox(a2)));
     } else {
@@ -1155,6 +2214,9 @@ extern "C" LEAN_EXPORT object * lean_nat_big_sub(object * a1, object * a2) {
 
 extern "C" LEAN_EXPORT object * lean_nat_big_mul(object * a1, object * a2) {
     lean_assert(!lean_is_scalar(a1) || !lean_is_scalar(a2));
+    uint64 h1, l1, h2, l2;
+    if (nat_get_u128(a1, h1, l1) && nat_get_u128(a2, h2, l2) && mul_u128(h1, l1, h2, l2, h1, l1))
+        return alloc_nat_u128(h1, l1);
     if (lean_is_scalar(a1))
         return mpz_to_nat(mpz::of_size_t(lean_unbox(a1)) * mpz_value(a2));
     else if (lean_is_scalar(a2))
@@ -1164,7 +2226,9 @@ extern "C" LEAN_EXPORT object * lean_nat_big_mul(object * a1, object * a2) {
 }
 
 extern "C" LEAN_EXPORT object * lean_nat_overflow_mul(size_t a1, size_t a2) {
-    return mpz_to_nat(mpz::of_size_t(a1) * mpz::of_size_t(a2));
+    uint64 h, l;
+    mul_u64(a1, a2, h, l);
+    return alloc_nat_u128(h, l);
 }
 
 extern "C" LEAN_EXPORT object * lean_nat_big_div(object * a1, object * a2) {
@@ -1280,7 +2344,7 @@ extern "C" LEAN_EXPORT lean_obj_res lean_nat_shiftl(b_lean_obj_arg a1, b_lean_ob
     }
     mpz r;
     mul2k(r, a, lean_unbox(a2));
-    return mpz_to_nat(r);
+    return mpz_to_nat(std::move(r));
 }
 
 extern "C" LEAN_EXPORT lean_obj_res lean_nat_shiftr(b_lean_obj_arg a1, b_lean_obj_arg a2) {
@@ -1302,7 +2366,7 @@ extern "C" LEAN_EXPORT lean_obj_res lean_nat_shiftr(b_lean_obj_arg a1, b_lean_ob
     }
     mpz r;
     div2k(r, a, s);
-    return mpz_to_nat(r);
+    return mpz_to_nat(std::move(r));
 }
 
 extern "C" LEAN_EXPORT lean_obj_res lean_nat_pow(b_lean_obj_arg a1, b_lean_obj_arg a2) {
@@ -1346,14 +2410,14 @@ extern "C" LEAN_EXPORT lean_obj_res lean_nat_log2(b_lean_obj_arg a) {
 // =======================================
 // Integers
 
-inline object * mpz_to_int_core(mpz const & m) {
+inline object * mpz_to_int_core(mpz && m) {
     lean_assert(m < LEAN_MIN_SMALL_INT || m > LEAN_MAX_SMALL_INT);
-    return alloc_mpz(m);
+    return alloc_mpz(std::move(m));
 }
 
-static object * mpz_to_int(mpz const & m) {
+static object * mpz_to_int(mpz && m) {
     if (m < LEAN_MIN_SMALL_INT || m > LEAN_MAX_SMALL_INT)
-        return mpz_to_int_core(m);
+        return mpz_to_int_core(std::move(m));
     else
         return lean_box(static_cast<unsigned>(m.get_int()));
 }
@@ -1362,7 +2426,7 @@ extern "C" LEAN_EXPORT lean_obj_res lean_big_int_to_nat(lean_obj_arg a) {
     lean_assert(!lean_is_scalar(a));
     mpz m = mpz_value(a);
     lean_dec(a);
-    return mpz_to_nat(m);
+    return mpz_to_nat(std::move(m));
 }
 
 extern "C" LEAN_EXPORT object * lean_cstr_to_int(char const * n) {
@@ -1676,6 +2740,14 @@ extern "C" LEAN_EXPORT object * lean_string_push(object * s, unsigned c) {
 extern "C" LEAN_EXPORT object * lean_string_append(object * s1, object * s2) {
     size_t sz1      = lean_string_size(s1);
     size_t sz2      = lean_string_size(s2);
+    /* Appending to or from the empty string shares the other argument instead of copying it. */
+    if (sz2 == 1)
+        return s1;
+    if (sz1 == 1 && !lean_is_exclusive(s1)) {
+        lean_inc_ref(s2);
+        lean_dec_ref(s1);
+        return s2;
+    }
     size_t len1     = lean_string_len(s1);
     size_t len2     = lean_string_len(s2);
     size_t new_len  = len1 + len2;
@@ -1696,6 +2768,70 @@ extern "C" LEAN_EXPORT object * lean_string_append(object * s1, object * s2) {
     return r;
 }
 
+extern "C" LEAN_EXPORT object * lean_string_reserve(object * s, b_obj_arg n) {
+    size_t sz = lean_string_size(s);
+    // a request that cannot be satisfied is ignored, the following appends then fail as usual
+    if (!lean_is_scalar(n) || lean_unbox(n) > LEAN_MAX_SMALL_NAT - sz)
+        return s;
+    size_t cap = sz + lean_unbox(n);
+    if (lean_is_exclusive(s) && cap <= lean_string_capacity(s))
+        return s;
+    object * r = lean_alloc_string(sz, std::max(cap, lean_string_capacity(s)), lean_string_len(s));
+    memcpy(w_string_cstr(r), lean_string_cstr(s), sz);
+    if (lean_is_exclusive(s))
+        lean_dealloc(s, lean_string_byte_size(s));
+    else
+        lean_dec_ref(s);
+    return r;
+}
+
+/* Concatenation of the strings of the list `l`, separated by `sep`. The result is allocated once. A list with a single
+   element returns it, as the reference implementations do. */
+static object * string_intercalate_core(b_obj_arg sep, b_obj_arg l) {
+    if (lean_is_scalar(l))
+        return lean_mk_string("");
+    if (lean_is_scalar(lean_ctor_get(l, 1))) {
+        object * s = lean_ctor_get(l, 0);
+        lean_inc_ref(s);
+        return s;
+    }
+    size_t sep_sz  = sep ? lean_string_size(sep) - 1 : 0;
+    size_t sep_len = sep ? lean_string_len(sep) : 0;
+    size_t sz  = 0;
+    size_t len = 0;
+    for (b_obj_arg it = l; !lean_is_scalar(it); it = lean_ctor_get(it, 1)) {
+        object * s = lean_ctor_get(it, 0);
+        if (it != l) {
+            sz  += sep_sz;
+            len += sep_len;
+        }
+        sz  += lean_string_size(s) - 1;
+        len += lean_string_len(s);
+    }
+    object * r = lean_alloc_string(sz + 1, sz + 1, len);
+    char * p   = w_string_cstr(r);
+    for (b_obj_arg it = l; !lean_is_scalar(it); it = lean_ctor_get(it, 1)) {
+        object * s = lean_ctor_get(it, 0);
+        if (it != l) {
+            memcpy(p, lean_string_cstr(sep), sep_sz);
+            p += sep_sz;
+        }
+        size_t s_sz = lean_string_size(s) - 1;
+        memcpy(p, lean_string_cstr(s), s_sz);
+        p += s_sz;
+    }
+    *p = 0;
+    return r;
+}
+
+extern "C" LEAN_EXPORT object * lean_string_join(b_obj_arg l) {
+    return string_intercalate_core(nullptr, l);
+}
+
+extern "C" LEAN_EXPORT object * lean_string_intercalate(b_obj_arg sep, b_obj_arg l) {
+    return string_intercalate_core(sep, l);
+}
+
 extern "C" LEAN_EXPORT bool lean_string_eq_cold(b_lean_obj_arg s1, b_lean_obj_arg s2) {
     return std::memcmp(lean_string_cstr(s1), lean_string_cstr(s2), lean_string_size(s1)) == 0;
 }
@@ -1969,9 +3105,122 @@ extern "C" LEAN_EXPORT obj_res lean_string_utf8_extract(b_obj_arg s, b_obj_arg b
     if (e < sz && !is_utf8_first_byte(str[e])) e = sz;
     usize new_sz = e - b;
     lean_assert(new_sz > 0);
+    if (new_sz == sz) {
+        /* The whole string is extracted, and strings are immutable unless exclusive, so share it. */
+        lean_inc_ref(s);
+        return s;
+    }
     return lean_mk_string_from_bytes(lean_string_cstr(s) + b, new_sz);
 }
 
+/* Return the first occurrence of `pat[0, m)` in `str[0, n)`, or `nullptr`. Candidates are found with `memchr`, which
+   is vectorized by the C library.
+   \pre m > 0 */
+static char const * find_bytes(char const * str, size_t n, char const * pat, size_t m) {
+    if (m > n)
+        return nullptr;
+    char const * end = str + (n - m + 1);
+    while (str < end) {
+        char const * p = static_cast<char const *>(memchr(str, pat[0], end - str));
+        if (!p)
+            return nullptr;
+        if (memcmp(p + 1, pat + 1, m - 1) == 0)
+            return p;
+        str = p + 1;
+    }
+    return nullptr;
+}
+
+/* Native version of `String.posOfAux`, which steps through `[pos, stopPos)` using `get` and `next`. Since strings
+   are valid UTF-8, the encoding of `c` can only occur at character boundaries, so we search for it as a byte
+   sequence. Recall that at positions inside of a character or past the end of the string, `get` returns the default
+   character and `next` adds 1. */
+extern "C" LEAN_EXPORT obj_res lean_string_pos_of_aux(b_obj_arg s, uint32 c, b_obj_arg stop0, b_obj_arg pos0) {
+    if (!lean_is_scalar(pos0) || (lean_is_scalar(stop0) && lean_unbox(pos0) >= lean_unbox(stop0))) {
+        lean_inc(pos0);
+        return pos0;
+    }
+    /* See comment at string_utf8_get */
+    usize stop = lean_is_scalar(stop0) ? lean_unbox(stop0) : static_cast<usize>(-1);
+    usize i    = lean_unbox(pos0);
+    char const * str = lean_string_cstr(s);
+    usize size = lean_string_size(s) - 1;
+    bool is_default = c == lean_char_default_value();
+    while (i < stop && i < size && !is_utf8_first_byte(str[i])) {
+        if (is_default) return lean_box(i);
+        i++;
+    }
+    if (i < stop && i < size) {
+        char enc[4];
+        unsigned n = push_unicode_scalar(enc, c);
+        /* a character starting before `stop` may end after it */
+        usize lim = std::min(size, std::min(stop, size) + n - 1);
+        char const * p = find_bytes(str + i, lim - i, enc, n);
+        if (p && static_cast<usize>(p - str) < stop)
+            return lean_box(p - str);
+        if (stop <= size) {
+            /* not found, the iteration ends at the first character boundary at or after `stop` */
+            i = stop;
+            while (i < size && !is_utf8_first_byte(str[i]))
+                i++;
+            return lean_box(i);
+        }
+        i = size;
+    }
+    if (i >= stop || is_default)
+        return lean_box(i);
+    lean_inc(stop0);
+    return stop0;
+}
+
+static inline bool is_ascii_id_rest(unsigned char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') ||
+        c == '_' || c == '\'' || c == '!' || c == '?';
+}
+
+/* Native version of `Lean.skipAsciiIdRest`. Continuation bytes are skipped as well: the reference implementation
+   reads `default = 'A'` at a position inside a character and then advances by one byte. */
+extern "C" LEAN_EXPORT obj_res lean_string_skip_ascii_id_rest(b_obj_arg s, b_obj_arg pos0) {
+    if (!lean_is_scalar(pos0)) {
+        lean_inc(pos0);
+        return pos0;
+    }
+    usize i    = lean_unbox(pos0);
+    unsigned char const * str = reinterpret_cast<unsigned char const *>(lean_string_cstr(s));
+    usize size = lean_string_size(s) - 1;
+    while (i < size && (is_ascii_id_rest(str[i]) || !is_utf8_first_byte(str[i])))
+        i++;
+    return lean_box(i);
+}
+
+/* Native version of `String.replace`. The reference implementation tests for an occurrence of `pattern` at every
+   character boundary from left to right, skipping over the occurrences it replaces. As `pattern` is valid UTF-8,
+   it can only occur at character boundaries, so this is the same as repeatedly searching for its bytes. */
+extern "C" LEAN_EXPORT obj_res lean_string_replace(b_obj_arg s, b_obj_arg pattern, b_obj_arg replacement) {
+    size_t m = lean_string_size(pattern) - 1;
+    char const * str = lean_string_cstr(s);
+    size_t n = lean_string_size(s) - 1;
+    char const * p = m == 0 ? nullptr : find_bytes(str, n, lean_string_cstr(pattern), m);
+    if (!p) {
+        lean_inc_ref(s);
+        return s;
+    }
+    char const * end = str + n;
+    size_t rsz = lean_string_size(replacement) - 1;
+    size_t num_matches = 0;
+    std::string r;
+    do {
+        r.append(str, p);
+        r.append(lean_string_cstr(replacement), rsz);
+        num_matches++;
+        str = p + m;
+        p = find_bytes(str, end - str, lean_string_cstr(pattern), m);
+    } while (p);
+    r.append(str, end);
+    size_t len = lean_string_len(s) - num_matches * lean_string_len(pattern) + num_matches * lean_string_len(replacement);
+    return lean_mk_string_core(r.data(), r.size(), len);
+}
+
 extern "C" LEAN_EXPORT obj_res lean_string_utf8_prev(b_obj_arg s, b_obj_arg i0) {
     if (!lean_is_scalar(i0)) {
         /* See comment at string_utf8_get */
@@ -2033,6 +3282,39 @@ extern "C" LEAN_EXPORT obj_res lean_string_of_usize(size_t n) {
     return mk_ascii_string(std::to_string(n));
 }
 
+/* Native version of `Nat.reprBig`. GMP converts big numbers in subquadratic time. */
+extern "C" LEAN_EXPORT obj_res lean_nat_big_repr(b_obj_arg n) {
+    if (lean_is_scalar(n))
+        return lean_string_of_usize(lean_unbox(n));
+    return mk_ascii_string(mpz_value(n).to_string());
+}
+
+/* Native version of `String.decToNat`, which computes `n*10 + (c.toNat - '0'.toNat)` for each character `c`. */
+extern "C" LEAN_EXPORT obj_res lean_string_dec_to_nat(b_obj_arg s) {
+    char const * str = lean_string_cstr(s);
+    size_t sz        = lean_string_size(s) - 1;
+    bool all_digits  = true;
+    for (size_t i = 0; i < sz && all_digits; i++)
+        all_digits = '0' <= str[i] && str[i] <= '9';
+    if (all_digits) {
+        if (sz <= 18) {
+            uint64 r = 0;
+            for (size_t i = 0; i < sz; i++)
+                r = r * 10 + (str[i] - '0');
+            return lean_uint64_to_nat(r);
+        }
+        return lean_cstr_to_nat(str);
+    }
+    mpz r;
+    for (size_t i = 0; i < sz; ) {
+        unsigned c = next_utf8(str, sz, i);
+        r *= 10u;
+        if (c > '0')
+            r += c - '0';
+    }
+    return mpz_to_nat(std::move(r));
+}
+
 // =======================================
 // ByteArray & FloatArray
 
@@ -2139,7 +3421,44 @@ extern "C" LEAN_EXPORT obj_res lean_byte_array_push(obj_arg a, uint8 b) {
 }
 
 extern "C" LEAN_EXPORT uint64_t lean_byte_array_hash(b_obj_arg a) {
-    return hash_str(lean_sarray_size(a), lean_sarray_cptr(a), 11);
+    return hash_bytes(lean_sarray_size(a), lean_sarray_cptr(a), 11);
+}
+
+extern "C" LEAN_EXPORT uint8 lean_byte_array_beq(b_obj_arg a, b_obj_arg b) {
+    size_t sz = lean_sarray_size(a);
+    return sz == lean_sarray_size(b) && memcmp(lean_sarray_cptr(a), lean_sarray_cptr(b), sz) == 0;
+}
+
+/* Lexicographic order, the result is an `Ordering`. */
+extern "C" LEAN_EXPORT uint8 lean_byte_array_compare(b_obj_arg a, b_obj_arg b) {
+    size_t sz1 = lean_sarray_size(a);
+    size_t sz2 = lean_sarray_size(b);
+    int c = memcmp(lean_sarray_cptr(a), lean_sarray_cptr(b), std::min(sz1, sz2));
+    if (c == 0)
+        c = sz1 < sz2 ? -1 : (sz1 > sz2 ? 1 : 0);
+    return c < 0 ? 0 : (c == 0 ? 1 : 2);
+}
+
+extern "C" LEAN_EXPORT obj_res lean_byte_array_index_of(b_obj_arg a, uint8 b, b_obj_arg start) {
+    size_t sz = lean_sarray_size(a);
+    if (!lean_is_scalar(start) || lean_unbox(start) >= sz)
+        return mk_option_none();
+    uint8 const * data = lean_sarray_cptr(a);
+    void const * p = memchr(data + lean_unbox(start), b, sz - lean_unbox(start));
+    return p ? mk_option_some(lean_box(static_cast<uint8 const *>(p) - data)) : mk_option_none();
+}
+
+extern "C" LEAN_EXPORT obj_res lean_byte_array_find(b_obj_arg a, b_obj_arg pat, b_obj_arg start) {
+    size_t sz = lean_sarray_size(a);
+    if (!lean_is_scalar(start) || lean_unbox(start) > sz)
+        return mk_option_none();
+    size_t i = lean_unbox(start);
+    size_t m = lean_sarray_size(pat);
+    if (m == 0)
+        return mk_option_some(lean_box(i));
+    char const * data = reinterpret_cast<char const *>(lean_sarray_cptr(a));
+    char const * p    = find_bytes(data + i, sz - i, reinterpret_cast<char const *>(lean_sarray_cptr(pat)), m);
+    return p ? mk_option_some(lean_box(p - data)) : mk_option_none();
 }
 
 extern "C" LEAN_EXPORT obj_res lean_copy_float_array(obj_arg a) {
@@ -2181,6 +3500,216 @@ extern "C" LEAN_EXPORT obj_res lean_float_array_push(obj_arg a, double d) {
     return r;
 }
 
+/* `UInt16Array`, `UInt32Array`, `UInt64Array`, and `USizeArray`, which are stored like `FloatArray`. */
+
+template<typename T, typename F> static obj_res sarray_mk(obj_arg a, F const & unbox) {
+    usize sz      = lean_array_size(a);
+    obj_res r     = lean_alloc_sarray(sizeof(T), sz, sz);
+    object ** it  = lean_array_cptr(a);
+    T * dest      = reinterpret_cast<T *>(lean_sarray_cptr(r));
+    for (usize i = 0; i < sz; i++)
+        dest[i] = unbox(it[i]);
+    lean_dec(a);
+    return r;
+}
+
+template<typename T, typename F> static obj_res sarray_data(obj_arg a, F const & box) {
+    usize sz       = lean_sarray_size(a);
+    obj_res r      = lean_alloc_array(sz, sz);
+    T const * it   = reinterpret_cast<T const *>(lean_sarray_cptr(a));
+    object ** dest = lean_array_cptr(r);
+    for (usize i = 0; i < sz; i++)
+        dest[i] = box(it[i]);
+    lean_dec(a);
+    return r;
+}
+
+template<typename T> static obj_res sarray_push(obj_arg a, T v) {
+    object * r = lean_sarray_ensure_exclusive(lean_sarray_ensure_capacity(a, lean_sarray_size(a) + 1, /* exact */ false));
+    size_t & sz  = lean_to_sarray(r)->m_size;
+    reinterpret_cast<T *>(lean_sarray_cptr(r))[sz] = v;
+    sz++;
+    return r;
+}
+
+extern "C" LEAN_EXPORT obj_res lean_copy_uint16_array(obj_arg a) {
+    return lean_copy_sarray(a, lean_sarray_capacity(a));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint16_array_mk(obj_arg a) {
+    return sarray_mk<uint16_t>(a, [](b_obj_arg v) { return static_cast<uint16_t>(lean_unbox(v)); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint16_array_data(obj_arg a) {
+    return sarray_data<uint16_t>(a, [](uint16_t v) { return lean_box(v); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint16_array_push(obj_arg a, uint16_t v) {
+    return sarray_push<uint16_t>(a, v);
+}
+
+extern "C" LEAN_EXPORT obj_res lean_copy_uint32_array(obj_arg a) {
+    return lean_copy_sarray(a, lean_sarray_capacity(a));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint32_array_mk(obj_arg a) {
+    return sarray_mk<uint32_t>(a, [](b_obj_arg v) { return static_cast<uint32_t>(lean_unbox_uint32(v)); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint32_array_data(obj_arg a) {
+    return sarray_data<uint32_t>(a, [](uint32_t v) { return lean_box_uint32(v); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint32_array_push(obj_arg a, uint32_t v) {
+    return sarray_push<uint32_t>(a, v);
+}
+
+extern "C" LEAN_EXPORT obj_res lean_copy_uint64_array(obj_arg a) {
+    return lean_copy_sarray(a, lean_sarray_capacity(a));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint64_array_mk(obj_arg a) {
+    return sarray_mk<uint64_t>(a, [](b_obj_arg v) { return static_cast<uint64_t>(lean_unbox_uint64(v)); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint64_array_data(obj_arg a) {
+    return sarray_data<uint64_t>(a, [](uint64_t v) { return lean_box_uint64(v); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_uint64_array_push(obj_arg a, uint64_t v) {
+    return sarray_push<uint64_t>(a, v);
+}
+
+extern "C" LEAN_EXPORT obj_res lean_copy_usize_array(obj_arg a) {
+    return lean_copy_sarray(a, lean_sarray_capacity(a));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_usize_array_mk(obj_arg a) {
+    return sarray_mk<size_t>(a, [](b_obj_arg v) { return static_cast<size_t>(lean_unbox_usize(v)); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_usize_array_data(obj_arg a) {
+    return sarray_data<size_t>(a, [](size_t v) { return lean_box_usize(v); });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_usize_array_push(obj_arg a, size_t v) {
+    return sarray_push<size_t>(a, v);
+}
+
+/* Bulk `FloatArray` operations. The loops are simple enough for the compiler to vectorize them. Reductions that add up
+   elements use `LEAN_FLOAT_ARRAY_LANES` independent partial sums, in the order of their reference implementations, so
+   that they can be vectorized without changing the result. */
+
+#define LEAN_FLOAT_ARRAY_LANES 4
+
+static inline double * float_array_cptr(b_obj_arg a) {
+    return reinterpret_cast<double *>(lean_sarray_cptr(a));
+}
+
+/* Return an array of `n <= lean_sarray_size(a)` elements for the result of an elementwise operation on `a`, which is
+   `a` itself if it is exclusive. */
+static inline obj_res float_array_result(b_obj_arg a, size_t n) {
+    if (lean_is_exclusive(a)) {
+        lean_to_sarray(a)->m_size = n;
+        return a;
+    } else {
+        return lean_alloc_sarray(sizeof(double), n, n); // NOLINT
+    }
+}
+
+template<typename F> static obj_res float_array_zip_with(obj_arg a, b_obj_arg b, F const & f) {
+    size_t n        = std::min(lean_sarray_size(a), lean_sarray_size(b));
+    double const * x = float_array_cptr(a);
+    double const * y = float_array_cptr(b);
+    object * r      = float_array_result(a, n);
+    double * z      = float_array_cptr(r);
+    for (size_t i = 0; i < n; i++)
+        z[i] = f(x[i], y[i]);
+    if (r != a) lean_dec_ref(a);
+    return r;
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_add(obj_arg a, b_obj_arg b) {
+    return float_array_zip_with(a, b, [](double x, double y) { return x + y; });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_sub(obj_arg a, b_obj_arg b) {
+    return float_array_zip_with(a, b, [](double x, double y) { return x - y; });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_mul(obj_arg a, b_obj_arg b) {
+    return float_array_zip_with(a, b, [](double x, double y) { return x * y; });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_mul_add(obj_arg a, b_obj_arg b, b_obj_arg c) {
+    size_t n         = std::min(lean_sarray_size(a), std::min(lean_sarray_size(b), lean_sarray_size(c)));
+    double const * x = float_array_cptr(a);
+    double const * y = float_array_cptr(b);
+    double const * w = float_array_cptr(c);
+    object * r       = float_array_result(a, n);
+    double * z       = float_array_cptr(r);
+    for (size_t i = 0; i < n; i++)
+        z[i] = x[i] * y[i] + w[i];
+    if (r != a) lean_dec_ref(a);
+    return r;
+}
+
+template<typename F> static double float_array_sum_of(size_t n, F const & f) {
+    double s[LEAN_FLOAT_ARRAY_LANES] = {};
+    size_t i = 0;
+    for (; i + LEAN_FLOAT_ARRAY_LANES <= n; i += LEAN_FLOAT_ARRAY_LANES) {
+        for (unsigned j = 0; j < LEAN_FLOAT_ARRAY_LANES; j++)
+            s[j] += f(i + j);
+    }
+    for (unsigned j = 0; i < n; i++, j++)
+        s[j] += f(i);
+    return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+extern "C" LEAN_EXPORT double lean_float_array_sum(b_obj_arg a) {
+    double const * x = float_array_cptr(a);
+    return float_array_sum_of(lean_sarray_size(a), [&](size_t i) { return x[i]; });
+}
+
+extern "C" LEAN_EXPORT double lean_float_array_dot(b_obj_arg a, b_obj_arg b) {
+    double const * x = float_array_cptr(a);
+    double const * y = float_array_cptr(b);
+    return float_array_sum_of(std::min(lean_sarray_size(a), lean_sarray_size(b)),
+                              [&](size_t i) { return x[i] * y[i]; });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_min(b_obj_arg a) {
+    size_t n = lean_sarray_size(a);
+    if (n == 0)
+        return mk_option_none();
+    double const * x = float_array_cptr(a);
+    double m = x[0];
+    for (size_t i = 1; i < n; i++)
+        m = x[i] < m ? x[i] : m;
+    return mk_option_some(lean_box_float(m));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_max(b_obj_arg a) {
+    size_t n = lean_sarray_size(a);
+    if (n == 0)
+        return mk_option_none();
+    double const * x = float_array_cptr(a);
+    double m = x[0];
+    for (size_t i = 1; i < n; i++)
+        m = m < x[i] ? x[i] : m;
+    return mk_option_some(lean_box_float(m));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_extract(b_obj_arg a, b_obj_arg b, b_obj_arg e) {
+    size_t sz    = lean_sarray_size(a);
+    size_t end   = lean_is_scalar(e) ? std::min<size_t>(lean_unbox(e), sz) : sz;
+    size_t begin = lean_is_scalar(b) ? std::min<size_t>(lean_unbox(b), end) : end;
+    size_t n     = end - begin;
+    object * r   = lean_alloc_sarray(sizeof(double), n, n); // NOLINT
+    memcpy(float_array_cptr(r), float_array_cptr(a) + begin, n * sizeof(double));
+    return r;
+}
+
 // =======================================
 // Array functions for generated code
 
@@ -2208,12 +3737,39 @@ extern "C" LEAN_EXPORT object * lean_mk_array(obj_arg n, obj_arg v) {
     return r;
 }
 
+/* Return true if an array of `byte_sz` bytes lives in a block allocated with `malloc`, see `lean_alloc_object`. */
+static inline bool lean_array_is_malloced(size_t byte_sz) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    return byte_sz > LEAN_MAX_SMALL_OBJECT_SIZE;
+#else
+    (void)byte_sz;
+    return true;
+#endif
+}
+
+/* Set the capacity of the exclusive array `a` to `cap` using `realloc`, which may extend the block in place and
+   otherwise moves the elements without touching their reference counts.
+   \pre lean_is_exclusive(a) && lean_array_is_malloced(lean_array_byte_size(a)) && cap >= lean_array_capacity(a) */
+static object * lean_realloc_array(object * a, size_t cap) {
+    if (LEAN_UNLIKELY(get_heap_profile_interval() != 0))
+        heap_profile_forget(a);
+    size_t old_byte_sz = lean_array_byte_size(a);
+    size_t new_byte_sz = sizeof(lean_array_object) + sizeof(void*)*cap;
+    void * r = realloc(a, new_byte_sz);
+    if (r == nullptr) lean_internal_panic_out_of_memory();
+    account_realloc(old_byte_sz, new_byte_sz);
+    lean_to_array(static_cast<object *>(r))->m_capacity = cap;
+    return static_cast<object *>(r);
+}
+
 extern "C" LEAN_EXPORT obj_res lean_copy_expand_array(obj_arg a, bool expand) {
     size_t sz      = lean_array_size(a);
     size_t cap     = lean_array_capacity(a);
     lean_assert(cap >= sz);
     if (expand) cap = (cap + 1) * 2;
     lean_assert(!expand || cap > sz);
+    if (expand && lean_is_exclusive(a) && lean_array_is_malloced(lean_array_byte_size(a)))
+        return lean_realloc_array(a, cap);
     object * r     = lean_alloc_array(sz, cap);
     object ** it   = lean_array_cptr(a);
     object ** end  = it + sz;
@@ -2250,6 +3806,36 @@ extern "C" LEAN_EXPORT object * lean_array_push(obj_arg a, obj_arg v) {
     return r;
 }
 
+extern "C" LEAN_EXPORT object * lean_array_reserve(obj_arg a, b_obj_arg n) {
+    if (!lean_is_scalar(n)) lean_internal_panic_out_of_memory();
+    size_t sz  = lean_array_size(a);
+    size_t cap = sz + lean_unbox(n);
+    if (cap < sz) lean_internal_panic_out_of_memory();
+    if (lean_array_capacity(a) >= cap)
+        return a;
+    if (lean_is_exclusive(a)) {
+        size_t byte_sz = lean_array_byte_size(a);
+        if (lean_array_is_malloced(byte_sz)) {
+            return lean_realloc_array(a, cap);
+        } else {
+            object * r = lean_alloc_array(sz, cap);
+            memcpy(lean_array_cptr(r), lean_array_cptr(a), sz * sizeof(object *));
+            lean_dealloc(a, byte_sz);
+            return r;
+        }
+    } else {
+        object * r = lean_alloc_array(sz, cap);
+        object ** src = lean_array_cptr(a);
+        object ** dest = lean_array_cptr(r);
+        for (size_t i = 0; i < sz; i++) {
+            dest[i] = src[i];
+            lean_inc(src[i]);
+        }
+        lean_dec(a);
+        return r;
+    }
+}
+
 // =======================================
 // Name primitives
 
@@ -2268,7 +3854,7 @@ extern "C" LEAN_EXPORT uint8 lean_name_eq(b_lean_obj_arg n1, b_lean_obj_arg n2)
             if (!lean_string_eq(lean_ctor_get(n1, 1), lean_ctor_get(n2, 1)))
                 return false;
         } else {
-            if (!lean_nat_eq(lean_ctor_get(n1, 1), lean_ctor_get(n1, 1)))
+            if (!lean_nat_eq(lean_ctor_get(n1, 1), lean_ctor_get(n2, 1)))
                 return false;
         }
         n1 = lean_ctor_get(n1, 0);
@@ -2345,13 +3931,23 @@ extern "C" LEAN_EXPORT lean_external_class * lean_register_external_class(lean_e
 void initialize_object() {
     g_ext_classes       = new std::vector<external_object_class*>();
     g_ext_classes_mutex = new mutex();
+#if defined(LEAN_MMAP)
+    g_mmap_sarrays_mutex = new mutex();
+    g_mmap_sarrays       = new std::unordered_map<object *, mmap_sarray_region>();
+#endif
     g_array_empty       = lean_alloc_array(0, 0);
     mark_persistent(g_array_empty);
+    g_thunk_wait_stripes = new thunk_wait_stripe[LEAN_THUNK_WAIT_STRIPES];
 }
 
 void finalize_object() {
     for (external_object_class * cls : *g_ext_classes) delete cls;
     delete g_ext_classes;
     delete g_ext_classes_mutex;
+    delete[] g_thunk_wait_stripes;
+#if defined(LEAN_MMAP)
+    delete g_mmap_sarrays;
+    delete g_mmap_sarrays_mutex;
+#endif
 }
 }
@@ -28,6 +28,7 @@ struct mpz_object {
     mpz         m_value;
     mpz_object() {}
     explicit mpz_object(mpz const & m):m_value(m) {}
+    explicit mpz_object(mpz && m):m_value(std::move(m)) {}
 };
 
 typedef lean_external_class         external_object_class;
@@ -56,6 +57,16 @@ inline void inc(object * o, size_t n) { lean_inc_n(o, n); }
 inline void dec(object * o) { lean_dec(o); }
 inline void free_heap_obj(object * o) { lean_free_object(o); }
 
+/** \brief When `n > 0`, multi-threaded object graphs of more than `n` objects are freed
+    partially by a low-priority background task instead of by the thread releasing them.
+    The default is `0`, i.e., objects are always freed eagerly. */
+LEAN_EXPORT void set_deferred_free_threshold(size_t n);
+
+/** \brief Set the stack size in bytes of the threads running dedicated tasks (priority `Task.Priority.dedicated`).
+    Dedicated tasks are often long-running or deeply recursive, while standard workers run many short tasks.
+    The default is `0`, i.e., the stack size of the standard workers. */
+LEAN_EXPORT void set_dedicated_task_stack_size(size_t sz);
+
 inline bool is_cnstr(object * o) { return lean_is_ctor(o); }
 inline bool is_closure(object * o) { return lean_is_closure(o); }
 inline bool is_array(object * o) { return lean_is_array(o); }
@@ -178,6 +189,7 @@ inline object* apply_m(object* f, unsigned n, object** args) { return lean_apply
 // MPZ
 
 LEAN_EXPORT object * alloc_mpz(mpz const &);
+LEAN_EXPORT object * alloc_mpz(mpz &&);
 inline mpz_object * to_mpz(object * o) { lean_assert(is_mpz(o)); return (mpz_object*)o; }
 
 // =======================================
@@ -225,6 +237,9 @@ inline uint8 * sarray_cptr(object * o) { return lean_sarray_cptr(o); }
 inline obj_res byte_array_mk(obj_arg a) { return lean_byte_array_mk(a); }
 inline obj_res byte_array_data(obj_arg a) { return lean_byte_array_data(a); }
 inline obj_res copy_byte_array(obj_arg a) { return lean_copy_byte_array(a); }
+/* Return a `ByteArray` of the given size whose data is a private (copy-on-write) mapping of the file `fd`,
+   or `nullptr` if that is not possible. The array is unmapped when it is freed. */
+LEAN_EXPORT obj_res mmap_byte_array(int fd, size_t size);
 inline obj_res mk_empty_byte_array(b_obj_arg capacity) { return lean_mk_empty_byte_array(capacity); }
 inline obj_res byte_array_size(b_obj_arg a) { return lean_byte_array_size(a); }
 inline uint8 byte_array_get(b_obj_arg a, b_obj_arg i) { return lean_byte_array_get(a, i); }
@@ -270,13 +285,19 @@ inline obj_res mk_thunk(obj_arg c) { return lean_mk_thunk(c); }
 inline obj_res thunk_pure(obj_arg v) { return lean_thunk_pure(v); }
 inline b_obj_res thunk_get(b_obj_arg t) { return lean_thunk_get(t); }
 inline obj_res thunk_get_own(b_obj_arg t) { return lean_thunk_get_own(t); }
+/* Store the number of times a thread forced a thunk that was being evaluated by another thread, and the number of
+   them that had to block until the value was available. */
+extern "C" LEAN_EXPORT void lean_get_thunk_wait_stats(uint64 * num_waits, uint64 * num_blocks);
 
 // =======================================
 // Tasks
 
+/* Return true if tasks are run by the task manager (i.e., promises and asynchronous tasks are available). */
+LEAN_EXPORT bool has_task_manager();
+
 class LEAN_EXPORT scoped_task_manager {
 public:
-    scoped_task_manager(unsigned num_workers);
+    scoped_task_manager(unsigned num_workers, unsigned max_extra_workers = LEAN_DEFAULT_MAX_EXTRA_WORKERS);
     ~scoped_task_manager();
 };
 
@@ -309,6 +330,7 @@ inline obj_res mk_option_some(obj_arg v) { obj_res r = alloc_cnstr(1, 1, 0); cns
 
 inline mpz const & mpz_value(b_obj_arg o) { return to_mpz(o)->m_value; }
 LEAN_EXPORT object * mpz_to_nat_core(mpz const & m);
+LEAN_EXPORT object * mpz_to_nat_core(mpz && m);
 inline object * mk_nat_obj_core(mpz const & m) { return mpz_to_nat_core(m); }
 inline obj_res mk_nat_obj(mpz const & m) {
     if (m.is_size_t() && m.get_size_t() <= LEAN_MAX_SMALL_NAT)
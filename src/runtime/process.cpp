@@ -24,7 +24,23 @@ Author: Jared Roesch
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <spawn.h>
+#include <poll.h>
+#include <sys/syscall.h>
 #include <limits.h> // NOLINT
+#include <vector>
+#include <unordered_set>
+#ifdef __APPLE__
+#include <crt_externs.h>
+#define LEAN_ENVIRON (*_NSGetEnviron())
+#else
+extern char ** environ;
+#define LEAN_ENVIRON environ
+#endif
+// `posix_spawn_file_actions_addchdir_np` is available since glibc 2.29
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define LEAN_POSIX_SPAWN_CHDIR
+#endif
 #endif
 
 #include "runtime/object.h"
@@ -34,9 +50,19 @@ Author: Jared Roesch
 #include "runtime/option_ref.h"
 #include "runtime/pair_ref.h"
 #include "runtime/buffer.h"
+#include "runtime/thread.h"
+#include "runtime/process.h"
 
 namespace lean {
 
+extern "C" obj_res lean_io_promise_new(obj_arg);
+extern "C" obj_res lean_io_promise_resolve(obj_arg value, b_obj_arg promise, obj_arg);
+extern "C" obj_res lean_io_promise_result(obj_arg promise);
+extern "C" obj_res lean_io_prim_handle_read(b_obj_arg h, usize nbytes, obj_arg);
+extern "C" obj_res lean_io_prim_handle_read_async(b_obj_arg h, usize nbytes, obj_arg);
+extern "C" obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg child, obj_arg);
+extern "C" obj_res lean_io_as_task(obj_arg act, obj_arg prio, obj_arg);
+
 enum stdio {
     PIPED,
     INHERIT,
@@ -264,6 +290,29 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_child_take_stdin(b_obj_arg, obj_a
     return lean_io_result_mk_ok(r.steal());
 }
 
+static obj_res child_wait_fn(obj_arg child, obj_arg w) {
+    obj_res r = lean_io_process_child_wait(box(0), child, w);
+    lean_dec(child);
+    return io_result_mk_ok(io_result_to_except(r));
+}
+
+/* Child.waitAsync {cfg : @& StdioConfig} : @& Child cfg → BaseIO (Task (Except IO.Error UInt32))
+   On Windows, the child process is waited for by a dedicated thread. */
+extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait_async(b_obj_arg, b_obj_arg child, obj_arg w) {
+    lean_inc(child);
+    object * c = lean_alloc_closure(reinterpret_cast<void *>(child_wait_fn), 2, 1);
+    lean_closure_set(c, 0, child);
+    // `Task.Priority.dedicated`
+    return lean_io_as_task(c, box(9), w);
+}
+
+/* readPipeAsync : (@& Handle) → USize → BaseIO (Task (Except IO.Error ByteArray)) */
+extern "C" LEAN_EXPORT obj_res lean_io_process_read_pipe_async(b_obj_arg h, usize nbytes, obj_arg w) {
+    return lean_io_prim_handle_read_async(h, nbytes, w);
+}
+
+void finalize_child_io() {}
+
 void initialize_process() {
     g_win_handle_external_class = lean_register_external_class(win_handle_finalizer, win_handle_foreach);
 }
@@ -293,6 +342,16 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_get_pid(obj_arg) {
     return lean_io_result_mk_ok(box_uint32(getpid()));
 }
 
+static unsigned decode_exit_status(int status) {
+    if (WIFEXITED(status)) {
+        return static_cast<unsigned>(WEXITSTATUS(status));
+    } else {
+        lean_assert(WIFSIGNALED(status));
+        // use bash's convention
+        return 128 + static_cast<unsigned>(WTERMSIG(status));
+    }
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg child, obj_arg) {
     static_assert(sizeof(pid_t) == sizeof(uint32), "pid_t is expected to be a 32-bit type"); // NOLINT
     pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
@@ -300,13 +359,7 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg c
     if (waitpid(pid, &status, 0) == -1) {
         return io_result_mk_error(decode_io_error(errno, nullptr));
     }
-    if (WIFEXITED(status)) {
-        return lean_io_result_mk_ok(box_uint32(static_cast<unsigned>(WEXITSTATUS(status))));
-    } else {
-        lean_assert(WIFSIGNALED(status));
-        // use bash's convention
-        return lean_io_result_mk_ok(box_uint32(128 + static_cast<unsigned>(WTERMSIG(status))));
-    }
+    return lean_io_result_mk_ok(box_uint32(decode_exit_status(status)));
 }
 
 extern "C" LEAN_EXPORT obj_res lean_io_process_child_kill(b_obj_arg, b_obj_arg child, obj_arg) {
@@ -345,14 +398,113 @@ static optional<pipe> setup_stdio(stdio cfg) {
     lean_unreachable();
 }
 
-static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
-  stdio stderr_mode, option_ref<string_ref> const & cwd, array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env,
-  bool do_setsid) {
-    /* Setup stdio based on process configuration. */
-    auto stdin_pipe  = setup_stdio(stdin_mode);
-    auto stdout_pipe = setup_stdio(stdout_mode);
-    auto stderr_pipe = setup_stdio(stderr_mode);
+static void close_pipe(optional<pipe> const & p) {
+    if (p) {
+        close(p->m_read_fd);
+        close(p->m_write_fd);
+    }
+}
+
+/* Return true if the child process can be created by `posix_spawn_child`, which avoids copying the address space
+   of the current process. Note that `posix_spawnp` searches the executable in the `PATH` of the current process. */
+static bool can_posix_spawn(string_ref const & proc_name, option_ref<string_ref> const & cwd,
+                            array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env, bool do_setsid) {
+#ifndef LEAN_POSIX_SPAWN_CHDIR
+    if (cwd) return false;
+#endif
+#ifndef POSIX_SPAWN_SETSID
+    if (do_setsid) return false;
+#endif
+    if (strchr(proc_name.data(), '/') == nullptr) {
+        for (auto & entry : env) {
+            if (strcmp(entry.fst().data(), "PATH") == 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+/* The environment of the current process updated with `env`. When a variable occurs several times in `env`,
+   the last occurrence wins, as with successive calls to `setenv`/`unsetenv`. */
+static std::vector<std::string> mk_child_env(array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env) {
+    std::unordered_set<std::string> keys;
+    std::vector<std::string> r;
+    for (size_t i = env.size(); i > 0; i--) {
+        auto const & entry = env[i - 1];
+        if (keys.insert(entry.fst().data()).second && entry.snd())
+            r.push_back(std::string(entry.fst().data()) + "=" + entry.snd().get()->data());
+    }
+    for (char ** e = LEAN_ENVIRON; *e; e++) {
+        char const * eq = strchr(*e, '=');
+        if (!keys.count(eq ? std::string(*e, eq - *e) : std::string(*e)))
+            r.push_back(*e);
+    }
+    return r;
+}
+
+static pid_t posix_spawn_child(string_ref const & proc_name, array_ref<string_ref> const & args,
+                               optional<pipe> const & stdin_pipe, optional<pipe> const & stdout_pipe, optional<pipe> const & stderr_pipe,
+                               stdio stdin_mode, stdio stdout_mode, stdio stderr_mode, option_ref<string_ref> const & cwd,
+                               array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env, bool do_setsid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    if (int err = posix_spawn_file_actions_init(&actions)) throw err;
+    if (int err = posix_spawnattr_init(&attr)) {
+        posix_spawn_file_actions_destroy(&actions);
+        throw err;
+    }
+    int err = 0;
+    auto setup = [&](optional<pipe> const & p, stdio mode, int fd, bool in) {
+        if (err) return;
+        // the pipe file descriptors are closed on exec, except for the duplicated ones
+        if (p) {
+            err = posix_spawn_file_actions_adddup2(&actions, in ? p->m_read_fd : p->m_write_fd, fd);
+        } else if (mode == stdio::NUL) {
+            err = posix_spawn_file_actions_addopen(&actions, fd, "/dev/null", in ? O_RDONLY : O_WRONLY, 0);
+        }
+    };
+    setup(stdin_pipe,  stdin_mode,  STDIN_FILENO,  true);
+    setup(stdout_pipe, stdout_mode, STDOUT_FILENO, false);
+    setup(stderr_pipe, stderr_mode, STDERR_FILENO, false);
+#ifdef LEAN_POSIX_SPAWN_CHDIR
+    if (!err && cwd)
+        err = posix_spawn_file_actions_addchdir_np(&actions, cwd.get()->data());
+#endif
+#ifdef POSIX_SPAWN_SETSID
+    if (!err && do_setsid)
+        err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+#endif
+
+    std::vector<char *> pargs;
+    pargs.push_back(const_cast<char *>(proc_name.data()));
+    for (auto & arg : args)
+        pargs.push_back(const_cast<char *>(arg.data()));
+    pargs.push_back(nullptr);
+
+    std::vector<std::string> env_strs;
+    std::vector<char *> penv;
+    char ** envp = LEAN_ENVIRON;
+    if (env.size()) {
+        env_strs = mk_child_env(env);
+        for (std::string & e : env_strs)
+            penv.push_back(&e[0]);
+        penv.push_back(nullptr);
+        envp = penv.data();
+    }
+
+    pid_t pid = -1;
+    if (!err)
+        err = posix_spawnp(&pid, pargs[0], &actions, &attr, pargs.data(), envp);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err) throw err;
+    return pid;
+}
 
+static pid_t fork_child(string_ref const & proc_name, array_ref<string_ref> const & args,
+                        optional<pipe> const & stdin_pipe, optional<pipe> const & stdout_pipe, optional<pipe> const & stderr_pipe,
+                        stdio stdin_mode, stdio stdout_mode, stdio stderr_mode, option_ref<string_ref> const & cwd,
+                        array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env, bool do_setsid) {
     int pid = fork();
 
     if (pid == 0) {
@@ -412,6 +564,32 @@ static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const &
     } else if (pid == -1) {
         throw errno;
     }
+    return pid;
+}
+
+static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
+  stdio stderr_mode, option_ref<string_ref> const & cwd, array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env,
+  bool do_setsid) {
+    /* Setup stdio based on process configuration. */
+    auto stdin_pipe  = setup_stdio(stdin_mode);
+    auto stdout_pipe = setup_stdio(stdout_mode);
+    auto stderr_pipe = setup_stdio(stderr_mode);
+
+    pid_t pid;
+    try {
+        if (can_posix_spawn(proc_name, cwd, env, do_setsid)) {
+            pid = posix_spawn_child(proc_name, args, stdin_pipe, stdout_pipe, stderr_pipe,
+                                    stdin_mode, stdout_mode, stderr_mode, cwd, env, do_setsid);
+        } else {
+            pid = fork_child(proc_name, args, stdin_pipe, stdout_pipe, stderr_pipe,
+                             stdin_mode, stdout_mode, stderr_mode, cwd, env, do_setsid);
+        }
+    } catch (int) {
+        close_pipe(stdin_pipe);
+        close_pipe(stdout_pipe);
+        close_pipe(stderr_pipe);
+        throw;
+    }
 
     object * parent_stdin  = box(0);
     object * parent_stdout = box(0);
@@ -446,8 +624,271 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_child_take_stdin(b_obj_arg, obj_a
     return lean_io_result_mk_ok(r.steal());
 }
 
-void initialize_process() {}
-void finalize_process() {}
+// =======================================
+// Asynchronous child process I/O
+
+/* A single thread waits for data on child process pipes and for child processes to exit using `poll`, and resolves
+   the corresponding promises, so that no thread is blocked per pipe or child process. Child processes are
+   observed using a `pidfd` where available (Linux 5.3+), and by polling `waitpid` otherwise. */
+class child_io_reactor {
+    struct pending_read {
+        int      m_fd;
+        size_t   m_nbytes;
+        object * m_handle;
+        object * m_promise;
+    };
+    struct pending_wait {
+        pid_t    m_pid;
+        int      m_pidfd;
+        object * m_promise;
+    };
+    /* An operation that has finished, and whose promise must be resolved after releasing `m_mutex`. */
+    struct completion {
+        object * m_promise;
+        object * m_value;
+    };
+
+    mutex                        m_mutex;
+    std::vector<pending_read>    m_reads;
+    std::vector<pending_wait>    m_waits;
+    int                          m_wake_fds[2];
+    bool                         m_shutting_down{false};
+    std::unique_ptr<lthread>     m_thread;
+
+    static object * mk_except_ok(object * v) {
+        object * r = lean_alloc_ctor(1, 1, 0);
+        lean_ctor_set(r, 0, v);
+        return r;
+    }
+
+    static object * mk_except_error(int err) {
+        object * r = lean_alloc_ctor(0, 1, 0);
+        lean_ctor_set(r, 0, decode_io_error(err, nullptr));
+        return r;
+    }
+
+    void wake() {
+        char c = 0;
+        while (write(m_wake_fds[1], &c, 1) < 0 && errno == EINTR) {}
+    }
+
+    static bool read_pipe(pending_read const & r, std::vector<completion> & done) {
+        object * arr = lean_alloc_sarray(1, 0, r.m_nbytes);
+        ssize_t n = read(r.m_fd, lean_sarray_cptr(arr), r.m_nbytes);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            lean_dec_ref(arr);
+            return false;
+        }
+        if (n < 0) {
+            int err = errno;
+            lean_dec_ref(arr);
+            done.push_back(completion{r.m_promise, mk_except_error(err)});
+        } else {
+            lean_sarray_set_size(arr, n);
+            done.push_back(completion{r.m_promise, mk_except_ok(arr)});
+        }
+        lean_dec(r.m_handle);
+        return true;
+    }
+
+    static bool reap_child(pending_wait const & w, std::vector<completion> & done) {
+        int status;
+        pid_t r = waitpid(w.m_pid, &status, WNOHANG);
+        if (r == 0 || (r < 0 && errno == EINTR))
+            return false;
+        if (r < 0)
+            done.push_back(completion{w.m_promise, mk_except_error(errno)});
+        else
+            done.push_back(completion{w.m_promise, mk_except_ok(box_uint32(decode_exit_status(status)))});
+        if (w.m_pidfd >= 0)
+            close(w.m_pidfd);
+        return true;
+    }
+
+    void loop() {
+        std::vector<pollfd> fds;
+        std::vector<completion> done;
+        unique_lock<mutex> lock(m_mutex);
+        while (!m_shutting_down) {
+            fds.clear();
+            fds.push_back(pollfd{m_wake_fds[0], POLLIN, 0});
+            bool needs_timeout = false;
+            for (pending_read const & r : m_reads)
+                fds.push_back(pollfd{r.m_fd, POLLIN, 0});
+            for (pending_wait const & w : m_waits) {
+                if (w.m_pidfd >= 0)
+                    fds.push_back(pollfd{w.m_pidfd, POLLIN, 0});
+                else
+                    needs_timeout = true;
+            }
+            size_t num_reads = m_reads.size();
+            lock.unlock();
+            int r = poll(fds.data(), fds.size(), needs_timeout ? 10 : -1);
+            lock.lock();
+            if (r < 0 && errno != EINTR) {
+                // should not happen, avoid spinning
+                lock.unlock();
+                this_thread::sleep_for(chrono::milliseconds(10));
+                lock.lock();
+            }
+            if (fds[0].revents & POLLIN) {
+                char buf[64];
+                while (read(m_wake_fds[0], buf, sizeof(buf)) == sizeof(buf)) {}
+            }
+            /* Requests added while polling are at the end of `m_reads` and `m_waits`, and are not part of `fds`. */
+            size_t j = 0;
+            for (size_t i = 0; i < m_reads.size(); i++) {
+                bool ready = i < num_reads && fds[1 + i].revents != 0;
+                if (!(ready && read_pipe(m_reads[i], done)))
+                    m_reads[j++] = m_reads[i];
+            }
+            m_reads.resize(j);
+            j = 0;
+            for (size_t i = 0; i < m_waits.size(); i++) {
+                if (!reap_child(m_waits[i], done))
+                    m_waits[j++] = m_waits[i];
+            }
+            m_waits.resize(j);
+            if (!done.empty()) {
+                lock.unlock();
+                for (completion const & c : done) {
+                    lean_dec_ref(lean_io_promise_resolve(c.m_value, c.m_promise, io_mk_world()));
+                    lean_dec_ref(c.m_promise);
+                }
+                done.clear();
+                lock.lock();
+            }
+        }
+    }
+
+public:
+    child_io_reactor() {
+#ifdef __APPLE__
+        if (::pipe(m_wake_fds) == -1) { throw errno; }
+        ::fcntl(m_wake_fds[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(m_wake_fds[1], F_SETFD, FD_CLOEXEC);
+#else
+        if (::pipe2(m_wake_fds, O_CLOEXEC) == -1) { throw errno; }
+#endif
+        ::fcntl(m_wake_fds[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(m_wake_fds[1], F_SETFL, O_NONBLOCK);
+        m_thread.reset(new lthread([this]() { loop(); }));
+    }
+
+    /* Pending operations are abandoned, their promises are never resolved. */
+    ~child_io_reactor() {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_shutting_down = true;
+            wake();
+        }
+        m_thread->join();
+        for (pending_read const & r : m_reads) {
+            lean_dec(r.m_handle);
+            lean_dec_ref(r.m_promise);
+        }
+        for (pending_wait const & w : m_waits) {
+            if (w.m_pidfd >= 0)
+                close(w.m_pidfd);
+            lean_dec_ref(w.m_promise);
+        }
+        close(m_wake_fds[0]);
+        close(m_wake_fds[1]);
+    }
+
+    /* Takes ownership of `handle` and `promise`. */
+    void add_read(int fd, size_t nbytes, object * handle, object * promise) {
+        lock_guard<mutex> lock(m_mutex);
+        m_reads.push_back(pending_read{fd, nbytes, handle, promise});
+        wake();
+    }
+
+    /* Takes ownership of `promise`. */
+    void add_wait(pid_t pid, object * promise) {
+        int pidfd = -1;
+#ifdef SYS_pidfd_open
+        pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+        if (pidfd >= 0)
+            ::fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+#endif
+        lock_guard<mutex> lock(m_mutex);
+        m_waits.push_back(pending_wait{pid, pidfd, promise});
+        wake();
+    }
+};
+
+static mutex *            g_child_io_mutex   = nullptr;
+static child_io_reactor * g_child_io_reactor = nullptr;
+
+static child_io_reactor & get_child_io_reactor() {
+    lock_guard<mutex> lock(*g_child_io_mutex);
+    if (!g_child_io_reactor)
+        g_child_io_reactor = new child_io_reactor();
+    return *g_child_io_reactor;
+}
+
+void finalize_child_io() {
+    child_io_reactor * reactor;
+    {
+        lock_guard<mutex> lock(*g_child_io_mutex);
+        reactor = g_child_io_reactor;
+        g_child_io_reactor = nullptr;
+    }
+    delete reactor;
+}
+
+/* Without threads, the operations are executed synchronously. */
+static bool use_child_io_reactor() {
+#if defined(LEAN_MULTI_THREAD)
+    return has_task_manager();
+#else
+    return false;
+#endif
+}
+
+/* Create a new promise, and return it together with its task. */
+static object * mk_promise(object ** task) {
+    object * r = lean_io_promise_new(io_mk_world());
+    object * promise = lean_io_result_get_value(r);
+    lean_inc(promise);
+    lean_dec_ref(r);
+    lean_inc(promise);
+    *task = lean_io_promise_result(promise);
+    return promise;
+}
+
+/* Child.waitAsync {cfg : @& StdioConfig} : @& Child cfg → BaseIO (Task (Except IO.Error UInt32)) */
+extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait_async(b_obj_arg cfg, b_obj_arg child, obj_arg w) {
+    if (!use_child_io_reactor())
+        return io_result_mk_ok(lean_task_pure(io_result_to_except(lean_io_process_child_wait(cfg, child, w))));
+    pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
+    object * task;
+    object * promise = mk_promise(&task);
+    get_child_io_reactor().add_wait(pid, promise);
+    return io_result_mk_ok(task);
+}
+
+/* readPipeAsync : (@& Handle) → USize → BaseIO (Task (Except IO.Error ByteArray)) */
+extern "C" LEAN_EXPORT obj_res lean_io_process_read_pipe_async(b_obj_arg h, usize nbytes, obj_arg w) {
+    if (!use_child_io_reactor())
+        return io_result_mk_ok(lean_task_pure(io_result_to_except(lean_io_prim_handle_read(h, nbytes, w))));
+    int fd = fileno(static_cast<FILE *>(lean_get_external_data(h)));
+    object * task;
+    object * promise = mk_promise(&task);
+    // `h` is released by the reactor thread
+    lean_mark_mt(h);
+    lean_inc(h);
+    get_child_io_reactor().add_read(fd, nbytes, h, promise);
+    return io_result_mk_ok(task);
+}
+
+void initialize_process() {
+    g_child_io_mutex = new mutex();
+}
+
+void finalize_process() {
+    delete g_child_io_mutex;
+}
 
 #endif
 
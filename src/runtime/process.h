@@ -9,4 +9,6 @@ Authors: Sebastian Ullrich
 namespace lean {
 void initialize_process();
 void finalize_process();
+/* Stop the thread resolving `Child.waitAsync`/`readPipeAsync` promises. */
+void finalize_child_io();
 }
@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #include <vector>
 #include <cstring>
+#include <utility>
 #include "runtime/object.h"
 #include "runtime/hash.h"
 
@@ -33,7 +34,7 @@ extern "C" LEAN_EXPORT uint64_t lean_sharecommon_hash(b_obj_arg o) {
     // hash relevant parts of the header
     unsigned init = hash(lean_ptr_tag(o), lean_ptr_other(o));
     // hash body
-    return hash_str(sz - header_sz, reinterpret_cast<unsigned char const *>(o) + header_sz, init);
+    return hash_bytes(sz - header_sz, reinterpret_cast<unsigned char const *>(o) + header_sz, init);
 }
 
 static obj_res mk_pair(obj_arg a, obj_arg b) {
@@ -44,7 +45,8 @@ static obj_res mk_pair(obj_arg a, obj_arg b) {
     return r;
 }
 
-class sharecommon_state {
+/* State driven by the map and set operations of a `ShareCommon.StateFactory`. */
+class sharecommon_closure_state {
 protected:
     object * m_map_find;
     object * m_map_insert;
@@ -53,7 +55,7 @@ protected:
     object * m_map;
     object * m_set;
 public:
-    sharecommon_state(b_obj_arg tc, obj_arg s) {
+    sharecommon_closure_state(b_obj_arg tc, obj_arg s) {
         m_map_find   = lean_ctor_get(tc, 1);
         m_map_insert = lean_ctor_get(tc, 2);
         m_set_find   = lean_ctor_get(tc, 3);
@@ -64,7 +66,7 @@ public:
         lean_dec(s);
     }
 
-    ~sharecommon_state() {
+    ~sharecommon_closure_state() {
         lean_dec(m_map);
         lean_dec(m_set);
     }
@@ -76,9 +78,15 @@ public:
         return r;
     }
 
-    obj_res map_find(b_obj_arg k) {
+    /* Return the value of `k`, or `nullptr`. The map still has a reference to the result. */
+    object * map_find(b_obj_arg k) {
         lean_inc(m_map_find); lean_inc(m_map); lean_inc(k);
-        return lean_apply_2(m_map_find, m_map, k);
+        obj_res o = lean_apply_2(m_map_find, m_map, k);
+        if (o == lean_box(0))
+            return nullptr;
+        object * r = lean_ctor_get(o, 0);
+        lean_dec(o);
+        return r;
     }
 
     void map_insert(obj_arg k, obj_arg v) {
@@ -86,9 +94,15 @@ public:
         m_map = lean_apply_3(m_map_insert, m_map, k, v);
     }
 
-    obj_res set_find(b_obj_arg o) {
+    /* Return the element equal to `o`, or `nullptr`. The set still has a reference to the result. */
+    object * set_find(b_obj_arg o) {
         lean_inc(m_set_find); lean_inc(m_set); lean_inc(o);
-        return lean_apply_2(m_set_find, m_set, o);
+        obj_res r = lean_apply_2(m_set_find, m_set, o);
+        if (r == lean_box(0))
+            return nullptr;
+        object * e = lean_ctor_get(r, 0);
+        lean_dec(r);
+        return e;
     }
 
     void set_insert(obj_arg o) {
@@ -97,8 +111,108 @@ public:
     }
 };
 
+/* Open-addressing hash table with linear probing, owning a reference to each of its keys and values. Keys are compared
+   by pointer if `by_ptr`, and using `lean_sharecommon_eq` otherwise. */
+template<bool by_ptr>
+class sharecommon_table {
+    struct entry {
+        object * m_key{nullptr};
+        object * m_value{nullptr};
+        uint64   m_hash{0};
+    };
+    std::vector<entry> m_entries;
+    size_t             m_size{0};
+
+    static uint64 hash_key(b_obj_arg k) {
+        if (by_ptr) {
+            uint64 h = reinterpret_cast<size_t>(k);
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            return h ^ (h >> 33);
+        } else {
+            return lean_sharecommon_hash(k);
+        }
+    }
+
+    static bool eq_key(entry const & e, b_obj_arg k, uint64 h) {
+        return e.m_key == k || (!by_ptr && e.m_hash == h && lean_sharecommon_eq(e.m_key, k));
+    }
+
+    entry & find_entry(b_obj_arg k, uint64 h) {
+        size_t mask = m_entries.size() - 1;
+        size_t i = h & mask;
+        while (m_entries[i].m_key && !eq_key(m_entries[i], k, h))
+            i = (i + 1) & mask;
+        return m_entries[i];
+    }
+
+    void grow() {
+        std::vector<entry> old(m_entries.size() * 2);
+        old.swap(m_entries);
+        for (entry const & e : old) {
+            if (e.m_key) {
+                size_t mask = m_entries.size() - 1;
+                size_t i = e.m_hash & mask;
+                while (m_entries[i].m_key)
+                    i = (i + 1) & mask;
+                m_entries[i] = e;
+            }
+        }
+    }
+public:
+    sharecommon_table():m_entries(1024) {}
+    sharecommon_table(sharecommon_table const &) = delete;
+
+    ~sharecommon_table() {
+        for (entry const & e : m_entries) {
+            if (e.m_key) {
+                lean_dec(e.m_key);
+                lean_dec(e.m_value);
+            }
+        }
+    }
+
+    /* Return the value of `k`, or `nullptr`. */
+    object * find(b_obj_arg k) {
+        entry & e = find_entry(k, hash_key(k));
+        return e.m_key ? e.m_value : nullptr;
+    }
+
+    void insert(obj_arg k, obj_arg v) {
+        uint64 h  = hash_key(k);
+        entry * e = &find_entry(k, h);
+        if (e->m_key) {
+            lean_dec(k);
+            lean_dec(e->m_value);
+            e->m_value = v;
+            return;
+        }
+        if (2 * (m_size + 1) > m_entries.size()) {
+            grow();
+            e = &find_entry(k, h);
+        }
+        e->m_key   = k;
+        e->m_value = v;
+        e->m_hash  = h;
+        m_size++;
+    }
+};
+
+/* State of `lean_sharecommon_quick`, using native tables that are freed after maximizing sharing in a single object. */
+class sharecommon_native_state {
+    sharecommon_table<true>  m_map;
+    sharecommon_table<false> m_set;
+public:
+    obj_res pack(obj_arg a) { return a; }
+    object * map_find(b_obj_arg k) { return m_map.find(k); }
+    void map_insert(obj_arg k, obj_arg v) { m_map.insert(k, v); }
+    object * set_find(b_obj_arg o) { return m_set.find(o); }
+    void set_insert(obj_arg o) { lean_inc(o); m_set.insert(o, o); }
+};
+
+template<class state>
 class sharecommon_fn {
-    sharecommon_state         m_state;
+    state                     m_state;
     std::vector<lean_object*> m_children;
     std::vector<lean_object*> m_todo;
 
@@ -125,10 +239,7 @@ class sharecommon_fn {
         }
 
         // Check whether we have already maximized sharing for `a`
-        obj_res o = m_state.map_find(a);
-        if (o != lean_box(0)) {
-            obj_res r = lean_ctor_get(o, 0);
-            lean_dec(o);
+        if (object * r = m_state.map_find(a)) {
             // The map still has a reference to `r`
             m_children.push_back(r);
             // std::cout << "cached maximized " << r << "\n";
@@ -143,12 +254,10 @@ class sharecommon_fn {
         lean_assert(m_todo.size() > 0);
         lean_assert(m_todo.back() == a);
         m_todo.pop_back();
-        obj_res opt_new_r = m_state.set_find(new_a);
-        if (opt_new_r != lean_box(0)) {
+        if (object * r = m_state.set_find(new_a)) {
             lean_dec(new_a); // we already have a maximally shared term equivalent to `new_a`
-            new_a = lean_ctor_get(opt_new_r, 0);
+            new_a = r;
             lean_inc(new_a);
-            lean_dec(opt_new_r);
             lean_inc(a);
             m_state.map_insert(a, new_a);
             // std::cout << "already maximized " << new_a << "\n";
@@ -230,7 +339,8 @@ class sharecommon_fn {
     }
 
 public:
-    sharecommon_fn(b_obj_arg tc, obj_arg s):m_state(tc, s) {}
+    template<typename... Args>
+    sharecommon_fn(Args &&... args):m_state(std::forward<Args>(args)...) {}
 
     obj_res operator()(obj_arg a) {
         if (push_child(a)) {
@@ -254,11 +364,9 @@ public:
             }
         }
 
-        obj_res o = m_state.map_find(a);
-        lean_assert(o != lean_box(0));
-        obj_res r = lean_ctor_get(o, 0);
+        object * r = m_state.map_find(a);
+        lean_assert(r);
         lean_inc(r);
-        lean_dec(o);
         lean_dec(a);
         return m_state.pack(r);
     }
@@ -266,6 +374,12 @@ public:
 
 // def State.shareCommon {α} {σ : @& StateFactory} (s : State σ) (a : α) : α × State σ
 extern "C" LEAN_EXPORT obj_res lean_state_sharecommon(b_obj_arg tc, obj_arg s, obj_arg a) {
-    return sharecommon_fn(tc, s)(a);
+    return sharecommon_fn<sharecommon_closure_state>(tc, s)(a);
+}
+
+// def ShareCommon.shareCommon' (a : @& α) : α
+extern "C" LEAN_EXPORT obj_res lean_sharecommon_quick(b_obj_arg a) {
+    lean_inc(a);
+    return sharecommon_fn<sharecommon_native_state>()(a);
 }
 };
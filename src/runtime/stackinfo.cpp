@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #include <memory.h>
 #include <iostream>
+#include <exception>
 #include "runtime/thread.h"
 #include "runtime/exception.h"
 #include "runtime/stackinfo.h"
@@ -24,6 +25,22 @@ Author: Leonardo de Moura
 #include <emscripten/stack.h>
 #endif
 
+#if defined(__linux__) && !defined(LEAN_EMSCRIPTEN)
+#include <ucontext.h> // NOLINT
+#include <sys/mman.h> // NOLINT
+#include <unistd.h> // NOLINT
+#define LEAN_STACK_SEGMENTS
+#endif
+
+#ifndef LEAN_STACK_SEGMENT_SIZE
+#define LEAN_STACK_SEGMENT_SIZE 8*1024*1024 // 8Mb
+#endif
+
+#ifndef LEAN_STACK_SEGMENT_THRESHOLD
+// available stack below which `needs_stack_segment` holds, must be larger than `LEAN_STACK_BUFFER_SPACE`
+#define LEAN_STACK_SEGMENT_THRESHOLD 2*LEAN_STACK_BUFFER_SPACE
+#endif
+
 namespace lean {
 void throw_get_stack_size_failed() {
     throw exception("failed to retrieve thread stack size");
@@ -34,7 +51,7 @@ size_t get_stack_size(bool main) {
     if (main) {
         return LEAN_WIN_STACK_SIZE;
     } else {
-        return lthread::get_thread_stack_size();
+        return lthread::get_current_thread_stack_size();
     }
 }
 #elif defined (__APPLE__)
@@ -47,7 +64,7 @@ size_t get_stack_size(bool main) {
         }
         return curr.rlim_cur;
     } else {
-        return lthread::get_thread_stack_size();
+        return lthread::get_current_thread_stack_size();
     }
 }
 #elif defined(LEAN_EMSCRIPTEN)
@@ -55,7 +72,7 @@ size_t get_stack_size(bool main) {
     if (main) {
         return emscripten_stack_get_end() - emscripten_stack_get_base();
     } else {
-        return lthread::get_thread_stack_size();
+        return lthread::get_current_thread_stack_size();
     }
 }
 #else
@@ -68,7 +85,7 @@ size_t get_stack_size(bool main) {
         }
         return curr.rlim_cur;
     } else {
-        return lthread::get_thread_stack_size();
+        return lthread::get_current_thread_stack_size();
     }
 }
 #endif
@@ -118,5 +135,136 @@ void check_stack(char const * component_name) {
     if (curr_stack < g_stack_threshold)
         throw_stack_space_exception(component_name);
 }
+
+#ifdef LEAN_STACK_SEGMENTS
+static bool g_stack_segments = false;
+
+void set_stack_segments(bool enabled) {
+    g_stack_segments = enabled;
+}
+
+bool needs_stack_segment() {
+    if (!g_stack_segments)
+        return false;
+    if (!g_stack_info_init)
+        save_stack_info(false);
+    return get_available_stack_size() < LEAN_STACK_SEGMENT_THRESHOLD;
+}
+
+/* A stack segment, with a guard page below it. The last segment released by a thread is kept for reuse, since
+   a recursion close to the stack limit usually enters and leaves segments repeatedly. */
+LEAN_THREAD_PTR(char, g_free_stack_segment);
+
+static size_t stack_segment_guard_size() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+static void free_stack_segment(void * base) {
+    munmap(base, LEAN_STACK_SEGMENT_SIZE + stack_segment_guard_size());
+}
+
+LEAN_THREAD_VALUE(bool, g_stack_segment_finalizer, false);
+
+static void finalize_stack_segments(void *) {
+    if (g_free_stack_segment) {
+        free_stack_segment(g_free_stack_segment);
+        g_free_stack_segment = nullptr;
+    }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LEAN_NOINLINE __attribute__((noinline))
+#else
+#define LEAN_NOINLINE
+#endif
+
+/* Not inlined into `run_on_stack_segment`, where its locals would be live across `getcontext`/`swapcontext`
+   (`-Wclobbered`). */
+static LEAN_NOINLINE char * alloc_stack_segment() {
+    if (char * base = g_free_stack_segment) {
+        g_free_stack_segment = nullptr;
+        return base;
+    }
+    size_t guard = stack_segment_guard_size();
+    void * base = mmap(nullptr, LEAN_STACK_SEGMENT_SIZE + guard, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (base == MAP_FAILED)
+        return nullptr;
+    if (mprotect(base, guard, PROT_NONE) != 0) {
+        free_stack_segment(base);
+        return nullptr;
+    }
+    return static_cast<char *>(base);
+}
+
+static void release_stack_segment(char * base) {
+    if (g_free_stack_segment || in_thread_finalization()) {
+        free_stack_segment(base);
+        return;
+    }
+    if (!g_stack_segment_finalizer) {
+        register_thread_finalizer(finalize_stack_segments, nullptr);
+        g_stack_segment_finalizer = true;
+    }
+    g_free_stack_segment = base;
+}
+
+struct stack_segment_call {
+    std::function<void()> const * m_fn;
+    std::exception_ptr            m_ex;
+    ucontext_t                    m_caller;
+    ucontext_t                    m_callee;
+};
+
+LEAN_THREAD_PTR(stack_segment_call, g_stack_segment_call);
+
+static void stack_segment_main() {
+    stack_segment_call * call = g_stack_segment_call;
+    try {
+        (*call->m_fn)();
+    } catch (...) {
+        call->m_ex = std::current_exception();
+    }
+    // returning resumes `call->m_caller` through `uc_link`
+}
+
+void run_on_stack_segment(std::function<void()> const & fn) {
+    char * base = alloc_stack_segment();
+    if (!base)
+        return fn();
+    char * stack = base + stack_segment_guard_size();
+    stack_segment_call call;
+    call.m_fn = &fn;
+    getcontext(&call.m_callee);
+    call.m_callee.uc_stack.ss_sp   = stack;
+    call.m_callee.uc_stack.ss_size = LEAN_STACK_SEGMENT_SIZE;
+    call.m_callee.uc_link          = &call.m_caller;
+    makecontext(&call.m_callee, stack_segment_main, 0);
+    size_t stack_size      = g_stack_size;
+    size_t stack_base      = g_stack_base;
+    size_t stack_threshold = g_stack_threshold;
+    g_stack_size      = LEAN_STACK_SEGMENT_SIZE;
+    g_stack_base      = reinterpret_cast<size_t>(stack) + LEAN_STACK_SEGMENT_SIZE;
+    g_stack_threshold = reinterpret_cast<size_t>(stack) + LEAN_STACK_BUFFER_SPACE;
+    g_stack_segment_call = &call;
+    swapcontext(&call.m_caller, &call.m_callee);
+    g_stack_size      = stack_size;
+    g_stack_base      = stack_base;
+    g_stack_threshold = stack_threshold;
+    release_stack_segment(base);
+    if (call.m_ex)
+        std::rethrow_exception(call.m_ex);
+}
+#else
+void set_stack_segments(bool) {}
+
+bool needs_stack_segment() {
+    return false;
+}
+
+void run_on_stack_segment(std::function<void()> const & fn) {
+    fn();
+}
+#endif
 }
 #endif
@@ -6,7 +6,10 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <cstdlib>
+#include <functional>
+#include <utility>
 #include <lean/lean.h>
+#include "runtime/optional.h"
 
 namespace lean {
 #if defined(LEAN_USE_SPLIT_STACK)
@@ -16,6 +19,9 @@ inline size_t get_stack_size(bool ) { return 8192*1024; }
 inline void save_stack_info(bool = true) {}
 inline size_t get_used_stack_size() { return 0; }
 inline size_t get_available_stack_size() { return 8192*1024; }
+inline void set_stack_segments(bool) {}
+inline bool needs_stack_segment() { return false; }
+inline void run_on_stack_segment(std::function<void()> const & fn) { fn(); }
 #else
 LEAN_EXPORT size_t get_stack_size(bool main);
 LEAN_EXPORT void save_stack_info(bool main = true);
@@ -28,6 +34,28 @@ LEAN_EXPORT size_t get_available_stack_size();
    user which module is the potential offender.
 */
 LEAN_EXPORT void check_stack(char const * component_name);
+
+/**
+   \brief Enable stack segments, see `needs_stack_segment`. Only supported on Linux, a no-op elsewhere.
+*/
+LEAN_EXPORT void set_stack_segments(bool enabled);
+/**
+   \brief Return true if stack segments are enabled and the current stack is close to its limit.
+   Deeply recursive procedures can then continue on a fresh stack segment using `with_stack_segment`
+   instead of failing in `check_stack`.
+*/
+LEAN_EXPORT bool needs_stack_segment();
+/**
+   \brief Run `fn` on a fresh heap-allocated stack segment, and propagate the exception it throws, if any.
+*/
+LEAN_EXPORT void run_on_stack_segment(std::function<void()> const & fn);
 #endif
 
+template<typename R, typename F>
+R with_stack_segment(F && fn) {
+    optional<R> r;
+    run_on_stack_segment([&]() { r.emplace(fn()); });
+    return std::move(*r);
+}
+
 }
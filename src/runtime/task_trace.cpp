@@ -0,0 +1,202 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "runtime/thread.h"
+#include "runtime/task_trace.h"
+
+#ifndef LEAN_WINDOWS
+#include <dlfcn.h>
+#endif
+
+namespace lean {
+typedef chrono::steady_clock trace_clock;
+
+/* State of a task that has been seen by the tracer but not finished yet. */
+struct task_trace_state {
+    uint64_t              m_id;
+    unsigned              m_prio{0};
+    int64_t               m_ready{-1};
+    std::vector<uint64_t> m_deps;
+};
+
+/* A single execution of a task. A `bind` task is executed twice. */
+struct task_trace_slice {
+    uint64_t              m_id;
+    unsigned              m_prio;
+    unsigned              m_thread;
+    void *                m_fn;
+    int64_t               m_ready;
+    int64_t               m_start;
+    int64_t               m_stop;
+    std::vector<uint64_t> m_deps;
+};
+
+struct task_trace {
+    std::string                                                 m_fname;
+    trace_clock::time_point                                     m_start_time{trace_clock::now()};
+    mutex                                                       m_mutex;
+    uint64_t                                                    m_next_id{0};
+    unsigned                                                    m_next_thread{0};
+    std::unordered_map<lean_task_object *, task_trace_state>    m_tasks;
+    std::vector<task_trace_slice>                               m_slices;
+
+    int64_t now() const {
+        return chrono::duration_cast<chrono::microseconds>(trace_clock::now() - m_start_time).count();
+    }
+
+    task_trace_state & get(lean_task_object * t) {
+        auto it = m_tasks.find(t);
+        if (it != m_tasks.end())
+            return it->second;
+        task_trace_state & s = m_tasks[t];
+        s.m_id = m_next_id++;
+        return s;
+    }
+};
+
+static task_trace * g_task_trace = nullptr;
+
+/* Trace-local thread id and the start of the slice being executed by the current thread. */
+LEAN_THREAD_VALUE(int, g_trace_thread, -1);
+LEAN_THREAD_VALUE(int64_t, g_trace_slice_start, 0);
+LEAN_THREAD_VALUE(void *, g_trace_slice_fn, nullptr);
+
+void set_task_trace_file(std::string const & fname) {
+    if (!g_task_trace)
+        g_task_trace = new task_trace();
+    g_task_trace->m_fname = fname;
+}
+
+bool is_task_tracing() {
+    return g_task_trace != nullptr;
+}
+
+void trace_task_ready(lean_task_object * t, unsigned prio) {
+    if (!g_task_trace) return;
+    lock_guard<mutex> lock(g_task_trace->m_mutex);
+    task_trace_state & s = g_task_trace->get(t);
+    s.m_prio  = prio;
+    s.m_ready = g_task_trace->now();
+}
+
+void trace_task_dep(lean_task_object * t1, lean_task_object * t2) {
+    if (!g_task_trace) return;
+    lock_guard<mutex> lock(g_task_trace->m_mutex);
+    uint64_t id1 = g_task_trace->get(t1).m_id;
+    g_task_trace->get(t2).m_deps.push_back(id1);
+}
+
+void trace_task_start(lean_task_object *, void * fn) {
+    if (!g_task_trace) return;
+    lock_guard<mutex> lock(g_task_trace->m_mutex);
+    if (g_trace_thread < 0)
+        g_trace_thread = g_task_trace->m_next_thread++;
+    g_trace_slice_start = g_task_trace->now();
+    g_trace_slice_fn    = fn;
+}
+
+void trace_task_stop(lean_task_object * t, bool done) {
+    if (!g_task_trace) return;
+    lock_guard<mutex> lock(g_task_trace->m_mutex);
+    task_trace_state & s = g_task_trace->get(t);
+    int64_t start = g_trace_slice_start;
+    g_task_trace->m_slices.push_back(task_trace_slice{s.m_id, s.m_prio, static_cast<unsigned>(g_trace_thread),
+                g_trace_slice_fn, s.m_ready < 0 ? start : s.m_ready, start, g_task_trace->now(), s.m_deps});
+    if (done) {
+        g_task_trace->m_tasks.erase(t);
+    } else {
+        s.m_ready = -1;
+        s.m_deps.clear();
+    }
+}
+
+void trace_task_free(lean_task_object * t) {
+    if (!g_task_trace) return;
+    lock_guard<mutex> lock(g_task_trace->m_mutex);
+    g_task_trace->m_tasks.erase(t);
+}
+
+static std::string fn_name(void * fn) {
+#ifndef LEAN_WINDOWS
+    Dl_info info;
+    if (dladdr(fn, &info) && info.dli_sname)
+        return info.dli_sname;
+#endif
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%p", fn);
+    return buffer;
+}
+
+static void write_json_string(std::ostream & out, std::string const & s) {
+    out << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c == '\n') {
+            out << "\\n";
+        } else if (c == '\t') {
+            out << "\\t";
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void write_task_trace() {
+    if (!g_task_trace) return;
+    lock_guard<mutex> lock(g_task_trace->m_mutex);
+    std::ofstream out(g_task_trace->m_fname);
+    if (!out) {
+        std::cerr << "failed to write task trace to '" << g_task_trace->m_fname << "'\n";
+        return;
+    }
+    std::unordered_map<void *, std::string> names;
+    /* Last slice of each task, for drawing dependency arrows. */
+    std::unordered_map<uint64_t, task_trace_slice const *> last_slice;
+    for (task_trace_slice const & s : g_task_trace->m_slices)
+        last_slice[s.m_id] = &s;
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    uint64_t flow_id = 0;
+    auto sep = [&]() { if (!first) out << ",\n"; first = false; };
+    for (task_trace_slice const & s : g_task_trace->m_slices) {
+        auto it = names.find(s.m_fn);
+        if (it == names.end())
+            it = names.emplace(s.m_fn, fn_name(s.m_fn)).first;
+        sep();
+        out << "{\"ph\":\"X\",\"cat\":\"task\",\"pid\":0,\"tid\":" << s.m_thread << ",\"name\":";
+        write_json_string(out, it->second);
+        out << ",\"ts\":" << s.m_start << ",\"dur\":" << (s.m_stop - s.m_start)
+            << ",\"args\":{\"id\":" << s.m_id << ",\"prio\":" << s.m_prio
+            << ",\"wait_us\":" << (s.m_start - s.m_ready) << ",\"deps\":[";
+        for (size_t i = 0; i < s.m_deps.size(); i++)
+            out << (i > 0 ? "," : "") << s.m_deps[i];
+        out << "]}}";
+        /* Flow arrows from the end of each dependency to the start of this slice. */
+        for (uint64_t dep : s.m_deps) {
+            auto d = last_slice.find(dep);
+            if (d == last_slice.end()) continue;
+            flow_id++;
+            sep();
+            out << "{\"ph\":\"s\",\"cat\":\"dep\",\"name\":\"dep\",\"pid\":0,\"tid\":" << d->second->m_thread
+                << ",\"ts\":" << d->second->m_stop << ",\"id\":" << flow_id << "}";
+            sep();
+            out << "{\"ph\":\"f\",\"bp\":\"e\",\"cat\":\"dep\",\"name\":\"dep\",\"pid\":0,\"tid\":" << s.m_thread
+                << ",\"ts\":" << s.m_start << ",\"id\":" << flow_id << "}";
+        }
+    }
+    out << "\n]}\n";
+}
+}
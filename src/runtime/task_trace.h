@@ -0,0 +1,32 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <string>
+#include <lean/lean.h>
+
+namespace lean {
+/* Optional tracing of the task manager. When enabled, every execution of a task is recorded together with
+   the time it became ready, its priority, the thread executing it, the closure it runs, and the tasks it
+   waited on. The trace is written in the Chrome trace event format (readable by `chrome://tracing` and
+   Perfetto) when the task manager is finalized. */
+
+/* Enable tracing and write the trace to `fname`. Must be called before the task manager is initialized. */
+LEAN_EXPORT void set_task_trace_file(std::string const & fname);
+bool is_task_tracing();
+
+/* Hooks invoked by the task manager, they are no-ops unless tracing is enabled. */
+/* `t` has been queued (or otherwise scheduled for execution) with priority `prio`. */
+void trace_task_ready(lean_task_object * t, unsigned prio);
+/* `t2` waits for `t1`. */
+void trace_task_dep(lean_task_object * t1, lean_task_object * t2);
+/* The current thread starts running `fn` for task `t`. */
+void trace_task_start(lean_task_object * t, void * fn);
+/* The current thread stopped running `t`. If `done` is false, `t` is a `bind` task waiting for its nested task. */
+void trace_task_stop(lean_task_object * t, bool done);
+/* `t` is about to be freed. */
+void trace_task_free(lean_task_object * t);
+/* Write the trace file. */
+void write_task_trace();
+}
@@ -11,6 +11,8 @@ Author: Leonardo de Moura
 #include <windows.h>
 #else
 #include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 #include <lean/config.h>
 #include "runtime/thread.h"
@@ -23,6 +25,15 @@ Author: Leonardo de Moura
 #define LEAN_DEFAULT_THREAD_STACK_SIZE 8*1024*1024 // 8Mb
 #endif
 
+#ifndef LEAN_THREAD_STACK_CACHE_SIZE
+// maximal total size of the stacks of terminated threads kept for reuse
+#define LEAN_THREAD_STACK_CACHE_SIZE 64*1024*1024 // 64Mb
+#endif
+
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+#define LEAN_THREAD_STACK_POOL
+#endif
+
 namespace lean {
 static std::vector<std::function<void()>> * g_thread_local_reset_fns;
 
@@ -79,8 +90,14 @@ size_t lthread::get_thread_stack_size() {
     return m_thread_stack_size;
 }
 
-static runnable mk_thread_proc(runnable const & p, size_t max) {
-    return [=]() { set_max_heartbeat(max); p(); }; // NOLINT
+LEAN_THREAD_VALUE(size_t, g_current_thread_stack_size, 0);
+
+size_t lthread::get_current_thread_stack_size() {
+    return g_current_thread_stack_size ? g_current_thread_stack_size : m_thread_stack_size;
+}
+
+static runnable mk_thread_proc(runnable const & p, size_t max, size_t stack_size) {
+    return [=]() { g_current_thread_stack_size = stack_size; set_max_heartbeat(max); p(); }; // NOLINT
 }
 
 #if defined(LEAN_WINDOWS)
@@ -94,9 +111,9 @@ struct lthread::imp {
         return 0;
     }
 
-    imp(runnable const & p) {
-        runnable * f = new std::function<void()>(mk_thread_proc(p, get_max_heartbeat()));
-        m_thread = CreateThread(nullptr, m_thread_stack_size,
+    imp(runnable const & p, size_t stack_size) {
+        runnable * f = new std::function<void()>(mk_thread_proc(p, get_max_heartbeat(), stack_size));
+        m_thread = CreateThread(nullptr, stack_size,
                                 _main, f, 0, nullptr);
         if (m_thread == NULL) {
             throw exception("failed to create thread");
@@ -114,11 +131,116 @@ struct lthread::imp {
     }
 };
 #else
+#ifdef LEAN_THREAD_STACK_POOL
+/* Thread stacks, allocated with a guard page below them. The stacks of terminated threads are kept for reuse by
+   threads with the same stack size, which avoids mapping, protecting, and faulting in a fresh stack for every
+   short-lived thread such as the dedicated task workers. A stack is reused only after its thread has been joined;
+   threads that are never joined explicitly are joined after they signaled their termination. */
+struct thread_stack {
+    char * m_base; // start of the guard page
+    size_t m_size; // usable size, not including the guard page
+};
+
+class thread_stack_pool {
+    struct detached_thread {
+        pthread_t                     m_thread;
+        thread_stack                  m_stack;
+        std::shared_ptr<atomic<bool>> m_done;
+    };
+    mutex                        m_mutex;
+    std::vector<thread_stack>    m_free;
+    size_t                       m_free_size{0};
+    std::vector<detached_thread> m_detached;
+    size_t                       m_page_size;
+
+    void release_core(thread_stack const & s) {
+        if (m_free_size + s.m_size <= LEAN_THREAD_STACK_CACHE_SIZE) {
+            m_free.push_back(s);
+            m_free_size += s.m_size;
+        } else {
+            munmap(s.m_base, s.m_size + m_page_size);
+        }
+    }
+
+    void reap_detached() {
+        size_t j = 0;
+        for (size_t i = 0; i < m_detached.size(); i++) {
+            if (m_detached[i].m_done->load(memory_order_acquire)) {
+                // the thread is exiting, so this does not block for long
+                pthread_join(m_detached[i].m_thread, nullptr);
+                release_core(m_detached[i].m_stack);
+            } else {
+                m_detached[j++] = m_detached[i];
+            }
+        }
+        m_detached.resize(j);
+    }
+public:
+    thread_stack_pool():m_page_size(static_cast<size_t>(sysconf(_SC_PAGESIZE))) {}
+
+    bool alloc(size_t sz, thread_stack & r) {
+        sz = (sz + m_page_size - 1) / m_page_size * m_page_size;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            reap_detached();
+            for (size_t i = 0; i < m_free.size(); i++) {
+                if (m_free[i].m_size == sz) {
+                    r = m_free[i];
+                    m_free[i] = m_free.back();
+                    m_free.pop_back();
+                    m_free_size -= sz;
+                    return true;
+                }
+            }
+        }
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_STACK
+        flags |= MAP_STACK;
+#endif
+        void * base = mmap(nullptr, sz + m_page_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (base == MAP_FAILED)
+            return false;
+        if (mprotect(base, m_page_size, PROT_NONE) != 0) {
+            munmap(base, sz + m_page_size);
+            return false;
+        }
+        r.m_base = static_cast<char *>(base);
+        r.m_size = sz;
+        return true;
+    }
+
+    void * stack_addr(thread_stack const & s) const { return s.m_base + m_page_size; }
+
+    /* `s` is not used anymore, its thread has been joined. */
+    void release(thread_stack const & s) {
+        lock_guard<mutex> lock(m_mutex);
+        release_core(s);
+    }
+
+    /* Join `t` after it set `done`, and then release `s`. */
+    void release_detached(pthread_t t, thread_stack const & s, std::shared_ptr<atomic<bool>> const & done) {
+        lock_guard<mutex> lock(m_mutex);
+        m_detached.push_back(detached_thread{t, s, done});
+    }
+};
+
+static thread_stack_pool & get_thread_stack_pool() {
+    // never freed, since threads may still be terminating at exit
+    static thread_stack_pool * pool = new thread_stack_pool();
+    return *pool;
+}
+#endif
+
 /* OSX/Linux version based on pthreads */
 struct lthread::imp {
     pthread_attr_t            m_attr;
     pthread_t                 m_thread;
     bool                      m_joined = false;
+#ifdef LEAN_THREAD_STACK_POOL
+    thread_stack              m_stack;
+    /* Set by the thread right before it terminates, see `thread_stack_pool::release_detached`. */
+    std::shared_ptr<atomic<bool>> m_done;
+#endif
 
     static void * _main(void * p) {
         stack_guard guard;
@@ -126,20 +248,45 @@ struct lthread::imp {
         return nullptr;
     }
 
-    imp(runnable const & p) {
+    imp(runnable const & p, size_t stack_size) {
         pthread_attr_init(&m_attr);
-        if (pthread_attr_setstacksize(&m_attr, m_thread_stack_size)) {
+        runnable proc = mk_thread_proc(p, get_max_heartbeat(), stack_size);
+#ifdef LEAN_THREAD_STACK_POOL
+        if (!get_thread_stack_pool().alloc(stack_size, m_stack)) {
+            pthread_attr_destroy(&m_attr);
+            throw exception("failed to allocate thread stack");
+        }
+        if (pthread_attr_setstack(&m_attr, get_thread_stack_pool().stack_addr(m_stack), m_stack.m_size)) {
+            get_thread_stack_pool().release(m_stack);
+            pthread_attr_destroy(&m_attr);
             throw exception("failed to set thread stack size");
         }
-        runnable * f = new std::function<void()>(mk_thread_proc(p, get_max_heartbeat()));
+        std::shared_ptr<atomic<bool>> done = std::make_shared<atomic<bool>>(false);
+        m_done = done;
+        proc = [=]() { proc(); done->store(true, memory_order_release); }; // NOLINT
+#else
+        if (pthread_attr_setstacksize(&m_attr, stack_size)) {
+            throw exception("failed to set thread stack size");
+        }
+#endif
+        runnable * f = new std::function<void()>(proc);
         if (pthread_create(&m_thread, &m_attr, _main, f)) {
+            delete f;
+#ifdef LEAN_THREAD_STACK_POOL
+            get_thread_stack_pool().release(m_stack);
+#endif
+            pthread_attr_destroy(&m_attr);
             throw exception("failed to create thread");
         }
     }
 
     ~imp() {
         pthread_attr_destroy(&m_attr);
+#ifdef LEAN_THREAD_STACK_POOL
+        if (!m_joined) get_thread_stack_pool().release_detached(m_thread, m_stack, m_done);
+#else
         if (!m_joined) pthread_detach(m_thread);
+#endif
     }
 
     void join() {
@@ -147,10 +294,14 @@ struct lthread::imp {
         if (pthread_join(m_thread, nullptr)) {
             throw exception("failed to join thread");
         }
+#ifdef LEAN_THREAD_STACK_POOL
+        get_thread_stack_pool().release(m_stack);
+#endif
     }
 };
 #endif
-lthread::lthread(std::function<void(void)> const & p):m_imp(new imp(p)) {}
+lthread::lthread(std::function<void(void)> const & p, size_t stack_size):
+    m_imp(new imp(p, stack_size ? stack_size : m_thread_stack_size)) {}
 
 lthread::~lthread() {}
 
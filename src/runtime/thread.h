@@ -56,11 +56,15 @@ class LEAN_EXPORT lthread {
     struct imp;
     std::unique_ptr<imp> m_imp;
 public:
-    lthread(std::function<void(void)> const & p);
+    /** Run `p` in a new thread with a stack of `stack_size` bytes, or `get_thread_stack_size()` bytes if it is 0.
+        On POSIX systems, stacks are allocated with a guard page and reused after the thread terminated. */
+    lthread(std::function<void(void)> const & p, size_t stack_size = 0);
     ~lthread();
     void join();
     static void set_thread_stack_size(size_t sz);
     static size_t get_thread_stack_size();
+    /** Stack size of the current thread if it was created by `lthread`, and `get_thread_stack_size()` otherwise. */
+    static size_t get_current_thread_stack_size();
 };
 }
 
@@ -89,8 +93,8 @@ public:
     atomic & operator=(atomic const & v) { m_value = v.m_value; return *this; }
     atomic & operator=(atomic && v) { m_value = std::forward<T>(v.m_value); return *this; }
     operator T() const { return m_value; }
-    void store(T const & v) { m_value = v; }
-    T load() const { return m_value; }
+    void store(T const & v, int = 0) { m_value = v; }
+    T load(int = 0) const { return m_value; }
     atomic & operator|=(T const & v) { m_value |= v; return *this; }
     atomic & operator+=(T const & v) { m_value += v; return *this; }
     atomic & operator-=(T const & v) { m_value -= v; return *this; }
@@ -103,7 +107,7 @@ public:
     friend T atomic_fetch_add_explicit(atomic * a, T const & v, int ) { T r(a->m_value); a->m_value += v; return r; }
     friend T atomic_fetch_sub_explicit(atomic * a, T const & v, int ) { T r(a->m_value); a->m_value -= v; return r; }
     T exchange(T desired) { T old = m_value; m_value = desired; return old; }
-    bool compare_exchange_strong(T & expected, T desired) {
+    bool compare_exchange_strong(T & expected, T desired, int = 0, int = 0) {
         if (m_value == expected) {
             m_value = desired;
             return true;
@@ -112,6 +116,9 @@ public:
             return false;
         }
     }
+    bool compare_exchange_weak(T & expected, T desired, int = 0, int = 0) {
+        return compare_exchange_strong(expected, desired);
+    }
 };
 typedef atomic<unsigned short> atomic_ushort;
 typedef atomic<unsigned char>  atomic_uchar;
@@ -130,11 +137,12 @@ public:
 };
 class lthread {
 public:
-    lthread(std::function<void(void)> const & p) { p(); }
+    lthread(std::function<void(void)> const & p, size_t = 0) { p(); }
     ~lthread() {}
     void join() {}
     static void set_thread_stack_size(size_t) {}
     static size_t get_thread_stack_size() { return 0; }
+    static size_t get_current_thread_stack_size() { return 0; }
 };
 class this_thread {
 public:
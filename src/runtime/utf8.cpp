@@ -5,6 +5,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include "runtime/debug.h"
 #include "runtime/optional.h"
@@ -32,14 +33,22 @@ unsigned get_utf8_size(unsigned char c) {
         return 1; /* invalid */
 }
 
-extern "C" LEAN_EXPORT size_t lean_utf8_strlen(char const * str) {
-    size_t r = 0;
-    while (*str != 0) {
-        unsigned sz = get_utf8_size(*str);
-        r++;
-        str += sz;
+/* Return the length of the longest prefix of `str[0, size)` that consists of whole 8-byte words of ASCII characters.
+   ASCII runs make up most of the text we process (source files, JSON-RPC messages), and checking a word at a time
+   lets the loops below skip them without decoding each byte. */
+static inline size_t ascii_words_prefix(uint8_t const * str, size_t size) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, str + i, sizeof(uint64_t));
+        if (w & 0x8080808080808080ull)
+            break;
     }
-    return r;
+    return i;
+}
+
+extern "C" LEAN_EXPORT size_t lean_utf8_strlen(char const * str) {
+    return lean_utf8_n_strlen(str, strlen(str));
 }
 
 size_t utf8_strlen(char const * str) {
@@ -47,12 +56,19 @@ size_t utf8_strlen(char const * str) {
 }
 
 extern "C" LEAN_EXPORT size_t lean_utf8_n_strlen(char const * str, size_t sz) {
+    uint8_t const * ustr = reinterpret_cast<uint8_t const *>(str);
     size_t r = 0;
     size_t i = 0;
     while (i < sz) {
-        unsigned d = get_utf8_size(str[i]);
-        r++;
-        i += d;
+        unsigned char c = ustr[i];
+        if (c < 0x80) {
+            size_t n = 1 + ascii_words_prefix(ustr + i + 1, sz - i - 1);
+            r += n;
+            i += n;
+        } else {
+            r++;
+            i += get_utf8_size(c);
+        }
     }
     return r;
 }
@@ -227,6 +243,7 @@ bool validate_utf8(uint8_t const * str, size_t size) {
         if ((c & 0x80) == 0) {
             /* zero continuation (0 to 0x7F) */
             i++;
+            i += ascii_words_prefix(str + i, size - i);
         } else if ((c & 0xe0) == 0xc0) {
             /* one continuation (0x80 to 0x7FF) */
             if (i + 1 >= size) return false;
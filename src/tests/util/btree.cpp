@@ -0,0 +1,181 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+#include "util/rb_tree.h"
+#include "util/btree.h"
+using namespace lean;
+
+/* Randomized tests of `util/btree.h` against `std::map` and `rb_tree`. The keys are drawn from a small range so that
+   insertions of existing keys and erasures of missing ones are frequent, and the trees grow and shrink repeatedly,
+   which exercises node splits and, when erasing, merges and borrows from siblings. The test is also built with
+   `LEAN_BTREE_MIN_DEGREE=2`, where these operations happen on almost every update. */
+
+typedef std::pair<unsigned, unsigned> entry;
+typedef std::map<unsigned, unsigned>  model;
+
+struct entry_cmp {
+    int operator()(entry const & e1, entry const & e2) const { return unsigned_cmp()(e1.first, e2.first); }
+};
+
+typedef btree<entry, entry_cmp>   tree;
+typedef rb_tree<entry, entry_cmp> ref_tree;
+
+#define check(COND) {                                                     \
+    if (!(COND)) {                                                        \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #COND << "\n"; \
+        std::exit(1);                                                     \
+    }                                                                     \
+}
+
+static void check_same(tree const & t, model const & m) {
+    check(t.check_invariant());
+    check(t.size() == m.size());
+    check(t.empty() == m.empty());
+    auto it = m.begin();
+    t.for_each([&](entry const & e) {
+        check(it != m.end());
+        check(e.first == it->first && e.second == it->second);
+        ++it;
+    });
+    check(it == m.end());
+    if (!m.empty()) {
+        check(t.min()->first == m.begin()->first);
+        check(t.max()->first == m.rbegin()->first);
+    } else {
+        check(t.min() == nullptr && t.max() == nullptr);
+    }
+}
+
+static void check_same(tree const & t, ref_tree const & r) {
+    buffer<entry> b1, b2;
+    t.to_buffer(b1);
+    r.to_buffer(b2);
+    check(b1.size() == b2.size());
+    for (unsigned i = 0; i < b1.size(); i++)
+        check(b1[i] == b2[i]);
+}
+
+/* Perform `num_ops` random updates on a tree with keys in `[0, key_range)`. Phases of insertions alternate with phases
+   of erasures, so that the tree repeatedly grows by splitting its root and shrinks by merging it. */
+static void tst_random(unsigned seed, unsigned key_range, unsigned num_ops) {
+    std::mt19937 rng(seed);
+    tree t;
+    ref_tree r;
+    model m;
+    std::vector<std::pair<tree, model>> snapshots;
+    unsigned max_depth = 0;
+    unsigned min_depth_after_max = 0;
+    for (unsigned i = 0; i < num_ops; i++) {
+        bool growing = (i / (4 * key_range)) % 2 == 0;
+        unsigned k = rng() % key_range;
+        unsigned v = rng();
+        if (growing) {
+            t.insert(entry(k, v));
+            r.insert(entry(k, v));
+            m[k] = v;
+        } else {
+            t.erase(entry(k, 0));
+            r.erase(entry(k, 0));
+            m.erase(k);
+        }
+        check(t.check_invariant());
+        check(t.size() == m.size());
+        unsigned q = rng() % key_range;
+        entry const * e = t.find(entry(q, 0));
+        auto it = m.find(q);
+        check((e == nullptr) == (it == m.end()));
+        if (e)
+            check(e->second == it->second);
+        check(t.contains(entry(q, 0)) == r.contains(entry(q, 0)));
+        entry const * g = t.find_next_greater_or_equal(entry(q, 0));
+        auto lb = m.lower_bound(q);
+        check((g == nullptr) == (lb == m.end()));
+        if (g)
+            check(g->first == lb->first);
+        unsigned depth = t.get_depth();
+        if (depth > max_depth) {
+            max_depth = depth;
+            min_depth_after_max = depth;
+        } else if (depth < min_depth_after_max) {
+            min_depth_after_max = depth;
+        }
+        if (i % 97 == 0) {
+            check_same(t, m);
+            check_same(t, r);
+        }
+        if (i % 211 == 0)
+            snapshots.emplace_back(t, m);
+    }
+    check_same(t, m);
+    check_same(t, r);
+    // the root must have been split, and merged again
+    check(max_depth >= 2);
+    check(min_depth_after_max < max_depth);
+    // updates copy shared nodes, so older versions are unchanged
+    for (auto const & s : snapshots)
+        check_same(s.first, s.second);
+}
+
+/* Erase all keys of a large tree in random order, which ends with the tree being empty. */
+static void tst_erase_all(unsigned seed, unsigned n) {
+    std::mt19937 rng(seed);
+    std::vector<unsigned> keys;
+    tree t;
+    model m;
+    for (unsigned i = 0; i < n; i++) {
+        keys.push_back(i);
+        t.insert(entry(i, i));
+        m[i] = i;
+    }
+    check_same(t, m);
+    tree copy = t;
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (unsigned i = 0; i < keys.size(); i++) {
+        t.erase(entry(keys[i], 0));
+        m.erase(keys[i]);
+        check(t.check_invariant());
+        check(!t.contains(entry(keys[i], 0)));
+        if (i % 101 == 0)
+            check_same(t, m);
+    }
+    check(t.empty());
+    check(copy.size() == n);
+    check(copy.check_invariant());
+}
+
+/* Sequential insertions only ever split the rightmost nodes, and erasing the minimum repeatedly only borrows from
+   and merges with right siblings. */
+static void tst_sequential(unsigned n) {
+    tree t;
+    model m;
+    for (unsigned i = 0; i < n; i++) {
+        t.insert(entry(i, 2 * i));
+        m[i] = 2 * i;
+        check(t.check_invariant());
+    }
+    check_same(t, m);
+    while (!t.empty()) {
+        check(t.min()->first == m.begin()->first);
+        t.erase_min();
+        m.erase(m.begin());
+        check(t.check_invariant());
+    }
+    check(m.empty());
+}
+
+int main() {
+    tst_random(1, 64, 4000);
+    tst_random(2, 200, 20000);
+    tst_random(3, 2000, 100000);
+    tst_erase_all(4, 5000);
+    tst_sequential(3000);
+    return 0;
+}
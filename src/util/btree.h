@@ -0,0 +1,656 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include "runtime/optional.h"
+#include "runtime/debug.h"
+#include "runtime/buffer.h"
+#include "util/rc.h"
+
+#ifndef LEAN_BTREE_MIN_DEGREE
+// nodes other than the root have between `LEAN_BTREE_MIN_DEGREE - 1` and `2 * LEAN_BTREE_MIN_DEGREE - 1` values
+#define LEAN_BTREE_MIN_DEGREE 8
+#endif
+
+namespace lean {
+/**
+   \brief Persistent B-trees
+
+   Drop-in replacement for `rb_tree` with the same interface. Each node stores up to
+   `2 * LEAN_BTREE_MIN_DEGREE - 1` values contiguously, which makes lookups and traversals touch far fewer
+   cache lines than a binary tree with one node per value. It uses a O(1) copy operation. Different trees
+   can share nodes, and updates only copy the shared nodes on the path to the updated value.
+   The sharing is thread-safe.
+
+   \c CMP is a functional object for comparing values of type T, see `rb_tree`.
+*/
+template<typename T, typename CMP>
+class btree : private CMP {
+    static constexpr unsigned min_degree = LEAN_BTREE_MIN_DEGREE;
+    static constexpr unsigned max_values = 2 * min_degree - 1;
+    static_assert(min_degree >= 2, "B-tree nodes must have at least 2 children");
+
+    struct node_cell;
+    struct node {
+        node_cell * m_ptr;
+        node():m_ptr(nullptr) {}
+        node(node_cell * ptr):m_ptr(ptr) { if (m_ptr) ptr->inc_ref(); }
+        node(node const & s):m_ptr(s.m_ptr) { if (m_ptr) m_ptr->inc_ref(); }
+        node(node && s):m_ptr(s.m_ptr) { s.m_ptr = nullptr; }
+        ~node() { if (m_ptr) m_ptr->dec_ref(); }
+        node & operator=(node const & n) { LEAN_COPY_REF(n); }
+        node & operator=(node&& n) { LEAN_MOVE_REF(n); }
+        operator bool() const { return m_ptr != nullptr; }
+        bool is_shared() const { return m_ptr && m_ptr->get_rc() > 1; }
+        node_cell * operator->() const { lean_assert(m_ptr); return m_ptr; }
+        friend bool is_eqp(node const & n1, node const & n2) { return n1.m_ptr == n2.m_ptr; }
+        friend void swap(node & n1, node & n2) { std::swap(n1.m_ptr, n2.m_ptr); }
+        node steal() { node r; swap(r, *this); return r; }
+    };
+
+    struct node_cell {
+        unsigned m_size;
+        bool     m_leaf;
+        MK_LEAN_RC();
+        /* `m_size` values, and `m_size + 1` children if the node is not a leaf */
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type m_values[max_values];
+        node     m_children[max_values + 1];
+        void dealloc();
+        node_cell(bool leaf):m_size(0), m_leaf(leaf), m_rc(0) {}
+        node_cell(node_cell const & s):m_size(s.m_size), m_leaf(s.m_leaf), m_rc(0) {
+            for (unsigned i = 0; i < m_size; i++)
+                new (&m_values[i]) T(s.value(i));
+            if (!m_leaf) {
+                for (unsigned i = 0; i <= m_size; i++)
+                    m_children[i] = s.m_children[i];
+            }
+        }
+        ~node_cell() {
+            for (unsigned i = 0; i < m_size; i++)
+                value(i).~T();
+        }
+
+        T & value(unsigned i) { return *reinterpret_cast<T *>(&m_values[i]); }
+        T const & value(unsigned i) const { return *reinterpret_cast<T const *>(&m_values[i]); }
+        node_cell const * child(unsigned i) const { return m_leaf ? nullptr : m_children[i].m_ptr; }
+
+        /* Insert `v` at position `i`, shifting the following values. */
+        void insert_value(unsigned i, T const & v) {
+            lean_assert(m_size < max_values && i <= m_size);
+            if (i == m_size) {
+                new (&m_values[m_size]) T(v);
+            } else {
+                new (&m_values[m_size]) T(std::move(value(m_size - 1)));
+                for (unsigned j = m_size - 1; j > i; j--)
+                    value(j) = std::move(value(j - 1));
+                value(i) = v;
+            }
+            m_size++;
+        }
+
+        /* Insert child `c` at position `i`, must be called after the corresponding `insert_value`. */
+        void insert_child(unsigned i, node && c) {
+            lean_assert(i <= m_size);
+            for (unsigned j = m_size; j > i; j--)
+                m_children[j] = m_children[j - 1].steal();
+            m_children[i] = std::move(c);
+        }
+
+        void erase_value(unsigned i) {
+            lean_assert(i < m_size);
+            for (unsigned j = i; j + 1 < m_size; j++)
+                value(j) = std::move(value(j + 1));
+            m_size--;
+            value(m_size).~T();
+        }
+
+        /* Erase child `i`, must be called after the corresponding `erase_value`. */
+        node erase_child(unsigned i) {
+            lean_assert(i <= m_size + 1);
+            node r = m_children[i].steal();
+            for (unsigned j = i; j <= m_size; j++)
+                m_children[j] = m_children[j + 1].steal();
+            return r;
+        }
+    };
+
+    bool check_cmp_result(T const & DEBUG_CODE(v1), T const & DEBUG_CODE(v2)) const {
+        DEBUG_CODE(int n1 = CMP::operator()(v1, v2); int n2 = CMP::operator()(v2, v1););
+        lean_assert((n1 < 0  && n2 > 0) || (n1 == 0 && n2 == 0) || (n1 > 0  && n2 < 0));
+        return true;
+    }
+
+    int cmp(T const & v1, T const & v2) const {
+        lean_cond_assert("btree", check_cmp_result(v1, v2));
+        return CMP::operator()(v1, v2);
+    }
+
+    /* Return the position of the first value of `n` that is not less than `v`, and set `found` if it is equal to `v`.
+       For nodes of this size, a linear scan is faster than a binary search. */
+    unsigned lower_bound(node_cell const * n, T const & v, bool & found) const {
+        unsigned i = 0;
+        for (; i < n->m_size; i++) {
+            int c = cmp(v, n->value(i));
+            if (c <= 0) {
+                found = c == 0;
+                return i;
+            }
+        }
+        found = false;
+        return i;
+    }
+
+    static void ensure_unshared(node & n) {
+        if (n.is_shared())
+            n = node(new node_cell(*n.m_ptr));
+    }
+
+    /* Make child `i` of `h` unshared and return it. */
+    static node_cell * unshared_child(node_cell * h, unsigned i) {
+        ensure_unshared(h->m_children[i]);
+        return h->m_children[i].m_ptr;
+    }
+
+    /* Split the full child `i` of `h`, moving its median value to `h`. */
+    static void split_child(node_cell * h, unsigned i) {
+        node_cell * y = unshared_child(h, i);
+        lean_assert(y->m_size == max_values);
+        node z(new node_cell(y->m_leaf));
+        for (unsigned j = 0; j < min_degree - 1; j++)
+            z->insert_value(j, y->value(min_degree + j));
+        if (!y->m_leaf) {
+            for (unsigned j = 0; j < min_degree; j++)
+                z->m_children[j] = y->m_children[min_degree + j].steal();
+        }
+        h->insert_value(i, y->value(min_degree - 1));
+        h->insert_child(i + 1, std::move(z));
+        while (y->m_size > min_degree - 1)
+            y->erase_value(y->m_size - 1);
+    }
+
+    /* Merge child `i + 1` and value `i` of `h` into child `i`. */
+    static void merge_children(node_cell * h, unsigned i) {
+        node_cell * y = unshared_child(h, i);
+        node z = h->m_children[i + 1];
+        lean_assert(y->m_size + z->m_size < max_values);
+        y->insert_value(y->m_size, h->value(i));
+        unsigned off = y->m_size;
+        for (unsigned j = 0; j < z->m_size; j++)
+            y->insert_value(off + j, z->value(j));
+        if (!y->m_leaf) {
+            for (unsigned j = 0; j <= z->m_size; j++)
+                y->m_children[off + j] = z->m_children[j];
+        }
+        h->erase_value(i);
+        h->erase_child(i + 1);
+    }
+
+    /* Make sure child `i` of `h` has at least `min_degree` values before descending into it, by moving a value
+       from a sibling or merging it with one. Return the position of the child containing the values of child `i`. */
+    static unsigned fill_child(node_cell * h, unsigned i) {
+        if (h->m_children[i]->m_size >= min_degree)
+            return i;
+        if (i > 0 && h->m_children[i - 1]->m_size >= min_degree) {
+            // move the last value of the left sibling to `h`, and value `i - 1` of `h` to child `i`
+            node_cell * c = unshared_child(h, i);
+            node_cell * l = unshared_child(h, i - 1);
+            c->insert_value(0, h->value(i - 1));
+            if (!c->m_leaf)
+                c->insert_child(0, l->m_children[l->m_size].steal());
+            h->value(i - 1) = l->value(l->m_size - 1);
+            l->erase_value(l->m_size - 1);
+            return i;
+        } else if (i < h->m_size && h->m_children[i + 1]->m_size >= min_degree) {
+            // move the first value of the right sibling to `h`, and value `i` of `h` to child `i`
+            node_cell * c = unshared_child(h, i);
+            node_cell * r = unshared_child(h, i + 1);
+            c->insert_value(c->m_size, h->value(i));
+            if (!c->m_leaf)
+                c->m_children[c->m_size] = r->m_children[0].steal();
+            h->value(i) = r->value(0);
+            r->erase_value(0);
+            if (!r->m_leaf)
+                r->erase_child(0);
+            return i;
+        } else if (i < h->m_size) {
+            merge_children(h, i);
+            return i;
+        } else {
+            merge_children(h, i - 1);
+            return i - 1;
+        }
+    }
+
+    void insert(node_cell * h, T const & v) {
+        while (true) {
+            bool found;
+            unsigned i = lower_bound(h, v, found);
+            if (found) {
+                h->value(i) = v;
+                return;
+            }
+            if (h->m_leaf) {
+                h->insert_value(i, v);
+                return;
+            }
+            if (h->m_children[i]->m_size == max_values) {
+                split_child(h, i);
+                int c = cmp(v, h->value(i));
+                if (c == 0) {
+                    h->value(i) = v;
+                    return;
+                } else if (c > 0) {
+                    i++;
+                }
+            }
+            h = unshared_child(h, i);
+        }
+    }
+
+    /* Erase `v` from the subtree `h`, which has at least `min_degree` values unless it is the root. */
+    void erase(node_cell * h, T const & v) {
+        while (true) {
+            bool found;
+            unsigned i = lower_bound(h, v, found);
+            if (h->m_leaf) {
+                if (found)
+                    h->erase_value(i);
+                return;
+            }
+            if (found) {
+                if (h->m_children[i]->m_size >= min_degree) {
+                    node_cell * y = unshared_child(h, i);
+                    h->value(i) = *max(y);
+                    erase(y, h->value(i));
+                    return;
+                } else if (h->m_children[i + 1]->m_size >= min_degree) {
+                    node_cell * z = unshared_child(h, i + 1);
+                    h->value(i) = *min(z);
+                    erase(z, h->value(i));
+                    return;
+                } else {
+                    merge_children(h, i);
+                    h = unshared_child(h, i);
+                    continue;
+                }
+            }
+            i = fill_child(h, i);
+            h = unshared_child(h, i);
+        }
+    }
+
+    /* Remove the root if it became empty. */
+    void shrink_root() {
+        if (m_root && m_root->m_size == 0) {
+            if (m_root->m_leaf)
+                m_root = node();
+            else
+                m_root = m_root->m_children[0];
+        }
+    }
+
+    static T const * min(node_cell const * n) {
+        if (!n)
+            return nullptr;
+        while (!n->m_leaf)
+            n = n->m_children[0].m_ptr;
+        return &n->value(0);
+    }
+
+    static T const * max(node_cell const * n) {
+        if (!n)
+            return nullptr;
+        while (!n->m_leaf)
+            n = n->m_children[n->m_size].m_ptr;
+        return &n->value(n->m_size - 1);
+    }
+
+    template<typename F>
+    static void for_each(F && f, node_cell const * n) {
+        if (n) {
+            for (unsigned i = 0; i < n->m_size; i++) {
+                for_each(f, n->child(i));
+                f(n->value(i));
+            }
+            for_each(f, n->child(n->m_size));
+        }
+    }
+
+    template<typename F>
+    static optional<T> find_if(F && f, node_cell const * n) {
+        if (n) {
+            for (unsigned i = 0; i < n->m_size; i++) {
+                if (auto r = find_if(f, n->child(i)))
+                    return r;
+                if (f(n->value(i)))
+                    return optional<T>(n->value(i));
+            }
+            return find_if(f, n->child(n->m_size));
+        }
+        return optional<T>();
+    }
+
+    template<typename F>
+    static optional<T> back_find_if(F && f, node_cell const * n) {
+        if (n) {
+            for (unsigned i = n->m_size; i > 0; i--) {
+                if (auto r = back_find_if(f, n->child(i)))
+                    return r;
+                if (f(n->value(i - 1)))
+                    return optional<T>(n->value(i - 1));
+            }
+            return back_find_if(f, n->child(0));
+        }
+        return optional<T>();
+    }
+
+    template<typename F>
+    void for_each_greater(T const & v, F && f, node_cell const * n) const {
+        if (n) {
+            bool found;
+            unsigned i = lower_bound(n, v, found);
+            if (found) {
+                for_each(f, n->child(i + 1));
+                i++;
+            } else {
+                for_each_greater(v, f, n->child(i));
+            }
+            for (; i < n->m_size; i++) {
+                f(n->value(i));
+                for_each(f, n->child(i + 1));
+            }
+        }
+    }
+
+    T const * find_next_greater_or_equal(T const & v, node_cell const * n) const {
+        if (n) {
+            bool found;
+            unsigned i = lower_bound(n, v, found);
+            if (found)
+                return &n->value(i);
+            if (auto r = find_next_greater_or_equal(v, n->child(i)))
+                return r;
+            return i < n->m_size ? &n->value(i) : nullptr;
+        } else {
+            return nullptr;
+        }
+    }
+
+    static void display(std::ostream & out, node_cell const * n) {
+        if (n) {
+            out << "(";
+            for (unsigned i = 0; i < n->m_size; i++) {
+                if (!n->m_leaf) {
+                    display(out, n->child(i));
+                    out << " ";
+                }
+                out << n->value(i) << " ";
+            }
+            if (!n->m_leaf)
+                display(out, n->child(n->m_size));
+            out << ")";
+        } else {
+            out << "nil";
+        }
+    }
+
+    static unsigned get_depth(node_cell const * n) {
+        unsigned r = 0;
+        for (; n; n = n->child(0))
+            r++;
+        return r;
+    }
+
+    bool check_invariant(node_cell const * n, bool root, unsigned depth, optional<unsigned> & leaf_depth) const {
+        // We check:
+        //  1) the values are ordered, also with respect to the values of the children
+        //  2) all nodes but the root have at least `min_degree - 1` values
+        //  3) all leaves have the same depth
+        lean_assert(n->m_size <= max_values);
+        lean_assert(root || n->m_size >= min_degree - 1);
+        lean_assert(n->m_size > 0);
+        for (unsigned i = 0; i + 1 < n->m_size; i++)
+            lean_assert(cmp(n->value(i), n->value(i + 1)) < 0);
+        if (n->m_leaf) {
+            if (leaf_depth) {
+                lean_assert(depth == *leaf_depth);
+            } else {
+                leaf_depth = depth;
+            }
+        } else {
+            for (unsigned i = 0; i <= n->m_size; i++) {
+                node_cell const * c = n->child(i);
+                lean_assert(c);
+                check_invariant(c, false, depth + 1, leaf_depth);
+                lean_assert(i == 0 || cmp(n->value(i - 1), c->value(0)) < 0);
+                lean_assert(i == n->m_size || cmp(c->value(c->m_size - 1), n->value(i)) < 0);
+            }
+        }
+        return true;
+    }
+
+    node m_root;
+
+public:
+    btree(CMP const & cmp = CMP()):CMP(cmp) {}
+    btree(btree const & s):CMP(s), m_root(s.m_root) {}
+    btree(btree && s):CMP(s), m_root(s.m_root) {}
+    explicit btree(buffer<T> const & s) {
+        for (auto const & v : s)
+            insert(v);
+    }
+    explicit btree(T const & v) {
+        insert(v);
+    }
+
+    btree & operator=(btree const & s) { m_root = s.m_root; return *this; }
+    btree & operator=(btree && s) { m_root = s.m_root; return *this; }
+
+    CMP const & get_cmp() const { return *this; }
+
+    unsigned get_rc() const { return m_root ? m_root->get_rc() : 0; }
+
+    void insert(T const & v) {
+        lean_cond_assert("btree", check_invariant());
+        if (!m_root) {
+            m_root = node(new node_cell(true));
+        } else {
+            ensure_unshared(m_root);
+            if (m_root->m_size == max_values) {
+                node r(new node_cell(false));
+                r->m_children[0] = m_root.steal();
+                split_child(r.m_ptr, 0);
+                m_root = std::move(r);
+            }
+        }
+        insert(m_root.m_ptr, v);
+        lean_cond_assert("btree", check_invariant());
+    }
+
+    void erase_min() {
+        lean_assert(!empty());
+        T v = *min();
+        erase_core(v);
+    }
+
+    void erase_core(T const & v) {
+        lean_cond_assert("btree", check_invariant());
+        lean_assert(contains(v));
+        ensure_unshared(m_root);
+        erase(m_root.m_ptr, v);
+        shrink_root();
+        lean_cond_assert("btree", check_invariant());
+    }
+
+    void erase(T const & v) {
+        if (contains(v))
+            erase_core(v);
+    }
+
+    T const * find(T const & v) const {
+        node_cell const * h = m_root.m_ptr;
+        while (h) {
+            bool found;
+            unsigned i = lower_bound(h, v, found);
+            if (found)
+                return &h->value(i);
+            h = h->child(i);
+        }
+        return nullptr;
+    }
+
+    T const * min() const { return min(m_root.m_ptr); }
+    T const * max() const { return max(m_root.m_ptr); }
+    bool contains(T const & v) const { return find(v) != nullptr; }
+
+    template<typename F>
+    void for_each(F && f) const {
+        node r = m_root;
+        for_each(f, r.m_ptr);
+    }
+
+    template<typename F>
+    optional<T> find_if(F && f) const {
+        node r = m_root;
+        return find_if(f, r.m_ptr);
+    }
+
+    /* Similar to find_if, but searches keys backwards from greatest to least */
+    template<typename F>
+    optional<T> back_find_if(F && f) const {
+        node r = m_root;
+        return back_find_if(f, r.m_ptr);
+    }
+
+    template<typename F>
+    void for_each_greater(T const & v, F && f) const {
+        node r = m_root;
+        for_each_greater(v, f, r.m_ptr);
+    }
+
+    T const * find_next_greater_or_equal(T const & v) const {
+        return find_next_greater_or_equal(v, m_root.m_ptr);
+    }
+
+    // For debugging purposes
+    void display(std::ostream & out) const { display(out, m_root.m_ptr); }
+
+    unsigned get_depth() const { return get_depth(m_root.m_ptr); }
+
+    unsigned size() const {
+        unsigned r = 0;
+        for_each([&](T const & ){ r = r + 1; });
+        return r;
+    }
+
+    bool empty() const { return m_root.m_ptr == nullptr; }
+
+    void clear() { m_root = node(); }
+
+    friend std::ostream & operator<<(std::ostream & out, btree const & t) {
+        t.display(out);
+        return out;
+    }
+
+    bool check_invariant() const {
+        optional<unsigned> leaf_depth;
+        return !m_root || check_invariant(m_root.m_ptr, true, 0, leaf_depth);
+    }
+
+    /**
+        \brief Copy the contents of this tree to the given buffer.
+        The elements will be stored in increasing order.
+    */
+    void to_buffer(buffer<T> & r) const {
+        for_each([&](T const & v) { r.push_back(v); });
+    }
+
+    void merge(btree const & s) {
+        if (empty())
+            *this = s;
+        else if (!is_eqp(*this, s))
+            s.for_each([&](T const & v) { insert(v); });
+    }
+
+    bool is_superset(btree const & s) const {
+        return !s.find_if([&](T const & v) { return !contains(v); });
+    }
+
+    bool is_strict_superset(btree const & s) const {
+        if (!is_superset(s))
+            return false;
+        return !s.is_superset(*this);
+    }
+
+    void remove(btree const & s) {
+        s.for_each([&](T const & v) { erase(v); });
+    }
+
+    friend bool is_eqp(btree const & s1, btree const & s2) { return is_eqp(s1.m_root, s2.m_root); }
+
+    class iterator {
+        /* The nodes on the path to the next value, and the position of the next value in each of them. */
+        buffer<std::pair<node_cell const *, unsigned>> m_path;
+
+        void push_left(node_cell const * it) {
+            while (it) {
+                m_path.emplace_back(it, 0u);
+                it = it->child(0);
+            }
+        }
+
+    public:
+        iterator(btree const & t) {
+            push_left(t.m_root.m_ptr);
+        }
+
+        bool has_next() const { return !m_path.empty(); }
+
+        T const & next() {
+            lean_assert(has_next());
+            node_cell const * it = m_path.back().first;
+            unsigned i           = m_path.back().second++;
+            if (!it->m_leaf) {
+                // the values of child `i + 1` come next
+                push_left(it->child(i + 1));
+            } else {
+                while (!m_path.empty() && m_path.back().second == m_path.back().first->m_size)
+                    m_path.pop_back();
+            }
+            return it->value(i);
+        }
+    };
+
+    /* Return true iff this and other have the same set of elements with respect to CMP.
+       This method assumes the cmp for this and other are the same. */
+    bool equal_elems(btree const & other) const {
+        iterator it1(*this);
+        iterator it2(other);
+        while (it1.has_next() && it2.has_next()) {
+            if (cmp(it1.next(), it2.next()) != 0)
+                return false;
+        }
+        return !it1.has_next() && !it2.has_next();
+    }
+};
+
+template<typename T, typename CMP>
+bool operator==(btree<T, CMP> const & s1, btree<T, CMP> const & s2) {
+    return s1.is_superset(s2) && s2.is_superset(s1);
+}
+
+template<typename T, typename CMP>
+void btree<T, CMP>::node_cell::dealloc() {
+    delete this;
+}
+
+template<typename T, typename CMP>
+btree<T, CMP> insert(btree<T, CMP> const & t, T const & v) { btree<T, CMP> r(t); r.insert(v); return r; }
+template<typename T, typename CMP>
+btree<T, CMP> erase(btree<T, CMP> const & t, T const & v) { btree<T, CMP> r(t); r.erase(v); return r; }
+}
@@ -10,6 +10,8 @@ Author: Leonardo de Moura
 #include <algorithm>
 #include <sstream>
 #include <string>
+#include <cstdlib>
+#include <unordered_set>
 #include "runtime/thread.h"
 #include "runtime/debug.h"
 #include "runtime/sstream.h"
@@ -23,8 +25,65 @@ namespace lean {
 extern "C" obj_res lean_name_mk_string(obj_arg p, obj_arg s);
 extern "C" obj_res lean_name_mk_numeral(obj_arg p, obj_arg n);
 
-static inline obj_res name_mk_string_of_cstr(obj_arg p, char const * s) {
-    return lean_name_mk_string(p, mk_string(s));
+#ifndef LEAN_NAME_INTERN_SHARDS
+#define LEAN_NAME_INTERN_SHARDS 64
+#endif
+
+/* Optional process-wide table of the names created by the `name` constructors, enabled by setting the environment
+   variable `LEAN_INTERN_NAMES`. Equal names created this way share the same object, so `lean_name_eq` succeeds at its
+   pointer equality test. The table keeps a reference to each interned name, which is marked as multi-threaded since
+   it may be returned to any thread. */
+struct name_interner {
+    struct hash_fn { size_t operator()(object * n) const { return lean_name_hash_ptr(n); } };
+    struct eq_fn { bool operator()(object * n1, object * n2) const { return lean_name_eq(n1, n2); } };
+    struct shard {
+        mutex                                           m_mutex;
+        std::unordered_set<object *, hash_fn, eq_fn>    m_names;
+    };
+    shard m_shards[LEAN_NAME_INTERN_SHARDS];
+
+    ~name_interner() {
+        for (shard & s : m_shards)
+            for (object * n : s.m_names)
+                dec_ref(n);
+    }
+
+    obj_res intern(obj_arg n) {
+        shard & s = m_shards[lean_name_hash_ptr(n) % LEAN_NAME_INTERN_SHARDS];
+        lock_guard<mutex> lock(s.m_mutex);
+        auto it = s.m_names.find(n);
+        if (it != s.m_names.end()) {
+            dec_ref(n);
+            inc_ref(*it);
+            return *it;
+        }
+        lean_mark_mt(n);
+        inc_ref(n);
+        s.m_names.insert(n);
+        return n;
+    }
+};
+
+static name_interner * g_name_interner = nullptr;
+
+static inline obj_res intern_name_core(obj_arg n) {
+    return g_name_interner ? g_name_interner->intern(n) : n;
+}
+
+name intern_name(name const & n) {
+    if (n.is_anonymous())
+        return n;
+    return name(intern_name_core(n.to_obj_arg()));
+}
+
+static inline obj_res name_mk_string(b_obj_arg p, obj_arg s) {
+    inc(p);
+    return intern_name_core(lean_name_mk_string(p, s));
+}
+
+static inline obj_res name_mk_numeral(b_obj_arg p, obj_arg k) {
+    inc(p);
+    return intern_name_core(lean_name_mk_numeral(p, k));
 }
 
 constexpr char const * anonymous_str = "[anonymous]";
@@ -101,25 +160,19 @@ static void display_name(std::ostream & out, name const & n, bool escape, char c
 }
 
 name::name(name const & prefix, char const * n):
-    object_ref(name_mk_string_of_cstr(prefix.raw(), n)) {
-    inc(prefix.raw());
+    object_ref(name_mk_string(prefix.raw(), mk_string(n))) {
 }
 
 name::name(name const & prefix, unsigned k):
-    object_ref(lean_name_mk_numeral(prefix.raw(), mk_nat_obj(k))) {
-    inc(prefix.raw());
+    object_ref(name_mk_numeral(prefix.raw(), mk_nat_obj(k))) {
 }
 
 name::name(name const & prefix, string_ref const & s):
-    object_ref(lean_name_mk_string(prefix.raw(), s.raw())) {
-    inc(prefix.raw());
-    inc(s.raw());
+    object_ref(name_mk_string(prefix.raw(), s.to_obj_arg())) {
 }
 
 name::name(name const & prefix, nat const & k):
-    object_ref(lean_name_mk_numeral(prefix.raw(), k.raw())) {
-    inc(prefix.raw());
-    inc(k.raw());
+    object_ref(name_mk_numeral(prefix.raw(), k.to_obj_arg())) {
 }
 
 name::name(std::initializer_list<char const *> const & l):name() {
@@ -423,9 +476,13 @@ void initialize_name() {
     g_anonymous = new name();
     mark_persistent(g_anonymous->raw());
     g_next_id   = new atomic<unsigned>(0);
+    if (std::getenv("LEAN_INTERN_NAMES"))
+        g_name_interner = new name_interner();
 }
 
 void finalize_name() {
+    delete g_name_interner;
+    g_name_interner = nullptr;
     delete g_next_id;
     delete g_anonymous;
 }
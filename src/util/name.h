@@ -203,6 +203,10 @@ public:
 
 name string_to_name(std::string const & str);
 
+/** \brief Return the interned name equal to \c n if name interning is enabled (by `LEAN_INTERN_NAMES`), and \c n
+    otherwise. The `name` constructors intern the names they create. */
+name intern_name(name const & n);
+
 struct name_hash_fn { unsigned operator()(name const & n) const { return n.hash(); } };
 struct name_eq_fn { bool operator()(name const & n1, name const & n2) const { return n1 == n2; } };
 struct name_cmp {
@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <iomanip>
+#include "runtime/thread.h"
+#include "util/perf_counters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define LEAN_PERF_EVENTS
+#endif
+
+namespace lean {
+static constexpr unsigned num_counters = static_cast<unsigned>(perf_counter::NumCounters);
+static bool g_perf_counters_enabled = false;
+
+perf_counter_values & perf_counter_values::operator+=(perf_counter_values const & v) {
+    for (unsigned i = 0; i < num_counters; i++)
+        m_values[i] += v.m_values[i];
+    return *this;
+}
+
+perf_counter_values & perf_counter_values::operator-=(perf_counter_values const & v) {
+    for (unsigned i = 0; i < num_counters; i++)
+        m_values[i] -= v.m_values[i];
+    return *this;
+}
+
+void set_perf_counters_enabled(bool enabled) {
+    g_perf_counters_enabled = enabled;
+}
+
+bool perf_counters_enabled() {
+    return g_perf_counters_enabled;
+}
+
+#if defined(LEAN_PERF_EVENTS)
+/* Counters of a thread, opened as a single group so that they can be read at once. */
+struct perf_counter_group {
+    int      m_leader{-1};
+    int      m_fds[num_counters];
+    /* Position of each counter in the values read from the group leader, or -1 if it could not be opened. */
+    int      m_pos[num_counters];
+    unsigned m_num_open{0};
+};
+
+LEAN_THREAD_PTR(perf_counter_group, g_perf_counter_group);
+LEAN_THREAD_VALUE(bool, g_perf_counters_failed, false);
+
+static int perf_event_open(uint64 config, int group_fd) {
+    perf_event_attr attr = {};
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+static void close_perf_counter_group(void * p) {
+    perf_counter_group * g = static_cast<perf_counter_group *>(p);
+    for (unsigned i = 0; i < num_counters; i++) {
+        if (g->m_pos[i] >= 0)
+            close(g->m_fds[i]);
+    }
+    delete g;
+}
+
+static perf_counter_group * open_perf_counter_group() {
+    static uint64 const configs[num_counters] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    perf_counter_group * g = new perf_counter_group();
+    for (unsigned i = 0; i < num_counters; i++) {
+        g->m_fds[i] = perf_event_open(configs[i], g->m_leader);
+        if (g->m_fds[i] < 0) {
+            g->m_pos[i] = -1;
+        } else {
+            if (g->m_leader < 0)
+                g->m_leader = g->m_fds[i];
+            g->m_pos[i] = g->m_num_open++;
+        }
+    }
+    if (g->m_num_open == 0) {
+        delete g;
+        return nullptr;
+    }
+    register_thread_finalizer(close_perf_counter_group, g);
+    return g;
+}
+
+bool read_perf_counters(perf_counter_values & r) {
+    perf_counter_group * g = g_perf_counter_group;
+    if (!g) {
+        if (g_perf_counters_failed)
+            return false;
+        g = open_perf_counter_group();
+        if (!g) {
+            g_perf_counters_failed = true;
+            return false;
+        }
+        g_perf_counter_group = g;
+    }
+    /* With `PERF_FORMAT_GROUP`, the leader returns the number of counters followed by their values. */
+    uint64 buf[num_counters + 1];
+    if (read(g->m_leader, buf, sizeof(buf)) < static_cast<ssize_t>(sizeof(uint64) * (g->m_num_open + 1)))
+        return false;
+    for (unsigned i = 0; i < num_counters; i++)
+        r.m_values[i] = g->m_pos[i] >= 0 ? buf[1 + g->m_pos[i]] : 0;
+    return true;
+}
+#else
+bool read_perf_counters(perf_counter_values &) {
+    return false;
+}
+#endif
+
+static void display_count(std::ostream & out, uint64 n) {
+    if (n >= 1000000000)
+        out << static_cast<double>(n) / 1e9 << "G";
+    else if (n >= 1000000)
+        out << static_cast<double>(n) / 1e6 << "M";
+    else if (n >= 1000)
+        out << static_cast<double>(n) / 1e3 << "K";
+    else
+        out << n;
+}
+
+std::ostream & operator<<(std::ostream & out, display_perf_counters const & c) {
+    perf_counter_values const & v = c.m_values;
+    out << std::setprecision(3);
+    display_count(out, v[perf_counter::Cycles]);
+    out << " cycles, ";
+    display_count(out, v[perf_counter::Instructions]);
+    out << " instructions";
+    if (v[perf_counter::Cycles] > 0)
+        out << " (" << static_cast<double>(v[perf_counter::Instructions]) / v[perf_counter::Cycles] << " IPC)";
+    out << ", ";
+    display_count(out, v[perf_counter::CacheMisses]);
+    out << " cache misses, ";
+    display_count(out, v[perf_counter::BranchMisses]);
+    out << " branch misses";
+    return out;
+}
+}
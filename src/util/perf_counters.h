@@ -0,0 +1,32 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <iostream>
+#include "runtime/int64.h"
+
+namespace lean {
+/* Hardware performance counters of the current thread, read using `perf_event_open` on Linux. Counters that are not
+   supported by the machine (e.g., in virtual machines) read as zero. */
+enum class perf_counter { Cycles, Instructions, CacheMisses, BranchMisses, NumCounters };
+
+struct perf_counter_values {
+    uint64 m_values[static_cast<unsigned>(perf_counter::NumCounters)] = {};
+    uint64 operator[](perf_counter c) const { return m_values[static_cast<unsigned>(c)]; }
+    perf_counter_values & operator+=(perf_counter_values const & v);
+    perf_counter_values & operator-=(perf_counter_values const & v);
+};
+
+inline perf_counter_values operator-(perf_counter_values a, perf_counter_values const & b) { return a -= b; }
+
+void set_perf_counters_enabled(bool enabled);
+bool perf_counters_enabled();
+/* Store the counters of the current thread in `r`, opening them on first use. Return false if no counter is
+   available. */
+bool read_perf_counters(perf_counter_values & r);
+
+/* Print the counters in a human-readable form, e.g., `1.2G cycles, 1.50 IPC, 3.4M cache misses, 5.6M branch misses`. */
+struct display_perf_counters { perf_counter_values const & m_values; };
+std::ostream & operator<<(std::ostream & out, display_perf_counters const & c);
+}
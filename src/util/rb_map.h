@@ -8,10 +8,11 @@ Author: Leonardo de Moura
 #include <utility>
 #include "util/pair.h"
 #include "util/rb_tree.h"
+#include "util/btree.h"
 
 namespace lean {
 /**
-   \brief Wrapper for implementing maps using red black trees.
+   \brief Wrapper for implementing maps using persistent B-trees.
 */
 template<typename K, typename T, typename CMP>
 class rb_map {
@@ -23,7 +24,7 @@ private:
         int operator()(entry const & e1, entry const & e2) const { return CMP::operator()(e1.first, e2.first); }
         CMP const & get_cmp() const { return *this; }
     };
-    rb_tree<entry, entry_cmp> m_map;
+    btree<entry, entry_cmp> m_map;
 public:
     rb_map(CMP const & cmp = CMP()):m_map(entry_cmp(cmp)) {}
     friend void swap(rb_map & a, rb_map & b) { swap(a.m_map, b.m_map); }
@@ -121,9 +122,9 @@ public:
     // For debugging purposes
     void display(std::ostream & out) const { m_map.display(out); }
 
-    class iterator : public rb_tree<entry, entry_cmp>::iterator {
+    class iterator : public btree<entry, entry_cmp>::iterator {
     public:
-        iterator(rb_map const & map):rb_tree<entry, entry_cmp>::iterator(map.m_map) {}
+        iterator(rb_map const & map):btree<entry, entry_cmp>::iterator(map.m_map) {}
     };
 };
 template<typename K, typename T, typename CMP>
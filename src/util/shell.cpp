@@ -9,13 +9,20 @@ Author: Leonardo de Moura
 #include <signal.h>
 #include <cctype>
 #include <cstdlib>
+#include <cstdio>
 #include <string>
 #include <utility>
 #include <vector>
 #include <set>
+#include <algorithm>
 #include "runtime/stackinfo.h"
 #include "runtime/interrupt.h"
 #include "runtime/memory.h"
+#include "runtime/cache_registry.h"
+#include "runtime/alloc.h"
+#include "runtime/heap_profile.h"
+#include "runtime/numa.h"
+#include "runtime/task_trace.h"
 #include "runtime/thread.h"
 #include "runtime/debug.h"
 #include "runtime/sstream.h"
@@ -30,14 +37,18 @@ Author: Leonardo de Moura
 #include "kernel/environment.h"
 #include "kernel/kernel_exception.h"
 #include "kernel/trace.h"
+#include "kernel/profiler.h"
+#include "kernel/check_cache.h"
 #include "library/formatter.h"
 #include "library/module.h"
+#include "library/artifact_cache.h"
 #include "library/time_task.h"
 #include "library/compiler/ir.h"
 #include "library/print.h"
 #include "initialize/init.h"
 #include "library/compiler/ir_interpreter.h"
 #include "util/path.h"
+#include "util/worker_zygote.h"
 #include "stdlib_flags.h"
 #ifdef _MSC_VER
 #include <io.h>
@@ -169,11 +180,17 @@ using namespace lean; // NOLINT
 #ifndef LEAN_SERVER_DEFAULT_MAX_HEARTBEAT
 #define LEAN_SERVER_DEFAULT_MAX_HEARTBEAT 100000
 #endif
+#ifndef LEAN_DEFAULT_SEGMENT_PURGE_DELAY
+#define LEAN_DEFAULT_SEGMENT_PURGE_DELAY 0
+#endif
+#ifndef LEAN_SERVER_DEFAULT_SEGMENT_PURGE_DELAY
+#define LEAN_SERVER_DEFAULT_SEGMENT_PURGE_DELAY 10000
+#endif
 
 extern "C" void *initialize_Lean_Compiler_IR_EmitLLVM(uint8_t builtin,
                                                       lean_object *);
 extern "C" object *lean_ir_emit_llvm(object *env, object *mod_name,
-                                     object *filepath, object *w);
+                                     object *filepath, uint8_t thin_lto, object *w);
 
 static void display_header(std::ostream & out) {
     out << "Lean (version " << get_version_string() << ", " << LEAN_STR(LEAN_BUILD_TYPE) << ")\n";
@@ -198,22 +215,52 @@ static void display_help(std::ostream & out) {
     std::cout << "  --o=oname -o       create olean file\n";
     std::cout << "  --i=iname -i       create ilean file\n";
     std::cout << "  --c=fname -c       name of the C output file\n";
+    std::cout << "  --c-shards=num     split the C output into num files that can be compiled in parallel, the i-th one\n"
+              << "                     (i > 0) is named like the C output file with `.i` inserted before the extension\n";
+    std::cout << "  --c-instrument     count the calls of every function of the C output, see `runtime/call_profile.h`\n";
+    std::cout << "  --c-profile=fname  mark the functions of the C output as hot or cold according to a call profile\n";
     std::cout << "  --bc=fname -b      name of the LLVM bitcode file\n";
+    std::cout << "  --bc-thinlto       include the module summary for ThinLTO in the LLVM bitcode file\n";
     std::cout << "  --stdin            take input from stdin\n";
     std::cout << "  --root=dir         set package root directory from which the module name of the input file is calculated\n"
               << "                     (default: current working directory)\n";
     std::cout << "  --trust=num -t     trust level (default: max) 0 means do not trust any macro,\n"
               << "                     and type check all imported modules\n";
+    std::cout << "  --artifact-cache=dir\n";
+    std::cout << "                     reuse the outputs of a previous run on the same input with the same configuration and\n"
+              << "                     unchanged imported .olean files from dir, and add the outputs of successful runs to it\n";
+    std::cout << "  --kernel-cache=file\n";
+    std::cout << "                     do not type check declarations recorded in file as checked with the same dependencies,\n"
+              << "                     and record the declarations checked by this run (ignored with --trust=0)\n";
     std::cout << "  --quiet -q         do not print verbose messages\n";
     std::cout << "  --memory=num -M    maximum amount of memory that should be used by Lean\n";
     std::cout << "                     (in megabytes)\n";
+    std::cout << "  --memory-soft=num  evict the least recently used caches when the memory used by Lean objects\n";
+    std::cout << "                     reaches the given number of megabytes\n";
     std::cout << "  --timeout=num -T   maximum number of memory allocations per task\n";
     std::cout << "                     this is a deterministic way of interrupting long running tasks\n";
+    std::cout << "  --huge-pages=mode  back allocator memory with huge pages, where mode is\n";
+    std::cout << "                     'none' (default), 'transparent' or 'explicit'\n";
+    std::cout << "  --purge-delay=num  return unused allocator memory to the OS after it has been free\n";
+    std::cout << "                     for the given number of milliseconds (0 = never, default for --worker: "
+              << LEAN_SERVER_DEFAULT_SEGMENT_PURGE_DELAY << ")\n";
+    std::cout << "  --stack-segments   continue deep recursions in the kernel on fresh stack segments\n";
+    std::cout << "                     instead of failing with a deep recursion error (Linux only)\n";
 #if defined(LEAN_MULTI_THREAD)
+    std::cout << "  --deferred-free=num free shared object graphs with more than the given number of objects\n";
+    std::cout << "                     in a background task (0 = never, default)\n";
+    std::cout << "  --trace-tasks=file record the execution of all tasks and write them to the given file\n";
+    std::cout << "                     in the Chrome trace event format\n";
     std::cout << "  --threads=num -j   number of threads used to process lean files\n";
     std::cout << "  --tstack=num -s    thread stack size in Kb\n";
+    std::cout << "  --tstack-dedicated=num\n";
+    std::cout << "                     stack size in Kb of the threads running dedicated tasks (default: --tstack)\n";
+    std::cout << "  --numa             pin worker threads to NUMA nodes and allocate their memory locally\n";
     std::cout << "  --server           start lean in server mode\n";
     std::cout << "  --worker           start lean in server-worker mode\n";
+    std::cout << "  --worker-zygote=socket [Mod...]\n";
+    std::cout << "                     import the given modules and fork server workers from this process on requests on\n";
+    std::cout << "                     the Unix domain socket, used by `--worker` when LEAN_WORKER_ZYGOTE=socket is set\n";
 #endif
     std::cout << "  --plugin=file      load and initialize Lean shared library for registering linters etc.\n";
     std::cout << "  --load-dynlib=file load shared library to make its symbols available to the interpreter\n";
@@ -223,6 +270,11 @@ static void display_help(std::ostream & out) {
     std::cout << "  --print-libdir     print the installation directory for Lean's built-in libraries and exit\n";
     std::cout << "  --profile          display elaboration/type checking time for each definition/theorem\n";
     std::cout << "  --stats            display environment statistics\n";
+    std::cout << "  --mem-stats[=num]  print the memory used by the imported modules, the environment extensions and\n"
+              << "                     the num (default: 100) largest declarations as JSON\n";
+    std::cout << "  --fast-exit        exit without freeing memory once all outputs have been written\n";
+    std::cout << "  --peak-rss=file    write the peak resident set size in bytes to the given file at exit\n";
+    std::cout << "  --build-worker     process compilation jobs read from stdin, one per line, see shell.cpp\n";
     DEBUG_CODE(
     std::cout << "  --debug=tag        enable assertions with the given tag\n";
         )
@@ -232,6 +284,14 @@ static void display_help(std::ostream & out) {
 static int print_prefix = 0;
 static int print_libdir = 0;
 static int json_output = 0;
+static int fast_exit = 0;
+static int build_worker = 0;
+static int stack_segments = 0;
+static unsigned c_shards = 1;
+static int c_instrument = 0;
+static std::string c_profile;
+static int bc_thin_lto = 0;
+static std::string peak_rss_file;
 
 static struct option g_long_options[] = {
     {"version",      no_argument,       0, 'v'},
@@ -243,26 +303,45 @@ static struct option g_long_options[] = {
     {"stdin",        no_argument,       0, 'I'},
     {"root",         required_argument, 0, 'R'},
     {"memory",       required_argument, 0, 'M'},
+    {"memory-soft",  required_argument, 0, 'E'},
     {"trust",        required_argument, 0, 't'},
+    {"kernel-cache", required_argument, 0, 'G'},
+    {"artifact-cache", required_argument, 0, 'U'},
     {"profile",      no_argument,       0, 'P'},
     {"stats",        no_argument,       0, 'a'},
+    {"mem-stats",    optional_argument, 0, 'L'},
     {"quiet",        no_argument,       0, 'q'},
     {"deps",         no_argument,       0, 'd'},
     {"deps-json",    no_argument,       0, 'J'},
     {"timeout",      optional_argument, 0, 'T'},
+    {"purge-delay",  required_argument, 0, 'Y'},
+    {"huge-pages",   required_argument, 0, 'H'},
     {"c",            optional_argument, 0, 'c'},
+    {"c-shards",     required_argument, 0, 'Q'},
+    {"c-instrument", no_argument,       &c_instrument, 1},
+    {"c-profile",    required_argument, 0, 'A'},
     {"bc",           optional_argument, 0, 'b'},
+    {"bc-thinlto",   no_argument,       &bc_thin_lto, 1},
     {"features",     optional_argument, 0, 'f'},
     {"exitOnPanic",  no_argument,       0, 'e'},
 #if defined(LEAN_MULTI_THREAD)
     {"threads",      required_argument, 0, 'j'},
     {"tstack",       required_argument, 0, 's'},
+    {"tstack-dedicated", required_argument, 0, 'X'},
+    {"numa",         no_argument,       0, 'N'},
+    {"deferred-free", required_argument, 0, 'F'},
+    {"trace-tasks",  required_argument, 0, 'Z'},
     {"server",       no_argument,       0, 'S'},
     {"worker",       no_argument,       0, 'W'},
+    {"worker-zygote", required_argument, 0, 'K'},
 #endif
     {"plugin",       required_argument, 0, 'p'},
     {"load-dynlib",  required_argument, 0, 'l'},
     {"json",         no_argument,       &json_output, 1},
+    {"fast-exit",    no_argument,       &fast_exit, 1},
+    {"peak-rss",     required_argument, 0, 'O'},
+    {"build-worker", no_argument,       &build_worker, 1},
+    {"stack-segments", no_argument,     &stack_segments, 1},
     {"print-prefix", no_argument,       &print_prefix, 1},
     {"print-libdir", no_argument,       &print_libdir, 1},
 #ifdef LEAN_DEBUG
@@ -382,6 +461,54 @@ uint32_t run_server_worker(options const & opts) {
     return get_io_scalar_result<uint32_t>(lean_server_worker_main(opts.to_obj_arg(), io_mk_world()));
 }
 
+/* def importModules (imports : Array Import) (opts : Options) (trustLevel : UInt32 := 0) (leakEnv := false) : IO Environment */
+extern "C" object * lean_import_modules(object * imports, object * opts, uint32 trust_level, uint8 leak_env, object * w);
+
+extern "C" object* lean_init_search_path(object* w);
+void init_search_path() {
+    get_io_scalar_result<unsigned>(lean_init_search_path(io_mk_world()));
+}
+
+/* Serve server workers from a zygote listening on `socket_path`, see `util/worker_zygote.h`. The zygote imports
+   `mods` first, keeping their module data, so that the forked workers find it in the cache and share it copy-on-write.
+   Workers of a watchdog started with `LEAN_WORKER_ZYGOTE=socket_path` are run in the zygote, in the working directory
+   and environment of the worker process that sent the request, so a zygote can serve any workspace; only the modules
+   imported from the search path of the zygote are shared. Must be called before the task manager is started, as
+   threads do not survive `fork`. */
+static int run_worker_zygote(std::string const & socket_path, std::vector<std::string> const & mods,
+                             options const & opts, unsigned trust_lvl, unsigned num_threads) {
+    set_module_data_cache(true);
+    buffer<object_ref> imports;
+    for (std::string const & mod : mods) {
+        object * imp = alloc_cnstr(0, 1, 1);
+        cnstr_set(imp, 0, string_to_name(mod).steal());
+        cnstr_set_uint8(imp, sizeof(void*), false);
+        imports.push_back(object_ref(imp));
+    }
+    if (!imports.empty()) {
+        array_ref<object_ref> imports_arr(imports);
+        environment env(get_io_result<environment>(lean_import_modules(imports_arr.to_obj_arg(), opts.to_obj_arg(),
+                                                                       trust_lvl, true, io_mk_world())));
+    }
+    return serve_worker_zygote(socket_path, [&](std::vector<std::string> const & args) {
+        // only the `-D` arguments of the worker are used, the other ones are the same as for the zygote
+        options worker_opts = opts;
+        try {
+            // the search path depends on `LEAN_PATH`, which is now the one of the requester
+            init_search_path();
+            for (std::string const & arg : args) {
+                if (arg.compare(0, 2, "-D") == 0)
+                    worker_opts = set_config_option(worker_opts, arg.c_str() + 2);
+            }
+            scoped_task_manager scope_task_man(num_threads);
+            return static_cast<int>(run_server_worker(worker_opts));
+        } catch (lean::throwable & ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
+    });
+}
+
 /* def watchdogMain (args : List String) : IO Uint32 */
 extern "C" object* lean_server_watchdog_main(object* args, object* w);
 uint32_t run_server_watchdog(buffer<string_ref> const & args) {
@@ -389,11 +516,6 @@ uint32_t run_server_watchdog(buffer<string_ref> const & args) {
     return get_io_scalar_result<uint32_t>(lean_server_watchdog_main(arglist.to_obj_arg(), io_mk_world()));
 }
 
-extern "C" object* lean_init_search_path(object* w);
-void init_search_path() {
-    get_io_scalar_result<unsigned>(lean_init_search_path(io_mk_world()));
-}
-
 extern "C" object* lean_module_name_of_file(object* fname, object * root_dir, object* w);
 optional<name> module_name_of_file(std::string const & fname, optional<std::string> const & root_dir, bool optional) {
     object * oroot_dir = mk_option_none();
@@ -420,6 +542,80 @@ void print_imports_json(array_ref<string_ref> const & fnames) {
     consume_io_result(lean_print_imports_json(fnames.to_obj_arg(), io_mk_world()));
 }
 
+/* def findImportOLeans (input : String) (fileName : Option String) : IO (Array String) */
+extern "C" object * lean_find_import_oleans(object * input, object * file_name, object * w);
+/* def getImportedOLeans (env : Environment) : IO (Array String) */
+extern "C" object * lean_get_imported_oleans(object * env, object * w);
+
+static optional<std::string> g_artifact_cache_dir;
+/* The command-line arguments that affect the outputs of a module, for `--artifact-cache`. */
+static std::vector<std::string> g_config_args;
+
+static std::vector<std::string> to_std_strings(array_ref<string_ref> const & strs) {
+    std::vector<std::string> r;
+    for (string_ref const & s : strs)
+        r.push_back(s.to_std_string());
+    return r;
+}
+
+/* Return the key of the module in the `--artifact-cache`, see `library/artifact_cache.h`. `config_args` are the
+   arguments that affect its outputs, e.g., `-D` options. Return `none` if the cache is not used or the imports cannot
+   be resolved, in which case the frontend reports the error. */
+static optional<std::string> get_module_artifact_key(std::string const & contents, std::string const & mod_fn,
+                                                     name const & mod_name, unsigned trust_lvl,
+                                                     std::vector<std::string> const & config_args,
+                                                     module_artifacts const & outs) {
+    if (!g_artifact_cache_dir || (!outs.m_olean && !outs.m_ilean && !outs.m_c && !outs.m_bc))
+        return optional<std::string>();
+    /* The cache stores a single C file, and does not track the contents of the call profile. */
+    if (outs.m_c && (c_shards > 1 || c_instrument || !c_profile.empty()))
+        return optional<std::string>();
+    std::ostringstream config;
+    config << mod_name << '\0' << trust_lvl << '\0'
+           << !!outs.m_olean << !!outs.m_ilean << !!outs.m_c << !!outs.m_bc;
+    for (std::string const & arg : config_args)
+        config << '\0' << arg;
+    try {
+        std::vector<std::string> oleans = to_std_strings(get_io_result<array_ref<string_ref>>(
+            lean_find_import_oleans(mk_string(contents), mk_option_some(mk_string(mod_fn)), io_mk_world())));
+        return get_artifact_key(contents, config.str(), oleans);
+    } catch (lean::throwable &) {
+        return optional<std::string>();
+    }
+}
+
+/* Add the outputs of a module that was processed successfully to the `--artifact-cache`. */
+static void store_module_artifacts(environment const & env, std::string const & key, module_artifacts const & outs) {
+    try {
+        std::vector<std::string> oleans = to_std_strings(get_io_result<array_ref<string_ref>>(
+            lean_get_imported_oleans(env.to_obj_arg(), io_mk_world())));
+        store_artifacts(*g_artifact_cache_dir, key, outs, oleans);
+    } catch (lean::throwable &) {
+    }
+}
+
+/* With `--fast-exit`, terminate the process as soon as its outputs have been written, without finalizing the modules,
+   freeing the environment or destroying static objects. This teardown takes a noticeable part of short invocations
+   such as the ones of `lake build`. The task manager is not finalized either, so the task trace of `--trace-tasks`
+   is written explicitly. */
+static int exit_code(int code) {
+    if (!peak_rss_file.empty()) {
+        // used by `lake` to estimate the memory needed to rebuild the module
+        std::ofstream out(peak_rss_file);
+        out << get_peak_rss() << "\n";
+    }
+    if (fast_exit) {
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(nullptr);
+        // `atexit` handlers are skipped as well
+        write_heap_profile();
+        write_task_trace();
+        std::_Exit(code);
+    }
+    return code;
+}
+
 extern "C" object* lean_environment_free_regions(object * env, object * w);
 void environment_free_regions(environment && env) {
     consume_io_result(lean_environment_free_regions(env.steal(), io_mk_world()));
@@ -436,6 +632,150 @@ void check_optarg(char const * option_name) {
     }
 }
 
+/* Return the name of the `i`-th C output file of `--c-shards`, i.e., `c_output` with `.i` inserted before its
+   extension. */
+static std::string c_shard_file_name(std::string const & c_output, size_t i) {
+    size_t dot = c_output.rfind('.');
+    size_t sep = c_output.find_last_of("/\\");
+    if (dot == std::string::npos || (sep != std::string::npos && dot < sep))
+        return c_output + "." + std::to_string(i);
+    return c_output.substr(0, dot) + "." + std::to_string(i) + c_output.substr(dot);
+}
+
+/* Write the .olean, C and LLVM outputs of the module `mod_name` that were requested. Return `false` if an output file
+   cannot be created. */
+static bool write_outputs(environment const & env, options const & opts, name const & mod_name,
+                          optional<std::string> const & olean_fn, optional<std::string> const & c_output,
+                          optional<std::string> const & llvm_output) {
+    if (olean_fn) {
+        time_task t(".olean serialization", opts);
+        write_module(env, *olean_fn);
+    }
+
+    if (c_output) {
+        time_task _("C code generation", opts);
+        std::string profile = c_profile.empty() ? std::string() : read_file(c_profile);
+        array_ref<string_ref> units = lean::ir::emit_c_shards(env, mod_name, c_shards, c_instrument, profile);
+        for (size_t i = 0; i < units.size(); i++) {
+            std::string fn = i == 0 ? *c_output : c_shard_file_name(*c_output, i);
+            std::ofstream out(fn, std::ios_base::binary);
+            if (out.fail()) {
+                std::cerr << "failed to create '" << fn << "'\n";
+                return false;
+            }
+            out << units[i].data();
+        }
+    }
+
+    if (llvm_output) {
+        initialize_Lean_Compiler_IR_EmitLLVM(/*builtin*/ false,
+                lean_io_mk_world());
+        time_task _("LLVM code generation", opts);
+        lean::consume_io_result(lean_ir_emit_llvm(
+                    env.to_obj_arg(), mod_name.to_obj_arg(),
+                    lean::string_ref(*llvm_output).to_obj_arg(),
+                    bc_thin_lto, lean_io_mk_world()));
+    }
+    return true;
+}
+
+/* Run a job of `--build-worker`, see `run_build_worker`, and return its exit code. */
+static int run_build_job(std::vector<std::string> const & args, options opts, unsigned trust_lvl) {
+    optional<std::string> olean_fn;
+    optional<std::string> ilean_fn;
+    optional<std::string> c_output;
+    optional<std::string> llvm_output;
+    optional<std::string> root_dir;
+    optional<std::string> mod_fn;
+    std::vector<std::string> config_args = g_config_args;
+    try {
+        for (size_t i = 0; i < args.size(); i++) {
+            std::string const & arg = args[i];
+            auto value = [&]() -> std::string const & {
+                if (i + 1 >= args.size())
+                    throw exception(sstream() << "argument missing for option '" << arg << "'");
+                return args[++i];
+            };
+            if (arg == "-o") {
+                olean_fn = value();
+            } else if (arg == "-i") {
+                ilean_fn = value();
+            } else if (arg == "-c") {
+                c_output = value();
+            } else if (arg == "-b") {
+                llvm_output = value();
+            } else if (arg == "-R") {
+                root_dir = value();
+            } else if (arg == "-D") {
+                opts = set_config_option(opts, value().c_str());
+                config_args.push_back("-D" + args[i]);
+            } else if (!arg.empty() && arg[0] == '-') {
+                throw exception(sstream() << "unknown option '" << arg << "'");
+            } else if (mod_fn) {
+                throw exception("expected exactly one file name");
+            } else {
+                mod_fn = arg;
+            }
+        }
+        if (!mod_fn)
+            throw exception("expected exactly one file name");
+        std::string contents = read_file(*mod_fn);
+        optional<name> main_module_name = module_name_of_file(*mod_fn, root_dir, /* optional */ !olean_fn && !c_output);
+        if (!main_module_name)
+            main_module_name = name("_stdin");
+        module_artifacts artifacts{olean_fn, ilean_fn, c_output, llvm_output};
+        optional<std::string> artifact_key =
+            get_module_artifact_key(contents, *mod_fn, *main_module_name, trust_lvl, config_args, artifacts);
+        if (artifact_key && restore_artifacts(*g_artifact_cache_dir, *artifact_key, artifacts))
+            return 0;
+        pair_ref<environment, object_ref> r =
+            run_new_frontend(contents, opts, *mod_fn, *main_module_name, trust_lvl, ilean_fn, json_output);
+        environment env = r.fst();
+        bool ok = unbox(r.snd().raw());
+        if (ok && !write_outputs(env, opts, *main_module_name, olean_fn, c_output, llvm_output))
+            return 1;
+        if (ok && artifact_key)
+            store_module_artifacts(env, *artifact_key, artifacts);
+        return ok ? 0 : 1;
+    } catch (lean::throwable & ex) {
+        std::cerr << ex.what() << "\n";
+    } catch (std::bad_alloc & ex) {
+        std::cerr << "out of memory" << std::endl;
+    }
+    return 1;
+}
+
+/* `--build-worker`: process the compilation jobs read from stdin in this process, so that build systems do not pay for
+   the startup of `lean` for each file. Each line is a job consisting of tab-separated arguments: the file name, and
+   the options `-o`, `-i`, `-c`, `-b`, `-R` and `-D` each followed by its value as a separate argument. The options of
+   the worker's command line apply to all jobs. The messages of a job are printed as usual, followed by a line
+   `exit <code>`.
+
+   The module data read by a job is kept for the next ones as long as the .olean files do not change. Initializers of
+   imported modules only run the first time a module is imported. */
+static int run_build_worker(options const & opts, unsigned trust_lvl) {
+    set_module_data_cache(true);
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.empty())
+            continue;
+        std::vector<std::string> args;
+        size_t start = 0;
+        while (true) {
+            size_t end = line.find('\t', start);
+            args.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+            if (end == std::string::npos)
+                break;
+            start = end + 1;
+        }
+        int code = run_build_job(args, opts, trust_lvl);
+        std::cerr.flush();
+        std::cout << "exit " << code << std::endl;
+    }
+    display_cumulative_profiling_times(std::cerr);
+    return 0;
+}
+
 extern "C" object * lean_enable_initializer_execution(object * w);
 
 extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
@@ -472,9 +812,11 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
     bool only_deps = false;
     bool deps_json = false;
     bool stats = false;
+    optional<unsigned> mem_stats;
     // 0 = don't run server, 1 = watchdog, 2 = worker
     int run_server = 0;
     unsigned num_threads    = 0;
+    optional<unsigned> purge_delay;
 #if defined(LEAN_MULTI_THREAD)
     num_threads = hardware_concurrency();
 #endif
@@ -495,6 +837,7 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
     optional<std::string> llvm_output;
     optional<std::string> root_dir;
     buffer<string_ref> forwarded_args;
+    optional<std::string> zygote_socket;
 
     while (true) {
         int c = getopt_long(argc, argv, g_opt_str, g_long_options, NULL);
@@ -526,6 +869,18 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
                 check_optarg("c");
                 c_output = optarg;
                 break;
+            case 'Q':
+                check_optarg("c-shards");
+                c_shards = static_cast<unsigned>(std::max(1, atoi(optarg)));
+                break;
+            case 'A':
+                check_optarg("c-profile");
+                c_profile = optarg;
+                break;
+            case 'O':
+                check_optarg("peak-rss");
+                peak_rss_file = optarg;
+                break;
             case 'b':
                 check_optarg("bc");
                 llvm_output = optarg;
@@ -535,6 +890,25 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
                         static_cast<size_t>((atoi(optarg) / 4) * 4) * static_cast<size_t>(1024));
                 forwarded_args.push_back(string_ref("-s" + std::string(optarg)));
                 break;
+            case 'X':
+                check_optarg("tstack-dedicated");
+                set_dedicated_task_stack_size(
+                        static_cast<size_t>((atoi(optarg) / 4) * 4) * static_cast<size_t>(1024) + LEAN_STACK_BUFFER_SPACE);
+                forwarded_args.push_back(string_ref("--tstack-dedicated=" + std::string(optarg)));
+                break;
+            case 'N':
+                set_numa_aware(true);
+                forwarded_args.push_back(string_ref("--numa"));
+                break;
+            case 'F':
+                check_optarg("deferred-free");
+                set_deferred_free_threshold(static_cast<size_t>(atoi(optarg)));
+                forwarded_args.push_back(string_ref("--deferred-free=" + std::string(optarg)));
+                break;
+            case 'Z':
+                check_optarg("trace-tasks");
+                set_task_trace_file(optarg);
+                break;
             case 'I':
                 use_stdin = true;
                 break;
@@ -556,11 +930,35 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
                 opts = opts.update(get_max_memory_opt_name(), static_cast<unsigned>(atoi(optarg)));
                 forwarded_args.push_back(string_ref("-M" + std::string(optarg)));
                 break;
+            case 'E':
+                check_optarg("memory-soft");
+                set_cache_eviction_limit(static_cast<size_t>(atoi(optarg)) * 1024 * 1024);
+                forwarded_args.push_back(string_ref("--memory-soft=" + std::string(optarg)));
+                break;
             case 'T':
                 check_optarg("T");
                 opts = opts.update(get_timeout_opt_name(), static_cast<unsigned>(atoi(optarg)));
                 forwarded_args.push_back(string_ref("-T" + std::string(optarg)));
                 break;
+            case 'Y':
+                check_optarg("purge-delay");
+                purge_delay = static_cast<unsigned>(atoi(optarg));
+                forwarded_args.push_back(string_ref("--purge-delay=" + std::string(optarg)));
+                break;
+            case 'H':
+                check_optarg("huge-pages");
+                if (strcmp(optarg, "none") == 0) {
+                    set_segment_huge_pages(LEAN_HUGE_PAGES_NONE);
+                } else if (strcmp(optarg, "transparent") == 0) {
+                    set_segment_huge_pages(LEAN_HUGE_PAGES_TRANSPARENT);
+                } else if (strcmp(optarg, "explicit") == 0) {
+                    set_segment_huge_pages(LEAN_HUGE_PAGES_EXPLICIT);
+                } else {
+                    std::cerr << "error: invalid argument for option '--huge-pages', expected 'none', 'transparent' or 'explicit'" << std::endl;
+                    return 1;
+                }
+                forwarded_args.push_back(string_ref("--huge-pages=" + std::string(optarg)));
+                break;
             case 't':
                 check_optarg("t");
                 trust_lvl = atoi(optarg);
@@ -579,11 +977,15 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
             case 'a':
                 stats = true;
                 break;
+            case 'L':
+                mem_stats = optarg ? static_cast<unsigned>(std::max(0, atoi(optarg))) : 100u;
+                break;
             case 'D':
                 try {
                     check_optarg("D");
                     opts = set_config_option(opts, optarg);
                     forwarded_args.push_back(string_ref("-D" + std::string(optarg)));
+                    g_config_args.push_back("-D" + std::string(optarg));
                 } catch (lean::exception & ex) {
                     std::cerr << ex.what() << std::endl;
                     return 1;
@@ -595,6 +997,22 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
             case 'W':
                 run_server = 2;
                 break;
+            case 'U':
+                check_optarg("artifact-cache");
+                g_artifact_cache_dir = std::string(optarg);
+                break;
+            case 'G':
+                check_optarg("kernel-cache");
+                if (!set_kernel_check_cache(optarg)) {
+                    std::cerr << "failed to open '" << optarg << "'\n";
+                    return 1;
+                }
+                forwarded_args.push_back(string_ref("--kernel-cache=" + std::string(optarg)));
+                break;
+            case 'K':
+                check_optarg("worker-zygote");
+                zygote_socket = optarg;
+                break;
             case 'P':
                 opts = opts.update("profiler", true);
                 break;
@@ -608,11 +1026,13 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
                 check_optarg("p");
                 load_plugin(optarg);
                 forwarded_args.push_back(string_ref("--plugin=" + std::string(optarg)));
+                g_config_args.push_back("--plugin=" + std::string(optarg));
                 break;
             case 'l':
                 check_optarg("l");
                 lean::load_dynlib(optarg);
                 forwarded_args.push_back(string_ref("--load-dynlib=" + std::string(optarg)));
+                g_config_args.push_back("--load-dynlib=" + std::string(optarg));
                 break;
             default:
                 std::cerr << "Unknown command line option\n";
@@ -621,6 +1041,11 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         }
     }
 
+    if (stack_segments) {
+        set_stack_segments(true);
+        forwarded_args.push_back(string_ref("--stack-segments"));
+    }
+
     lean::io_mark_end_initialization();
 
     if (print_prefix) {
@@ -646,8 +1071,44 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         set_max_heartbeat_thousands(timeout);
     }
 
+    if (!purge_delay)
+        purge_delay = run_server == 2 ? LEAN_SERVER_DEFAULT_SEGMENT_PURGE_DELAY : LEAN_DEFAULT_SEGMENT_PURGE_DELAY;
+    set_segment_purge_delay(*purge_delay);
+
     if (get_profiler(opts)) {
         report_profiling_time("initialization", init_time);
+        set_kernel_profiler(true, get_profiling_threshold(opts));
+        if (get_profiling_trace_file(opts))
+            set_record_profiling_spans(true);
+        if (get_profiling_counters(opts))
+            set_perf_counters_enabled(true);
+        if (char const * report_fn = get_profiling_report_file(opts)) {
+            if (!set_profiling_report_file(report_fn)) {
+                std::cerr << "failed to create '" << report_fn << "'\n";
+                return 1;
+            }
+        }
+    }
+
+    if (zygote_socket) {
+        try {
+            return run_worker_zygote(*zygote_socket, std::vector<std::string>(argv + optind, argv + argc), opts,
+                                     trust_lvl, num_threads);
+        } catch (lean::throwable & ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
+    }
+
+    if (run_server == 2) {
+        if (char const * socket_path = getenv("LEAN_WORKER_ZYGOTE")) {
+            std::vector<std::string> args;
+            for (string_ref const & arg : forwarded_args)
+                args.push_back(arg.to_std_string());
+            int code;
+            if (run_in_worker_zygote(socket_path, args, code))
+                return code;
+        }
     }
 
     environment env(trust_lvl);
@@ -662,6 +1123,8 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
             return run_server_watchdog(forwarded_args);
         else if (run_server == 2)
             return run_server_worker(opts);
+        if (build_worker)
+            return exit_code(run_build_worker(opts, trust_lvl));
 
         if (only_deps && deps_json) {
             buffer<string_ref> fns;
@@ -722,6 +1185,14 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
 
         if (!main_module_name)
             main_module_name = name("_stdin");
+        module_artifacts artifacts{olean_fn, ilean_fn, c_output, llvm_output};
+        optional<std::string> artifact_key;
+        if (!run && !use_stdin) {
+            artifact_key = get_module_artifact_key(contents, mod_fn, *main_module_name, trust_lvl, g_config_args,
+                                                   artifacts);
+            if (artifact_key && restore_artifacts(*g_artifact_cache_dir, *artifact_key, artifacts))
+                return exit_code(0);
+        }
         pair_ref<environment, object_ref> r = run_new_frontend(contents, opts, mod_fn, *main_module_name, trust_lvl, ilean_fn, json_output);
         env = r.fst();
         bool ok = unbox(r.snd().raw());
@@ -729,47 +1200,42 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         if (stats) {
             env.display_stats();
         }
+        if (mem_stats) {
+            env.display_memory_stats(*mem_stats);
+        }
 
         if (run && ok) {
             uint32 ret = ir::run_main(env, opts, argc - optind, argv + optind);
             // environment_free_regions(std::move(env));
-            return ret;
-        }
-        if (olean_fn && ok) {
-            time_task t(".olean serialization", opts);
-            write_module(env, *olean_fn);
+            return exit_code(ret);
         }
+        if (ok && !write_outputs(env, opts, *main_module_name, olean_fn, c_output, llvm_output))
+            return 1;
+        if (ok && artifact_key)
+            store_module_artifacts(env, *artifact_key, artifacts);
 
-        if (c_output && ok) {
-            std::ofstream out(*c_output, std::ios_base::binary);
-            if (out.fail()) {
-                std::cerr << "failed to create '" << *c_output << "'\n";
-                return 1;
+        display_cumulative_profiling_times(std::cerr);
+        if (get_profiler(opts)) {
+            if (char const * trace_fn = get_profiling_trace_file(opts)) {
+                std::ofstream out(trace_fn);
+                if (out.fail()) {
+                    std::cerr << "failed to create '" << trace_fn << "'\n";
+                    return 1;
+                }
+                write_profiling_trace(out);
             }
-            time_task _("C code generation", opts);
-            out << lean::ir::emit_c(env, *main_module_name).data();
-            out.close();
-        }
-
-        if (llvm_output && ok) {
-            initialize_Lean_Compiler_IR_EmitLLVM(/*builtin*/ false,
-                    lean_io_mk_world());
-            time_task _("LLVM code generation", opts);
-            lean::consume_io_result(lean_ir_emit_llvm(
-                        env.to_obj_arg(), (*main_module_name).to_obj_arg(),
-                        lean::string_ref(*llvm_output).to_obj_arg(),
-                        lean_io_mk_world()));
         }
 
-        display_cumulative_profiling_times(std::cerr);
-
 #ifdef LEAN_SMALL_ALLOCATOR
         // If the small allocator is not enabled, then we assume we are not using the sanitizer.
         // Thus, we interrupt execution without garbage collecting.
         // This is useful when profiling improvements to Lean startup time.
-        exit(ok ? 0 : 1);
+        int code = exit_code(ok ? 0 : 1);
+        // `exit` does not unwind the stack, so `scope_task_man` does not write the trace
+        write_task_trace();
+        exit(code);
 #else
-        return ok ? 0 : 1;
+        return exit_code(ok ? 0 : 1);
 #endif
     } catch (lean::throwable & ex) {
         std::cerr << ex.what() << "\n";
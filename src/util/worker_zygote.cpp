@@ -0,0 +1,276 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <cstdint>
+#include "util/worker_zygote.h"
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __APPLE__
+#include <crt_externs.h>
+#define LEAN_ENVIRON (*_NSGetEnviron())
+#else
+extern char ** environ;
+#define LEAN_ENVIRON environ
+#endif
+#define LEAN_WORKER_ZYGOTE
+#endif
+
+namespace lean {
+#ifdef LEAN_WORKER_ZYGOTE
+static bool mk_address(std::string const & socket_path, sockaddr_un & addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, socket_path.c_str());
+    return true;
+}
+
+static bool read_all(int fd, void * buf, size_t n) {
+    char * p = static_cast<char *>(buf);
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool write_all(int fd, void const * buf, size_t n) {
+    char const * p = static_cast<char const *>(buf);
+    while (n > 0) {
+        ssize_t r = write(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+/* A request is a header with the number of arguments and the size of the payload, followed by the payload: the
+   NUL-terminated working directory, arguments and environment variables (`NAME=value`) of the requester. The standard
+   streams of the requester are passed with the header. */
+bool run_in_worker_zygote(std::string const & socket_path, std::vector<std::string> const & args, int & exit_code) {
+    sockaddr_un addr;
+    if (!mk_address(socket_path, addr))
+        return false;
+    char * cwd = getcwd(nullptr, 0);
+    if (!cwd)
+        return false;
+    std::string payload(cwd);
+    payload += '\0';
+    free(cwd);
+    for (std::string const & arg : args) {
+        payload += arg;
+        payload += '\0';
+    }
+    for (char ** e = LEAN_ENVIRON; *e; e++) {
+        payload += *e;
+        payload += '\0';
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return false;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    uint32_t header[2] = {static_cast<uint32_t>(args.size()), static_cast<uint32_t>(payload.size())};
+    iovec iov;
+    iov.iov_base = header;
+    iov.iov_len  = sizeof(header);
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr * cmsg   = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, 0) != static_cast<ssize_t>(sizeof(header)) || !write_all(fd, payload.data(), payload.size())) {
+        close(fd);
+        return false;
+    }
+    int32_t code;
+    // the connection is closed without an exit code if the worker crashed
+    exit_code = read_all(fd, &code, sizeof(code)) ? code : 1;
+    close(fd);
+    return true;
+}
+
+/* Close the file descriptors received in `msg`. */
+static void close_received_fds(msghdr & msg) {
+    for (cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; i++) {
+            int f;
+            memcpy(&f, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            close(f);
+        }
+    }
+}
+
+struct worker_request {
+    std::string              m_cwd;
+    std::vector<std::string> m_args;
+    std::vector<std::string> m_env;
+};
+
+/* Receive a request on `fd`, see `run_in_worker_zygote`. The received file descriptors are closed on failure. */
+static bool receive_request(int fd, int (&fds)[3], worker_request & req) {
+    uint32_t header[2];
+    iovec iov;
+    iov.iov_base = header;
+    iov.iov_len  = sizeof(header);
+    char control[CMSG_SPACE(sizeof(fds))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t r = recvmsg(fd, &msg, 0);
+    if (r < 0)
+        return false;
+    cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    if (r != static_cast<ssize_t>(sizeof(header)) || (msg.msg_flags & MSG_CTRUNC) || !cmsg ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) ||
+        CMSG_NXTHDR(&msg, cmsg)) {
+        close_received_fds(msg);
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    uint32_t num_args = header[0];
+    std::string payload(header[1], '\0');
+    if (!read_all(fd, &payload[0], payload.size()) || payload.empty() || payload.back() != '\0') {
+        close_received_fds(msg);
+        return false;
+    }
+    std::vector<std::string> strs;
+    size_t start = 0;
+    while (start < payload.size()) {
+        size_t end = payload.find('\0', start);
+        strs.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+    if (strs.size() < 1 + static_cast<size_t>(num_args)) {
+        close_received_fds(msg);
+        return false;
+    }
+    req.m_cwd = strs[0];
+    req.m_args.assign(strs.begin() + 1, strs.begin() + 1 + num_args);
+    req.m_env.assign(strs.begin() + 1 + num_args, strs.end());
+    return true;
+}
+
+/* Replace the environment of this process with `env`. */
+static void set_environment(std::vector<std::string> const & env) {
+    std::vector<std::string> names;
+    for (char ** e = LEAN_ENVIRON; *e; e++) {
+        char const * var = *e;
+        char const * eq  = strchr(var, '=');
+        names.push_back(eq ? std::string(var, eq) : std::string(var));
+    }
+    for (std::string const & name : names)
+        unsetenv(name.c_str());
+    for (std::string const & var : env) {
+        size_t eq = var.find('=');
+        if (eq != std::string::npos && eq > 0)
+            setenv(var.substr(0, eq).c_str(), var.c_str() + eq + 1, 1);
+    }
+}
+
+int serve_worker_zygote(std::string const & socket_path,
+                        std::function<int(std::vector<std::string> const &)> const & worker) {
+    sockaddr_un addr;
+    if (!mk_address(socket_path, addr)) {
+        std::cerr << "socket path '" << socket_path << "' is too long\n";
+        return 1;
+    }
+    // the workers are not waited for
+    signal(SIGCHLD, SIG_IGN);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd == -1 || bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "failed to listen on '" << socket_path << "': " << strerror(errno) << "\n";
+        return 1;
+    }
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "failed to accept a connection on '" << socket_path << "': " << strerror(errno) << "\n";
+            return 1;
+        }
+        int fds[3];
+        worker_request req;
+        if (!receive_request(fd, fds, req)) {
+            close(fd);
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+            for (int i = 0; i < 3; i++) {
+                dup2(fds[i], i);
+                close(fds[i]);
+            }
+            signal(SIGCHLD, SIG_DFL);
+            int32_t code;
+            if (chdir(req.m_cwd.c_str()) != 0) {
+                std::cerr << "failed to change to directory '" << req.m_cwd << "': " << strerror(errno) << "\n";
+                code = 1;
+            } else {
+                set_environment(req.m_env);
+                code = worker(req.m_args);
+            }
+            std::cout.flush();
+            std::cerr.flush();
+            std::fflush(nullptr);
+            if (write(fd, &code, sizeof(code)) != sizeof(code)) {
+                // the requester is gone
+            }
+            _exit(code);
+        }
+        for (int f : fds)
+            close(f);
+        close(fd);
+    }
+}
+#else
+bool run_in_worker_zygote(std::string const &, std::vector<std::string> const &, int &) {
+    return false;
+}
+
+int serve_worker_zygote(std::string const &, std::function<int(std::vector<std::string> const &)> const &) {
+    std::cerr << "worker zygotes are not supported on this platform\n";
+    return 1;
+}
+#endif
+}
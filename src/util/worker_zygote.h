@@ -0,0 +1,26 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace lean {
+/* Server worker zygote. A zygote process imports modules once, and then forks a process for each request received on
+   a Unix domain socket, so that the server file workers share the module data it loaded copy-on-write instead of
+   loading it again. The requester passes its standard streams, so that the forked worker talks to the watchdog
+   directly, as well as its working directory and environment, which the forked worker adopts before running, and waits
+   for its exit code. Only supported on POSIX systems. */
+
+/* Run a worker with the arguments `args` and the standard streams of this process in the zygote listening on
+   `socket_path`, and set `exit_code` to its exit code. Return `false` if the zygote cannot be reached. */
+bool run_in_worker_zygote(std::string const & socket_path, std::vector<std::string> const & args, int & exit_code);
+
+/* Listen on `socket_path` and, for each request, fork a process running `worker(args)` with the standard streams,
+   working directory and environment of the requester. The zygote must not have started any threads. Only returns on
+   failure, with an exit code. */
+int serve_worker_zygote(std::string const & socket_path,
+                        std::function<int(std::vector<std::string> const &)> const & worker);
+}
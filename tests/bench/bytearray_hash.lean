@@ -0,0 +1,31 @@
+/-!
+`ByteArray.hash`: the time of hashing a 1 MiB array, and the quality of the hashes of similar short arrays, measured
+by the largest of `2^16` buckets that the hashes of the 8-byte encodings of `0, ..., 2^20 - 1` fall into (the average
+is 16).
+-/
+
+def encode (i : Nat) : ByteArray := Id.run do
+  let mut a := ByteArray.mkEmpty 8
+  for j in [0:8] do
+    a := a.push (i >>> (8 * j)).toUInt8
+  return a
+
+def maxBucket (n : Nat) : Nat := Id.run do
+  let mut buckets := mkArray 65536 0
+  for i in [0:n] do
+    let k := ((encode i).hash % 65536).toNat
+    buckets := buckets.modify k (· + 1)
+  return buckets.foldl max 0
+
+def main : List String → IO Unit
+| [n] => do
+  let mut a := ByteArray.mkEmpty 1048576
+  for i in [0:1048576] do
+    a := a.push i.toUInt8
+  let mut h : UInt64 := 0
+  for i in [0:n.toNat!] do
+    a := a.set! 0 i.toUInt8
+    h := h ^^^ a.hash
+  IO.println s!"max bucket: {maxBucket 1048576}"
+  IO.println (h != 0)
+| _ => throw $ IO.userError "give number of iterations"
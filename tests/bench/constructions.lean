@@ -0,0 +1,40 @@
+import Lean
+
+/-!
+Benchmark of the auxiliary constructions generated for an inductive family with many constructors. Each
+construction is generated and type checked by the kernel once, and its time is reported in the format expected by
+the `output` runner of temci.
+-/
+
+open Lean Meta
+
+def numCtors : Nat := 200
+
+def bigName : Name := `BenchBig
+
+/-- `(n : Nat) → BenchBig n → (Nat → BenchBig n) → BenchBig (Nat.succ n)`, a reflexive constructor with an index -/
+def ctorType : Expr :=
+  let nat := mkConst ``Nat
+  let big (n : Expr) := mkApp (mkConst bigName) n
+  .forallE `n nat
+    (.forallE `x (big (.bvar 0))
+      (.forallE `f (.forallE `k nat (big (.bvar 2)) .default)
+        (big (mkApp (mkConst ``Nat.succ) (.bvar 2))) .default) .default) .default
+
+def steps : List (String × (Name → MetaM Unit)) := [
+  ("recOn", mkRecOn), ("casesOn", mkCasesOn), ("noConfusion", mkNoConfusion), ("below", mkBelow),
+  ("ibelow", mkIBelow), ("brecOn", mkBRecOn), ("binductionOn", mkBInductionOn)]
+
+#eval show MetaM Unit from do
+  let ctors := (List.range numCtors).map fun i => { name := bigName ++ .mkSimple s!"c{i}", type := ctorType : Constructor }
+  let start ← IO.monoNanosNow
+  addDecl <| .inductDecl [] 0 [{ name := bigName, type := mkArrow (mkConst ``Nat) (mkSort levelOne), ctors }] false
+  IO.println s!"inductive time ns: {(← IO.monoNanosNow) - start}"
+  let mut total := 0
+  for (label, mk) in steps do
+    let start ← IO.monoNanosNow
+    mk bigName
+    let time := (← IO.monoNanosNow) - start
+    total := total + time
+    IO.println s!"{label} time ns: {time}"
+  IO.println s!"total time ns: {total}"
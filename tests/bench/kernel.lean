@@ -0,0 +1,76 @@
+import Lean
+
+/-!
+Benchmark of the kernel type checker in isolation from the elaborator. The declarations of the corpus below are
+elaborated once, and are then type checked again `replays` times by `Environment.addDeclWithStats` under fresh
+names. For each declaration, the fastest check is reported together with its heartbeats and the peak size of the
+kernel caches, in the format expected by the `output` runner of temci.
+-/
+
+/-! Deep `decide` proofs -/
+
+theorem kernel_decide_ball : ∀ n, n < 200 → n * n % 4 ≠ 2 := by decide
+
+theorem kernel_decide_list : (List.range 300).foldl (· + ·) 0 = 44850 := by decide
+
+/-! Large `Nat` computations, reduced using GMP -/
+
+theorem kernel_nat_pow : 3 ^ 20000 % 1000 / 1000 + 2 ^ 4096 / 2 ^ 4090 = 64 := by decide
+
+theorem kernel_nat_gcd : Nat.gcd (2 ^ 3000 * 3 ^ 5) (2 ^ 2000 * 3 ^ 7) = 2 ^ 2000 * 3 ^ 5 := by decide
+
+/-! Structure eta -/
+
+structure Big where
+  (a b c d e f g h : Nat)
+
+theorem kernel_struct_eta (x : Big) :
+    x = ⟨x.a, x.b, x.c, x.d, x.e, x.f, x.g, x.h⟩ ∧ (x, x, x) = ((x, x, x).1, (x, x, x).2.1, (x, x, x).2.2) :=
+  ⟨rfl, rfl⟩
+
+/-! Universe polymorphism -/
+
+universe u v w
+
+def kernel_univ_comp {α : Sort u} {β : Sort v} {γ : Sort w} (f : α → β) (g : β → γ) : α → γ :=
+  fun x => g (f x)
+
+theorem kernel_univ {α : Type u} (f : α → α) (x : α) :
+    kernel_univ_comp (kernel_univ_comp (kernel_univ_comp f f) (kernel_univ_comp f f))
+      (kernel_univ_comp (kernel_univ_comp f f) (kernel_univ_comp f f)) x =
+    f (f (f (f (f (f (f (f x))))))) :=
+  rfl
+
+open Lean
+
+def corpus : List Name := [
+  ``kernel_decide_ball, ``kernel_decide_list, ``kernel_nat_pow, ``kernel_nat_gcd, ``kernel_struct_eta,
+  ``kernel_univ_comp, ``kernel_univ]
+
+def replays : Nat := 5
+
+/-- The declaration of `c` under the name `n`. -/
+def replayDecl (c : ConstantInfo) (n : Name) : Option Declaration :=
+  match c with
+  | .thmInfo v  => some <| .thmDecl { v with name := n }
+  | .defnInfo v => some <| .defnDecl { v with name := n, all := [n] }
+  | _           => none
+
+#eval show CoreM Unit from do
+  let env ← getEnv
+  let mut total := 0
+  for declName in corpus do
+    let some c := env.find? declName | throwError "unknown declaration '{declName}'"
+    let mut best : Option KernelCheckStats := none
+    for i in [0:replays] do
+      let some decl := replayDecl c (.num declName i) | throwError "'{declName}' is not a definition or theorem"
+      let (_, stats) ← ofExceptKernelException (env.addDeclWithStats 0 decl)
+      match best with
+      | some b => if stats.timeNs < b.timeNs then best := some stats
+      | none   => best := some stats
+    let some stats := best | unreachable!
+    total := total + stats.timeNs.toNat
+    IO.println s!"{declName} time ns: {stats.timeNs}"
+    IO.println s!"{declName} heartbeats: {stats.heartbeats}"
+    IO.println s!"{declName} peak cache size: {stats.peakCacheSize}"
+  IO.println s!"total time ns: {total}"
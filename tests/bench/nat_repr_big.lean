@@ -0,0 +1,12 @@
+/-! Conversions of big numbers from and to decimal strings. -/
+
+def main : List String → IO Unit
+| [n] => do
+  let mut x := 1
+  let mut s := 0
+  for i in [0:n.toNat!] do
+    x := x * 3 + i
+    let str := x.repr
+    s := s + str.length + str.toNat!.log2
+  IO.println s
+| _ => throw $ IO.userError "give number of iterations"
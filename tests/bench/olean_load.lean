@@ -0,0 +1,40 @@
+import Lean
+open Lean
+
+/-!
+Benchmark of loading .olean files. `olean_load.lean.out [module] [importers]` imports `module` (`Lean` by default)
+in `importers` concurrent tasks and reports the time spent in each phase, summed over all tasks, in the format
+expected by the `output` runner of temci. The environment construction time is the time spent in `importModules`
+outside of `readModuleDataMany`.
+
+The page cache can be dropped for a cold run beforehand, and `LEAN_OLEAN_NO_MMAP=1` forces the files to be copied and
+relocated instead of being mapped at their base address.
+-/
+
+def main (args : List String) : IO Unit := do
+  let mod := (args.headD "Lean").toName
+  let importers := (args.get? 1 >>= String.toNat?).getD 1
+  initSearchPath (← findSysroot)
+  let start ← IO.monoNanosNow
+  let tasks ← (List.range importers).mapM fun _ => IO.asTask do
+    let start ← IO.monoNanosNow
+    let env ← importModules #[{ module := mod }] {}
+    let time := (← IO.monoNanosNow) - start
+    if env.constants.size == 0 then
+      throw <| IO.userError s!"no constants imported from {mod}"
+    return time
+  let mut importNs := 0
+  for t in tasks do
+    importNs := importNs + (← IO.ofExcept t.get)
+  let wallNs := (← IO.monoNanosNow) - start
+  let stats ← getOleanLoadStats
+  let loadNs := stats.openNs.toNat + stats.readNs.toNat + stats.fixupNs.toNat
+  IO.println s!"files: {stats.files}"
+  IO.println s!"bytes: {stats.bytes}"
+  IO.println s!"mapped files: {stats.mappedFiles}"
+  IO.println s!"resident bytes: {stats.residentBytes}"
+  IO.println s!"open ns: {stats.openNs}"
+  IO.println s!"read ns: {stats.readNs}"
+  IO.println s!"fixup ns: {stats.fixupNs}"
+  IO.println s!"environment ns: {importNs - loadNs}"
+  IO.println s!"wall ns: {wallNs}"
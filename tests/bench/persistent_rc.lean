@@ -0,0 +1,29 @@
+/-!
+Reference counting on persistent objects: `tree` is a closed term, so it is evaluated once at initialization and
+marked persistent. The traversal puts its (shared) subtrees into fresh list cells, so nearly all reference counting
+operations below are applied to persistent objects.
+-/
+
+inductive Tree where
+  | leaf
+  | node (l : Tree) (v : Nat) (r : Tree)
+
+def mk : Nat → Tree
+  | 0   => .leaf
+  | n+1 => let t := mk n; .node t n t
+
+def tree : Tree := mk 20
+
+partial def sumAll (todo : List Tree) (acc : Nat) : Nat :=
+  match todo with
+  | []                    => acc
+  | .leaf :: todo         => sumAll todo acc
+  | .node l v r :: todo   => sumAll (l :: r :: todo) (acc + v)
+
+def main : List String → IO Unit
+| [n] => do
+  let mut s := 0
+  for i in [0:n.toNat!] do
+    s := s + sumAll [tree] i
+  IO.println s
+| _ => throw $ IO.userError "give number of iterations"
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "util/rb_tree.h"
+#include "util/btree.h"
+using namespace lean;
+
+/* Compares the red-black trees of `util/rb_tree.h` with the B-trees of `util/btree.h` backing `rb_map`,
+   `name_map` and `name_set`: inserting `n` keys in a pseudo-random order, looking them up, folding over them,
+   and inserting them while keeping a checkpoint of the tree every 10 insertions. Run each implementation in a
+   separate process, as in `rbmap_cpp_btree 1000000 btree`, so that they do not share a fragmented heap. */
+
+typedef std::pair<unsigned, bool> entry;
+
+struct entry_cmp {
+    int operator()(entry const & e1, entry const & e2) const { return unsigned_cmp()(e1.first, e2.first); }
+};
+
+static unsigned key(unsigned i, unsigned n) { return static_cast<unsigned>((i * 2654435761u) % n); }
+
+template<typename Tree>
+static void run(char const * name, unsigned n) {
+    typedef std::chrono::steady_clock clock;
+    auto ms = [](clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count();
+    };
+    auto start = clock::now();
+    Tree t;
+    for (unsigned i = 0; i < n; i++)
+        t.insert(entry(key(i, n), i % 10 == 0));
+    std::cout << name << " insert: " << ms(start) << "\n";
+
+    start = clock::now();
+    unsigned found = 0;
+    for (unsigned i = 0; i < n; i++)
+        if (auto e = t.find(entry(key(i + 1, n), false)))
+            found += e->second;
+    std::cout << name << " find: " << ms(start) << "\n";
+
+    start = clock::now();
+    unsigned count = 0;
+    for (unsigned i = 0; i < 10; i++)
+        t.for_each([&](entry const & e) { count += e.second; });
+    std::cout << name << " for_each: " << ms(start) << "\n";
+
+    start = clock::now();
+    Tree c;
+    std::vector<Tree> checkpoints;
+    for (unsigned i = 0; i < n; i++) {
+        c.insert(entry(key(i, n), true));
+        if (i % 10 == 0)
+            checkpoints.push_back(c);
+    }
+    std::cout << name << " insert with checkpoints: " << ms(start) << "\n";
+    std::cout << name << " checksum: " << found + count + checkpoints.size() << "\n";
+}
+
+int main(int argc, char ** argv) {
+    if (argc != 3) {
+        std::cout << "usage: rbmap_cpp_btree <n> rb_tree|btree\n";
+        return 1;
+    }
+    unsigned n = atoi(argv[1]);
+    std::string impl = argv[2];
+    if (impl == "rb_tree")
+        run<rb_tree<entry, entry_cmp>>("rb_tree", n);
+    else
+        run<btree<entry, entry_cmp>>("btree", n);
+    return 0;
+}
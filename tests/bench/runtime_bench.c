@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Microbenchmarks of the runtime primitives used by compiled Lean code. Each benchmark is run until it takes at
+least `MIN_TIME_NS`, then `REPEATS` more times, and the fastest run is reported in the format "<name>: <ns/op>"
+expected by the `output` runner of temci. Build it with `leanc -O3 -DNDEBUG -o runtime_bench.out runtime_bench.c`.
+*/
+#include <lean/lean.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_TIME_NS 20000000ull
+#define REPEATS     5
+
+void lean_initialize_runtime_module(void);
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Returns the number of operations performed by `n` iterations. */
+typedef size_t (*bench_fn)(size_t n);
+
+static void run(char const * name, bench_fn f) {
+    size_t n = 1;
+    uint64_t t;
+    for (;;) {
+        uint64_t start = now_ns();
+        f(n);
+        t = now_ns() - start;
+        if (t >= MIN_TIME_NS)
+            break;
+        n *= 2;
+    }
+    double best = -1;
+    for (int i = 0; i < REPEATS; i++) {
+        uint64_t start = now_ns();
+        size_t ops = f(n);
+        double r = (double)(now_ns() - start) / (double)ops;
+        if (best < 0 || r < best)
+            best = r;
+    }
+    printf("%s: %.3f\n", name, best);
+    fflush(stdout);
+}
+
+static lean_object * volatile g_sink;
+
+/* Reference counting */
+
+static size_t inc_dec(size_t n, bool mt) {
+    lean_object * o = lean_alloc_ctor(0, 1, 0);
+    lean_ctor_set(o, 0, lean_box(0));
+    if (mt)
+        lean_mark_mt(o);
+    for (size_t i = 0; i < n; i++) {
+        lean_inc_ref(o);
+        g_sink = o;
+        lean_dec_ref(o);
+    }
+    lean_dec_ref(o);
+    return n;
+}
+
+static size_t inc_dec_st(size_t n) { return inc_dec(n, false); }
+static size_t inc_dec_mt(size_t n) { return inc_dec(n, true); }
+
+/* Small object allocator */
+
+static size_t alloc_free(size_t n, unsigned sz) {
+    for (size_t i = 0; i < n; i++) {
+        lean_object * o = lean_alloc_small_object(sz);
+        g_sink = o;
+        lean_free_small_object(o);
+    }
+    return n;
+}
+
+static size_t alloc_16(size_t n)  { return alloc_free(n, 16); }
+static size_t alloc_32(size_t n)  { return alloc_free(n, 32); }
+static size_t alloc_64(size_t n)  { return alloc_free(n, 64); }
+static size_t alloc_128(size_t n) { return alloc_free(n, 128); }
+static size_t alloc_256(size_t n) { return alloc_free(n, 256); }
+static size_t alloc_512(size_t n) { return alloc_free(n, 512); }
+
+/* Arrays */
+
+#define ARRAY_SIZE 1024
+
+static size_t array_push(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        lean_object * a = lean_mk_empty_array();
+        for (size_t j = 0; j < ARRAY_SIZE; j++)
+            a = lean_array_push(a, lean_box(j));
+        g_sink = a;
+        lean_dec(a);
+    }
+    return n * ARRAY_SIZE;
+}
+
+/* Strings */
+
+#define STRING_APPENDS 1024
+
+static size_t string_append(size_t n) {
+    lean_object * chunk = lean_mk_string("0123456789abcdef");
+    for (size_t i = 0; i < n; i++) {
+        lean_object * s = lean_mk_string("");
+        for (size_t j = 0; j < STRING_APPENDS; j++)
+            s = lean_string_append(s, chunk);
+        g_sink = s;
+        lean_dec(s);
+    }
+    lean_dec(chunk);
+    return n * STRING_APPENDS;
+}
+
+static size_t string_extract(size_t n) {
+    char buf[1025];
+    memset(buf, 'a', 1024);
+    buf[1024] = 0;
+    lean_object * s = lean_mk_string(buf);
+    for (size_t i = 0; i < n; i++) {
+        size_t b = (i * 17) % 1000;
+        lean_object * r = lean_string_utf8_extract(s, lean_box(b), lean_box(b + 16));
+        g_sink = r;
+        lean_dec(r);
+    }
+    lean_dec(s);
+    return n;
+}
+
+/* Big numbers */
+
+static size_t nat_big(size_t n, bool mul) {
+    lean_object * a = lean_cstr_to_nat("123456789012345678901234567890123456789012345678901234567890123456789012345");
+    lean_object * b = lean_cstr_to_nat("987654321098765432109876543210987654321098765432109876543210987654321098765");
+    for (size_t i = 0; i < n; i++) {
+        lean_object * r = mul ? lean_nat_big_mul(a, b) : lean_nat_big_add(a, b);
+        g_sink = r;
+        lean_dec(r);
+    }
+    lean_dec(a);
+    lean_dec(b);
+    return n;
+}
+
+static size_t nat_big_add(size_t n) { return nat_big(n, false); }
+static size_t nat_big_mul(size_t n) { return nat_big(n, true); }
+
+/* Closures */
+
+static lean_object * fn1(lean_object * a) { return a; }
+static lean_object * fn2(lean_object * a, lean_object * b) { (void)b; return a; }
+static lean_object * fn3(lean_object * a, lean_object * b, lean_object * c) { (void)b; (void)c; return a; }
+
+static size_t apply_1(size_t n) {
+    lean_object * f = lean_alloc_closure((void *)fn1, 1, 0);
+    for (size_t i = 0; i < n; i++) {
+        lean_inc(f);
+        g_sink = lean_apply_1(f, lean_box(i));
+    }
+    lean_dec(f);
+    return n;
+}
+
+static size_t apply_2(size_t n) {
+    lean_object * f = lean_alloc_closure((void *)fn2, 2, 0);
+    for (size_t i = 0; i < n; i++) {
+        lean_inc(f);
+        g_sink = lean_apply_2(f, lean_box(i), lean_box(0));
+    }
+    lean_dec(f);
+    return n;
+}
+
+/* Partial application followed by saturation: allocates a closure on each iteration. */
+static size_t apply_partial(size_t n) {
+    lean_object * f = lean_alloc_closure((void *)fn3, 3, 0);
+    for (size_t i = 0; i < n; i++) {
+        lean_inc(f);
+        lean_object * g = lean_apply_1(f, lean_box(i));
+        g_sink = lean_apply_2(g, lean_box(0), lean_box(0));
+    }
+    lean_dec(f);
+    return n;
+}
+
+/* Tasks */
+
+static lean_object * task_fn(lean_object * unit) { (void)unit; return lean_box(0); }
+
+static size_t task_spawn_get(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        lean_object * t = lean_task_spawn_core(lean_alloc_closure((void *)task_fn, 1, 0), 0, false);
+        g_sink = lean_task_get_own(t);
+    }
+    return n;
+}
+
+int main(int argc, char ** argv) {
+    lean_initialize_runtime_module();
+    lean_init_task_manager();
+    struct { char const * name; bench_fn f; } benches[] = {
+        {"inc_dec_st", inc_dec_st},
+        {"inc_dec_mt", inc_dec_mt},
+        {"alloc_small 16", alloc_16},
+        {"alloc_small 32", alloc_32},
+        {"alloc_small 64", alloc_64},
+        {"alloc_small 128", alloc_128},
+        {"alloc_small 256", alloc_256},
+        {"alloc_small 512", alloc_512},
+        {"array_push", array_push},
+        {"string_append", string_append},
+        {"string_extract", string_extract},
+        {"nat_big_add", nat_big_add},
+        {"nat_big_mul", nat_big_mul},
+        {"apply_1", apply_1},
+        {"apply_2", apply_2},
+        {"apply_partial", apply_partial},
+        {"task_spawn_get", task_spawn_get},
+    };
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        /* Run only the benchmarks whose names start with one of the arguments, if any. */
+        bool selected = argc <= 1;
+        for (int j = 1; j < argc && !selected; j++)
+            selected = strncmp(benches[i].name, argv[j], strlen(argv[j])) == 0;
+        if (selected)
+            run(benches[i].name, benches[i].f);
+    }
+    lean_finalize_task_manager();
+    return 0;
+}
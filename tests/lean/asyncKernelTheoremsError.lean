@@ -0,0 +1,18 @@
+import Lean.Elab.Command
+
+-- adds a theorem that the elaborator would reject, so that only the kernel can catch it
+open Lean Elab Command in
+elab "bad_theorem " id:ident : command => liftCoreM <| addDecl <| .thmDecl {
+  name := id.getId, levelParams := [], type := mkConst ``False, value := mkConst ``True.intro }
+
+set_option debug.kernel.asyncTheorems true
+
+theorem goodThm₁ : 2 + 2 = 4 := rfl
+
+bad_theorem badThm
+
+theorem goodThm₂ : 3 + 3 = 6 := rfl
+
+-- The rejected theorem can be used until its check finishes, but the error is reported at its declaration when the
+-- file ends, so the file fails and no .olean containing it is written.
+theorem useBadThm : False := badThm
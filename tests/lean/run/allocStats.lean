@@ -0,0 +1,15 @@
+def numAlloc (stats : Array IO.AllocSlotStats) : Nat :=
+  stats.foldl (fun acc s => acc + s.numAlloc) 0
+
+#eval show IO Unit from do
+  let before ← IO.getAllocStats
+  let after ← IO.getAllocStats
+  -- The runtime may have been built without the small object allocator
+  unless before.isEmpty do
+    assert! before.size == after.size
+    -- Pages are always counted, allocations only if the runtime was built with `RUNTIME_STATS=ON`
+    assert! before.any (·.numPages > 0)
+    assert! numAlloc after ≥ numAlloc before
+    for s in after do
+      assert! s.numFree ≤ s.numAlloc
+      assert! s.numLive * s.objSize == s.liveBytes
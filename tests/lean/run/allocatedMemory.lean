@@ -0,0 +1,13 @@
+def allocate (n : Nat) : IO Unit := do
+  let before ← IO.getAllocatedMemory
+  let r ← IO.mkRef (Array.range n)
+  let after ← IO.getAllocatedMemory
+  unless after ≥ before + 8 * n do
+    throw <| IO.userError s!"allocated memory only grew from {before} to {after}"
+  IO.println (← r.get).size
+
+/-- info: 1000000 -/
+#guard_msgs in
+#eval allocate 1000000
+
+#eval IO.setMemorySoftLimit 0 (pure ())
@@ -0,0 +1,19 @@
+/-! `Array.parMap` and `Array.parFoldl`, which split the array into blocks processed by the task manager. -/
+
+def nums (n : Nat) : Array Nat := (List.range n).toArray
+
+#guard (nums 0).parMap (· + 1) == #[]
+#guard (nums 5).parMap (· * 2) == #[0, 2, 4, 6, 8]
+#guard (nums 100000).parMap (· * 3) == (nums 100000).map (· * 3)
+#guard ((nums 100000).parMap toString).size == 100000
+
+-- the array is shared with a later use
+#guard
+  let a := nums 10000
+  let b := a.parMap (· + 1)
+  a.size + b.size == 20000 && b[9999]! == 10000
+
+#guard (nums 0).parFoldl (· + ·) (· + ·) 7 == 7
+#guard (nums 100000).parFoldl (· + ·) (· + ·) 0 == 100000 * 99999 / 2
+#guard (nums 1000).parFoldl (fun l a => l ++ [a]) (· ++ ·) [] == List.range 1000
+#guard (nums 50000).parFoldl (fun s a => s.push a) (· ++ ·) #[] == nums 50000
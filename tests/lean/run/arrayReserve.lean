@@ -0,0 +1,20 @@
+/-! `Array.reserve`, and pushing onto large exclusive arrays, which the runtime grows in place. -/
+
+def pushMany (a : Array Nat) (n : Nat) : Array Nat := Id.run do
+  let mut a := a.reserve n
+  for i in [0:n] do
+    a := a.push i
+  return a
+
+#guard (#[1, 2, 3].reserve 10).toList == [1, 2, 3]
+#guard ((#[] : Array Nat).reserve 0).size == 0
+#guard (pushMany #[] 100000).size == 100000
+#guard (pushMany (pushMany #[] 100000) 100000).foldl (· + ·) 0 == 2 * (100000 * 99999 / 2)
+
+-- reserving capacity in a shared array does not change the other references
+#guard
+  let a := #[1, 2, 3]
+  let b := a.reserve 100 |>.push 4
+  a.toList == [1, 2, 3] && b.toList == [1, 2, 3, 4]
+
+example : #[1, 2, 3].reserve 5 = #[1, 2, 3] := rfl
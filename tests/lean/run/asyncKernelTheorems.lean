@@ -0,0 +1,10 @@
+set_option debug.kernel.asyncTheorems true
+
+theorem asyncThm₁ : 2 + 2 = 4 := rfl
+
+theorem asyncThm₂ (n : Nat) : n + 0 = n := rfl
+
+-- theorems checked asynchronously can be used right away
+theorem asyncThm₃ : 2 + 2 + 0 = 4 := by rw [asyncThm₂, asyncThm₁]
+
+example : 2 + 2 = 4 := asyncThm₁
@@ -0,0 +1,19 @@
+def counter (r : IO.Ref Nat) (n : Nat) : IO Unit := do
+  for _ in [0:n] do
+    r.atomicModifyGet fun v => ((), v + 1)
+
+/-- info: 4000 -/
+#guard_msgs in
+#eval show IO Unit from do
+  let r ← IO.mkRef 0
+  let tasks ← (List.range 4).mapM fun _ => IO.asTask (counter r 1000)
+  for t in tasks do
+    discard <| IO.ofExcept t.get
+  IO.println (← r.get)
+
+/-- info: (3, 13) -/
+#guard_msgs in
+#eval show IO Unit from do
+  let r ← IO.mkRef 3
+  let old ← r.atomicModifyGet fun v => (v, v + 10)
+  IO.println (old, ← r.get)
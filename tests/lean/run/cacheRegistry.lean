@@ -0,0 +1,20 @@
+/-- info: (true, false) -/
+#guard_msgs in
+#eval show IO Unit from do
+  let cache ← IO.mkRef (Array.range 1000)
+  let other ← IO.mkRef (Array.range 1000)
+  let id ← IO.registerCache "test" (return 8 * (← cache.get).size) (cache.set #[])
+  let otherId ← IO.registerCache "other" (return 8 * (← other.get).size) (other.set #[])
+  IO.unregisterCache otherId
+  IO.touchCache id
+  let _ ← IO.evictCaches 0
+  IO.unregisterCache id
+  IO.println ((← cache.get).isEmpty, (← other.get).isEmpty)
+
+-- identifiers that were not returned by `registerCache` are ignored
+#eval show IO Unit from do
+  let id ← IO.registerCache "test" (return 0) (return ())
+  for i in [id + 1, 1000000, 2^32, 2^64] do
+    IO.touchCache i
+    IO.unregisterCache i
+  IO.unregisterCache id
@@ -0,0 +1,56 @@
+open IO
+
+/-- info: (4, some 1, some 2, none) -/
+#guard_msgs in
+#eval show IO Unit from do
+  let q ← ConcurrentQueue.new (α := Nat) 3
+  let _ ← q.tryPush 1
+  let _ ← q.tryPush 2
+  IO.println (q.capacity, ← q.tryPop, ← q.tryPop, ← q.tryPop)
+
+/-- info: (false, 1, 2) -/
+#guard_msgs in
+#eval show IO Unit from do
+  let q ← ConcurrentQueue.new (α := Nat) 2
+  let _ ← q.tryPush 1
+  let _ ← q.tryPush 2
+  IO.println ((← q.tryPush 3), (← q.tryPop).get!, (← q.tryPop).get!)
+
+/-- info: 499500 -/
+#guard_msgs in
+#eval show IO Unit from do
+  let q ← ConcurrentQueue.new (α := Nat) 16
+  let producers ← (List.range 4).mapM fun p => IO.asTask do
+    for i in [0:250] do
+      while !(← q.tryPush (p * 250 + i)) do IO.sleep 0
+  let mut sum := 0
+  let mut n := 0
+  while n < 1000 do
+    match ← q.tryPop with
+    | some v => sum := sum + v; n := n + 1
+    | none   => IO.sleep 0
+  for t in producers do
+    discard <| IO.ofExcept t.get
+  IO.println sum
+
+/-- info: (500, some "3", none, some "4", none) -/
+#guard_msgs in
+#eval show IO Unit from do
+  let m ← ConcurrentHashMap.new (α := Nat) (β := String)
+  let tasks ← (List.range 4).mapM fun t => IO.asTask do
+    for i in [t * 250:(t + 1) * 250] do
+      m.insert i (toString i)
+  for t in tasks do
+    discard <| IO.ofExcept t.get
+  m.insert 3 "3"
+  IO.println (← m.size, ← m.get? 3, ← m.get? 1000, ← m.erase 4, ← m.get? 4)
+
+-- consecutive `Nat` keys, whose hashes only differ in their low bits, are spread over all shards
+/-- info: (64, true, true) -/
+#guard_msgs in
+#eval show IO Unit from do
+  let m ← ConcurrentHashMap.new (α := Nat) (β := Unit)
+  for i in [0:1000] do
+    m.insert i ()
+  let sizes ← m.shardSizes
+  IO.println (sizes.size, sizes.all (· > 0), sizes.all (· < 64))
@@ -0,0 +1,23 @@
+import Lean
+open Lean
+
+#eval show CoreM Unit from do
+  let env ← getEnv
+  let rs := env.findMany #[``Nat.add, `doesNotExist, ``List.map]
+  assert! rs.size == 3
+  assert! rs[0]!.map (·.name) == some ``Nat.add
+  assert! rs[1]!.isNone
+  assert! rs[2]!.map (·.name) == some ``List.map
+
+mutual
+unsafe def isEven : Nat → Bool
+  | 0 => true
+  | n+1 => isOdd n
+unsafe def isOdd : Nat → Bool
+  | 0 => false
+  | n+1 => isEven n
+end
+
+#eval show CoreM Unit from do
+  assert! (← getEnv).contains ``isEven
+  assert! (← getEnv).contains ``isOdd
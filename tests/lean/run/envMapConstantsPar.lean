@@ -0,0 +1,14 @@
+import Lean
+open Lean
+
+def myConst := 42
+
+#eval show CoreM Unit from do
+  let env ← getEnv
+  let counts := env.mapConstantsPar (chunkSize := 1000) (·.size) |>.map Task.get
+  assert! counts.foldl (· + ·) 0 == env.constants.size
+  assert! counts.all (· ≤ 1000)
+  -- the slice of local constants comes last
+  let names := env.mapConstantsPar (·.toArray.map (·.name)) |>.map Task.get
+  assert! names.back.contains ``myConst
+  assert! !(names.pop.any (·.contains ``myConst))
@@ -0,0 +1,25 @@
+import Lean.Data.Lsp.Utf16
+open Lean
+
+/-! The conversions of `FileMap` must give the same results with and without the ASCII line index. -/
+
+def checkFileMap (s : String) : IO Unit := do
+  let fast := FileMap.ofString s
+  let slow := { fast with asciiLines := #[] }
+  for i in [0:s.utf8ByteSize + 1] do
+    let p : String.Pos := ⟨i⟩
+    let q := fast.toPosition p
+    unless q == slow.toPosition p do
+      throw <| IO.userError s!"toPosition {i}"
+    unless fast.ofPosition q == slow.ofPosition q do
+      throw <| IO.userError s!"ofPosition {q}"
+    let lp := fast.utf8PosToLspPos p
+    unless lp == slow.utf8PosToLspPos p do
+      throw <| IO.userError s!"utf8PosToLspPos {i}"
+    unless fast.lspPosToUtf8Pos lp == slow.lspPosToUtf8Pos lp do
+      throw <| IO.userError s!"lspPosToUtf8Pos {lp}"
+
+#eval checkFileMap ""
+#eval checkFileMap "a\n"
+#eval checkFileMap "def f := 1\n\ntheorem t : f = 1 := rfl"
+#eval checkFileMap "ascii line\nα → β 𝔸\n\nmore ascii\n"
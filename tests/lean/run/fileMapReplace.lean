@@ -0,0 +1,24 @@
+import Lean.Data.Position
+open Lean
+
+/-! `FileMap.replace` agrees with recomputing the line table of the edited text. -/
+
+def checkReplace (s : String) (start stop : Nat) (newText : String) : Bool :=
+  let text := s.toFileMap
+  let r := text.replace ⟨start⟩ ⟨stop⟩ newText
+  let expected := (s.extract 0 ⟨start⟩ ++ newText ++ s.extract ⟨stop⟩ s.endPos).toFileMap
+  r.source == expected.source && r.positions == expected.positions && r.asciiLines == expected.asciiLines
+
+def src := "def f := 1\n\ntheorem t : f = 1 := rfl\n-- αβγ\nend\n"
+
+#guard checkReplace src 0 0 "x"
+#guard checkReplace src 4 5 "g"
+#guard checkReplace src 11 11 "\n"
+#guard checkReplace src 10 12 ""
+#guard checkReplace src 5 30 "α\nβ\n"
+#guard checkReplace src 40 42 "a"
+#guard checkReplace src 38 42 "x\ny"
+#guard checkReplace src 0 src.utf8ByteSize ""
+#guard checkReplace src src.utf8ByteSize src.utf8ByteSize "\n"
+#guard checkReplace "" 0 0 "a\nb"
+#guard checkReplace "a" 0 1 "é"
@@ -0,0 +1,38 @@
+/-! Bulk `FloatArray` and `ByteArray` operations, which are implemented natively. -/
+
+def fa (l : List Float) : FloatArray := l.toFloatArray
+
+#guard (fa [1, 2, 3]).add (fa [10, 20]) |>.toList == [11, 22]
+#guard (fa [1, 2, 3]).sub (fa [1, 1, 1]) |>.toList == [0, 1, 2]
+#guard (fa [1, 2, 3]).mul (fa [2, 2, 2]) |>.toList == [2, 4, 6]
+#guard (fa [1, 2, 3]).mulAdd (fa [2, 2, 2]) (fa [1, 1, 1]) |>.toList == [3, 5, 7]
+#guard (fa []).sum == 0
+#guard (fa [1, 2, 3, 4, 5, 6, 7]).sum == 28
+#guard (fa [1, 2, 3]).dot (fa [4, 5, 6, 7]) == 32
+#guard (fa [3, 1, 2]).min? == some 1
+#guard (fa [3, 1, 2]).max? == some 3
+#guard (fa []).min? == none
+#guard (fa [1, 2, 3, 4]).extract 1 3 |>.toList == [2, 3]
+#guard (fa [1, 2, 3, 4]).extract 3 10 |>.toList == [4]
+
+-- the first argument is shared here, so it is not updated in place
+#guard
+  let a := fa [1, 2]
+  let b := a.add a
+  a.toList == [1, 2] && b.toList == [2, 4]
+
+def ba (l : List UInt8) : ByteArray := l.toByteArray
+
+#guard ba [1, 2, 3] == ba [1, 2, 3]
+#guard ba [1, 2, 3] != ba [1, 2]
+#guard compare (ba [1, 2, 3]) (ba [1, 3]) == .lt
+#guard compare (ba [1, 2]) (ba [1, 2, 0]) == .lt
+#guard compare (ba [2]) (ba [1, 9]) == .gt
+#guard compare (ba []) (ba []) == .eq
+#guard (ba [5, 6, 7, 6]).indexOf? 6 == some 1
+#guard (ba [5, 6, 7, 6]).indexOf? 6 2 == some 3
+#guard (ba [5, 6, 7, 6]).indexOf? 8 == none
+#guard (ba [1, 2, 1, 2, 3]).find? (ba [1, 2, 3]) == some 2
+#guard (ba [1, 2, 1, 2, 3]).find? (ba [2]) 2 == some 3
+#guard (ba [1, 2]).find? (ba []) 2 == some 2
+#guard (ba [1, 2]).find? (ba [2, 3]) == none
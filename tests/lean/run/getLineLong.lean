@@ -0,0 +1,19 @@
+open IO.FS
+
+def testGetLine : IO Unit := do
+  let fn := "getLineLong.txt"
+  let long := String.mk (List.replicate 10000 'α')
+  writeFile fn s!"a\x00b\n{long}\nlast"
+  withFile fn .read fun h => do
+    let l ← h.getLine
+    assert! l == "a\x00b\n"
+    assert! l.length == 4
+    let l ← h.getLine
+    assert! l == long ++ "\n"
+    let l ← h.getLine
+    assert! l == "last"
+    let l ← h.getLine
+    assert! l.isEmpty
+  removeFile fn
+
+#eval testGetLine
@@ -0,0 +1,18 @@
+open IO.FS
+
+def testAsync : IO Unit := do
+  let fn := "handleAsync.txt"
+  let xs : ByteArray := ⟨#[1, 2, 3, 4, 5, 6]⟩
+  withFile fn .write fun h => do
+    let t ← h.writeAsync xs
+    IO.ofExcept (← IO.wait t)
+  withFile fn .read fun h => do
+    let ys ← IO.ofExcept (← IO.wait (← h.readAsync 4))
+    assert! ys.toList == [1, 2, 3, 4]
+    let ys ← IO.ofExcept (← IO.wait (← h.readAsync 4))
+    assert! ys.toList == [5, 6]
+    let ys ← IO.ofExcept (← IO.wait (← h.readAsync 4))
+    assert! ys.isEmpty
+  IO.FS.removeFile fn
+
+#eval testAsync
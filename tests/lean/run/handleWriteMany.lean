@@ -0,0 +1,15 @@
+open IO.FS
+
+def testWriteMany : IO Unit := do
+  let fn := "handleWriteMany.txt"
+  let parts := (List.range 2000).toArray.map fun i => (toString i).toUTF8
+  withFile fn .write fun h => do
+    h.putStr "start:"
+    h.writeMany parts
+    h.writeMany #[]
+    h.putStr ":end"
+  let s ← readFile fn
+  assert! s == "start:" ++ String.join ((List.range 2000).map toString) ++ ":end"
+  removeFile fn
+
+#eval testWriteMany
@@ -0,0 +1,17 @@
+open IO.FS
+
+def countOccurrences (s pat : String) : Nat :=
+  (s.splitOn pat).length - 1
+
+def testHeapSnapshot : IO Unit := do
+  let fn := "heapSnapshot.heapsnapshot"
+  let xs := (List.range 100).map fun i => (toString i, #[i])
+  IO.heapSnapshot xs fn
+  let json ← readFile fn
+  assert! json.startsWith "{\"snapshot\":"
+  assert! countOccurrences json "\"(roots)\"" == 1
+  assert! countOccurrences json "\"String\"" == 1
+  assert! countOccurrences json "\"Array\"" == 1
+  removeFile fn
+
+#eval testHeapSnapshot
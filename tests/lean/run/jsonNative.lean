@@ -0,0 +1,39 @@
+import Lean.Data.Json
+open Lean
+
+/-! The native parser and renderer agree with `Json.Parser.any` and `Json.compressCore`. -/
+
+def parseLean (s : String) : Option Json :=
+  match Json.Parser.any s.mkIterator with
+  | .success _ j => some j
+  | .error ..    => none
+
+def samples : List String := [
+  "null", " true ", "false", "[]", "{}", "\"\"", "0", "-0", "01", "-", "1.", "1.5e", "[1,]", "{\"a\":}",
+  "12345678901234567890123", "-98765432109876543210.0123", "2.50", "-0.001e2", "1e3", "1E+3", "7e-2",
+  "0.0000000000000005", "1.5e-20", "120e-1",
+  "\"x\\u0001\\n\\r\\t\\b\\f\\/\\\\\\\"\\ud800\\u00e9é\"", "\"\t\"", "\"\\x\"", "\"abc",
+  "{\"b\": [1, 2, {\"c\": null}], \"a\": \"x\", \"a\": 1}  ",
+  "{\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7}",
+  " [ [ ], { } , [ [ \"deep\" ] ] ] ", "[1 2]", "nul", "truex"
+]
+
+#guard samples.all fun s => Json.parseNative? s == parseLean s
+
+#guard samples.all fun s =>
+  match parseLean s with
+  | some j => Json.compressNative? j == some j.compressCore
+  | none   => true
+
+-- the trees built by the native parser support lookups and insertions
+#guard (Json.parse "{\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5}" >>= (·.getObjVal? "k4")).toOption == some 4
+
+#guard (Json.parse "{\"a\":1,\"b\":2,\"c\":3}").toOption.map (·.setObjVal! "b" 5 |>.compress) ==
+  some "{\"c\":3,\"b\":5,\"a\":1}"
+
+-- error messages are those of the Lean parser
+#guard match Json.parse "[1 2]" with
+  | .error e => e == "offset 4: unexpected character in array"
+  | .ok _    => false
+
+#guard Json.compress (.num ⟨5, 20⟩) == "0.0000000005e-10"
@@ -0,0 +1,16 @@
+import Lean
+open Lean
+
+#eval show CoreM Unit from do
+  let decl := Declaration.thmDecl {
+    name := `kernelCheckStatsThm, levelParams := [], type := mkConst ``True, value := mkConst ``True.intro }
+  match (← getEnv).addDeclWithStats 0 decl with
+  | .ok (env, _) => assert! env.contains `kernelCheckStatsThm
+  | .error _ => throwError "unexpected kernel error"
+
+#eval show CoreM Unit from do
+  let decl := Declaration.thmDecl {
+    name := `kernelCheckStatsBad, levelParams := [], type := mkConst ``True, value := mkConst ``Nat.zero }
+  match (← getEnv).addDeclWithStats 0 decl with
+  | .ok _ => throwError "kernel accepted ill-typed theorem"
+  | .error _ => pure ()
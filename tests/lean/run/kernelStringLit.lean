@@ -0,0 +1,38 @@
+import Lean
+
+open Lean
+
+/-! The kernel evaluates `String` functions on string literals without expanding them into `List Char`. -/
+
+def kernelWhnf (e : Expr) : CoreM Expr := do
+  ofExceptKernelException (Kernel.whnf (← getEnv) {} e)
+
+def checkWhnf (e expected : Expr) : CoreM Unit := do
+  let r ← kernelWhnf e
+  unless r == expected do
+    throwError "unexpected result {r}, expected {expected}"
+
+def long : String := String.mk (List.replicate 100000 'a')
+
+#eval checkWhnf (mkApp (mkConst ``String.length) (mkStrLit "hello")) (mkRawNatLit 5)
+#eval checkWhnf (mkApp (mkConst ``String.length) (mkStrLit "L∃∀N")) (mkRawNatLit 4)
+#eval checkWhnf (mkApp (mkConst ``String.utf8ByteSize) (mkStrLit "L∃∀N")) (mkRawNatLit 8)
+#eval checkWhnf (mkApp (mkConst ``String.length) (mkStrLit long)) (mkRawNatLit 100000)
+#eval checkWhnf (mkApp2 (mkConst ``String.append) (mkStrLit "abc") (mkStrLit "def")) (mkStrLit "abcdef")
+#eval checkWhnf (mkApp2 (mkConst ``String.append) (mkStrLit long) (mkStrLit long)) (mkStrLit (long ++ long))
+
+#eval show CoreM Unit from do
+  let r ← kernelWhnf (mkApp2 (mkConst ``String.decEq) (mkStrLit long) (mkStrLit long))
+  unless r.isAppOf ``Decidable.isTrue do
+    throwError "unexpected result {r}"
+
+/-! Different literals still reduce by unfolding. -/
+#eval show CoreM Unit from do
+  let r ← kernelWhnf (mkApp2 (mkConst ``String.decEq) (mkStrLit "abc") (mkStrLit "abd"))
+  unless r.isAppOf ``Decidable.isFalse do
+    throwError "unexpected result {r}"
+
+example : "hello".length = 5 := by decide
+example : "abc" ++ "def" = "abcdef" := by decide
+example : ("abc" == "abc") = true := by decide
+example : ("abc" == "abd") = false := by decide
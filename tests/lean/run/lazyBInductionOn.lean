@@ -0,0 +1,28 @@
+import Lean
+open Lean
+
+set_option inductive.lazyBInductionOn true
+
+inductive Tree where
+  | leaf
+  | node (f : Nat → Tree)
+
+#eval show CoreM Unit from do
+  assert! (← getEnv).contains ``Tree.brecOn
+  assert! !(← getEnv).contains ``Tree.binductionOn
+
+-- structural recursion into `Prop` over a reflexive type generates the constructions on demand
+theorem Tree.rec_ok : (t : Tree) → True
+  | .leaf => trivial
+  | .node f => (f 0).rec_ok
+
+#eval show CoreM Unit from do
+  assert! (← getEnv).contains ``Tree.binductionOn
+
+inductive Tree' where
+  | leaf
+  | node (f : Nat → Tree')
+
+-- referring to the construction by name generates it
+#check @Tree'.binductionOn
+#check @Tree'.ibelow
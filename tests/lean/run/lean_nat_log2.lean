@@ -0,0 +1,25 @@
+-- This confirms that `Nat.log2` and `Nat.pred` are implemented in the kernel
+-- and performs a few basic tests.
+
+-- `Nat.log2` is defined by well-founded recursion. Without kernel support
+-- the tests containing the 2^20 constant will fail.
+
+example : Nat.log2 0 = 0 := rfl
+example : Nat.log2 1 = 0 := rfl
+example : Nat.log2 2 = 1 := rfl
+example : Nat.log2 3 = 1 := rfl
+example : Nat.log2 4 = 2 := rfl
+example : Nat.log2 1023 = 9 := rfl
+example : Nat.log2 1024 = 10 := rfl
+example : Nat.log2 (2^20) = 20 := rfl
+example : Nat.log2 (2^1000 - 1) = 999 := rfl
+example : Nat.log2 (2^(2^16)) = 2^16 := by decide
+
+example : Nat.pred 0 = 0 := rfl
+example : Nat.pred 1 = 0 := rfl
+example : Nat.pred (2^20) = 1048575 := rfl
+example : Nat.pred (2^100) = 2^100 - 1 := rfl
+
+-- The kernel also reduces them when the argument is a closed term.
+theorem log2_pow (n : Nat) (h : n = 64) : Nat.log2 (2^n) = 64 := by
+  subst h; rfl
@@ -0,0 +1,14 @@
+/-! Native conversions between big numbers and decimal strings. -/
+
+#guard (2^64).repr == "18446744073709551616"
+#guard (10^40 + 7).repr == "10000000000000000000000000000000000000007"
+#guard toString (2^200) == "1606938044258990275541962092341162602522202993782792835301376"
+#guard (3^1000).repr.length == 478
+#guard (3^1000).repr.toNat? == some (3^1000)
+#guard "18446744073709551616".toNat! == 2^64
+#guard "000000000000000000000000000000000000001".toNat? == some 1
+#guard "12a".toNat? == none
+#guard "".toNat? == none
+#guard "123".decToNat == 123
+#guard "12a".decToNat == 169
+#guard "é".decToNat == 185
@@ -0,0 +1,18 @@
+/-! Arithmetic on natural numbers around `2^64` and `2^128`, where the runtime uses inline fast paths. -/
+
+def u64max : Nat := 2^64 - 1
+def u128max : Nat := 2^128 - 1
+
+#guard u64max + 1 == 18446744073709551616
+#guard u64max * u64max == 340282366920938463426481119284349108225
+#guard u128max + 1 == 340282366920938463463374607431768211456
+#guard (u128max + 1) - 1 == u128max
+#guard u128max * 2 == 680564733841876926926749214863536422910
+#guard (2^64 + 5) * (2^63) == 2^127 + 5 * 2^63
+#guard (2^64 + 5) * (2^64) == 2^128 + 5 * 2^64
+#guard (2^65) - (2^65 + 1) == 0
+#guard (2^65 + 3) - (2^65) == 3
+#guard (2^100) - (2^64 + 1) == 1267650600209811436485927960575
+#guard Nat.succ u128max == 2^128
+#guard (u64max.toUInt64.toNat) == u64max
+#guard (u128max % 2^64) == u64max
@@ -0,0 +1,20 @@
+import Lean
+open Lean
+
+def mkStr (n : Nat) : String := "".pushn 'x' n
+
+#eval show IO Unit from do
+  let s := mkStr 100
+  let n ← objectGraphSize s
+  assert! n ≥ 100
+  -- shared objects are counted once
+  let p ← objectGraphSize (s, s)
+  assert! n < p && p < 2 * n
+
+#eval show CoreM Unit from do
+  let env ← getEnv
+  assert! env.header.regions.all (·.size > 0)
+  -- imported declarations are contained in the compacted regions
+  let some c := env.find? ``Nat.add | unreachable!
+  assert! (← objectGraphSize c) > 0
+  assert! (← objectGraphSize c env.header.regions) == 0
@@ -0,0 +1,10 @@
+import Lean
+open Lean
+
+/-! The imports of this file have been loaded by `readModuleDataMany`. -/
+
+#eval show IO Unit from do
+  let stats ← getOleanLoadStats
+  unless stats.files > 0 && stats.bytes > 0 && stats.mappedFiles ≤ stats.files &&
+      stats.lockedFiles ≤ stats.mappedFiles do
+    throw <| IO.userError s!"unexpected stats {repr stats}"
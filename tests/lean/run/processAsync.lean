@@ -0,0 +1,19 @@
+open IO.Process
+
+def testOutputAsync : IO Unit := do
+  let tasks ← (List.range 8).mapM fun i =>
+    outputAsync { cmd := "sh", args := #["-c", s!"printf '%100000s'; echo {i} >&2; exit {i}"] }
+  for t in tasks, i in List.range 8 do
+    let out ← IO.ofExcept (← IO.wait t)
+    assert! out.exitCode == i.toUInt32
+    assert! out.stdout.length == 100000
+    assert! out.stderr == s!"{i}\n"
+
+#eval testOutputAsync
+
+def testWaitAsync : IO Unit := do
+  let child ← spawn { cmd := "sh", args := #["-c", "exit 3"] }
+  let code ← IO.ofExcept (← IO.wait (← child.waitAsync))
+  assert! code == 3
+
+#eval testWaitAsync
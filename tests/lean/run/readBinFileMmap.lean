@@ -0,0 +1,32 @@
+open IO.FS
+
+def testReadBinFile (read : System.FilePath → IO ByteArray) (size : Nat) : IO Unit := do
+  let fn := "readBinFileMmap.bin"
+  let xs := ByteArray.mk <| (List.range size).toArray.map (·.toUInt8)
+  writeBinFile fn xs
+  let ys ← read fn
+  assert! ys.size == size
+  assert! ys == xs
+  -- updates must not be written back to the file
+  let ys := ys.set! 0 42
+  assert! ys.get! 0 == 42
+  let zs ← read fn
+  assert! zs == xs
+  removeFile fn
+
+#eval testReadBinFile readBinFile 0
+#eval testReadBinFile readBinFile 1000
+#eval testReadBinFile readBinFile (3 * 1024 * 1024 + 17)
+#eval testReadBinFile mapBinFile 0
+#eval testReadBinFile mapBinFile 1000
+#eval testReadBinFile mapBinFile (3 * 1024 * 1024 + 17)
+
+-- the result of `readBinFile` does not depend on the file once it has been read
+#eval show IO Unit from do
+  let fn := "readBinFileMmap.bin"
+  let xs := ByteArray.mk <| (List.range (3 * 1024 * 1024)).toArray.map (·.toUInt8)
+  writeBinFile fn xs
+  let ys ← readBinFile fn
+  writeBinFile fn ByteArray.empty
+  assert! ys == xs
+  removeFile fn
@@ -0,0 +1,20 @@
+open IO.FS System
+
+def testReadDirRecursive : IO Unit := do
+  let root : FilePath := "readDirRecursive.dir"
+  if ← root.pathExists then removeDirAll root
+  for i in [0:5] do
+    createDirAll (root / s!"d{i}" / "sub")
+    writeFile (root / s!"d{i}" / "a.txt") "a"
+    writeFile (root / s!"d{i}" / "sub" / "b.txt") "b"
+  writeFile (root / "top.txt") "top"
+  let entries ← root.readDirRecursive
+  assert! entries.size == 21
+  assert! (entries.filter (·.type == .dir)).size == 10
+  assert! (entries.filter (·.type == .file)).size == 11
+  assert! entries.any (·.path == root / "d3" / "sub" / "b.txt")
+  for e in entries do
+    assert! (← e.path.metadata).modified == e.modified
+  removeDirAll root
+
+#eval testReadDirRecursive
@@ -177,3 +177,19 @@ info: [[2, 3, 4]]
 -/
 #guard_msgs in
 #eval (tst6 2).run
+
+unsafe def tst7 : IO Unit := do
+let x := [1, 2]
+let y := [0, 1].map (fun x => x + 1)
+let (a, b, c) := ShareCommon.shareCommon' (x, y, [2])
+check' $ ptrAddrUnsafe a == ptrAddrUnsafe b
+check' $ ptrAddrUnsafe a.tail! == ptrAddrUnsafe c
+IO.println (a, b, c)
+where
+  check' (b : Bool) : IO Unit := unless b do throw $ IO.userError "check failed"
+
+/--
+info: ([1, 2], [1, 2], [2])
+-/
+#guard_msgs in
+#eval tst7
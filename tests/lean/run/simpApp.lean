@@ -0,0 +1,22 @@
+/-!
+Closures created and applied in the same declaration, to exercise the `simp_app` IR pass.
+-/
+
+def addAll (n : Nat) (xs : List Nat) : List Nat × Nat :=
+  let f := fun x => x + n
+  (xs.map f, f 10)
+
+def applyPartial (n : Nat) (xs : Array Nat) : Array Nat × Nat :=
+  let f := fun (a b c : Nat) => a * 100 + b * 10 + c + n
+  let g := f 1
+  let h := g 2
+  (xs.map h, g 3 4)
+
+def boxedArgs (k : UInt32) (xs : List UInt32) : List UInt32 × UInt32 :=
+  let f := fun (x : UInt32) => x * k
+  (xs.map f, f 7)
+
+#guard addAll 1 [1, 2] == ([2, 3], 11)
+#guard applyPartial 0 #[3, 4] == (#[123, 124], 134)
+#guard applyPartial 5 #[] == (#[], 139)
+#guard boxedArgs 2 [1, 3] == ([2, 6], 14)
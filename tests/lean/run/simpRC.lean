@@ -0,0 +1,29 @@
+/-!
+Code with join points and `case` alternatives sharing reference counting instructions,
+to exercise the `simp_rc` IR pass.
+-/
+
+def pick (b : Bool) (xs ys : List Nat) : List Nat :=
+  let zs := if b then xs ++ ys else ys ++ xs
+  zs ++ xs
+
+def sumPairs : List (Nat × Nat) → Nat
+  | [] => 0
+  | (a, b) :: ps =>
+    let s := match a with
+      | 0 => b
+      | _ => a + b
+    s + sumPairs ps
+
+def share (xs : Array Nat) (n : Nat) : Array Nat × Array Nat :=
+  match n with
+  | 0 => (xs, xs)
+  | 1 => (xs.push 1, xs)
+  | _ => (xs, xs.push n)
+
+#guard pick true [1] [2] == [1, 2, 1]
+#guard pick false [1] [2] == [2, 1, 1]
+#guard sumPairs [(0, 1), (2, 3), (0, 4)] == 10
+#guard share #[0] 0 == (#[0], #[0])
+#guard share #[0] 1 == (#[0, 1], #[0])
+#guard share #[0] 5 == (#[0], #[0, 5])
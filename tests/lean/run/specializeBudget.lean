@@ -0,0 +1,20 @@
+/-!
+With a specialization budget, code that is no longer specialized still calls the generic functions,
+and it must compute the same results.
+-/
+
+set_option compiler.specialize.budget 1 in
+def sums (xs : List Nat) : Nat × Nat × List Nat :=
+  let a := xs.foldl (· + ·) 0
+  let b := xs.foldr (· * ·) 1
+  let c := xs.map (· + 1) |>.filter (· % 2 == 0)
+  (a, b, c)
+
+def sumsUnlimited (xs : List Nat) : Nat × Nat × List Nat :=
+  let a := xs.foldl (· + ·) 0
+  let b := xs.foldr (· * ·) 1
+  let c := xs.map (· + 1) |>.filter (· % 2 == 0)
+  (a, b, c)
+
+#guard sums [1, 2, 3, 4] == (10, 24, [2, 4])
+#guard sums [1, 2, 3, 4] == sumsUnlimited [1, 2, 3, 4]
@@ -0,0 +1,27 @@
+/-! Tests for the native implementations of `String.reserve`, `String.join` and `String.intercalate`. -/
+
+#guard ("abc".reserve 100) == "abc"
+#guard (("abc".reserve 100).push 'd' ++ "é") == "abcdé"
+#guard ("".reserve 0) == ""
+#guard ("abc".reserve (2^80)) == "abc"
+#guard (("a€".reserve 10).length) == 2
+
+#guard String.join [] == ""
+#guard String.join ["abc"] == "abc"
+#guard String.join ["a", "", "bc", "€"] == "abc€"
+#guard (String.join ["a", "€", "😀"]).length == 3
+
+#guard ", ".intercalate [] == ""
+#guard ", ".intercalate ["a"] == "a"
+#guard ", ".intercalate ["a", "b", "c"] == "a, b, c"
+#guard "".intercalate ["a", "b"] == "ab"
+#guard ("→".intercalate ["α", "", "β"]).length == 4
+#guard ("→".intercalate ["α", "", "β"]) == "α→→β"
+
+def build (n : Nat) : String := Id.run do
+  let mut s := "".reserve (2 * n)
+  for i in [0:n] do
+    s := s.push (if i % 2 == 0 then 'x' else 'y')
+  return s
+
+#guard (build 1000).length == 1000
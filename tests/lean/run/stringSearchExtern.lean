@@ -0,0 +1,44 @@
+/-! Tests for the native implementations of `String.posOfAux`, `String.replace` and `Lean.skipAsciiIdRest`. -/
+
+#guard "hello".posOf 'l' == ⟨2⟩
+#guard "hello".posOf 'z' == "hello".endPos
+#guard "".posOf 'a' == 0
+#guard "aé€😀b".posOf 'b' == ⟨10⟩
+#guard "aé€😀b".posOf '😀' == ⟨6⟩
+#guard "aé€😀b".posOf '€' == ⟨3⟩
+#guard "aé€😀b".revPosOf 'é' == some ⟨1⟩
+
+-- The character is found only if it starts before the stop position.
+#guard String.posOfAux "ab€" '€' ⟨3⟩ 0 == ⟨3⟩
+#guard String.posOfAux "ab€" '€' ⟨2⟩ 0 == ⟨2⟩
+#guard String.posOfAux "a€b" 'b' ⟨2⟩ 0 == ⟨4⟩
+#guard String.posOfAux "a€b" 'b' ⟨2⟩ ⟨2⟩ == ⟨2⟩
+-- Invalid positions
+#guard String.posOfAux "a€b" 'A' ⟨5⟩ ⟨2⟩ == ⟨2⟩
+#guard String.posOfAux "a€b" 'b' ⟨5⟩ ⟨2⟩ == ⟨4⟩
+#guard String.posOfAux "ab" 'A' ⟨10⟩ 0 == ⟨2⟩
+#guard String.posOfAux "ab" 'c' ⟨10⟩ 0 == ⟨10⟩
+
+#guard ("abc".toSubstring.drop 1).posOf 'c' == ⟨1⟩
+#guard ("abc".toSubstring.drop 1).posOf 'a' == ⟨2⟩
+
+#guard "hello world".replace "o" "0" == "hell0 w0rld"
+#guard "aaaa".replace "aa" "b" == "bb"
+#guard "aaa".replace "aa" "b" == "ba"
+#guard "abc".replace "" "x" == "abc"
+#guard "abc".replace "d" "x" == "abc"
+#guard "é€é".replace "é" "e" == "e€e"
+#guard ("é€é".replace "€" "😀").length == 3
+#guard "abab".replace "ab" "" == ""
+
+#guard Lean.skipAsciiIdRest "foo_bar'! baz" 0 == ⟨9⟩
+#guard Lean.skipAsciiIdRest "x₁" 0 == ⟨1⟩
+#guard Lean.skipAsciiIdRest "αβ" 0 == 0
+#guard Lean.skipAsciiIdRest "ab" ⟨2⟩ == ⟨2⟩
+#guard Lean.skipAsciiIdRest "ab" ⟨10⟩ == ⟨10⟩
+-- Invalid positions inside a character are skipped byte by byte
+#guard Lean.skipAsciiIdRest "€ab c" ⟨1⟩ == ⟨5⟩
+
+-- The parser's identifier and comment fast paths
+def x₁αb' := 1 -- comment with ∀ unicode
+#guard x₁αb' == 1
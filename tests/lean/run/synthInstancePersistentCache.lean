@@ -0,0 +1,22 @@
+import Lean
+open Lean Meta
+
+set_option synthInstance.persistentCache true
+
+def inst₁ : Inhabited Nat := inferInstance
+
+-- the solution is stored in the environment, and thus in the `.olean` file (not for `example`s, which do not keep
+-- their environment changes)
+#eval show MetaM Unit from do
+  guard <| (synthInstanceCacheExt.getState (← getEnv)).contains (mkApp (mkConst ``Inhabited [levelOne]) (mkConst ``Nat))
+
+-- a new instance for the same problem invalidates the stored solution
+instance (priority := high) myInst : Inhabited Nat := ⟨42⟩
+
+example : (default : Nat) = 42 := rfl
+
+-- problems with local instances are not stored
+def inst₂ [Inhabited Bool] : Inhabited Bool := inferInstance
+
+#eval show MetaM Unit from do
+  guard <| !(synthInstanceCacheExt.getState (← getEnv)).contains (mkApp (mkConst ``Inhabited [levelOne]) (mkConst ``Bool))
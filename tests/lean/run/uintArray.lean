@@ -0,0 +1,30 @@
+/-! Unboxed arrays of unsigned integers. -/
+
+def fill (n : Nat) : UInt64Array := Id.run do
+  let mut a := UInt64Array.mkEmpty n
+  for i in [0:n] do
+    a := a.push (i.toUInt64 * 0x100000001)
+  return a
+
+#guard (fill 1000).size == 1000
+#guard (fill 1000)[999]! == 999 * 0x100000001
+#guard (fill 10).foldl (· + ·) 0 == 45 * 0x100000001
+#guard ((fill 5).set! 2 7).toList == [0, 0x100000001, 7, 3 * 0x100000001, 4 * 0x100000001]
+#guard (fill 5).data.size == 5
+#guard (UInt64Array.mk #[1, 2, 3]).toList == [1, 2, 3]
+
+-- `set!` does not change other references to a shared array
+#guard
+  let a := [1, 2, 3].toUInt32Array
+  let b := a.set! 0 5
+  a.toList == [1, 2, 3] && b.toList == [5, 2, 3]
+
+#guard [65535, 0].toUInt16Array.toList == [65535, 0]
+#guard ([1, 2].toUInt16Array.push 3).toList == [1, 2, 3]
+#guard [USize.size.toUSize - 1].toUSizeArray[0]! == (USize.size - 1).toUSize
+#guard toString [1, 2].toUInt32Array == "[1, 2]"
+#guard (Id.run do
+  let mut s := 0
+  for x in [1, 2, 3].toUSizeArray do
+    s := s + x
+  return s) == 6